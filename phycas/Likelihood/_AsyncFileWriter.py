@@ -0,0 +1,72 @@
+from _LikelihoodExt import *
+
+class AsyncFileWriter(AsyncFileWriterBase):
+    #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+    """
+    A text output file written by a separate thread, so that calls to
+    write and flush return without waiting for the disk. Text passed to
+    write is collected into large blocks that are handed to the writer
+    thread; the file is brought up to date at least every flush_interval
+    seconds while output is being produced. Provides the write, flush,
+    tell, close and name members of a file object, so it can be used in
+    place of the files to which MCMC samples are written (see the
+    background_output option of the mcmc command).
+
+    """
+    def __init__(self, filename, append = True, flush_interval = 1.0):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Opens filename, adding to the end of it if append is True and
+        replacing it otherwise, and starts the writer thread. Raises
+        IOError if the file cannot be opened.
+
+        """
+        AsyncFileWriterBase.__init__(self)
+        self.name = filename
+        AsyncFileWriterBase.setFlushInterval(self, flush_interval)
+        AsyncFileWriterBase.open(self, filename, append)
+        if not AsyncFileWriterBase.isOpen(self):
+            raise IOError('could not open %s' % filename)
+
+    def write(self, s):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Adds the string s to the file. Raises IOError if the writer thread
+        has reported a failed write.
+
+        """
+        AsyncFileWriterBase.write(self, s)
+        if AsyncFileWriterBase.fail(self):
+            raise IOError('error writing %s' % self.name)
+
+    def flush(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Hands everything written so far to the writer thread without
+        waiting for it to reach the disk.
+
+        """
+        AsyncFileWriterBase.flush(self)
+
+    def tell(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Waits until everything written so far is in the file and returns
+        the length of the file.
+
+        """
+        AsyncFileWriterBase.sync(self)
+        if AsyncFileWriterBase.fail(self):
+            raise IOError('error writing %s' % self.name)
+        return long(AsyncFileWriterBase.tellp(self))
+
+    def close(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Waits for the writer thread to write everything and closes the
+        file. Raises IOError if any write failed.
+
+        """
+        AsyncFileWriterBase.close(self)
+        if AsyncFileWriterBase.fail(self):
+            raise IOError('error writing %s' % self.name)
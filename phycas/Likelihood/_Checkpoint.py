@@ -0,0 +1,134 @@
+from _LikelihoodExt import *
+
+class CheckpointWriter(CheckpointWriterBase):
+    #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+    """
+    Writes the binary checkpoint file used to restart an MCMC analysis.
+    Values are written to a temporary file that replaces the named file
+    only when close is called, so an interrupted write never destroys the
+    previous checkpoint. Values must be read back by a CheckpointReader
+    in the order in which they were written.
+    
+    """
+    def __init__(self, filename):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Opens a temporary file alongside filename and writes the checkpoint
+        header to it.
+        
+        """
+        CheckpointWriterBase.__init__(self, filename)
+        
+    def putUInt(self, x):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Writes the non-negative integer x.
+        
+        """
+        CheckpointWriterBase.putUInt(self, x)
+        
+    def putDouble(self, x):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Writes the float x exactly (no conversion to text is involved).
+        
+        """
+        CheckpointWriterBase.putDouble(self, x)
+        
+    def putBool(self, x):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Writes the boolean x.
+        
+        """
+        CheckpointWriterBase.putBool(self, x)
+        
+    def putString(self, s):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Writes the string s preceded by its length.
+        
+        """
+        CheckpointWriterBase.putString(self, s)
+        
+    def putDoubleVect(self, v):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Writes the list of floats v preceded by its length.
+        
+        """
+        CheckpointWriterBase.putDoubleVect(self, v)
+        
+    def close(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Closes the temporary file and renames it so that it replaces the
+        file named in the constructor.
+        
+        """
+        CheckpointWriterBase.close(self)
+
+class CheckpointReader(CheckpointReaderBase):
+    #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+    """
+    Reads a checkpoint file written by CheckpointWriter. The header is
+    checked when the file is opened, and an exception is raised if the
+    file was not written by Phycas, was written by an incompatible 
+    version, or was written on a machine with a different byte order.
+    
+    """
+    def __init__(self, filename):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Opens filename and checks its header.
+        
+        """
+        CheckpointReaderBase.__init__(self, filename)
+        
+    def getUInt(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Reads and returns a non-negative integer.
+        
+        """
+        return CheckpointReaderBase.getUInt(self)
+        
+    def getDouble(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Reads and returns a float.
+        
+        """
+        return CheckpointReaderBase.getDouble(self)
+        
+    def getBool(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Reads and returns a boolean.
+        
+        """
+        return CheckpointReaderBase.getBool(self)
+        
+    def getString(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Reads and returns a string.
+        
+        """
+        return CheckpointReaderBase.getString(self)
+        
+    def getDoubleVect(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Reads and returns a list of floats.
+        
+        """
+        return list(CheckpointReaderBase.getDoubleVect(self))
+        
+    def atEnd(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True if every value in the file has been read.
+        
+        """
+        return CheckpointReaderBase.atEnd(self)
@@ -120,3 +120,161 @@ class MCMCChainManager(MCMCChainManagerBase):
         """
         return MCMCChainManagerBase.getAllUpdaters(self)
 
+
+class MCMCCoupler(MCMCCouplerBase):
+    #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+    """
+    Runs the chains of a Metropolis-coupled MCMC analysis in C++. Each
+    call to advance updates every chain (chains are divided among
+    threads) and then attempts one swap between two randomly-chosen
+    chains. Chains are added in order of their position in the heating
+    ladder (cold chain first); that position is called the rank. When a
+    swap is accepted the two chains exchange powers and ranks, so the
+    power associated with each rank never changes.
+
+    Because chains are updated concurrently, each chain must have its own
+    Lot, and the Lot given to setLot must differ from all of them.
+    
+    """
+    def __init__(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Creates a coupler with no chains.
+        
+        """
+        MCMCCouplerBase.__init__(self)
+        
+    def addChain(self, chain_manager, power):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Adds the chain managed by chain_manager at the next rank and sets
+        the power of all of its updaters to power. The chain manager must
+        already have been finalized.
+        
+        """
+        MCMCCouplerBase.addChain(self, chain_manager, power)
+        
+    def setLot(self, lot):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Sets the Lot used to choose which chains to swap and to decide
+        whether each swap is accepted.
+        
+        """
+        MCMCCouplerBase.setLot(self, lot)
+        
+    def setNumThreads(self, nthreads):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Sets the number of threads among which chains are divided. At most
+        one thread per chain is used.
+        
+        """
+        MCMCCouplerBase.setNumThreads(self, nthreads)
+        
+    def getNumThreads(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of threads among which chains are divided.
+        
+        """
+        return MCMCCouplerBase.getNumThreads(self)
+        
+    def allowSwaps(self, allow):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        If allow is False, advance no longer attempts swaps, so the chains
+        run independently, each keeping the power it was added with (used
+        to explore several power posteriors at once in steppingstone
+        sampling). Swaps are allowed by default.
+        
+        """
+        MCMCCouplerBase.allowSwaps(self, allow)
+        
+    def isAllowingSwaps(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True if advance attempts a chain swap after each cycle.
+        
+        """
+        return MCMCCouplerBase.isAllowingSwaps(self)
+        
+    def getNumChains(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of chains added so far.
+        
+        """
+        return MCMCCouplerBase.getNumChains(self)
+        
+    def advance(self, ncycles = 1):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Performs ncycles cycles, each consisting of one update of every
+        chain followed by one attempted swap (if swaps are allowed).
+        
+        """
+        MCMCCouplerBase.advance(self, ncycles)
+        
+    def attemptSwap(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Attempts one swap between two randomly-chosen ranks, returning True
+        if the swap was accepted.
+        
+        """
+        return MCMCCouplerBase.attemptSwap(self)
+        
+    def getChainAtRank(self, rank):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the index (in the order chains were added) of the chain now
+        at the supplied rank.
+        
+        """
+        return MCMCCouplerBase.getChainAtRank(self, rank)
+        
+    def getPowerAtRank(self, rank):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the heating power associated with the supplied rank.
+        
+        """
+        return MCMCCouplerBase.getPowerAtRank(self, rank)
+        
+    def getNumSwapAttempts(self, i, j):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of swaps attempted between ranks i and j.
+        
+        """
+        return MCMCCouplerBase.getNumSwapAttempts(self, i, j)
+        
+    def getNumSwapsAccepted(self, i, j):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of swaps accepted between ranks i and j.
+        
+        """
+        return MCMCCouplerBase.getNumSwapsAccepted(self, i, j)
+        
+    def getSwapTable(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the swap table as a list of rows laid out like the
+        swap_table of MCMCManager: element [i][j] with i < j is the number
+        of swaps attempted between ranks i and j, and element [j][i] is the
+        number of those that were accepted.
+        
+        """
+        n = self.getNumChains()
+        flat = list(MCMCCouplerBase.getSwapTable(self))
+        return [flat[i*n:(i + 1)*n] for i in range(n)]
+        
+    def resetSwapTable(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Sets all elements of the swap table to zero.
+        
+        """
+        MCMCCouplerBase.resetSwapTable(self)
@@ -0,0 +1,191 @@
+from _LikelihoodExt import *
+
+class SiteLikeWriter(SiteLikeWriterBase):
+    #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+    """
+    Saves the pattern log-likelihoods of sampled states to a binary file
+    used to compute conditional predictive ordinates (see the cpofile
+    option of the sump command). The file header stores the mapping from
+    sites to patterns once, so each sample holds one value per pattern
+    rather than one per site. Samples are taken from the site likelihoods
+    stored by the most recent likelihood calculation, so no extra
+    likelihood calculation is needed. Provides the name, flush, tell and
+    close members of a file object so that it can be handled like the
+    other MCMC output files.
+
+    If filename is empty, samples are only held in memory until they are
+    passed to another SiteLikeWriter by transferTo.
+
+    """
+    def __init__(self, filename = ''):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Stores filename. The file is not created until setup is called.
+
+        """
+        SiteLikeWriterBase.__init__(self, filename)
+        self.name = filename
+
+    def setup(self, likelihood):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Creates the file, writing a header containing the site-to-pattern
+        map of the supplied TreeLikelihood object. Does nothing if the file
+        has already been created (or reopened).
+
+        """
+        if self.name and not SiteLikeWriterBase.isOpen(self):
+            SiteLikeWriterBase.create(self, likelihood.getCharIndexToPatternIndex(), likelihood.getNPatterns())
+
+    def reopen(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Opens an existing file so that further samples are added to the end
+        of it. The number of patterns is read from the file header.
+
+        """
+        SiteLikeWriterBase.reopen(self)
+
+    def addSample(self, cycle, likelihood):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Adds the pattern log-likelihoods stored by the last likelihood
+        calculation performed by the supplied TreeLikelihood object, which
+        must be storing site likelihoods (see storeSiteLikelihoods).
+
+        """
+        SiteLikeWriterBase.addSample(self, cycle, likelihood)
+
+    def transferTo(self, other):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Adds every sample held by this writer to the SiteLikeWriter other,
+        leaving this writer empty.
+
+        """
+        SiteLikeWriterBase.transferTo(self, other)
+
+    def flush(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Passes any samples not yet written to the background thread that
+        writes the file, without waiting for them to be written.
+
+        """
+        SiteLikeWriterBase.flush(self)
+
+    def tell(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Waits until every sample is in the file and returns the length of
+        the file in bytes.
+
+        """
+        return long(SiteLikeWriterBase.tell(self))
+
+    def close(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Writes any samples not yet written and closes the file.
+
+        """
+        SiteLikeWriterBase.close(self)
+
+    def setFlushInterval(self, seconds):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Blocks are written to the file by a separate thread. This sets the
+        minimum time between the occasions on which that thread flushes the
+        file (0.0 flushes after every block).
+
+        """
+        SiteLikeWriterBase.setFlushInterval(self, seconds)
+
+class SiteLikeReader(SiteLikeReaderBase):
+    #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+    """
+    Reads a file written by SiteLikeWriter. Because the file is stored by
+    pattern in blocks of samples, all samples of a single pattern can be
+    read without reading the rest of the file.
+
+    """
+    def __init__(self, filename):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Opens filename and reads its header.
+
+        """
+        SiteLikeReaderBase.__init__(self, filename)
+
+    def isSiteLikeFile(filename):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True if filename was written by a SiteLikeWriter (as opposed
+        to being a text file of site log-likelihoods).
+
+        """
+        return SiteLikeReaderBase.isSiteLikeFile(filename)
+
+    isSiteLikeFile = staticmethod(isSiteLikeFile)
+
+    def getNumSites(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of sites, including excluded sites.
+
+        """
+        return SiteLikeReaderBase.getNumSites(self)
+
+    def getNumPatterns(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of patterns stored for each sample.
+
+        """
+        return SiteLikeReaderBase.getNumPatterns(self)
+
+    def getNumSamples(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of samples in the file.
+
+        """
+        return SiteLikeReaderBase.getNumSamples(self)
+
+    def getCharToPattern(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list holding the index of the pattern for each site. The
+        value for an excluded site is greater than or equal to the number
+        of patterns.
+
+        """
+        return list(SiteLikeReaderBase.getCharToPattern(self))
+
+    def getCycles(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list of the cycles at which the samples were taken.
+
+        """
+        return list(SiteLikeReaderBase.getCycles(self))
+
+    def getPatternSamples(self, pattern):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list of all sampled log-likelihoods of the specified
+        pattern.
+
+        """
+        return list(SiteLikeReaderBase.getPatternSamples(self, pattern))
+
+    def calcSiteLogHarmonicMeans(self, burnin):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list holding, for each site, the log of the harmonic mean
+        of the sampled site likelihoods (i.e. the log of the conditional
+        predictive ordinate), ignoring the first burnin samples. The value
+        for an excluded site is 0.0.
+
+        """
+        return list(SiteLikeReaderBase.calcSiteLogHarmonicMeans(self, burnin))
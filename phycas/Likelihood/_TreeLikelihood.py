@@ -46,14 +46,17 @@ class TreeLikelihood(TreeLikelihoodBase):
     
     """
     
-    def __init__(self, model):
+    def __init__(self, model, pattern_blocked=False):
         """
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
         Initializes the TreeLikelihoodBase object, establishing the model to
-        be used.
+        be used. If pattern_blocked is True, conditional likelihood arrays
+        store site patterns in cache-sized blocks, each holding all rate
+        categories for its patterns, rather than one full run of patterns
+        per rate category. The layout cannot be changed afterwards.
         
         """
-        TreeLikelihoodBase.__init__(self, model)
+        TreeLikelihoodBase.__init__(self, model, pattern_blocked)
 
     def copyDataFromDiscreteMatrix(self, data_matrix, partition_info):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
@@ -117,6 +120,39 @@ class TreeLikelihood(TreeLikelihoodBase):
         """
         return TreeLikelihoodBase.calcLnL(self, tree)
 
+    def calcEdgeLenDerivatives(self, tree):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Computes the first and second derivatives of the log-likelihood
+        with respect to the length of every edge of the unrooted tree, using
+        two traversals of the tree, and returns the log-likelihood. Use
+        getEdgeLenFirstDerivs and getEdgeLenSecondDerivs to obtain the
+        derivatives, which are listed in preorder (the order of the edge
+        length parameters).
+        
+        """
+        return TreeLikelihoodBase.calcEdgeLenDerivatives(self, tree)
+
+    def getEdgeLenFirstDerivs(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list of the first derivatives of the log-likelihood with
+        respect to each edge length computed by the last call to
+        calcEdgeLenDerivatives (the gradient).
+        
+        """
+        return list(TreeLikelihoodBase.getEdgeLenFirstDerivs(self))
+
+    def getEdgeLenSecondDerivs(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list of the second derivatives of the log-likelihood with
+        respect to each edge length computed by the last call to
+        calcEdgeLenDerivatives (the diagonal of the Hessian).
+        
+        """
+        return list(TreeLikelihoodBase.getEdgeLenSecondDerivs(self))
+
     def calcLnLFromNode(self, nd):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
         """
@@ -362,6 +398,240 @@ class TreeLikelihood(TreeLikelihoodBase):
         """
         TreeLikelihoodBase.setUFNumEdges(self, nedges)
         
+    def usePowerOfTwoScaling(self, yes_or_no):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        If yes_or_no is True, conditional likelihoods are rescaled by powers
+        of 2 while they are computed, whenever the largest conditional
+        likelihood of a pattern becomes small enough to risk underflow. No
+        logarithms are needed and the arrays are not traversed a second
+        time, so this is usually faster than the default scheme (see
+        setUFNumEdges, which has no effect while this scheme is in use).
+        
+        """
+        TreeLikelihoodBase.usePowerOfTwoScaling(self, yes_or_no)
+        
+    def isUsingPowerOfTwoScaling(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True if conditional likelihoods are rescaled by powers of 2
+        while they are computed (see usePowerOfTwoScaling).
+        
+        """
+        return TreeLikelihoodBase.isUsingPowerOfTwoScaling(self)
+        
+    def getCLAKernelLevel(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the level of the loops used to compute conditional
+        likelihood arrays: 0 = scalar, 1 = SSE2, 2 = AVX2, 3 = AVX-512. By
+        default, the highest level supported by the processor is used.
+        
+        """
+        return TreeLikelihoodBase.getCLAKernelLevel(self)
+        
+    def setCLAKernelLevel(self, level):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Selects the level of the loops used to compute conditional
+        likelihood arrays (0 = scalar, 1 = SSE2, 2 = AVX2, 3 = AVX-512).
+        Levels higher than the processor supports are silently reduced to
+        the highest supported level. All levels should produce the same
+        log-likelihood to within rounding error; setting level 0 is useful
+        mainly for checking this.
+        
+        """
+        TreeLikelihoodBase.setCLAKernelLevel(self, level)
+        
+    def getCLAKernelName(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the name of the instruction set (e.g. 'AVX2') used by the
+        loops that compute conditional likelihood arrays.
+        
+        """
+        return TreeLikelihoodBase.getCLAKernelName(self)
+
+    def isUsingFloatCLAs(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True if conditional likelihood arrays are stored in single
+        precision (i.e. Phycas was compiled with PHYCAS_FLOAT_CLA defined).
+        Site likelihoods are accumulated in double precision either way.
+
+        """
+        return TreeLikelihoodBase.isUsingFloatCLAs(self)
+
+    def isPatternBlocked(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True if conditional likelihood arrays use the pattern-blocked
+        layout chosen when this object was constructed.
+
+        """
+        return TreeLikelihoodBase.isPatternBlocked(self)
+
+    def getNumThreads(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of threads among which site patterns are
+        divided when computing the likelihood (1 by default).
+
+        """
+        return TreeLikelihoodBase.getNumThreads(self)
+
+    def setNumThreads(self, nthreads):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Sets the number of threads among which site patterns are divided
+        when computing the likelihood. Patterns are split into blocks whose
+        size depends only on the number of states, so the log-likelihood
+        is the same whatever number of threads is used. Only worthwhile
+        for data sets with many thousands of patterns.
+
+        """
+        TreeLikelihoodBase.setNumThreads(self, nthreads)
+
+    def useLikelihoodEngine(self, name):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Selects the likelihood engine used by calcLnL: 'cpu' for the native
+        multithreaded engine or 'beagle' for the BEAGLE library. Engines
+        recompute the whole tree every time. If name is None or '' (the
+        default), conditional likelihood arrays stored in the tree are
+        used instead, so that only the part of the tree changed by a move
+        is recomputed.
+
+        """
+        TreeLikelihoodBase.useLikelihoodEngine(self, name or '')
+
+    def getLikelihoodEngineName(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the name of the likelihood engine used by calcLnL, or None
+        if conditional likelihood arrays stored in the tree are used.
+
+        """
+        return TreeLikelihoodBase.getLikelihoodEngineName(self) or None
+
+    def usePMatCache(self, yes_or_no):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        If yes_or_no is True (the default), transition matrices are only
+        recomputed when the model, or the edge length of the edge to which
+        they belong, has changed since they were last computed. Setting
+        this to False forces recomputation every time and is useful mainly
+        for checking that caching does not change the likelihood.
+
+        """
+        TreeLikelihoodBase.usePMatCache(self, yes_or_no)
+
+    def isUsingPMatCache(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True if transition matrices are being cached.
+
+        """
+        return TreeLikelihoodBase.isUsingPMatCache(self)
+
+    def getPMatCacheHits(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of times the transition matrices for one subset
+        of one edge were found to be up to date and were not recomputed.
+
+        """
+        return TreeLikelihoodBase.getPMatCacheHits(self)
+
+    def getPMatCacheMisses(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of times the transition matrices for one subset
+        of one edge had to be recomputed.
+
+        """
+        return TreeLikelihoodBase.getPMatCacheMisses(self)
+
+    def resetPMatCacheStats(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Sets the counts returned by getPMatCacheHits and getPMatCacheMisses
+        back to zero.
+
+        """
+        TreeLikelihoodBase.resetPMatCacheStats(self)
+
+    def isTimingHotPaths(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True unless Phycas was compiled with
+        PHYCAS_NO_HOT_PATH_TIMING defined, in which case the counts and
+        times returned by getHotPathStats are always zero.
+
+        """
+        return TreeLikelihoodBase.isTimingHotPaths(self)
+
+    def getHotPathStats(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a dictionary describing the work done in the innermost
+        likelihood calculations since this object was created or
+        resetHotPathStats was last called. Keys are:
+          cla_calcs         conditional likelihood arrays computed
+          cla_seconds       time spent computing them (including underflow
+                            correction, but not transition matrices)
+          pmat_calcs        times the transition matrices of one subset
+                            were computed for one edge
+          pmat_seconds      time spent computing transition matrices
+          uf_corrections    conditional likelihood arrays rescaled to
+                            prevent underflow (always 0 with power-of-two
+                            scaling, which rescales at every node)
+          uf_seconds        always 0 (rescaling is done by the kernels as
+                            each block of patterns is computed, so its time
+                            is included in cla_seconds)
+          cache_restores    cached conditional likelihood arrays restored
+                            after rejected proposals
+        Times are wall-clock seconds.
+
+        """
+        return {'cla_calcs':      TreeLikelihoodBase.getNumCLACalcs(self),
+                'cla_seconds':    TreeLikelihoodBase.getCLACalcSeconds(self),
+                'pmat_calcs':     TreeLikelihoodBase.getNumPMatCalcs(self),
+                'pmat_seconds':   TreeLikelihoodBase.getPMatCalcSeconds(self),
+                'uf_corrections': TreeLikelihoodBase.getNumUnderflowCorrections(self),
+                'uf_seconds':     TreeLikelihoodBase.getUnderflowCorrectionSeconds(self),
+                'cache_restores': TreeLikelihoodBase.getNumCacheRestores(self)}
+
+    def resetHotPathStats(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Sets all counts and times returned by getHotPathStats back to zero.
+
+        """
+        TreeLikelihoodBase.resetHotPathStats(self)
+
+    def useCLAArena(self, yes_or_no, huge_pages=False):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        If yes_or_no is True, conditional likelihood arrays created from
+        now on are allocated in batches, each batch occupying a single
+        block of memory aligned to a cache line boundary. This avoids one
+        heap allocation per array and, for large trees, reduces TLB misses.
+        If huge_pages is also True, blocks of 2 MB or more are backed by
+        huge pages where the operating system supports it.
+
+        """
+        TreeLikelihoodBase.useCLAArena(self, yes_or_no, huge_pages)
+
+    def isUsingCLAArena(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True if conditional likelihood arrays are being allocated
+        in batches from aligned blocks of memory.
+
+        """
+        return TreeLikelihoodBase.isUsingCLAArena(self)
+
     def startTreeViewer(self, t, s, i):
         import phycas.TreeViewer
         tv = phycas.TreeViewer.TreeViewer(tree=t, msg=s, site=i)
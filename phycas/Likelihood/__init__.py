@@ -6,6 +6,9 @@ from _LikelihoodExt import *
 from _TreeLikelihood import *
 from _Model import *
 from _MCMCChainManager import *
+from _Checkpoint import *
+from _SiteLikeFile import *
+from _AsyncFileWriter import *
 from _SimData import *
 from _TopoPriorCalculator import *
 from _QMatrix import *
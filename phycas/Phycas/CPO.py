@@ -5,11 +5,11 @@ from phycas import mcmc
 
 class CPO(PhycasCommand):
     def __init__(self):
-        args = (("patterns_only", False, "If True, each row of the sitelike output file will contain sampled log-likelihoods for each pattern, with the first row of the file holding the counts for each pattern. If False, the rows of the sitelike file will contain the log-likelihoods for each site in the order in which the sites occur in the data file (generally produces a larger file).", BoolArgValidate),)
+        args = (("patterns_only", False, "Currently ignored: the sitelike output file always holds one sampled log-likelihood per pattern, along with a map from sites to patterns that the sump command uses to compute the conditional predictive ordinate of every site.", BoolArgValidate),)
         # Specify output options
         o = PhycasCommandOutputOptions()
         o.__dict__["_help_order"] = ["sitelike"]
-        p = TextOutputSpec(prefix='sitelike', suffix=".txt", help_str="The text file in which all sampled site log-likelihood values are saved.")
+        p = SiteLikeOutputSpec(prefix='sitelike', suffix=".bin", help_str="The binary file in which the sampled site log-likelihood values are saved (use the cpofile option of the sump command to summarize it).")
         o.__dict__["sitelike"] = p
         PhycasCommand.__init__(self, args, "cpo", "Performs a Conditional Predictive Ordinate (CPO) analysis to determine the relative fit of the model to individual sites/characters.", o)
 
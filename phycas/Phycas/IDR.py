@@ -22,6 +22,12 @@ class IDR(PhycasCommand):
         # data members hidden from users
         self.__dict__["use_unimap"]                     = False
         self.__dict__["uf_num_edges"]                   = 50
+        self.__dict__["uf_power_of_two"]                = False
+        self.__dict__["num_threads"]                    = 1
+        self.__dict__["cla_arena"]                      = False
+        self.__dict__["pmat_cache"]                     = True
+        self.__dict__["cla_pattern_blocked"]            = False
+        self.__dict__["likelihood_engine"]              = None
         self.__dict__["fix_topology"]                   = False
         self.__dict__["slice_max_units"]                = 1000
         self.__dict__["slice_weight"]                   = 1
@@ -33,6 +39,7 @@ class IDR(PhycasCommand):
         self.__dict__["rel_rate_psi"]                   = 300.0
         self.__dict__["rel_rate_psi0"]                  = 1.0
         self.__dict__["tree_scaler_weight"]             = 0.0
+        self.__dict__["edgelen_hmc_weight"]             = 0
         self.__dict__["ls_move_weight"]                 = 100
         self.__dict__["ls_move_lambda"]                 = 0.2
         self.__dict__["ls_move_lambda0"]                = 1.0
@@ -26,6 +26,12 @@ class JPG(PhycasCommand):
         # The roundabout way of introducing these data members is necessary because PhycasCommand.__setattr__ tries
         # to prevent users from adding new data members (to prevent accidental misspellings from causing problems)
         self.__dict__["uf_num_edges"] = 50      # necessary because LikelihoodCore looks for this variable
+        self.__dict__["uf_power_of_two"] = False  # ditto
+        self.__dict__["num_threads"] = 1        # necessary because LikelihoodCore looks for this variable
+        self.__dict__["cla_arena"] = False      # necessary because LikelihoodCore looks for this variable
+        self.__dict__["pmat_cache"] = True      # necessary because LikelihoodCore looks for this variable
+        self.__dict__["cla_pattern_blocked"] = False  # necessary because LikelihoodCore looks for this variable
+        self.__dict__["likelihood_engine"] = None   # necessary because LikelihoodCore looks for this variable
         self.__dict__["use_unimap"] = False     # necessary because LikelihoodCore looks for this variable
         
         #self.__dict__["sitelikef"] = None
@@ -14,6 +14,12 @@ class Like(PhycasCommand):
                 ("starting_edgelen_dist",   Exponential(10.0),          "Used to select the starting edge lengths when tree_source is 'random'"),
                 ("store_site_likes",         False,                      "If True, site log-likelihoods will be stored and can be retrieved using the getSiteLikes() function"),
                 ("uf_num_edges",              50,    "Number of edges to traverse before taking action to prevent underflow", IntArgValidate(min=1)),
+                ("uf_power_of_two",        False,    "If True, conditional likelihoods are rescaled by powers of 2 while they are computed, whenever they become small enough to risk underflow (uf_num_edges is then ignored). This avoids computing logarithms and exponentials", BoolArgValidate),
+                ("num_threads",                1,    "Number of threads among which site patterns are divided when computing the likelihood (the log-likelihood does not depend on this setting)", IntArgValidate(min=1)),
+                ("cla_arena",              False,    "If True, conditional likelihood arrays are allocated together in large aligned blocks of memory rather than one at a time, which can speed up analyses of large trees", BoolArgValidate),
+                ("pmat_cache",              True,    "If True, the transition probability matrices of an edge are recomputed only if its length or the model has changed since they were last computed. Setting this to False (which never changes the log-likelihood) is mainly useful for checking that caching works", BoolArgValidate),
+                ("cla_pattern_blocked",    False,    "If True, conditional likelihood arrays store site patterns in cache-sized blocks holding all rate categories, which can speed up analyses of long alignments with several rate categories", BoolArgValidate),
+                ("likelihood_engine",       None,    "If None, the likelihood is computed from conditional likelihood arrays stored in the tree, so that moves recompute only the part of the tree they change. If 'cpu' or 'beagle', the whole tree is recomputed every time by a separate likelihood engine: 'cpu' is the native multithreaded engine (see num_threads) and 'beagle' uses the BEAGLE library, and hence a GPU if one is available", EnumArgValidate([None, 'cpu', 'beagle'])),
                 ]
                 )
         PhycasCommand.__init__(self, args, "like", "Calculates the log-likelihood under the current model.")
@@ -211,9 +211,15 @@ class LikelihoodCore(object):
             self.parent.phycassert(num_subset_relrates == num_subsets, 'Length of partition.subset_relrates list (%d) should equal the number of subsets defined (%d)' % (num_subset_relrates, num_subsets))
             self.partition_model.setSubsetRelRatesVect(partition.subset_relrates)
         
-        self.likelihood = Likelihood.TreeLikelihood(self.partition_model)
+        self.likelihood = Likelihood.TreeLikelihood(self.partition_model, self.parent.opts.cla_pattern_blocked)
         self.likelihood.setLot(self.r)
         self.likelihood.setUFNumEdges(self.parent.opts.uf_num_edges)
+        self.likelihood.usePowerOfTwoScaling(self.parent.opts.uf_power_of_two)
+        self.likelihood.setNumThreads(self.parent.opts.num_threads)
+        self.likelihood.useCLAArena(self.parent.opts.cla_arena)
+        self.likelihood.usePMatCache(self.parent.opts.pmat_cache)
+        if self.parent.opts.likelihood_engine is not None:
+            self.likelihood.useLikelihoodEngine(self.parent.opts.likelihood_engine)
         self.likelihood.useUnimap(self.parent.opts.use_unimap)
         if self.parent.data_matrix:
             #print '~!~!~!~!~! calling copyDataFromDiscreteMatrix !~!~!~!~!~' # temporary
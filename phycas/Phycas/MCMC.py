@@ -41,6 +41,10 @@ class MCMC(PhycasCommand):
                 ("tree_scaler_lambda",       0.5,    "Sets the minimum value of the tuning parameter for the TreeScalerMove Metropolis-Hastings move. This value corresponds to a boldness vlaue of 0.0 and is the value used for normal analyses.", FloatArgValidate(min=0.01)),
                 ("tree_scaler_lambda0",      1.0,    "Sets the maximum value of the tuning parameter for the TreeScalerMove Metropolis-Hastings move. This value corresponds to a boldness value of 100.0 and is only used during path sampling analyses.", FloatArgValidate(min=0.01)),
                 ("tree_scaler_weight",         0,    "Whole-tree scaling will be performed this many times per cycle", IntArgValidate(min=0)),
+                ("edgelen_hmc_weight",         0,    "Joint Hamiltonian Monte Carlo updates of all edge lengths will be performed this many times per cycle", IntArgValidate(min=0)),
+                ("edgelen_hmc_stepsize",    0.05,    "Sets the initial leapfrog step size (on the log edge length scale) for the EdgeLenHMCMove. The step size is adapted during burn-in. This value corresponds to a boldness value of 0.0 and is the value used for normal analyses.", FloatArgValidate(min=0.0001)),
+                ("edgelen_hmc_stepsize0",    0.5,    "Sets the leapfrog step size for the EdgeLenHMCMove corresponding to a boldness value of 100.0, which is only used during path sampling analyses. If the step size was adapted during burn-in, the adapted step size is scaled by edgelen_hmc_stepsize0/edgelen_hmc_stepsize instead.", FloatArgValidate(min=0.0001)),
+                ("edgelen_hmc_nsteps",        10,    "Sets the number of leapfrog steps (each requiring one calculation of the gradient of the log-likelihood) in each trajectory proposed by the EdgeLenHMCMove", IntArgValidate(min=1)),
                 ("allow_polytomies",       False,    "If True, do Bush moves in addition to Larget-Simon moves; if False, do Larget-Simon moves only", BoolArgValidate),
                 ("polytomy_prior",          True,    "If True, use polytomy prior; if False, use resolution class prior", BoolArgValidate),
                 ("topo_prior_C",             2.0,    "Specifies the strength of the prior (C = 1 is flat prior; C > 1 favors less resolved topologies)", FloatArgValidate(min=0.01)),
@@ -51,25 +55,43 @@ class MCMC(PhycasCommand):
                 ("slice_max_units",         1000,    "Max. number of units used in slice sampling", IntArgValidate(min=0)),
                 ("adapt_first",              100,    "Adaptation of slice samplers is performed the first time at cycle adapt_first. Subsequent adaptations wait twice the number of cycles as the previous adaptation. Thus, adaptation n occurs at cycle adapt_first*(2**(n - 1)). The total number of adaptations that will occur during an MCMC run is [ln(adapt_first + ncycles) - ln(adapt_first)]/ln(2)", IntArgValidate(min=0)),
                 ("adapt_simple_param",       0.5,    "Slice sampler adaptation parameter", FloatArgValidate(min=0.01)),
+                ("adapt_weights",          False,    "If True, the weights of Metropolis-Hastings moves (e.g. the Larget-Simon and Bush moves) are revised each time slice samplers are adapted during burn-in, so that moves getting more proposals accepted per second of computing time are attempted more often and moves that are expensive or seldom accepted less often. Weights are not changed after burn-in", BoolArgValidate),
+                ("adapt_weights_max_factor", 4.0,    "If adapt_weights is True, no move's weight is made more than adapt_weights_max_factor times larger or smaller than the weight originally specified for it", FloatArgValidate(min=1.0)),
                 ("min_heat_power",           0.5,    "Power of the hottest chain when nchains > 1", FloatArgValidate(min=0.01)),
                 ("heat_vector",             None,    "List of heating powers, one of which should be 1.0 (default value None causes this vector to be generated using min_heat_pwer)"),
                 ("uf_num_edges",              50,    "Number of edges to traverse before taking action to prevent underflow", IntArgValidate(min=1)),
+                ("uf_power_of_two",        False,    "If True, conditional likelihoods are rescaled by powers of 2 while they are computed, whenever they become small enough to risk underflow (uf_num_edges is then ignored). This avoids computing logarithms and exponentials", BoolArgValidate),
+                ("num_threads",                1,    "Number of threads among which site patterns are divided when computing the likelihood (the log-likelihood does not depend on this setting)", IntArgValidate(min=1)),
+                ("cla_arena",              False,    "If True, conditional likelihood arrays are allocated together in large aligned blocks of memory rather than one at a time, which can speed up analyses of large trees", BoolArgValidate),
+                ("pmat_cache",              True,    "If True, the transition probability matrices of an edge are recomputed only if its length or the model has changed since they were last computed. Setting this to False (which never changes the log-likelihood) is mainly useful for checking that caching works", BoolArgValidate),
+                ("cla_pattern_blocked",    False,    "If True, conditional likelihood arrays store site patterns in cache-sized blocks holding all rate categories, which can speed up analyses of long alignments with several rate categories", BoolArgValidate),
+                ("likelihood_engine",       None,    "If None, the likelihood is computed from conditional likelihood arrays stored in the tree, so that moves recompute only the part of the tree they change. If 'cpu' or 'beagle', the whole tree is recomputed every time by a separate likelihood engine: 'cpu' is the native multithreaded engine (see num_threads) and 'beagle' uses the BEAGLE library, and hence a GPU if one is available", EnumArgValidate([None, 'cpu', 'beagle'])),
+                ("chain_threads",              1,    "Number of threads among which chains are divided when nchains > 1. If greater than 1, chains are updated concurrently and chain swaps are performed in C++; each chain then draws from its own stream of random numbers, so results differ from a run using one thread even if the same random_seed is used (streams are guaranteed not to overlap if the Lot supplied as rng uses the xoshiro256** engine; see Lot.useXoshiro)", IntArgValidate(min=1)),
                 ("ntax",                       0,    "To explore the prior, set to some positive value. Also set data_source to None", IntArgValidate(min=0)),
                 ("ndecimals",                  8,    "Number of decimal places used for sampled parameter values", IntArgValidate(min=1)),
+                ("binary_trees",           False,    "If True, sampled trees are saved to the compact binary file named by mcmc.out.treesamples rather than as NEXUS tree descriptions in mcmc.out.trees. The sumt command reads either kind of file; use the exportNexus method of Phylogeny.TreeSampleReader to convert a binary file to a NEXUS tree file", BoolArgValidate),
+                ("background_output",       True,    "If True, the parameter, tree and site log-likelihood files are written by separate threads, so that sampling never waits for the disk (which can take milliseconds per sample on a networked file system). Samples reach the files within about flush_interval seconds, and the files are complete when mcmc finishes", BoolArgValidate),
+                ("flush_interval",           1.0,    "Longest time (in seconds) that sampled values are held in memory before being written to the parameter, tree and site log-likelihood files when background_output is True. Use 0.0 to write every sample as soon as possible", FloatArgValidate(min=0.0)),
+                ("report_costs",           False,    "If True, a table is printed at the end of the run showing, for each updater of the cold chain, the number of updates, the time they took and the number of likelihood evaluations they needed, along with counts and times for the innermost likelihood calculations. Useful for judging whether an updater is worth its weight", BoolArgValidate),
                 ("save_sitelikes",         False,    "Saves file of site log-likelihoods (name determined by mcmc.out.sitelikes) that sump command can use in computing conditional predictive ordinates", BoolArgValidate),
-                ("use_beaglelib",          False,    "Use GPU if available.", BoolArgValidate),
+                ("use_beaglelib",          False,    "If True, equivalent to setting likelihood_engine to 'beagle' (uses a GPU if available).", BoolArgValidate),
+                ("checkpoint_every",           0,    "If greater than 0, the complete state of the analysis is saved to checkpoint_file every checkpoint_every cycles so that it can later be resumed by setting restart to True", IntArgValidate(min=0)),
+                ("checkpoint_file",   "mcmc.ckp",    "Name of the binary file to which checkpoints are saved (see checkpoint_every) and from which they are read when restart is True"),
+                ("restart",                False,    "If True, the analysis resumes from the state saved in checkpoint_file rather than starting over. All other settings (including the data, model and random_seed) must be the same as in the run that saved the checkpoint. Output files are truncated to the point reached when the checkpoint was saved and appended to from there, and the results are identical to those of an uninterrupted run", BoolArgValidate),
                 ])
 
         # Specify output options
         o = PhycasCommandOutputOptions()
-        o.__dict__["_help_order"] = ["log", "trees", "params", "sitelikes"]
+        o.__dict__["_help_order"] = ["log", "trees", "treesamples", "params", "sitelikes"]
         logf_spec = TextOutputSpec(prefix='mcmcoutput', help_str="The file specified by this setting saves the console output generated by mcmc(). If set to None, console output will not be saved to a file.")
         o.__dict__["log"] = logf_spec
         t = TextOutputSpec(prefix='trees', suffix=".t", help_str="The nexus tree file in which all sampled tree topologies are saved. This file is equivalent to the MrBayes *.t file.")
         o.__dict__["trees"] = t
+        t = TreeSampleOutputSpec(prefix='trees', suffix=".tsf", help_str="The binary file in which all sampled trees are saved if binary_trees is True. The sumt command can summarize this file directly.")
+        o.__dict__["treesamples"] = t
         p = TextOutputSpec(prefix='params', suffix=".p", help_str="The text file in which all sampled parameter values are saved. This file is equivalent to the MrBayes *.p file.")
         o.__dict__["params"] = p
-        p = TextOutputSpec(prefix='sitelikes', suffix=".txt", help_str="The text file in which all sampled site log-likelihood values are saved.")
+        p = SiteLikeOutputSpec(prefix='sitelikes', suffix=".bin", help_str="The binary file in which the sampled site log-likelihood values are saved (use the cpofile option of the sump command to summarize it).")
         o.__dict__["sitelikes"] = p
         PhycasCommand.__init__(self, args, "mcmc", "The mcmc command is used to conduct a Bayesian Markov chain Monte Carlo analysis.", o)
 
@@ -125,7 +147,8 @@ class MCMC(PhycasCommand):
         c = copy.deepcopy(self)
         mcmc_impl = MCMCImpl(c)
         
-        if self.save_sitelikes:
+        if self.save_sitelikes and not self.restart:
+            # When restarting, MCMCImpl reopens the site log-likelihood file named in the checkpoint
             mcmc_impl.siteLikeFileOpen()
             if mcmc_impl.sitelikef:
                 self.saving_sitelikes = True
@@ -137,6 +160,9 @@ class MCMC(PhycasCommand):
         
         mcmc_impl.run()
         
+        if self.restart:
+            self.saving_sitelikes = (mcmc_impl.sitelikef is not None)
+        
         self.ss_sampled_betas = mcmc_impl.ss_sampled_betas
         self.ss_sampled_likes = mcmc_impl.ss_sampled_likes
         
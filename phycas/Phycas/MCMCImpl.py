@@ -3,6 +3,8 @@ from phycas import *
 from phycas.Utilities.PhycasCommand import *
 from phycas.Utilities.CommonFunctions import CommonFunctions
 from MCMCManager import MCMCManager
+from MarkovChain import MarkovChain
+import phycas.Likelihood as Likelihood
 from phycas.ProbDist import StopWatch
 from phycas.ReadNexus import NexusReader
 from phycas.Likelihood import BeagleLibBase 
@@ -73,7 +75,9 @@ class MCMCImpl(CommonFunctions):
         self.ss_beta_index          = 0
         self.ss_sampled_betas       = None
         self.ss_sampled_likes       = None
-        self.siteIndicesForPatternIndex = None
+        self.concurrent_evals       = 0         # likelihood evaluations by chains created to explore power posteriors concurrently
+        self.checkpoint_reader      = None      # CheckpointReader positioned just past the loop position (only used when restarting)
+        self.restart_cycle          = 0         # cycle at which the restarted beta value (or ordinary run) resumes
         
     def setSiteLikeFile(self, sitelikef):
         if sitelikef is not None:
@@ -81,29 +85,19 @@ class MCMCImpl(CommonFunctions):
             
     def siteLikeFileSetup(self, coldchain):
         if self.sitelikef is not None:
-            # Set up the siteIndicesForPatternIndex, which holds a list of sites for each pattern index
-            # This allows us to spit out site likelihoods for each site, even though site likelihoods
-            # are stored for patterns, many of which represent numerous sites
+            # The header of the site log-likelihood file holds the site-to-pattern map, so only
+            # pattern log-likelihoods need to be saved for each sample. Every chain stores its
+            # pattern log-likelihoods because the cold chain changes when chains are swapped.
             v = coldchain.likelihood.getCharIndexToPatternIndex()
-            nexcluded = 0
             self.phycassert(len(v) == self.nchar,'Number of sites returned by coldchain.likelihood.getCharIndexToPatternIndex (%d) differs from MCMCImpl.nchar (%d) in MCMCImpl.siteLikeFileSetup()' % (len(v), self.nchar))
-            npatterns = coldchain.likelihood.getNPatterns()
-            #raw_input('POLPOL: len(v) = %d, self.nchar = %d, npatterns = %d' % (len(v), self.nchar, npatterns))
-            self.siteIndicesForPatternIndex = []
-            for i in range(npatterns):
-                self.siteIndicesForPatternIndex.append([])
-            for i,p in enumerate(v):
-                if p < npatterns:
-                    self.siteIndicesForPatternIndex[p].append(i)
-                else:
-                    nexcluded += 1;
-        #raw_input('POLPOL: leaving MCMCImpl.siteLikeFileSetup(): nexcluded = %d' % nexcluded)
+            self.sitelikef.setup(coldchain.likelihood)
+            for c in self.mcmc_manager.chains:
+                c.likelihood.storeSiteLikelihoods(True)
 
     def unsetSiteLikeFile(self):
         self.sitelikef = None
-        self.siteIndicesForPatternIndex = None
 
-    def adaptSliceSamplers(self):
+    def adaptSliceSamplers(self, chain_manager = None, label = ''):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
         """
         Cycles through all slice samplers and adapts each one. Adaptation of
@@ -114,12 +108,16 @@ class MCMCImpl(CommonFunctions):
         too many failed sampling attempts are needed before a valid sample
         can be obtained. Adaptation adjusts the slice unit width of each
         slice sampler in an attempt to bring it closer to the optimum width
-        using experience from past sampling attempts.
+        using experience from past sampling attempts. The updaters of the
+        cold chain are adapted unless chain_manager is supplied; label is
+        appended to the heading of the diagnostics output.
         
         """
         summary = ''
         # need to adapt all chains, not just the cold one!
-        cold_chain_manager = self.mcmc_manager.getColdChainManager()
+        cold_chain_manager = chain_manager
+        if cold_chain_manager is None:
+            cold_chain_manager = self.mcmc_manager.getColdChainManager()
         for p in cold_chain_manager.getAllUpdaters():
             p_summary = ''
             nm = p.getName()
@@ -146,9 +144,105 @@ class MCMCImpl(CommonFunctions):
             summary += p_summary
         
         if self.opts.verbose and summary != '':
-            self.output('\nUpdater diagnostics (* = slice sampler):')
+            self.output('\nUpdater diagnostics%s (* = slice sampler):' % label)
             self.output(summary)
             
+    def adaptUpdaterWeights(self, chain_manager = None, label = ''):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Revises the weights of the Metropolis-Hastings moves so that moves
+        getting more proposals accepted per second of computing time are
+        attempted more often (see MCMCChainManager::adaptWeights). Must be
+        called before adaptSliceSamplers, which resets the acceptance counts
+        used. The moves of every chain are re-weighted unless chain_manager
+        is supplied; label is appended to the heading of the allocation
+        report, which lists each move's new weight, the weight originally
+        specified for it, its acceptance rate and its cost per update (the
+        report is given only for the cold chain unless chain_manager is
+        supplied).
+        
+        """
+        if chain_manager is None:
+            managers = [c.chain_manager for c in self.mcmc_manager.chains]
+        else:
+            managers = [chain_manager]
+        for cm in managers:
+            rows = []
+            for p in cm.getAllUpdaters():
+                if p.isMove() and not p.hasSliceSampler() and p.getNumAttempts() > 0 and p.getNumTimedUpdates() > 0:
+                    accept_pct = 100.0*float(p.getNumAccepts())/float(p.getNumAttempts())
+                    ms_per_update = 1000.0*p.getTimedUpdateSeconds()/p.getNumTimedUpdates()
+                    rows.append((p, accept_pct, ms_per_update))
+            report = self.opts.verbose and (chain_manager is not None or cm is self.mcmc_manager.getColdChainManager())
+            if cm.adaptWeights(self.opts.adapt_weights_max_factor) > 0 and report:
+                self.output('\nMove weights%s:' % label)
+                self.output('%8s %8s %10s %12s  %s' % ('weight', 'initial', '% accept', 'ms/update', 'move'))
+                for p, accept_pct, ms_per_update in rows:
+                    self.output('%8d %8d %10.1f %12.5f  %s' % (p.getWeight(), p.getBaseWeight(), accept_pct, ms_per_update, p.getName()))
+
+    def setHMCAdaptation(self, adapting, chains = None):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Starts (if adapting is True) or stops adapting the step size of the
+        EdgeLenHMCMove of every chain, or of just the chains in the list
+        chains if it is supplied. Called when burn-in begins and ends, so
+        that the step size is fixed while samples are being taken.
+        
+        """
+        if chains is None:
+            chains = self.mcmc_manager.chains
+        for c in chains:
+            if c.edgelen_hmc_move is not None:
+                c.edgelen_hmc_move.setAdapting(adapting)
+
+    def resetUpdaterCosts(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Sets the update counts, times and likelihood evaluation counts kept
+        by every updater of every chain, and the hot-path counts kept by
+        each chain's likelihood object, back to zero.
+        
+        """
+        for c in self.mcmc_manager.chains:
+            for p in c.chain_manager.getAllUpdaters():
+                p.resetTimedUpdateStats()
+            c.likelihood.resetHotPathStats()
+
+    def reportUpdaterCosts(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Outputs, for each updater of the cold chain that was updated, the
+        number of updates, the time they took (in total, per update and as
+        a percentage of the time taken by all updaters), the number of
+        likelihood evaluations they needed and its weight at the end of the
+        run (which differs from the weight specified if adapt_weights is
+        True), followed by the counts and times
+        kept by the cold chain's likelihood object for the innermost 
+        likelihood calculations (see TreeLikelihood.getHotPathStats).
+        
+        """
+        cold_chain = self.mcmc_manager.getColdChain()
+        if not cold_chain.likelihood.isTimingHotPaths():
+            self.output('\nUpdater costs are unavailable (Phycas was compiled with PHYCAS_NO_HOT_PATH_TIMING defined)')
+            return
+        rows = []
+        for p in cold_chain.chain_manager.getAllUpdaters():
+            n = p.getNumTimedUpdates()
+            if n > 0:
+                rows.append((p.getName(), n, p.getTimedUpdateSeconds(), p.getTimedUpdateLikelihoodEvals(), p.getWeight()))
+        total_secs = sum([r[2] for r in rows])
+        self.output('\nUpdater costs (cold chain):')
+        self.output('%12s %12s %12s %8s %12s %12s %8s  %s' % ('updates', 'seconds', 'ms/update', '% time', 'lnL evals', 'evals/update', 'weight', 'updater'))
+        for nm, n, secs, evals, w in rows:
+            pct = total_secs > 0.0 and 100.0*secs/total_secs or 0.0
+            self.output('%12d %12.3f %12.5f %8.1f %12d %12.2f %8d  %s' % (n, secs, 1000.0*secs/n, pct, evals, evals/n, w, nm))
+        h = cold_chain.likelihood.getHotPathStats()
+        self.output('\nLikelihood calculations (cold chain):')
+        self.output('  %d conditional likelihood arrays computed in %.3f seconds' % (h['cla_calcs'], h['cla_seconds']))
+        self.output('  %d transition matrix sets computed in %.3f seconds' % (h['pmat_calcs'], h['pmat_seconds']))
+        self.output('  %d conditional likelihood arrays rescaled to prevent underflow' % h['uf_corrections'])
+        self.output('  %d cached conditional likelihood arrays restored' % h['cache_restores'])
+            
     def obsoleteUpdateAllUpdaters(self, chain, chain_index, cycle):
         # This function abandoned; functionality moved to C++ side 
         # for speed reasons: see MCMCChainManager::updateAllUpdaters
@@ -219,6 +313,32 @@ class MCMCImpl(CommonFunctions):
             self.output('  Prior log-density:  %s' % p.getLnPrior())
             self.output()
                 
+    def openTextOutputFile(self, file_spec):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Opens the text file described by file_spec, returning an
+        AsyncFileWriter (which writes in a separate thread) if
+        opts.background_output is True and an ordinary file object
+        otherwise.
+        
+        """
+        if self.opts.background_output:
+            return file_spec.openInBackground(self.stdout, self.opts.flush_interval)
+        return file_spec.open(self.stdout)
+
+    def binaryFlushInterval(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the flush interval given to the writers of the binary output
+        files, which always write in a separate thread: opts.flush_interval
+        if opts.background_output is True, and 0.0 (flush every batch of
+        samples, as with the text files in this case) otherwise.
+        
+        """
+        if self.opts.background_output:
+            return self.opts.flush_interval
+        return 0.0
+
     def siteLikeFileOpen(self):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
         """
@@ -229,12 +349,11 @@ class MCMCImpl(CommonFunctions):
         sitelnl_file_spec = self.opts.out.sitelikes
         try:
             self.sitelikef = sitelnl_file_spec.open(self.stdout)
-            raw_input('%s.sitelikef was opened successfully' % self.__class__.__name__)
         except:
-            print '*** Attempt to open site log-likelihood file (%s) failed.' % self.opts.out.sitelike.filename
-            #raw_input('siteLikeFileOpen failed')
+            print '*** Attempt to open site log-likelihood file (%s) failed.' % self.opts.out.sitelikes.filename
 
         if self.sitelikef:
+            self.sitelikef.setFlushInterval(self.binaryFlushInterval())
             print 'Site log-likelihood file was opened successfully'
             #mcmc.sitelikef = self.sitelikef
 
@@ -251,21 +370,35 @@ class MCMCImpl(CommonFunctions):
     def treeFileOpen(self):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
         """
-        Opens the tree file and writes a translate table.
+        Opens the tree file and writes a translate table. If opts.binary_trees
+        is True, the binary tree sample file specified by opts.out.treesamples
+        is opened instead, and its header (which holds the taxon labels) is
+        written.
         
         """
-        tree_file_spec = self.opts.out.trees
+        if self.opts.binary_trees:
+            tree_file_spec = self.opts.out.treesamples
+        else:
+            tree_file_spec = self.opts.out.trees
         self.treef = None
         try:
-            self.treef = tree_file_spec.open(self.stdout)
+            if self.opts.binary_trees:
+                self.treef = tree_file_spec.open(self.stdout)
+            else:
+                self.treef = self.openTextOutputFile(tree_file_spec)
         except:
-            print '*** Attempt to open tree file (%s) failed.' % self.opts.out.trees.filename
+            print '*** Attempt to open tree file (%s) failed.' % tree_file_spec.filename
 
         if self.treef:
-            self.mcmc_manager.treeFileHeader(self.treef)
+            if self.opts.binary_trees:
+                self.treef.setFlushInterval(self.binaryFlushInterval())
+                self.treef.create(self.taxon_labels, self.mcmc_manager.getColdChain().tree.isRooted())
+            else:
+                self.mcmc_manager.treeFileHeader(self.treef)
 
     def treeFileClose(self):
-        self.treef.write('end;\n')
+        if not self.opts.binary_trees:
+            self.treef.write('end;\n')
         self.treef.close()
 
     def paramFileOpen(self):
@@ -277,7 +410,7 @@ class MCMCImpl(CommonFunctions):
         param_file_spec = self.opts.out.params
         self.paramf = None
         try:
-            self.paramf = param_file_spec.open(self.stdout)
+            self.paramf = self.openTextOutputFile(param_file_spec)
         except:
             print '*** Attempt to open parameter file (%s) failed.' % self.opts.out.params.filename
 
@@ -300,8 +433,147 @@ class MCMCImpl(CommonFunctions):
         #self.param_file_name = prefix + '.p'
         #self.tree_file_name = prefix + '.t'
 
-        self.paramFileOpen()
-        self.treeFileOpen()
+        if self.opts.restart:
+            self.openCheckpoint()
+        else:
+            self.paramFileOpen()
+            self.treeFileOpen()
+
+    def reopenOutputFile(self, filename, offset):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Reopens an output file that was open when a checkpoint was saved,
+        discarding anything written to it after offset (the position of the
+        end of the file at the time the checkpoint was saved). Returns None
+        if filename is empty (i.e. the file was not open).
+        
+        """
+        if filename == '':
+            return None
+        self.phycassert(os.path.exists(filename), 'Output file %s, which was open when the checkpoint was saved, no longer exists' % filename)
+        f = open(filename, 'r+')
+        f.seek(offset)
+        f.truncate()
+        if self.opts.background_output:
+            f.close()
+            f = Likelihood.AsyncFileWriter(filename, True, self.opts.flush_interval)
+        return f
+
+    def saveCheckpoint(self, cycle):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Saves everything needed to resume the analysis after the supplied
+        cycle of the current beta value to opts.checkpoint_file: the loop
+        position and adaptation schedule, the log-likelihoods sampled so far
+        for each beta value, the names and current lengths of the output
+        files, the state of the master Lot, the chain order and powers, the
+        swap table and the complete state of every chain. 
+        
+        """
+        ckp = Likelihood.CheckpointWriter(self.opts.checkpoint_file)
+        
+        # Loop position
+        ckp.putUInt(self.ss_beta_index)
+        ckp.putUInt(cycle + 1)
+        ckp.putUInt(self.cycle_start)
+        ckp.putUInt(self.last_adaptation)
+        ckp.putUInt(self.next_adaptation)
+        ckp.putUInt(len(self.ss_sampled_likes))
+        for v in self.ss_sampled_likes:
+            ckp.putDoubleVect(v)
+        
+        # Output files (offsets are stored as doubles because they may not fit in 32 bits)
+        for f in [self.paramf, self.treef, self.sitelikef]:
+            if f is None:
+                ckp.putString('')
+                ckp.putDouble(0.0)
+            else:
+                f.flush()
+                ckp.putString(f.name)
+                ckp.putDouble(float(f.tell()))
+        
+        # Random number generator used for chain swaps and for drawing from the prior
+        ckp.putString(self._getLot().getState())
+        
+        # Chains
+        m = self.mcmc_manager
+        n = len(m.chains)
+        ckp.putUInt(n)
+        for c in m.chains:
+            ckp.putUInt(m.original_chains.index(c))
+            ckp.putDouble(c.heating_power)
+        for row in m.swap_table:
+            for x in row:
+                ckp.putUInt(x)
+        for c in m.original_chains:
+            c.chain_manager.saveState(ckp)
+        if m.coupler is not None:
+            m.coupler.saveState(ckp)
+        ckp.close()
+            
+    def openCheckpoint(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Opens opts.checkpoint_file, reads the loop position and the sampled
+        log-likelihoods, and reopens the output files, truncating each to
+        its length at the time the checkpoint was saved. The state of the 
+        chains is read later by restoreCheckpoint, after the chains have 
+        been created.
+        
+        """
+        self.phycassert(os.path.exists(self.opts.checkpoint_file), 'Cannot restart because the checkpoint file (%s) does not exist' % self.opts.checkpoint_file)
+        ckp = Likelihood.CheckpointReader(self.opts.checkpoint_file)
+        self.ss_beta_index   = ckp.getUInt()
+        self.restart_cycle   = ckp.getUInt()
+        self.cycle_start     = ckp.getUInt()
+        self.last_adaptation = ckp.getUInt()
+        self.next_adaptation = ckp.getUInt()
+        self.ss_sampled_likes = [ckp.getDoubleVect() for i in range(ckp.getUInt())]
+        
+        fn = ckp.getString()
+        self.paramf = self.reopenOutputFile(fn, long(ckp.getDouble()))
+        fn = ckp.getString()
+        self.treef = self.reopenOutputFile(fn, long(ckp.getDouble()))
+        if self.treef is not None and self.opts.binary_trees:
+            self.treef.close()
+            self.treef = Phylogeny.TreeSampleWriter(fn)
+            self.treef.setFlushInterval(self.binaryFlushInterval())
+            self.treef.reopen()
+        fn = ckp.getString()
+        f = self.reopenOutputFile(fn, long(ckp.getDouble()))
+        if f is not None:
+            f.close()
+            self.sitelikef = Likelihood.SiteLikeWriter(fn)
+            self.sitelikef.setFlushInterval(self.binaryFlushInterval())
+            self.sitelikef.reopen()
+        self.output('Restarting from checkpoint file %s' % self.opts.checkpoint_file)
+        self.checkpoint_reader = ckp
+        
+    def restoreCheckpoint(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Finishes the restart begun by openCheckpoint by restoring the master
+        Lot, the order and powers of the chains, the swap table and the state 
+        of every chain.
+        
+        """
+        ckp = self.checkpoint_reader
+        self._getLot().setState(ckp.getString())
+        
+        m = self.mcmc_manager
+        n = ckp.getUInt()
+        self.phycassert(n == len(m.chains), 'Checkpoint file holds %d chains but this analysis has %d' % (n, len(m.chains)))
+        for k in range(n):
+            c = m.original_chains[ckp.getUInt()]
+            c.heating_power = ckp.getDouble()
+            m.chains[k] = c
+        m.swap_table = [[ckp.getUInt() for j in range(n)] for i in range(n)]
+        for c in m.original_chains:
+            c.chain_manager.restoreState(ckp)
+        if m.coupler is not None:
+            m.coupler.restoreState(ckp)
+        self.phycassert(ckp.atEnd(), 'Checkpoint file %s contains more data than expected' % self.opts.checkpoint_file)
+        self.checkpoint_reader = None
         
     def _loadData(self, matrix):
         self.phycassert(matrix is not None, 'Tried to load data from a non-existant matrix')
@@ -850,6 +1122,8 @@ class MCMCImpl(CommonFunctions):
                 pass
             elif name.find('tree_scaler') == 0:                     # C++ class TreeScalerMove
                 pass
+            elif name.find('edgelen_hmc') == 0:                     # C++ class EdgeLenHMCMove
+                pass
             elif name.find('bush_move') == 0:                       # C++ class BushMove
                 pass    # polytomies handled further down (by randomly pruning fully-resolved equiprobable tree)
             else:
@@ -949,22 +1223,29 @@ class MCMCImpl(CommonFunctions):
         else:
             return '%d seconds remaining' % math.floor(secs_remaining)
         
-    def mainMCMCLoop(self, explore_prior = False):
+    def mainMCMCLoop(self, explore_prior = False, first_cycle = 0):
         levels_file_created = False #temp!
         nchains = len(self.mcmc_manager.chains)
         # print '******** nchains =',nchains
-        self.last_adaptation = 0
-        self.next_adaptation = self.opts.adapt_first
+        if first_cycle == 0:
+            self.last_adaptation = 0
+            self.next_adaptation = self.opts.adapt_first
         
         CPP_UPDATER = True # using python obsoleteUpdateAllUpdaters
         
-        for cycle in xrange(self.burnin + self.ncycles):
+        for cycle in xrange(first_cycle, self.burnin + self.ncycles):
+            if cycle == first_cycle or cycle == self.burnin:
+                self.setHMCAdaptation(cycle < self.burnin)
+
             # Update all updaters
             if explore_prior and self.opts.draw_directly_from_prior:
                 if self.opts.doing_steppingstone_sampling and not self.opts.ssobj.ti:
                     self.exploreWorkingPrior(cycle)
                 else:
                     self.explorePrior(cycle)
+            elif self.mcmc_manager.coupler is not None:
+                # Update chains in separate threads and attempt a chain swap, all in C++
+                self.mcmc_manager.advanceCoupledChains()
             else:
                 for i,c in enumerate(self.mcmc_manager.chains):
                     if CPP_UPDATER:
@@ -975,7 +1256,7 @@ class MCMCImpl(CommonFunctions):
             # print '******** time_stamp =',self.mcmc_manager.getColdChain().model.getTimeStamp()
                     
             # Attempt to swap two random chains
-            if nchains > 1:
+            if nchains > 1 and self.mcmc_manager.coupler is None:
                 self.mcmc_manager.attemptChainSwap(cycle)
     
             # Provide progress report to user if it is time
@@ -1024,9 +1305,15 @@ class MCMCImpl(CommonFunctions):
 
             # Adapt slice samplers if it is time
             if self.doThisCycle(cycle, self.next_adaptation):
+                if self.opts.adapt_weights and cycle < self.burnin:
+                    self.adaptUpdaterWeights()
                 self.adaptSliceSamplers()
                 self.next_adaptation += 2*(self.next_adaptation - self.last_adaptation)
                 self.last_adaptation = cycle + 1
+                
+            # Save checkpoint if it is time
+            if self.opts.checkpoint_every > 0 and self.doThisCycle(cycle, self.opts.checkpoint_every):
+                self.saveCheckpoint(cycle)
         self.cycle_start += self.burnin + self.ncycles
         
     def debugCreateRefDistMap(self, fn):
@@ -1069,12 +1356,234 @@ class MCMCImpl(CommonFunctions):
         self.beagle = BeagleLibBase()
         self.beagle.listResources()
         
+    def exploreBeta(self, chain, first_cycle = 0):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Uses the supplied MarkovChain (the cold chain) to explore the power
+        posterior for the current beta value (self.ss_beta) during 
+        steppingstone sampling, continuing from the chain's current state.
+        If first_cycle is greater than 0, exploration of this beta value is
+        being resumed from a checkpoint and cycles before first_cycle have
+        already been performed.
+        
+        """
+        if first_cycle == 0:
+            self.ss_sampled_likes.append([])
+        chain.setPower(self.ss_beta)
+        boldness = 100.0*(1.0 - self.ss_beta)
+        chain.setBoldness(boldness)
+        self.output('Setting chain boldness to %g based on beta = %g' % (boldness,self.ss_beta))
+        self.cycle_stop = self.opts.burnin + len(self.ss_sampled_betas)*self.opts.ncycles + self.opts.ssobj.xcycles
+        if self.ss_beta_index > 0:
+            self.burnin = 0
+            self.ncycles = self.opts.ncycles
+        else:
+            self.burnin = self.opts.burnin
+            self.ncycles = self.opts.ncycles + self.opts.ssobj.xcycles
+            self.cycle_start = 0
+        if self.ss_beta == 0.0:
+            self.mainMCMCLoop(explore_prior=True, first_cycle=first_cycle)
+        else:
+            self.mainMCMCLoop(first_cycle=first_cycle)
+
+    def exploreBetasConcurrently(self, chain):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Explores the power posteriors for all beta values from 
+        self.ss_beta_index onward, up to ssobj.nthreads of them at a time,
+        each by its own chain in its own thread. The supplied MarkovChain
+        (the cold chain, which has just explored the posterior) takes the
+        first beta value; each other beta value gets a new MarkovChain with
+        its own Lot, whose working priors are fitted to the samples gathered
+        by the cold chain. New chains start from scratch, so every chain is
+        given mcmc.burnin cycles of burn-in before sampling begins. Samples
+        are written to the parameter, tree and site-likelihood files grouped
+        by beta value, in the same order used when beta values are explored
+        one after another. If draw_directly_from_prior is True, the final 
+        beta value (0.0) is explored afterwards by the cold chain alone.
+        
+        """
+        first = self.ss_beta_index
+        last = len(self.ss_sampled_betas)
+        if self.opts.draw_directly_from_prior and self.ss_sampled_betas[-1] == 0.0:
+            last -= 1
+        nthreads = self.opts.ssobj.nthreads
+        self.output('Exploring %d power posteriors, %d at a time' % (last - first, nthreads))
+        self.cycle_stop = self.opts.burnin + len(self.ss_sampled_betas)*self.opts.ncycles + self.opts.ssobj.xcycles
+        for group_first in range(first, last, nthreads):
+            group = range(group_first, min(group_first + nthreads, last))
+            self.exploreBetaGroup(group, chain, group_first == first)
+        
+        if last < len(self.ss_sampled_betas):
+            self.ss_beta_index = last
+            self.ss_beta = self.ss_sampled_betas[last]
+            self.exploreBeta(chain)
+
+    def exploreBetaGroup(self, group, cold_chain, use_cold_chain):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Called by exploreBetasConcurrently to explore the power posteriors
+        whose indices into self.ss_sampled_betas are listed in group, all at
+        the same time. If use_cold_chain is True, cold_chain explores the
+        first of these; otherwise, new chains are created for all of them.
+        
+        """
+        from cStringIO import StringIO
+        chains = []
+        for k in group:
+            beta = self.ss_sampled_betas[k]
+            if use_cold_chain and k == group[0]:
+                c = cold_chain
+            else:
+                lot = ProbDist.Lot()
+                lot.useStream(self._getLot(), k + 1)
+                c = MarkovChain(self, beta, lot)
+                c.chain_manager.setRefTree(cold_chain.chain_manager.getRefTree())
+                if not self.opts.ssobj.ti:
+                    self.setupWorkingPriors(c, cold_chain)
+            c.setPower(beta)
+            c.setBoldness(100.0*(1.0 - beta))
+            c.chain_manager.refreshLastLnLike()
+            c.chain_manager.refreshLastLnPrior()
+            chains.append(c)
+            self.ss_sampled_likes.append([])
+            self.output('Exploring beta = %g using chain %d' % (beta, len(chains)))
+            
+        coupler = Likelihood.MCMCCoupler()
+        coupler.allowSwaps(False)
+        coupler.setNumThreads(len(chains))
+        for c in chains:
+            coupler.addChain(c.chain_manager, c.heating_power)
+        
+        # Samples are buffered so that they can be written grouped by beta value
+        paramf = [self.paramf and StringIO() or None for c in chains]
+        if self.opts.binary_trees:
+            treef = [self.treef and Phylogeny.TreeSampleWriter() or None for c in chains]
+        else:
+            treef = [self.treef and StringIO() or None for c in chains]
+        sitelikef = [None]*len(chains)
+        if self.sitelikef is not None:
+            for i,c in enumerate(chains):
+                c.likelihood.storeSiteLikelihoods(True)
+                sitelikef[i] = Likelihood.SiteLikeWriter()
+        
+        burnin = self.opts.burnin
+        last_adaptation = 0
+        next_adaptation = self.opts.adapt_first
+        for cycle in xrange(burnin + self.opts.ncycles):
+            if cycle == 0 or cycle == burnin:
+                self.setHMCAdaptation(cycle < burnin, chains)
+            coupler.advance(1)
+            sampling = cycle >= burnin and self.doThisCycle(cycle - burnin, self.opts.sample_every)
+            for i,c in enumerate(chains):
+                k = group[i]
+                if c.heating_power == 0.0 and (sampling or self.doThisCycle(cycle, self.opts.report_every)):
+                    c.chain_manager.refreshLastLnLike()
+                if self.opts.verbose and self.doThisCycle(cycle, self.opts.report_every):
+                    self.output('beta = %.5f, cycle = %d, lnL = %.5f' % (c.heating_power, cycle + 1, c.chain_manager.getLastLnLike()))
+                if sampling:
+                    if c.heating_power == 0.0:
+                        c.chain_manager.refreshLastLnPrior()
+                    sample_cycle = self.cycle_start + (k - group[0])*self.opts.ncycles + cycle - burnin
+                    self.mcmc_manager.recordSample(False, sample_cycle, c, paramf[i], treef[i], sitelikef[i])
+                    self.ss_sampled_likes[k].append(c.chain_manager.getLastLnLike())
+            if self.doThisCycle(cycle, next_adaptation):
+                for c in chains:
+                    if self.opts.adapt_weights and cycle < burnin:
+                        self.adaptUpdaterWeights(c.chain_manager, ' for beta = %g' % c.heating_power)
+                    self.adaptSliceSamplers(c.chain_manager, ' for beta = %g' % c.heating_power)
+                next_adaptation += 2*(next_adaptation - last_adaptation)
+                last_adaptation = cycle + 1
+        self.cycle_start += len(group)*self.opts.ncycles
+        
+        for i,c in enumerate(chains):
+            if paramf[i] is not None:
+                self.paramf.write(paramf[i].getvalue())
+                self.paramf.flush()
+            if treef[i] is not None:
+                if self.opts.binary_trees:
+                    treef[i].transferTo(self.treef)
+                else:
+                    self.treef.write(treef[i].getvalue())
+                self.treef.flush()
+            if sitelikef[i] is not None:
+                sitelikef[i].transferTo(self.sitelikef)
+                self.sitelikef.flush()
+            if c is not cold_chain:
+                self.concurrent_evals += c.getNumLikelihoodEvals()
+
+    def setupWorkingPriors(self, chain, source_chain = None):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Parameterizes the working prior (reference distribution) of every
+        updater of the supplied MarkovChain so that it can be used by
+        steppingstone sampling for the remaining beta values. Working priors
+        are either read from ssobj.refdist_definition_file or fitted to the
+        samples gathered while exploring the posterior. If source_chain is
+        supplied, those samples are copied from the corresponding updaters
+        of source_chain (the chain that explored the posterior) and nothing
+        is output; otherwise chain's own samples are used and the working
+        priors are described in the output.
+        
+        """
+        if source_chain is None:
+            self.output('\nReference distribution details:')
+        if self.opts.ssobj.refdist_definition_file is not None:
+            # User has specified a file containing the reference distribution definitions
+            ref_dist_tree,ref_dist_map = self.debugCreateRefDistMap(self.opts.ssobj.refdist_definition_file)
+            # build focal tree
+            focal_tree = TreeCollection(newick=ref_dist_tree).trees[0]
+            ntips = focal_tree.getNObservables()
+            focal_tree.recalcAllSplits(ntips)
+            nd = focal_tree.getFirstPreorder()
+            assert nd.isRoot(), 'the first preorder node should be the root'
+            self.stdout.phycassert(focal_tree.hasEdgeLens(), 'focal tree from reference distribution must have edge lengths (which will be interpreted as split posteriors)')
+            nd = nd.getNextPreorder()
+            while nd:
+                # Determine whether this split represents an internal or tip node
+                if not (nd.isTip() or nd.getParent().isRoot()):
+                    split_prob = nd.getEdgeLen()
+                    self.stdout.phycassert(split_prob > 0.0 and split_prob < 1.0, 'Split probabilities must be in the range (0, 1)')
+                    s = nd.getSplit()
+                    if s.isBitSet(0):
+                        s.invertSplit()
+                nd = nd.getNextPreorder()
+        topo_ref_dist_calculator = None
+        all_updaters = chain.chain_manager.getAllUpdaters() 
+        if source_chain is not None:
+            source_updaters = list(source_chain.chain_manager.getAllUpdaters())
+        for i,u in enumerate(all_updaters):
+            if not u.isFixed():
+                u.setUseWorkingPrior(True)
+                if u.computesUnivariatePrior() or u.computesMultivariatePrior():
+                    if self.opts.ssobj.refdist_definition_file is not None:
+                        # User has specified a file containing the reference distribution definitions
+                        if u.computesUnivariatePrior():
+                            u.setWorkingPrior(ref_dist_map[u.getName()])
+                        else:
+                            u.setMultivariateWorkingPrior(ref_dist_map[u.getName()])
+                    else:                           
+                        # Compute reference distributions from samples already stored
+                        #raw_input('POLPOL: calling finalizeWorkingPrior for %s' % u.getName())
+                        if source_chain is not None:
+                            u.copyWorkingPriorSample(source_updaters[i])
+                        u.finalizeWorkingPrior()
+                    if source_chain is None:
+                        self.output('  %s = %s' % (u.getName(), u.getWorkingPriorDescr()))
+                if u.computesTopologyPrior():
+                    if topo_ref_dist_calculator is None:
+                        topo_ref_dist_calculator = FocalTreeTopoProbCalculatorBase(focal_tree)
+                    u.setReferenceDistribution(topo_ref_dist_calculator)
+
     def run(self):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
         """
         Performs the MCMC analysis. 
         
         """        
+        if self.opts.checkpoint_every > 0 or self.opts.restart:
+            self.phycassert(not self.opts.use_unimap, 'checkpoints cannot (yet) be used with uniformized mapping MCMC')
+            self.phycassert(not (self.opts.doing_steppingstone_sampling and self.opts.ssobj.nthreads > 1), 'checkpoints cannot be used when power posteriors are explored concurrently (ss.nthreads > 1)')
         self.setup()
         #self.checkForBeaglelib()
         
@@ -1089,7 +1598,8 @@ class MCMCImpl(CommonFunctions):
         nchains = len(self.mcmc_manager.chains)
         
         cold_chain = self.mcmc_manager.getColdChain()
-        cold_chain.likelihood.useBeagleLib(self.opts.use_beaglelib)
+        if self.opts.use_beaglelib:
+            cold_chain.likelihood.useBeagleLib(True)
         
         if self.opts.verbose:
             if self.data_matrix == None:
@@ -1132,7 +1642,10 @@ class MCMCImpl(CommonFunctions):
                 self.output('No. cycles:     %s' % self.opts.ncycles)
                 self.output('Sample every:   %s' % self.opts.sample_every)
                 self.output('No. samples:    %s' % self.nsamples)
-            self.output('Sampled trees will be saved in %s' % str_value_for_user(self.opts.out.trees))
+            if self.opts.binary_trees:
+                self.output('Sampled trees will be saved in %s' % str_value_for_user(self.opts.out.treesamples))
+            else:
+                self.output('Sampled trees will be saved in %s' % str_value_for_user(self.opts.out.trees))
             self.output('Sampled parameters will be saved in %s' % str_value_for_user(self.opts.out.params))
             if self.opts.use_unimap:
                 self.output('Using uniformized mapping MCMC')
@@ -1196,6 +1709,8 @@ class MCMCImpl(CommonFunctions):
         
         self.stopwatch.start()
         self.mcmc_manager.resetNumLikelihoodEvals()
+        self.resetUpdaterCosts()
+        self.concurrent_evals = 0
         
         if self.opts.doing_steppingstone_sampling:
             self.output('\nSampling (%d cycles for each of the %d values of beta)...' % (self.opts.ncycles, self.opts.ssobj.nbetavals))
@@ -1209,8 +1724,12 @@ class MCMCImpl(CommonFunctions):
         #self.last_adaptation = 0
         #self.next_adaptation = self.opts.adapt_first
 
-        # Lay down first line in params file (recorded as cycle 0) containing starting values of parameters
-        self.mcmc_manager.recordSample(False)
+        if self.opts.restart:
+            # Output files already hold everything up to the checkpoint
+            self.restoreCheckpoint()
+        else:
+            # Lay down first line in params file (recorded as cycle 0) containing starting values of parameters
+            self.mcmc_manager.recordSample(False)
         if self.opts.doing_steppingstone_sampling:
             self.phycassert(self.data_matrix is not None, 'path sampling requires data')
             self.phycassert(nchains == 1, 'path sampling requires nchains to be 1')
@@ -1245,95 +1764,57 @@ class MCMCImpl(CommonFunctions):
                 self.ss_sampled_betas = [self.opts.ssobj.minbeta]
             
             # Run the main MCMC loop for each beta value in ss_sampled_betas
-            self.ss_sampled_likes = []
+            if self.opts.restart:
+                # Beta values before restart_beta_index were finished before the checkpoint was saved
+                restart_beta_index = self.ss_beta_index
+            else:
+                restart_beta_index = 0
+                self.ss_sampled_likes = []
             ref_dist_calculated = False
             for self.ss_beta_index, self.ss_beta in enumerate(self.ss_sampled_betas):
+                if self.ss_beta_index < restart_beta_index:
+                    continue
                 if self.ss_beta_index > 0 and (not self.opts.ssobj.ti) and not ref_dist_calculated:
                     # If using working prior with steppingstone sampling, it is now time to 
                     # parameterize the working prior for all updaters so that this working prior
                     # can be used in the sequel
-                    self.output('\nReference distribution details:')
-                    if self.opts.ssobj.refdist_definition_file is not None:
-                        # User has specified a file containing the reference distribution definitions
-                        ref_dist_tree,ref_dist_map = self.debugCreateRefDistMap(self.opts.ssobj.refdist_definition_file)
-                        # build focal tree
-                        focal_tree = TreeCollection(newick=ref_dist_tree).trees[0]
-                        ntips = focal_tree.getNObservables()
-                        focal_tree.recalcAllSplits(ntips)
-                        nd = focal_tree.getFirstPreorder()
-                        assert nd.isRoot(), 'the first preorder node should be the root'
-                        self.stdout.phycassert(focal_tree.hasEdgeLens(), 'focal tree from reference distribution must have edge lengths (which will be interpreted as split posteriors)')
-                        nd = nd.getNextPreorder()
-                        while nd:
-                            # Determine whether this split represents an internal or tip node
-                            if not (nd.isTip() or nd.getParent().isRoot()):
-                                split_prob = nd.getEdgeLen()
-                                self.stdout.phycassert(split_prob > 0.0 and split_prob < 1.0, 'Split probabilities must be in the range (0, 1)')
-                                s = nd.getSplit()
-                                if s.isBitSet(0):
-                                    s.invertSplit()
-                            nd = nd.getNextPreorder()
-                    topo_ref_dist_calculator = None
-                    all_updaters = cold_chain.chain_manager.getAllUpdaters() 
-                    for u in all_updaters:
-                        if not u.isFixed():
-                            u.setUseWorkingPrior(True)
-                            if u.computesUnivariatePrior() or u.computesMultivariatePrior():
-                                if self.opts.ssobj.refdist_definition_file is not None:
-                                    # User has specified a file containing the reference distribution definitions
-                                    if u.computesUnivariatePrior():
-                                        u.setWorkingPrior(ref_dist_map[u.getName()])
-                                    else:
-                                        u.setMultivariateWorkingPrior(ref_dist_map[u.getName()])
-                                else:                           
-                                    # Compute reference distributions from samples already stored
-                                    #raw_input('POLPOL: calling finalizeWorkingPrior for %s' % u.getName())
-                                    u.finalizeWorkingPrior()
-                                self.output('  %s = %s' % (u.getName(), u.getWorkingPriorDescr()))
-                            if u.computesTopologyPrior():
-                                if topo_ref_dist_calculator is None:
-                                    topo_ref_dist_calculator = FocalTreeTopoProbCalculatorBase(focal_tree)
-                                u.setReferenceDistribution(topo_ref_dist_calculator)
+                    self.setupWorkingPriors(chain)
                     self.output()
                     ref_dist_calculated = True
                     
-                self.ss_sampled_likes.append([])
-                chain.setPower(self.ss_beta)
-                boldness = 100.0*(1.0 - self.ss_beta)
-                chain.setBoldness(boldness)
-                self.output('Setting chain boldness to %g based on beta = %g' % (boldness,self.ss_beta))
-                self.cycle_stop = self.opts.burnin + len(self.ss_sampled_betas)*self.opts.ncycles + self.opts.ssobj.xcycles
-                if self.ss_beta_index > 0:
-                    self.burnin = 0
-                    self.ncycles = self.opts.ncycles
-                else:
-                    self.burnin = self.opts.burnin
-                    self.ncycles = self.opts.ncycles + self.opts.ssobj.xcycles
-                    self.cycle_start = 0
-                if self.ss_beta == 0.0:
-                    self.mainMCMCLoop(explore_prior=True)
+                if self.ss_beta_index > 0 and self.opts.ssobj.nthreads > 1:
+                    # The posterior has been explored; the remaining power posteriors
+                    # do not depend on one another and can be explored concurrently
+                    self.exploreBetasConcurrently(chain)
+                    break
+                    
+                if self.ss_beta_index == restart_beta_index:
+                    self.exploreBeta(chain, self.restart_cycle)
                 else:
-                    self.mainMCMCLoop()
+                    self.exploreBeta(chain)
         else:   # not doing steppingstone sampling
             #print '@@@@@@@@@@@@@@ debugging steppingstone @@@@@@@@@@@@@'
-            self.ss_sampled_likes = []
-            self.ss_sampled_likes.append([])
+            if not self.opts.restart:
+                self.ss_sampled_likes = []
+                self.ss_sampled_likes.append([])
             self.ss_beta_index = 0
             self.cycle_start = 0
             self.cycle_stop = self.opts.burnin + self.opts.ncycles
             self.burnin = self.opts.burnin
             self.ncycles = self.opts.ncycles
             if self.data_matrix is None:
-                self.mainMCMCLoop(explore_prior=True)
+                self.mainMCMCLoop(explore_prior=True, first_cycle=self.restart_cycle)
             else:
-                self.mainMCMCLoop()
+                self.mainMCMCLoop(first_cycle=self.restart_cycle)
 
         self.adaptSliceSamplers()
-        total_evals = self.mcmc_manager.getTotalEvals() #self.likelihood.getNumLikelihoodEvals()
+        total_evals = self.mcmc_manager.getTotalEvals() + self.concurrent_evals #self.likelihood.getNumLikelihoodEvals()
         total_secs = self.stopwatch.elapsedSeconds()
         self.output('%d likelihood evaluations in %.5f seconds' % (total_evals, total_secs))
         if (total_secs > 0.0):
             self.output('  = %.5f likelihood evaluations/sec' % (total_evals/total_secs))
+        if self.opts.report_costs:
+            self.reportUpdaterCosts()
 
         if self.treef:
             self.treeFileClose()
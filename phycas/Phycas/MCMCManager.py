@@ -27,6 +27,9 @@ class MCMCManager:
         self.parent = parent    # parent is MCMCImpl object
         self.chains = []
         self.swap_table = None
+        self.coupler = None
+        self.coupled_chains = None
+        self.original_chains = None
 
     def paramFileHeader(self, paramf):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
@@ -77,14 +80,32 @@ class MCMCManager:
         self.parent.phycassert(not unimap_and_polytomies, 'Allowing polytomies cannot (yet) be used in conjunction with use_unimap')
         self.parent.phycassert(not unimap_and_ratehet, 'Rate heterogeneity cannot (yet) be used in conjunction with use_unimap')
     
+        # Chains are updated in C++ worker threads if more than one thread was requested;
+        # each chain then needs its own Lot, which uses its own stream derived from the shared one
+        n = len(self.parent.heat_vector)
+        use_coupler = (n > 1 and self.parent.opts.chain_threads > 1 and not self.parent.opts.doing_steppingstone_sampling)
+
         # Create the chains
         # print '@@@@@ heat vector =',self.parent.heat_vector
         for i, heating_power in enumerate(self.parent.heat_vector):
-            markov_chain = MarkovChain(self.parent, heating_power)
+            if use_coupler:
+                lot = ProbDist.Lot()
+                lot.useStream(self.parent._getLot(), i + 1)
+                markov_chain = MarkovChain(self.parent, heating_power, lot)
+            else:
+                markov_chain = MarkovChain(self.parent, heating_power)
             self.chains.append(markov_chain)
             
-        n = len(self.parent.heat_vector)
         self.swap_table = [[0]*n for i in range(n)]
+        
+        self.original_chains = list(self.chains)   # self.chains is reordered by swaps; checkpoints need the original order
+        if use_coupler:
+            self.coupled_chains = list(self.chains)
+            self.coupler = Likelihood.MCMCCoupler()
+            self.coupler.setLot(self.parent._getLot())
+            self.coupler.setNumThreads(self.parent.opts.chain_threads)
+            for c in self.chains:
+                self.coupler.addChain(c.chain_manager, c.heating_power)
 
     def getNumChains(self):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
@@ -146,8 +167,15 @@ class MCMCManager:
         """
         # Note: self.parent is the MCMCImpl object
         self.parent.opts.random_seed = rnseed
-        for c in self.chains:
-            c.r.setSeed(int(rnseed))
+        if self.coupler is None:
+            for c in self.chains:
+                c.r.setSeed(int(rnseed))
+        else:
+            # chains have their own Lot objects, each using a different stream
+            r = self.parent._getLot()
+            r.setSeed(int(rnseed))
+            for i, c in enumerate(self.coupled_chains):
+                c.r.useStream(r, i + 1)
 
     def getTotalEvals(self):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
@@ -162,14 +190,18 @@ class MCMCManager:
             total += c.getNumLikelihoodEvals()
         return total
 
-    def recordSample(self, dofit, cycle = -1):
+    def recordSample(self, dofit, cycle = -1, chain = None, paramf = None, treef = None, sitelikef = None):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
         """
         Records the current tree topology and edge lengths by adding a line to
         the tree file, and records tree length and substitution parameters
         by adding a line to the parameter file. If dofit is True, add to 
         the fitting sample of each updater. The fitting sample is used to 
-        construct a working prior for steppingstone sampling.
+        construct a working prior for steppingstone sampling. If chain is
+        supplied, that MarkovChain (which need not be one of self.chains) is
+        recorded instead of the cold chain, and the lines are written to the
+        supplied paramf, treef and sitelikef file objects (any of which may
+        be None) rather than to the parent's files.
         
         """
         # Note: self.parent is the MCMCImpl object
@@ -177,11 +209,19 @@ class MCMCManager:
         float_format_notab_str = '%%.%df' % self.parent.opts.ndecimals
         
         # Only record samples from the current cold chain
-        cold_chain = self.parent.mcmc_manager.getColdChain()
+        if chain is None:
+            cold_chain = self.parent.mcmc_manager.getColdChain()
+            chains = self.chains
+            paramf = self.parent.paramf
+            treef = self.parent.treef
+            sitelikef = self.parent.sitelikef
+        else:
+            cold_chain = chain
+            chains = [chain]
         
         # Gather log-likelihoods, and if path sampling save in path_sample list for later
         lnLikes = []
-        for i,c in enumerate(self.chains):
+        for i,c in enumerate(chains):
             lnLi = c.chain_manager.getLastLnLike()
             lnLikes.append(lnLi)
         
@@ -192,21 +232,21 @@ class MCMCManager:
                 u.educateWorkingPrior()
         
         # Add line to parameter file if it exists
-        if self.parent.paramf:
+        if paramf:
             # cycle
-            self.parent.paramf.write('%d\t' % (cycle + 1))
+            paramf.write('%d\t' % (cycle + 1))
             
             # beta
             if self.parent.opts.doing_steppingstone_sampling:
-                self.parent.paramf.write(float_format_str % (cold_chain.heating_power))
+                paramf.write(float_format_str % (cold_chain.heating_power))
                 
             # lnL for each chain
             for lnl in lnLikes:
-                self.parent.paramf.write(float_format_str % lnl)
+                paramf.write(float_format_str % lnl)
             
             # lnPrior
             ln_prior = cold_chain.chain_manager.calcJointLnPrior()
-            self.parent.paramf.write(float_format_str % ln_prior)
+            paramf.write(float_format_str % ln_prior)
             
             # lnWorkingPrior
             if self.parent.opts.doing_steppingstone_sampling and self.parent.opts.ssobj and not self.parent.opts.ssobj.ti:
@@ -214,69 +254,83 @@ class MCMCManager:
                     ln_ref_dist = cold_chain.chain_manager.recalcLnWorkingPrior()
                 else:
                     ln_ref_dist = 0.0
-                self.parent.paramf.write(float_format_str % ln_ref_dist)
+                paramf.write(float_format_str % ln_ref_dist)
     
             # Robinson-Foulds distance between sampled tree and reference tree
             if cold_chain.chain_manager.getRefTree() is not None:
                 dRF = cold_chain.chain_manager.calcRFDistance(cold_chain.chain_manager.getRefTree())
-                self.parent.paramf.write('%d\t' % dRF)
+                paramf.write('%d\t' % dRF)
             
             # If using a polytomy model, record the resolution class of the sampled tree
             if self.parent.opts.allow_polytomies:
                 ninternals = cold_chain.tree.getNInternals()
-                self.parent.paramf.write('%d\t' % ninternals)
+                paramf.write('%d\t' % ninternals)
             
             # tree length
-            self.parent.paramf.write(float_format_str % cold_chain.tree.edgeLenSum())
+            paramf.write(float_format_str % cold_chain.tree.edgeLenSum())
             if self.parent.opts.fix_topology:
                 all_edgelens = cold_chain.tree.edgeLens()
-                self.parent.paramf.write('%s\t' % '\t'.join([float_format_notab_str % brlen for brlen in all_edgelens]))
+                paramf.write('%s\t' % '\t'.join([float_format_notab_str % brlen for brlen in all_edgelens]))
             
             # record parameter values for each model in partition
             nmodels = cold_chain.partition_model.getNumSubsets()
             if nmodels > 1:
                 for i in range(nmodels):
                     ssrr = cold_chain.partition_model.getSubsetRelRate(i)
-                    self.parent.paramf.write(float_format_str % ssrr)                   
+                    paramf.write(float_format_str % ssrr)                   
             for i in range(nmodels):
                 m = cold_chain.partition_model.getModel(i)
                 include_edgelen_hyperparams = (i == 0)
-                self.parent.paramf.write(m.paramReport(self.parent.opts.ndecimals, include_edgelen_hyperparams))
+                paramf.write(m.paramReport(self.parent.opts.ndecimals, include_edgelen_hyperparams))
                 #if m.hasEdgeLenHyperPrior():
                 #   if m.isSeparateInternalExternalEdgeLenPriors():
-                #       self.parent.paramf.write(float_format_str % m.getExternalEdgelenHyperparam())
-                #       self.parent.paramf.write(float_format_str % m.getInternalEdgelenHyperparam())
+                #       paramf.write(float_format_str % m.getExternalEdgelenHyperparam())
+                #       paramf.write(float_format_str % m.getInternalEdgelenHyperparam())
                 #   else:
-                #       self.parent.paramf.write(float_format_str % m.getInternalEdgelenHyperparam())
+                #       paramf.write(float_format_str % m.getInternalEdgelenHyperparam())
                 
-            self.parent.paramf.write('\n')
-            self.parent.paramf.flush()
+            paramf.write('\n')
+            paramf.flush()
             
-        # Add line to tree file if it exists
-        if self.parent.treef:
-            self.parent.treef.write('\ttree rep.%d = %s;\n' % (cycle + 1, cold_chain.tree.makeNewick(self.parent.opts.ndecimals)))
-            self.parent.treef.flush()
+        # Add line to tree file if it exists (or add the tree to the binary tree sample file)
+        if treef:
+            if self.parent.opts.binary_trees:
+                treef.addTree(cycle + 1, cold_chain.tree)
+            else:
+                treef.write('\ttree rep.%d = %s;\n' % (cycle + 1, cold_chain.tree.makeNewick(self.parent.opts.ndecimals)))
+                treef.flush()
 
-        # If we are saving site-likelihoods, and if the sitelikes file exists, add line to sitelikes file 
-        #raw_input('POLPOL: self.parent = %s' % self.parent.__class__.__name__)
-        if self.parent.sitelikef:
-            #raw_input('%s.sitelikef is True' % self.parent.__class__.__name__)
-            cold_chain.likelihood.storeSiteLikelihoods(True)
-            cold_chain.likelihood.calcLnL(cold_chain.tree)
-            cold_chain.likelihood.storeSiteLikelihoods(False)
-            
-            patternLnLikes = cold_chain.likelihood.getSiteLikelihoods()
-            siteloglikes = [0.0]*self.parent.nchar
-            for i,patternLnL in enumerate(patternLnLikes):
-                for site in self.parent.siteIndicesForPatternIndex[i]:
-                    siteloglikes[site] = patternLnL
-            for siteLnL in siteloglikes:
-                self.parent.sitelikef.write(float_format_str % siteLnL)
-            self.parent.sitelikef.write('\n')
-            self.parent.sitelikef.flush()
-        #else:
-        #   raw_input('%s.sitelikef is False' % self.parent.__class__.__name__)
+        # If we are saving site-likelihoods, add the pattern log-likelihoods of the sampled state to the
+        # sitelikes file. These were stored when the likelihood of the sampled state was computed; the
+        # likelihood is only recomputed if the most recent calculation was of some other state (e.g. a 
+        # rejected proposal)
+        if sitelikef is not None:
+            if not cold_chain.likelihood.hasSiteLikelihoodsFor(cold_chain.chain_manager.getLastLnLike()):
+                cold_chain.likelihood.storeSiteLikelihoods(True)
+                cold_chain.likelihood.calcLnL(cold_chain.tree)
+            sitelikef.addSample(cycle + 1, cold_chain.likelihood)
                                 
+    def advanceCoupledChains(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Updates all chains concurrently and attempts one chain swap using
+        self.coupler (only used if createChains created a coupler), then
+        reorders self.chains and copies the swap table so that both look
+        just as they would had the chains been updated one at a time and
+        swapped by attemptChainSwap.
+        
+        """
+        self.coupler.advance(1)
+        n = len(self.coupled_chains)
+        for k in range(n):
+            c = self.coupled_chains[self.coupler.getChainAtRank(k)]
+            c.heating_power = self.coupler.getPowerAtRank(k)
+            self.chains[k] = c
+        
+        # The coupler stores the swap table row by row in a single tuple
+        table = self.coupler.getSwapTable()
+        self.swap_table = [list(table[i*n:(i + 1)*n]) for i in range(n)]
+
     def attemptChainSwap(self, cycle):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
         """
@@ -56,22 +56,26 @@ class MarkovChain(LikelihoodCore):
     self.heating_power data member.
     
     """
-    def __init__(self, parent, power):
+    def __init__(self, parent, power, lot = None):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
         """
         The MarkovChain constructor makes a copy of the supplied parent
         object, clones all of the prior ProbabilityDistribution objects in the
         supplied parent object, and sets self.heating_power to the supplied
-        power.
+        power. If lot is supplied, the chain uses it in place of the Lot
+        shared by all chains (needed if chains are to be updated in
+        different threads).
         
         """
         LikelihoodCore.__init__(self, parent)
         
         self.parent                     = parent    # Note: self.parent is the MCMCImpl object
+        self.private_lot                = lot
         self.boldness                   = 0.0
         self.heating_power              = power
         self.chain_manager              = None
         self.tree_scaler_move           = None      
+        self.edgelen_hmc_move           = None
         self.subset_relrates_move       = None
         self.edge_move                  = None
         self.unimap_fast_nni_move       = None
@@ -231,6 +235,9 @@ class MarkovChain(LikelihoodCore):
         
         """
         LikelihoodCore.setupCore(self)
+        if self.private_lot is not None:
+            self.r = self.private_lot
+            self.likelihood.setLot(self.r)
 
         from phycas import partition,model
         if self.parent.opts.partition.noData():
@@ -408,6 +415,23 @@ class MarkovChain(LikelihoodCore):
                 self.tree_scaler_move.fixParameter()
             self.chain_manager.addMove(self.tree_scaler_move)
 
+        # Create an EdgeLenHMCMove object to update all edge lengths jointly using Hamiltonian
+        # dynamics driven by the gradient of the log posterior
+        if self.parent.opts.edgelen_hmc_weight > 0:
+            self.edgelen_hmc_move = Likelihood.EdgeLenHMCMove()
+            self.edgelen_hmc_move.setName("edgelen_hmc")
+            self.edgelen_hmc_move.setWeight(self.parent.opts.edgelen_hmc_weight)
+            self.edgelen_hmc_move.setPosteriorTuningParam(self.parent.opts.edgelen_hmc_stepsize)
+            self.edgelen_hmc_move.setPriorTuningParam(self.parent.opts.edgelen_hmc_stepsize0)
+            self.edgelen_hmc_move.setNumLeapfrogSteps(self.parent.opts.edgelen_hmc_nsteps)
+            self.edgelen_hmc_move.setTree(self.tree)
+            self.edgelen_hmc_move.setModel(model0)
+            self.edgelen_hmc_move.setTreeLikelihood(self.likelihood)
+            self.edgelen_hmc_move.setLot(self.r)
+            if model0.edgeLengthsFixed():
+                self.edgelen_hmc_move.fixParameter()
+            self.chain_manager.addMove(self.edgelen_hmc_move)
+
         # If more than one partition subset, add a SubsetRelRate move to modify the 
         # vector of relative substitution rates for each subset
         if (nmodels > 1):
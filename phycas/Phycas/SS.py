@@ -12,6 +12,7 @@ class SS(PhycasCommand):
                    ("minsample", 10, "Minimum sample size needed to create a split-specific edge length reference distribution.", IntArgValidate(min=0)),
                    ("shape1", 1.0, "The first shape parameter of the distribution used to determine the beta values to be sampled. This distribution is, confusingly, a Beta distribution. Thus, if both shape1 and shape2 are set to 1, beta values will be chosen at uniform intervals from minbeta to maxbeta.", FloatArgValidate(greaterthan=0.0)),
                    ("shape2", 1.0, "The second shape parameter of the distribution used to determine the beta values to be sampled. This distribution is, confusingly, a Beta distribution. Thus, if both shape1 and shape2 are set to 1, beta values will be chosen at uniform intervals from minbeta to maxbeta.", FloatArgValidate(greaterthan=0.0)),
+                   ("nthreads", 1, "The number of beta values whose power posteriors are explored at the same time (each by its own chain in its own thread) once the posterior has been explored. If 1 (the default), beta values are explored one after another by a single chain. If greater than 1, each additional chain is started from scratch and given mcmc.burnin cycles of burn-in.", IntArgValidate(min=1)),
                 )
         # Specify output options
         #self.__dict__["hidden"] = True # hide from main phycas help list of commands until working
@@ -24,6 +24,12 @@ class Sim(PhycasCommand):
         # to prevent users from adding new data members (to prevent accidental misspellings from causing problems)
         self.__dict__["fix_edgelens"]   = False
         self.__dict__["uf_num_edges"]   = 50
+        self.__dict__["uf_power_of_two"] = False
+        self.__dict__["num_threads"]    = 1
+        self.__dict__["cla_arena"]      = False
+        self.__dict__["pmat_cache"]     = True
+        self.__dict__["cla_pattern_blocked"] = False
+        self.__dict__["likelihood_engine"] = None
         self.__dict__["use_unimap"]     = False
         self.__dict__["data_source"]    = None
         
@@ -2,6 +2,7 @@ import os,sys,math,random
 from phycas import *
 from phycas.Utilities.PhycasCommand import *
 from phycas.Utilities.CommonFunctions import CommonFunctions
+import phycas.Likelihood as Likelihood
 
 class VarianceZeroError(Exception):
     def __init__(self):
@@ -592,31 +593,24 @@ class ParamSummarizer(CommonFunctions):
             self._cpoRFile = sp.open(self.stdout)
         return self._cpoRFile
 
-    def cpo_summary(self, lines, burnin):
+    def cpo_summary(self, site_loghm):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
         """
             Produces an R file containing commands for producing a plot of CPO
             (Conditional Predictive Ordinates). This plot has site position as the
             x-coordinate and site CPO as the y-coordinate. The title of the plot
-            contains the summary measure (sum of CPO over all sites).
+            contains the summary measure (sum of CPO over all sites). The list
+            site_loghm holds the log of the harmonic mean of the sampled site 
+            likelihoods (i.e. the log-CPO) of each site in data file order.
             
             """
         self.output('\nCPO analysis')
-        
-        # Each line in lines comprises nsites log-site-likelihood values (one sample from the chain)
-        nsites = len(lines[0].split())
-        loglikes = [[] for i in range(nsites)]
-        
-        # Create nsites lists, each of which holds all log-site-likelihood values sampled from one site
-        for line in lines:
-            parts = line.split()
-            for i,logx in enumerate(parts):
-                loglikes[i].append(float(logx))
+        nsites = len(site_loghm)
         
         # Create the default partition if none has been defined
         partition.validate(nsites)
         
-        # Compute the log-CPO measure for each site, and the sum over all sites
+        # Sum the log-CPO measure over all sites, ordering sites by subset.
         # Sites that have been excluded will have lognm = 0.0 and thus will not
         # contribute to total_cpo
         cpovect = [0.0]*nsites  #POLPOL was []
@@ -625,7 +619,7 @@ class ParamSummarizer(CommonFunctions):
         for subset_index,(subset_name,subset_sitelist,subset_model) in enumerate(partition.subset):
             print 'CPO: processing subset = %s...' % subset_name
             for i in subset_sitelist:
-                loghm = self.calcLogHM(loglikes[i-1])
+                loghm = site_loghm[i-1]
                 total_cpo += loghm
                 cpovect[k] = loghm  #POLPOL added
                 k += 1  #POLPOL added
@@ -851,12 +845,37 @@ class ParamSummarizer(CommonFunctions):
                 self.std_summary(headers, lines, burnin)
                 
     def handleCPOFile(self, cpofn):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Computes the log-CPO of every site from the sampled site 
+        log-likelihoods in cpofn and passes them to cpo_summary. Binary 
+        files saved by mcmc are read by Likelihood.SiteLikeReader, which
+        skips the first opts.burnin samples and computes the harmonic means
+        of all patterns in one pass through the file. Text files (one line
+        of site log-likelihoods per sample, as saved by older versions) are
+        still accepted; as before, every line of a text file is used.
+        
+        """
         burnin = self.opts.burnin
+        if Likelihood.SiteLikeReader.isSiteLikeFile(cpofn):
+            reader = Likelihood.SiteLikeReader(cpofn)
+            if reader.getNumSamples() < 2 + burnin:
+                self.output("File '%s' has too few samples (%d) for a burnin of %d" % (cpofn, reader.getNumSamples(), burnin))
+            else:
+                self.cpo_summary(reader.calcSiteLogHarmonicMeans(burnin))
+            return
         lines = open(cpofn, 'r').readlines()
         if len(lines) < 3 + burnin:
             self.output("File '%s' does not look like a site likelihood file (too few lines)" % cpofn)
         else:
-            self.cpo_summary(lines, burnin)
+            # Each line in lines comprises nsites log-site-likelihood values (one sample from the chain)
+            nsites = len(lines[0].split())
+            loglikes = [[] for i in range(nsites)]
+            for line in lines:
+                parts = line.split()
+                for i,logx in enumerate(parts):
+                    loglikes[i].append(float(logx))
+            self.cpo_summary([self.calcLogHM(v) for v in loglikes])
         
     def run(self):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
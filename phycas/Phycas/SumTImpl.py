@@ -184,13 +184,8 @@ class TreeSummarizer(CommonFunctions):
                 uninteresting_ignored += 1
                 continue
             line_data = [(0.0,0.0)]
-            v = value[2:]
-            k = 0
-            for i,x in enumerate(xvect[1:]):
-                while k < len(v) and v[k] <= x:
-                    k += 1
-                y = float(k)/float(x)
-                line_data.append((x,y))
+            yvect = self.summarizer.calcSplitPosteriorSeries(self.split_index[k], xvect)
+            line_data.extend(zip(xvect[1:], yvect[1:]))
             data.append(line_data)
             
             splits_plotted += 1
@@ -293,73 +288,58 @@ class TreeSummarizer(CommonFunctions):
 
         return True
 
-    def recordTreeInMaps(self, tree, split_map, tree_key):
-        # Each split found in any tree is associated with a list by the dictionary split_map
-        #   The list is organized as follows:
-        #   - element 0 is the number of times the split was seen over all sampled trees
-        #       (this provides the posterior probability of this split when divided by the
-        #       number of trees sampled)
-        #   - element 1 holds the sum of edge lengths for this split (this provides the posterior
-        #       mean edge length corresponding to this split when divided by the value in element 0)
-        #   - elements 2... are, for internal nodes, the indices of trees in which the split was
-        #       found (this part is omitted for terminal nodes, which must appear in every tree)
-        #   From the tree index list we can compute the following quantities for internal splits:
-        #   1. the number of sojourns for each internal split (a sojourn is a series of consecutive
-        #      samples in which a split was found that is preceded and followed by at least one
-        #      sample not containing the split)
-        #   2. sliding window and cumulative plots, such as those produced by AWTY
-        # Each distinct tree topology is associated with a similar list:
-        #   - element 0 is again the number of times the tree topology was seen over all samples
-        #   - element 1 holds the newick tree description
-        #   - element 2 holds the sum of tree lengths over all sampled trees of this topology
-        #   - elements 3... are the indices of trees in which the topology was found. This list
-        #       allows the number and extent of each sojourn to be computed
-        nd = tree.getFirstPreorder()
-        assert nd.isRoot(), 'the first preorder node should be the root'
-        #split_vec = []
-        treelen = 0.0
-        has_edge_lens = tree.hasEdgeLens()
-        while True:
-            nd = nd.getNextPreorder()
-            if not nd:
-                break
-            else:
-                # Determine whether this split represents an internal or tip node
-                is_tip_node = nd.isTip() or nd.getParent().isRoot()
-                # Grab the edge length
-                edge_len = has_edge_lens and nd.getEdgeLen() or 1.0
-                treelen += edge_len
-                self.recordNodeInMaps(nd, split_map, tree_key, is_tip_node, edge_len)
-        return treelen
-
-    def recordNodeInMaps(self, nd, split_map, tree_key, is_tip_node, edge_len):
-        # Grab the split and invert it if necessary to attain a standard polarity
-        s = nd.getSplit()
-        if (not self.rooted_trees) and s.isBitSet(0):
-            s.invertSplit()
-            
-        # Create a string representation of the split
-        ss = s.createPatternRepresentation()
-
-        # Add string represention of the split to the tree_key list, which
-        # will be used to uniquely identify the tree topology
-        if not is_tip_node:                        
-            tree_key.append(ss)
-
-        # Update the dictionary entry corresponding to this split
-        if ss in split_map.keys():
-            # split has been seen before
-            entry = split_map[ss]
-            entry[0] += 1
-            entry[1] += edge_len
-            if not is_tip_node:
-                entry.append(self.num_trees_considered)
-        else:
-            # split not yet seen
-            if is_tip_node:
-                split_map[ss] = [1, edge_len]
-            else:
-                split_map[ss] = [1, edge_len, self.num_trees_considered]
+    def summaryMaps(self, summarizer):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a tuple (split_map, tree_map) of dictionaries built from the
+        splits and tree topologies tallied by the supplied
+        Phylogeny.TreeSummarizer, and saves in self.split_index a dictionary
+        associating each split pattern with its index in summarizer.
+        
+        Each split found in any tree is associated with a list by the
+        dictionary split_map. The list is organized as follows: element 0 is
+        the number of times the split was seen over all sampled trees (this
+        provides the posterior probability of this split when divided by
+        the number of trees sampled); element 1 holds the sum of edge lengths
+        for this split (this provides the posterior mean edge length
+        corresponding to this split when divided by the value in element 0);
+        elements 2... are, for internal nodes, the indices of trees in which
+        the split was found (this part is omitted for terminal nodes, which
+        must appear in every tree). The tree index list is used for sliding
+        window and cumulative plots, such as those produced by AWTY.
+        
+        Each distinct tree topology is associated by tree_map (whose keys
+        are sorted tuples of the patterns of its internal splits) with a
+        similar list: element 0 is again the number of times the tree
+        topology was seen over all samples; element 1 holds the index of
+        the topology in summarizer; element 2 holds the sum of tree lengths
+        over all sampled trees of this topology; and elements 3... are the
+        indices of trees in which the topology was found.
+        
+        Splits and topologies are entered in the order in which they were
+        first encountered, so ties are broken in the same way when these
+        dictionaries are sorted by frequency.
+        
+        """
+        split_map = {}
+        self.split_index = {}
+        patterns = []
+        for i in range(summarizer.getNumSplits()):
+            ss = summarizer.getSplitPattern(i)
+            patterns.append(ss)
+            self.split_index[ss] = i
+            entry = [summarizer.getSplitCount(i), summarizer.getSplitEdgeLenSum(i)]
+            if not summarizer.isTrivialSplit(i):
+                entry.extend(summarizer.getSplitSamples(i))
+            split_map[ss] = entry
+        tree_map = {}
+        for i in range(summarizer.getNumTopologies()):
+            tree_key = [patterns[j] for j in summarizer.getTopologySplits(i)]
+            tree_key.sort()
+            entry = [summarizer.getTopologyCount(i), i, summarizer.getTopologyTreeLenSum(i)]
+            entry.extend(summarizer.getTopologySamples(i))
+            tree_map[tuple(tree_key)] = entry
+        return split_map, tree_map
 
     def consensus(self):
         #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
@@ -377,66 +357,50 @@ class TreeSummarizer(CommonFunctions):
         
         num_trees = 0
         self.num_trees_considered = 0
-        split_map = {}
-        tree_map = {}
 
         # Open sumt_tfile_name and read trees therein
         self.stdout.info('\nReading %s...' % str(input_trees))
-        self.stored_tree_defs = list(input_trees)
-        self.taxon_labels = input_trees.taxon_labels # this must be kept after the coercion of the trees to a list (in case that is what triggers the readinf of the file with the taxon labels)
-
-        num_stored_trees = len(self.stored_tree_defs)
+        tree_reader = None
+        if input_trees.filename and Phylogeny.TreeSampleReader.isTreeSampleFile(input_trees.filename):
+            # Binary file saved by mcmc (see mcmc.binary_trees): trees are read directly
+            # into a Tree object below, so no tree descriptions are stored or parsed
+            tree_reader = Phylogeny.TreeSampleReader(input_trees.filename)
+            self.stdout.phycassert(tree_reader.isRooted() == bool(self.rooted_trees), 'Trees in %s are %s, so sumt.rooted should be %s' % (str(input_trees), tree_reader.isRooted() and 'rooted' or 'unrooted', tree_reader.isRooted()))
+            self.stored_tree_defs = None
+            self.taxon_labels = tree_reader.getTaxonLabels()
+            num_stored_trees = tree_reader.getNumTrees()
+        else:
+            self.stored_tree_defs = list(input_trees)
+            self.taxon_labels = input_trees.taxon_labels # this must be kept after the coercion of the trees to a list (in case that is what triggers the readinf of the file with the taxon labels)
+            num_stored_trees = len(self.stored_tree_defs)
         self.stdout.phycassert(num_stored_trees > 0, 'Specified tree source (%s) contained no stored trees' %  str(input_trees))
 
         # Build each tree and add the splits and tree topolgies found there to the
-        # dictionary of splits (split_map) and the dictionary of tree topologies
-        # (tree_map), respectively
+        # summary, from which the dictionary of splits (split_map) and the dictionary
+        # of tree topologies (tree_map) are then built
         self.stdout.info('Compiling lists of tree topologies and splits...')
         t = Phylogeny.Tree()
         if self.rooted_trees:
             t.setRooted()
 
         # values used for display purposes
-        split_field_width = 0
         sojourn_field_width = 2 + math.floor(math.log10(float(num_stored_trees)))
         
-        for tree_def in self.stored_tree_defs:
-            if num_trees < self.opts.burnin:
+        summarizer = Phylogeny.TreeSummarizer(self.rooted_trees)
+        if tree_reader is None:
+            for tree_def in self.stored_tree_defs:
                 num_trees += 1
-                continue
-            num_trees += 1
-            self.num_trees_considered += 1
-
-            # Create a tree key, which is a list of internal node splits that can be
-            # used to uniquely identify a tree topology
-            tree_key = []
-
-            # Build the tree
-            tree_def.buildTree(t)
-            t.rectifyNames(self.taxon_labels)
-            #ntips = t.getNTips()
-            ntips = t.getNObservables()
-            if ntips > split_field_width:
-                # this is necessary only if number of taxa varies from tree to tree
-                split_field_width = ntips
-            t.recalcAllSplits(ntips)
-            
-            treelen = self.recordTreeInMaps(t, split_map, tree_key)
-            
-            # Update tree_map, which is a map with keys equal to lists of internal node splits
-            # and values equal to 2-element lists containing the frequency and newick tree
-            # description
-            tree_key.sort()
-            k = tuple(tree_key)
-            if k in tree_map.keys():
-                # tree topology has been seen before
-                entry = tree_map[k]
-                entry[0] += 1
-                entry[2] += treelen
-                entry.append(self.num_trees_considered)
-            else:
-                # tree topology has not yet been seen
-                tree_map[k] = [1, tree_def, treelen, self.num_trees_considered]
+                if num_trees > self.opts.burnin:
+                    tree_def.buildTree(t)
+                    summarizer.addTree(t)
+        else:
+            # Binary file saved by mcmc (see mcmc.binary_trees): each tree is read
+            # directly into t and tallied without returning to Python
+            num_trees = summarizer.addTreesFromFile(tree_reader, self.opts.burnin, t)
+        self.num_trees_considered = summarizer.getNumTrees()
+        split_field_width = summarizer.getMaxNumTaxa()
+        split_map, tree_map = self.summaryMaps(summarizer)
+        self.summarizer = summarizer
 
         self.stdout.info('\nSummary of sampled trees:')
         self.stdout.info('-------------------------')
@@ -470,7 +434,6 @@ class TreeSummarizer(CommonFunctions):
         sk_str = sojourn_label_fmt_str % 'sk'
         k_str = sojourn_label_fmt_str % 'k'
         self.stdout.info('%6s %s %s %10s %10s %s %s %s' % ('split', split_str, freq_str, 'prob.', 'weight', s0_str, sk_str, k_str))
-        first_below_50 = None
         num_trivial = 0
         split_info = []
         for i,(k,v) in enumerate(split_vect):
@@ -489,27 +452,14 @@ class TreeSummarizer(CommonFunctions):
             # split_weight is the sum of edge lengths v[1] divided by the split_freq
             split_weight = float(v[1])/float(split_freq)
 
-            # Identify the index of the first split having a posterior probability
-            # lower than 0.5. The list up to this point will be used to generate the
-            # majority-rule consensus tree
-            if not first_below_50 and split_posterior < 0.5:
-                first_below_50 = i
-
             # Determine first sojourn (the third element of the list)
             first_sojourn_start = trivial_split and 1 or v[2]
 
             # Determine last sojourn (the final element of the list)
             last_sojourn_end = trivial_split and self.num_trees_considered or v[-1]
 
-            # Determine the number of sojourns (this must be counted)
-            num_sojourns = 1
-            if not trivial_split:
-                in_sojourn = True
-                prev = v[2]
-                for curr in v[3:]:
-                    if curr - prev > 1:
-                        num_sojourns += 1
-                    prev = curr
+            # Determine the number of sojourns
+            num_sojourns = summarizer.countSplitSojourns(self.split_index[k])
 
             split_str = split_fmt_str % k            
             freq_str = sojourn_fmt_str % split_freq
@@ -525,10 +475,7 @@ class TreeSummarizer(CommonFunctions):
         if self.rooted_trees:
             majrule.setRooted()
         tm = Phylogeny.TreeManip(majrule)
-        majrule_splits = []
-        for k,v in split_vect[:first_below_50]:
-            if len(v) > 2:
-                majrule_splits.append(k)
+        majrule_splits = [summarizer.getSplitPattern(i) for i in summarizer.getMajorityRuleSplits()]
         
         if len(majrule_splits) == 0:
             tm.starTree(num_trivial)
@@ -574,14 +521,8 @@ class TreeSummarizer(CommonFunctions):
                 # Determine the sampled tree that ended the last sojourn (the final element of the list)
                 last_sojourn_end = v[-1]
 
-                # Determine the number of sojourns (this must be counted)
-                num_sojourns = 1
-                in_sojourn = True
-                prev = v[3]
-                for curr in v[4:]:
-                    if curr - prev > 1:
-                        num_sojourns += 1
-                    prev = curr
+                # Determine the number of sojourns
+                num_sojourns = summarizer.countTopologySojourns(v[1])
 
                 # Output summary line for this tree topology                
                 freq_str = sojourn_fmt_str % v[0]
@@ -594,7 +535,7 @@ class TreeSummarizer(CommonFunctions):
                 t = Phylogeny.Tree()
                 if self.rooted_trees:
                     t.setRooted()
-                v[1].buildTree(t)
+                t.buildFromString(summarizer.getTopologyNewick(v[1]), False)
                 self.assignEdgeLensAndSupportValues(t, split_map, self.num_trees_considered)
                 t.stripNodeNames()
                 summary_short_name_list.append('%d %d of %d' % (i+1,v[0], self.num_trees_considered))
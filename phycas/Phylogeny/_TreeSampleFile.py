@@ -0,0 +1,223 @@
+from _PhylogenyExt import *
+
+class TreeSampleWriter(TreeSampleWriterBase):
+    #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+    """
+    Saves sampled trees to a compact binary file rather than as NEXUS
+    tree descriptions. Each tree is stored as arrays of parent indices
+    and node numbers in preorder sequence followed by its edge lengths,
+    and the arrays describing the topology are omitted whenever the
+    topology is the same as that of the previous tree. The sumt command
+    reads these files directly, and TreeSampleReader.exportNexus
+    converts them to NEXUS tree files. Provides the name, flush, tell
+    and close members of a file object so that it can be handled like
+    the other MCMC output files.
+
+    If filename is empty, trees are only held in memory until they are
+    passed to another TreeSampleWriter by transferTo.
+
+    """
+    def __init__(self, filename = ''):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Stores filename. The file is not created until create is called.
+
+        """
+        TreeSampleWriterBase.__init__(self, filename)
+        self.name = filename
+
+    def create(self, taxon_labels, rooted = False):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Creates the file and writes a header holding the taxon labels (in
+        the order of the tip node numbers) and whether the trees are
+        rooted.
+
+        """
+        TreeSampleWriterBase.create(self, list(taxon_labels), rooted)
+
+    def reopen(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Opens an existing file so that further trees are added to the end
+        of it.
+
+        """
+        TreeSampleWriterBase.reopen(self)
+
+    def addTree(self, cycle, tree):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Adds tree, which was sampled at the supplied cycle.
+
+        """
+        TreeSampleWriterBase.addTree(self, cycle, tree)
+
+    def transferTo(self, other):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Adds every tree held in memory by this writer to the
+        TreeSampleWriter other, leaving this writer empty.
+
+        """
+        TreeSampleWriterBase.transferTo(self, other)
+
+    def flush(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Hands the trees added so far to the background thread that writes
+        the file, without waiting for them to be written.
+
+        """
+        TreeSampleWriterBase.flush(self)
+
+    def tell(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Waits until every tree added is in the file and returns the length
+        of the file in bytes.
+
+        """
+        return long(TreeSampleWriterBase.tell(self))
+
+    def close(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Closes the file once every tree has been written.
+
+        """
+        TreeSampleWriterBase.close(self)
+
+    def setFlushInterval(self, seconds):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Trees are written to the file by a background thread, which flushes
+        the file at most once every seconds seconds (after every batch of
+        trees if seconds is 0.0).
+
+        """
+        TreeSampleWriterBase.setFlushInterval(self, seconds)
+
+class TreeSampleReader(TreeSampleReaderBase):
+    #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+    """
+    Reads the trees in a file written by TreeSampleWriter, one at a time.
+    Trees are built directly from the stored arrays, so no tree
+    descriptions need to be parsed. When consecutive trees share a
+    topology and are read into the same Tree object, only the edge
+    lengths are replaced.
+
+    """
+    def __init__(self, filename):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Opens filename and reads its header.
+
+        """
+        TreeSampleReaderBase.__init__(self, filename)
+        self.name = filename
+
+    def isTreeSampleFile(filename):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True if filename was written by a TreeSampleWriter (as
+        opposed to being a NEXUS tree file).
+
+        """
+        return TreeSampleReaderBase.isTreeSampleFile(filename)
+
+    isTreeSampleFile = staticmethod(isTreeSampleFile)
+
+    def getTaxonLabels(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list of the taxon labels stored in the file header.
+
+        """
+        return list(TreeSampleReaderBase.getTaxonLabels(self))
+
+    def isRooted(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True if the trees in the file are rooted.
+
+        """
+        return TreeSampleReaderBase.isRooted(self)
+
+    def getNumTrees(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of trees in the file.
+
+        """
+        return TreeSampleReaderBase.getNumTrees(self)
+
+    def readNext(self, tree):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Reads the next tree in the file into tree, returning False if
+        there are no more trees. The topology and node numbers of tree
+        should not be changed between calls. Tip nodes are not named; use
+        tree.rectifyNames(self.getTaxonLabels()) if names are needed.
+
+        """
+        return TreeSampleReaderBase.readNext(self, tree)
+
+    def rewind(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns to the first tree in the file.
+
+        """
+        TreeSampleReaderBase.rewind(self)
+
+    def getCycle(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the cycle at which the tree most recently read was sampled.
+
+        """
+        return TreeSampleReaderBase.getCycle(self)
+
+    def topologyChanged(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns False if the tree most recently read has the same topology
+        as the tree read before it.
+
+        """
+        return TreeSampleReaderBase.topologyChanged(self)
+
+    def exportNexus(self, filename, ndecimals = 8):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Writes every tree in the file to a NEXUS tree file named filename,
+        in the same format as the tree files saved by the mcmc command (a
+        translate table followed by one tree description per sample, with
+        edge lengths shown to ndecimals decimal places). Returns the number
+        of trees written.
+
+        """
+        from _Tree import Tree
+        labels = self.getTaxonLabels()
+        ntax = len(labels)
+        f = open(filename, 'w')
+        f.write('#NEXUS\n')
+        f.write('begin trees;\n')
+        if ntax > 0:
+            f.write('\ttranslate\n')
+            for i,label in enumerate(labels):
+                if label.find(' ') < 0:
+                    f.write('\t\t%d %s%s\n' % (i + 1, label, i == ntax - 1 and ';' or ','))
+                else:
+                    f.write("\t\t%d '%s'%s\n" % (i + 1, label, i == ntax - 1 and ';' or ','))
+        self.rewind()
+        t = Tree()
+        n = 0
+        while self.readNext(t):
+            f.write('\ttree rep.%d = %s;\n' % (self.getCycle(), t.makeNewick(ndecimals)))
+            n += 1
+        f.write('end;\n')
+        f.close()
+        self.rewind()
+        return n
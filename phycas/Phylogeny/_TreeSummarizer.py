@@ -0,0 +1,208 @@
+from _PhylogenyExt import *
+
+class TreeSummarizer(TreeSummarizerBase):
+    #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+    """
+    Tallies the splits and distinct tree topologies found in a sample of
+    trees, such as the trees saved by the mcmc command. For each split,
+    the number of trees containing it, the sum of its edge lengths and
+    the (1-based) indices of the trees containing it are recorded; the
+    same quantities (with tree length in place of edge length) are
+    recorded for each distinct topology. Splits of unrooted trees are
+    stored with the first taxon excluded, and splits and topologies are
+    numbered in the order in which they were first encountered. Tip
+    splits (those separating a single taxon from the others) are
+    counted, but the trees in which they were found are not recorded.
+
+    """
+    def __init__(self, rooted = False):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Creates an empty summary of rooted (if rooted is True) or unrooted
+        trees.
+
+        """
+        TreeSummarizerBase.__init__(self, rooted)
+
+    def clear(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Forgets all trees added so far.
+
+        """
+        TreeSummarizerBase.clear(self)
+
+    def addTree(self, tree):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Adds the splits and topology of tree to the summary. The splits
+        stored in the nodes of tree are recalculated. If tree has no edge
+        lengths, every edge is taken to have length 1.0.
+
+        """
+        TreeSummarizerBase.addTree(self, tree)
+
+    def addTreesFromFile(self, reader, burnin, tree):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Reads every remaining tree from the TreeSampleReader reader into
+        the supplied tree, adding all but the first burnin trees to the
+        summary. No Python code is run for each tree. Returns the number
+        of trees read, including those skipped.
+
+        """
+        return TreeSummarizerBase.addTreesFromFile(self, reader, burnin, tree)
+
+    def getNumTrees(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of trees added.
+
+        """
+        return TreeSummarizerBase.getNumTrees(self)
+
+    def getMaxNumTaxa(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the largest number of tips in any tree added.
+
+        """
+        return TreeSummarizerBase.getMaxNumTaxa(self)
+
+    def getNumSplits(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of distinct splits found, including tip splits.
+
+        """
+        return TreeSummarizerBase.getNumSplits(self)
+
+    def getSplitPattern(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the pattern representation of split i (see
+        Split.createPatternRepresentation).
+
+        """
+        return TreeSummarizerBase.getSplitPattern(self, i)
+
+    def isTrivialSplit(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns True if split i was only ever found as a tip split.
+
+        """
+        return TreeSummarizerBase.isTrivialSplit(self, i)
+
+    def getSplitCount(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of trees containing split i.
+
+        """
+        return TreeSummarizerBase.getSplitCount(self, i)
+
+    def getSplitEdgeLenSum(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the sum of the edge lengths of split i over all trees
+        containing it.
+
+        """
+        return TreeSummarizerBase.getSplitEdgeLenSum(self, i)
+
+    def getSplitSamples(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list of the indices (starting at 1) of the trees in
+        which split i was found other than as a tip split.
+
+        """
+        return list(TreeSummarizerBase.getSplitSamples(self, i))
+
+    def countSplitSojourns(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of runs of consecutive trees containing split i.
+
+        """
+        return TreeSummarizerBase.countSplitSojourns(self, i)
+
+    def calcSplitPosteriorSeries(self, i, xvect):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list holding, for each number of trees x in the
+        increasing list xvect, the fraction of the first x trees that
+        contain split i (0.0 if x is 0), as plotted by AWTY.
+
+        """
+        return list(TreeSummarizerBase.calcSplitPosteriorSeries(self, i, xvect))
+
+    def getMajorityRuleSplits(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list of the indices of the non-trivial splits found in
+        at least half of the trees, from most to least frequent. These are
+        the splits of the majority-rule consensus tree.
+
+        """
+        return list(TreeSummarizerBase.getMajorityRuleSplits(self))
+
+    def getNumTopologies(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of distinct tree topologies found.
+
+        """
+        return TreeSummarizerBase.getNumTopologies(self)
+
+    def getTopologyCount(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of trees having topology i.
+
+        """
+        return TreeSummarizerBase.getTopologyCount(self, i)
+
+    def getTopologyTreeLenSum(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the sum of the lengths of the trees having topology i.
+
+        """
+        return TreeSummarizerBase.getTopologyTreeLenSum(self, i)
+
+    def getTopologySamples(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list of the indices (starting at 1) of the trees having
+        topology i.
+
+        """
+        return list(TreeSummarizerBase.getTopologySamples(self, i))
+
+    def getTopologySplits(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a list of the indices of the non-trivial splits making up
+        topology i.
+
+        """
+        return list(TreeSummarizerBase.getTopologySplits(self, i))
+
+    def getTopologyNewick(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the numbered newick description of the first tree found
+        having topology i.
+
+        """
+        return TreeSummarizerBase.getTopologyNewick(self, i)
+
+    def countTopologySojourns(self, i):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns the number of runs of consecutive trees having topology i.
+
+        """
+        return TreeSummarizerBase.countTopologySojourns(self, i)
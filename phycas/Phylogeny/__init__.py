@@ -6,6 +6,8 @@ from _PhylogenyExt import *
 from _Tree import *
 from _TreeManip import *
 from _Split import *
+from _TreeSampleFile import *
+from _TreeSummarizer import *
 
 #print 'importing Phylogeny...'
 
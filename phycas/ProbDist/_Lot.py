@@ -90,3 +90,94 @@ class Lot(LotBase):
         """
         return LotBase.sampleUInt(self, upper_bound)
     
+
+    def useXoshiro(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Switches this Lot to the xoshiro256** engine and restarts it from
+        the seed returned by getInitSeed. The xoshiro256** engine has a
+        period of 2^256 - 1 and can jump ahead 2^128 draws at once, so it
+        can supply many non-overlapping streams (see useStream). The
+        default engine (a Lehmer generator with period 2^31 - 2) is
+        retained so that results obtained with earlier versions can be
+        reproduced.
+
+        >>> from phycas.ProbDist import *
+        >>> lot = Lot(1357)
+        >>> lot.useXoshiro()
+        >>> lot.getEngine() == LotEngine.xoshiro256ss
+        True
+
+        """
+        LotBase.setEngine(self, LotEngine.xoshiro256ss)
+
+    def useLehmer(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Switches this Lot back to the default (Lehmer) engine and restarts
+        it from the seed returned by getInitSeed.
+
+        """
+        LotBase.setEngine(self, LotEngine.lehmer)
+
+    def useStream(self, parent, stream):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Makes this Lot generate stream number stream derived from the seed
+        of the Lot parent, using the same engine as parent. No numbers are
+        drawn from parent. Give each chain (or thread) its own stream so
+        that chains never share a generator. With the xoshiro256** engine,
+        streams are guaranteed not to overlap; with the Lehmer engine each
+        stream simply starts from a different seed.
+
+        >>> from phycas.ProbDist import *
+        >>> master = Lot(1357)
+        >>> master.useXoshiro()
+        >>> a = Lot()
+        >>> a.useStream(master, 1)
+        >>> b = Lot()
+        >>> b.useStream(master, 1)
+        >>> a.uniform() == b.uniform()
+        True
+        >>> a.getStream()
+        1
+
+        """
+        LotBase.useStream(self, parent, stream)
+
+    def getState(self):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a string holding the complete state of this Lot. Passing
+        this string to setState (of this or any other Lot) resumes the
+        sequence of pseudorandom numbers exactly where it left off.
+
+        >>> from phycas.ProbDist import *
+        >>> lot = Lot(1357)
+        >>> s = lot.getState()
+        >>> u = lot.uniform()
+        >>> lot.setState(s)
+        >>> lot.uniform() == u
+        True
+
+        """
+        return LotBase.getState(self)
+
+    def setState(self, state):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Restores the state saved by getState. Raises an exception if state
+        was not returned by getState.
+
+        """
+        LotBase.setState(self, state)
+
+    def uniforms(self, n):
+        #---+----|----+----|----+----|----+----|----+----|----+----|----+----|
+        """
+        Returns a tuple of n pseudorandom numbers between 0.0 and 1.0,
+        identical to the numbers that n calls to uniform would return but
+        generated in a single call to the underlying C++ code.
+
+        """
+        return LotBase.getUniforms(self, n)
@@ -0,0 +1,116 @@
+# This example checks adaptation of the weights of Metropolis-Hastings moves (mcmc.adapt_weights
+# = True), in which each move is attempted more or less often according to the number of
+# proposals it gets accepted per second of computing time. With adapt_first = 10 and a burn-in
+# of 100 cycles, weights must be adapted at cycles 10, 30 and 70 and never again (slice
+# samplers are adapted once more, at cycle 150, after burn-in). No weight may ever be more than
+# adapt_weights_max_factor times larger or smaller than the weight originally specified, the
+# weights at the end of the run must be those in effect when burn-in ended, and each
+# adaptation must print the new allocation of every move. Only whether the checks passed is
+# written to output.txt.
+
+import copy
+from phycas import *
+from phycas.Phycas.MCMCImpl import MCMCImpl
+
+max_factor = 2.0
+
+def moveWeights(impl):
+    # Returns a list of (name, weight) pairs for the Metropolis-Hastings moves of the cold chain
+    cm = impl.mcmc_manager.getColdChainManager()
+    return [(u.getName(), u.getWeight()) for u in cm.getAllUpdaters() if u.isMove() and not u.hasSliceSampler() and not u.isFixed() and u.getWeight() > 0]
+
+# Records the weights when burn-in begins and ends (setHMCAdaptation is called at both times)
+phase_weights = []
+original_setHMCAdaptation = MCMCImpl.setHMCAdaptation
+def recordingSetHMCAdaptation(self, adapting, chains = None):
+    original_setHMCAdaptation(self, adapting, chains)
+    phase_weights.append((adapting, moveWeights(self)))
+
+# Records the weights after every adaptation
+adapted_weights = []
+original_adaptUpdaterWeights = MCMCImpl.adaptUpdaterWeights
+def recordingAdaptUpdaterWeights(self, chain_manager = None, label = ''):
+    original_adaptUpdaterWeights(self, chain_manager, label)
+    adapted_weights.append(moveWeights(self))
+
+# Records everything output
+messages = []
+original_output = MCMCImpl.output
+def recordingOutput(self, msg = ''):
+    messages.append(msg)
+    original_output(self, msg)
+
+def withinFactor(w, w0):
+    # Weights are whole numbers no smaller than 1
+    return w <= w0*max_factor and (w*max_factor >= w0 or w == 1)
+
+def lastReport():
+    # Returns (weight, initial weight, name) for each row of the last allocation printed
+    rows = []
+    heading = [i for i,msg in enumerate(messages) if msg.strip() == 'Move weights:']
+    if heading:
+        for msg in messages[heading[-1] + 2:]:
+            words = msg.split()
+            if len(words) != 5 or not words[0].isdigit() or not words[1].isdigit():
+                break
+            rows.append((int(words[0]), int(words[1]), words[4]))
+    return rows
+
+def check(ok):
+    return ok and 'yes' or 'NO'
+
+outf = open('output.txt', 'w')
+
+model.type               = 'hky'
+model.num_rates          = 4
+model.pinvar_model       = False
+model.edgelen_prior      = Exponential(10.0)
+model.edgelen_hyperprior = None
+
+blob = readFile(getPhycasTestData('nyldna4.nex'))
+rng = ProbDist.Lot()
+rng.setSeed(13579)
+mcmc.data_source              = blob.characters
+mcmc.rng                      = rng
+mcmc.starting_tree_source     = randomtree(n_taxa=len(blob.taxon_labels), rng=rng)
+mcmc.out.log                  = 'output.log'
+mcmc.out.log.mode             = REPLACE
+mcmc.out.trees                = 'trees.t'
+mcmc.out.trees.mode           = REPLACE
+mcmc.out.params               = 'params.p'
+mcmc.out.params.mode          = REPLACE
+mcmc.verbose                  = True
+mcmc.burnin                   = 100
+mcmc.ncycles                  = 100
+mcmc.sample_every             = 10
+mcmc.adapt_first              = 10
+mcmc.ls_move_weight           = 20
+mcmc.tree_scaler_weight       = 20
+mcmc.adapt_weights            = True
+mcmc.adapt_weights_max_factor = max_factor
+
+MCMCImpl.setHMCAdaptation = recordingSetHMCAdaptation
+MCMCImpl.adaptUpdaterWeights = recordingAdaptUpdaterWeights
+MCMCImpl.output = recordingOutput
+impl = MCMCImpl(copy.deepcopy(mcmc))
+impl.run()
+MCMCImpl.setHMCAdaptation = original_setHMCAdaptation
+MCMCImpl.adaptUpdaterWeights = original_adaptUpdaterWeights
+MCMCImpl.output = original_output
+
+original = dict(phase_weights[0][1])
+final = moveWeights(impl)
+outf.write('HKY+G, nyldna4, adapt_weights_max_factor = %g:\n' % max_factor)
+outf.write('  weights recorded when burn-in began and ended: %s\n' % check([adapting for adapting, w in phase_weights] == [True, False]))
+outf.write('  at least two moves compared: %s\n' % check(len(original) >= 2))
+outf.write('  weights adapted 3 times during burn-in: %s\n' % check(len(adapted_weights) == 3))
+outf.write('  some weights changed: %s\n' % check(len([1 for weights in adapted_weights for name, w in weights if w != original[name]]) > 0))
+outf.write('  weights within max factor of original: %s\n' % check(len([1 for weights in adapted_weights + [final] for name, w in weights if not withinFactor(w, original[name])]) == 0))
+outf.write('  weights fixed after burn-in: %s\n' % check(len(adapted_weights) > 0 and phase_weights[1][1] == adapted_weights[-1] and final == adapted_weights[-1]))
+outf.write('  allocation printed after each adaptation: %s\n' % check(len([1 for msg in messages if msg.strip() == 'Move weights:']) == len(adapted_weights)))
+report = lastReport()
+outf.write('  allocation printed lists every move: %s\n' % check(sorted([(name, w) for w, w0, name in report]) == sorted(final)))
+outf.write('  allocation printed gives original weights: %s\n' % check(len(report) > 0 and len([1 for w, w0, name in report if w0 != original[name]]) == 0))
+outf.write('\n')
+
+outf.close()
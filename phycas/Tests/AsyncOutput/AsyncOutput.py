@@ -0,0 +1,121 @@
+# This example checks AsyncFileWriter, which writes the parameter and tree files in a separate
+# thread when mcmc.background_output is True (the default). Several megabytes of lines of
+# varying length (far more than the 16 blocks of 64 KiB that the writer's ring can hold) are
+# written to one file through an AsyncFileWriter with a very short flush interval and to
+# another through an ordinary Python file, flushing now and then and checking the length
+# reported by tell (which waits for the writer thread) against the length of the file on disk.
+# Both files must be identical, as must files extended after being reopened for appending. A
+# file closed while the ring is still full of blocks, with a partly filled block left over,
+# must contain every byte written. Finally, an MCMC analysis must write the same parameter and
+# tree files whether or not background_output is True. Only whether the checks passed is
+# written to output.txt.
+
+import copy, os
+from phycas import *
+from phycas.Phycas.MCMCImpl import MCMCImpl
+
+def contents(filename):
+    return open(filename, 'rb').read()
+
+def makeLines(lot, n):
+    # Returns n lines of between 1 and about 1000 characters
+    lines = []
+    for i in range(n):
+        words = ['%.17g' % lot.uniform() for k in range(lot.sampleUInt(40))]
+        lines.append('%d\t%s\n' % (i, '\t'.join(words)))
+    return lines
+
+def writeLines(f, lines, sync_every = 0):
+    # Writes lines to f, flushing every 7 lines. If sync_every is greater than 0, f is an
+    # AsyncFileWriter whose reported length is checked against the length of the file on disk
+    # every sync_every lines; returns False if they ever disagree.
+    lengths_ok = True
+    for i,line in enumerate(lines):
+        f.write(line)
+        if (i + 1) % 7 == 0:
+            f.flush()
+        if sync_every > 0 and (i + 1) % sync_every == 0:
+            if f.tell() != os.path.getsize(f.name):
+                lengths_ok = False
+    return lengths_ok
+
+def check(ok):
+    return ok and 'yes' or 'NO'
+
+outf = open('output.txt', 'w')
+
+lot = ProbDist.Lot()
+lot.setSeed(24680)
+lot.useXoshiro()
+lines = makeLines(lot, 12000)
+total = sum([len(line) for line in lines])
+more_lines = makeLines(lot, 3000)
+
+outf.write('AsyncFileWriter compared with ordinary file:\n')
+outf.write('  more than 16 blocks of 64 KiB written: %s\n' % check(total > 16*65536))
+
+f = open('sync.txt', 'wb')
+writeLines(f, lines)
+f.close()
+f = Likelihood.AsyncFileWriter('async.txt', False, 0.001)
+lengths_ok = writeLines(f, lines, 1000) and f.tell() == total
+f.close()
+outf.write('  tell agrees with length of file: %s\n' % check(lengths_ok))
+outf.write('  identical files: %s\n' % check(contents('async.txt') == contents('sync.txt')))
+
+f = open('sync.txt', 'ab')
+writeLines(f, more_lines)
+f.close()
+f = Likelihood.AsyncFileWriter('async.txt', True, 0.001)
+lengths_ok = writeLines(f, more_lines, 500)
+f.close()
+outf.write('  identical files after appending: %s\n' % check(lengths_ok and contents('async.txt') == contents('sync.txt')))
+
+# Blocks larger than 64 KiB are handed off as soon as they are written, so this fills the
+# ring faster than the writer thread can empty it; the final short line stays in the
+# producer's block until close
+big = ''.join(lines[:1000])
+f = Likelihood.AsyncFileWriter('full.txt', False, 0.001)
+for i in range(40):
+    f.write(big)
+f.write(lines[0])
+f.close()
+outf.write('  file closed with full ring complete: %s\n' % check(contents('full.txt') == 40*big + lines[0]))
+outf.write('\n')
+
+def runMCMC(blob, background_output, prefix):
+    rng = ProbDist.Lot()
+    rng.setSeed(13579)
+    mcmc.out.log              = prefix + '.log'
+    mcmc.out.log.mode         = REPLACE
+    mcmc.out.trees            = prefix + '.t'
+    mcmc.out.trees.mode       = REPLACE
+    mcmc.out.params           = prefix + '.p'
+    mcmc.out.params.mode      = REPLACE
+    mcmc.rng                  = rng
+    mcmc.starting_tree_source = randomtree(n_taxa=len(blob.taxon_labels), rng=rng)
+    mcmc.background_output    = background_output
+    mcmc.flush_interval       = 0.0
+    impl = MCMCImpl(copy.deepcopy(mcmc))
+    impl.run()
+
+model.type               = 'hky'
+model.num_rates          = 4
+model.pinvar_model       = False
+model.edgelen_prior      = Exponential(10.0)
+model.edgelen_hyperprior = None
+
+blob = readFile(getPhycasTestData('nyldna4.nex'))
+mcmc.data_source  = blob.characters
+mcmc.burnin       = 0
+mcmc.ncycles      = 200
+mcmc.sample_every = 1
+
+runMCMC(blob, True, 'background')
+runMCMC(blob, False, 'foreground')
+outf.write('HKY+G, nyldna4, 200 samples:\n')
+outf.write('  identical parameter files with and without background output: %s\n' % check(contents('background.p') == contents('foreground.p')))
+outf.write('  identical tree files with and without background output: %s\n' % check(contents('background.t') == contents('foreground.t')))
+outf.write('\n')
+
+outf.close()
@@ -0,0 +1,181 @@
+# This example checks that every level of the loops used to compute conditional
+# likelihood arrays (0 = scalar, 1 = SSE2, 2 = AVX2, 3 = AVX-512) that is supported
+# by this processor gives the same log-likelihood as the scalar (reference) loops.
+# Which levels were actually checked depends on the processor, so that information
+# is only printed to the console; output.txt is the same on every machine. It also
+# checks that dividing the patterns among several threads gives exactly the same
+# log-likelihood as using a single thread. Finally, it checks that allocating conditional
+# likelihood arrays from slabs (like.cla_arena and mcmc.cla_arena) gives exactly the same
+# log-likelihoods as allocating each one separately, both while edge lengths are changed
+# one at a time and during a short MCMC analysis whose topology moves return arrays to the
+# pool and take them out again.
+
+import os
+from phycas import *
+from phycas.Phycas.LikeImpl import LikeImpl
+from phycas.Phycas.LikelihoodCore import LikelihoodCore
+
+def samples(filename):
+    # Returns the lines of a params or tree file, omitting comments such as the [ID: ...] line
+    return [line for line in open(filename) if not line.startswith('[')]
+
+def buildLikelihood(matrix, cla_arena):
+    # Build the TreeLikelihood object exactly as like() would
+    like.cla_arena = cla_arena
+    impl = LikeImpl(like)
+    impl._loadData(matrix)
+    core = LikelihoodCore(impl)
+    core.setupCore()
+    core.prepareForLikelihood()
+    like.cla_arena = False
+    return core
+
+def edgeChangeLnLs(matrix, cla_arena):
+    # Changes several internal edge lengths one at a time, recomputing the likelihood around
+    # each changed node (which returns the invalidated arrays to the pool and takes them out
+    # again), and returns the log-likelihood after each change
+    core = buildLikelihood(matrix, cla_arena)
+    lnLs = [core.likelihood.calcLnL(core.tree)]
+    internals = [nd for nd in core.tree.nodesWithEdges() if nd.isInternal()]
+    for k, new_edgelen in [(1, 0.05), (5, 0.2), (9, 0.01), (1, 0.3)]:
+        nd = internals[k]
+        nd.setEdgeLen(new_edgelen)
+        core.likelihood.invalidateAwayFromNode(nd)
+        lnLs.append(core.likelihood.calcLnLFromNode(nd, core.tree))
+    return core.likelihood.isUsingCLAArena(), lnLs
+
+def runMCMC(blob, cla_arena, prefix):
+    rng = ProbDist.Lot()
+    rng.setSeed(13579)
+    mcmc.cla_arena            = cla_arena
+    mcmc.out.log              = prefix + '.log'
+    mcmc.out.log.mode         = REPLACE
+    mcmc.out.trees            = prefix + '.t'
+    mcmc.out.trees.mode       = REPLACE
+    mcmc.out.params           = prefix + '.p'
+    mcmc.out.params.mode      = REPLACE
+    mcmc.nchains              = 1
+    mcmc.ncycles              = 20
+    mcmc.sample_every         = 2
+    mcmc.rng                  = rng
+    mcmc.data_source          = blob.characters
+    mcmc.starting_tree_source = randomtree(n_taxa=len(blob.taxon_labels), rng=rng)
+    mcmc()
+    mcmc.cla_arena            = False
+
+def checkAllLevels(title, matrix, ndecimals):
+    # Build the TreeLikelihood object exactly as like() would
+    impl = LikeImpl(like)
+    impl._loadData(matrix)
+    core = LikelihoodCore(impl)
+    core.setupCore()
+    core.prepareForLikelihood()
+    
+    core.likelihood.setCLAKernelLevel(0)
+    ref_lnL = core.likelihood.calcLnL(core.tree)
+    print '%s: level 0 (%s) lnL = %.8f' % (title, core.likelihood.getCLAKernelName(), ref_lnL)
+
+    all_agree = True
+    for level in range(1, 4):
+        core.likelihood.setCLAKernelLevel(level)
+        if core.likelihood.getCLAKernelLevel() != level:
+            print '%s: level %d not supported by this processor' % (title, level)
+            break
+        lnL = core.likelihood.calcLnL(core.tree)
+        print '%s: level %d (%s) lnL = %.8f' % (title, level, core.likelihood.getCLAKernelName(), lnL)
+        if abs(lnL - ref_lnL) > 1.e-8*abs(ref_lnL):
+            all_agree = False
+
+    # Setting the kernel level forces all conditional likelihood arrays to be recomputed
+    core.likelihood.setCLAKernelLevel(0)
+    one_thread_lnL = core.likelihood.calcLnL(core.tree)
+    core.likelihood.setNumThreads(4)
+    core.likelihood.setCLAKernelLevel(0)
+    four_thread_lnL = core.likelihood.calcLnL(core.tree)
+    core.likelihood.setNumThreads(1)
+    print '%s: 1 thread lnL = %.8f, %d threads lnL = %.8f' % (title, one_thread_lnL, 4, four_thread_lnL)
+
+    outf.write('%s:\n' % title)
+    if ndecimals > 0:
+        outf.write('  lnL = %.*f\n' % (ndecimals, ref_lnL))
+    outf.write('  all kernel levels agree: %s\n' % (all_agree and 'yes' or 'NO'))
+    outf.write('  1 and 4 threads agree: %s\n\n' % (one_thread_lnL == four_thread_lnL and 'yes' or 'NO'))
+
+outf = open('output.txt', 'w')
+
+# 4 states, GTR+I+G, underflow correction used (see also the Underflow example)
+model.type = 'gtr'
+model.pinvar_model = True
+model.edgelen_hyperprior = None
+model.state_freqs = [0.339271, 0.154491, 0.134649, 0.371589]
+model.relrates    = [1.144048, 5.419204, 0.454958, 1.766404, 5.546350, 1.0]
+model.gamma_shape = 0.906291 
+model.pinvar      = 0.442154
+model.num_rates   = 4
+
+blob = readFile(getPhycasTestData('rbcL50.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(filename=os.path.join('..', 'Underflow', 'gtrig.rbcL50.best.tre'))
+like.starting_edgelen_dist = None
+like.uf_num_edges = 5
+checkAllLevels('GTR+I+G, rbcL50 (correct lnL = -18117.830737)', blob.characters.getMatrix(), 6)
+
+# 4 states, HKY+G, tree with polytomies (exercises conditionOnAdditionalTip/Internal)
+model.type        = 'hky'
+model.pinvar_model = False
+model.num_rates   = 4
+model.state_freqs = [0.25, 0.25, 0.25, 0.25]
+model.kappa       = 4.0
+model.gamma_shape = 0.5
+
+blob = readFile(getPhycasTestData('ShoupLewis.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(filename=os.path.join('..', 'Underflow', 'polytomous.tre'))
+like.starting_edgelen_dist = None
+like.uf_num_edges = 5
+checkAllLevels('HKY+G, polytomous tree (correct lnL = -16403.967004)', blob.characters.getMatrix(), 6)
+
+# 61 states, codon model (number of states not a multiple of any vector width)
+model.type        = 'codon'
+model.num_rates   = 1
+model.pinvar_model = False
+model.state_freqs = [1.0/61.0]*61
+model.state_freq_prior = Dirichlet([1.0]*61)
+model.kappa       = 2.0
+model.omega       = 0.5
+
+blob = readFile(getPhycasTestData('green.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(newick='(8:0.56880388,(((3:0.40888265,(1:1.03799510,2:0.41917430):0.03417782):0.16416599,4:0.29333306):0.14865078,(6:0.28599164,((7:0.14870266,10:0.32973086):0.06151508,9:0.24129778):0.17828009):0.11396143):0.15762955,5:0.29601916);')
+like.starting_edgelen_dist = None
+like.uf_num_edges = 50
+checkAllLevels('Codon model, green', blob.characters.getMatrix(), 0)
+
+# Conditional likelihood arrays allocated from slabs, HKY+G
+model.type         = 'hky'
+model.num_rates    = 4
+model.pinvar_model = False
+model.state_freqs  = [0.25, 0.25, 0.25, 0.25]
+model.state_freq_prior = Dirichlet([1.0]*4)
+model.kappa        = 4.0
+model.gamma_shape  = 0.5
+model.edgelen_prior = ProbDist.Exponential(10.0)
+
+blob = readFile(getPhycasTestData('rbcL50.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(filename=os.path.join('..', 'Underflow', 'gtrig.rbcL50.best.tre'))
+like.starting_edgelen_dist = None
+like.uf_num_edges = 5
+arena_used, arena_lnLs = edgeChangeLnLs(blob.characters.getMatrix(), True)
+separate_used, separate_lnLs = edgeChangeLnLs(blob.characters.getMatrix(), False)
+print 'edge changes: lnL with arena = %s' % ', '.join(['%.8f' % x for x in arena_lnLs])
+print 'edge changes: lnL without arena = %s' % ', '.join(['%.8f' % x for x in separate_lnLs])
+runMCMC(blob, True, 'arena')
+runMCMC(blob, False, 'separate')
+outf.write('HKY+G, rbcL50, conditional likelihood arrays allocated from slabs:\n')
+outf.write('  arena used only when requested: %s\n' % (arena_used and not separate_used and 'yes' or 'NO'))
+outf.write('  lnL identical after edge length changes: %s\n' % (arena_lnLs == separate_lnLs and 'yes' or 'NO'))
+outf.write('  MCMC lnL trace identical: %s\n' % (samples('arena.p') == samples('separate.p') and 'yes' or 'NO'))
+outf.write('  MCMC trees identical: %s\n\n' % (samples('arena.t') == samples('separate.t') and 'yes' or 'NO'))
+
+outf.close()
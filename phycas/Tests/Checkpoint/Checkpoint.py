@@ -0,0 +1,72 @@
+# This example checks that an MCMC analysis resumed from a checkpoint (mcmc.restart = True)
+# produces exactly the same output as an uninterrupted analysis started from the same seed.
+# The interrupted analysis saves a checkpoint every 120 cycles; restarting from the last
+# checkpoint (saved after cycle 240 of 300) truncates its parameter and tree files to their
+# length at that point and runs the remaining cycles. Only whether the checks passed is
+# written to output.txt.
+
+import os
+from phycas import *
+
+# Largest acceptable difference between sampled log-likelihoods of the uninterrupted and
+# restarted analyses. The checkpoint stores every double exactly and restores the random
+# number generators, so the two runs follow the same path and the difference must be zero.
+tolerance = 0.0
+
+def runMCMC(blob, nchains, prefix, checkpoint_every, restart):
+    rng = ProbDist.Lot()
+    rng.setSeed(13579)
+    mcmc.out.log              = prefix + '.log'
+    mcmc.out.log.mode         = REPLACE
+    mcmc.out.trees            = prefix + '.t'
+    mcmc.out.trees.mode       = REPLACE
+    mcmc.out.params           = prefix + '.p'
+    mcmc.out.params.mode      = REPLACE
+    mcmc.nchains              = nchains
+    mcmc.ncycles              = 300
+    mcmc.sample_every         = 10
+    mcmc.checkpoint_every     = checkpoint_every
+    mcmc.checkpoint_file      = prefix + '.ckp'
+    mcmc.restart              = restart
+    mcmc.rng                  = rng
+    mcmc.data_source          = blob.characters
+    mcmc.starting_tree_source = randomtree(n_taxa=len(blob.taxon_labels), rng=rng)
+    mcmc()
+
+def lnLTrace(filename):
+    # Returns the lnL column of a parameter file
+    lines = [line.split() for line in open(filename) if not line.startswith('[')]
+    col = lines[0].index('lnL')
+    return [float(v[col]) for v in lines[1:]]
+
+def check(title, blob, nchains):
+    runMCMC(blob, nchains, 'uninterrupted', 0, False)
+    runMCMC(blob, nchains, 'interrupted', 120, False)
+    runMCMC(blob, nchains, 'interrupted', 120, True)
+    
+    a = lnLTrace('uninterrupted.p')
+    b = lnLTrace('interrupted.p')
+    max_diff = max([abs(x - y) for x,y in zip(a, b)])
+    print '%s: %d and %d samples, largest lnL difference = %g' % (title, len(a), len(b), max_diff)
+    outf.write('%s:\n' % title)
+    outf.write('  lnL trace agrees: %s\n' % (len(a) == len(b) and max_diff <= tolerance and 'yes' or 'NO'))
+    outf.write('  parameter files identical: %s\n' % (open('uninterrupted.p').read() == open('interrupted.p').read() and 'yes' or 'NO'))
+    outf.write('  tree files identical: %s\n' % (open('uninterrupted.t').read() == open('interrupted.t').read() and 'yes' or 'NO'))
+    outf.write('\n')
+    mcmc.checkpoint_every = 0
+    mcmc.restart = False
+
+outf = open('output.txt', 'w')
+
+model.type               = 'hky'
+model.num_rates          = 4
+model.pinvar_model       = True
+model.fix_edgelens       = False
+model.edgelen_prior      = ProbDist.Exponential(10.0)
+model.edgelen_hyperprior = ProbDist.InverseGamma(2.1, 0.9090909)
+
+blob = readFile(getPhycasTestData('nyldna4.nex'))
+check('HKY+I+G, one chain', blob, 1)
+check('HKY+I+G, two heated chains', blob, 2)
+
+outf.close()
@@ -0,0 +1,177 @@
+# This example checks steppingstone sampling in which the power posteriors remaining after
+# the posterior has been explored are explored concurrently (ss.nthreads > 1), each by its own
+# chain in its own thread. The same analysis is run with ss.nthreads = 1, which must take the
+# sequential path, and twice with ss.nthreads = 2, which splits the three power posteriors
+# between the cold chain and a new chain and then gives the last one to another new chain;
+# the prior (beta = 0) is always explored by the cold chain because draw_directly_from_prior
+# is True. Whatever the number of threads, samples must appear in the parameter and tree files
+# grouped by beta value with the same generation numbers, and the log-likelihoods saved for
+# each beta value must be the ones written to the parameter file. Samples from the posterior
+# must not depend on ss.nthreads, two concurrent runs started from the same seed must write
+# identical files, new chains must be given the working priors of the cold chain, and new
+# chains must draw from their own streams of the master Lot. The generation numbers sampled
+# for each beta value are written to output.txt along with whether the checks passed.
+
+from phycas import *
+from phycas.Phycas.MCMCImpl import MCMCImpl
+
+def contents(filename):
+    return open(filename, 'rb').read()
+
+def samples(filename):
+    # Returns the header and the sampled rows (as lists of strings) of a parameter file
+    lines = [line.split() for line in open(filename) if not line.startswith('[')]
+    return lines[0], lines[1:]
+
+def treeGenerations(filename):
+    return [int(line.split()[1].split('.')[1]) for line in open(filename) if line.strip().startswith('tree rep.')]
+
+def betaBlocks(filename):
+    # Groups the rows of a parameter file after the starting values (generation 0) into runs
+    # of consecutive rows sharing the same beta value
+    header, rows = samples(filename)
+    gen_col = header.index('Gen')
+    beta_col = header.index('beta')
+    lnl_col = header.index('lnL')
+    blocks = []
+    for row in rows:
+        if int(row[gen_col]) == 0:
+            continue
+        if not blocks or blocks[-1][0] != row[beta_col]:
+            blocks.append((row[beta_col], [], []))
+        blocks[-1][1].append(int(row[gen_col]))
+        blocks[-1][2].append(float(row[lnl_col]))
+    return blocks
+
+def posteriorLines(filename, last_gen):
+    # Returns the lines of a parameter or tree file up to and including generation last_gen
+    lines = []
+    for line in open(filename):
+        words = line.split()
+        if len(words) > 0 and words[0].isdigit() and int(words[0]) > last_gen:
+            break
+        if len(words) > 1 and words[0] == 'tree' and int(words[1].split('.')[1]) > last_gen:
+            break
+        lines.append(line)
+    return lines
+
+# Counts calls of exploreBetasConcurrently
+concurrent_calls = []
+original_exploreBetasConcurrently = MCMCImpl.exploreBetasConcurrently
+def countingExploreBetasConcurrently(self, chain):
+    concurrent_calls.append(chain)
+    original_exploreBetasConcurrently(self, chain)
+
+# Records the working priors of every chain for which they are set up, along with whether
+# they were fitted to the chain's own samples (the cold chain) or copied from another chain
+working_priors = []
+original_setupWorkingPriors = MCMCImpl.setupWorkingPriors
+def recordingSetupWorkingPriors(self, chain, source_chain = None):
+    original_setupWorkingPriors(self, chain, source_chain)
+    descr = [u.getWorkingPriorDescr() for u in chain.chain_manager.getAllUpdaters() if not u.isFixed() and (u.computesUnivariatePrior() or u.computesMultivariatePrior())]
+    working_priors.append((source_chain is None, descr))
+
+# Records the stream number and starting state of every Lot given its own stream
+streams = []
+original_useStream = ProbDist.Lot.useStream
+def recordingUseStream(self, parent, stream):
+    original_useStream(self, parent, stream)
+    streams.append((stream, self.getState()))
+
+MCMCImpl.exploreBetasConcurrently = countingExploreBetasConcurrently
+MCMCImpl.setupWorkingPriors = recordingSetupWorkingPriors
+ProbDist.Lot.useStream = recordingUseStream
+
+def runSS(nthreads, prefix):
+    rng = ProbDist.Lot()
+    rng.setSeed(98765)
+    rng.useXoshiro()
+    mcmc.rng                  = rng
+    mcmc.starting_tree_source = randomtree(newick=Newick('(1,2,(3,(4,((5,8),(6,((7,10),9))))))'), rng=rng)
+    mcmc.out.log              = prefix + '.log'
+    mcmc.out.log.mode         = REPLACE
+    mcmc.out.trees            = prefix + '.t'
+    mcmc.out.trees.mode       = REPLACE
+    mcmc.out.params           = prefix + '.p'
+    mcmc.out.params.mode      = REPLACE
+    ss.nthreads               = nthreads
+    del concurrent_calls[:]
+    del working_priors[:]
+    del streams[:]
+    ss()
+    return ss.sampled_betas, ss.sampled_likes, len(concurrent_calls) > 0, list(working_priors), list(streams)
+
+def check(ok):
+    return ok and 'yes' or 'NO'
+
+def writeSummary(outf, prefix, betas, likes, concurrent):
+    blocks = betaBlocks(prefix + '.p')
+    outf.write('  power posteriors explored concurrently: %s\n' % (concurrent and 'yes' or 'no'))
+    for beta, gens, lnls in blocks:
+        outf.write('  beta = %.2f: %d samples, generations %s\n' % (float(beta), len(gens), ' '.join(['%d' % g for g in gens])))
+    likes_ok = len(blocks) == len(betas) and len(likes) == len(betas)
+    if likes_ok:
+        for i, (beta, gens, lnls) in enumerate(blocks):
+            if abs(float(beta) - betas[i]) > 1.e-6 or len(likes[i]) != len(lnls):
+                likes_ok = False
+            elif len([1 for x,y in zip(likes[i], lnls) if abs(x - y) > 1.e-6]) > 0:
+                likes_ok = False
+    outf.write('  log-likelihoods saved for each beta match parameter file: %s\n' % check(likes_ok))
+    header, rows = samples(prefix + '.p')
+    param_gens = [int(row[header.index('Gen')]) for row in rows]
+    outf.write('  tree file holds same generations as parameter file: %s\n' % check(treeGenerations(prefix + '.t') == param_gens))
+
+outf = open('output.txt', 'w')
+
+model.type                = 'jc'
+model.edgelen_hyperprior  = None
+model.edgelen_prior       = ProbDist.Exponential(10.0)
+
+burnin = 20
+ncycles = 20
+
+mcmc.burnin               = burnin
+mcmc.ncycles              = ncycles
+mcmc.sample_every         = 5
+mcmc.report_every         = 10
+mcmc.data_source          = getPhycasTestData('green.nex')
+mcmc.fix_topology         = True
+mcmc.edge_move_weight     = 1
+mcmc.draw_directly_from_prior = True
+
+ss.nbetavals              = 5
+ss.maxbeta                = 1.0
+ss.minbeta                = 0.0
+ss.shape1                 = 1
+ss.shape2                 = 1
+
+betas, likes, concurrent, priors, lots = runSS(1, 'sequential')
+outf.write('Steppingstone sampling, one beta value at a time (ss.nthreads = 1):\n')
+writeSummary(outf, 'sequential', betas, likes, concurrent)
+outf.write('\n')
+
+betas, likes, concurrent, priors, lots = runSS(2, 'first')
+second = runSS(2, 'second')
+outf.write('Steppingstone sampling, two beta values at a time (ss.nthreads = 2):\n')
+writeSummary(outf, 'first', betas, likes, concurrent)
+
+# The posterior is explored by the cold chain before any new chain is created
+last_posterior_gen = burnin + ncycles
+same_posterior = posteriorLines('first.p', last_posterior_gen) == posteriorLines('sequential.p', last_posterior_gen) and posteriorLines('first.t', last_posterior_gen) == posteriorLines('sequential.t', last_posterior_gen)
+outf.write('  posterior samples same as with ss.nthreads = 1: %s\n' % check(same_posterior))
+outf.write('  identical parameter and tree files from same seed: %s\n' % check(contents('first.p') == contents('second.p') and contents('first.t') == contents('second.t')))
+
+# The cold chain explores betas[1] and the prior; new chains explore betas[2] and betas[3]
+fitted = [descr for own, descr in priors if own]
+copied = [descr for own, descr in priors if not own]
+priors_ok = len(fitted) == 1 and len(copied) == 2 and len(fitted[0]) > 0 and copied[0] == fitted[0] and copied[1] == fitted[0]
+outf.write('  new chains given working priors of cold chain: %s\n' % check(priors_ok))
+# The new chains exploring betas[k] use stream k + 1 of the master Lot
+outf.write('  new chains draw from streams 3 and 4: %s\n' % check([stream for stream, state in lots] == [3, 4] and lots[0][1] != lots[1][1]))
+outf.write('\n')
+
+MCMCImpl.exploreBetasConcurrently = original_exploreBetasConcurrently
+MCMCImpl.setupWorkingPriors = original_setupWorkingPriors
+ProbDist.Lot.useStream = original_useStream
+
+outf.close()
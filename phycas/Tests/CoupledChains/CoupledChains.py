@@ -0,0 +1,105 @@
+# This example checks Metropolis-coupled MCMC run with the chains divided among several
+# threads (mcmc.chain_threads > 1), in which chains are updated concurrently and swapped in
+# C++ by MCMCCoupler. Four chains are run in two threads using the xoshiro256** engine, which
+# gives each chain its own stream of pseudorandom numbers. Two runs started from the same
+# seed must write identical parameter and tree files however the threads happen to be
+# scheduled. A run in which swaps are turned off must start from the same cold chain state.
+# The swap table must count one attempted swap per cycle, never more accepted swaps than
+# attempts, and must agree with the counts kept by the coupler. Only whether the checks
+# passed is written to output.txt.
+
+import copy
+from phycas import *
+from phycas.Phycas.MCMCImpl import MCMCImpl
+from phycas.Phycas.MCMCManager import MCMCManager
+
+nchains = 4
+ncycles = 100
+
+def contents(filename):
+    return open(filename, 'rb').read()
+
+def firstLnL(filename):
+    # Returns the log-likelihood of the starting state (cycle 0) from a parameter file
+    lines = [line.split() for line in open(filename) if not line.startswith('[')]
+    col = lines[0].index('lnL')
+    return float(lines[1][col])
+
+def runMCMC(blob, prefix):
+    rng = ProbDist.Lot()
+    rng.setSeed(13579)
+    rng.useXoshiro()
+    mcmc.out.log              = prefix + '.log'
+    mcmc.out.log.mode         = REPLACE
+    mcmc.out.trees            = prefix + '.t'
+    mcmc.out.trees.mode       = REPLACE
+    mcmc.out.params           = prefix + '.p'
+    mcmc.out.params.mode      = REPLACE
+    mcmc.rng                  = rng
+    mcmc.starting_tree_source = randomtree(n_taxa=len(blob.taxon_labels), rng=rng)
+    impl = MCMCImpl(copy.deepcopy(mcmc))
+    impl.run()
+    return impl.mcmc_manager
+
+# Creates the chains as usual, then turns off swapping in the coupler
+original_createChains = MCMCManager.createChains
+def createChainsWithoutSwaps(self):
+    original_createChains(self)
+    self.coupler.allowSwaps(False)
+
+outf = open('output.txt', 'w')
+
+model.type               = 'hky'
+model.num_rates          = 4
+model.pinvar_model       = False
+model.edgelen_prior      = Exponential(10.0)
+model.edgelen_hyperprior = None
+
+blob = readFile(getPhycasTestData('nyldna4.nex'))
+mcmc.data_source   = blob.characters
+mcmc.nchains       = nchains
+mcmc.chain_threads = 2
+mcmc.burnin        = 0
+mcmc.ncycles       = ncycles
+mcmc.sample_every  = 10
+
+first = runMCMC(blob, 'first')
+second = runMCMC(blob, 'second')
+
+MCMCManager.createChains = createChainsWithoutSwaps
+noswap = runMCMC(blob, 'noswap')
+MCMCManager.createChains = original_createChains
+
+outf.write('%d chains in 2 threads, nyldna4:\n' % nchains)
+outf.write('  chains updated by coupler: %s\n' % (first.coupler is not None and first.coupler.getNumChains() == nchains and 'yes' or 'NO'))
+outf.write('  identical parameter files from same seed: %s\n' % (contents('first.p') == contents('second.p') and 'yes' or 'NO'))
+outf.write('  identical tree files from same seed: %s\n' % (contents('first.t') == contents('second.t') and 'yes' or 'NO'))
+outf.write('  same starting lnL with swaps turned off: %s\n' % (firstLnL('first.p') == firstLnL('noswap.p') and 'yes' or 'NO'))
+
+# Element [i][j] of the swap table counts attempted swaps between ranks i < j, and element
+# [j][i] counts accepted ones. One swap is attempted per cycle and involves two ranks, so the
+# attempts in the row and column of every rank sum to twice the number of cycles.
+table = first.swap_table
+attempted = [[table[min(i,j)][max(i,j)] for j in range(nchains)] for i in range(nchains)]
+accepted = [[table[max(i,j)][min(i,j)] for j in range(nchains)] for i in range(nchains)]
+total_attempted = sum([attempted[i][j] for i in range(nchains) for j in range(i + 1, nchains)])
+total_accepted = sum([accepted[i][j] for i in range(nchains) for j in range(i + 1, nchains)])
+rank_attempts = [sum([attempted[i][j] for j in range(nchains) if j != i]) for i in range(nchains)]
+print 'swaps attempted = %d, accepted = %d, attempts per rank = %s' % (total_attempted, total_accepted, rank_attempts)
+table_ok = len(table) == nchains and len([row for row in table if len(row) != nchains]) == 0
+agrees_with_coupler = True
+for i in range(nchains):
+    for j in range(i + 1, nchains):
+        if attempted[i][j] != first.coupler.getNumSwapAttempts(i, j) or accepted[i][j] != first.coupler.getNumSwapsAccepted(i, j):
+            agrees_with_coupler = False
+outf.write('  swap table has one row and one column per chain: %s\n' % (table_ok and 'yes' or 'NO'))
+outf.write('  one swap attempted per cycle: %s\n' % (total_attempted == ncycles and 'yes' or 'NO'))
+outf.write('  attempts in row and column of each rank sum to twice the cycles: %s\n' % (sum(rank_attempts) == 2*ncycles and 'yes' or 'NO'))
+outf.write('  no more swaps accepted than attempted: %s\n' % (len([1 for i in range(nchains) for j in range(nchains) if accepted[i][j] > attempted[i][j]]) == 0 and 'yes' or 'NO'))
+outf.write('  some swaps accepted: %s\n' % (total_accepted > 0 and 'yes' or 'NO'))
+outf.write('  swap table agrees with coupler: %s\n' % (agrees_with_coupler and 'yes' or 'NO'))
+noswap_attempts = sum([noswap.swap_table[i][j] for i in range(nchains) for j in range(i + 1, nchains)])
+outf.write('  no swaps attempted with swaps turned off: %s\n' % (noswap_attempts == 0 and 'yes' or 'NO'))
+outf.write('\n')
+
+outf.close()
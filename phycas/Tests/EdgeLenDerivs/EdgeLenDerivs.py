@@ -0,0 +1,105 @@
+# This example checks the first and second derivatives of the log-likelihood with respect to
+# edge lengths computed analytically by TreeLikelihood::calcEdgeLenDerivatives against central
+# differences of the log-likelihood. A tip edge and an internal edge are checked for JC, HKY and
+# GTR+I+G (whose transition matrix derivatives are themselves obtained by differencing, see
+# Model::calcPMatDerivatives) and for the data divided by codon position into three subsets,
+# one for each of these models. Only whether the checks passed is written to output.txt.
+
+import os
+from phycas import *
+from phycas.Phycas.LikeImpl import LikeImpl
+from phycas.Phycas.LikelihoodCore import LikelihoodCore
+
+# Step sizes used for the central differences: the error of the first derivative is of order
+# h1^2 times the third derivative, and that of the second derivative is dominated by roundoff,
+# of order 1e-16 times the log-likelihood divided by h2^2
+h1 = 1.e-5
+h2 = 1.e-4
+
+# Largest acceptable difference between an analytical derivative and its central difference,
+# relative to the magnitude of the derivative (or absolute if the magnitude is less than 1)
+tolerance = 1.e-4
+
+def buildLikelihood(matrix):
+    # Build the TreeLikelihood object exactly as like() would
+    impl = LikeImpl(like)
+    impl._loadData(matrix)
+    core = LikelihoodCore(impl)
+    core.setupCore()
+    core.prepareForLikelihood()
+    return core
+
+def lnLWithEdgeLen(matrix, tree, which, edgelen):
+    # Computes the log-likelihood from scratch on a copy of tree in which the edge of the
+    # which'th node (in preorder) that has an edge is set to edgelen
+    core = buildLikelihood(matrix)
+    for i, (nd, other) in enumerate(zip(core.tree.nodesWithEdges(), tree.nodesWithEdges())):
+        nd.setEdgeLen(i == which and edgelen or other.getEdgeLen())
+    return core.likelihood.calcLnL(core.tree)
+
+def agrees(analytical, numerical):
+    return abs(analytical - numerical) <= tolerance*max(1.0, abs(analytical))
+
+def check(title, matrix):
+    core = buildLikelihood(matrix)
+    core.likelihood.calcEdgeLenDerivatives(core.tree)
+    d1 = core.likelihood.getEdgeLenFirstDerivs()
+    d2 = core.likelihood.getEdgeLenSecondDerivs()
+
+    # Derivatives are stored in the same order as nodesWithEdges visits nodes
+    nodes = list(core.tree.nodesWithEdges())
+    tip = [i for i,nd in enumerate(nodes) if nd.isTip()][0]
+    internal = [i for i,nd in enumerate(nodes) if nd.isInternal()][1]
+    outf.write('%s:\n' % title)
+    for label, which in [('tip', tip), ('internal', internal)]:
+        x = nodes[which].getEdgeLen()
+        lnL = lnLWithEdgeLen(matrix, core.tree, which, x)
+        fd1 = (lnLWithEdgeLen(matrix, core.tree, which, x + h1) - lnLWithEdgeLen(matrix, core.tree, which, x - h1))/(2.0*h1)
+        fd2 = (lnLWithEdgeLen(matrix, core.tree, which, x + h2) - 2.0*lnL + lnLWithEdgeLen(matrix, core.tree, which, x - h2))/(h2*h2)
+        print '%s, %s edge (length %g): d1 = %.6f (central difference %.6f), d2 = %.4f (central difference %.4f)' % (title, label, x, d1[which], fd1, d2[which], fd2)
+        outf.write('  first derivative agrees for %s edge: %s\n' % (label, agrees(d1[which], fd1) and 'yes' or 'NO'))
+        outf.write('  second derivative agrees for %s edge: %s\n' % (label, agrees(d2[which], fd2) and 'yes' or 'NO'))
+    outf.write('\n')
+
+outf = open('output.txt', 'w')
+
+blob = readFile(getPhycasTestData('rbcL50.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(filename=os.path.join('..', 'Underflow', 'gtrig.rbcL50.best.tre'))
+like.starting_edgelen_dist = None
+model.edgelen_hyperprior = None
+
+# JC
+model.type         = 'jc'
+model.pinvar_model = False
+model.num_rates    = 1
+jc = model()
+check('JC, rbcL50', blob.characters.getMatrix())
+
+# HKY
+model.type        = 'hky'
+model.state_freqs = [0.3, 0.2, 0.2, 0.3]
+model.kappa       = 4.0
+hky = model()
+check('HKY, rbcL50', blob.characters.getMatrix())
+
+# GTR+I+G
+model.type         = 'gtr'
+model.pinvar_model = True
+model.state_freqs  = [0.339271, 0.154491, 0.134649, 0.371589]
+model.relrates     = [1.144048, 5.419204, 0.454958, 1.766404, 5.546350, 1.0]
+model.gamma_shape  = 0.906291
+model.pinvar       = 0.442154
+model.num_rates    = 4
+gtrig = model()
+check('GTR+I+G, rbcL50', blob.characters.getMatrix())
+
+# Partitioned by codon position
+partition.addSubset(subset(1,1314,3), jc, 'first')
+partition.addSubset(subset(2,1314,3), hky, 'second')
+partition.addSubset(subset(3,1314,3), gtrig, 'third')
+partition()
+check('Partitioned JC, HKY, GTR+I+G, rbcL50', blob.characters.getMatrix())
+partition.resetPartition()
+
+outf.close()
@@ -0,0 +1,101 @@
+# This example checks the Hamiltonian Monte Carlo edge length move (mcmc.edgelen_hmc_weight).
+# With no data the chain explores the prior, and with every other updater switched off the
+# HMC move alone must reproduce the mean tree length implied by the edge length prior, to
+# within Monte Carlo error estimated by batch means. It also checks that setting the boldness
+# of the move (as steppingstone sampling does) scales the step size adapted during burn-in
+# rather than replacing it. Only whether the checks passed is written to output.txt.
+
+import copy, math
+from phycas import *
+from phycas.Phycas.MCMCImpl import MCMCImpl
+
+ntax = 5
+nedges = 2*ntax - 3
+edgelen_mean = 0.1
+
+# The sample mean tree length must lie within this many estimated standard errors of the
+# expected tree length
+max_std_errors = 4.0
+
+# Number of batches used to estimate the standard error of the mean
+nbatches = 20
+
+def treeLengths(filename):
+    # Returns the TL column of a parameter file
+    lines = [line.split() for line in open(filename) if not line.startswith('[')]
+    col = lines[0].index('TL')
+    return [float(v[col]) for v in lines[1:]]
+
+def batchMeansStdError(x, nbatches):
+    # Estimates the standard error of the mean of the autocorrelated sample x
+    n = len(x)//nbatches
+    means = [sum(x[b*n:(b + 1)*n])/n for b in range(nbatches)]
+    grand_mean = sum(means)/nbatches
+    var = sum([(m - grand_mean)**2 for m in means])/(nbatches - 1)
+    return math.sqrt(var/nbatches)
+
+def agrees(x, y):
+    return abs(x - y) <= 1.e-12*abs(y)
+
+outf = open('output.txt', 'w')
+
+setMasterSeed(24680)
+
+model.type               = 'jc'
+model.num_rates          = 1
+model.pinvar_model       = False
+model.edgelen_prior      = Exponential(1.0/edgelen_mean)
+model.edgelen_hyperprior = None
+
+mcmc.data_source          = None
+mcmc.ntax                 = ntax
+mcmc.draw_directly_from_prior = False     # explore the prior using the updaters
+mcmc.starting_tree_source = randomtree(n_taxa=ntax)
+mcmc.out.log              = 'hmc.log'
+mcmc.out.log.mode         = REPLACE
+mcmc.out.trees            = 'hmc.t'
+mcmc.out.trees.mode       = REPLACE
+mcmc.out.params           = 'hmc.p'
+mcmc.out.params.mode      = REPLACE
+mcmc.nchains              = 1
+mcmc.burnin               = 500
+mcmc.ncycles              = 10000
+mcmc.sample_every         = 5
+mcmc.edgelen_hmc_weight   = 1
+mcmc.edgelen_hmc_stepsize = 0.05
+mcmc.edgelen_hmc_stepsize0 = 0.5
+mcmc.ls_move_weight       = 0
+mcmc.slice_weight         = 0
+
+impl = MCMCImpl(copy.deepcopy(mcmc))
+impl.run()
+
+# Tree length, the sum of nedges independent exponential edge lengths
+tl = treeLengths('hmc.p')
+tl_mean = sum(tl)/len(tl)
+tl_se = batchMeansStdError(tl, nbatches)
+expected = nedges*edgelen_mean
+print 'mean tree length = %.5f (expected %.5f), standard error = %.5f, %d samples' % (tl_mean, expected, tl_se, len(tl))
+outf.write('HMC exploring the prior:\n')
+outf.write('  mean tree length agrees with prior: %s\n' % (abs(tl_mean - expected) <= max_std_errors*tl_se and 'yes' or 'NO'))
+outf.write('\n')
+
+# Boldness scales the adapted step size: a boldness of 100 multiplies it by
+# edgelen_hmc_stepsize0/edgelen_hmc_stepsize, and a boldness of 0 restores it
+hmc = impl.mcmc_manager.getColdChain().edgelen_hmc_move
+adapted = hmc.getStepSize()
+hmc.setBoldness(100.0)
+bold100 = hmc.getStepSize()
+hmc.setBoldness(50.0)
+bold50 = hmc.getStepSize()
+hmc.setBoldness(0.0)
+bold0 = hmc.getStepSize()
+print 'adapted step size = %.6f, at boldness 50 = %.6f, at boldness 100 = %.6f' % (adapted, bold50, bold100)
+outf.write('HMC step size:\n')
+outf.write('  adapted during burn-in: %s\n' % (not agrees(adapted, mcmc.edgelen_hmc_stepsize) and 'yes' or 'NO'))
+outf.write('  boldness 100 scales adapted step size: %s\n' % (agrees(bold100, adapted*10.0) and 'yes' or 'NO'))
+outf.write('  boldness 50 scales adapted step size: %s\n' % (agrees(bold50, adapted*5.5) and 'yes' or 'NO'))
+outf.write('  boldness 0 restores adapted step size: %s\n' % (agrees(bold0, adapted) and 'yes' or 'NO'))
+outf.write('\n')
+
+outf.close()
@@ -0,0 +1,108 @@
+# This example checks that TreeLikelihood::calcEdgeLnL, which the edge length slice samplers
+# use to compute the log-likelihood from the two conditional likelihood arrays on either side
+# of the edge being updated, agrees with the log-likelihood computed from scratch after the
+# length of that edge is set to the same value. Several lengths of a tip edge and of an
+# internal edge are tried, first with GTR+I+G and then with the data divided by codon position
+# into three subsets, each with its own model. Only whether the checks passed is written to
+# output.txt.
+
+import os
+from phycas import *
+from phycas.Phycas.LikeImpl import LikeImpl
+from phycas.Phycas.LikelihoodCore import LikelihoodCore
+
+# Largest acceptable difference between the two log-likelihoods, relative to the magnitude of
+# the log-likelihood computed from scratch (the two are summed around different nodes)
+tolerance = 1.e-10
+
+edgelens = [0.001, 0.05, 0.3, 1.2]
+
+def buildLikelihood(matrix):
+    # Build the TreeLikelihood object exactly as like() would
+    impl = LikeImpl(like)
+    impl._loadData(matrix)
+    core = LikelihoodCore(impl)
+    core.setupCore()
+    core.prepareForLikelihood()
+    return core
+
+def freshLnL(matrix, tree):
+    # Computes the log-likelihood from scratch on a copy of tree
+    core = buildLikelihood(matrix)
+    for nd, other in zip(core.tree.nodesWithEdges(), tree.nodesWithEdges()):
+        nd.setEdgeLen(other.getEdgeLen())
+    return core.likelihood.calcLnL(core.tree)
+
+def check(title, matrix):
+    core = buildLikelihood(matrix)
+    L = core.likelihood
+    t = core.tree
+    L.calcLnL(t)
+    nodes = list(t.nodesWithEdges())
+    tip = [nd for nd in nodes if nd.isTip()][0]
+    internal = [nd for nd in nodes if nd.isInternal()][1]
+    outf.write('%s:\n' % title)
+    for label, nd in [('tip', tip), ('internal', internal)]:
+        orig_edgelen = nd.getEdgeLen()
+
+        # As the edge length slice samplers do: invalidate the arrays that depend on the length
+        # of the edge, then compute the arrays on either side of it just once
+        L.invalidateAwayFromNode(nd)
+        prepared = L.prepareEdgeLnL(t, nd)
+        max_rel_diff = 0.0
+        for x in edgelens:
+            nd.setEdgeLen(x)
+            edge_lnL = L.calcEdgeLnL()
+            lnL = freshLnL(matrix, t)
+            rel_diff = abs(edge_lnL - lnL)/abs(lnL)
+            print '%s, %s edge set to %g: calcEdgeLnL = %.6f, calcLnL = %.6f, difference = %g' % (title, label, x, edge_lnL, lnL, abs(edge_lnL - lnL))
+            max_rel_diff = max(max_rel_diff, rel_diff)
+        outf.write('  calcEdgeLnL agrees with calcLnL for %s edge: %s\n' % (label, prepared and max_rel_diff <= tolerance and 'yes' or 'NO'))
+
+        # Restore the edge length and the arrays that depend on it
+        nd.setEdgeLen(orig_edgelen)
+        L.invalidateAwayFromNode(nd)
+        L.calcLnLFromNode(nd.isInternal() and nd or nd.getParent(), t)
+    outf.write('\n')
+
+outf = open('output.txt', 'w')
+
+blob = readFile(getPhycasTestData('rbcL50.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(filename=os.path.join('..', 'Underflow', 'gtrig.rbcL50.best.tre'))
+like.starting_edgelen_dist = None
+
+# GTR+I+G
+model.type = 'gtr'
+model.pinvar_model = True
+model.edgelen_hyperprior = None
+model.state_freqs = [0.339271, 0.154491, 0.134649, 0.371589]
+model.relrates    = [1.144048, 5.419204, 0.454958, 1.766404, 5.546350, 1.0]
+model.gamma_shape = 0.906291
+model.pinvar      = 0.442154
+model.num_rates   = 4
+gtrig = model()
+check('GTR+I+G, rbcL50', blob.characters.getMatrix())
+
+# Partitioned by codon position: GTR+I+G, HKY+G and JC+I
+model.type = 'hky'
+model.pinvar_model = False
+model.state_freqs = [0.25, 0.25, 0.25, 0.25]
+model.kappa       = 4.0
+model.gamma_shape = 0.5
+hkyg = model()
+
+model.type = 'jc'
+model.pinvar_model = True
+model.pinvar       = 0.3
+model.num_rates    = 1
+jci = model()
+
+partition.addSubset(subset(1,1314,3), gtrig, 'first')
+partition.addSubset(subset(2,1314,3), hkyg, 'second')
+partition.addSubset(subset(3,1314,3), jci, 'third')
+partition()
+check('Partitioned GTR+I+G, HKY+G, JC+I, rbcL50', blob.characters.getMatrix())
+partition.resetPartition()
+
+outf.close()
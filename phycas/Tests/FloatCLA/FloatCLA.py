@@ -0,0 +1,66 @@
+# This example checks the log-likelihoods computed with conditional likelihood arrays
+# stored in single precision (Phycas compiled with PHYCAS_FLOAT_CLA defined) against
+# the values obtained using double precision. Because the difference depends on the
+# precision Phycas was compiled for (and on the processor), only whether the difference
+# is within tolerance is written to output.txt; the values themselves are printed to
+# the console. In a double precision build the check is trivially satisfied.
+
+import os
+from phycas import *
+from phycas.Phycas.LikeImpl import LikeImpl
+from phycas.Phycas.LikelihoodCore import LikelihoodCore
+
+# Largest acceptable difference between single and double precision log-likelihoods,
+# relative to the magnitude of the double precision log-likelihood
+tolerance = 1.e-6
+
+def check(title, matrix, double_lnL):
+    # Build the TreeLikelihood object exactly as like() would
+    impl = LikeImpl(like)
+    impl._loadData(matrix)
+    core = LikelihoodCore(impl)
+    core.setupCore()
+    core.prepareForLikelihood()
+
+    lnL = core.likelihood.calcLnL(core.tree)
+    diff = abs(lnL - double_lnL)
+    precision = core.likelihood.isUsingFloatCLAs() and 'single' or 'double'
+    print '%s: %s precision lnL = %.6f, double precision lnL = %.6f, difference = %g' % (title, precision, lnL, double_lnL, diff)
+    outf.write('%s:\n' % title)
+    outf.write('  agrees with double precision lnL: %s\n\n' % (diff <= tolerance*abs(double_lnL) and 'yes' or 'NO'))
+
+outf = open('output.txt', 'w')
+
+# 4 states, GTR+I+G, underflow correction used (see also the Underflow example)
+model.type = 'gtr'
+model.pinvar_model = True
+model.edgelen_hyperprior = None
+model.state_freqs = [0.339271, 0.154491, 0.134649, 0.371589]
+model.relrates    = [1.144048, 5.419204, 0.454958, 1.766404, 5.546350, 1.0]
+model.gamma_shape = 0.906291 
+model.pinvar      = 0.442154
+model.num_rates   = 4
+
+blob = readFile(getPhycasTestData('rbcL50.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(filename=os.path.join('..', 'Underflow', 'gtrig.rbcL50.best.tre'))
+like.starting_edgelen_dist = None
+like.uf_num_edges = 5
+check('GTR+I+G, rbcL50', blob.characters.getMatrix(), -18117.830733)
+
+# 4 states, HKY+G, tree with polytomies
+model.type        = 'hky'
+model.pinvar_model = False
+model.num_rates   = 4
+model.state_freqs = [0.25, 0.25, 0.25, 0.25]
+model.kappa       = 4.0
+model.gamma_shape = 0.5
+
+blob = readFile(getPhycasTestData('ShoupLewis.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(filename=os.path.join('..', 'Underflow', 'polytomous.tre'))
+like.starting_edgelen_dist = None
+like.uf_num_edges = 50
+check('HKY+G, polytomous tree (uf_num_edges = 50)', blob.characters.getMatrix(), -16403.967004)
+
+outf.close()
@@ -0,0 +1,71 @@
+# This example checks that the log-likelihoods computed by the native likelihood engine
+# (like.likelihood_engine = 'cpu'), which recomputes the whole tree without using the
+# conditional likelihood arrays stored in the tree, agree with the values obtained the
+# usual way, with one thread and with several. The values themselves are printed to the
+# console; only whether they agree is written to output.txt.
+
+import os
+from phycas import *
+from phycas.Phycas.LikeImpl import LikeImpl
+from phycas.Phycas.LikelihoodCore import LikelihoodCore
+
+# Largest acceptable difference between the two log-likelihoods, relative to the 
+# magnitude of the log-likelihood computed the usual way
+tolerance = 1.e-10
+
+def calcLnL(matrix, engine, nthreads):
+    # Build the TreeLikelihood object exactly as like() would
+    like.likelihood_engine = engine
+    like.num_threads = nthreads
+    impl = LikeImpl(like)
+    impl._loadData(matrix)
+    core = LikelihoodCore(impl)
+    core.setupCore()
+    core.prepareForLikelihood()
+    return core.likelihood.calcLnL(core.tree)
+
+def check(title, matrix):
+    lnL = calcLnL(matrix, None, 1)
+    outf.write('%s:\n' % title)
+    for nthreads in [1, 3]:
+        engine_lnL = calcLnL(matrix, 'cpu', nthreads)
+        diff = abs(engine_lnL - lnL)
+        print '%s: lnL = %.6f, cpu engine lnL (%d threads) = %.6f, difference = %g' % (title, lnL, nthreads, engine_lnL, diff)
+        outf.write('  cpu engine agrees using %d thread(s): %s\n' % (nthreads, diff <= tolerance*abs(lnL) and 'yes' or 'NO'))
+    outf.write('\n')
+    like.likelihood_engine = None
+    like.num_threads = 1
+
+outf = open('output.txt', 'w')
+
+# 4 states, GTR+I+G (invariable sites become an extra rate category of the engine)
+model.type = 'gtr'
+model.pinvar_model = True
+model.edgelen_hyperprior = None
+model.state_freqs = [0.339271, 0.154491, 0.134649, 0.371589]
+model.relrates    = [1.144048, 5.419204, 0.454958, 1.766404, 5.546350, 1.0]
+model.gamma_shape = 0.906291 
+model.pinvar      = 0.442154
+model.num_rates   = 4
+
+blob = readFile(getPhycasTestData('rbcL50.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(filename=os.path.join('..', 'Underflow', 'gtrig.rbcL50.best.tre'))
+like.starting_edgelen_dist = None
+check('GTR+I+G, rbcL50', blob.characters.getMatrix())
+
+# 4 states, HKY+G, tree with polytomies
+model.type        = 'hky'
+model.pinvar_model = False
+model.num_rates   = 4
+model.state_freqs = [0.25, 0.25, 0.25, 0.25]
+model.kappa       = 4.0
+model.gamma_shape = 0.5
+
+blob = readFile(getPhycasTestData('ShoupLewis.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(filename=os.path.join('..', 'Underflow', 'polytomous.tre'))
+like.starting_edgelen_dist = None
+check('HKY+G, polytomous tree', blob.characters.getMatrix())
+
+outf.close()
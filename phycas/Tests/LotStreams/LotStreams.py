@@ -0,0 +1,91 @@
+# This example checks the xoshiro256** engine of Lot, the pseudorandom number generator used
+# throughout Phycas. The first numbers generated from seed 13579, both by the master Lot and
+# by Lots given streams 1 and 2 of it using useStream, are compared with reference values
+# computed by an independent implementation of xoshiro256** (seeded using splitmix64 and
+# jumped ahead 2^128 draws per stream) to the last bit. Giving a Lot a stream must not draw
+# from the master Lot, different streams must differ, and the same stream must always give
+# the same numbers. A state saved by getState part way through a sequence must resume the
+# sequence exactly when passed to setState of another Lot, and uniforms must return the same
+# numbers as repeated calls to uniform. Only whether the checks passed is written to
+# output.txt.
+
+from phycas import *
+
+seed = 13579
+
+# The first five numbers of streams 0 (the master Lot itself), 1 and 2 for seed 13579
+reference = [
+    [0.86482922231931303, 0.69614358286732858, 0.10463419147081049, 0.064664615500893252, 0.95783358254297735],
+    [0.1550733160359869, 0.87587354512899473, 0.77418155362359165, 0.8420208216552183, 0.58116398101726396],
+    [0.052883068876633021, 0.064127172777999009, 0.10359782741888707, 0.097258514866924994, 0.25024292223451977]
+    ]
+
+# The state of the master Lot after three numbers have been drawn
+reference_state = 'xoshiro256ss 13579 0 13847618146376534813 16410123174531338939 3617683789115744347 8180753820265904898'
+
+def masterLot():
+    lot = ProbDist.Lot()
+    lot.setSeed(seed)
+    lot.useXoshiro()
+    return lot
+
+def streamLot(master, stream):
+    lot = ProbDist.Lot()
+    lot.useStream(master, stream)
+    return lot
+
+def draw(lot, n):
+    return [lot.uniform() for i in range(n)]
+
+def check(ok):
+    return ok and 'yes' or 'NO'
+
+outf = open('output.txt', 'w')
+
+outf.write('xoshiro256** engine, seed %d:\n' % seed)
+master = masterLot()
+first = streamLot(master, 1)
+second = streamLot(master, 2)
+outf.write('  master Lot matches reference: %s\n' % check(draw(master, 5) == reference[0]))
+outf.write('  stream 1 matches reference: %s\n' % check(first.getStream() == 1 and draw(first, 5) == reference[1]))
+outf.write('  stream 2 matches reference: %s\n' % check(second.getStream() == 2 and draw(second, 5) == reference[2]))
+outf.write('  streams 1 and 2 differ: %s\n' % check(reference[1] != reference[2]))
+
+# Streams depend only on the seed of the master Lot, not on how many numbers it has drawn
+master = masterLot()
+before = draw(streamLot(master, 1), 5)
+drawn = draw(master, 5)
+after = draw(streamLot(master, 1), 5)
+outf.write('  creating a stream draws nothing from master Lot: %s\n' % check(drawn == reference[0]))
+outf.write('  same stream gives same numbers: %s\n' % check(before == after and before == reference[1]))
+
+# Save the state part way through the sequence and resume it using another Lot
+master = masterLot()
+draw(master, 3)
+state = master.getState()
+rest = draw(master, 2)
+resumed = ProbDist.Lot()
+resumed.setState(state)
+outf.write('  state part way through matches reference: %s\n' % check(state == reference_state))
+outf.write('  restored state resumes sequence: %s\n' % check(resumed.getEngine() == ProbDist.LotEngine.xoshiro256ss and draw(resumed, 2) == rest and rest == reference[0][3:]))
+
+# The same for a stream, whose state must remember the stream number
+second = streamLot(masterLot(), 2)
+draw(second, 2)
+state = second.getState()
+rest = draw(second, 3)
+resumed = ProbDist.Lot()
+resumed.setState(state)
+outf.write('  restored state of stream resumes stream: %s\n' % check(resumed.getStream() == 2 and draw(resumed, 3) == rest and rest == reference[2][2:]))
+
+invalid_state_rejected = False
+try:
+    resumed.setState('xoshiro256ss 13579')
+except:
+    invalid_state_rejected = True
+outf.write('  incomplete state rejected: %s\n' % check(invalid_state_rejected))
+
+outf.write('  uniforms agrees with uniform: %s\n' % check(list(masterLot().uniforms(5)) == reference[0]))
+outf.write('\n')
+
+outf.close()
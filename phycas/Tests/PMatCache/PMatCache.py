@@ -0,0 +1,119 @@
+# This example checks that caching transition probability matrices (like.pmat_cache and
+# mcmc.pmat_cache, True by default) never changes the log-likelihood. A short MCMC analysis
+# is run twice from the same seed, once with and once without caching, and the sampled
+# log-likelihoods and trees must be identical. It also checks that, after only one edge
+# length is changed, the matrices of the other edges are taken from the cache and the
+# log-likelihood still agrees with one computed from scratch without caching. Only whether
+# the checks passed is written to output.txt.
+
+import os
+from phycas import *
+from phycas.Phycas.LikeImpl import LikeImpl
+from phycas.Phycas.LikelihoodCore import LikelihoodCore
+
+# Largest acceptable difference between cached and uncached log-likelihoods, relative to
+# the magnitude of the uncached log-likelihood (the two are summed around different nodes)
+tolerance = 1.e-10
+
+def samples(filename):
+    # Returns the lines of a params or tree file, omitting comments such as the [ID: ...] line
+    return [line for line in open(filename) if not line.startswith('[')]
+
+def runMCMC(blob, pmat_cache, prefix):
+    rng = ProbDist.Lot()
+    rng.setSeed(13579)
+    mcmc.pmat_cache           = pmat_cache
+    mcmc.out.log              = prefix + '.log'
+    mcmc.out.log.mode         = REPLACE
+    mcmc.out.trees            = prefix + '.t'
+    mcmc.out.trees.mode       = REPLACE
+    mcmc.out.params           = prefix + '.p'
+    mcmc.out.params.mode      = REPLACE
+    mcmc.nchains              = 1
+    mcmc.ncycles              = 200
+    mcmc.sample_every         = 10
+    mcmc.rng                  = rng
+    mcmc.data_source          = blob.characters
+    mcmc.starting_tree_source = randomtree(n_taxa=len(blob.taxon_labels), rng=rng)
+    mcmc()
+
+def buildLikelihood(matrix, pmat_cache):
+    # Build the TreeLikelihood object exactly as like() would
+    like.pmat_cache = pmat_cache
+    impl = LikeImpl(like)
+    impl._loadData(matrix)
+    core = LikelihoodCore(impl)
+    core.setupCore()
+    core.prepareForLikelihood()
+    return core
+
+def changeEdgeLen(core, which, new_edgelen):
+    # Sets the length of the edge belonging to the which'th node (in preorder) that has an edge
+    nd = list(core.tree.nodesWithEdges())[which]
+    nd.setEdgeLen(new_edgelen)
+    return nd
+
+outf = open('output.txt', 'w')
+
+# MCMC with HKY+G, all parameters free
+model.type              = 'hky'
+model.num_rates         = 4
+model.pinvar_model      = False
+model.fix_edgelens      = False
+model.edgelen_prior     = ProbDist.Exponential(10.0)
+model.edgelen_hyperprior = None
+
+blob = readFile(getPhycasTestData('nyldna4.nex'))
+runMCMC(blob, True, 'cached')
+runMCMC(blob, False, 'uncached')
+params_same = samples('cached.p') == samples('uncached.p')
+trees_same = samples('cached.t') == samples('uncached.t')
+outf.write('HKY+G MCMC, nyldna4:\n')
+outf.write('  lnL trace identical with and without caching: %s\n' % (params_same and 'yes' or 'NO'))
+outf.write('  trees identical with and without caching: %s\n' % (trees_same and 'yes' or 'NO'))
+outf.write('\n')
+mcmc.pmat_cache = True
+
+# GTR+I+G on a fixed tree, changing only edge lengths
+model.type = 'gtr'
+model.pinvar_model = True
+model.state_freqs = [0.339271, 0.154491, 0.134649, 0.371589]
+model.relrates    = [1.144048, 5.419204, 0.454958, 1.766404, 5.546350, 1.0]
+model.gamma_shape = 0.906291 
+model.pinvar      = 0.442154
+model.num_rates   = 4
+
+blob = readFile(getPhycasTestData('rbcL50.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(filename=os.path.join('..', 'Underflow', 'gtrig.rbcL50.best.tre'))
+like.starting_edgelen_dist = None
+
+cached = buildLikelihood(blob.characters.getMatrix(), True)
+cached.likelihood.calcLnL(cached.tree)
+cached.likelihood.resetPMatCacheStats()
+outf.write('GTR+I+G, rbcL50:\n')
+internals = [i for i,nd in enumerate(cached.tree.nodesWithEdges()) if nd.isInternal()]
+for k, new_edgelen in [(1, 0.05), (5, 0.2)]:
+    # Recompute the likelihood around the node whose edge changed, as the edge length moves do:
+    # every conditional likelihood array pointing toward it is recomputed, but only the transition
+    # matrices of its own edge need to be
+    which = internals[k]
+    nd = changeEdgeLen(cached, which, new_edgelen)
+    cached.likelihood.invalidateAwayFromNode(nd)
+    lnL = cached.likelihood.calcLnLFromNode(nd, cached.tree)
+    hits = cached.likelihood.getPMatCacheHits()
+    misses = cached.likelihood.getPMatCacheMisses()
+    cached.likelihood.resetPMatCacheStats()
+
+    uncached = buildLikelihood(blob.characters.getMatrix(), False)
+    for i, other in enumerate(cached.tree.nodesWithEdges()):
+        changeEdgeLen(uncached, i, other.getEdgeLen())
+    uncached_lnL = uncached.likelihood.calcLnL(uncached.tree)
+    diff = abs(lnL - uncached_lnL)
+    print 'internal edge %d set to %g: lnL = %.6f, uncached lnL = %.6f, difference = %g, pmat cache hits = %d, misses = %d' % (k, new_edgelen, lnL, uncached_lnL, diff, hits, misses)
+    outf.write('  pmat cache hits after changing only internal edge %d: %s\n' % (k, hits > 0 and 'yes' or 'NO'))
+    outf.write('  lnL agrees with uncached after changing internal edge %d: %s\n' % (k, diff <= tolerance*abs(uncached_lnL) and 'yes' or 'NO'))
+outf.write('\n')
+like.pmat_cache = True
+
+outf.close()
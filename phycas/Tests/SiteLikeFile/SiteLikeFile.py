@@ -0,0 +1,119 @@
+# This example checks that site log-likelihoods saved in the binary format written by
+# mcmc (Likelihood.SiteLikeWriter) survive the round trip to disk, and that the sump
+# command computes the same conditional predictive ordinates (CPO) from the binary file
+# as from a text file (one line of site log-likelihoods per sample, the format saved by
+# older versions) holding the same samples. The samples are obtained by rescaling the
+# edge lengths of a fixed tree; there are more of them than fit in one block of the 
+# binary file. Only whether the checks passed is written to output.txt.
+
+import os, copy
+from phycas import *
+from phycas.Phycas.LikeImpl import LikeImpl
+from phycas.Phycas.LikelihoodCore import LikelihoodCore
+from phycas.Phycas.SumPImpl import ParamSummarizer
+
+# Largest acceptable difference between the log-CPO of a site computed from the binary
+# file and from the text file (the text file stores every value to 17 significant digits)
+tolerance = 1.e-9
+
+nsamples = 150
+
+class CPOCatcher(ParamSummarizer):
+    # Keeps the site log-CPO values computed by handleCPOFile rather than summarizing them
+    def cpo_summary(self, site_loghm):
+        self.site_loghm = list(site_loghm)
+
+def calcCPO(filename):
+    sump.burnin = 0
+    summarizer = CPOCatcher(copy.deepcopy(sump))
+    summarizer.handleCPOFile(filename)
+    return summarizer.site_loghm
+
+outf = open('output.txt', 'w')
+
+model.type = 'gtr'
+model.pinvar_model = True
+model.edgelen_hyperprior = None
+model.state_freqs = [0.339271, 0.154491, 0.134649, 0.371589]
+model.relrates    = [1.144048, 5.419204, 0.454958, 1.766404, 5.546350, 1.0]
+model.gamma_shape = 0.906291 
+model.pinvar      = 0.442154
+model.num_rates   = 4
+
+blob = readFile(getPhycasTestData('rbcL50.nex'))
+like.data_source = blob.characters
+like.tree_source = TreeCollection(filename=os.path.join('..', 'Underflow', 'gtrig.rbcL50.best.tre'))
+like.starting_edgelen_dist = None
+
+# Build the TreeLikelihood object exactly as like() would
+impl = LikeImpl(like)
+impl._loadData(blob.characters.getMatrix())
+core = LikelihoodCore(impl)
+core.setupCore()
+core.prepareForLikelihood()
+lnl = core.likelihood
+tree = core.tree
+lnl.storeSiteLikelihoods(True)
+
+nodes = list(tree.nodesWithEdges())
+orig_edgelens = [nd.getEdgeLen() for nd in nodes]
+focal = [nd for nd in nodes if nd.isInternal()][0]
+char_to_pattern = list(lnl.getCharIndexToPatternIndex())
+npatterns = lnl.getNPatterns()
+
+binf = Likelihood.SiteLikeWriter('sitelikes.bin')
+binf.setup(lnl)
+textf = open('sitelikes.txt', 'w')
+pattern_samples = []
+for i in range(nsamples):
+    # Rescale every edge and recompute all conditional likelihood arrays
+    scaler = 0.5 + 1.5*float(i)/float(nsamples)
+    for nd, edgelen in zip(nodes, orig_edgelens):
+        nd.setEdgeLen(scaler*edgelen)
+    lnl.invalidateAwayFromNode(focal)
+    lnl.calcLnLFromNode(focal, tree)
+    
+    binf.addSample(10*(i + 1), lnl)
+    pattern_lnL = list(lnl.getSiteLikelihoods())
+    pattern_samples.append(pattern_lnL)
+    for p in char_to_pattern:
+        if p < npatterns:
+            textf.write('%.17g\t' % pattern_lnL[p])
+        else:
+            textf.write('%.17g\t' % 0.0)
+    textf.write('\n')
+binf.close()
+textf.close()
+
+# Read the binary file back
+reader = Likelihood.SiteLikeReader('sitelikes.bin')
+header_ok = reader.getNumSites() == len(char_to_pattern) and reader.getNumPatterns() == npatterns
+for p, q in zip(char_to_pattern, reader.getCharToPattern()):
+    # excluded sites need only be marked as such, not mapped to the same value
+    if (p < npatterns or q < npatterns) and p != q:
+        header_ok = False
+cycles_ok = reader.getNumSamples() == nsamples and reader.getCycles() == [10*(i + 1) for i in range(nsamples)]
+values_ok = True
+for p in range(npatterns):
+    if reader.getPatternSamples(p) != [v[p] for v in pattern_samples]:
+        values_ok = False
+del reader
+outf.write('Binary site likelihood file, %d samples:\n' % nsamples)
+outf.write('  header read back correctly: %s\n' % (header_ok and 'yes' or 'NO'))
+outf.write('  cycles read back correctly: %s\n' % (cycles_ok and 'yes' or 'NO'))
+outf.write('  pattern log-likelihoods read back exactly: %s\n' % (values_ok and 'yes' or 'NO'))
+outf.write('\n')
+
+# Compare the CPO computed by sump from the two files
+bin_cpo = calcCPO('sitelikes.bin')
+text_cpo = calcCPO('sitelikes.txt')
+max_diff = max([abs(x - y) for x,y in zip(bin_cpo, text_cpo)])
+total_diff = abs(sum(bin_cpo) - sum(text_cpo))
+print 'Model CPO: binary = %.6f, text = %.6f, largest site difference = %g' % (sum(bin_cpo), sum(text_cpo), max_diff)
+outf.write('CPO computed by sump:\n')
+outf.write('  same number of sites: %s\n' % (len(bin_cpo) == len(text_cpo) and 'yes' or 'NO'))
+outf.write('  site log-CPO agrees: %s\n' % (max_diff <= tolerance and 'yes' or 'NO'))
+outf.write('  model CPO agrees: %s\n' % (total_diff <= tolerance*len(bin_cpo) and 'yes' or 'NO'))
+outf.write('\n')
+
+outf.close()
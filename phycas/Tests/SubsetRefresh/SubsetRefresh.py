@@ -0,0 +1,114 @@
+# This example checks that recomputing only the part of each conditional likelihood array
+# belonging to one partition subset (which happens when a parameter of a model used by just
+# that subset changes, see TreeLikelihood::invalidateSubsetCLAs) gives the same log-likelihood
+# as recomputing the whole tree. The data are divided by codon position into three subsets,
+# each with its own model, and the updaters of the cold chain are called one at a time. After
+# each update the log-likelihood remembered by the chain manager, the log-likelihood computed
+# by calcLnL from the conditional likelihood arrays left by the updater, and the log-likelihood
+# recomputed from scratch by the "cpu" likelihood engine must agree. Because the state frequency
+# and relative rate moves (DirichletMove) invalidate only their own subset both when proposing
+# and when reverting, rejected proposals are the case most likely to leave stale arrays behind.
+# Only whether the checks passed is written to output.txt.
+
+import copy
+from phycas import *
+from phycas.Phycas.MCMCImpl import MCMCImpl
+
+# Largest acceptable relative difference between log-likelihoods. The engine sums over the
+# same patterns in the same order as calcLnL, but the arrays it combines were computed along
+# a different path, so the two may differ in the last few digits.
+tolerance = 1.e-10
+
+ncycles = 20
+
+def relDiff(a, b):
+    return abs(a - b)/max(1.0, abs(b))
+
+def isDirichletMove(name):
+    return name.startswith('state_freqs_') or name.startswith('relrates_')
+
+outf = open('output.txt', 'w')
+
+setMasterSeed(97531)
+
+model.type                       = 'gtr'
+model.num_rates                  = 4
+model.pinvar_model               = False
+model.update_freqs_separately    = False
+model.update_relrates_separately = False
+model.edgelen_prior              = Exponential(10.0)
+model.edgelen_hyperprior         = None
+m1 = model()
+
+model.type                       = 'hky'
+model.pinvar_model               = True
+m2 = model()
+
+model.type                       = 'gtr'
+m3 = model()
+
+partition.addSubset(subset(1,3080,3), m1, 'first')
+partition.addSubset(subset(2,3080,3), m2, 'second')
+partition.addSubset(subset(3,3080,3), m3, 'third')
+partition()
+
+blob = readFile(getPhycasTestData('nyldna4.nex'))
+mcmc.data_source       = blob.characters
+mcmc.out.log           = 'subsetrefresh.log'
+mcmc.out.log.mode      = REPLACE
+mcmc.out.trees         = 'subsetrefresh.t'
+mcmc.out.trees.mode    = REPLACE
+mcmc.out.params        = 'subsetrefresh.p'
+mcmc.out.params.mode   = REPLACE
+mcmc.nchains           = 1
+
+impl = MCMCImpl(copy.deepcopy(mcmc))
+impl.setup()
+chain = impl.mcmc_manager.getColdChain()
+mgr = chain.chain_manager
+like = chain.likelihood
+tree = chain.tree
+mgr.refreshLastLnLike()
+mgr.refreshLastLnPrior()
+
+num_checked = 0
+num_failed = 0
+num_rejected_subset_moves = 0
+num_accepted_subset_moves = 0
+for cycle in range(ncycles):
+    for u in mgr.getAllUpdaters():
+        if u.getWeight() == 0 or u.isFixed():
+            continue
+        accepted = u.update()
+
+        # Uses whatever arrays the updater left valid (and, after a rejected DirichletMove,
+        # recomputes just the subset whose model was reverted)
+        lnL_incr = like.calcLnL(tree)
+
+        # Recomputes everything without the conditional likelihood arrays stored in the tree,
+        # then makes every array in the tree valid again before the next updater is called
+        like.useLikelihoodEngine('cpu')
+        lnL_full = like.calcLnL(tree)
+        like.useLikelihoodEngine('')
+        like.calcLnL(tree)
+
+        lnL_last = mgr.getLastLnLike()
+        ok = relDiff(lnL_incr, lnL_full) <= tolerance and relDiff(lnL_last, lnL_full) <= tolerance
+        num_checked += 1
+        if not ok:
+            num_failed += 1
+            print 'cycle %d, %s (%s): last = %.12f, calcLnL = %.12f, full = %.12f' % (cycle, u.getName(), accepted and 'accepted' or 'rejected', lnL_last, lnL_incr, lnL_full)
+        if u.isMove() and isDirichletMove(u.getName()):
+            if accepted:
+                num_accepted_subset_moves += 1
+            else:
+                num_rejected_subset_moves += 1
+
+print '%d updates checked, %d failed (%d accepted and %d rejected subset moves)' % (num_checked, num_failed, num_accepted_subset_moves, num_rejected_subset_moves)
+outf.write('Partitioned GTR+G, HKY+I+G, GTR+I+G:\n')
+outf.write('  lnL after each update agrees with full recomputation: %s\n' % (num_checked > 0 and num_failed == 0 and 'yes' or 'NO'))
+outf.write('  accepted subset moves checked: %s\n' % (num_accepted_subset_moves > 0 and 'yes' or 'NO'))
+outf.write('  rejected subset moves checked: %s\n' % (num_rejected_subset_moves > 0 and 'yes' or 'NO'))
+outf.write('\n')
+
+outf.close()
@@ -0,0 +1,70 @@
+# This example checks that trees saved in the binary format written by mcmc when
+# mcmc.binary_trees is True survive the round trip to disk. The same analysis is run twice
+# from the same seed, saving trees first as NEXUS tree descriptions and then to a binary
+# tree sample file, and the NEXUS file exported from the binary file must be identical to
+# the one saved directly, apart from the [ID: ...] comment holding the random number seed
+# (the binary file does not store it). Trees are sampled every cycle so that the binary
+# file holds both samples whose topology differs from the previous one and samples that
+# store only edge lengths. Only whether the checks passed is written to output.txt.
+
+from phycas import *
+
+def runMCMC(blob, binary_trees, prefix):
+    rng = ProbDist.Lot()
+    rng.setSeed(13579)
+    mcmc.binary_trees         = binary_trees
+    mcmc.out.log              = prefix + '.log'
+    mcmc.out.log.mode         = REPLACE
+    mcmc.out.trees            = prefix + '.t'
+    mcmc.out.trees.mode       = REPLACE
+    mcmc.out.treesamples      = prefix + '.tsf'
+    mcmc.out.treesamples.mode = REPLACE
+    mcmc.out.params           = prefix + '.p'
+    mcmc.out.params.mode      = REPLACE
+    mcmc.nchains              = 1
+    mcmc.ncycles              = 500
+    mcmc.sample_every         = 1
+    mcmc.rng                  = rng
+    mcmc.data_source          = blob.characters
+    mcmc.starting_tree_source = randomtree(n_taxa=len(blob.taxon_labels), rng=rng)
+    mcmc()
+
+def treeFileLines(filename):
+    # Returns the lines of a NEXUS tree file, omitting the [ID: ...] comment
+    return [line for line in open(filename) if not line.startswith('[ID:')]
+
+outf = open('output.txt', 'w')
+
+model.type               = 'hky'
+model.num_rates          = 4
+model.pinvar_model       = False
+model.fix_edgelens       = False
+model.edgelen_prior      = ProbDist.Exponential(10.0)
+model.edgelen_hyperprior = None
+
+blob = readFile(getPhycasTestData('nyldna4.nex'))
+runMCMC(blob, False, 'text')
+runMCMC(blob, True, 'binary')
+mcmc.binary_trees = False
+
+reader = Phylogeny.TreeSampleReader('binary.tsf')
+ntrees = reader.getNumTrees()
+t = Phylogeny.Tree()
+ntopology_changes = 0
+while reader.readNext(t):
+    if reader.topologyChanged():
+        ntopology_changes += 1
+nexported = reader.exportNexus('exported.t')
+del reader
+
+text_lines = treeFileLines('text.t')
+exported_lines = treeFileLines('exported.t')
+print '%d trees in binary file (%d topology changes), %d exported' % (ntrees, ntopology_changes, nexported)
+outf.write('HKY+G MCMC, nyldna4:\n')
+outf.write('  binary file holds every sampled tree: %s\n' % (ntrees == len([line for line in text_lines if line.startswith('\ttree ')]) and 'yes' or 'NO'))
+outf.write('  binary file holds trees with and without topology changes: %s\n' % (ntopology_changes > 1 and ntopology_changes < ntrees and 'yes' or 'NO'))
+outf.write('  exported NEXUS identical to text tree file: %s\n' % (text_lines == exported_lines and 'yes' or 'NO'))
+outf.write('  parameter files identical: %s\n' % (open('text.p').read() == open('binary.p').read() and 'yes' or 'NO'))
+outf.write('\n')
+
+outf.close()
@@ -28,6 +28,14 @@ outf.write('Computing likelihood for non-polytomous tree:\n')
 outf.write('  correct lnL = -18117.830737\n')
 outf.write('          lnL = %.6f\n\n' % lnL)
 
+# Same, but rescaling by powers of 2 inside the CLA kernels
+like.uf_power_of_two = True
+pow2_lnL = like()
+like.uf_power_of_two = False
+
+outf.write('Computing likelihood for non-polytomous tree with power-of-two scaling:\n')
+outf.write('  agrees with lnL above: %s\n\n' % (abs(pow2_lnL - lnL) < 1.e-8*abs(lnL) and 'yes' or 'NO'))
+
 # Calculate likelihood under conditions in which underflow correction is used
 # for a tree that has polytomies
 
@@ -51,4 +59,12 @@ outf.write('Computing likelihood for tree with polytomies:\n')
 outf.write('  correct lnL = -16403.967004359674\n')
 outf.write('          lnL = %.6f\n\n' % lnL)
 
+# Same, but rescaling by powers of 2 inside the CLA kernels (exercises multiplyTipScaled and multiplyInternalScaled)
+like.uf_power_of_two = True
+pow2_lnL = like()
+like.uf_power_of_two = False
+
+outf.write('Computing likelihood for tree with polytomies with power-of-two scaling:\n')
+outf.write('  agrees with lnL above: %s\n\n' % (abs(pow2_lnL - lnL) < 1.e-8*abs(lnL) and 'yes' or 'NO'))
+
 outf.close()
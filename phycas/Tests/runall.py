@@ -160,6 +160,23 @@ if __name__ == '__main__':
     runTest(outFile, "FixedParams", ["fixed.p", "fixed.t"])
     runTest(outFile, "Underflow", ["output.txt"])
     runTest(outFile, "CodonTest", ["params.p", "trees.t"])
+    runTest(outFile, "CLAKernels", ["output.txt"])
+    runTest(outFile, "FloatCLA", ["output.txt"])
+    runTest(outFile, "LikelihoodEngine", ["output.txt"])
+    runTest(outFile, "PMatCache", ["output.txt"])
+    runTest(outFile, "Checkpoint", ["output.txt"])
+    runTest(outFile, "SiteLikeFile", ["output.txt"])
+    runTest(outFile, "TreeSampleFile", ["output.txt"])
+    runTest(outFile, "SubsetRefresh", ["output.txt"])
+    runTest(outFile, "EdgeLnL", ["output.txt"])
+    runTest(outFile, "EdgeLenDerivs", ["output.txt"])
+    runTest(outFile, "EdgeLenHMC", ["output.txt"])
+    runTest(outFile, "CLALayout", ["output.txt"])
+    runTest(outFile, "CoupledChains", ["output.txt"])
+    runTest(outFile, "ConcurrentSteppingstone", ["output.txt"])
+    runTest(outFile, "LotStreams", ["output.txt"])
+    runTest(outFile, "AsyncOutput", ["output.txt"])
+    runTest(outFile, "AdaptWeights", ["output.txt"])
     #runTest(outFile, "FixedTopology", ["fixdtree.p", "fixdtree.t", "simulated.nex"])
     # note: should add trees.pdf to list for SumT, but slight rounding differences
     # cause PDF files to be different, and haven't been able to figure out
@@ -490,6 +490,18 @@ class FileOutputSpec(PhycasOutput):
     def openAsLog(self, out):
         return self.open(out, True)
 
+    def openInBackground(self, out, flush_interval):
+        # Like open, but returns an AsyncFileWriter (which writes the file in
+        # a separate thread) rather than a file object. The file is created 
+        # (or appended to) by open so that existing-file behavior is handled 
+        # as usual, and then reopened for appending by the writer
+        if FileOutputSpec.open(self, out) is None:
+            return None
+        fn = self._opened_filename
+        FileOutputSpec.close(self)
+        from phycas.Likelihood import AsyncFileWriter
+        return AsyncFileWriter(fn, True, flush_interval)
+
     def close(self):
         if self._opened_file:
             if self._opened_file_is_log_in is not None:
@@ -536,6 +548,44 @@ class BinaryOutputSpec(FileOutputSpec):
     def _getValidModeNames(self):
         return 'REPLACE, or ADD_NUMBER'
 
+class SiteLikeOutputSpec(BinaryOutputSpec):
+    def __init__(self, prefix="", suffix=".bin", help_str="", filename=None):
+        BinaryOutputSpec.__init__(self, prefix, help_str, filename)
+        self.__dict__["suffix"] = suffix
+    def _getSuffix(self):
+        return self.suffix
+
+    def open(self, out):
+        # Returns a SiteLikeWriter rather than a file object. The file is 
+        # created here (so that existing-file behavior is handled as usual), 
+        # but its header is not written until the writer's setup method is
+        # called with the likelihood object that defines the patterns
+        if FileOutputSpec.open(self, out) is None:
+            return None
+        fn = self._opened_filename
+        FileOutputSpec.close(self)
+        from phycas.Likelihood import SiteLikeWriter
+        return SiteLikeWriter(fn)
+
+class TreeSampleOutputSpec(BinaryOutputSpec):
+    def __init__(self, prefix="", suffix=".tsf", help_str="", filename=None):
+        BinaryOutputSpec.__init__(self, prefix, help_str, filename)
+        self.__dict__["suffix"] = suffix
+    def _getSuffix(self):
+        return self.suffix
+
+    def open(self, out):
+        # Returns a TreeSampleWriter rather than a file object. As with 
+        # SiteLikeOutputSpec, the file is created here but the header is 
+        # written later (by the writer's create method), once the taxon 
+        # labels are known
+        if FileOutputSpec.open(self, out) is None:
+            return None
+        fn = self._opened_filename
+        FileOutputSpec.close(self)
+        from phycas.Phylogeny import TreeSampleWriter
+        return TreeSampleWriter(fn)
+
 class DevNullWriter(object):
     """Class that fulfills the TreeWriter and MatrixWriter interface, but does
     not write any data.""" 
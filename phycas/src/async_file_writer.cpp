@@ -0,0 +1,305 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread_time.hpp>
+#include "phycas/src/async_file_writer.hpp"
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Constructs a writer with no file open. The flush interval is initially one second.
+*/
+AsyncFileWriter::AsyncFileWriter()
+  : position(0), failed(false), head(0), num_queued(0), sync_requested(0), sync_completed(0), flush_interval(1.0), stopping(false), write_error(false)
+	{
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Closes the file (if open), waiting for the writer thread to write everything handed to it. Errors are ignored here;
+|	call close explicitly to find out whether the file was written successfully.
+*/
+AsyncFileWriter::~AsyncFileWriter()
+	{
+	try
+		{
+		close();
+		}
+	catch(...)
+		{
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Opens the file `fn' (replacing it unless `append' is true, in which case bytes written are added to the end of it)
+|	and starts the writer thread. If the file cannot be opened, is_open returns false afterwards and fail returns true.
+*/
+void AsyncFileWriter::open(
+  const std::string & fn,	/**< is the name of the file */
+  bool append)				/**< is true if an existing file is to be extended rather than replaced */
+	{
+	PHYCAS_ASSERT(!is_open());
+	out.clear();
+	out.open(fn.c_str(), std::ios::out | std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+	failed = !out.is_open();
+	if (failed)
+		return;
+	position = 0;
+	if (append)
+		{
+		out.seekp(0, std::ios::end);
+		position = out.tellp();
+		}
+	current.clear();
+	ring.assign(num_blocks, std::string());
+	head			= 0;
+	num_queued		= 0;
+	sync_requested	= 0;
+	sync_completed	= 0;
+	stopping		= false;
+	write_error		= false;
+	writer.reset(new boost::thread(boost::bind(&AsyncFileWriter::writerLoop, this)));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if open has succeeded and close has not been called since.
+*/
+bool AsyncFileWriter::is_open() const
+	{
+	return (bool)writer;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Appends the `n' bytes starting at `p' to the producer's block, handing the block to the writer thread if it is full.
+|	Sets the fail state if the file is not open.
+*/
+AsyncFileWriter & AsyncFileWriter::write(
+  const char * p,		/**< is the address of the first byte to write */
+  std::streamsize n)	/**< is the number of bytes to write */
+	{
+	if (!writer)
+		{
+		failed = true;
+		return *this;
+		}
+	current.append(p, (std::string::size_type)n);
+	position += n;
+	if (current.size() >= block_size)
+		handOff();
+	return *this;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes the characters of `s' (used from Python, where the file is written as text).
+*/
+void AsyncFileWriter::writeString(
+  const std::string & s)	/**< is the string to write */
+	{
+	write(s.data(), (std::streamsize)s.size());
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Hands the producer's block (if not empty) to the writer thread without waiting for it to be written. Unlike
+|	std::ofstream::flush, this does not by itself put anything in the file; the writer thread does so within about 
+|	`flush_interval' seconds. Use sync to wait until the file is up to date.
+*/
+void AsyncFileWriter::flush()
+	{
+	if (writer)
+		handOff();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Hands off the producer's block, then waits until the writer thread has written everything handed to it and flushed
+|	the file, so that the file holds every byte passed to write so far (e.g. before its length is saved in a 
+|	checkpoint).
+*/
+void AsyncFileWriter::sync()
+	{
+	if (!writer)
+		return;
+	handOff();
+	boost::mutex::scoped_lock lock(mutex);
+	const unsigned ticket = ++sync_requested;
+	block_ready.notify_one();
+	while (sync_completed < ticket && !write_error)
+		block_done.wait(lock);
+	if (write_error)
+		failed = true;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the length the file will have once every byte passed to write has reached it. Call sync first if the file 
+|	itself must have this length.
+*/
+std::streamoff AsyncFileWriter::tellp() const
+	{
+	return position;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Hands off the producer's block, waits for the writer thread to write everything and exit, then closes the file. 
+|	Check fail afterwards to find out whether every byte was written. Does nothing if the file is not open.
+*/
+void AsyncFileWriter::close()
+	{
+	if (!writer)
+		return;
+	handOff();
+		{
+		boost::mutex::scoped_lock lock(mutex);
+		stopping = true;
+		}
+	block_ready.notify_one();
+	writer->join();
+	writer.reset();
+	out.close();
+	if (write_error || !out)
+		failed = true;
+	ring.clear();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if the file could not be opened or a write error has been detected.
+*/
+bool AsyncFileWriter::fail() const
+	{
+	return failed;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Same as fail, so that a writer can be tested like a stream.
+*/
+bool AsyncFileWriter::operator!() const
+	{
+	return failed;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the minimum time between flushes of the file by the writer thread. If `seconds' is 0.0, the file is flushed
+|	after every block handed off, which gives the same guarantee as flushing a std::ofstream after each sample but still
+|	keeps the producer from waiting.
+*/
+void AsyncFileWriter::setFlushInterval(
+  double seconds)	/**< is the new flush interval in seconds */
+	{
+	PHYCAS_ASSERT(seconds >= 0.0);
+	boost::mutex::scoped_lock lock(mutex);
+	flush_interval = seconds;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Moves the producer's block (if not empty) into the ring, waiting only if every block of the ring is still waiting 
+|	to be written. The block taken from the ring in exchange was emptied by the writer thread but keeps its capacity, so
+|	once the ring has filled no further memory is allocated. Picks up any error reported by the writer thread.
+*/
+void AsyncFileWriter::handOff()
+	{
+		{
+		boost::mutex::scoped_lock lock(mutex);
+		while (num_queued == num_blocks && !write_error)
+			block_done.wait(lock);
+		if (write_error)
+			{
+			failed = true;
+			current.clear();
+			return;
+			}
+		if (current.empty())
+			return;
+		ring[(head + num_queued) % num_blocks].swap(current);
+		++num_queued;
+		}
+	block_ready.notify_one();
+	current.clear();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Body of the writer thread: writes blocks in the order in which they were handed off, flushes the file when 
+|	`flush_interval' seconds have passed since the last flush (or when sync asks it to), and returns once close has been
+|	called and every block has been written. The mutex is released during every disk operation.
+*/
+void AsyncFileWriter::writerLoop()
+	{
+	std::string block;
+	bool dirty = false;
+	boost::system_time last_flush = boost::get_system_time();
+	boost::mutex::scoped_lock lock(mutex);
+	for (;;)
+		{
+		const boost::system_time next_flush = last_flush + boost::posix_time::microseconds((boost::int64_t)(1.0e6*flush_interval));
+		if (num_queued > 0)
+			{
+			block.swap(ring[head]);
+			head = (head + 1) % num_blocks;
+			--num_queued;
+			lock.unlock();
+			out.write(block.data(), (std::streamsize)block.size());
+			block.clear();
+			bool ok = out.good();
+			const bool due = (boost::get_system_time() >= next_flush);
+			if (ok && due)
+				{
+				out.flush();
+				ok = out.good();
+				last_flush = boost::get_system_time();
+				}
+			lock.lock();
+			dirty = !due;
+			if (!ok)
+				write_error = true;
+			block_done.notify_all();
+			}
+		else if (sync_completed != sync_requested)
+			{
+			const unsigned target = sync_requested;
+			lock.unlock();
+			out.flush();
+			const bool ok = out.good();
+			last_flush = boost::get_system_time();
+			lock.lock();
+			dirty = false;
+			if (!ok)
+				write_error = true;
+			sync_completed = target;
+			block_done.notify_all();
+			}
+		else if (stopping)
+			break;
+		else if (dirty)
+			{
+			if (!block_ready.timed_wait(lock, next_flush) && num_queued == 0)
+				{
+				lock.unlock();
+				out.flush();
+				const bool ok = out.good();
+				last_flush = boost::get_system_time();
+				lock.lock();
+				dirty = false;
+				if (!ok)
+					write_error = true;
+				}
+			}
+		else
+			block_ready.wait(lock);
+		}
+	}
+
+} // namespace phycas
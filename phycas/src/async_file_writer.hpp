@@ -0,0 +1,99 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(ASYNC_FILE_WRITER_HPP)
+#define ASYNC_FILE_WRITER_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	An output file whose bytes are written to disk by a dedicated thread, so that the thread producing the output (e.g.
+|	the thread running an MCMC analysis) never waits for the disk. Bytes passed to write accumulate in a block owned by
+|	the producer; when the block is full, or flush is called, it is handed to the writer thread through a bounded ring
+|	of blocks. The hand-off swaps the block with an empty one while holding a mutex, so the lock is never held during a
+|	disk operation or a copy. The producer waits only if the ring is full, i.e. if output is produced faster than the 
+|	disk can accept it for a sustained period. The writer thread flushes the file to the operating system whenever it
+|	has been idle with unflushed data for `flush_interval' seconds, so a file being written is never more than about
+|	that far behind. The interface mimics std::ofstream so that this class can replace it: write errors (including 
+|	those detected later by the writer thread) are reported by operator! and fail.
+*/
+class AsyncFileWriter : boost::noncopyable
+	{
+	public:
+									AsyncFileWriter();
+									~AsyncFileWriter();
+
+		void						open(const std::string & fn, bool append);
+		bool						is_open() const;
+
+		AsyncFileWriter &			write(const char * p, std::streamsize n);
+		void						writeString(const std::string & s);
+		void						flush();
+		void						sync();
+		std::streamoff				tellp() const;
+		void						close();
+
+		bool						fail() const;
+		bool						operator!() const;
+
+		void						setFlushInterval(double seconds);
+
+	private:
+
+		void						handOff();
+		void						writerLoop();
+
+		static const unsigned		block_size = 65536;	/**< The size at which the producer's block is handed to the writer thread */
+		static const unsigned		num_blocks = 16;	/**< The number of blocks in the ring */
+
+		std::ofstream				out;				/**< The file, which only the writer thread touches while it is running */
+		boost::scoped_ptr<boost::thread>	writer;		/**< The writer thread (NULL if the file is not open) */
+		std::string					current;			/**< The block being filled by the producer */
+		std::streamoff				position;			/**< The length the file will have once every byte passed to write has been written */
+		bool						failed;				/**< True if a write error has been detected (read and set only by the producer) */
+
+		boost::mutex				mutex;				/**< Guards all data members below */
+		boost::condition_variable	block_ready;		/**< Signalled when a block is handed off, when a sync is requested, or when the writer must stop */
+		boost::condition_variable	block_done;			/**< Signalled when the writer thread has written a block or completed a sync */
+		std::vector<std::string>	ring;				/**< The blocks handed to the writer thread and not yet written */
+		unsigned					head;				/**< The index in `ring' of the next block to be written */
+		unsigned					num_queued;			/**< The number of blocks in `ring' waiting to be written */
+		unsigned					sync_requested;		/**< Incremented by sync to ask the writer thread to flush the file */
+		unsigned					sync_completed;		/**< Set to `sync_requested' by the writer thread once the flush requested has been done */
+		double						flush_interval;		/**< The minimum time (in seconds) between flushes of the file by the writer thread */
+		bool						stopping;			/**< Set by close to tell the writer thread to exit once the ring is empty */
+		bool						write_error;		/**< Set by the writer thread if a write or flush fails */
+	};
+
+typedef boost::shared_ptr<AsyncFileWriter> AsyncFileWriterShPtr;
+
+} // namespace phycas
+
+#endif
@@ -17,17 +17,42 @@
 |  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
 \~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
+#include <sstream>
 #include "phycas/src/basic_lot.hpp"
+#include "phycas/src/xprobdist.hpp"
 
 const unsigned MASKSIGNBIT = 0x80000000;
 
+namespace
+{
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns `x' rotated left by `k' bits.
+*/
+inline boost::uint64_t rotl(const boost::uint64_t x, int k)
+	{
+	return (x << k) | (x >> (64 - k));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	One step of the splitmix64 generator, used to turn a 32-bit seed into well-mixed 64-bit words.
+*/
+inline boost::uint64_t splitmix64(boost::uint64_t & z)
+	{
+	z += 0x9E3779B97F4A7C15ULL;
+	boost::uint64_t x = z;
+	x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27))*0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+	}
+}
+
 using namespace phycas;
 
 /*----------------------------------------------------------------------------------------------------------------------
 |	Default constructor. Sets `last_seed_setting' and `curr_seed' both to 1U, creates a new CDF object and stored the
 |	pointer in `cdf_converter', then calls the UseClockToSeed function.
 */
-Lot::Lot() : last_seed_setting(1U), curr_seed(1U), num_seeds_generated(0)
+Lot::Lot() : engine(lehmer), last_seed_setting(1U), curr_seed(1U), num_seeds_generated(0), stream(0)
 	{
 	UseClockToSeed();
 	}
@@ -37,7 +62,7 @@ Lot::Lot() : last_seed_setting(1U), curr_seed(1U), num_seeds_generated(0)
 |	object and stores the pointer in `cdf_converter', then calls the UseClockToSeed function if `rnd_seed' is zero or
 |	UINT_MAX, or the SetSeed function if `rnd_seed' is any other value.
 */
-Lot::Lot(unsigned rnd_seed) : last_seed_setting(1U), curr_seed(1U), num_seeds_generated(0)
+Lot::Lot(unsigned rnd_seed) : engine(lehmer), last_seed_setting(1U), curr_seed(1U), num_seeds_generated(0), stream(0)
 	{
 	//cdf_converter = new CDF();
 	if (rnd_seed == 0 || rnd_seed == UINT_MAX)
@@ -67,6 +92,9 @@ double Lot::Uniform(const char * file, const int line)
 double Lot::Uniform()
 #endif
 	{
+	if (engine == xoshiro256ss)
+		return XoshiroUniform();
+
 #if 1	// original random number generator; a tiny bit slower but probably better
 
 	const unsigned a = 16807U;
@@ -160,10 +188,14 @@ unsigned Lot::MultinomialDraw(const double * probs, unsigned n, double totalProb
 // below here formerly in basic_lot.inl
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Returns value of data member `curr_seed', which stores the current seed (which changes after each draw).
+|	Returns value of data member `curr_seed', which stores the current seed (which changes after each draw). The state of
+|	the xoshiro256ss engine is 256 bits long, so for that engine the high-order 32 bits of the first state word are 
+|	returned instead; use GetState to save the complete state.
 */
 unsigned Lot::GetSeed() const
 	{
+	if (engine == xoshiro256ss)
+		return (unsigned)(xstate[0] >> 32);
 	return curr_seed;
 	}
 
@@ -182,6 +214,8 @@ void Lot::SetSeed(unsigned s)
 	{
 	PHYCAS_ASSERT(s > 0 && s < UINT_MAX);
 	curr_seed = last_seed_setting = s;
+	stream = 0;
+	SeedXoshiro();
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -192,6 +226,8 @@ void Lot::UseClockToSeed()
 	time_t timer;
 	curr_seed = (unsigned)time(&timer);
 	last_seed_setting = curr_seed;
+	stream = 0;
+	SeedXoshiro();
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -232,3 +268,206 @@ unsigned Lot::GetRandBits(unsigned nbits)
 		}
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the engine currently used to generate pseudorandom numbers.
+*/
+Lot::EngineType Lot::GetEngine() const
+	{
+	return engine;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the stream set by the last call to UseStream (0 if UseStream has not been called since the seed was last 
+|	set).
+*/
+unsigned Lot::GetStream() const
+	{
+	return stream;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Selects the engine used to generate pseudorandom numbers and restarts it from the seed last set (the value returned 
+|	by GetInitSeed), so that the sequence generated after calling SetEngine depends only on the engine and the seed.
+*/
+void Lot::SetEngine(
+  EngineType e)		/**< is the engine to use */
+	{
+	engine = e;
+	curr_seed = last_seed_setting;
+	SeedXoshiro();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Makes this Lot generate stream number `stream_index' derived from the seed of `parent', using the same engine as
+|	`parent'. Draws from `parent' are not consumed, so the streams given to a set of chains depend only on the parent's
+|	seed. For the xoshiro256ss engine, stream k starts 2^(128)k draws into the sequence started by the parent's seed 
+|	(stream 0 is the parent's own sequence), so streams cannot overlap unless more than 2^128 numbers are drawn from 
+|	one of them. The lehmer engine has no jump function, so each of its streams is simply started from a different seed
+|	computed from the parent's seed and `stream_index'; such streams are only overlapping by chance, but that chance is
+|	not negligible for long runs.
+*/
+void Lot::UseStream(
+  const Lot & parent,		/**< is the Lot whose seed and engine are to be used */
+  unsigned stream_index)	/**< is the index of the stream */
+	{
+	engine = parent.engine;
+	stream = stream_index;
+	if (engine == xoshiro256ss)
+		{
+		curr_seed = last_seed_setting = parent.last_seed_setting;
+		SeedXoshiro();
+		}
+	else
+		{
+		boost::uint64_t z = ((boost::uint64_t)parent.last_seed_setting << 32) | stream_index;
+		curr_seed = last_seed_setting = 1U + (unsigned)(splitmix64(z) % 2147483646ULL);
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns a string holding the complete state of this Lot, which can be passed to SetState to resume the sequence of
+|	pseudorandom numbers exactly where it left off (e.g. when restarting an analysis from a checkpoint).
+*/
+std::string Lot::GetState() const
+	{
+	std::ostringstream out;
+	if (engine == xoshiro256ss)
+		{
+		out << "xoshiro256ss " << last_seed_setting << ' ' << stream;
+		for (unsigned i = 0; i < 4; ++i)
+			out << ' ' << (unsigned long long)xstate[i];
+		}
+	else
+		out << "lehmer " << last_seed_setting << ' ' << curr_seed;
+	return out.str();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the state saved by an earlier call to GetState (possibly by a different Lot object). Throws XProbDist if 
+|	`state' was not produced by GetState.
+*/
+void Lot::SetState(
+  const std::string & state)	/**< is a string returned by GetState */
+	{
+	std::istringstream in(state);
+	std::string engine_name;
+	in >> engine_name;
+	if (engine_name == "xoshiro256ss")
+		{
+		unsigned long long x[4];
+		unsigned init_seed = 0, stream_index = 0;
+		in >> init_seed >> stream_index >> x[0] >> x[1] >> x[2] >> x[3];
+		if (in.fail() || (x[0] | x[1] | x[2] | x[3]) == 0)
+			throw XProbDist("invalid xoshiro256ss state supplied to Lot::SetState");
+		engine = xoshiro256ss;
+		curr_seed = last_seed_setting = init_seed;
+		stream = stream_index;
+		for (unsigned i = 0; i < 4; ++i)
+			xstate[i] = x[i];
+		}
+	else if (engine_name == "lehmer")
+		{
+		unsigned init_seed = 0, seed = 0;
+		in >> init_seed >> seed;
+		if (in.fail() || seed == 0 || seed >= 2147483647U)
+			throw XProbDist("invalid lehmer state supplied to Lot::SetState");
+		engine = lehmer;
+		last_seed_setting = init_seed;
+		curr_seed = seed;
+		stream = 0;
+		SeedXoshiro();
+		}
+	else
+		throw XProbDist("unrecognized engine in state supplied to Lot::SetState");
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Fills `buffer' with `n' uniform deviates, exactly as if Uniform had been called `n' times. Much faster than calling
+|	Uniform repeatedly from Python, and lets C++ code that needs many deviates draw them all at once.
+*/
+void Lot::FillUniform(
+  double * buffer,	/**< is the array to fill (must have room for at least `n' values) */
+  unsigned n)		/**< is the number of deviates to generate */
+	{
+	PHYCAS_ASSERT(buffer != NULL || n == 0);
+	if (engine == xoshiro256ss)
+		{
+		for (unsigned i = 0; i < n; ++i)
+			buffer[i] = XoshiroUniform();
+		}
+	else
+		{
+		for (unsigned i = 0; i < n; ++i)
+			buffer[i] = Uniform(FILE_AND_LINE);
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns a vector of `n' uniform deviates generated using FillUniform.
+*/
+std::vector<double> Lot::GetUniforms(
+  unsigned n)	/**< is the number of deviates to generate */
+	{
+	std::vector<double> v(n);
+	if (n > 0)
+		FillUniform(&v[0], n);
+	return v;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the state of the xoshiro256ss engine from `last_seed_setting' (expanded to 256 bits using splitmix64), then
+|	jumps ahead `stream' times. Called whenever the seed changes, so that either engine can be selected at any time.
+*/
+void Lot::SeedXoshiro()
+	{
+	boost::uint64_t z = last_seed_setting;
+	for (unsigned i = 0; i < 4; ++i)
+		xstate[i] = splitmix64(z);
+	for (unsigned k = 0; k < stream; ++k)
+		JumpXoshiro();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Advances the xoshiro256ss engine by 2^128 draws (the jump function of Blackman and Vigna).
+*/
+void Lot::JumpXoshiro()
+	{
+	static const boost::uint64_t jump[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+	boost::uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	for (unsigned i = 0; i < 4; ++i)
+		{
+		for (unsigned b = 0; b < 64; ++b)
+			{
+			if (jump[i] & ((boost::uint64_t)1 << b))
+				{
+				s0 ^= xstate[0];
+				s1 ^= xstate[1];
+				s2 ^= xstate[2];
+				s3 ^= xstate[3];
+				}
+			XoshiroUniform();
+			}
+		}
+	xstate[0] = s0;
+	xstate[1] = s1;
+	xstate[2] = s2;
+	xstate[3] = s3;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Advances the xoshiro256ss engine one step and returns a uniform deviate made from the high-order 53 bits of the 
+|	output. Half of the spacing between representable values is added so that the result lies strictly between 0 and 1 
+|	(as do all values produced by the lehmer engine); callers may therefore safely take its logarithm.
+*/
+inline double Lot::XoshiroUniform()
+	{
+	const boost::uint64_t result = rotl(xstate[1]*5, 7)*9;
+	const boost::uint64_t t = xstate[1] << 17;
+	xstate[2] ^= xstate[0];
+	xstate[3] ^= xstate[1];
+	xstate[1] ^= xstate[2];
+	xstate[0] ^= xstate[3];
+	xstate[2] ^= t;
+	xstate[3] = rotl(xstate[3], 45);
+	return ((double)(result >> 11) + 0.5)*(1.0/9007199254740992.0);
+	}
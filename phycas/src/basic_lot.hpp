@@ -22,6 +22,9 @@
 
 #include <cmath>
 #include <ctime>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 
 namespace phycas
@@ -30,10 +33,23 @@ namespace phycas
 /*----------------------------------------------------------------------------------------------------------------------
 |	This class was called Lot because the noun lot is defined as "an object used in deciding something by chance" 
 |	according to The New Merriam-Webster Dictionary.
+|
+|	Two engines are available. The default (Lot::lehmer) is the original 31-bit multiplicative congruential generator,
+|	which has a period of only 2^31 - 2 and offers no way to create independent streams. The other (Lot::xoshiro256ss)
+|	is the xoshiro256** generator of Blackman and Vigna (2018), which has a period of 2^256 - 1 and a jump function 
+|	that advances it by 2^128 draws; UseStream uses this to give each chain (or thread) its own non-overlapping stream
+|	derived from a single seed. The complete state of either engine can be saved with GetState and restored with 
+|	SetState so that runs can be checkpointed.
 */
 class Lot
 	{
 	public:
+		enum EngineType
+			{
+			lehmer			= 0,	/**< the original 31-bit multiplicative congruential generator */
+			xoshiro256ss	= 1		/**< the xoshiro256** generator */
+			};
+
 								Lot();
 								Lot(unsigned);
 								~Lot();
@@ -41,15 +57,23 @@ class Lot
 		// Accessors
 		unsigned				GetSeed() const;
 		unsigned 				GetInitSeed() const;
+		EngineType				GetEngine() const;
+		unsigned				GetStream() const;
+		std::string				GetState() const;
 
 		// Modifiers
 		void 					UseClockToSeed();
 		void 					SetSeed(unsigned s);
+		void					SetEngine(EngineType e);
+		void					UseStream(const Lot & parent, unsigned stream);
+		void					SetState(const std::string & state);
 
 		// Utilities
         unsigned                MultinomialDraw(const double * probs, unsigned n, double totalProb=1.0);
 		unsigned 				SampleUInt(unsigned);
 		unsigned				GetRandBits(unsigned nbits);
+		void					FillUniform(double * buffer, unsigned n);
+		std::vector<double>		GetUniforms(unsigned n);
 
 #if defined(LOG_LOT_UNIFORM_CALLS)
 		double 					Uniform(const char * file, const int line);
@@ -59,9 +83,16 @@ class Lot
 		bool					Boolean();
 	private:    	
 
-		unsigned 				last_seed_setting;
-		unsigned				curr_seed;
+		void					SeedXoshiro();
+		void					JumpXoshiro();
+		double					XoshiroUniform();
+
+		EngineType				engine;					/**< The engine used to generate pseudorandom numbers */
+		unsigned 				last_seed_setting;		/**< The seed last supplied to SetSeed (or taken from the clock) */
+		unsigned				curr_seed;				/**< The state of the lehmer engine */
 		unsigned				num_seeds_generated;
+		unsigned				stream;					/**< The stream (number of 2^128 jumps from the state implied by `last_seed_setting') used by the xoshiro256ss engine */
+		boost::uint64_t			xstate[4];				/**< The state of the xoshiro256ss engine */
 	};
 
 typedef boost::shared_ptr<Lot> LotShPtr;
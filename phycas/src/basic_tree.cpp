@@ -20,6 +20,7 @@
 #include <string>
 #include <cstdio>
 #include <cctype>
+#include <algorithm>
 //#include "phycas/src/phycas_string.hpp"
 #include "phycas/src/basic_tree.hpp"
 #include "phycas/src/tree_manip.hpp"
@@ -1807,6 +1808,69 @@ void Tree::BuildFromString(
  	//	}
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Builds the tree from arrays describing its nodes in preorder sequence, as stored by TreeSampleWriter. Element i of
+|	`parents' is the preorder index of the parent of node i (UINT_MAX for the root, which must be node 0 and have just
+|	one child), and element i of `numbers' is its node number. If `edgelens' is not empty, it holds the edge lengths of
+|	all nodes but the root, in preorder sequence. No node names are parsed, so this is much faster than 
+|	BuildFromString. The arrays are checked before the tree is changed, and XPhylogeny is thrown if they do not 
+|	describe a tree.
+*/
+void Tree::BuildFromPreorder(
+  const std::vector<unsigned> & parents,	/**< is the preorder index of the parent of each node */
+  const std::vector<unsigned> & numbers,	/**< is the node number of each node */
+  const std::vector<double> & edgelens)		/**< is the edge length of each node except the root (may be empty) */
+	{
+	const unsigned nnodes = (unsigned)parents.size();
+	if (nnodes < 2 || numbers.size() != nnodes)
+		throw XPhylogeny("the parent and node number arrays must have the same length and describe at least two nodes");
+	if (!edgelens.empty() && edgelens.size() != nnodes - 1)
+		throw XPhylogeny(boost::str(boost::format("expecting %d edge lengths but found %d") % (nnodes - 1) % edgelens.size()));
+	if (parents[0] != UINT_MAX)
+		throw XPhylogeny("the first node in preorder sequence must be the root");
+	std::vector<unsigned> nchildren(nnodes, 0);
+	for (unsigned i = 1; i < nnodes; ++i)
+		{
+		if (parents[i] >= i)
+			throw XPhylogeny(boost::str(boost::format("the parent of node %d does not precede it in preorder sequence") % i));
+		++nchildren[parents[i]];
+		}
+	if (nchildren[0] != 1)
+		throw XPhylogeny("the root node must have exactly one child");
+	if (std::find(nchildren.begin() + 1, nchildren.end(), 1U) != nchildren.end())
+		throw XPhylogeny("internal node has only one child");
+
+	Clear();
+	TreeNodeVec nodes(nnodes, (TreeNode *)NULL);
+	for (unsigned i = 0; i < nnodes; ++i)
+		{
+		TreeNode * nd = GetNewNode();
+		nd->nodeNum = numbers[i];
+		if (i == 0)
+			{
+			firstPreorder = nd;
+			nd->SetEdgeLen(0.0);
+			++nTips;
+			}
+		else
+			{
+			nodes[parents[i]]->AddChild(nd);
+			if (!edgelens.empty())
+				nd->SetEdgeLen(edgelens[i - 1]);
+			if (nchildren[i] == 0)
+				++nTips;
+			else
+				++nInternals;
+			}
+		nodes[i] = nd;
+		}
+	if (isRooted)
+		firstPreorder->nodeName = "root";
+	hasEdgeLens = !edgelens.empty();
+	nodeCountsValid = true;
+	RefreshPreorder();
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Creates a parenthetical description of the tree (Newick format). If the tree has edge lengths, these are included in
 |	the Newick description. Any nodes having non-empty node names are named in the Newick description. If a tip node
@@ -119,6 +119,7 @@ class Tree : public boost::enable_shared_from_this<Tree>
         void                    stripNodeNames();
         void                    renumberInternalNodes(unsigned start_at);
 		void					BuildFromString(const std::string & newick, bool zero_based_tips = false); // throws XPhylogeny
+		void					BuildFromPreorder(const std::vector<unsigned> & parents, const std::vector<unsigned> & numbers, const std::vector<double> & edgelens); // throws XPhylogeny
 		void					RectifyNumbers(std::vector<std::string> name_vector); // throws XPhylogeny
 		void					RectifyNames(std::vector<std::string> name_vector); // throws XPhylogeny
 		double					internalEdgeLenSum();
@@ -11,43 +11,55 @@
 
 #include <vector>
 #include "boost/shared_ptr.hpp"
-#include "basic_tree.hpp"
+#include "phycas/src/likelihood_engine.hpp"
 
 namespace phycas {
 
-class BeagleLib
+/*----------------------------------------------------------------------------------------------------------------------
+|	LikelihoodEngine implemented by the BEAGLE library (a GPU is used if one is available). Each partials buffer has a
+|	scale buffer with the same index; one extra scale buffer accumulates the scale factors of every buffer written by
+|	the last call to updatePartials, so that call must cover the whole tree (TreeLikelihood always recomputes the whole
+|	tree when using an engine).
+*/
+class BeagleLib : public LikelihoodEngine
 {
 	public:
 	BeagleLib();
 	~BeagleLib();
-	
-	//void					Init(unsigned nTaxa, unsigned nCat, unsigned nStates, unsigned nPatterns, unsigned debug);
-	void					Init(unsigned nTaxa, unsigned nCat, unsigned nStates, unsigned nPatterns);
+
 	void					ListResources();
-	void					SetStateFrequencies(const std::vector<double> &freqs);
-	void					SetTipStates(TreeShPtr t, unsigned whichSubset = 0);
-	void					SetCategoryRatesAndWeights(const std::vector<double> &rates, const std::vector<double> &weights);
-	void					SetPatternWeights(const std::vector<double> &patternWeights);
-	void					SetEigenDecomposition(const std::vector<double> &eigenValues, const std::vector<double> &eigenVectors, const std::vector<double> &inverseEigenVectors);
-	void					DefineOperations(TreeShPtr t, double edgelenScaler);
-	void					IndexNodes(TreeShPtr t);
-	double					CalcLogLikelihood(TreeShPtr t);
-	
+
+	virtual std::string		getName() const;
+
+	virtual void			createInstance(unsigned ntips, unsigned nbuffers, unsigned nmatrices, unsigned nstates, unsigned npatterns, unsigned ncategories);
+
+	virtual void			setTipPartials(unsigned tip, const std::vector<double> & tip_partials);
+	virtual void			setPatternWeights(const std::vector<double> & weights);
+	virtual void			setStateFrequencies(const double * freqs);
+	virtual void			setCategoryWeights(const std::vector<double> & weights);
+	virtual void			setTransitionMatrices(unsigned index, const double * const * const * pmats);
+
+	virtual void			updatePartials(const LikelihoodEngineOperationVect & ops);
+	virtual double			calcEdgeLogLikelihood(unsigned parent, unsigned child, unsigned child_pmat, double * site_lnL);
+
+	private:
+
+	void					CheckCode(int code, const char * what) const;
+
 	int						_instance;
-	int						_nTaxa;
+	bool					_haveInstance;
+	int						_nBuffers;
 	int						_nCat;
 	int						_nStates;
 	int						_nPatterns;
-	double					_logLikelihood;
-	bool					_reCalLogLikelihoodNeeded;
-	
+
 	std::vector<int>		_operations;
-	std::vector<int>		_pMatrixIndex;
-	std::vector<double>		_brLens;
+	std::vector<int>		_scaleIndices;
+	std::vector<double>		_flatMatrices;
 };
 
 typedef boost::shared_ptr<BeagleLib> BeagleLibShPtr;
 
 }
 
-#endif 
\ No newline at end of file
+#endif
@@ -75,6 +75,7 @@ void Binary::setScalingFactor(
     {
     PHYCAS_ASSERT(sf >= 0.0);
     scaling_factor = sf;
+	++time_stamp;
     }
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -127,7 +128,7 @@ void Binary::setKappa(
     kappa = k;
     state_freqs[0] = 1.0/(1.0 + kappa);
     state_freqs[1] = 1.0 - state_freqs[0];
-        
+	++time_stamp;
 }   
 
 /*----------------------------------------------------------------------------------------------------------------------
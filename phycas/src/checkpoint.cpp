@@ -0,0 +1,236 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#include <cstdio>
+#include <algorithm>
+#include "phycas/src/checkpoint.hpp"
+#include "phycas/src/xlikelihood.hpp"
+
+namespace
+{
+const char			checkpoint_magic[8]	= {'P', 'H', 'Y', 'C', 'K', 'P', 'T', '\0'};
+const unsigned		checkpoint_version	= 2;
+const unsigned		byte_order_mark		= 0x01020304;
+}
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Opens a temporary file (`fn' with ".tmp" appended) and writes the file header to it. Throws XLikelihood if the file 
+|	cannot be opened.
+*/
+CheckpointWriter::CheckpointWriter(
+  const std::string & fn)	/**< is the name of the checkpoint file */
+  : filename(fn), tmp_filename(fn + ".tmp")
+	{
+	out.open(tmp_filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		throw XLikelihood(std::string("could not open checkpoint file ") + tmp_filename);
+	putBytes(checkpoint_magic, sizeof(checkpoint_magic));
+	putUInt(checkpoint_version);
+	putUInt(byte_order_mark);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	If close was not called (e.g. because an exception was thrown while the checkpoint was being written), removes the
+|	temporary file so that the previous checkpoint is left as it was.
+*/
+CheckpointWriter::~CheckpointWriter()
+	{
+	if (out.is_open())
+		{
+		out.close();
+		std::remove(tmp_filename.c_str());
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes `n' bytes starting at `p', throwing XLikelihood if the write fails (e.g. because the disk is full).
+*/
+void CheckpointWriter::putBytes(
+  const void * p,		/**< is the address of the first byte to write */
+  std::streamsize n)	/**< is the number of bytes to write */
+	{
+	if (!out.is_open())
+		throw XLikelihood(std::string("checkpoint file ") + filename + " has already been closed");
+	out.write(reinterpret_cast<const char *>(p), n);
+	if (!out)
+		throw XLikelihood(std::string("error writing checkpoint file ") + tmp_filename);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes the unsigned integer `x'.
+*/
+void CheckpointWriter::putUInt(
+  unsigned x)	/**< is the value to write */
+	{
+	putBytes(&x, sizeof(x));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes the double `x' (all 8 bytes, so that it can be restored exactly).
+*/
+void CheckpointWriter::putDouble(
+  double x)		/**< is the value to write */
+	{
+	putBytes(&x, sizeof(x));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes the bool `x' as an unsigned integer (1 for true, 0 for false).
+*/
+void CheckpointWriter::putBool(
+  bool x)	/**< is the value to write */
+	{
+	putUInt(x ? 1U : 0U);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes the length of `s' followed by its characters.
+*/
+void CheckpointWriter::putString(
+  const std::string & s)	/**< is the string to write */
+	{
+	putUInt((unsigned)s.size());
+	if (!s.empty())
+		putBytes(s.data(), (std::streamsize)s.size());
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes the length of `v' followed by its elements.
+*/
+void CheckpointWriter::putDoubleVect(
+  const double_vect_t & v)	/**< is the vector to write */
+	{
+	putUInt((unsigned)v.size());
+	if (!v.empty())
+		putBytes(&v[0], (std::streamsize)(v.size()*sizeof(double)));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Closes the temporary file and renames it, replacing any existing file named `filename'. Nothing more can be written
+|	after close is called.
+*/
+void CheckpointWriter::close()
+	{
+	out.close();
+	if (!out)
+		throw XLikelihood(std::string("error closing checkpoint file ") + tmp_filename);
+#if defined(_WIN32)
+	std::remove(filename.c_str());	// rename fails on Windows if the destination exists
+#endif
+	if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+		throw XLikelihood(std::string("could not rename ") + tmp_filename + " to " + filename);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Opens the checkpoint file `fn' and checks its header.
+*/
+CheckpointReader::CheckpointReader(
+  const std::string & fn)	/**< is the name of the checkpoint file */
+  : filename(fn)
+	{
+	in.open(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!in.is_open())
+		throw XLikelihood(std::string("could not open checkpoint file ") + filename);
+	char magic[sizeof(checkpoint_magic)];
+	getBytes(magic, sizeof(magic));
+	if (!std::equal(magic, magic + sizeof(magic), checkpoint_magic))
+		throw XLikelihood(filename + " is not a Phycas checkpoint file");
+	const unsigned version = getUInt();
+	if (version != checkpoint_version)
+		throw XLikelihood(filename + " was written by an incompatible version of Phycas");
+	if (getUInt() != byte_order_mark)
+		throw XLikelihood(filename + " was written on a machine with a different byte order");
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads `n' bytes into the memory starting at `p', throwing XLikelihood if the end of the file is reached first.
+*/
+void CheckpointReader::getBytes(
+  void * p,				/**< is the address at which to store the first byte read */
+  std::streamsize n)	/**< is the number of bytes to read */
+	{
+	in.read(reinterpret_cast<char *>(p), n);
+	if (in.gcount() != n)
+		throw XLikelihood(std::string("checkpoint file ") + filename + " is truncated or corrupt");
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads an unsigned integer written by CheckpointWriter::putUInt.
+*/
+unsigned CheckpointReader::getUInt()
+	{
+	unsigned x = 0;
+	getBytes(&x, sizeof(x));
+	return x;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads a double written by CheckpointWriter::putDouble.
+*/
+double CheckpointReader::getDouble()
+	{
+	double x = 0.0;
+	getBytes(&x, sizeof(x));
+	return x;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads a bool written by CheckpointWriter::putBool.
+*/
+bool CheckpointReader::getBool()
+	{
+	return (getUInt() != 0);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads a string written by CheckpointWriter::putString.
+*/
+std::string CheckpointReader::getString()
+	{
+	const unsigned n = getUInt();
+	std::string s(n, '\0');
+	if (n > 0)
+		getBytes(&s[0], (std::streamsize)n);
+	return s;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads a vector written by CheckpointWriter::putDoubleVect.
+*/
+double_vect_t CheckpointReader::getDoubleVect()
+	{
+	const unsigned n = getUInt();
+	double_vect_t v(n);
+	if (n > 0)
+		getBytes(&v[0], (std::streamsize)(n*sizeof(double)));
+	return v;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if everything in the file has been read.
+*/
+bool CheckpointReader::atEnd()
+	{
+	return (in.peek() == std::char_traits<char>::eof());
+	}
+
+} // namespace phycas
@@ -0,0 +1,93 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(CHECKPOINT_HPP)
+#define CHECKPOINT_HPP
+
+#include <string>
+#include <fstream>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "phycas/src/states_patterns.hpp"		// for double_vect_t
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes a binary checkpoint file from which an interrupted MCMC analysis can be resumed. Values are written in native
+|	byte order (doubles as their raw 8 bytes, so they are restored exactly); the header records the byte order, and 
+|	CheckpointReader refuses files written on a machine with a different one. Nothing is written to the file named in 
+|	the constructor until close is called: the data go to a temporary file that close renames, so a job killed while
+|	writing a checkpoint leaves the previous checkpoint intact.
+*/
+class CheckpointWriter : boost::noncopyable
+	{
+	public:
+									CheckpointWriter(const std::string & fn);
+									~CheckpointWriter();
+
+		void						putUInt(unsigned x);
+		void						putDouble(double x);
+		void						putBool(bool x);
+		void						putString(const std::string & s);
+		void						putDoubleVect(const double_vect_t & v);
+
+		void						close();
+
+	private:
+
+		void						putBytes(const void * p, std::streamsize n);
+
+		std::string					filename;		/**< The name of the checkpoint file */
+		std::string					tmp_filename;	/**< The name of the temporary file written until close is called */
+		std::ofstream				out;			/**< The stream attached to `tmp_filename' */
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads a checkpoint file written by CheckpointWriter. Values must be read in the order in which they were written.
+|	Throws XLikelihood if the file cannot be opened, was not written by CheckpointWriter (or was written on a machine
+|	with different byte order), or ends prematurely.
+*/
+class CheckpointReader : boost::noncopyable
+	{
+	public:
+									CheckpointReader(const std::string & fn);
+
+		unsigned					getUInt();
+		double						getDouble();
+		bool						getBool();
+		std::string					getString();
+		double_vect_t				getDoubleVect();
+
+		bool						atEnd();
+
+	private:
+
+		void						getBytes(void * p, std::streamsize n);
+
+		std::string					filename;		/**< The name of the checkpoint file (used in error messages) */
+		std::ifstream				in;				/**< The stream attached to `filename' */
+	};
+
+typedef boost::shared_ptr<CheckpointWriter> CheckpointWriterShPtr;
+typedef boost::shared_ptr<CheckpointReader> CheckpointReaderShPtr;
+
+} // namespace phycas
+
+#endif
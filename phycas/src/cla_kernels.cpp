@@ -0,0 +1,1005 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#include <algorithm>
+#include <cmath>
+#include <boost/bind.hpp>
+#include "phycas/src/cla_kernels.hpp"
+#include "phycas/src/thread_pool.hpp"
+
+#if !defined(PHYCAS_NO_SIMD) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#	if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#		define PHYCAS_CLA_SIMD
+#		define PHYCAS_CLA_TARGET(isa) __attribute__((target(isa)))
+#	elif defined(_MSC_VER) && _MSC_VER >= 1700
+#		define PHYCAS_CLA_SIMD
+#		define PHYCAS_CLA_TARGET(isa)
+#		include <intrin.h>
+#	endif
+#endif
+
+#if defined(PHYCAS_CLA_SIMD)
+#	include <immintrin.h>
+#	if !defined(PHYCAS_NO_AVX512) && (!defined(_MSC_VER) || _MSC_VER >= 1910)
+#		define PHYCAS_CLA_AVX512
+#	endif
+#endif
+
+namespace phycas
+{
+
+typedef void (*ClaTwoTipsFn)(unsigned np, unsigned ns, const double * const * leftRows, const int8_t * leftCodes, const double * const * rightRows, const int8_t * rightCodes, LikeFltType * cla, double * work);
+typedef void (*ClaOneTipFn)(unsigned np, unsigned ns, unsigned ld, const double * const * leftRows, const int8_t * leftCodes, const double * packedRight, const LikeFltType * rightCLA, LikeFltType * cla, double * work);
+typedef void (*ClaNoTipsFn)(unsigned np, unsigned ns, unsigned ld, const double * packedLeft, const LikeFltType * leftCLA, const double * packedRight, const LikeFltType * rightCLA, LikeFltType * cla, double * work);
+typedef void (*ClaMultiplyTipFn)(unsigned np, unsigned ns, const double * const * rows, const int8_t * codes, LikeFltType * cla, double * work);
+typedef void (*ClaMultiplyInternalFn)(unsigned np, unsigned ns, unsigned ld, const double * packedChild, const LikeFltType * childCLA, LikeFltType * cla, double * work);
+typedef void (*ClaEdgeTipFn)(unsigned np, unsigned ns, const double * freq, const LikeFltType * focalCLA, const double * const * rows, const int8_t * codes, double * out, double * work);
+typedef void (*ClaEdgeInternalFn)(unsigned np, unsigned ns, unsigned ld, const double * packedM, const LikeFltType * focalCLA, const LikeFltType * neighborCLA, double * out, double * work);
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Holds one function pointer for each loop provided by CLAKernels. There is one (static) table for each kernel level.
+*/
+struct CLAKernelTable
+	{
+	ClaTwoTipsFn			two_tips;
+	ClaOneTipFn				one_tip;
+	ClaNoTipsFn				no_tips;
+	ClaMultiplyTipFn		multiply_tip;
+	ClaMultiplyInternalFn	multiply_internal;
+	ClaEdgeTipFn			edge_tip;
+	ClaEdgeInternalFn		edge_internal;
+	};
+
+// ***************************************************************************************************************
+// Scalar (reference) loops. These perform exactly the same floating point operations, in the same order, as the
+// loops formerly found in TreeLikelihood::calcCLANoTips and friends.
+// ***************************************************************************************************************
+
+static void claTwoTips_scalar(unsigned np, unsigned ns, const double * const * leftRows, const int8_t * leftCodes, const double * const * rightRows, const int8_t * rightCodes, LikeFltType * cla, double *)
+	{
+	for (unsigned pat = 0; pat < np; ++pat, cla += ns)
+		{
+		const double * left  = leftRows[leftCodes[pat]];
+		const double * right = rightRows[rightCodes[pat]];
+		for (unsigned s = 0; s < ns; ++s)
+			cla[s] = left[s]*right[s];
+		}
+	}
+
+static void claOneTip_scalar(unsigned np, unsigned ns, unsigned ld, const double * const * leftRows, const int8_t * leftCodes, const double * packedRight, const LikeFltType * rightCLA, LikeFltType * cla, double *)
+	{
+	for (unsigned pat = 0; pat < np; ++pat, rightCLA += ns)
+		{
+		const double * left = leftRows[leftCodes[pat]];
+		for (unsigned i = 0; i < ns; ++i)
+			{
+			double right_side = 0.0;
+			const double * col = packedRight + i;
+			for (unsigned j = 0; j < ns; ++j, col += ld)
+				right_side += (*col)*rightCLA[j];
+			*cla++ = left[i]*right_side;
+			}
+		}
+	}
+
+static void claNoTips_scalar(unsigned np, unsigned ns, unsigned ld, const double * packedLeft, const LikeFltType * leftCLA, const double * packedRight, const LikeFltType * rightCLA, LikeFltType * cla, double *)
+	{
+	for (unsigned pat = 0; pat < np; ++pat, leftCLA += ns, rightCLA += ns)
+		{
+		for (unsigned i = 0; i < ns; ++i)
+			{
+			double left_side  = 0.0;
+			double right_side = 0.0;
+			const double * left_col  = packedLeft + i;
+			const double * right_col = packedRight + i;
+			for (unsigned j = 0; j < ns; ++j, left_col += ld, right_col += ld)
+				{
+				left_side  += (*left_col)*leftCLA[j];
+				right_side += (*right_col)*rightCLA[j];
+				}
+			*cla++ = left_side*right_side;
+			}
+		}
+	}
+
+static void claMultiplyTip_scalar(unsigned np, unsigned ns, const double * const * rows, const int8_t * codes, LikeFltType * cla, double *)
+	{
+	for (unsigned pat = 0; pat < np; ++pat)
+		{
+		const double * row = rows[codes[pat]];
+		for (unsigned s = 0; s < ns; ++s)
+			*cla++ *= row[s];
+		}
+	}
+
+static void claMultiplyInternal_scalar(unsigned np, unsigned ns, unsigned ld, const double * packedChild, const LikeFltType * childCLA, LikeFltType * cla, double *)
+	{
+	for (unsigned pat = 0; pat < np; ++pat, childCLA += ns)
+		{
+		for (unsigned i = 0; i < ns; ++i)
+			{
+			double child_like = 0.0;
+			const double * col = packedChild + i;
+			for (unsigned j = 0; j < ns; ++j, col += ld)
+				child_like += (*col)*childCLA[j];
+			*cla++ *= child_like;
+			}
+		}
+	}
+
+static void claEdgeTip_scalar(unsigned np, unsigned ns, const double * freq, const LikeFltType * focalCLA, const double * const * rows, const int8_t * codes, double * out, double *)
+	{
+	for (unsigned pat = 0; pat < np; ++pat, focalCLA += ns)
+		{
+		const double * row = rows[codes[pat]];
+		double site_rate_like = 0.0;
+		for (unsigned s = 0; s < ns; ++s)
+			site_rate_like += freq[s]*focalCLA[s]*row[s];
+		out[pat] = site_rate_like;
+		}
+	}
+
+static void claEdgeInternal_scalar(unsigned np, unsigned ns, unsigned ld, const double * packedM, const LikeFltType * focalCLA, const LikeFltType * neighborCLA, double * out, double *)
+	{
+	for (unsigned pat = 0; pat < np; ++pat, focalCLA += ns, neighborCLA += ns)
+		{
+		double site_rate_like = 0.0;
+		for (unsigned f = 0; f < ns; ++f)
+			{
+			double neighbor_like = 0.0;
+			const double * col = packedM + f;
+			for (unsigned n = 0; n < ns; ++n, col += ld)
+				neighbor_like += (*col)*neighborCLA[n];
+			site_rate_like += focalCLA[f]*neighbor_like;
+			}
+		out[pat] = site_rate_like;
+		}
+	}
+
+static const CLAKernelTable scalar_kernels = 
+	{
+	claTwoTips_scalar,
+	claOneTip_scalar,
+	claNoTips_scalar,
+	claMultiplyTip_scalar,
+	claMultiplyInternal_scalar,
+	claEdgeTip_scalar,
+	claEdgeInternal_scalar
+	};
+
+#if defined(PHYCAS_CLA_SIMD)
+
+// ***************************************************************************************************************
+// SSE2 loops
+// ***************************************************************************************************************
+
+static inline PHYCAS_CLA_TARGET("sse2") double hsum_sse2(__m128d v)
+	{
+	return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+	}
+
+#define CLA_SIMD_FN(name)		name##_sse2
+#define CLA_SIMD_TARGET			PHYCAS_CLA_TARGET("sse2")
+#define CLA_SIMD_W				2
+#define CLA_SIMD_VEC			__m128d
+#define CLA_SIMD_ZERO()			_mm_setzero_pd()
+#define CLA_SIMD_SET1(x)		_mm_set1_pd(x)
+#define CLA_SIMD_LOAD(p)		_mm_loadu_pd(p)
+#define CLA_SIMD_STORE(p,v)		_mm_storeu_pd(p,v)
+#if defined(PHYCAS_FLOAT_CLA)
+#	define CLA_SIMD_LOADC(p)	_mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double *)(p))))
+#	define CLA_SIMD_STOREC(p,v)	_mm_store_sd((double *)(p), _mm_castps_pd(_mm_cvtpd_ps(v)))
+#else
+#	define CLA_SIMD_LOADC(p)	CLA_SIMD_LOAD(p)
+#	define CLA_SIMD_STOREC(p,v)	CLA_SIMD_STORE(p,v)
+#endif
+#define CLA_SIMD_ADD(a,b)		_mm_add_pd(a,b)
+#define CLA_SIMD_MUL(a,b)		_mm_mul_pd(a,b)
+#define CLA_SIMD_HSUM(v)		hsum_sse2(v)
+#include "phycas/src/cla_kernels_simd.hpp"
+#undef CLA_SIMD_FN
+#undef CLA_SIMD_TARGET
+#undef CLA_SIMD_W
+#undef CLA_SIMD_VEC
+#undef CLA_SIMD_ZERO
+#undef CLA_SIMD_SET1
+#undef CLA_SIMD_LOAD
+#undef CLA_SIMD_STORE
+#undef CLA_SIMD_LOADC
+#undef CLA_SIMD_STOREC
+#undef CLA_SIMD_ADD
+#undef CLA_SIMD_MUL
+#undef CLA_SIMD_HSUM
+
+static const CLAKernelTable sse2_kernels = 
+	{
+	claTwoTips_sse2,
+	claOneTip_sse2,
+	claNoTips_sse2,
+	claMultiplyTip_sse2,
+	claMultiplyInternal_sse2,
+	claEdgeTip_sse2,
+	claEdgeInternal_sse2
+	};
+
+// ***************************************************************************************************************
+// AVX2 loops (FMA is deliberately not enabled so that sums are rounded exactly as in the scalar loops)
+// ***************************************************************************************************************
+
+static inline PHYCAS_CLA_TARGET("avx2") double hsum_avx2(__m256d v)
+	{
+	__m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+	}
+
+#define CLA_SIMD_FN(name)		name##_avx2
+#define CLA_SIMD_TARGET			PHYCAS_CLA_TARGET("avx2")
+#define CLA_SIMD_W				4
+#define CLA_SIMD_VEC			__m256d
+#define CLA_SIMD_ZERO()			_mm256_setzero_pd()
+#define CLA_SIMD_SET1(x)		_mm256_set1_pd(x)
+#define CLA_SIMD_LOAD(p)		_mm256_loadu_pd(p)
+#define CLA_SIMD_STORE(p,v)		_mm256_storeu_pd(p,v)
+#if defined(PHYCAS_FLOAT_CLA)
+#	define CLA_SIMD_LOADC(p)	_mm256_cvtps_pd(_mm_loadu_ps(p))
+#	define CLA_SIMD_STOREC(p,v)	_mm_storeu_ps(p, _mm256_cvtpd_ps(v))
+#else
+#	define CLA_SIMD_LOADC(p)	CLA_SIMD_LOAD(p)
+#	define CLA_SIMD_STOREC(p,v)	CLA_SIMD_STORE(p,v)
+#endif
+#define CLA_SIMD_ADD(a,b)		_mm256_add_pd(a,b)
+#define CLA_SIMD_MUL(a,b)		_mm256_mul_pd(a,b)
+#define CLA_SIMD_HSUM(v)		hsum_avx2(v)
+#include "phycas/src/cla_kernels_simd.hpp"
+#undef CLA_SIMD_FN
+#undef CLA_SIMD_TARGET
+#undef CLA_SIMD_W
+#undef CLA_SIMD_VEC
+#undef CLA_SIMD_ZERO
+#undef CLA_SIMD_SET1
+#undef CLA_SIMD_LOAD
+#undef CLA_SIMD_STORE
+#undef CLA_SIMD_LOADC
+#undef CLA_SIMD_STOREC
+#undef CLA_SIMD_ADD
+#undef CLA_SIMD_MUL
+#undef CLA_SIMD_HSUM
+
+static const CLAKernelTable avx2_kernels = 
+	{
+	claTwoTips_avx2,
+	claOneTip_avx2,
+	claNoTips_avx2,
+	claMultiplyTip_avx2,
+	claMultiplyInternal_avx2,
+	claEdgeTip_avx2,
+	claEdgeInternal_avx2
+	};
+
+#if defined(PHYCAS_CLA_AVX512)
+
+// ***************************************************************************************************************
+// AVX-512 loops
+// ***************************************************************************************************************
+
+static inline PHYCAS_CLA_TARGET("avx512f") double hsum_avx512(__m512d v)
+	{
+	__m256d h = _mm256_add_pd(_mm512_castpd512_pd256(v), _mm512_extractf64x4_pd(v, 1));
+	__m128d s = _mm_add_pd(_mm256_castpd256_pd128(h), _mm256_extractf128_pd(h, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+	}
+
+#define CLA_SIMD_FN(name)		name##_avx512
+#define CLA_SIMD_TARGET			PHYCAS_CLA_TARGET("avx512f")
+#define CLA_SIMD_W				8
+#define CLA_SIMD_VEC			__m512d
+#define CLA_SIMD_ZERO()			_mm512_setzero_pd()
+#define CLA_SIMD_SET1(x)		_mm512_set1_pd(x)
+#define CLA_SIMD_LOAD(p)		_mm512_loadu_pd(p)
+#define CLA_SIMD_STORE(p,v)		_mm512_storeu_pd(p,v)
+#if defined(PHYCAS_FLOAT_CLA)
+#	define CLA_SIMD_LOADC(p)	_mm512_cvtps_pd(_mm256_loadu_ps(p))
+#	define CLA_SIMD_STOREC(p,v)	_mm256_storeu_ps(p, _mm512_cvtpd_ps(v))
+#else
+#	define CLA_SIMD_LOADC(p)	CLA_SIMD_LOAD(p)
+#	define CLA_SIMD_STOREC(p,v)	CLA_SIMD_STORE(p,v)
+#endif
+#define CLA_SIMD_ADD(a,b)		_mm512_add_pd(a,b)
+#define CLA_SIMD_MUL(a,b)		_mm512_mul_pd(a,b)
+#define CLA_SIMD_HSUM(v)		hsum_avx512(v)
+#include "phycas/src/cla_kernels_simd.hpp"
+#undef CLA_SIMD_FN
+#undef CLA_SIMD_TARGET
+#undef CLA_SIMD_W
+#undef CLA_SIMD_VEC
+#undef CLA_SIMD_ZERO
+#undef CLA_SIMD_SET1
+#undef CLA_SIMD_LOAD
+#undef CLA_SIMD_STORE
+#undef CLA_SIMD_LOADC
+#undef CLA_SIMD_STOREC
+#undef CLA_SIMD_ADD
+#undef CLA_SIMD_MUL
+#undef CLA_SIMD_HSUM
+
+static const CLAKernelTable avx512_kernels = 
+	{
+	claTwoTips_avx512,
+	claOneTip_avx512,
+	claNoTips_avx512,
+	claMultiplyTip_avx512,
+	claMultiplyInternal_avx512,
+	claEdgeTip_avx512,
+	claEdgeInternal_avx512
+	};
+
+#endif	// PHYCAS_CLA_AVX512
+#endif	// PHYCAS_CLA_SIMD
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Holds the arguments of one call to a CLAKernels loop so that the call can be divided into blocks of patterns. Only
+|	the members needed by `kind' are used; transition matrices are already packed (where the loop expects them to be).
+*/
+struct CLAKernels::KernelCall
+	{
+	enum Kind
+		{
+		kTwoTips,
+		kOneTip,
+		kNoTips,
+		kMultiplyTip,
+		kMultiplyInternal,
+		kEdgeTip,
+		kEdgeInternal
+		};
+
+	KernelCall(Kind k, const CLASubsetLayout & layout, const CLAKernelTable * t)
+	  : kind(k), np(layout.np), ns(layout.ns), block_len(layout.block_len), block_stride(layout.block_stride), ld(CLAKernels::calcPackedDim(layout.ns)), table(t), 
+	  left_rows(NULL), left_codes(NULL), left_packed(NULL), left_cla(NULL), 
+	  right_rows(NULL), right_codes(NULL), right_packed(NULL), right_cla(NULL), freq(NULL), cla(NULL), out(NULL)
+		{
+		}
+
+	Kind					kind;			/**< identifies the loop to call */
+	unsigned				np;				/**< is the number of patterns */
+	unsigned				ns;				/**< is the number of states */
+	unsigned				block_len;		/**< is the number of patterns in each block of the conditional likelihood arrays (see CLASubsetLayout) */
+	unsigned				block_stride;	/**< is the distance between adjacent blocks of the conditional likelihood arrays */
+	unsigned				ld;				/**< is the leading dimension of packed matrices */
+	const CLAKernelTable *	table;			/**< is the table of loops to use */
+	const double * const *	left_rows;		/**< are the rows of the transposed transition matrix of the left (or only) tip */
+	const int8_t *			left_codes;		/**< are the state codes of the left (or only) tip */
+	const double *			left_packed;	/**< is the packed transition matrix of the left (or only) internal child (or piP) */
+	const LikeFltType *		left_cla;		/**< is the conditional likelihood array of the left (or only) child (or focal node) */
+	const double * const *	right_rows;		/**< are the rows of the transposed transition matrix of the right tip */
+	const int8_t *			right_codes;	/**< are the state codes of the right tip */
+	const double *			right_packed;	/**< is the packed transition matrix of the right internal child */
+	const LikeFltType *		right_cla;		/**< is the conditional likelihood array of the right child (or focal neighbor) */
+	const double *			freq;			/**< are the state frequencies (edgeTip only) */
+	LikeFltType *			cla;			/**< is the conditional likelihood array to fill or modify (all loops but edgeTip and edgeInternal) */
+	double *				out;			/**< is the array of site likelihoods to fill (edgeTip and edgeInternal only) */
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Holds one KernelCall for each rate category of a subset, together with what is needed to finish each block of
+|	patterns once all rates have been computed. If `uf' is not NULL, it receives the sum of `left_uf' and `right_uf'
+|	(either or both of which may be NULL) plus the correction of any rescaling done (see `rescaling'); if `accumulate'
+|	is true, this sum is added to the values already stored in `uf' (used for the additional children of polytomies).
+|	If `after_block' is not NULL, it is called with the first pattern and the number of patterns of each finished block.
+*/
+struct CLAKernels::SubsetCall
+	{
+	SubsetCall(const CLASubsetLayout & subset_layout, LikeFltType * cla_array, UnderflowType * uf_array, Rescaling how, double target)
+	  : layout(subset_layout), np(subset_layout.np), nr(subset_layout.nr), ns(subset_layout.ns), cla(cla_array), uf(uf_array), left_uf(NULL), right_uf(NULL), 
+	  accumulate(false), rescaling(how), correct_to(target), after_block(NULL)
+		{
+		rates.reserve(nr);
+		}
+
+	std::vector<KernelCall>	rates;			/**< holds the call for each rate category (the `cla' members point into `cla') */
+	CLASubsetLayout			layout;			/**< describes the arrangement of `cla' and of the children's conditional likelihood arrays */
+	unsigned				np;				/**< is the number of patterns */
+	unsigned				nr;				/**< is the number of rate categories */
+	unsigned				ns;				/**< is the number of states */
+	LikeFltType *			cla;			/**< is the first element of the conditional likelihood array for the first rate category */
+	UnderflowType *			uf;				/**< is the underflow correction array (one element per pattern) to fill (NULL for edge calls) */
+	const UnderflowType *	left_uf;		/**< is the underflow correction array of the left (or only) internal child (may be NULL) */
+	const UnderflowType *	right_uf;		/**< is the underflow correction array of the right internal child (may be NULL) */
+	bool					accumulate;		/**< is true if the sum is to be added to `uf' rather than replacing it */
+	Rescaling				rescaling;		/**< says whether and how patterns are to be rescaled */
+	double					correct_to;		/**< is the value to which the largest conditional likelihood of a pattern is scaled (kRescaleLog only) */
+	const BlockFn *			after_block;	/**< is called for each finished block of patterns (may be NULL) */
+	};
+
+#if defined(PHYCAS_FLOAT_CLA)
+// Patterns are rescaled once their largest conditional likelihood falls below 2^-32. Two such children, each shrunk
+// by another 2^-17 or so by their edges, still give a product well above float's smallest normal value (2^-126)
+static const int pow2_scaling_trigger = 32;
+#else
+static const int pow2_scaling_trigger = 256;
+#endif
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	The constructor selects the highest kernel level supported by the processor.
+*/
+CLAKernels::CLAKernels()
+  : level(kScalar), kernels(&scalar_kernels), narrow_kernels(&scalar_kernels), thread_pool(NULL), thread_work(1)
+	{
+	setLevel(getMaxSupportedLevel());
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Uses CPUID to determine the highest kernel level (see CLAKernels::KernelLevel) that can be used on this processor
+|	(and operating system, which must save the wider registers on context switches). Returns kScalar if Phycas was 
+|	compiled for a processor other than x86 or if PHYCAS_NO_SIMD was defined.
+*/
+unsigned CLAKernels::getMaxSupportedLevel()
+	{
+	unsigned max_level = kScalar;
+#if defined(PHYCAS_CLA_SIMD)
+#	if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int max_leaf = info[0];
+	__cpuid(info, 1);
+	const bool has_sse2		= ((info[3] & (1 << 26)) != 0);
+	const bool has_osxsave	= ((info[2] & (1 << 27)) != 0);
+	const bool has_avx		= ((info[2] & (1 << 28)) != 0);
+	const unsigned __int64 xcr0 = (has_osxsave ? _xgetbv(0) : 0);
+	bool has_avx2 = false;
+	bool has_avx512 = false;
+	if (max_leaf >= 7 && has_avx && (xcr0 & 0x06) == 0x06)
+		{
+		__cpuidex(info, 7, 0);
+		has_avx2	= ((info[1] & (1 << 5)) != 0);
+		has_avx512	= ((info[1] & (1 << 16)) != 0) && ((xcr0 & 0xe6) == 0xe6);
+		}
+#	else
+	__builtin_cpu_init();
+	const bool has_sse2		= (__builtin_cpu_supports("sse2") != 0);
+	const bool has_avx2		= (__builtin_cpu_supports("avx2") != 0);
+	const bool has_avx512	= (__builtin_cpu_supports("avx512f") != 0);
+#	endif
+	if (has_sse2)
+		max_level = kSSE2;
+	if (has_sse2 && has_avx2)
+		max_level = kAVX2;
+#	if defined(PHYCAS_CLA_AVX512)
+	if (has_sse2 && has_avx2 && has_avx512)
+		max_level = kAVX512;
+#	else
+	(void)has_avx512;
+#	endif
+#endif
+	return max_level;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns a short name for the supplied kernel `level' (e.g. "AVX2").
+*/
+std::string CLAKernels::getLevelName(
+  unsigned level)	/**< is the kernel level (see CLAKernels::KernelLevel) */
+	{
+	switch (level)
+		{
+		case kSSE2:
+			return std::string("SSE2");
+		case kAVX2:
+			return std::string("AVX2");
+		case kAVX512:
+			return std::string("AVX-512");
+		default:
+			return std::string("scalar");
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the kernel level to the smaller of `new_level' and the highest level supported by this processor.
+*/
+void CLAKernels::setLevel(
+  unsigned new_level)	/**< is the requested kernel level (see CLAKernels::KernelLevel) */
+	{
+	level = std::min(new_level, getMaxSupportedLevel());
+	kernels = &scalar_kernels;
+#if defined(PHYCAS_CLA_SIMD)
+	if (level == kSSE2)
+		kernels = &sse2_kernels;
+	else if (level == kAVX2)
+		kernels = &avx2_kernels;
+#	if defined(PHYCAS_CLA_AVX512)
+	else if (level == kAVX512)
+		kernels = &avx512_kernels;
+#	endif
+#endif
+	narrow_kernels = kernels;
+#if defined(PHYCAS_CLA_AVX512)
+	// With fewer than 8 states (e.g. nucleotides) half of each 512-bit vector would be wasted
+	if (level == kAVX512)
+		narrow_kernels = &avx2_kernels;
+#endif
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Copies the `ns' x `ns' transition matrix `pmat' into `packed' in column-major order using the leading dimension 
+|	returned by calcPackedDim. Padding elements are set to zero. Returns a pointer to the first element of `packed'.
+*/
+const double * CLAKernels::pack(
+  const double * const * pmat,		/**< is the transition matrix (row = from state, column = to state) */
+  unsigned ns,						/**< is the number of states */
+  std::vector<double> & packed)		/**< is the vector to fill */
+	const
+	{
+	const unsigned ld = calcPackedDim(ns);
+	packed.assign(ld*ns, 0.0);
+	for (unsigned i = 0; i < ns; ++i)
+		{
+		const double * row = pmat[i];
+		for (unsigned j = 0; j < ns; ++j)
+			packed[j*ld + i] = row[j];
+		}
+	return &packed[0];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Supplies the ThreadPool used to share the work among threads (NULL to do all work in the calling thread). The pool
+|	is not owned by this object and must outlive it (or be replaced before it is destroyed).
+*/
+void CLAKernels::setThreadPool(
+  ThreadPool * pool)	/**< is the pool to use (may be NULL) */
+	{
+	thread_pool = pool;
+	thread_work.resize(thread_pool ? thread_pool->getNumThreads() : 1);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Performs `call' for the `n' patterns beginning with pattern `first', all of which must lie in the same block of the
+|	conditional likelihood arrays.
+*/
+void CLAKernels::runBlock(
+  const KernelCall & call,	/**< is the call being performed */
+  unsigned first,			/**< is the index of the first pattern in the block */
+  unsigned n,				/**< is the number of patterns in the block */
+  double * work)			/**< is scratch space of length at least call.ld */
+	const
+	{
+	const unsigned ns = call.ns;
+	const unsigned offset = (first/call.block_len)*call.block_stride + (first%call.block_len)*ns;
+	PHYCAS_ASSERT((first%call.block_len) + n <= call.block_len);
+	switch (call.kind)
+		{
+		case KernelCall::kTwoTips:
+			call.table->two_tips(n, ns, call.left_rows, call.left_codes + first, call.right_rows, call.right_codes + first, call.cla + offset, work);
+			break;
+		case KernelCall::kOneTip:
+			call.table->one_tip(n, ns, call.ld, call.left_rows, call.left_codes + first, call.right_packed, call.right_cla + offset, call.cla + offset, work);
+			break;
+		case KernelCall::kNoTips:
+			call.table->no_tips(n, ns, call.ld, call.left_packed, call.left_cla + offset, call.right_packed, call.right_cla + offset, call.cla + offset, work);
+			break;
+		case KernelCall::kMultiplyTip:
+			call.table->multiply_tip(n, ns, call.left_rows, call.left_codes + first, call.cla + offset, work);
+			break;
+		case KernelCall::kMultiplyInternal:
+			call.table->multiply_internal(n, ns, call.ld, call.left_packed, call.left_cla + offset, call.cla + offset, work);
+			break;
+		case KernelCall::kEdgeTip:
+			call.table->edge_tip(n, ns, call.freq, call.left_cla + offset, call.left_rows, call.left_codes + first, call.out + first, work);
+			break;
+		case KernelCall::kEdgeInternal:
+			call.table->edge_internal(n, ns, call.ld, call.left_packed, call.left_cla + offset, call.right_cla + offset, call.out + first, work);
+			break;
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the (negated) binary exponent below which kRescalePow2 rescales a pattern: a pattern is rescaled if its
+|	largest conditional likelihood is less than 2 to the power -getScalingTrigger().
+*/
+int CLAKernels::getScalingTrigger()
+	{
+	return pow2_scaling_trigger;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Packs the transition matrix `pmat' for rate category `r' into element `r' of `packed' and returns a pointer to the
+|	packed matrix. Unlike pack, the matrices of different rates do not share storage, so all of them remain valid until
+|	the next call to a public function. The caller must have made `packed' long enough beforehand (enlarging it here
+|	could move the matrices of rates already packed).
+*/
+const double * CLAKernels::packRate(
+  const double * const * pmat,						/**< is the transition matrix (row = from state, column = to state) */
+  unsigned ns,										/**< is the number of states */
+  unsigned r,										/**< is the index of the rate category */
+  std::vector< std::vector<double> > & packed)		/**< is the vector of packed matrices */
+	const
+	{
+	PHYCAS_ASSERT(r < packed.size());
+	return pack(pmat, ns, packed[r]);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Performs the calls in `subset' (one per rate category), dividing the patterns into blocks of calcBlockSize patterns
+|	that are processed concurrently if a thread pool is available and there is more than one block. Each block is
+|	finished (see runSubsetBlock) as soon as all rate categories of that block have been computed, so the only
+|	synchronization among threads is the one at the end of ThreadPool::run.
+*/
+void CLAKernels::dispatchSubset(
+  const SubsetCall & subset)	/**< is the set of calls to perform */
+	const
+	{
+	const unsigned ld = calcPackedDim(subset.ns);
+	for (std::vector< std::vector<double> >::iterator it = thread_work.begin(); it != thread_work.end(); ++it)
+		{
+		if (it->size() < ld)
+			it->resize(ld);
+		}
+
+	const unsigned block_size = calcBlockSize(subset.ns);
+	const unsigned nblocks = (subset.np + block_size - 1)/block_size;
+	PHYCAS_ASSERT(subset.layout.block_len == subset.np || subset.layout.block_len == block_size);
+	if (thread_pool == NULL || thread_pool->getNumThreads() == 1 || nblocks < 2)
+		{
+		// Still work block by block so that each block is finished while it is in cache
+		for (unsigned first = 0; first < subset.np; first += block_size)
+			runSubsetBlock(subset, first, std::min(block_size, subset.np - first), &thread_work[0][0]);
+		}
+	else
+		thread_pool->run(nblocks, boost::bind(&CLAKernels::runSubsetBlockTask, this, &subset, _1, _2));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Performs block number `block' of `subset' using the scratch space belonging to thread `thread'.
+*/
+void CLAKernels::runSubsetBlockTask(
+  const SubsetCall * subset,	/**< is the set of calls being performed */
+  unsigned block,				/**< is the index of the block of patterns */
+  unsigned thread)				/**< is the index of the thread performing the block */
+	const
+	{
+	const unsigned block_size = calcBlockSize(subset->ns);
+	const unsigned first = block*block_size;
+	runSubsetBlock(*subset, first, std::min(block_size, subset->np - first), &thread_work[thread][0]);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Performs every rate category of `subset' for the `n' patterns beginning with pattern `first', then updates their
+|	underflow corrections (rescaling them if requested) and calls `subset.after_block', if any.
+*/
+void CLAKernels::runSubsetBlock(
+  const SubsetCall & subset,	/**< is the set of calls being performed */
+  unsigned first,				/**< is the index of the first pattern in the block */
+  unsigned n,					/**< is the number of patterns in the block */
+  double * work)				/**< is scratch space of length at least calcPackedDim(subset.ns) */
+	const
+	{
+	for (std::vector<KernelCall>::const_iterator it = subset.rates.begin(); it != subset.rates.end(); ++it)
+		runBlock(*it, first, n, work);
+	if (subset.uf != NULL)
+		rescaleBlock(subset, first, n);
+	if (subset.after_block != NULL)
+		(*subset.after_block)(first, n);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	For each of the `n' patterns beginning with `first', adds up the underflow corrections of the children and, unless
+|	`subset.rescaling' is kNoRescaling, finds the largest conditional likelihood over all rates and states. With
+|	kRescalePow2, its binary exponent e is obtained using frexp; if e is less than -getScalingTrigger(), every
+|	conditional likelihood of the pattern is multiplied by 2^-e (an exact operation, since only the exponent changes),
+|	leaving the largest in [0.5, 1), and -e is added to the pattern's correction, so no log or exp is ever evaluated.
+|	With kRescaleLog, every pattern is multiplied by exp(f), where f is the integer part of the natural log of the ratio
+|	of `subset.correct_to' to the largest value, and f is added to the correction (see 
+|	UnderflowManager::setCorrectToValue). Either way the block is rescaled while it is still in cache, so the 
+|	conditional likelihood array is never traversed a second time.
+*/
+void CLAKernels::rescaleBlock(
+  const SubsetCall & subset,	/**< is the set of calls being performed */
+  unsigned first,				/**< is the index of the first pattern in the block */
+  unsigned n)					/**< is the number of patterns in the block */
+	const
+	{
+	const unsigned ns = subset.ns;
+	const unsigned nr = subset.nr;
+	const unsigned rate_stride = subset.layout.rate_stride;
+	for (unsigned pat = first; pat < first + n; ++pat)
+		{
+		UnderflowType k = (subset.accumulate ? subset.uf[pat] : 0);
+		if (subset.left_uf != NULL)
+			k += subset.left_uf[pat];
+		if (subset.right_uf != NULL)
+			k += subset.right_uf[pat];
+
+		if (subset.rescaling != kNoRescaling)
+			{
+			LikeFltType * claPat = subset.cla + subset.layout.offset(pat, 0);
+			double maxval = 0.0;
+			LikeFltType * p = claPat;
+			for (unsigned r = 0; r < nr; ++r, p += rate_stride)
+				{
+				for (unsigned i = 0; i < ns; ++i)
+					{
+					if ((double)p[i] > maxval)
+						maxval = (double)p[i];
+					}
+				}
+
+			double factor = 1.0;
+			if (subset.rescaling == kRescalePow2)
+				{
+				int e = 0;
+				std::frexp(maxval, &e);
+				if (maxval > 0.0 && e < -pow2_scaling_trigger)
+					{
+					// Multiply in double precision because 2^-e may be out of float's range
+					factor = std::ldexp(1.0, -e);
+					k -= (UnderflowType)e;
+					}
+				}
+			else if (maxval > 0.0)
+				{
+				const double f = std::floor(std::log(subset.correct_to/maxval));
+				factor = std::exp(f);
+				k += (UnderflowType)f;
+				}
+
+			if (factor != 1.0)
+				{
+				p = claPat;
+				for (unsigned r = 0; r < nr; ++r, p += rate_stride)
+					{
+					for (unsigned i = 0; i < ns; ++i)
+						p[i] = (LikeFltType)(factor*(double)p[i]);
+					}
+				}
+			}
+		subset.uf[pat] = k;
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes conditional likelihoods for all `layout.nr' rate categories of the `layout.np' patterns of a subset at an
+|	internal node whose children are both tips, storing the underflow corrections in `uf' (see rescaleBlock).
+|	`leftPMatT' and `rightPMatT' hold the transposed, augmented transition matrices of the tips (see TipData) for each
+|	rate category. Here `cla' points to the first element of the subset, and the rate categories are found
+|	`layout.rate_stride' elements apart.
+*/
+void CLAKernels::twoTips(
+  const CLASubsetLayout & layout,				/**< describes the arrangement of the conditional likelihood arrays */
+  const double * const * const * leftPMatT,		/**< is the transposed transition matrix of the left tip for each rate */
+  const int8_t * leftCodes,						/**< is the array of state codes for the left tip */
+  const double * const * const * rightPMatT,	/**< is the transposed transition matrix of the right tip for each rate */
+  const int8_t * rightCodes,					/**< is the array of state codes for the right tip */
+  LikeFltType * cla,							/**< is the conditional likelihood array to fill */
+  UnderflowType * uf,							/**< is the underflow correction array to fill */
+  Rescaling rescaling,							/**< says how patterns are to be rescaled */
+  double correct_to)							/**< is the target value of the largest conditional likelihood of each pattern (kRescaleLog only) */
+	const
+	{
+	SubsetCall subset(layout, cla, uf, rescaling, correct_to);
+	const CLAKernelTable * table = getTable(layout.ns);
+	for (unsigned r = 0; r < layout.nr; ++r)
+		{
+		KernelCall call(KernelCall::kTwoTips, layout, table);
+		call.left_rows		= leftPMatT[r];
+		call.left_codes		= leftCodes;
+		call.right_rows		= rightPMatT[r];
+		call.right_codes	= rightCodes;
+		call.cla			= cla + r*layout.rate_stride;
+		subset.rates.push_back(call);
+		}
+	dispatchSubset(subset);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Same as twoTips, but for an internal node whose left child is a tip and whose right child is an internal node. The
+|	underflow corrections of the internal child (`rightUF') are carried over to `uf'.
+*/
+void CLAKernels::oneTip(
+  const CLASubsetLayout & layout,				/**< describes the arrangement of the conditional likelihood arrays */
+  const double * const * const * leftPMatT,		/**< is the transposed transition matrix of the tip child for each rate */
+  const int8_t * leftCodes,						/**< is the array of state codes for the tip child */
+  const double * const * const * rightPMat,		/**< is the transition matrix of the internal child for each rate */
+  const LikeFltType * rightCLA,					/**< is the conditional likelihood array of the internal child */
+  const UnderflowType * rightUF,				/**< is the underflow correction array of the internal child */
+  LikeFltType * cla,							/**< is the conditional likelihood array to fill */
+  UnderflowType * uf,							/**< is the underflow correction array to fill */
+  Rescaling rescaling,							/**< says how patterns are to be rescaled */
+  double correct_to)							/**< is the target value of the largest conditional likelihood of each pattern (kRescaleLog only) */
+	const
+	{
+	SubsetCall subset(layout, cla, uf, rescaling, correct_to);
+	subset.right_uf = rightUF;
+	if (packed_rates_right.size() < layout.nr)
+		packed_rates_right.resize(layout.nr);
+	const CLAKernelTable * table = getTable(layout.ns);
+	for (unsigned r = 0; r < layout.nr; ++r)
+		{
+		KernelCall call(KernelCall::kOneTip, layout, table);
+		call.left_rows		= leftPMatT[r];
+		call.left_codes		= leftCodes;
+		call.right_packed	= packRate(rightPMat[r], layout.ns, r, packed_rates_right);
+		call.right_cla		= rightCLA + r*layout.rate_stride;
+		call.cla			= cla + r*layout.rate_stride;
+		subset.rates.push_back(call);
+		}
+	dispatchSubset(subset);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Same as twoTips, but for an internal node whose children are both internal nodes. The underflow corrections of both
+|	children are summed into `uf'.
+*/
+void CLAKernels::noTips(
+  const CLASubsetLayout & layout,				/**< describes the arrangement of the conditional likelihood arrays */
+  const double * const * const * leftPMat,		/**< is the transition matrix of the left child for each rate */
+  const LikeFltType * leftCLA,					/**< is the conditional likelihood array of the left child */
+  const UnderflowType * leftUF,					/**< is the underflow correction array of the left child */
+  const double * const * const * rightPMat,		/**< is the transition matrix of the right child for each rate */
+  const LikeFltType * rightCLA,					/**< is the conditional likelihood array of the right child */
+  const UnderflowType * rightUF,				/**< is the underflow correction array of the right child */
+  LikeFltType * cla,							/**< is the conditional likelihood array to fill */
+  UnderflowType * uf,							/**< is the underflow correction array to fill */
+  Rescaling rescaling,							/**< says how patterns are to be rescaled */
+  double correct_to)							/**< is the target value of the largest conditional likelihood of each pattern (kRescaleLog only) */
+	const
+	{
+	SubsetCall subset(layout, cla, uf, rescaling, correct_to);
+	subset.left_uf = leftUF;
+	subset.right_uf = rightUF;
+	if (packed_rates_left.size() < layout.nr)
+		packed_rates_left.resize(layout.nr);
+	if (packed_rates_right.size() < layout.nr)
+		packed_rates_right.resize(layout.nr);
+	const CLAKernelTable * table = getTable(layout.ns);
+	for (unsigned r = 0; r < layout.nr; ++r)
+		{
+		KernelCall call(KernelCall::kNoTips, layout, table);
+		call.left_packed	= packRate(leftPMat[r], layout.ns, r, packed_rates_left);
+		call.left_cla		= leftCLA + r*layout.rate_stride;
+		call.right_packed	= packRate(rightPMat[r], layout.ns, r, packed_rates_right);
+		call.right_cla		= rightCLA + r*layout.rate_stride;
+		call.cla			= cla + r*layout.rate_stride;
+		subset.rates.push_back(call);
+		}
+	dispatchSubset(subset);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Multiplies the conditional likelihoods of a subset by the transition probabilities of an additional tip child (used
+|	for polytomies). Any new correction is added to those already in `uf' (see twoTips).
+*/
+void CLAKernels::multiplyTip(
+  const CLASubsetLayout & layout,				/**< describes the arrangement of the conditional likelihood arrays */
+  const double * const * const * tipPMatT,		/**< is the transposed transition matrix of the tip for each rate */
+  const int8_t * tipCodes,						/**< is the array of state codes for the tip */
+  LikeFltType * cla,							/**< is the conditional likelihood array to modify */
+  UnderflowType * uf,							/**< is the underflow correction array to update */
+  Rescaling rescaling,							/**< says how patterns are to be rescaled */
+  double correct_to)							/**< is the target value of the largest conditional likelihood of each pattern (kRescaleLog only) */
+	const
+	{
+	SubsetCall subset(layout, cla, uf, rescaling, correct_to);
+	subset.accumulate = true;
+	const CLAKernelTable * table = getTable(layout.ns);
+	for (unsigned r = 0; r < layout.nr; ++r)
+		{
+		KernelCall call(KernelCall::kMultiplyTip, layout, table);
+		call.left_rows		= tipPMatT[r];
+		call.left_codes		= tipCodes;
+		call.cla			= cla + r*layout.rate_stride;
+		subset.rates.push_back(call);
+		}
+	dispatchSubset(subset);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Multiplies the conditional likelihoods of a subset by the child likelihoods of an additional internal child (used
+|	for polytomies). The corrections of the child (`childUF') and any new correction are added to those already in `uf'.
+*/
+void CLAKernels::multiplyInternal(
+  const CLASubsetLayout & layout,				/**< describes the arrangement of the conditional likelihood arrays */
+  const double * const * const * childPMat,		/**< is the transition matrix of the child for each rate */
+  const LikeFltType * childCLA,					/**< is the conditional likelihood array of the child */
+  const UnderflowType * childUF,				/**< is the underflow correction array of the child */
+  LikeFltType * cla,							/**< is the conditional likelihood array to modify */
+  UnderflowType * uf,							/**< is the underflow correction array to update */
+  Rescaling rescaling,							/**< says how patterns are to be rescaled */
+  double correct_to)							/**< is the target value of the largest conditional likelihood of each pattern (kRescaleLog only) */
+	const
+	{
+	SubsetCall subset(layout, cla, uf, rescaling, correct_to);
+	subset.left_uf = childUF;
+	subset.accumulate = true;
+	if (packed_rates_left.size() < layout.nr)
+		packed_rates_left.resize(layout.nr);
+	const CLAKernelTable * table = getTable(layout.ns);
+	for (unsigned r = 0; r < layout.nr; ++r)
+		{
+		KernelCall call(KernelCall::kMultiplyInternal, layout, table);
+		call.left_packed	= packRate(childPMat[r], layout.ns, r, packed_rates_left);
+		call.left_cla		= childCLA + r*layout.rate_stride;
+		call.cla			= cla + r*layout.rate_stride;
+		subset.rates.push_back(call);
+		}
+	dispatchSubset(subset);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the likelihood of each of the `layout.np' patterns of a subset for each rate category across an edge
+|	connecting an internal focal node to a tip, storing the value for pattern p and rate r in `siteRateLike'[r*np + p].
+|	`after_block' (if not empty) is called for each block of patterns once all of its rates have been computed.
+*/
+void CLAKernels::edgeTip(
+  const CLASubsetLayout & layout,				/**< describes the arrangement of the conditional likelihood arrays */
+  const double * stateFreq,						/**< is the array of equilibrium state frequencies */
+  const LikeFltType * focalCLA,					/**< is the conditional likelihood array of the focal node */
+  const double * const * const * tipPMatT,		/**< is the transposed transition matrix of the tip for each rate */
+  const int8_t * tipCodes,						/**< is the array of state codes for the tip */
+  double * siteRateLike,						/**< is the array of `layout.nr'*`layout.np' site likelihoods to fill */
+  const BlockFn & after_block)					/**< is called for each block of patterns (may be empty) */
+	const
+	{
+	SubsetCall subset(layout, NULL, NULL, kNoRescaling, 0.0);
+	if (!after_block.empty())
+		subset.after_block = &after_block;
+	const CLAKernelTable * table = getTable(layout.ns);
+	for (unsigned r = 0; r < layout.nr; ++r)
+		{
+		KernelCall call(KernelCall::kEdgeTip, layout, table);
+		call.freq			= stateFreq;
+		call.left_cla		= focalCLA + r*layout.rate_stride;
+		call.left_rows		= tipPMatT[r];
+		call.left_codes		= tipCodes;
+		call.out			= siteRateLike + r*layout.np;
+		subset.rates.push_back(call);
+		}
+	dispatchSubset(subset);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Same as edgeTip, but for an edge connecting two internal nodes. The matrix `piP'[r] holds the product of state
+|	frequencies and transition probabilities for rate r, indexed [focal state][neighbor state].
+*/
+void CLAKernels::edgeInternal(
+  const CLASubsetLayout & layout,				/**< describes the arrangement of the conditional likelihood arrays */
+  const double * const * const * piP,			/**< is the frequency-weighted transition matrix for each rate */
+  const LikeFltType * focalCLA,					/**< is the conditional likelihood array of the focal node */
+  const LikeFltType * neighborCLA,				/**< is the conditional likelihood array of the focal node's neighbor */
+  double * siteRateLike,						/**< is the array of `layout.nr'*`layout.np' site likelihoods to fill */
+  const BlockFn & after_block)					/**< is called for each block of patterns (may be empty) */
+	const
+	{
+	SubsetCall subset(layout, NULL, NULL, kNoRescaling, 0.0);
+	if (!after_block.empty())
+		subset.after_block = &after_block;
+	if (packed_rates_left.size() < layout.nr)
+		packed_rates_left.resize(layout.nr);
+	const CLAKernelTable * table = getTable(layout.ns);
+	for (unsigned r = 0; r < layout.nr; ++r)
+		{
+		KernelCall call(KernelCall::kEdgeInternal, layout, table);
+		call.left_packed	= packRate(piP[r], layout.ns, r, packed_rates_left);
+		call.left_cla		= focalCLA + r*layout.rate_stride;
+		call.right_cla		= neighborCLA + r*layout.rate_stride;
+		call.out			= siteRateLike + r*layout.np;
+		subset.rates.push_back(call);
+		}
+	dispatchSubset(subset);
+	}
+
+} // namespace phycas
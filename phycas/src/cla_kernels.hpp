@@ -0,0 +1,123 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(CLA_KERNELS_HPP)
+#define CLA_KERNELS_HPP
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include "phycas/src/states_patterns.hpp"
+#include "phycas/src/cond_likelihood.hpp"
+
+namespace phycas
+{
+
+struct CLAKernelTable;
+class ThreadPool;
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Provides the innermost loops used by TreeLikelihood to compute conditional likelihood arrays and to harvest site
+|	likelihoods. Each loop is implemented once in plain C++ (the reference implementation) and once for each of the 
+|	SSE2, AVX2 and AVX-512 instruction sets. The best variant supported by the processor is chosen (using CPUID) when 
+|	the object is constructed, but a lower level may be selected using setLevel (e.g. to check that the vectorized 
+|	loops give the same answer as the scalar ones). Each public function handles every rate category of one partition
+|	subset; conditional likelihood array arguments point to the first element of the subset, and the supplied 
+|	CLASubsetLayout tells the kernels where each rate category of each pattern lies. The patterns are divided into
+|	blocks of calcBlockSize patterns (in the pattern-blocked layout these are exactly the blocks of the arrays), and 
+|	every rate category of a block is computed before moving on to the next block. If a ThreadPool has been supplied
+|	(see setThreadPool), the blocks are processed concurrently, so a thread synchronizes with the others only once per
+|	subset. Patterns are independent, so the results do not depend on the number of threads. Once all rates of a block
+|	of a conditional likelihood array have been computed (while the block is still in cache), the underflow 
+|	corrections of the children are added up and the patterns are rescaled as requested (see Rescaling and 
+|	rescaleBlock). The functions computing site likelihoods instead call a function supplied by the caller for each
+|	block, which TreeLikelihood uses to combine rate categories into site log-likelihoods in the same task.
+*/
+class CLAKernels
+	{
+	public:
+
+		enum KernelLevel
+			{
+			kScalar = 0,	/**< plain C++ loops (reference implementation) */
+			kSSE2	= 1,	/**< 128-bit vectors (2 doubles) */
+			kAVX2	= 2,	/**< 256-bit vectors (4 doubles) */
+			kAVX512	= 3		/**< 512-bit vectors (8 doubles) */
+			};
+
+		enum Rescaling
+			{
+			kNoRescaling	= 0,	/**< the underflow corrections of the children are added up, but no pattern is rescaled */
+			kRescalePow2	= 1,	/**< patterns at risk of underflow are rescaled by a power of 2 (corrections count powers of 2) */
+			kRescaleLog		= 2		/**< every pattern is rescaled so that its largest value is close to a target (corrections are natural logs, see UnderflowManager) */
+			};
+
+		typedef boost::function<void (unsigned, unsigned)>	BlockFn;	/**< called with the index (within the subset) of the first pattern of a block and the number of patterns in the block */
+
+									CLAKernels();
+
+		static unsigned				getMaxSupportedLevel();
+		static std::string			getLevelName(unsigned level);
+
+		unsigned					getLevel() const;
+		void						setLevel(unsigned level);
+
+		void						setThreadPool(ThreadPool * pool);
+
+		void						twoTips(const CLASubsetLayout & layout, const double * const * const * leftPMatT, const int8_t * leftCodes, const double * const * const * rightPMatT, const int8_t * rightCodes, LikeFltType * cla, UnderflowType * uf, Rescaling rescaling, double correct_to) const;
+		void						oneTip(const CLASubsetLayout & layout, const double * const * const * leftPMatT, const int8_t * leftCodes, const double * const * const * rightPMat, const LikeFltType * rightCLA, const UnderflowType * rightUF, LikeFltType * cla, UnderflowType * uf, Rescaling rescaling, double correct_to) const;
+		void						noTips(const CLASubsetLayout & layout, const double * const * const * leftPMat, const LikeFltType * leftCLA, const UnderflowType * leftUF, const double * const * const * rightPMat, const LikeFltType * rightCLA, const UnderflowType * rightUF, LikeFltType * cla, UnderflowType * uf, Rescaling rescaling, double correct_to) const;
+		void						multiplyTip(const CLASubsetLayout & layout, const double * const * const * tipPMatT, const int8_t * tipCodes, LikeFltType * cla, UnderflowType * uf, Rescaling rescaling, double correct_to) const;
+		void						multiplyInternal(const CLASubsetLayout & layout, const double * const * const * childPMat, const LikeFltType * childCLA, const UnderflowType * childUF, LikeFltType * cla, UnderflowType * uf, Rescaling rescaling, double correct_to) const;
+		void						edgeTip(const CLASubsetLayout & layout, const double * stateFreq, const LikeFltType * focalCLA, const double * const * const * tipPMatT, const int8_t * tipCodes, double * siteRateLike, const BlockFn & after_block) const;
+		void						edgeInternal(const CLASubsetLayout & layout, const double * const * const * piP, const LikeFltType * focalCLA, const LikeFltType * neighborCLA, double * siteRateLike, const BlockFn & after_block) const;
+
+		static int					getScalingTrigger();
+		static unsigned				calcPackedDim(unsigned ns);
+		static unsigned				calcBlockSize(unsigned ns);
+
+	private:
+
+		struct KernelCall;
+		struct SubsetCall;
+
+		const double *				pack(const double * const * pmat, unsigned ns, std::vector<double> & packed) const;
+		const CLAKernelTable *		getTable(unsigned ns) const;
+		void						runBlock(const KernelCall & call, unsigned first, unsigned n, double * work) const;
+		const double *				packRate(const double * const * pmat, unsigned ns, unsigned r, std::vector< std::vector<double> > & packed) const;
+		void						dispatchSubset(const SubsetCall & subset) const;
+		void						runSubsetBlock(const SubsetCall & subset, unsigned first, unsigned n, double * work) const;
+		void						runSubsetBlockTask(const SubsetCall * subset, unsigned block, unsigned thread) const;
+		void						rescaleBlock(const SubsetCall & subset, unsigned first, unsigned n) const;
+
+		unsigned					level;				/**< The kernel level currently in use (one of the KernelLevel values) */
+		const CLAKernelTable *		kernels;			/**< Table of function pointers to the loops implementing `level' */
+		const CLAKernelTable *		narrow_kernels;		/**< Table used when there are fewer than 8 states (AVX2 rather than half-empty AVX-512 vectors) */
+		mutable std::vector< std::vector<double> >	packed_rates_left;	/**< Workspace holding the left (or only) packed transition matrix of each rate category */
+		mutable std::vector< std::vector<double> >	packed_rates_right;	/**< Workspace holding the right packed transition matrix of each rate category */
+		ThreadPool *				thread_pool;		/**< If not NULL, the pool used to process blocks of patterns concurrently */
+		mutable std::vector< std::vector<double> >	thread_work;	/**< Scratch space (one padded state vector per thread) used by the kernels for partial vectors */
+	};
+
+} // namespace phycas
+
+#include "phycas/src/cla_kernels.inl"
+
+#endif
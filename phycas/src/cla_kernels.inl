@@ -0,0 +1,67 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(CLA_KERNELS_INL)
+#define CLA_KERNELS_INL
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the kernel level currently in use (see CLAKernels::KernelLevel).
+*/
+inline unsigned CLAKernels::getLevel() const
+	{
+	return level;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the leading dimension used for packed transition matrices: `ns' rounded up to a multiple of 8 so that a
+|	whole number of vectors fits in each column regardless of which instruction set is in use.
+*/
+inline unsigned CLAKernels::calcPackedDim(
+  unsigned ns)	/**< is the number of states */
+	{
+	return ((ns + 7)/8)*8;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of patterns in each block when the work is shared among threads. Blocks are sized so that one
+|	block of a single-rate conditional likelihood array occupies about 32 KB (so that the arrays touched by a block
+|	fit comfortably in a core's private cache), but never fewer than 16 patterns.
+*/
+inline unsigned CLAKernels::calcBlockSize(
+  unsigned ns)	/**< is the number of states */
+	{
+	return std::max(32768U/(8U*std::max(ns, 1U)), 16U);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the table of loops to use for data having `ns' states.
+*/
+inline const CLAKernelTable * CLAKernels::getTable(
+  unsigned ns)	/**< is the number of states */
+	const
+	{
+	return (ns < 8 ? narrow_kernels : kernels);
+	}
+
+} // namespace phycas
+
+#endif
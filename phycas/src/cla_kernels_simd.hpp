@@ -0,0 +1,207 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// This file is deliberately not protected by an include guard. It is included by cla_kernels.cpp once for each
+// instruction set, after the following macros have been defined:
+//
+//	CLA_SIMD_FN(name)	decorates `name' with a suffix identifying the instruction set (e.g. name##_avx2)
+//	CLA_SIMD_TARGET		function attribute enabling the instruction set (empty for compilers that do not need it)
+//	CLA_SIMD_W			number of doubles per vector
+//	CLA_SIMD_VEC		vector type
+//	CLA_SIMD_ZERO()		vector of zeros
+//	CLA_SIMD_SET1(x)	vector with every element equal to x
+//	CLA_SIMD_LOAD(p)	unaligned load from p
+//	CLA_SIMD_STORE(p,v)	unaligned store of v to p
+//	CLA_SIMD_LOADC(p)	unaligned load of W conditional likelihoods (LikeFltType) from p, widened to doubles
+//	CLA_SIMD_STOREC(p,v)	unaligned store of v to W conditional likelihoods (LikeFltType) at p
+//	CLA_SIMD_ADD(a,b)	element-wise sum
+//	CLA_SIMD_MUL(a,b)	element-wise product
+//	CLA_SIMD_HSUM(v)	sum of all elements of v
+//
+// Transition matrices are supplied packed in column-major order with leading dimension `ld' (see CLAKernels::pack),
+// so that a vector of W consecutive "from" states can be multiplied by a broadcast child conditional likelihood and
+// accumulated without any horizontal operations. The sum over "to" states is done in the same order as in the scalar
+// loops, so results differ from the scalar ones only if the compiler fuses multiplies and adds. Conditional likelihood
+// arrays are always accessed through CLA_SIMD_LOADC and CLA_SIMD_STOREC, so that all arithmetic is done in double
+// precision even if conditional likelihoods are stored as floats (see PHYCAS_FLOAT_CLA).
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes cla[p][i] = leftRows[leftCodes[p]][i]*rightRows[rightCodes[p]][i] for every pattern p.
+*/
+static CLA_SIMD_TARGET void CLA_SIMD_FN(claTwoTips)(unsigned np, unsigned ns, const double * const * leftRows, const int8_t * leftCodes, const double * const * rightRows, const int8_t * rightCodes, LikeFltType * cla, double *)
+	{
+	const unsigned nfull = ns - ns % CLA_SIMD_W;
+	for (unsigned pat = 0; pat < np; ++pat, cla += ns)
+		{
+		const double * left  = leftRows[leftCodes[pat]];
+		const double * right = rightRows[rightCodes[pat]];
+		unsigned s = 0;
+		for (; s < nfull; s += CLA_SIMD_W)
+			CLA_SIMD_STOREC(cla + s, CLA_SIMD_MUL(CLA_SIMD_LOAD(left + s), CLA_SIMD_LOAD(right + s)));
+		for (; s < ns; ++s)
+			cla[s] = left[s]*right[s];
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes cla[p][i] = leftRows[leftCodes[p]][i]*(sum_j P[i][j]*rightCLA[p][j]) for every pattern p.
+*/
+static CLA_SIMD_TARGET void CLA_SIMD_FN(claOneTip)(unsigned np, unsigned ns, unsigned ld, const double * const * leftRows, const int8_t * leftCodes, const double * packedRight, const LikeFltType * rightCLA, LikeFltType * cla, double * work)
+	{
+	for (unsigned pat = 0; pat < np; ++pat, rightCLA += ns, cla += ns)
+		{
+		const double * left = leftRows[leftCodes[pat]];
+		for (unsigned i = 0; i < ns; i += CLA_SIMD_W)
+			{
+			CLA_SIMD_VEC right_side = CLA_SIMD_ZERO();
+			const double * col = packedRight + i;
+			for (unsigned j = 0; j < ns; ++j, col += ld)
+				right_side = CLA_SIMD_ADD(right_side, CLA_SIMD_MUL(CLA_SIMD_LOAD(col), CLA_SIMD_SET1(rightCLA[j])));
+			if (i + CLA_SIMD_W <= ns)
+				CLA_SIMD_STOREC(cla + i, CLA_SIMD_MUL(CLA_SIMD_LOAD(left + i), right_side));
+			else
+				{
+				CLA_SIMD_STORE(work, right_side);
+				for (unsigned k = i; k < ns; ++k)
+					cla[k] = left[k]*work[k - i];
+				}
+			}
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes cla[p][i] = (sum_j L[i][j]*leftCLA[p][j])*(sum_j R[i][j]*rightCLA[p][j]) for every pattern p.
+*/
+static CLA_SIMD_TARGET void CLA_SIMD_FN(claNoTips)(unsigned np, unsigned ns, unsigned ld, const double * packedLeft, const LikeFltType * leftCLA, const double * packedRight, const LikeFltType * rightCLA, LikeFltType * cla, double * work)
+	{
+	for (unsigned pat = 0; pat < np; ++pat, leftCLA += ns, rightCLA += ns, cla += ns)
+		{
+		for (unsigned i = 0; i < ns; i += CLA_SIMD_W)
+			{
+			CLA_SIMD_VEC left_side  = CLA_SIMD_ZERO();
+			CLA_SIMD_VEC right_side = CLA_SIMD_ZERO();
+			const double * left_col  = packedLeft + i;
+			const double * right_col = packedRight + i;
+			for (unsigned j = 0; j < ns; ++j, left_col += ld, right_col += ld)
+				{
+				left_side  = CLA_SIMD_ADD(left_side,  CLA_SIMD_MUL(CLA_SIMD_LOAD(left_col),  CLA_SIMD_SET1(leftCLA[j])));
+				right_side = CLA_SIMD_ADD(right_side, CLA_SIMD_MUL(CLA_SIMD_LOAD(right_col), CLA_SIMD_SET1(rightCLA[j])));
+				}
+			CLA_SIMD_VEC prod = CLA_SIMD_MUL(left_side, right_side);
+			if (i + CLA_SIMD_W <= ns)
+				CLA_SIMD_STOREC(cla + i, prod);
+			else
+				{
+				CLA_SIMD_STORE(work, prod);
+				for (unsigned k = i; k < ns; ++k)
+					cla[k] = work[k - i];
+				}
+			}
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes cla[p][i] *= rows[codes[p]][i] for every pattern p.
+*/
+static CLA_SIMD_TARGET void CLA_SIMD_FN(claMultiplyTip)(unsigned np, unsigned ns, const double * const * rows, const int8_t * codes, LikeFltType * cla, double *)
+	{
+	const unsigned nfull = ns - ns % CLA_SIMD_W;
+	for (unsigned pat = 0; pat < np; ++pat, cla += ns)
+		{
+		const double * row = rows[codes[pat]];
+		unsigned s = 0;
+		for (; s < nfull; s += CLA_SIMD_W)
+			CLA_SIMD_STOREC(cla + s, CLA_SIMD_MUL(CLA_SIMD_LOADC(cla + s), CLA_SIMD_LOAD(row + s)));
+		for (; s < ns; ++s)
+			cla[s] *= row[s];
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes cla[p][i] *= (sum_j P[i][j]*childCLA[p][j]) for every pattern p.
+*/
+static CLA_SIMD_TARGET void CLA_SIMD_FN(claMultiplyInternal)(unsigned np, unsigned ns, unsigned ld, const double * packedChild, const LikeFltType * childCLA, LikeFltType * cla, double * work)
+	{
+	for (unsigned pat = 0; pat < np; ++pat, childCLA += ns, cla += ns)
+		{
+		for (unsigned i = 0; i < ns; i += CLA_SIMD_W)
+			{
+			CLA_SIMD_VEC child_like = CLA_SIMD_ZERO();
+			const double * col = packedChild + i;
+			for (unsigned j = 0; j < ns; ++j, col += ld)
+				child_like = CLA_SIMD_ADD(child_like, CLA_SIMD_MUL(CLA_SIMD_LOAD(col), CLA_SIMD_SET1(childCLA[j])));
+			if (i + CLA_SIMD_W <= ns)
+				CLA_SIMD_STOREC(cla + i, CLA_SIMD_MUL(CLA_SIMD_LOADC(cla + i), child_like));
+			else
+				{
+				CLA_SIMD_STORE(work, child_like);
+				for (unsigned k = i; k < ns; ++k)
+					cla[k] *= work[k - i];
+				}
+			}
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes out[p] = sum_s freq[s]*focalCLA[p][s]*rows[codes[p]][s] for every pattern p.
+*/
+static CLA_SIMD_TARGET void CLA_SIMD_FN(claEdgeTip)(unsigned np, unsigned ns, const double * freq, const LikeFltType * focalCLA, const double * const * rows, const int8_t * codes, double * out, double *)
+	{
+	const unsigned nfull = ns - ns % CLA_SIMD_W;
+	for (unsigned pat = 0; pat < np; ++pat, focalCLA += ns)
+		{
+		const double * row = rows[codes[pat]];
+		CLA_SIMD_VEC acc = CLA_SIMD_ZERO();
+		unsigned s = 0;
+		for (; s < nfull; s += CLA_SIMD_W)
+			acc = CLA_SIMD_ADD(acc, CLA_SIMD_MUL(CLA_SIMD_MUL(CLA_SIMD_LOAD(freq + s), CLA_SIMD_LOADC(focalCLA + s)), CLA_SIMD_LOAD(row + s)));
+		double tail = 0.0;
+		for (; s < ns; ++s)
+			tail += freq[s]*focalCLA[s]*row[s];
+		out[pat] = CLA_SIMD_HSUM(acc) + tail;
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes out[p] = sum_f focalCLA[p][f]*(sum_n M[f][n]*neighborCLA[p][n]) for every pattern p.
+*/
+static CLA_SIMD_TARGET void CLA_SIMD_FN(claEdgeInternal)(unsigned np, unsigned ns, unsigned ld, const double * packedM, const LikeFltType * focalCLA, const LikeFltType * neighborCLA, double * out, double * work)
+	{
+	for (unsigned pat = 0; pat < np; ++pat, focalCLA += ns, neighborCLA += ns)
+		{
+		CLA_SIMD_VEC acc = CLA_SIMD_ZERO();
+		double tail = 0.0;
+		for (unsigned f = 0; f < ns; f += CLA_SIMD_W)
+			{
+			CLA_SIMD_VEC neighbor_like = CLA_SIMD_ZERO();
+			const double * col = packedM + f;
+			for (unsigned n = 0; n < ns; ++n, col += ld)
+				neighbor_like = CLA_SIMD_ADD(neighbor_like, CLA_SIMD_MUL(CLA_SIMD_LOAD(col), CLA_SIMD_SET1(neighborCLA[n])));
+			if (f + CLA_SIMD_W <= ns)
+				acc = CLA_SIMD_ADD(acc, CLA_SIMD_MUL(CLA_SIMD_LOADC(focalCLA + f), neighbor_like));
+			else
+				{
+				CLA_SIMD_STORE(work, neighbor_like);
+				for (unsigned k = f; k < ns; ++k)
+					tail += focalCLA[k]*work[k - f];
+				}
+			}
+		out[pat] = CLA_SIMD_HSUM(acc) + tail;
+		}
+	}
@@ -592,6 +592,26 @@ void Codon::calcPMat(double * * pMat, double edgeLength) const
 	{
 	q_matrix.recalcPMat(pMat, edgeLength);
 	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes all `numRates' transition probability matrices at once. With 61 states, assembling the matrices dominates
+|	the cost, so QMatrix::recalcPMatBatch is used to share one eigensystem check across the whole batch. Overrides the
+|	virtual function inherited from the base class Model.
+*/
+void Codon::calcPMatrices(double * * * pMat, const double * edgeLength, unsigned numRates) const
+	{
+	q_matrix.recalcPMatBatch(numRates, pMat, edgeLength);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the first and second derivatives of the transition probability matrix with respect to `edgeLength' using
+|	the eigensystem held by the data member `q_matrix'. Overrides the virtual function inherited from the base class
+|	Model.
+*/
+void Codon::calcPMatDerivatives(double * * dPMat, double * * d2PMat, double edgeLength) const
+	{
+	q_matrix.recalcPMatDerivatives(dPMat, d2PMat, edgeLength);
+	}
 	
 /*----------------------------------------------------------------------------------------------------------------------
 |   Needs work.
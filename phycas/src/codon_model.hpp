@@ -89,6 +89,8 @@ class Codon: public Model
         double					    calcLMat(double * * lMat) const;
         double					    calcUMat(double * * uMat) const;
 		void						calcPMat(double * * pMat, double edgeLength) const;
+		void						calcPMatrices(double * * * pMat, const double * edgeLength, unsigned numRates) const;
+		void						calcPMatDerivatives(double * * dPMat, double * * d2PMat, double edgeLength) const;
 		
 		void						beagleGetStateFreqs(std::vector<double> & freqs);
 		void						beagleGetEigenValues(std::vector<double> & eigenValues);
@@ -19,46 +19,114 @@
 
 
 #include "phycas/src/cond_likelihood.hpp"
+#include "phycas/src/cla_kernels.hpp"
 
 namespace phycas
 {
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	The default constructor describes an empty subset.
+*/
+CLASubsetLayout::CLASubsetLayout()
+  : np(0), nr(0), ns(0), block_len(0), rate_stride(0), block_stride(0), length(0)
+	{
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Describes a subset having `npatterns' patterns, `nrates' rate categories and `nstates' states, using the 
+|	pattern-blocked layout if `pattern_blocked' is true and the standard layout otherwise. If there are no more 
+|	patterns than fit in one block, the pattern-blocked layout differs from the standard one only in its padding.
+*/
+CLASubsetLayout::CLASubsetLayout(
+  unsigned npatterns,		/**< is the number of data patterns in the subset */
+  unsigned nrates,			/**< is the number of among-site relative rate categories in the subset */
+  unsigned nstates,			/**< is the number of states in the subset */
+  bool pattern_blocked)		/**< is true to use the pattern-blocked layout */
+  : np(npatterns), nr(nrates), ns(nstates), block_len(npatterns), rate_stride(npatterns*nstates), block_stride(0), length(0)
+	{
+	if (pattern_blocked)
+		{
+		block_len = std::min(np, CLAKernels::calcBlockSize(ns));
+		rate_stride = ((block_len*ns + 7)/8)*8;
+		}
+	block_stride = nr*rate_stride;
+	length = getNumBlocks()*block_stride;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of elements in a conditional likelihood array for the given dimensions, summed over all 
+|	partition subsets. The pattern-blocked layout (see CLASubsetLayout) may need a little more than the 
+|	`npatterns'*`nrates'*`nstates' elements needed by the standard layout because of padding.
+*/
 unsigned CondLikelihood::calcCLALength(
   const uint_vect_t & npatterns, 	/**< is a vector containing the number of data patterns for each partition subset */
   const uint_vect_t & nrates, 		/**< is a vector containing the number of among-site relative rate categories for each partition subset */
-  const uint_vect_t & nstates) 		/**< is a vector containing the number of states for each partition subset */
+  const uint_vect_t & nstates,		/**< is a vector containing the number of states for each partition subset */
+  bool pattern_blocked)				/**< is true if the pattern-blocked layout is used */
+	{
+	CLALayoutVect layout;
+	calcLayout(layout, npatterns, nrates, nstates, pattern_blocked);
+	
+	unsigned total = 0;
+	for (CLALayoutVect::const_iterator it = layout.begin(); it != layout.end(); ++it)
+		total += it->length;
+	return total;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Fills `layout' with one CLASubsetLayout for each partition subset.
+*/
+void CondLikelihood::calcLayout(
+  CLALayoutVect & layout,			/**< is the vector to fill */
+  const uint_vect_t & npatterns, 	/**< is a vector containing the number of data patterns for each partition subset */
+  const uint_vect_t & nrates, 		/**< is a vector containing the number of among-site relative rate categories for each partition subset */
+  const uint_vect_t & nstates,		/**< is a vector containing the number of states for each partition subset */
+  bool pattern_blocked)				/**< is true if the pattern-blocked layout is used */
 	{
 	unsigned sz = (unsigned)npatterns.size();
 	PHYCAS_ASSERT(nrates.size() == sz);
 	PHYCAS_ASSERT(nstates.size() == sz);
 	
-	unsigned total = 0;
+	layout.clear();
+	layout.reserve(sz);
 	for (unsigned i = 0; i < sz; ++i)
-		{
-		total += (npatterns[i]*nrates[i]*nstates[i]);
-		}
-	return total;
+		layout.push_back(CLASubsetLayout(npatterns[i], nrates[i], nstates[i], pattern_blocked));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the length of the underflow correction array, which has one element for every pattern in every partition 
+|	subset.
+*/
+unsigned CondLikelihood::calcUFLength(
+  const uint_vect_t & npatterns) 	/**< is a vector containing the number of data patterns for each partition subset */
+	{
+	return (unsigned)std::accumulate(npatterns.begin(), npatterns.end(), 0);
 	}
 
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	CondLikelihood constructor. Allocates `npatterns'*`nrates'*`nstates' elements to the conditional likelihood vector 
-|	`claVec', allocates `npatterns' elements to the vector `underflowExpon', and sets `numEdgesSinceUnderflowProtection'
-|	to UINT_MAX. Sets data member `cla' to point to the first element of the `claVec' vector and `uf' to point to the
-|	first element of `underflowExponVec'. All three arguments shoudl be non-zero, and no error checking is done to 
+|	CondLikelihood constructor. Allocates `npatterns'*`nrates'*`nstates' elements (plus any padding needed by the 
+|	pattern-blocked layout if `pattern_blocked' is true) to the conditional likelihood vector `claVec', allocates 
+|	`npatterns' elements to the vector `underflowExpon', and sets `numEdgesSinceUnderflowProtection' to UINT_MAX. Sets
+|	data member `cla' to point to the first element of the `claVec' vector and `uf' to point to the first element of 
+|	`underflowExponVec'. All three arguments shoudl be non-zero, and no error checking is done to 
 |	ensure this because CondLikelihood objects are managed exclusively by CondLikelihoodStorage class, which ensures
 |	that the dimensions are valid.
 */
 CondLikelihood::CondLikelihood(
   const uint_vect_t & npatterns,	/**< is a vector containing the number of data patterns for each partition subset */
   const uint_vect_t & nrates,		/**< is a vector containing the number of among-site relative rate categories for each partition subset */
-  const uint_vect_t & nstates)		/**< is a vector containing the number of states for each partition subset */
+  const uint_vect_t & nstates,		/**< is a vector containing the number of states for each partition subset */
+  bool pattern_blocked)				/**< is true if the pattern-blocked layout is used */
   :
-  total_num_patterns(0),
-  numEdgesSinceUnderflowProtection(UINT_MAX)
+  cla(NULL),
+  cla_length(0),
+  uf(NULL),
+  numEdgesSinceUnderflowProtection(UINT_MAX),
+  total_num_patterns(0)
 	{
-	unsigned cla_length = calcCLALength(npatterns, nrates, nstates);
-	total_num_patterns = (unsigned)std::accumulate(npatterns.begin(), npatterns.end(), 0);
+	cla_length = calcCLALength(npatterns, nrates, nstates, pattern_blocked);
+	total_num_patterns = calcUFLength(npatterns);
 	PHYCAS_ASSERT(total_num_patterns > 0);
 	underflowExponVec.resize(total_num_patterns);
 	claVec.resize(cla_length);
@@ -66,6 +134,33 @@ CondLikelihood::CondLikelihood(
 	uf = &underflowExponVec[0];
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	CondLikelihood constructor used by the arena mode of CondLikelihoodStorage. Identical to the constructor above 
+|	except that no memory is allocated: `cla_mem' must point to at least calcCLALength(`npatterns', `nrates', `nstates',
+|	`pattern_blocked') elements and `uf_mem' to at least calcUFLength(`npatterns') elements, both of which must 
+|	outlive this object. The contents of the arrays are not initialized.
+*/
+CondLikelihood::CondLikelihood(
+  const uint_vect_t & npatterns,	/**< is a vector containing the number of data patterns for each partition subset */
+  const uint_vect_t & nrates,		/**< is a vector containing the number of among-site relative rate categories for each partition subset */
+  const uint_vect_t & nstates,		/**< is a vector containing the number of states for each partition subset */
+  bool pattern_blocked,				/**< is true if the pattern-blocked layout is used */
+  LikeFltType * cla_mem,			/**< is the memory to use for the conditional likelihood array */
+  UnderflowType * uf_mem)			/**< is the memory to use for the underflow correction array */
+  :
+  cla(cla_mem),
+  cla_length(0),
+  uf(uf_mem),
+  numEdgesSinceUnderflowProtection(UINT_MAX),
+  total_num_patterns(0)
+	{
+	PHYCAS_ASSERT(cla_mem != NULL);
+	PHYCAS_ASSERT(uf_mem != NULL);
+	cla_length = calcCLALength(npatterns, nrates, nstates, pattern_blocked);
+	total_num_patterns = calcUFLength(npatterns);
+	PHYCAS_ASSERT(total_num_patterns > 0);
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Returns current value of the data member `numEdgesSinceUnderflowProtection'.
 */
@@ -116,36 +211,36 @@ UnderflowType const * CondLikelihood::getUF() const
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Returns length of the vector data member `claVec'.
+|	Returns the length of the conditional likelihood array pointed to by `cla'.
 */
 unsigned CondLikelihood::getCLASize() const
 	{
-	return (unsigned)claVec.size();
+	return cla_length;
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Returns length of the vector data member `underflowExponVec'.
+|	Returns the length of the underflow correction array pointed to by `uf'.
 */
 unsigned CondLikelihood::getUFSize() const
 	{
-	return (unsigned)underflowExponVec.size();
+	return total_num_patterns;
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Sets all elements in `underflowExponVec' to zero.
+|	Sets all elements of the underflow correction array to zero.
 */
 void CondLikelihood::zeroUF()
 	{
-	underflowExponVec.assign(underflowExponVec.size(), 0);
+	std::fill(uf, uf + total_num_patterns, (UnderflowType)0);
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Returns a string containing a space-separated list of all elements in `underflowExponVec'.
+|	Returns a string containing a space-separated list of all elements of the underflow correction array.
 */
 std::string CondLikelihood::debugShowUF() const
 	{
 	std::string s;
-	for (std::vector<UnderflowType>::const_iterator it = underflowExponVec.begin(); it != underflowExponVec.end(); ++it)
+	for (const UnderflowType * it = uf; it != uf + total_num_patterns; ++it)
 		s += str(boost::format("%d ") % (*it));
 	return s;
 	}
@@ -27,9 +27,44 @@
 
 namespace phycas
 {
+// Defining PHYCAS_FLOAT_CLA stores conditional likelihood arrays in single precision, halving the memory (and memory 
+// bandwidth) they require. Transition matrices, the arithmetic done by CLAKernels, and site likelihoods all remain 
+// double precision, and UnderflowManager rescales more often to make up for the narrower exponent range.
+#if defined(PHYCAS_FLOAT_CLA)
+typedef float LikeFltType;
+#else
 typedef double LikeFltType;
+#endif
 typedef long UnderflowType;
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Describes where the conditional likelihoods of one partition subset lie within a conditional likelihood array. 
+|	The patterns are divided into blocks of `block_len' patterns; within a block, all patterns of the first rate 
+|	category come first, then all patterns of the second rate category, and so on, with the states of each pattern 
+|	contiguous. In the standard layout there is just one block holding every pattern, so the subset is laid out rate 
+|	-> pattern -> state. In the pattern-blocked layout, each block holds CLAKernels::calcBlockSize patterns (the unit of
+|	work handed to each thread) and the run of patterns for each rate is padded to a multiple of 8 elements, so that 
+|	every rate category of a block is contiguous, fits in a core's private cache, and begins on a vector boundary.
+*/
+struct CLASubsetLayout
+	{
+									CLASubsetLayout();
+									CLASubsetLayout(unsigned npatterns, unsigned nrates, unsigned nstates, bool pattern_blocked);
+
+		unsigned					offset(unsigned pat, unsigned rate) const;
+		unsigned					getNumBlocks() const;
+
+		unsigned					np;				/**< The number of patterns in the subset */
+		unsigned					nr;				/**< The number of rate categories in the subset */
+		unsigned					ns;				/**< The number of states in the subset */
+		unsigned					block_len;		/**< The number of patterns in each block (`np' in the standard layout) */
+		unsigned					rate_stride;	/**< The distance between the first elements of adjacent rate categories within a block */
+		unsigned					block_stride;	/**< The distance between the first elements of adjacent blocks */
+		unsigned					length;			/**< The total number of elements occupied by the subset */
+	};
+
+typedef std::vector<CLASubsetLayout> CLALayoutVect;
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Manages a conditional likelihood array for one end of an edge.
 */
@@ -37,7 +72,8 @@ class CondLikelihood
 	{
 	public:
 
-									CondLikelihood(const uint_vect_t & npatterns, const uint_vect_t & nrates, const uint_vect_t & nstates);
+									CondLikelihood(const uint_vect_t & npatterns, const uint_vect_t & nrates, const uint_vect_t & nstates, bool pattern_blocked = false);
+									CondLikelihood(const uint_vect_t & npatterns, const uint_vect_t & nrates, const uint_vect_t & nstates, bool pattern_blocked, LikeFltType * cla_mem, UnderflowType * uf_mem);
 
 		LikeFltType *				getCLA();
 		LikeFltType *				getCLA() const;
@@ -53,15 +89,18 @@ class CondLikelihood
 		unsigned					getUnderflowNumEdges() const;
 		void						setUnderflowNumEdges(unsigned n);
 		
-		static unsigned				calcCLALength(const uint_vect_t & npatterns, const uint_vect_t & nrates, const uint_vect_t & nstates);
+		static unsigned				calcCLALength(const uint_vect_t & npatterns, const uint_vect_t & nrates, const uint_vect_t & nstates, bool pattern_blocked = false);
+		static void					calcLayout(CLALayoutVect & layout, const uint_vect_t & npatterns, const uint_vect_t & nrates, const uint_vect_t & nstates, bool pattern_blocked);
+		static unsigned				calcUFLength(const uint_vect_t & npatterns);
 
 	private:
 
-		LikeFltType *				cla;								/**< Pointer to conditional likelihood array stored by `claVec'  */
-		std::vector<LikeFltType>	claVec;								/**< Each element contains the likelihood conditional on a particular state, rate and pattern */
+		LikeFltType *				cla;								/**< Pointer to conditional likelihood array stored by `claVec' (or by the CondLikelihoodStorage arena) */
+		std::vector<LikeFltType>	claVec;								/**< Each element contains the likelihood conditional on a particular state, rate and pattern (empty if memory is supplied by an arena) */
+		unsigned					cla_length;							/**< The number of elements in the array pointed to by `cla' */
 
-		UnderflowType *				uf;									/**< Pointer to the underflow correction array stored in `underflowExponVec'. Used if UnderflowManager is in effect */
-		std::vector<UnderflowType>	underflowExponVec;					/**< Stores log of the underflow correction factor for each pattern. Used if UnderflowManager is in effect */
+		UnderflowType *				uf;									/**< Pointer to the underflow correction array stored in `underflowExponVec' (or by the CondLikelihoodStorage arena). Used if UnderflowManager is in effect */
+		std::vector<UnderflowType>	underflowExponVec;					/**< Stores log of the underflow correction factor for each pattern (empty if memory is supplied by an arena). Used if UnderflowManager is in effect */
 
 		unsigned 					numEdgesSinceUnderflowProtection;	/**< The number of edges traversed since the underflow protection factor was last updated */
 		
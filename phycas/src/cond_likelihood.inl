@@ -26,6 +26,26 @@
 namespace phycas
 {
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the position, relative to the start of the subset, of the first state of pattern `pat' (counting from the 
+|	first pattern of the subset) for rate category `rate'.
+*/
+inline unsigned CLASubsetLayout::offset(
+  unsigned pat,		/**< is the index of the pattern within the subset */
+  unsigned rate)	/**< is the index of the rate category */
+  const
+	{
+	return (pat/block_len)*block_stride + rate*rate_stride + (pat%block_len)*ns;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of blocks of patterns (1 in the standard layout).
+*/
+inline unsigned CLASubsetLayout::getNumBlocks() const
+	{
+	return (block_len == 0 ? 0 : (np + block_len - 1)/block_len);
+	}
+
 } //namespace phycas
 
 #endif
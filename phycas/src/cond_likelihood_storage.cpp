@@ -17,14 +17,117 @@
 |  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
 \~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
+#include <cstdlib>
+#include <algorithm>
+#include <boost/noncopyable.hpp>
+#include <boost/format.hpp>
 #include "phycas/src/cond_likelihood.hpp"
 #include "phycas/src/cond_likelihood_storage.hpp"
+#if defined(_WIN32)
+#	include <malloc.h>
+#elif defined(__linux__)
+#	include <sys/mman.h>
+#endif
 
 namespace phycas
 {
 
 static unsigned next_cond_like_storage = 0;
 
+static const std::size_t cla_slab_alignment	= 64;				// cache line size
+static const std::size_t cla_slab_huge_page	= 2*1024*1024;		// huge page size on x86-64 Linux
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns `n' rounded up to the nearest multiple of `m'.
+*/
+static std::size_t roundUpToMultiple(std::size_t n, std::size_t m)
+	{
+	return ((n + m - 1)/m)*m;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	A single block of aligned memory holding the conditional likelihood and underflow correction arrays of a fixed
+|	number of CondLikelihood objects, together with the objects themselves. Every array starts on a 64-byte boundary. 
+|	Slabs are created only by CondLikelihoodStorage::fillFromSlab, and each is destroyed when the last shared pointer 
+|	to one of its objects goes away.
+*/
+class CLASlab : boost::noncopyable
+	{
+	public:
+										CLASlab(unsigned n, const uint_vect_t & np, const uint_vect_t & nr, const uint_vect_t & ns, bool pattern_blocked, bool huge_pages);
+										~CLASlab();
+
+		std::vector<CondLikelihood>		objects;	/**< The CondLikelihood objects whose arrays live in `mem' */
+
+	private:
+
+		char *							mem;		/**< The aligned block of memory holding all arrays */
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Allocates one aligned block large enough for `n' conditional likelihood arrays (and their underflow correction
+|	arrays) with the dimensions given by `np', `nr' and `ns' (and the layout given by `pattern_blocked'), then constructs `n' CondLikelihood objects that use it.
+|	If `huge_pages' is true and the block is at least one huge page in size, the block is aligned to a huge page 
+|	boundary and (on Linux) the kernel is advised to back it with transparent huge pages. Throws XLikelihood if the 
+|	memory cannot be allocated.
+*/
+CLASlab::CLASlab(
+  unsigned n,					/**< is the number of CondLikelihood objects to create */
+  const uint_vect_t & np,		/**< is a vector containing the number of data patterns for each partition subset */
+  const uint_vect_t & nr,		/**< is a vector containing the number of among-site relative rate categories for each partition subset */
+  const uint_vect_t & ns,		/**< is a vector containing the number of states for each partition subset */
+  bool pattern_blocked,			/**< is true if the pattern-blocked layout is used (see CLASubsetLayout) */
+  bool huge_pages)				/**< is true if huge pages should be requested for large slabs */
+  : mem(NULL)
+	{
+	PHYCAS_ASSERT(n > 0);
+	const std::size_t cla_bytes = roundUpToMultiple(CondLikelihood::calcCLALength(np, nr, ns, pattern_blocked)*sizeof(LikeFltType), cla_slab_alignment);
+	const std::size_t uf_bytes = roundUpToMultiple(CondLikelihood::calcUFLength(np)*sizeof(UnderflowType), cla_slab_alignment);
+	const std::size_t stride = cla_bytes + uf_bytes;
+	std::size_t total_bytes = n*stride;
+	std::size_t alignment = cla_slab_alignment;
+	if (huge_pages && total_bytes >= cla_slab_huge_page)
+		{
+		alignment = cla_slab_huge_page;
+		total_bytes = roundUpToMultiple(total_bytes, cla_slab_huge_page);
+		}
+
+#	if defined(_WIN32)
+		mem = (char *)_aligned_malloc(total_bytes, alignment);
+#	else
+		void * p = NULL;
+		if (posix_memalign(&p, alignment, total_bytes) == 0)
+			mem = (char *)p;
+#	endif
+	if (mem == NULL)
+		throw XLikelihood(str(boost::format("could not allocate %d bytes for conditional likelihood arrays") % total_bytes));
+
+#	if defined(__linux__) && defined(MADV_HUGEPAGE)
+		if (alignment == cla_slab_huge_page)
+			madvise(mem, total_bytes, MADV_HUGEPAGE);	// advisory only, so failure is harmless
+#	endif
+
+	objects.reserve(n);
+	for (unsigned i = 0; i < n; ++i)
+		{
+		char * cla_mem = mem + i*stride;
+		objects.push_back(CondLikelihood(np, nr, ns, pattern_blocked, (LikeFltType *)cla_mem, (UnderflowType *)(cla_mem + cla_bytes)));
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Destructor releases the memory block.
+*/
+CLASlab::~CLASlab()
+	{
+	objects.clear();
+#	if defined(_WIN32)
+		_aligned_free(mem);
+#	else
+		std::free(mem);
+#	endif
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Ensures that the `cl_stack' contains at least `capacity' CondLikelihoodShPtr objects.
 */
@@ -35,20 +138,45 @@ void CondLikelihoodStorage::fillTo(unsigned capacity)
 	PHYCAS_ASSERT(std::accumulate(num_states.begin(), num_states.end(), 0) > 0);
 	unsigned curr_sz = (unsigned)cl_stack.size();
 	unsigned num_needed = (capacity > curr_sz ? capacity - curr_sz : 0);
+	if (use_arena)
+		{
+		if (num_needed > 0)
+			fillFromSlab(num_needed);
+		return;
+		}
 	for (unsigned i = 0; i < num_needed; ++i)
 		{
-		cl_stack.push(CondLikelihoodShPtr(new CondLikelihood(num_patterns, num_rates, num_states)));
+		cl_stack.push(CondLikelihoodShPtr(new CondLikelihood(num_patterns, num_rates, num_states, pattern_blocked)));
 		num_created++;
 		}
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Constructor sets `realloc_min' to 1 and `num_patterns', `num_rates' and `num_states' all to 0. 
+|	Creates a new CLASlab holding `n' CondLikelihood objects and pushes a shared pointer to each of them onto 
+|	`cl_stack'. The shared pointers all share ownership of the slab.
+*/
+void CondLikelihoodStorage::fillFromSlab(
+  unsigned n)	/**< is the number of objects to create */
+	{
+	CLASlabShPtr slab(new CLASlab(n, num_patterns, num_rates, num_states, pattern_blocked, use_huge_pages));
+	for (unsigned i = 0; i < n; ++i)
+		cl_stack.push(CondLikelihoodShPtr(slab, &slab->objects[i]));
+	num_created += n;
+	num_slabs++;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Constructor sets `realloc_min' to 1 and `num_patterns', `num_rates' and `num_states' all to 0. Arena mode is off,
+|	and CLAs use the standard layout.
 */
 CondLikelihoodStorage::CondLikelihoodStorage()
   : 
   num_created(0),
-  realloc_min(1)
+  realloc_min(1),
+  use_arena(false),
+  use_huge_pages(false),
+  pattern_blocked(false),
+  num_slabs(0)
 	{
 	which = next_cond_like_storage++;
 	}
@@ -104,20 +232,12 @@ unsigned CondLikelihoodStorage::getNumStates(
 
 /*----------------------------------------------------------------------------------------------------------------------
 |	Returns number of bytes allocated for each CLA. This equals sizeof(LikeFltType) times the product of the number of
-|	patterns, number of rates and number of states, summed over all partition subsets.
+|	patterns, number of rates and number of states, summed over all partition subsets (plus any padding needed by the
+|	pattern-blocked layout).
 */
 unsigned CondLikelihoodStorage::bytesPerCLA() const
 	{
-	unsigned sz = num_patterns.size();
-	PHYCAS_ASSERT(num_rates.size() == sz);
-	PHYCAS_ASSERT(num_states.size() == sz);
-	
-	unsigned total = 0;
-	for (unsigned i = 0; i < sz; ++i)
-		{
-		total += (unsigned)(num_patterns[i]*num_rates[i]*num_states[i]*sizeof(LikeFltType));
-		}
-	return total;
+	return (unsigned)(CondLikelihood::calcCLALength(num_patterns, num_rates, num_states, pattern_blocked)*sizeof(LikeFltType));
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -153,13 +273,15 @@ unsigned CondLikelihoodStorage::numCLAsStored() const
 //	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	If `cl_stack' is empty, calls CondLikelihoodStorage::fillTo to add `realloc_min' more objects to the stack. After
-|	ensuring that the `cl_stack' is not empty, pops a CondLikelihoodShPtr off and returns it.
+|	If `cl_stack' is empty, calls CondLikelihoodStorage::fillTo to add `realloc_min' more objects to the stack (in arena
+|	mode, the larger of `realloc_min' and the number of objects created so far, so that the number of slabs grows only
+|	logarithmically with the number of CLAs). After ensuring that the `cl_stack' is not empty, pops a 
+|	CondLikelihoodShPtr off and returns it.
 */
 CondLikelihoodShPtr CondLikelihoodStorage::getCondLikelihood()
 	{
 	if (cl_stack.empty())
-		fillTo(realloc_min);
+		fillTo(use_arena ? std::max(realloc_min, num_created) : realloc_min);
 
 	CondLikelihoodShPtr cl_ptr = cl_stack.top();
 	cl_stack.pop();
@@ -186,13 +308,46 @@ void CondLikelihoodStorage::setReallocMin(unsigned sz)
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Deletes all CondLikelihoodShPtr objects currently in the `cl_stack'.
+|	Deletes all CondLikelihoodShPtr objects currently in the `cl_stack'. Slabs are freed once none of their objects 
+|	remain checked out.
 */
 void CondLikelihoodStorage::clearStack()
 	{
 	while (!cl_stack.empty())
 		cl_stack.pop();
 	num_created = 0;
+	num_slabs = 0;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Turns arena mode on or off. In arena mode, CondLikelihood objects are created in batches whose arrays all reside in 
+|	one 64-byte aligned slab of memory; if `huge_pages' is also true, slabs at least 2 MB in size are aligned to 2 MB
+|	and (on Linux) the kernel is advised to back them with transparent huge pages. Objects already created, whether in 
+|	the stack or checked out, are unaffected; only objects created from now on use the new setting.
+*/
+void CondLikelihoodStorage::useArena(
+  bool yes_or_no,	/**< is true to allocate new CLAs from slabs, false to allocate each CLA separately */
+  bool huge_pages)	/**< is true to request huge pages for large slabs */
+	{
+	use_arena = yes_or_no;
+	use_huge_pages = yes_or_no && huge_pages;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the value of the data member `use_arena'.
+*/
+bool CondLikelihoodStorage::isUsingArena() const
+	{
+	return use_arena;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the value of the data member `num_slabs', which is the number of slabs created since this object was 
+|	constructed or since clearStack was last called.
+*/
+unsigned CondLikelihoodStorage::numSlabsCreated() const
+	{
+	return num_slabs;
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -205,9 +360,10 @@ void CondLikelihoodStorage::clearStack()
 |	checked out CLAs, an XLikelihood exception is thrown. This function has no effect unless the supplied arguments
 |	imply that newly-created CLAs will be longer than the existing ones. It is somewhat wastefull to leave in CLAs that
 |	are longer than they need to be, but perhaps more wasteful to continually recall and delete all existing CLAs just
-|	to ensure that their length is exactly correct.
+|	to ensure that their length is exactly correct. If `blocked' is true, new CLAs use the pattern-blocked layout (see
+|	CLASubsetLayout); changing the layout always deletes the existing objects.
 */
-void CondLikelihoodStorage::setCondLikeDimensions(const uint_vect_t & np, const uint_vect_t & nr, const uint_vect_t & ns)
+void CondLikelihoodStorage::setCondLikeDimensions(const uint_vect_t & np, const uint_vect_t & nr, const uint_vect_t & ns, bool blocked)
 	{
 	unsigned sz = (unsigned)np.size();
 	PHYCAS_ASSERT(nr.size() == sz);
@@ -216,21 +372,19 @@ void CondLikelihoodStorage::setCondLikeDimensions(const uint_vect_t & np, const
 	bool no_old = (num_patterns.size() == 0) || (num_rates.size() == 0) || (num_states.size() == 0);
 	bool old = !no_old;
 	
-	unsigned newlen = 0;
-	unsigned oldlen = 0;
 	for (unsigned i = 0; i < sz; ++i)
 		{
 		PHYCAS_ASSERT(np[i] > 0);
 		PHYCAS_ASSERT(nr[i] > 0);
 		PHYCAS_ASSERT(ns[i] > 0);
-		newlen += np[i]*nr[i]*ns[i];
-		if (old)
-			oldlen += num_patterns[i]*num_rates[i]*num_states[i];
 		}
+	unsigned newlen = CondLikelihood::calcCLALength(np, nr, ns, blocked);
+	unsigned oldlen = (old ? CondLikelihood::calcCLALength(num_patterns, num_rates, num_states, pattern_blocked) : 0);
 	
-	if (newlen > oldlen)
+	if (newlen > oldlen || blocked != pattern_blocked)
 		{
 		clearStack();
+		pattern_blocked = blocked;
 		num_patterns.resize(sz);
 		num_rates.resize(sz);
 		num_states.resize(sz);
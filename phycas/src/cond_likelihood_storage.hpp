@@ -31,12 +31,21 @@ namespace phycas
 class CondLikelihood;
 typedef boost::shared_ptr<CondLikelihood> CondLikelihoodShPtr;
 
+class CLASlab;
+typedef boost::shared_ptr<CLASlab> CLASlabShPtr;
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	A stack that stores CondLikelihood shared pointers. CondLikelihoodStorage object can be asked for a pointer to a
 |	CondLikelihoodShPtr object when one needed for a likelihood calculation. If the stack is not empty, the pointer on 
 |	top of the stack is popped off and returned. If the stack is empty, several new CondLikelihood objects are created 
 |	(`realloc_min' to be exact) on the heap and a pointer to one of them is returned. The `realloc_min' data member is 
 |	by default 1 but can be modified to improved efficiency if such "stack faults" are expected to be common.
+|	
+|	In arena mode (see useArena), each batch of new CondLikelihood objects is carved out of a single 64-byte aligned 
+|	slab (a CLASlab) rather than each object allocating its own arrays, and batches grow geometrically so that all the
+|	CLAs needed by a tree end up in a handful of slabs. The shared pointers handed out for objects in a slab all share 
+|	the slab's reference count, so creating them involves no per-CLA heap allocation; a slab is freed once the last of
+|	its objects is released.
 */
 class CondLikelihoodStorage
 	{
@@ -54,23 +63,33 @@ class CondLikelihoodStorage
 		unsigned						getNumPatterns(unsigned i) const;
 		unsigned						getNumRates(unsigned i) const;
 		unsigned						getNumStates(unsigned i) const;
-		void							setCondLikeDimensions(const uint_vect_t & np, const uint_vect_t & nr, const uint_vect_t & ns);
+		void							setCondLikeDimensions(const uint_vect_t & np, const uint_vect_t & nr, const uint_vect_t & ns, bool blocked = false);
 
 		void							setReallocMin(unsigned sz);
 		void							clearStack();
 
+		void							useArena(bool yes_or_no, bool huge_pages = false);
+		bool							isUsingArena() const;
+		unsigned						numSlabsCreated() const;
+
 		unsigned						bytesPerCLA() const;
 		unsigned						numCLAsCreated() const;
 		unsigned						numCLAsStored() const;
 
 	private:
 
+		void							fillFromSlab(unsigned n);
+
 		uint_vect_t						num_patterns;	/**< The number of data patterns vector (needed for the CondLikelihood constructor) */
 		uint_vect_t						num_rates;		/**< The number of discrete rate categories vector (needed for the CondLikelihood constructor) */
 		uint_vect_t						num_states;		/**< The number of states vector (needed for the CondLikelihood constructor) */
 		unsigned						num_created;	/**< The total number of CondLikelihood objects created in the lifetime of this object */
 		unsigned						realloc_min;	/**< When a request is made and `cl_stack' is empty, `realloc_min' new objects are created and added to the stack */
 		std::stack<CondLikelihoodShPtr>	cl_stack;		/**< The stack of CondLikelihoodShPtr */
+		bool							use_arena;		/**< If true, new CondLikelihood objects are allocated in batches from 64-byte aligned slabs */
+		bool							use_huge_pages;	/**< If true (and `use_arena' is true), the operating system is asked to back large slabs with huge pages where supported */
+		bool							pattern_blocked;	/**< If true, new CondLikelihood objects use the pattern-blocked layout (see CLASubsetLayout) */
+		unsigned						num_slabs;		/**< The number of slabs created since this object was constructed or clearStack was last called */
 		
 		unsigned						which;		//TEMP
 	};
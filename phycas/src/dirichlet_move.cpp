@@ -23,6 +23,7 @@
 #include "phycas/src/basic_tree_node.hpp"
 #include "phycas/src/tree_likelihood.hpp"
 #include "phycas/src/xlikelihood.hpp"
+#include "phycas/src/checkpoint.hpp"
 #include "phycas/src/mcmc_chain_manager.hpp"
 #include "phycas/src/dirichlet_move.hpp"
 #include "phycas/src/basic_tree.hpp"
@@ -124,6 +125,28 @@ void DirichletMove::setBoldness(
 	//std::cerr << boost::str(boost::format("####### DirichletMove::setBoldness(%.5f), boldness = %.5f, psi = %.5f, max_psi = %.5f, min_psi = %.5f") % x % boldness % psi % max_psi % min_psi) << std::endl;
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Saves the base class state (which includes the current parameter values) followed by `boldness' and `psi'.
+*/
+void DirichletMove::saveState(
+  CheckpointWriter & out) const	/**< is the checkpoint being written */
+	{
+	MCMCUpdater::saveState(out);
+	out.putDouble(boldness);
+	out.putDouble(psi);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the state written by saveState.
+*/
+void DirichletMove::restoreState(
+  CheckpointReader & in)	/**< is the checkpoint being read */
+	{
+	MCMCUpdater::restoreState(in);
+	boldness	= in.getDouble();
+	psi		= in.getDouble();
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Provides read access to the data member 'dim', which is the number of parameters updated jointly by this move.
 */
@@ -215,8 +238,8 @@ void DirichletMove::revert()
 	MCMCUpdater::revert();
     setParams(orig_params);
 
-    // invalidate all CLAs
-    likelihood->useAsLikelihoodRoot(NULL);	
+    // invalidate the CLAs of the subset(s) using this model
+    likelihood->invalidateSubsetCLAs(model);
 
 	reset();
 	}
@@ -242,7 +265,7 @@ bool DirichletMove::update()
 
     // replace current parameter values with new ones
     setParams(new_params);
-    likelihood->useAsLikelihoodRoot(NULL);	// invalidates all CLAs
+    likelihood->invalidateSubsetCLAs(model);	// invalidates the CLAs of the subset(s) using this model
 
 	double curr_ln_prior		= mv_prior->GetLnPDF(new_params);
 
@@ -519,6 +542,36 @@ void StateFreqMove::setParams(
     model->setStateFreqsUnnorm(v);
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Calls the base class version, then saves the unnormalized state frequencies held by the model. The normalized
+|	frequencies saved by the base class are not enough to restore the model exactly because normalizing them again may
+|	change their least significant bits.
+*/
+void StateFreqMove::saveState(
+  CheckpointWriter & out) const	/**< is the checkpoint being written */
+	{
+	DirichletMove::saveState(out);
+	double_vect_t unnorm;
+	if (model)
+		{
+		for (unsigned i = 0; i < dim; ++i)
+			unnorm.push_back(model->getStateFreqUnnorm(i));
+		}
+	out.putDoubleVect(unnorm);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the state written by saveState.
+*/
+void StateFreqMove::restoreState(
+  CheckpointReader & in)	/**< is the checkpoint being read */
+	{
+	DirichletMove::restoreState(in);
+	const double_vect_t unnorm = in.getDoubleVect();
+	if (model && !unnorm.empty())
+		model->setStateFreqsUnnorm(unnorm);
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	The constructor simply calls the base class (DirichletMove) constructor.
 */
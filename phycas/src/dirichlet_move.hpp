@@ -71,6 +71,8 @@ class DirichletMove : public MCMCUpdater
         virtual void                setPosteriorTuningParam(double x);
         virtual void                setPriorTuningParam(double x);
 		virtual void				setBoldness(double x);
+		virtual void				saveState(CheckpointWriter & out) const;
+		virtual void				restoreState(CheckpointReader & in);
 		virtual bool				update();
 		virtual double				getLnHastingsRatio() const;
 		virtual double				getLnJacobian() const;
@@ -118,6 +120,8 @@ class StateFreqMove : public DirichletMove
 		virtual double_vect_t		listCurrValuesFromModel();
         virtual void                getParams();
         virtual void                setParams(const std::vector<double> & v);
+		virtual void				saveState(CheckpointWriter & out) const;
+		virtual void				restoreState(CheckpointReader & in);
 
 	private:
 
@@ -106,7 +106,7 @@ double DiscreteGammaShapeParam::operator()(
 		sendCurrValueToModel(a);
 		recalcPrior(); // base class function that recomputes curr_ln_prior for the value curr_value
 		likelihood->recalcRelativeRates();	// must do this whenever model's shape parameter changes
-		likelihood->useAsLikelihoodRoot(NULL);	// invalidates all CLAs
+		likelihood->invalidateSubsetCLAs(model);	// invalidates the CLAs of the subset(s) using this model
 		curr_ln_like = (heating_power > 0.0 ? likelihood->calcLnL(tree) : 0.0);
 		ChainManagerShPtr p = chain_mgr.lock();
 		PHYCAS_ASSERT(p);
@@ -22,6 +22,7 @@
 #include "phycas/src/basic_tree_node.hpp"
 #include "phycas/src/tree_likelihood.hpp"
 #include "phycas/src/xlikelihood.hpp"
+#include "phycas/src/checkpoint.hpp"
 #include "phycas/src/mcmc_chain_manager.hpp"
 #include "phycas/src/edge_move.hpp"
 #include "phycas/src/topo_prior_calculator.hpp"
@@ -99,6 +100,28 @@ void EdgeMove::setBoldness(
 	lambda = min_lambda + (max_lambda - min_lambda)*boldness/100.0;
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Saves the base class state followed by the tuning parameter `lambda' and the `boldness' from which it was computed.
+*/
+void EdgeMove::saveState(
+  CheckpointWriter & out) const	/**< is the checkpoint being written */
+	{
+	MCMCUpdater::saveState(out);
+	out.putDouble(boldness);
+	out.putDouble(lambda);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the state written by saveState.
+*/
+void EdgeMove::restoreState(
+  CheckpointReader & in)	/**< is the checkpoint being read */
+	{
+	MCMCUpdater::restoreState(in);
+	boldness	= in.getDouble();
+	lambda		= in.getDouble();
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Sets the value for the data member lambda, which is the tuning parameter for this move.
 */
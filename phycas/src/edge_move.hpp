@@ -93,6 +93,8 @@ class EdgeMove : public MCMCUpdater
         virtual void                setPosteriorTuningParam(double x);
         virtual void                setPriorTuningParam(double x);
 		virtual void	            setBoldness(double x);
+		virtual void	            saveState(CheckpointWriter & out) const;
+		virtual void	            restoreState(CheckpointReader & in);
 		virtual bool				update();
 		virtual double				getLnHastingsRatio() const;
 		virtual double				getLnJacobian() const;
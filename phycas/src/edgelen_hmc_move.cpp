@@ -0,0 +1,451 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#include <cfloat>
+#include "phycas/src/probability_distribution.hpp"
+#include "phycas/src/likelihood_models.hpp"
+#include "phycas/src/tree_likelihood.hpp"
+#include "phycas/src/xlikelihood.hpp"
+#include "phycas/src/checkpoint.hpp"
+#include "phycas/src/mcmc_chain_manager.hpp"
+#include "phycas/src/mcmc_param.hpp"
+#include "phycas/src/edgelen_hmc_move.hpp"
+#include "phycas/src/basic_tree.hpp"
+
+#include "boost/format.hpp"
+
+namespace phycas
+{
+
+// Dual averaging constants recommended by Hoffman and Gelman (2014)
+static const double adapt_gamma	= 0.05;
+static const double adapt_t0	= 10.0;
+static const double adapt_kappa	= 0.75;
+
+// Log edge lengths are kept within these bounds so that exponentiating them neither overflows nor underflows
+static const double max_log_edgelen	= 690.0;
+static const double min_log_edgelen	= -690.0;
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	The default constructor.
+*/
+EdgeLenHMCMove::EdgeLenHMCMove() : MCMCUpdater()
+	{
+	is_move				= true;
+	boldness			= 0.0;
+	step_size			= 0.05;
+	min_step_size		= 0.05;
+	max_step_size		= 0.05;
+	num_steps			= 10;
+	target_accept		= 0.65;
+	adapting			= false;
+	adapt_count			= 0;
+	adapt_mu			= 0.0;
+	adapt_hbar			= 0.0;
+	adapt_log_step_bar	= 0.0;
+	curr_ln_ref_dist	= 0.0;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the value for the data member 'min_step_size', which is the step size used for exploring the posterior 
+|   distribution in this move. Any step size adapted so far is discarded.
+*/
+void EdgeLenHMCMove::setPosteriorTuningParam(
+  double x) /* is the new value for `min_step_size' */
+	{
+	min_step_size = x;
+	step_size = x*boldnessFactor();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the value for the data member `max_step_size', which is the step size used for exploring the prior 
+|   distribution in this move.
+*/
+void EdgeLenHMCMove::setPriorTuningParam(
+  double x) /* is the new value for `max_step_size' */
+	{
+	const double tuned_step_size = step_size/boldnessFactor();
+	max_step_size = x;
+	step_size = tuned_step_size*boldnessFactor();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the factor by which the step size at the current boldness exceeds the step size at boldness 0. The factor
+|	is interpolated linearly between 1 (boldness 0) and `max_step_size'/`min_step_size' (boldness 100).
+*/
+double EdgeLenHMCMove::boldnessFactor() const
+	{
+	return 1.0 + (max_step_size/min_step_size - 1.0)*boldness/100.0;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the value for the data member 'boldness', which ranges from 0 (least bold) to 100 (most bold), and scales 
+|	`step_size' accordingly (see boldnessFactor). The step size at boldness 0 is `min_step_size' unless it has been 
+|	adapted during burn-in, in which case the adapted value is scaled, so a boldness of 100 multiplies the adapted step
+|	size by `max_step_size'/`min_step_size'. If the step size is being adapted, dual averaging continues on the new 
+|	scale.
+*/
+void EdgeLenHMCMove::setBoldness(
+  double x) /* is the new boldness value */
+	{
+	const double old_factor = boldnessFactor();
+	boldness = x;
+	if (boldness < 0.0)
+		boldness = 0.0;
+	else if (boldness > 100.0)
+		boldness = 100.0;
+	const double ratio = boldnessFactor()/old_factor;
+	step_size *= ratio;
+	if (adapting)
+		{
+		adapt_mu += std::log(ratio);
+		adapt_log_step_bar += std::log(ratio);
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the number of leapfrog steps used to simulate each trajectory. Longer trajectories move farther but cost one
+|	gradient calculation (two traversals of the tree) per step.
+*/
+void EdgeLenHMCMove::setNumLeapfrogSteps(
+  unsigned n) /* is the new number of leapfrog steps */
+	{
+	PHYCAS_ASSERT(n > 0);
+	num_steps = n;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the value of the data member `num_steps'.
+*/
+unsigned EdgeLenHMCMove::getNumLeapfrogSteps() const
+	{
+	return num_steps;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the value of the data member `step_size'.
+*/
+double EdgeLenHMCMove::getStepSize() const
+	{
+	return step_size;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Starts (if `yes_or_no' is true) or stops adapting the step size. Starting resets the dual averaging state, which
+|	shrinks toward ten times the current step size as Hoffman and Gelman (2014) suggest. Stopping fixes the step size
+|	at the weighted average of the log step sizes tried during adaptation, which is less noisy than the last one tried.
+|	Adaptation makes the chain non-Markovian, so it should be confined to burn-in.
+*/
+void EdgeLenHMCMove::setAdapting(
+  bool yes_or_no)	/* is true to start adapting the step size and false to stop */
+	{
+	if (yes_or_no && !adapting)
+		{
+		adapt_count			= 0;
+		adapt_mu			= std::log(10.0*step_size);
+		adapt_hbar			= 0.0;
+		adapt_log_step_bar	= std::log(step_size);
+		}
+	else if (!yes_or_no && adapting && adapt_count > 0)
+		{
+		step_size = std::exp(adapt_log_step_bar);
+		}
+	adapting = yes_or_no;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the value of the data member `adapting'.
+*/
+bool EdgeLenHMCMove::isAdapting() const
+	{
+	return adapting;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Performs one dual averaging step, moving the log of `step_size' so that the mean of the acceptance probabilities
+|	`accept_prob' of successive updates approaches `target_accept'.
+*/
+void EdgeLenHMCMove::adaptStepSize(
+  double accept_prob)	/* is the acceptance probability of the update just completed */
+	{
+	++adapt_count;
+	const double m = (double)adapt_count;
+	const double w = 1.0/(m + adapt_t0);
+	adapt_hbar = (1.0 - w)*adapt_hbar + w*(target_accept - accept_prob);
+	const double log_step = adapt_mu - std::sqrt(m)*adapt_hbar/adapt_gamma;
+	const double eta = std::pow(m, -adapt_kappa);
+	adapt_log_step_bar = eta*log_step + (1.0 - eta)*adapt_log_step_bar;
+	step_size = std::exp(log_step);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Adds the step size and the state of step size adaptation to the state saved by MCMCUpdater::saveState.
+*/
+void EdgeLenHMCMove::saveState(
+  CheckpointWriter & out) const	/**< is the checkpoint being written */
+	{
+	MCMCUpdater::saveState(out);
+	out.putDouble(boldness);
+	out.putDouble(step_size);
+	out.putBool(adapting);
+	out.putUInt(adapt_count);
+	out.putDouble(adapt_mu);
+	out.putDouble(adapt_hbar);
+	out.putDouble(adapt_log_step_bar);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the state written by saveState.
+*/
+void EdgeLenHMCMove::restoreState(
+  CheckpointReader & in)	/**< is the checkpoint being read */
+	{
+	MCMCUpdater::restoreState(in);
+	boldness			= in.getDouble();
+	step_size			= in.getDouble();
+	adapting			= in.getBool();
+	adapt_count			= in.getUInt();
+	adapt_mu			= in.getDouble();
+	adapt_hbar			= in.getDouble();
+	adapt_log_step_bar	= in.getDouble();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the length of each edge in `edge_nodes' to the exponential of the corresponding element of `log_edgelens'.
+*/
+void EdgeLenHMCMove::setEdgeLens()
+	{
+	for (unsigned k = 0; k < (unsigned)edge_nodes.size(); ++k)
+		edge_nodes[k]->SetEdgeLen(std::exp(log_edgelens[k]));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the log of the target density of the log edge lengths at the current edge lengths and fills `gradient'
+|	with its derivatives with respect to each element of `log_edgelens'. The target density is the (heated) posterior
+|	density of the edge lengths, with the working prior included if `use_ref_dist' is true as in TreeScalerMove, times
+|	the Jacobian of the log transformation (the product of the edge lengths). Sets `curr_ln_like', `curr_ln_prior' and
+|	`curr_ln_ref_dist'. Every conditional likelihood array is recomputed, and all remain valid afterwards.
+*/
+double EdgeLenHMCMove::calcLnTarget()
+	{
+	ChainManagerShPtr p = chain_mgr.lock();
+	PHYCAS_ASSERT(p);
+	const unsigned n = (unsigned)edge_nodes.size();
+
+	// Gradient of the log-likelihood with respect to the edge lengths
+	double_vect_t like_grad(n, 0.0);
+	curr_ln_like = 0.0;
+	if (heating_power > 0.0)
+		{
+		likelihood->useAsLikelihoodRoot(NULL);	// invalidates all CLAs
+		curr_ln_like = likelihood->calcEdgeLenDerivatives(tree);
+		const double_vect_t & d1 = likelihood->getEdgeLenFirstDerivs();
+		PHYCAS_ASSERT((unsigned)d1.size() == n);
+		std::copy(d1.begin(), d1.end(), like_grad.begin());
+		}
+
+	// Gradients of the log prior and log working prior, provided by the EdgeLenMasterParam objects
+	double_vect_t prior_grad(n, 0.0);
+	double_vect_t ref_dist_grad(n, 0.0);
+	curr_ln_prior = 0.0;
+	curr_ln_ref_dist = 0.0;
+	const MCMCUpdaterVect & edge_length_params = p->getEdgeLenParams();
+	for (MCMCUpdaterVect::const_iterator it = edge_length_params.begin(); it != edge_length_params.end(); ++it)
+		{
+		curr_ln_prior += (*it)->recalcPrior();
+		EdgeLenMasterParamShPtr master = boost::dynamic_pointer_cast<EdgeLenMasterParam>(*it);
+		if (!master)
+			continue;
+		for (unsigned k = 0; k < n; ++k)
+			prior_grad[k] += master->lnPriorDerivOneEdge(*edge_nodes[k]);
+		if (use_ref_dist && !master->isFixed())
+			{
+			curr_ln_ref_dist += master->recalcWorkingPrior();
+			for (unsigned k = 0; k < n; ++k)
+				ref_dist_grad[k] += master->lnWorkingPriorDerivOneEdge(*edge_nodes[k]);
+			}
+		}
+
+	// Combine as TreeScalerMove::update does, then change variables from edge lengths to log edge lengths
+	double ln_target = 0.0;
+	gradient.resize(n);
+	for (unsigned k = 0; k < n; ++k)
+		{
+		if (is_standard_heating)
+			gradient[k] = heating_power*(like_grad[k] + prior_grad[k]) + (use_ref_dist ? (1.0 - heating_power)*ref_dist_grad[k] : 0.0);
+		else
+			gradient[k] = heating_power*like_grad[k] + prior_grad[k];
+		gradient[k] = gradient[k]*edge_nodes[k]->GetEdgeLen() + 1.0;
+		ln_target += log_edgelens[k];
+		}
+	if (is_standard_heating)
+		{
+		ln_target += heating_power*(curr_ln_like + curr_ln_prior);
+		if (use_ref_dist)
+			ln_target += (1.0 - heating_power)*curr_ln_ref_dist;
+		}
+	else
+		ln_target += heating_power*curr_ln_like + curr_ln_prior;
+	return ln_target;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Proposes new values for all edge lengths by simulating Hamiltonian dynamics for `num_steps' leapfrog steps starting
+|	from momenta drawn from a standard normal distribution, then accepts or rejects the proposal using the change in 
+|	total energy (log target density minus kinetic energy). The leapfrog integrator is reversible and preserves volume,
+|	so no Hastings ratio is needed. A trajectory that takes an edge length outside the range of representable positive
+|	numbers, or to a point of zero posterior density, is rejected immediately.
+*/
+bool EdgeLenHMCMove::update()
+	{
+    if (is_fixed)
+		return false;
+
+	ChainManagerShPtr p = chain_mgr.lock();
+	PHYCAS_ASSERT(p);
+
+	// Record the current position (the log of every edge length, in the order used by calcEdgeLenDerivatives)
+	edge_nodes.clear();
+	for (TreeNode * nd = tree->GetFirstPreorder(); nd != NULL; nd = nd->GetNextPreorder())
+		{
+		if (!nd->IsAnyRoot())
+			edge_nodes.push_back(nd);
+		}
+	const unsigned n = (unsigned)edge_nodes.size();
+	orig_edgelens.resize(n);
+	log_edgelens.resize(n);
+	momenta.resize(n);
+	for (unsigned k = 0; k < n; ++k)
+		{
+		orig_edgelens[k] = edge_nodes[k]->GetEdgeLen();
+		log_edgelens[k] = std::log(orig_edgelens[k]);
+		}
+
+	double prev_ln_target = calcLnTarget();
+	double prev_ln_like = curr_ln_like;
+	double prev_ln_prior = curr_ln_prior;
+
+	double prev_kinetic = 0.0;
+	for (unsigned k = 0; k < n; ++k)
+		{
+		momenta[k] = cdf.SampleNorm(rng->Uniform(FILE_AND_LINE), 0.0, 1.0);
+		prev_kinetic += 0.5*momenta[k]*momenta[k];
+		}
+
+	// Leapfrog integration: half step for momenta, full step for positions, half step for momenta
+	double curr_ln_target = prev_ln_target;
+	bool ok = true;
+	for (unsigned s = 0; ok && s < num_steps; ++s)
+		{
+		for (unsigned k = 0; k < n; ++k)
+			{
+			momenta[k] += 0.5*step_size*gradient[k];
+			log_edgelens[k] += step_size*momenta[k];
+			ok = ok && log_edgelens[k] > min_log_edgelen && log_edgelens[k] < max_log_edgelen;
+			}
+		if (!ok)
+			break;
+		setEdgeLens();
+		curr_ln_target = calcLnTarget();
+		ok = (curr_ln_target > -DBL_MAX && curr_ln_target < DBL_MAX);
+		for (unsigned k = 0; ok && k < n; ++k)
+			momenta[k] += 0.5*step_size*gradient[k];
+		}
+
+	double ln_accept_ratio = -DBL_MAX;
+	if (ok)
+		{
+		double curr_kinetic = 0.0;
+		for (unsigned k = 0; k < n; ++k)
+			curr_kinetic += 0.5*momenta[k]*momenta[k];
+		ln_accept_ratio = (curr_ln_target - curr_kinetic) - (prev_ln_target - prev_kinetic);
+		if (!(ln_accept_ratio > -DBL_MAX))
+			ln_accept_ratio = -DBL_MAX;
+		}
+	if (adapting)
+		adaptStepSize(ln_accept_ratio >= 0.0 ? 1.0 : std::exp(ln_accept_ratio));
+
+    double lnu = std::log(rng->Uniform(FILE_AND_LINE));
+	if (ok && (ln_accept_ratio >= 0.0 || lnu <= ln_accept_ratio))
+		{
+	    if (save_debug_info)
+    	    {
+			debug_info = boost::str(boost::format("ACCEPT, step_size = %.5f, prev_ln_prior = %.5f, curr_ln_prior = %.5f, prev_ln_like = %.5f, curr_ln_like = %.5f, lnu = %.5f, ln_accept_ratio = %.5f") % step_size % prev_ln_prior % curr_ln_prior % prev_ln_like % curr_ln_like % lnu % ln_accept_ratio);
+			}
+		if (heating_power == 0.0)
+			{
+			// The likelihood was never computed, so the CLAs in the tree are for the old edge lengths
+			likelihood->storeAllCLAs(tree);
+			likelihood->useAsLikelihoodRoot(NULL);
+			}
+		p->setLastLnPrior(curr_ln_prior);
+		p->setLastLnLike(curr_ln_like);
+		accept();
+		return true;
+		}
+	else
+		{
+	    if (save_debug_info)
+    	    {
+			debug_info = boost::str(boost::format("REJECT, step_size = %.5f, prev_ln_prior = %.5f, curr_ln_prior = %.5f, prev_ln_like = %.5f, curr_ln_like = %.5f, lnu = %.5f, ln_accept_ratio = %.5f") % step_size % prev_ln_prior % curr_ln_prior % prev_ln_like % curr_ln_like % lnu % ln_accept_ratio);
+			}
+		revert();
+		curr_ln_like	= p->getLastLnLike();
+		curr_ln_prior	= p->getLastLnPrior();
+		return false;
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the edge lengths that existed before the last proposal. The conditional likelihood arrays in the tree were
+|	computed for the rejected edge lengths, so they are all discarded.
+*/
+void EdgeLenHMCMove::revert()
+	{
+	MCMCUpdater::revert();
+	for (unsigned k = 0; k < (unsigned)edge_nodes.size(); ++k)
+		edge_nodes[k]->SetEdgeLen(orig_edgelens[k]);
+	likelihood->storeAllCLAs(tree);
+	likelihood->useAsLikelihoodRoot(NULL);	// invalidates all CLAs
+	}
+
+/*--------------------------------------------------------------------------------------------------------------------------
+|	Called if the move is accepted.
+*/
+void EdgeLenHMCMove::accept()
+	{
+	MCMCUpdater::accept();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the joint log prior over all edges in the associated tree and sets `curr_ln_prior'.
+*/
+double EdgeLenHMCMove::recalcPrior()
+	{
+    curr_ln_prior = 0.0;
+	ChainManagerShPtr p = chain_mgr.lock();
+	const MCMCUpdaterVect & edge_length_params = p->getEdgeLenParams();
+	for (MCMCUpdaterVect::const_iterator it = edge_length_params.begin(); it != edge_length_params.end(); ++it)
+		{
+		curr_ln_prior += (*it)->recalcPrior();
+		}
+	return curr_ln_prior;
+	}
+
+}	// namespace phycas
@@ -0,0 +1,100 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(EDGELEN_HMC_MOVE_HPP)
+#define EDGELEN_HMC_MOVE_HPP
+
+#include <vector>									// for std::vector
+#include <boost/shared_ptr.hpp>						// for boost::shared_ptr
+#include <boost/weak_ptr.hpp>						// for boost::weak_ptr
+#include "phycas/src/mcmc_updater.hpp"				// for base class MCMCUpdater
+#include "phycas/src/basic_cdf.hpp"					// for CDF
+
+namespace phycas
+{
+
+class MCMCChainManager;
+typedef boost::weak_ptr<MCMCChainManager>			ChainManagerWkPtr;
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Encapsulates a Hamiltonian Monte Carlo move that proposes new values for all edge lengths at once. Edge lengths 
+|	are transformed to the log scale, momenta are drawn from a standard normal distribution, and Hamiltonian dynamics 
+|	are simulated using `num_steps' leapfrog steps of size `step_size', each of which needs the gradient of the log 
+|	posterior: the likelihood part is supplied by TreeLikelihood::calcEdgeLenDerivatives and the prior part by the
+|	EdgeLenMasterParam objects of the chain manager. Unlike EdgeLenParam slice samplers, which update one edge at a 
+|	time, and TreeScalerMove, which changes only the tree length, this move changes every edge length in a direction
+|	informed by the data, so it mixes well even on trees with hundreds of edges. While `adapting' is true (normally 
+|	during burn-in), the step size is tuned by dual averaging (Hoffman and Gelman 2014) to achieve an average 
+|	acceptance probability of `target_accept'.
+*/
+class EdgeLenHMCMove : public MCMCUpdater
+	{
+	public:
+						EdgeLenHMCMove();
+						virtual ~EdgeLenHMCMove() {}
+
+		void			setNumLeapfrogSteps(unsigned n);
+		unsigned		getNumLeapfrogSteps() const;
+		double			getStepSize() const;
+		void			setAdapting(bool yes_or_no);
+		bool			isAdapting() const;
+
+		// These are virtual functions in the MCMCUpdater base class
+        virtual void    setPosteriorTuningParam(double x);
+        virtual void    setPriorTuningParam(double x);
+		virtual void	setBoldness(double x);
+		virtual void	saveState(CheckpointWriter & out) const;
+		virtual void	restoreState(CheckpointReader & in);
+		virtual bool	update();
+		virtual double	recalcPrior();			// override virtual from MCMCUpdater base class
+		virtual void	revert();
+		virtual void	accept();
+
+    private:
+
+		double			boldnessFactor() const;
+		double			calcLnTarget();
+		void			setEdgeLens();
+		void			adaptStepSize(double accept_prob);
+
+		double			boldness;			/**< Ranges from 0 to 100 and determines the boldness of the move */
+		double			step_size;			/**< The leapfrog step size (on the log edge length scale) at the current boldness */
+		double			min_step_size;		/**< The initial step size used for exploring the posterior distribution (boldness 0) */
+		double			max_step_size;		/**< The initial step size used for exploring the prior distribution (boldness 100) */
+		unsigned		num_steps;			/**< The number of leapfrog steps in each proposed trajectory */
+		double			target_accept;		/**< The mean acceptance probability sought when adapting the step size */
+		bool			adapting;			/**< If true, `step_size' is adapted after every update */
+		unsigned		adapt_count;		/**< The number of updates since adaptation began */
+		double			adapt_mu;			/**< The log step size toward which dual averaging shrinks its proposals */
+		double			adapt_hbar;			/**< The running average of the difference between `target_accept' and the acceptance probability */
+		double			adapt_log_step_bar;	/**< The weighted average of log step sizes tried, used once adaptation stops */
+		double			curr_ln_ref_dist;	/**< The log working prior computed by the last call to calcLnTarget */
+		CDF				cdf;				/**< Used to draw standard normal momenta */
+		std::vector<TreeNode *>	edge_nodes;	/**< The nodes whose edges are updated, in preorder (the order of TreeLikelihood::getEdgeLenFirstDerivs) */
+		double_vect_t	orig_edgelens;		/**< The edge lengths before the current proposal */
+		double_vect_t	log_edgelens;		/**< The current position: log of each edge length in `edge_nodes' */
+		double_vect_t	momenta;			/**< The current momentum of each element of `log_edgelens' */
+		double_vect_t	gradient;			/**< The gradient of the log target density with respect to `log_edgelens' computed by calcLnTarget */
+	};
+
+typedef boost::shared_ptr<EdgeLenHMCMove> EdgeLenHMCMoveShPtr;
+
+} // namespace phycas
+
+#endif
@@ -21,6 +21,7 @@
 #include "mcmc_param.hpp"
 #include "phycas/src/basic_tree.hpp"				// for Tree::begin() and Tree::end()
 #include "phycas/src/mcmc_chain_manager.hpp"
+#include "phycas/src/checkpoint.hpp"
 #include <boost/format.hpp>
 
 // these were at the top of basic_tree.inl
@@ -108,6 +109,49 @@ double EdgeLenMasterParam::lnPriorOneEdge(TreeNode & nd) const
         }
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the derivative, with respect to the length of the edge subtending `nd', of the log of the prior density of
+|	that edge length (zero if the edge is not one of those governed by this EdgeLenMasterParam). Used by moves, such as
+|	EdgeLenHMCMove, that need the gradient of the log posterior. ProbabilityDistribution provides no derivatives, so a
+|	central difference is used; the step is small relative to the edge length, so it never leaves the support.
+*/
+double EdgeLenMasterParam::lnPriorDerivOneEdge(const TreeNode & nd) const
+	{
+    bool skip = (nd.IsTipRoot())
+                || ((edgeLenType == EdgeLenMasterParam::internal) && (!nd.IsInternal()))
+                || ((edgeLenType == EdgeLenMasterParam::external) && (nd.IsInternal()));
+	if (skip)
+		return 0.0;
+
+	double v = nd.GetEdgeLen();
+	PHYCAS_ASSERT(v > 0.0);
+	double h = 1.e-5*v;
+	double retval = 0.0;
+	try 
+		{
+		retval = (prior->GetLnPDF(v + h) - prior->GetLnPDF(v - h))/(2.0*h);
+		}
+	catch(XProbDist &)
+		{
+		PHYCAS_ASSERT(0);
+		}
+	return retval;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the derivative, with respect to the length of the edge subtending `nd', of the log of the working prior 
+|	density computed by lnWorkingPriorOneEdge, using a central difference as in lnPriorDerivOneEdge.
+*/
+double EdgeLenMasterParam::lnWorkingPriorDerivOneEdge(const TreeNode & nd) const
+	{
+	if (nd.IsTipRoot())
+		return 0.0;
+	double v = nd.GetEdgeLen();
+	PHYCAS_ASSERT(v > 0.0);
+	double h = 1.e-5*v;
+	return (lnWorkingPriorOneEdge(nd, v + h) - lnWorkingPriorOneEdge(nd, v - h))/(2.0*h);
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Reports the distribution being used for both the generic `ref_dist' as well as the edge-specific working
 |	priors for edges that were sampled before the working priors were finalized.
@@ -412,4 +456,59 @@ void EdgeLenMasterParam::finalizeWorkingPrior()
 			}
 		}
 	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Overrides base class version to also copy the split-specific samples stored in `edge_ref_dist'. Any working 
+|	priors already fitted by `other' are not copied; call finalizeWorkingPrior afterwards to fit them anew.
+*/
+void EdgeLenMasterParam::copyWorkingPriorSample(
+  const MCMCUpdater & other)	/**< is the updater whose fitting sample is to be copied */
+	{
+	MCMCUpdater::copyWorkingPriorSample(other);
+	const EdgeLenMasterParam * p = dynamic_cast<const EdgeLenMasterParam *>(&other);
+	PHYCAS_ASSERT(p);
+	edge_ref_dist.clear();
+	for (WorkingPriorMapConstIter it = p->edge_ref_dist.begin(); it != p->edge_ref_dist.end(); ++it)
+		{
+		EdgeWorkingPrior e;
+		e.fs = (*it).second.fs;
+		edge_ref_dist.insert(WorkingPriorMapPair((*it).first, e));
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Overrides base class version to also save the split-specific samples stored in `edge_ref_dist'. As with 
+|	copyWorkingPriorSample, fitted working priors are not saved because finalizeWorkingPrior fits them again from the
+|	samples.
+*/
+void EdgeLenMasterParam::saveState(
+  CheckpointWriter & out) const	/**< is the checkpoint being written */
+	{
+	MCMCUpdater::saveState(out);
+	out.putUInt((unsigned)edge_ref_dist.size());
+	for (WorkingPriorMapConstIter it = edge_ref_dist.begin(); it != edge_ref_dist.end(); ++it)
+		{
+		out.putString((*it).first.Write());
+		out.putDoubleVect((*it).second.fs);
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the state written by saveState.
+*/
+void EdgeLenMasterParam::restoreState(
+  CheckpointReader & in)	/**< is the checkpoint being read */
+	{
+	MCMCUpdater::restoreState(in);
+	edge_ref_dist.clear();
+	const unsigned nsplits = in.getUInt();
+	for (unsigned i = 0; i < nsplits; ++i)
+		{
+		Split s;
+		s.Read(in.getString());
+		EdgeWorkingPrior e;
+		e.fs = in.getDoubleVect();
+		edge_ref_dist.insert(WorkingPriorMapPair(s, e));
+		}
+	}
 }
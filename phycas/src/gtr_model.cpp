@@ -233,6 +233,25 @@ void GTR::calcPMat(double * * pMat, double edgeLength) const
 	q_matrix.recalcPMat(pMat, edgeLength);
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the `numRates' transition probability matrices in `pMat' in a single call to QMatrix::recalcPMatBatch. 
+|	Overrides the virtual function inherited from the base class Model.
+*/
+void GTR::calcPMatrices(double * * * pMat, const double * edgeLength, unsigned numRates) const
+	{
+	q_matrix.recalcPMatBatch(numRates, pMat, edgeLength);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the first and second derivatives of the transition probability matrix with respect to `edgeLength' using
+|	the eigensystem held by the data member `q_matrix'. Overrides the virtual function inherited from the base class
+|	Model.
+*/
+void GTR::calcPMatDerivatives(double * * dPMat, double * * d2PMat, double edgeLength) const
+	{
+	q_matrix.recalcPMatDerivatives(dPMat, d2PMat, edgeLength);
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |   Needs work.
 */
@@ -53,6 +53,8 @@ class GTR: public Model
         double					    calcLMat(double * * lMat) const;
         double					    calcUMat(double * * uMat) const;
 		void						calcPMat(double * * pMat, double edgeLength) const;
+		void						calcPMatrices(double * * * pMat, const double * edgeLength, unsigned numRates) const;
+		void						calcPMatDerivatives(double * * dPMat, double * * d2PMat, double edgeLength) const;
 
         void						fixRelRates();
 		void						freeRelRates();
@@ -561,3 +561,55 @@ void HKY::calcPMat(double * * pMat, double edgeLength) const
 	pMat[2][3] = pMat[0][3];
 	pMat[3][3] = piT + (x*ta) + (y*tb);
 	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the first and second derivatives of the transition probabilities computed by calcPMat with respect to 
+|	`edgeLength'. Overrides the virtual function inherited from the base class Model. Every element of the transition
+|	matrix is a constant plus multiples of x = exp(-beta*t) and y = exp(td*t), so differentiating just replaces x by 
+|	-beta*x (then beta^2*x) and y by td*y (then td^2*y) and drops the constant.
+*/
+void HKY::calcPMatDerivatives(double * * dPMat, double * * d2PMat, double edgeLength) const
+	{
+	PHYCAS_ASSERT(state_freqs.size() == 4);
+	double t = edgeLength;
+	if (t < 1.e-8) 
+		t = 1.e-8; //TreeNode::edgeLenEpsilon;
+
+	double denom = ((state_freqs[0] + state_freqs[2])*(state_freqs[1] + state_freqs[3]) + kappa*((state_freqs[0]*state_freqs[2]) + (state_freqs[1]*state_freqs[3])));
+	double beta = 0.5/denom;
+	double x = exp(-beta*t);
+	double dx = -beta*x;
+	double d2x = beta*beta*x;
+
+	// Column j holds the probabilities of changes to base j; A (0) and G (2) are purines, C (1) and T (3) pyrimidines
+	for (unsigned j = 0; j < 4; ++j)
+		{
+		double pij = state_freqs[j];
+		double Pij = (j % 2 == 0 ? state_freqs[0] + state_freqs[2] : state_freqs[1] + state_freqs[3]);
+		double td = -beta*(1 + Pij*(kappa - 1.0));
+		double y = exp(t*td);
+		double dy = td*y;
+		double d2y = td*td*y;
+		double ta = pij*(1.0/Pij - 1.0);
+		double tb = (Pij - pij)/Pij;
+		double tc = pij/Pij;
+		for (unsigned i = 0; i < 4; ++i)
+			{
+			if (i == j)
+				{
+				dPMat[i][j] = (dx*ta) + (dy*tb);
+				d2PMat[i][j] = (d2x*ta) + (d2y*tb);
+				}
+			else if (i % 2 == j % 2)
+				{
+				dPMat[i][j] = (dx*ta) - (dy*tc);
+				d2PMat[i][j] = (d2x*ta) - (d2y*tc);
+				}
+			else
+				{
+				dPMat[i][j] = -pij*dx;
+				d2PMat[i][j] = -pij*d2x;
+				}
+			}
+		}
+	}
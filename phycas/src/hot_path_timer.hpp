@@ -0,0 +1,151 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(HOT_PATH_TIMER_HPP)
+#define HOT_PATH_TIMER_HPP
+
+#include <boost/cstdint.hpp>
+
+#if defined(_WIN32)
+#	if !defined(WIN32_LEAN_AND_MEAN)
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	if !defined(NOMINMAX)
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#elif defined(__APPLE__)
+#	include <mach/mach_time.h>
+#else
+#	include <time.h>
+#endif
+
+// Defining PHYCAS_NO_HOT_PATH_TIMING (e.g. -DPHYCAS_NO_HOT_PATH_TIMING) compiles the PHYCAS_HOT_PATH macros below to
+// nothing, so that the counters they maintain always read zero
+#if defined(PHYCAS_NO_HOT_PATH_TIMING)
+#	define PHYCAS_HOT_PATH_TIMER(counter)
+#	define PHYCAS_HOT_PATH_TIMER_N(counter, n)
+#	define PHYCAS_HOT_PATH_COUNT(counter)
+#else
+#	define PHYCAS_HOT_PATH_TIMER(counter)		phycas::HotPathTimer hot_path_timer_(counter, 1)
+#	define PHYCAS_HOT_PATH_TIMER_N(counter, n)	phycas::HotPathTimer hot_path_timer_(counter, n)
+#	define PHYCAS_HOT_PATH_COUNT(counter)		++(counter).count
+#endif
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads the operating system's monotonic high-resolution clock (QueryPerformanceCounter on Windows,
+|	mach_absolute_time on Mac OS X and clock_gettime(CLOCK_MONOTONIC) elsewhere). Unlike clock(), which StopWatch once used,
+|	these measure elapsed rather than processor time, have sub-microsecond resolution, do not wrap around during a run
+|	and cost only a few tens of nanoseconds to read.
+*/
+class HotPathClock
+	{
+	public:
+
+		static boost::uint64_t now()
+			{
+#			if defined(_WIN32)
+				LARGE_INTEGER t;
+				QueryPerformanceCounter(&t);
+				return (boost::uint64_t)t.QuadPart;
+#			elif defined(__APPLE__)
+				return (boost::uint64_t)mach_absolute_time();
+#			else
+				struct timespec t;
+				clock_gettime(CLOCK_MONOTONIC, &t);
+				return (boost::uint64_t)t.tv_sec*1000000000 + (boost::uint64_t)t.tv_nsec;
+#			endif
+			}
+
+		static double secondsPerTick()
+			{
+#			if defined(_WIN32)
+				LARGE_INTEGER f;
+				QueryPerformanceFrequency(&f);
+				return 1.0/(double)f.QuadPart;
+#			elif defined(__APPLE__)
+				mach_timebase_info_data_t tb;
+				mach_timebase_info(&tb);
+				return 1.0e-9*(double)tb.numer/(double)tb.denom;
+#			else
+				return 1.0e-9;
+#			endif
+			}
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Accumulates the number of times one hot-path operation was performed and the clock ticks spent performing it. A
+|	counter is not synchronized: each one belongs to an object (e.g. a TreeLikelihood or an MCMCUpdater) that is only
+|	ever used by one thread at a time, which keeps updating it as cheap as incrementing two integers.
+*/
+struct HotPathCounter
+	{
+	HotPathCounter() : count(0), ticks(0) {}
+
+	void	reset()				{count = 0; ticks = 0;}
+	double	getCount() const	{return (double)count;}
+	double	getSeconds() const	{return (double)ticks*HotPathClock::secondsPerTick();}
+
+	boost::uint64_t	count;	/**< is the number of operations performed */
+	boost::uint64_t	ticks;	/**< is the total time spent performing them (in HotPathClock ticks) */
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Scoped timer that adds the time between its construction and destruction, along with `n' operations, to a
+|	HotPathCounter. Normally created through the PHYCAS_HOT_PATH_TIMER macros so that it can be compiled out.
+*/
+class HotPathTimer
+	{
+	public:
+
+		HotPathTimer(HotPathCounter & c, unsigned n) : counter(c), nops(n), start(HotPathClock::now()) {}
+		~HotPathTimer()
+			{
+			counter.ticks += HotPathClock::now() - start;
+			counter.count += nops;
+			}
+
+	private:
+
+		HotPathTimer(const HotPathTimer &);
+		HotPathTimer & operator=(const HotPathTimer &);
+
+		HotPathCounter &	counter;	/**< is the counter to which the elapsed time is added */
+		unsigned			nops;		/**< is the number of operations performed while this timer exists */
+		boost::uint64_t		start;		/**< is the clock reading when this timer was created */
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true unless Phycas was compiled with PHYCAS_NO_HOT_PATH_TIMING defined.
+*/
+inline bool isTimingHotPaths()
+	{
+#	if defined(PHYCAS_NO_HOT_PATH_TIMING)
+		return false;
+#	else
+		return true;
+#	endif
+	}
+
+} // namespace phycas
+
+#endif
@@ -56,6 +56,7 @@ InternalData::InternalData(
 			}
 		}
 	pMatrices.resize(num_subsets);
+	pMatrixStamps.resize(num_subsets);
 	for (unsigned i = 0; i < num_subsets; ++i)
 		{
 		const unsigned num_rates	= partition->subset_num_rates[i];
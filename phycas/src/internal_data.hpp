@@ -28,6 +28,7 @@
 #include "phycas/src/states_patterns.hpp"
 #include "phycas/src/univents.hpp"
 #include "phycas/src/partition_model.hpp"
+#include "phycas/src/pmatrix_stamp.hpp"
 
 struct CIPRES_Matrix;
 
@@ -132,6 +133,7 @@ class InternalData
 
 		state_code_t								state;			/**< Used in simulation to temporarily store the state for one character */
 		std::vector< ScopedThreeDMatrix<double> >	pMatrices;		/**< pMatrix[s][r] is the transition matrix for subset s and relative rate r */
+		mutable std::vector<PMatrixStamp>			pMatrixStamps;	/**< pMatrixStamps[s] records the inputs used to compute pMatrices[s] (see TreeLikelihood::refreshPMat) */
 		CondLikelihoodStorageShPtr					cla_pool;		/**< CondLikelihood object storage facility */
 		std::vector<unsigned** >		    		sMat;
 	};
@@ -144,20 +146,24 @@ typedef std::vector<InternalDataShPtr>			VecInternalDataShPtr;
 // **************************************************************************************
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Accessor function that returns the data member `pMatrices'.
+|	Accessor function that returns the data member `pMatrices'. Because the caller may modify the matrices, the 
+|	corresponding element of `pMatrixStamps' is invalidated.
 */
 inline double * * * InternalData::getPMatrices(
   unsigned i)		/**< is the subset of the partition */
 	{
+	pMatrixStamps[i].invalidate();
 	return pMatrices[i].ptr;
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Accessor function that returns the data member `pMatrices'.
+|	Accessor function that returns the data member `pMatrices'. Because the caller may modify the matrices, the 
+|	corresponding element of `pMatrixStamps' is invalidated.
 */
 inline double * * * InternalData::getMutablePMatrices(
   unsigned i) const		/**< is the subset of the partition */
 	{
+	pMatrixStamps[i].invalidate();
 	return pMatrices[i].ptr;
 	}
 
@@ -73,6 +73,7 @@ void Irreversible::setScalingFactor(
     {
     PHYCAS_ASSERT(sf >= 0.0);
     scaling_factor = sf;
+	++time_stamp;
     }
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -118,6 +118,40 @@ void JC::calcPMat(double * * pMat, double edgeLength) const
 	//	cout << pMat[i][0] << ' '<< pMat[i][1] << ' '<< pMat[i][2] << ' '<< pMat[i][3] << '\n';
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the first and second derivatives of the transition probabilities computed by calcPMat with respect to 
+|	`edgeLength'. Overrides the virtual function inherited from the base class Model. Differentiating the expressions
+|	given for calcPMat yields:
+|>
+|	dPii/dt   = -exp{-4*edgeLength/3}
+|	dPij/dt   = exp{-4*edgeLength/3}/3
+|	d2Pii/dt2 = 4*exp{-4*edgeLength/3}/3
+|	d2Pij/dt2 = -4*exp{-4*edgeLength/3}/9
+|>
+*/
+void JC::calcPMatDerivatives(double * * dPMat, double * * d2PMat, double edgeLength) const
+	{
+	if (edgeLength < 1.e-8) 
+		edgeLength = 1.e-8; //TreeNode::edgeLenEpsilon;
+	const double exp_term = exp(-(4.0/3.0)*edgeLength);
+	for (unsigned i = 0; i < 4; ++i)
+		{
+		for (unsigned j = 0; j < 4; ++j)
+			{
+			if (i == j)
+				{
+				dPMat[i][j] = -exp_term;
+				d2PMat[i][j] = (4.0/3.0)*exp_term;
+				}
+			else
+				{
+				dPMat[i][j] = exp_term/3.0;
+				d2PMat[i][j] = -(4.0/9.0)*exp_term;
+				}
+			}
+		}
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |   Needs work.
 */
@@ -133,7 +133,7 @@ double KappaParam::operator()(
 		sendCurrValueToModel(k);
 		recalcPrior();
 
-		likelihood->useAsLikelihoodRoot(NULL);	// invalidates all CLAs
+		likelihood->invalidateSubsetCLAs(model);	// invalidates the CLAs of the subset(s) using this model
 		curr_ln_like = (heating_power > 0.0 ? likelihood->calcLnL(tree) : 0.0);
 		ChainManagerShPtr p = chain_mgr.lock();
 		PHYCAS_ASSERT(p);
@@ -22,6 +22,7 @@
 #include "phycas/src/basic_tree_node.hpp"
 #include "phycas/src/tree_likelihood.hpp"
 #include "phycas/src/xlikelihood.hpp"
+#include "phycas/src/checkpoint.hpp"
 #include "phycas/src/mcmc_chain_manager.hpp"
 #include "phycas/src/larget_simon_move.hpp"
 #include "phycas/src/basic_tree.hpp"
@@ -886,5 +887,28 @@ void LargetSimonMove::setBoldness(
 	lambda = min_lambda + (max_lambda - min_lambda)*boldness/100.0;
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Calls the base class version, then saves `boldness' and `lambda', which during steppingstone sampling depend on the
+|	beta value being explored.
+*/
+void LargetSimonMove::saveState(
+  CheckpointWriter & out) const	/**< is the checkpoint being written */
+	{
+	MCMCUpdater::saveState(out);
+	out.putDouble(boldness);
+	out.putDouble(lambda);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the state written by saveState.
+*/
+void LargetSimonMove::restoreState(
+  CheckpointReader & in)	/**< is the checkpoint being read */
+	{
+	MCMCUpdater::restoreState(in);
+	boldness	= in.getDouble();
+	lambda		= in.getDouble();
+	}
+
 }	// namespace phycas
 
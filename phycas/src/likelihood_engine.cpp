@@ -0,0 +1,432 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#include <cmath>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include "phycas/src/likelihood_engine.hpp"
+#include "phycas/src/cla_kernels.hpp"
+#include "phycas/src/thread_pool.hpp"
+#include "phycas/src/xlikelihood.hpp"
+#if !defined(PHYCAS_NO_BEAGLE)
+#	include "phycas/src/beaglelib.hpp"
+#endif
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Supplies a pool of threads among which the engine may divide its work (NULL means do all work in the calling
+|	thread). The pool is owned by the caller, which must call this function again before destroying it. This base
+|	class version ignores the pool.
+*/
+void LikelihoodEngine::setThreadPool(
+  ThreadPool *)	/**< is the pool to use (unused) */
+	{
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns a new engine of the kind named by `name': "cpu" for CPULikelihoodEngine or "beagle" for BeagleLib (unless
+|	Phycas was compiled with PHYCAS_NO_BEAGLE defined). Throws XLikelihood if `name' is not recognized.
+*/
+LikelihoodEngineShPtr createLikelihoodEngine(
+  const std::string & name)	/**< is the name of the engine to create */
+	{
+	if (name == "cpu")
+		return LikelihoodEngineShPtr(new CPULikelihoodEngine());
+#	if !defined(PHYCAS_NO_BEAGLE)
+		if (name == "beagle")
+			return LikelihoodEngineShPtr(new BeagleLib());
+#	endif
+	throw XLikelihood(boost::str(boost::format("unknown likelihood engine \"%s\"") % name));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Constructs an engine with no buffers; createInstance must be called before anything else.
+*/
+CPULikelihoodEngine::CPULikelihoodEngine()
+  : num_tips(0), num_buffers(0), num_matrices(0), num_states(0), num_patterns(0), num_categories(0), block_size(1), thread_pool(NULL)
+	{
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns "cpu".
+*/
+std::string CPULikelihoodEngine::getName() const
+	{
+	return "cpu";
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Allocates `nbuffers' partials buffers (the first `ntips' of which hold tip data and are filled by setTipPartials)
+|	and `nmatrices' sets of transition matrices for `npatterns' patterns of data having `nstates' states, analyzed
+|	with `ncategories' rate categories. All tip partials are initially 1 (missing data), all pattern weights 1, state
+|	frequencies equal, and all weight is given to the first category.
+*/
+void CPULikelihoodEngine::createInstance(
+  unsigned ntips,		/**< is the number of tips */
+  unsigned nbuffers,	/**< is the total number of partials buffers, including the `ntips' tip buffers */
+  unsigned nmatrices,	/**< is the number of sets of transition matrices */
+  unsigned nstates,		/**< is the number of states */
+  unsigned npatterns,	/**< is the number of patterns */
+  unsigned ncategories)	/**< is the number of rate categories */
+	{
+	if (ntips < 2 || nbuffers <= ntips || nmatrices == 0 || nstates == 0 || npatterns == 0 || ncategories == 0)
+		throw XLikelihood("invalid dimensions supplied to CPULikelihoodEngine::createInstance");
+	num_tips		= ntips;
+	num_buffers		= nbuffers;
+	num_matrices	= nmatrices;
+	num_states		= nstates;
+	num_patterns	= npatterns;
+	num_categories	= ncategories;
+	block_size		= CLAKernels::calcBlockSize(nstates);
+
+	partials.assign(num_buffers, std::vector<double>());
+	scalers.assign(num_buffers, std::vector<int>());
+	for (unsigned b = 0; b < num_buffers; ++b)
+		{
+		if (isTip(b))
+			partials[b].assign(num_patterns*num_states, 1.0);
+		else
+			{
+			partials[b].assign(num_categories*num_patterns*num_states, 0.0);
+			scalers[b].assign(num_patterns, 0);
+			}
+		}
+	matrices.assign(num_matrices, std::vector<double>(num_categories*num_states*num_states, 0.0));
+	pattern_weights.assign(num_patterns, 1.0);
+	state_freqs.assign(num_states, 1.0/(double)num_states);
+	category_weights.assign(num_categories, 0.0);
+	category_weights[0] = 1.0;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Supplies the pool of threads among which blocks of patterns are divided (NULL means use only the calling thread).
+*/
+void CPULikelihoodEngine::setThreadPool(
+  ThreadPool * pool)	/**< is the pool to use */
+	{
+	thread_pool = pool;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Copies `partials', which holds `num_states' values for each pattern (the probability of the observed data for each
+|	possible state, so 1 for every state compatible with an ambiguity), into tip buffer `tip'.
+*/
+void CPULikelihoodEngine::setTipPartials(
+  unsigned tip,							/**< is the index of the tip buffer */
+  const std::vector<double> & tip_partials)	/**< is the tip data */
+	{
+	if (tip >= num_tips)
+		throw XLikelihood(boost::str(boost::format("tip buffer %d does not exist") % tip));
+	if (tip_partials.size() != num_patterns*num_states)
+		throw XLikelihood("tip partials supplied to CPULikelihoodEngine have the wrong length");
+	partials[tip] = tip_partials;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the number of sites having each pattern.
+*/
+void CPULikelihoodEngine::setPatternWeights(
+  const std::vector<double> & weights)	/**< is the weight of each pattern */
+	{
+	if (weights.size() != num_patterns)
+		throw XLikelihood("pattern weights supplied to CPULikelihoodEngine have the wrong length");
+	pattern_weights = weights;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the equilibrium state frequencies used at the root of the calculation.
+*/
+void CPULikelihoodEngine::setStateFrequencies(
+  const double * freqs)	/**< is an array of `num_states' frequencies */
+	{
+	state_freqs.assign(freqs, freqs + num_states);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the probability of each rate category.
+*/
+void CPULikelihoodEngine::setCategoryWeights(
+  const std::vector<double> & weights)	/**< is the probability of each category */
+	{
+	if (weights.size() != num_categories)
+		throw XLikelihood("category weights supplied to CPULikelihoodEngine have the wrong length");
+	category_weights = weights;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Copies the transition matrices `pmats' (pmats[c][i][j] is the probability of ending in state j given a start in
+|	state i for category c) to index `index'.
+*/
+void CPULikelihoodEngine::setTransitionMatrices(
+  unsigned index,						/**< is the index at which to store the matrices */
+  const double * const * const * pmats)	/**< is the set of `num_categories' matrices */
+	{
+	checkMatrices(index);
+	double * dest = &matrices[index][0];
+	for (unsigned c = 0; c < num_categories; ++c)
+		{
+		for (unsigned i = 0; i < num_states; ++i)
+			{
+			std::copy(pmats[c][i], pmats[c][i] + num_states, dest);
+			dest += num_states;
+			}
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Performs the operations in `ops' in order. The blocks of patterns of each operation are divided among the threads of
+|	the pool (if there is one), but every block of an operation is finished before the next operation begins because
+|	later operations may read the buffers written by earlier ones.
+*/
+void CPULikelihoodEngine::updatePartials(
+  const LikelihoodEngineOperationVect & ops)	/**< is the list of operations to perform */
+	{
+	const unsigned nblocks = getNumBlocks();
+	for (LikelihoodEngineOperationVect::const_iterator it = ops.begin(); it != ops.end(); ++it)
+		{
+		if (isTip(it->destination))
+			throw XLikelihood("tip buffers cannot be the destination of a likelihood engine operation");
+		checkBuffer(it->destination);
+		checkBuffer(it->child1);
+		checkBuffer(it->child2);
+		checkMatrices(it->child1_pmat);
+		checkMatrices(it->child2_pmat);
+		if (thread_pool && nblocks > 1)
+			thread_pool->run(nblocks, boost::bind(&CPULikelihoodEngine::updateBlockTask, this, &(*it), _1, _2));
+		else
+			updateBlock(*it, 0, num_patterns);
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the log-likelihood obtained by joining the partials in buffer `parent' and those in buffer `child' across
+|	the edge whose transition matrices are stored at index `child_pmat', weighting each pattern by its count. If
+|	`site_lnL' is not NULL, the log-likelihood of each pattern (unweighted) is stored in site_lnL[0..num_patterns-1].
+*/
+double CPULikelihoodEngine::calcEdgeLogLikelihood(
+  unsigned parent,		/**< is the index of the parent partials buffer */
+  unsigned child,		/**< is the index of the child partials buffer */
+  unsigned child_pmat,	/**< is the index of the transition matrices for the edge joining them */
+  double * site_lnL)	/**< is an array in which to store site log-likelihoods, or NULL */
+	{
+	checkBuffer(parent);
+	checkBuffer(child);
+	checkMatrices(child_pmat);
+	EdgeCall call;
+	call.parent		= parent;
+	call.child		= child;
+	call.child_pmat	= child_pmat;
+	call.site_lnL	= site_lnL;
+
+	const unsigned nblocks = getNumBlocks();
+	block_lnL.assign(nblocks, 0.0);
+	if (thread_pool && nblocks > 1)
+		thread_pool->run(nblocks, boost::bind(&CPULikelihoodEngine::edgeBlockTask, this, &call, _1, _2));
+	else
+		{
+		for (unsigned b = 0; b < nblocks; ++b)
+			edgeBlockTask(&call, b, 0);
+		}
+
+	double lnL = 0.0;
+	for (unsigned b = 0; b < nblocks; ++b)
+		lnL += block_lnL[b];
+	return lnL;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if `buffer' is one of the tip buffers.
+*/
+bool CPULikelihoodEngine::isTip(
+  unsigned buffer) const	/**< is the index of a partials buffer */
+	{
+	return (buffer < num_tips);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns a pointer to the `num_states' partials for `pattern' and `category' in `buffer'. Tips have the same partials
+|	for every category.
+*/
+const double * CPULikelihoodEngine::getPartials(
+  unsigned buffer,		/**< is the index of the partials buffer */
+  unsigned category,	/**< is the rate category */
+  unsigned pattern) const	/**< is the pattern */
+	{
+	if (isTip(buffer))
+		return &partials[buffer][pattern*num_states];
+	return &partials[buffer][(category*num_patterns + pattern)*num_states];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Throws XLikelihood if `buffer' is not the index of a partials buffer.
+*/
+void CPULikelihoodEngine::checkBuffer(
+  unsigned buffer) const	/**< is the index to check */
+	{
+	if (buffer >= num_buffers)
+		throw XLikelihood(boost::str(boost::format("partials buffer %d does not exist (CPULikelihoodEngine has %d)") % buffer % num_buffers));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Throws XLikelihood if `index' is not the index of a set of transition matrices.
+*/
+void CPULikelihoodEngine::checkMatrices(
+  unsigned index) const	/**< is the index to check */
+	{
+	if (index >= num_matrices)
+		throw XLikelihood(boost::str(boost::format("transition matrix %d does not exist (CPULikelihoodEngine has %d)") % index % num_matrices));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of blocks of `block_size' patterns needed to cover all patterns.
+*/
+unsigned CPULikelihoodEngine::getNumBlocks() const
+	{
+	return (num_patterns + block_size - 1)/block_size;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Performs block number `block' of operation `op'. Called by updatePartials, possibly from a worker thread.
+*/
+void CPULikelihoodEngine::updateBlockTask(
+  const LikelihoodEngineOperation * op,	/**< is the operation being performed */
+  unsigned block,						/**< is the index of the block of patterns */
+  unsigned)								/**< is the index of the thread (unused) */
+	{
+	const unsigned first = block*block_size;
+	updateBlock(*op, first, std::min(first + block_size, num_patterns));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the partials of `op.destination' for patterns `first' up to, but not including, `last', then rescales each
+|	pattern whose largest value has fallen below 2^-CLAKernels::getScalingTrigger(). Modifies nothing outside these
+|	patterns, so may be called concurrently for disjoint ranges of patterns.
+*/
+void CPULikelihoodEngine::updateBlock(
+  const LikelihoodEngineOperation & op,	/**< is the operation being performed */
+  unsigned first,						/**< is the index of the first pattern */
+  unsigned last)						/**< is one more than the index of the last pattern */
+	{
+	const unsigned ns = num_states;
+	const unsigned nc = num_categories;
+	const int trigger = CLAKernels::getScalingTrigger();
+	const double * P1 = &matrices[op.child1_pmat][0];
+	const double * P2 = &matrices[op.child2_pmat][0];
+	double * dest = &partials[op.destination][0];
+	for (unsigned pat = first; pat < last; ++pat)
+		{
+		double maxval = 0.0;
+		for (unsigned c = 0; c < nc; ++c)
+			{
+			const double * L1 = getPartials(op.child1, c, pat);
+			const double * L2 = getPartials(op.child2, c, pat);
+			const double * P1c = P1 + c*ns*ns;
+			const double * P2c = P2 + c*ns*ns;
+			double * D = dest + (c*num_patterns + pat)*ns;
+			for (unsigned i = 0; i < ns; ++i)
+				{
+				double s1 = 0.0;
+				double s2 = 0.0;
+				for (unsigned j = 0; j < ns; ++j)
+					{
+					s1 += P1c[i*ns + j]*L1[j];
+					s2 += P2c[i*ns + j]*L2[j];
+					}
+				D[i] = s1*s2;
+				if (D[i] > maxval)
+					maxval = D[i];
+				}
+			}
+
+		int k = (isTip(op.child1) ? 0 : scalers[op.child1][pat]) + (isTip(op.child2) ? 0 : scalers[op.child2][pat]);
+		int e = 0;
+		std::frexp(maxval, &e);
+		if (maxval > 0.0 && e < -trigger)
+			{
+			const double factor = std::ldexp(1.0, -e);
+			for (unsigned c = 0; c < nc; ++c)
+				{
+				double * D = dest + (c*num_patterns + pat)*ns;
+				for (unsigned i = 0; i < ns; ++i)
+					D[i] *= factor;
+				}
+			k += e;
+			}
+		scalers[op.destination][pat] = k;
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the log-likelihood of block number `block' for `call', storing it in `block_lnL'[`block']. Called by
+|	calcEdgeLogLikelihood, possibly from a worker thread.
+*/
+void CPULikelihoodEngine::edgeBlockTask(
+  const EdgeCall * call,	/**< describes the calculation */
+  unsigned block,			/**< is the index of the block of patterns */
+  unsigned)					/**< is the index of the thread (unused) */
+	{
+	const unsigned first = block*block_size;
+	block_lnL[block] = edgeBlock(*call, first, std::min(first + block_size, num_patterns));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the sum, over patterns `first' up to but not including `last', of the pattern weight times the site
+|	log-likelihood, storing each site log-likelihood in `call.site_lnL' if it is not NULL.
+*/
+double CPULikelihoodEngine::edgeBlock(
+  const EdgeCall & call,	/**< describes the calculation */
+  unsigned first,			/**< is the index of the first pattern */
+  unsigned last)			/**< is one more than the index of the last pattern */
+	{
+	const unsigned ns = num_states;
+	const unsigned nc = num_categories;
+	const double log2 = std::log(2.0);
+	const double * P = &matrices[call.child_pmat][0];
+	double lnL = 0.0;
+	for (unsigned pat = first; pat < last; ++pat)
+		{
+		double site_like = 0.0;
+		for (unsigned c = 0; c < nc; ++c)
+			{
+			const double * Lp = getPartials(call.parent, c, pat);
+			const double * Lc = getPartials(call.child, c, pat);
+			const double * Pc = P + c*ns*ns;
+			double cat_like = 0.0;
+			for (unsigned i = 0; i < ns; ++i)
+				{
+				double s = 0.0;
+				for (unsigned j = 0; j < ns; ++j)
+					s += Pc[i*ns + j]*Lc[j];
+				cat_like += state_freqs[i]*Lp[i]*s;
+				}
+			site_like += category_weights[c]*cat_like;
+			}
+		const int k = (isTip(call.parent) ? 0 : scalers[call.parent][pat]) + (isTip(call.child) ? 0 : scalers[call.child][pat]);
+		const double site_lnL = std::log(site_like) + log2*(double)k;
+		if (call.site_lnL != NULL)
+			call.site_lnL[pat] = site_lnL;
+		lnL += pattern_weights[pat]*site_lnL;
+		}
+	return lnL;
+	}
+
+} // namespace phycas
@@ -0,0 +1,157 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(LIKELIHOOD_ENGINE_HPP)
+#define LIKELIHOOD_ENGINE_HPP
+
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace phycas
+{
+
+class ThreadPool;
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	One step of a postorder traversal: the partials in buffer `destination' are computed from the partials in buffers
+|	`child1' and `child2', each carried across the edge whose transition matrices are stored at the given index. The
+|	scale factors of `destination' are those of the two children plus any introduced while computing `destination'.
+*/
+struct LikelihoodEngineOperation
+	{
+	LikelihoodEngineOperation(unsigned dest, unsigned c1, unsigned c1_pmat, unsigned c2, unsigned c2_pmat)
+	  : destination(dest), child1(c1), child1_pmat(c1_pmat), child2(c2), child2_pmat(c2_pmat) {}
+
+	unsigned	destination;	/**< is the index of the partials buffer to compute */
+	unsigned	child1;			/**< is the index of the partials buffer of the first child */
+	unsigned	child1_pmat;	/**< is the index of the transition matrices for the edge leading to the first child */
+	unsigned	child2;			/**< is the index of the partials buffer of the second child */
+	unsigned	child2_pmat;	/**< is the index of the transition matrices for the edge leading to the second child */
+	};
+
+typedef std::vector<LikelihoodEngineOperation> LikelihoodEngineOperationVect;
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Abstract interface to the arithmetic of a Felsenstein pruning calculation for one partition subset, modelled on the
+|	BEAGLE library API so that BEAGLE itself can serve as one implementation. An engine knows nothing about trees or
+|	models: TreeLikelihood refers to everything by index (partials buffers, whose first `ntips' entries hold the tip
+|	data, and sets of transition matrices, one matrix per category), computes the transition matrices itself and hands
+|	the engine a list of operations built from the tree. Rate heterogeneity is expressed entirely through the category
+|	weights and the per-category transition matrices, so invariable sites are just a category whose matrices are the
+|	identity. Partials are stored category by category, and within a category pattern by pattern. Engines throw
+|	XLikelihood if something goes wrong. Use createLikelihoodEngine to obtain an engine by name.
+*/
+class LikelihoodEngine : boost::noncopyable
+	{
+	public:
+
+		virtual						~LikelihoodEngine() {}
+
+		virtual std::string			getName() const = 0;
+
+		virtual void				createInstance(unsigned ntips, unsigned nbuffers, unsigned nmatrices, unsigned nstates, unsigned npatterns, unsigned ncategories) = 0;
+		virtual void				setThreadPool(ThreadPool * pool);
+
+		virtual void				setTipPartials(unsigned tip, const std::vector<double> & tip_partials) = 0;
+		virtual void				setPatternWeights(const std::vector<double> & weights) = 0;
+		virtual void				setStateFrequencies(const double * freqs) = 0;
+		virtual void				setCategoryWeights(const std::vector<double> & weights) = 0;
+		virtual void				setTransitionMatrices(unsigned index, const double * const * const * pmats) = 0;
+
+		virtual void				updatePartials(const LikelihoodEngineOperationVect & ops) = 0;
+		virtual double				calcEdgeLogLikelihood(unsigned parent, unsigned child, unsigned child_pmat, double * site_lnL) = 0;
+	};
+
+typedef boost::shared_ptr<LikelihoodEngine> LikelihoodEngineShPtr;
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	The native implementation of LikelihoodEngine. Partials are held in double precision; patterns are divided into
+|	blocks of CLAKernels::calcBlockSize patterns, which are processed concurrently if a ThreadPool has been supplied,
+|	and block log-likelihoods are added in block order so that results do not depend on the number of threads. Each
+|	pattern of each computed buffer is rescaled by a power of two whenever its largest value becomes small enough to
+|	risk underflow (the same rule the CLA kernels use), so no precision is lost to scaling.
+*/
+class CPULikelihoodEngine : public LikelihoodEngine
+	{
+	public:
+
+									CPULikelihoodEngine();
+
+		virtual std::string			getName() const;
+
+		virtual void				createInstance(unsigned ntips, unsigned nbuffers, unsigned nmatrices, unsigned nstates, unsigned npatterns, unsigned ncategories);
+		virtual void				setThreadPool(ThreadPool * pool);
+
+		virtual void				setTipPartials(unsigned tip, const std::vector<double> & tip_partials);
+		virtual void				setPatternWeights(const std::vector<double> & weights);
+		virtual void				setStateFrequencies(const double * freqs);
+		virtual void				setCategoryWeights(const std::vector<double> & weights);
+		virtual void				setTransitionMatrices(unsigned index, const double * const * const * pmats);
+
+		virtual void				updatePartials(const LikelihoodEngineOperationVect & ops);
+		virtual double				calcEdgeLogLikelihood(unsigned parent, unsigned child, unsigned child_pmat, double * site_lnL);
+
+	private:
+
+		/*--------------------------------------------------------------------------------------------------------------
+		|	Describes a call to calcEdgeLogLikelihood to the tasks that handle its blocks of patterns.
+		*/
+		struct EdgeCall
+			{
+			unsigned				parent;		/**< is the index of the parent partials buffer */
+			unsigned				child;		/**< is the index of the child partials buffer */
+			unsigned				child_pmat;	/**< is the index of the transition matrices for the edge */
+			double *				site_lnL;	/**< is where site log-likelihoods are stored (may be NULL) */
+			};
+
+		bool						isTip(unsigned buffer) const;
+		const double *				getPartials(unsigned buffer, unsigned category, unsigned pattern) const;
+		void						checkBuffer(unsigned buffer) const;
+		void						checkMatrices(unsigned index) const;
+		unsigned					getNumBlocks() const;
+
+		void						updateBlockTask(const LikelihoodEngineOperation * op, unsigned block, unsigned thread);
+		void						updateBlock(const LikelihoodEngineOperation & op, unsigned first, unsigned last);
+		void						edgeBlockTask(const EdgeCall * call, unsigned block, unsigned thread);
+		double						edgeBlock(const EdgeCall & call, unsigned first, unsigned last);
+
+		unsigned					num_tips;			/**< The number of partials buffers holding tip data */
+		unsigned					num_buffers;		/**< The total number of partials buffers (including tips) */
+		unsigned					num_matrices;		/**< The number of sets of transition matrices */
+		unsigned					num_states;			/**< The number of states */
+		unsigned					num_patterns;		/**< The number of patterns */
+		unsigned					num_categories;		/**< The number of rate categories */
+		unsigned					block_size;			/**< The number of patterns handled by each task */
+		ThreadPool *				thread_pool;		/**< If not NULL, the pool used to process blocks of patterns concurrently */
+		std::vector< std::vector<double> >	partials;	/**< partials[b] holds buffer b: num_patterns*num_states values for tips, num_categories*num_patterns*num_states otherwise */
+		std::vector< std::vector<int> >		scalers;	/**< scalers[b][p] is the base 2 logarithm of the factor by which partials[b] for pattern p must be multiplied to undo rescaling (empty for tips) */
+		std::vector< std::vector<double> >	matrices;	/**< matrices[m] holds the num_categories transition matrices stored at index m, each row-major with rows representing "from" states */
+		std::vector<double>			pattern_weights;	/**< The number of sites having each pattern */
+		std::vector<double>			state_freqs;		/**< The equilibrium state frequencies */
+		std::vector<double>			category_weights;	/**< The probability of each rate category */
+		std::vector<double>			block_lnL;			/**< Workspace holding the log-likelihood of each block of patterns */
+	};
+
+LikelihoodEngineShPtr createLikelihoodEngine(const std::string & name);
+
+} // namespace phycas
+
+#endif
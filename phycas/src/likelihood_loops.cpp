@@ -33,7 +33,10 @@
 #include "phycas/src/tip_data.hpp"
 #include "phycas/src/internal_data.hpp"
 #include "phycas/src/edge_endpoints.hpp"
+#include "phycas/src/cla_kernels.hpp"
+#include "phycas/src/thread_pool.hpp"
 #include <numeric>
+#include <boost/bind.hpp>
 
 //for XCode debugging:
 //#include <CoreServices/CoreServices.h>
@@ -92,6 +95,25 @@ namespace phycas
 	}
 #endif
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Fills the data member `scaled_edgelens' with the product of `edgeLength', the relative rate of subset `i' and the 
+|	mean of each relative rate category of subset `i', and returns a reference to it. These are the edge lengths 
+|	actually used to compute the transition matrices for subset `i'.
+*/
+const double_vect_t & TreeLikelihood::calcScaledEdgeLens(
+  unsigned		i,				/**< is the subset of the partition */
+  double		edgeLength)		/**< is the edge length */
+	{
+	unsigned nr = partition_model->subset_num_rates[i];
+	double subset_relrate = partition_model->getSubsetRelRate(i);
+	scaled_edgelens.resize(nr);
+	for (unsigned r = 0; r < nr; ++r)
+		{
+		scaled_edgelens[r] = subset_relrate*edgeLength*rate_means[i][r];
+		}
+	return scaled_edgelens;
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Calculates a transition matrix for every rate category given the supplied `edgeLength' and the subset indexed by `i'.
 |	This function calculates the basic square transition matrix in which rows represent "from" states and columns 
@@ -106,13 +128,9 @@ void TreeLikelihood::calcPMatCommon(
   double		edgeLength)		/**< is the edge length */
 	{
 	unsigned nr = partition_model->subset_num_rates[i];
-	double subset_relrate = partition_model->getSubsetRelRate(i);
 	PHYCAS_ASSERT(nr > 0);
-	vector<double> scaled_edges(nr);
-	for (unsigned r = 0; r < nr; ++r)
-		{
-		scaled_edges[r] = subset_relrate*edgeLength*rate_means[i][r];
-		}
+	const double_vect_t & scaled_edges = calcScaledEdgeLens(i, edgeLength);
+	PHYCAS_HOT_PATH_TIMER(pmat_timing);
     //std::cerr << boost::str(boost::format("calcPMatCommon: i = %d, subset rate = %g, edgelen = %g, scaled_edges = %g") % i % subset_relrate % edgeLength % scaled_edges[0]) << std::endl;
 		//std::cerr << "i = " << i << '\n';
 		//std::cerr << "nr = " << nr << '\n';
@@ -172,10 +190,23 @@ void TreeLikelihood::calcPMatTranspose(
   double * * * 			transPMats,			/**< is the transition matrix to be calculated */
   const StateListPos &	stateListPosVec, 	/**< holds the locations of each state in the state list */
   double				edgeLength)			/**< is the edge length */
+	{
+	calcPMatCommon(i, transPMats, edgeLength);
+	augmentPMatTranspose(i, transPMats, stateListPosVec);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Turns the transition matrices `transPMats' of subset `i' (one per rate category), just computed by calcPMatCommon 
+|	or in a batch by refreshPMatrixBatch, into T matrices by transposing them and adding a row for complete ambiguity
+|	and one for each partial ambiguity listed in `stateListPosVec'.
+*/
+void TreeLikelihood::augmentPMatTranspose(
+  unsigned				i,					/**< is the subset of the partition */
+  double * * * 			transPMats,			/**< is the array of transition matrices (one per rate category) to transpose and augment */
+  const StateListPos &	stateListPosVec) 	/**< holds the locations of each state in the state list */
 	{
 	unsigned nr = partition_model->subset_num_rates[i];
 	unsigned ns = partition_model->subset_num_states[i];
-	calcPMatCommon(i, transPMats, edgeLength);
 
 	// For each rate category, transpose the ns X ns portion of the matrices
 	// and fill in the ambiguity codes by summing columns
@@ -211,49 +242,177 @@ void TreeLikelihood::calcPMatTranspose(
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Computes the conditional likelihood arrays at an internal node subtending two tips.
+|	Brings the transposed, augmented transition matrices of subset `i' stored in `tipData' up to date for an edge of 
+|	length `edgeLength', calling calcPMatTranspose only if the model, its time stamp, or the scaled edge lengths differ 
+|	from those used the last time the matrices were computed (see PMatrixStamp).
+*/
+void TreeLikelihood::refreshPMatTranspose(
+  unsigned				i,					/**< is the subset of the partition */
+  const TipData &		tipData,			/**< is the tip whose matrices are needed */
+  double				edgeLength)			/**< is the edge length */
+	{
+	ModelShPtr model = partition_model->subset_model[i];
+	PMatrixStamp & stamp = tipData.pMatrixStamps[i];
+	const double_vect_t & scaled = calcScaledEdgeLens(i, edgeLength);
+	if (pmat_caching && !using_unimap && stamp.matches(model.get(), model->getTimeStamp(), scaled))
+		{
+		++pmat_cache_hits;
+		return;
+		}
+	++pmat_cache_misses;
+	stamp.set(model, model->getTimeStamp(), scaled);
+	calcPMatTranspose(i, tipData.pMatrixTranspose[i].ptr, tipData.getConstStateListPos(i), edgeLength);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Brings the transition matrices of subset `i' stored in `internalData' up to date for an edge of length 
+|	`edgeLength', calling calcPMat only if the model, its time stamp, or the scaled edge lengths differ from those used 
+|	the last time the matrices were computed (see PMatrixStamp).
+*/
+void TreeLikelihood::refreshPMat(
+  unsigned				i,					/**< is the subset of the partition */
+  const InternalData &	internalData,		/**< is the internal node whose matrices are needed */
+  double				edgeLength)			/**< is the edge length */
+	{
+	ModelShPtr model = partition_model->subset_model[i];
+	PMatrixStamp & stamp = internalData.pMatrixStamps[i];
+	const double_vect_t & scaled = calcScaledEdgeLens(i, edgeLength);
+	if (pmat_caching && !using_unimap && stamp.matches(model.get(), model->getTimeStamp(), scaled))
+		{
+		++pmat_cache_hits;
+		return;
+		}
+	++pmat_cache_misses;
+	stamp.set(model, model->getTimeStamp(), scaled);
+	calcPMat(i, internalData.pMatrices[i].ptr, edgeLength);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Brings up to date, in one batch per subset, every transition matrix that refreshCLA will need when it is called for
+|	each of the (node, avoid) pairs in `edges'. For each pair, refreshCLA uses the matrices stored in every neighbor of
+|	the node except `avoid', computed for the edge joining the neighbor to the node. Matrices whose PMatrixStamp shows
+|	them to be current are skipped; the rest (all edges and rate categories) are passed to the subset model's 
+|	calcPMatrices in a single call, after which tip matrices are transposed and augmented and stamps are updated, so 
+|	the calls made by refreshCLA find every matrix current. Matrices computed here are counted as cache misses, and
+|	again as hits when refreshCLA finds them current. Does nothing if caching is disabled or unimap is in use, because
+|	refreshPMat and refreshPMatTranspose then always recompute.
+*/
+void TreeLikelihood::refreshPMatrixBatch(
+  const std::vector<EdgeEndpoints> & edges)		/**< holds the (node, avoid) pairs that will be passed to refreshCLA */
+	{
+	if (!pmat_caching || using_unimap || edges.empty())
+		return;
+
+	std::vector<double * *> batch_pmats;
+	double_vect_t batch_edgelens;
+	std::vector<const TipData *> batch_tips;
+	std::vector<TreeNode *> neighbors;
+	unsigned num_subsets = partition_model->getNumSubsets();
+	for (unsigned i = 0; i < num_subsets; ++i)
+		{
+		ModelShPtr model = partition_model->subset_model[i];
+		const unsigned time_stamp = model->getTimeStamp();
+		const unsigned nr = partition_model->subset_num_rates[i];
+		batch_pmats.clear();
+		batch_edgelens.clear();
+		batch_tips.clear();
+		for (std::vector<EdgeEndpoints>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+			{
+			TreeNode * nd = it->first;
+			const TreeNode * avoid = it->second;
+			
+			// List the neighbors of nd other than avoid
+			neighbors.clear();
+			if (nd->GetParent() != NULL && nd->GetParent() != avoid)
+				neighbors.push_back(nd->GetParent());
+			for (TreeNode * child = nd->GetLeftChild(); child != NULL; child = child->GetRightSib())
+				{
+				if (child != avoid)
+					neighbors.push_back(child);
+				}
+				
+			for (std::vector<TreeNode *>::const_iterator nit = neighbors.begin(); nit != neighbors.end(); ++nit)
+				{
+				TreeNode * neighbor = *nit;
+				const double edgeLength = (neighbor == nd->GetParent() ? nd->GetEdgeLen() : neighbor->GetEdgeLen());
+				const double_vect_t & scaled = calcScaledEdgeLens(i, edgeLength);
+				double * * * p = NULL;
+				if (neighbor->IsTip())
+					{
+					const TipData * td = neighbor->GetTipData();
+					PMatrixStamp & stamp = td->pMatrixStamps[i];
+					if (stamp.matches(model.get(), time_stamp, scaled))
+						continue;
+					stamp.set(model, time_stamp, scaled);
+					p = td->pMatrixTranspose[i].ptr;
+					batch_tips.push_back(td);
+					}
+				else
+					{
+					const InternalData * id = neighbor->GetInternalData();
+					PMatrixStamp & stamp = id->pMatrixStamps[i];
+					if (stamp.matches(model.get(), time_stamp, scaled))
+						continue;
+					stamp.set(model, time_stamp, scaled);
+					p = id->pMatrices[i].ptr;
+					}
+				++pmat_cache_misses;
+				for (unsigned r = 0; r < nr; ++r)
+					{
+					batch_pmats.push_back(p[r]);
+					batch_edgelens.push_back(scaled[r]);
+					}
+				}
+			}
+
+		if (batch_pmats.empty())
+			continue;
+		PHYCAS_HOT_PATH_TIMER_N(pmat_timing, (unsigned)batch_pmats.size()/nr);
+		model->calcPMatrices(&batch_pmats[0], &batch_edgelens[0], (unsigned)batch_pmats.size());
+		for (std::vector<const TipData *>::const_iterator tit = batch_tips.begin(); tit != batch_tips.end(); ++tit)
+			augmentPMatTranspose(i, (*tit)->pMatrixTranspose[i].ptr, (*tit)->getConstStateListPos(i));
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the conditional likelihood arrays at an internal node subtending two tips. This and the other calcCLA 
+|	functions loop over subsets; the loops over rates, patterns and states (and the rescaling requested by 
+|	`underflow_manager') are done by the data member `cla_kernels', which uses SSE2, AVX2 or AVX-512 instructions if
+|	the processor supports them and divides each subset into blocks of patterns shared among threads.
 */
 void TreeLikelihood::calcCLATwoTips(
   CondLikelihood & 		condLike,
   const TipData &		leftTip, 
   const TipData &		rightTip)
 	{
+	PHYCAS_HOT_PATH_TIMER(cla_timing);
+
     // cla is the conditional likelihood array we are updating
     LikeFltType * cla = condLike.getCLA();
+	UnderflowType * uf = condLike.getUF();
+#if defined(DO_UNDERFLOW_POLICY)
+	const CLAKernels::Rescaling rescaling = underflow_manager.twoTips(condLike);
+#else
+	const CLAKernels::Rescaling rescaling = CLAKernels::kNoRescaling;
+#endif
+	const double correct_to = underflow_manager.getUnderflowMaxValue();
 	
     unsigned num_subsets = partition_model->getNumSubsets();
     for (unsigned i = 0; i < num_subsets; ++i)
         {
-        const double * const * const * leftPMatricesTrans = leftTip.getConstTransposedPMatrices(i);
-        const int8_t * leftStateCodes = leftTip.getConstStateCodes(i);
-        const double * const * const * rightPMatricesTrans = rightTip.getConstTransposedPMatrices(i);
-        const int8_t * rightStateCodes = rightTip.getConstStateCodes(i);
-        unsigned num_patterns = partition_model->subset_num_patterns[i];
-        unsigned num_states = partition_model->subset_num_states[i];
-        unsigned num_rates = partition_model->subset_num_rates[i];
-        for (unsigned r = 0; r < num_rates; ++r)
+        const CLASubsetLayout & layout = cla_layout[i];
+        if (isRefreshingSubset(i))
             {
-            const double * const * leftPMatT = leftPMatricesTrans[r];
-            const double * const * const rightPMatT = rightPMatricesTrans[r];
-            for (unsigned p = 0; p < num_patterns; ++p, cla += num_states)
-                {
-                const double * leftPMatTRow = leftPMatT[leftStateCodes[p]];
-                const double * rightPMatTRow = rightPMatT[rightStateCodes[p]];
-                for (unsigned s = 0; s < num_states; ++s)
-                    {
-                    double leftprob = leftPMatTRow[s];
-                    double rightprob = rightPMatTRow[s];
-                    cla[s] = leftprob*rightprob;
-                        
-                    //@POLTEMP
-                    //std::cerr << boost::str(boost::format("subset=%d, rate=%d, pattern=%d, state=%d, left=%g, right=%g, cla=%g") % i % r % p % s % leftprob % rightprob % cla[s]) << std::endl;
-                    }
-                }
+            // Otherwise only subset cla_subset is being recomputed (see TreeLikelihood::refreshChangedSubsetCLAs)
+            const double * const * const * leftPMatricesTrans = leftTip.getConstTransposedPMatrices(i);
+            const int8_t * leftStateCodes = leftTip.getConstStateCodes(i);
+            const double * const * const * rightPMatricesTrans = rightTip.getConstTransposedPMatrices(i);
+            const int8_t * rightStateCodes = rightTip.getConstStateCodes(i);
+            cla_kernels.twoTips(layout, leftPMatricesTrans, leftStateCodes, rightPMatricesTrans, rightStateCodes, cla, uf, rescaling, correct_to);
             }
+        cla += layout.length;
+        uf += layout.np;
         }
-#if defined(DO_UNDERFLOW_POLICY)
-	underflow_manager.twoTips(condLike);
-#endif
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -266,110 +425,53 @@ void TreeLikelihood::calcCLAOneTip(
   const InternalData &		rightChild,
   const CondLikelihood &	rightCondLike)
 	{
+	PHYCAS_HOT_PATH_TIMER(cla_timing);
+
     // cla is the conditional likelihood array we are updating
     LikeFltType * cla = condLike.getCLA();
 
     // rightCLA is the conditional likelihood array of the internal child node 
-    const double * rightCLA = rightCondLike.getCLA();
+    const LikeFltType * rightCLA = rightCondLike.getCLA();
+
+	UnderflowType * uf = condLike.getUF();
+	const UnderflowType * rightUF = rightCondLike.getUF();
+#if defined(DO_UNDERFLOW_POLICY)
+	const CLAKernels::Rescaling rescaling = underflow_manager.check(condLike, rightCondLike, rightCondLike, false);	// last argument is polytomy 
+#else
+	const CLAKernels::Rescaling rescaling = CLAKernels::kNoRescaling;
+#endif
+	const double correct_to = underflow_manager.getUnderflowMaxValue();
     
     unsigned num_subsets = partition_model->getNumSubsets();
     for (unsigned i = 0; i < num_subsets; ++i)
         {
-        unsigned num_patterns = partition_model->subset_num_patterns[i];
-        unsigned num_states = partition_model->subset_num_states[i];
-        unsigned num_rates = partition_model->subset_num_rates[i];
-
-        // Get transition probability matrices for the left and right child nodes of this node
-        // These are 3D because there are potentially several 2D transition matrices, one
-        // for each relative rate
-        ConstPMatrices leftPMatricesTrans = leftChild.getConstTransposedPMatrices(i);
-        ConstPMatrices rightPMatrices = rightChild.getConstPMatrices(i);
-    
-        // Get the state codes for the tip child
-        const int8_t * leftStateCodes = leftChild.getConstStateCodes(i);
-        
-        // conditional likelihood arrays are laid out as follows for DNA data:
-        //
-        // +---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
-        // |   pattern 1   |               |               |               |               |
-        // +---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
-        // | A | C | G | T | A | C | G | T | A | C | G | T | A | C | G | T | A | C | G | T |
-        // +---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
-        //
-        for (unsigned r = 0; r < num_rates; ++r)
+        const CLASubsetLayout & layout = cla_layout[i];
+        if (isRefreshingSubset(i))
             {
-            const double * const * const leftPMatrixT = leftPMatricesTrans[r];
-            const double * const * rightPMatrix = rightPMatrices[r];
-            if (num_states == 4)
-                {
-                //POL 16-June-2006 Unrolling the nested loops across states here as well as in TreeLikelihood::calcCLANoTips
-                // resulted in a 26.6% speedup on Windows using green.nex and SVN version 97
-                for (unsigned pat = 0; pat < num_patterns; ++pat)
-                    {
-                    const double * leftPMatT_pat = leftPMatrixT[leftStateCodes[pat]];
-                    double rightCLA0 = *rightCLA++;
-                    double rightCLA1 = *rightCLA++;
-                    double rightCLA2 = *rightCLA++;
-                    double rightCLA3 = *rightCLA++;
-    
-                    // *** from state 0
-                    const double * rightP_i = rightPMatrix[0];
-                    double right0 = (*rightP_i++)*rightCLA0;
-                    double right1 = (*rightP_i++)*rightCLA1;
-                    double right2 = (*rightP_i++)*rightCLA2;
-                    double right3 = (*rightP_i++)*rightCLA3;
-                    double right_side = right0 + right1 + right2 + right3;
-                    *cla++ = ((*leftPMatT_pat++)*right_side);
-    
-                    // *** from state 1
-                    rightP_i = rightPMatrix[1];
-                    right0 = (*rightP_i++)*rightCLA0;
-                    right1 = (*rightP_i++)*rightCLA1;
-                    right2 = (*rightP_i++)*rightCLA2;
-                    right3 = (*rightP_i++)*rightCLA3;
-                    right_side = right0 + right1 + right2 + right3;
-                    *cla++ = ((*leftPMatT_pat++)*right_side);
-    
-                    // *** from state 2
-                    rightP_i = rightPMatrix[2];
-                    right0 = (*rightP_i++)*rightCLA0;
-                    right1 = (*rightP_i++)*rightCLA1;
-                    right2 = (*rightP_i++)*rightCLA2;
-                    right3 = (*rightP_i++)*rightCLA3;
-                    right_side = right0 + right1 + right2 + right3;
-                    *cla++ = ((*leftPMatT_pat++)*right_side);
-    
-                    // *** from state 3
-                    rightP_i = rightPMatrix[3];
-                    right0 = (*rightP_i++)*rightCLA0;
-                    right1 = (*rightP_i++)*rightCLA1;
-                    right2 = (*rightP_i++)*rightCLA2;
-                    right3 = (*rightP_i++)*rightCLA3;
-                    right_side = right0 + right1 + right2 + right3;
-                    *cla++ = ((*leftPMatT_pat++)*right_side);
-                    }
-                }
-            else	// num_states not 4
-                {
-                for (unsigned pat = 0; pat < num_patterns; ++pat, rightCLA += num_states)
-                    {
-                    const double * leftPMatT_pat = leftPMatrixT[leftStateCodes[pat]];
-                    for (unsigned i = 0; i < num_states; ++i)
-                        {
-                        double right_side = 0.0;
-                        const double * rightP_i = rightPMatrix[i];
-                        for (unsigned j = 0; j < num_states; ++j)
-                            right_side += rightP_i[j]*rightCLA[j];
-                        *cla++ = (leftPMatT_pat[i]*right_side);
-                        }
-                    }
-                }
-            } // loop over rates
-        } // loop over subsets of partition
+            // Get transition probability matrices for the left and right child nodes of this node
+            // These are 3D because there are potentially several 2D transition matrices, one
+            // for each relative rate
+            ConstPMatrices leftPMatricesTrans = leftChild.getConstTransposedPMatrices(i);
+            ConstPMatrices rightPMatrices = rightChild.getConstPMatrices(i);
+        
+            // Get the state codes for the tip child
+            const int8_t * leftStateCodes = leftChild.getConstStateCodes(i);
 
-#if defined(DO_UNDERFLOW_POLICY)
-	underflow_manager.check(condLike, rightCondLike, rightCondLike, pattern_counts, false);	// last argument is polytomy 
-#endif
+            // conditional likelihood arrays are laid out as follows for DNA data:
+            //
+            // +---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
+            // |   pattern 1   |               |               |               |               |
+            // +---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
+            // | A | C | G | T | A | C | G | T | A | C | G | T | A | C | G | T | A | C | G | T |
+            // +---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
+            //
+            cla_kernels.oneTip(layout, leftPMatricesTrans, leftStateCodes, rightPMatrices, rightCLA, rightUF, cla, uf, rescaling, correct_to);
+            }
+        cla += layout.length;
+        rightCLA += layout.length;
+        uf += layout.np;
+        rightUF += layout.np;
+        } // loop over subsets of partition
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -382,6 +484,8 @@ void TreeLikelihood::calcCLANoTips(
   const InternalData &		rightChild,
   const CondLikelihood &	rightCondLike)
 	{
+	PHYCAS_HOT_PATH_TIMER(cla_timing);
+
     // cla is the conditional likelihood array we are updating
     LikeFltType * cla = condLike.getCLA();
 
@@ -389,171 +493,51 @@ void TreeLikelihood::calcCLANoTips(
     const LikeFltType * leftCLA  = leftCondLike.getCLA();
     const LikeFltType * rightCLA = rightCondLike.getCLA();
 
+	UnderflowType * uf = condLike.getUF();
+	const UnderflowType * leftUF  = leftCondLike.getUF();
+	const UnderflowType * rightUF = rightCondLike.getUF();
+#if defined(DO_UNDERFLOW_POLICY)
+	const CLAKernels::Rescaling rescaling = underflow_manager.check(condLike, leftCondLike, rightCondLike, false);	// last argument is polytomy
+#else
+	const CLAKernels::Rescaling rescaling = CLAKernels::kNoRescaling;
+#endif
+	const double correct_to = underflow_manager.getUnderflowMaxValue();
+
     unsigned num_subsets = partition_model->getNumSubsets();
     for (unsigned i = 0; i < num_subsets; ++i)
         {
-        unsigned num_patterns = partition_model->subset_num_patterns[i];
-        unsigned num_states = partition_model->subset_num_states[i];
-        unsigned num_rates = partition_model->subset_num_rates[i];
-
-        ConstPMatrices leftPMatrices = leftChild.getConstPMatrices(i);
-        ConstPMatrices rightPMatrices = rightChild.getConstPMatrices(i);
-
-        // This function updates the conditional likelihood array of a node assuming that the
-        // conditional likelihood arrays of its left and right children have already been 
-        // updated
-    
-        // conditional likelihood arrays are laid out as follows for DNA data:
-        //
-        // +---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
-        // |                            rate 1                             | ...
-        // +---+---+---+---+---+---+---+---+---------------+---+---+---+---+
-        // |   pattern 1   |   pattern 2   |      ...      |   pattern n   | ...
-        // +---+---+---+---+---+---+---+---+---------------+---+---+---+---+
-        // | A | C | G | T | A | C | G | T |      ...      | A | C | G | T | ...
-        // +---+---+---+---+---+---+---+---+---------------+---+---+---+---+
-        //
-        for (unsigned r = 0; r < num_rates; ++r)
+        const CLASubsetLayout & layout = cla_layout[i];
+        if (isRefreshingSubset(i))
             {
-            double const * const * leftPMatrix  = leftPMatrices[r];
-            double const * const * rightPMatrix = rightPMatrices[r];
-            if (num_states == 4)
-                {
-                //POL 16-June-2006 Unrolling the nested loops across states here as well as in TreeLikelihood::calcCLAOneTip
-                // resulted in a 26.6% speedup on Windows using green.nex and SVN version 97
-                for (unsigned pat = 0; pat < num_patterns; ++pat)
-                    {
-                    double leftCLA0 = *leftCLA++;
-                    double leftCLA1 = *leftCLA++;
-                    double leftCLA2 = *leftCLA++;
-                    double leftCLA3 = *leftCLA++;
-                    double rightCLA0 = *rightCLA++;
-                    double rightCLA1 = *rightCLA++;
-                    double rightCLA2 = *rightCLA++;
-                    double rightCLA3 = *rightCLA++;
-    
-                    // *** from state 0 ***
-                    const double * leftP_i  = leftPMatrix[0];
-                    const double * rightP_i = rightPMatrix[0];
-    
-                    // to state 0
-                    double left0 = (*leftP_i++)*leftCLA0;
-                    double right0 = (*rightP_i++)*rightCLA0;
-    
-                    // to state 1
-                    double left1 = (*leftP_i++)*leftCLA1;
-                    double right1 = (*rightP_i++)*rightCLA1;
-    
-                    // to state 2
-                    double left2 = (*leftP_i++)*leftCLA2;
-                    double right2 = (*rightP_i++)*rightCLA2;
-    
-                    // to state 3
-                    double left3 = (*leftP_i++)*leftCLA3;
-                    double right3 = (*rightP_i++)*rightCLA3;
-    
-                    double left_side  = left0 + left1 + left2 + left3;
-                    double right_side = right0 + right1 + right2 + right3;
-                    *cla++ = (left_side*right_side);
-    
-                    // *** from state 1 ***
-                    leftP_i  = leftPMatrix[1];
-                    rightP_i = rightPMatrix[1];
-    
-                    // to state 0
-                    left0 = (*leftP_i++)*leftCLA0;
-                    right0 = (*rightP_i++)*rightCLA0;
-    
-                    // to state 1
-                    left1 = (*leftP_i++)*leftCLA1;
-                    right1 = (*rightP_i++)*rightCLA1;
-    
-                    // to state 2
-                    left2 = (*leftP_i++)*leftCLA2;
-                    right2 = (*rightP_i++)*rightCLA2;
-    
-                    // to state 3
-                    left3 = (*leftP_i++)*leftCLA3;
-                    right3 = (*rightP_i++)*rightCLA3;
-    
-                    left_side  = left0 + left1 + left2 + left3;
-                    right_side = right0 + right1 + right2 + right3;
-                    *cla++ = (left_side*right_side);
-    
-                    // *** from state 2 ***
-                    leftP_i  = leftPMatrix[2];
-                    rightP_i = rightPMatrix[2];
-    
-                    // to state 0
-                    left0 = (*leftP_i++)*leftCLA0;
-                    right0 = (*rightP_i++)*rightCLA0;
-    
-                    // to state 1
-                    left1 = (*leftP_i++)*leftCLA1;
-                    right1 = (*rightP_i++)*rightCLA1;
-    
-                    // to state 2
-                    left2 = (*leftP_i++)*leftCLA2;
-                    right2 = (*rightP_i++)*rightCLA2;
-    
-                    // to state 3
-                    left3 = (*leftP_i++)*leftCLA3;
-                    right3 = (*rightP_i++)*rightCLA3;
-    
-                    left_side  = left0 + left1 + left2 + left3;
-                    right_side = right0 + right1 + right2 + right3;
-                    *cla++ = (left_side*right_side);
-    
-                    // *** from state 3 ***
-                    leftP_i  = leftPMatrix[3];
-                    rightP_i = rightPMatrix[3];
-    
-                    // to state 0
-                    left0 = (*leftP_i++)*leftCLA0;
-                    right0 = (*rightP_i++)*rightCLA0;
-    
-                    // to state 1
-                    left1 = (*leftP_i++)*leftCLA1;
-                    right1 = (*rightP_i++)*rightCLA1;
-    
-                    // to state 2
-                    left2 = (*leftP_i++)*leftCLA2;
-                    right2 = (*rightP_i++)*rightCLA2;
-    
-                    // to state 3
-                    left3 = (*leftP_i++)*leftCLA3;
-                    right3 = (*rightP_i++)*rightCLA3;
-    
-                    left_side  = left0 + left1 + left2 + left3;
-                    right_side = right0 + right1 + right2 + right3;
-                    *cla++ = (left_side*right_side);
-                    }
-                }
-            else	// num_states != 4
-                {
-                for (unsigned pat = 0; pat < num_patterns; ++pat, leftCLA += num_states, rightCLA += num_states)
-                    {
-                    for (unsigned i = 0; i < num_states; ++i)
-                        {
-                        double left_side  = 0.0;
-                        double right_side = 0.0;
-                        const double * leftP_i  = leftPMatrix[i];
-                        const double * rightP_i = rightPMatrix[i];
-                        for (unsigned j = 0; j < num_states; ++j)
-                            {
-                            left_side  += (leftP_i[j]*leftCLA[j]);
-                            right_side += (rightP_i[j]*rightCLA[j]);
-                            }
-                        *cla++ = (left_side*right_side);
-                        }
-                    }
-                }
-            }	// loop over rates
-        } // loop across subsets of partition
+            ConstPMatrices leftPMatrices = leftChild.getConstPMatrices(i);
+            ConstPMatrices rightPMatrices = rightChild.getConstPMatrices(i);
 
-#if defined(DO_UNDERFLOW_POLICY)
-	underflow_manager.check(condLike, leftCondLike, rightCondLike, pattern_counts, false);	// last argument is polytomy
-#endif
+            // This function updates the conditional likelihood array of a node assuming that the
+            // conditional likelihood arrays of its left and right children have already been 
+            // updated
+        
+            // conditional likelihood arrays are laid out as follows for DNA data:
+            //
+            // +---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
+            // |                            rate 1                             | ...
+            // +---+---+---+---+---+---+---+---+---------------+---+---+---+---+
+            // |   pattern 1   |   pattern 2   |      ...      |   pattern n   | ...
+            // +---+---+---+---+---+---+---+---+---------------+---+---+---+---+
+            // | A | C | G | T | A | C | G | T |      ...      | A | C | G | T | ...
+            // +---+---+---+---+---+---+---+---+---------------+---+---+---+---+
+            //
+            // In the pattern-blocked layout, this picture applies to each block of patterns in turn 
+            // (see CLASubsetLayout), so the rates of a block are found layout.rate_stride elements apart
+            //
+            cla_kernels.noTips(layout, leftPMatrices, leftCLA, leftUF, rightPMatrices, rightCLA, rightUF, cla, uf, rescaling, correct_to);
+            }
+        cla += layout.length;
+        leftCLA += layout.length;
+        rightCLA += layout.length;
+        uf += layout.np;
+        leftUF += layout.np;
+        rightUF += layout.np;
+        } // loop across subsets of partition
 	}
 	
 /*----------------------------------------------------------------------------------------------------------------------
@@ -566,42 +550,31 @@ void TreeLikelihood::conditionOnAdditionalTip(
   CondLikelihood &	condLike,
   const TipData &	tipData)
 	{
+	PHYCAS_HOT_PATH_TIMER_N(cla_timing, 0);	// part of a conditional likelihood array already counted
+
 	LikeFltType * cla = condLike.getCLA();
+	UnderflowType * uf = condLike.getUF();
+#if defined(DO_UNDERFLOW_POLICY)
+	// Note: check() has 3 CondLikelihood & args, but we only need 1 of them, so provide condLike 3 times
+	const CLAKernels::Rescaling rescaling = underflow_manager.check(condLike, condLike, condLike, true);	// last argument is polytomy
+#else
+	const CLAKernels::Rescaling rescaling = CLAKernels::kNoRescaling;
+#endif
+	const double correct_to = underflow_manager.getUnderflowMaxValue();
 	
     unsigned num_subsets = partition_model->getNumSubsets();
     for (unsigned i = 0; i < num_subsets; ++i)
         {
-        unsigned num_patterns = partition_model->subset_num_patterns[i];
-        unsigned num_states = partition_model->subset_num_states[i];
-        unsigned num_rates = partition_model->subset_num_rates[i];
-
-        const double * const * const * tipPMatricesTrans = tipData.getConstTransposedPMatrices(i);
-        const int8_t * tipStateCodes = tipData.getConstStateCodes(i);
-        
-        //	+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
-        //	|                            rate 1                             | ...
-        //	+---+---+---+---+---+---+---+---+---------------+---+---+---+---+
-        //	|   pattern 1   |   pattern 2   |      ...      |   pattern n   | ...
-        //	+---+---+---+---+---+---+---+---+---------------+---+---+---+---+
-        //	| A | C | G | T | A | C | G | T |      ...      | A | C | G | T | ...
-        //	+---+---+---+---+---+---+---+---+---------------+---+---+---+---+
-        for (unsigned r = 0; r < num_rates; ++r)
+        const CLASubsetLayout & layout = cla_layout[i];
+        if (isRefreshingSubset(i))
             {
-            const double * const * const tipPMatrixT = tipPMatricesTrans[r];
-            for (unsigned pat = 0; pat < num_patterns; ++pat)
-                {
-                const double * tipPMatT_pat = tipPMatrixT[tipStateCodes[pat]];
-                for (unsigned i = 0; i < num_states; ++i)
-                    *cla++ *= tipPMatT_pat[i];
-                }   // loop across patterns
-            }   // loop across rates
+            const double * const * const * tipPMatricesTrans = tipData.getConstTransposedPMatrices(i);
+            const int8_t * tipStateCodes = tipData.getConstStateCodes(i);
+            cla_kernels.multiplyTip(layout, tipPMatricesTrans, tipStateCodes, cla, uf, rescaling, correct_to);
+            }
+        cla += layout.length;
+        uf += layout.np;
         } // loop across subsets of partition
-		
-#if defined(DO_UNDERFLOW_POLICY)
-	//std::cerr << "@@@@@@@@@@@@@@ additional tip @@@@@@@@@@@@@@" << std::endl;
-	// Note: check() has 3 CondLikelihood & args, but we only need 1 of them, so provide condLike 3 times
-	underflow_manager.check(condLike, condLike, condLike, pattern_counts, true);	// last argument is polytomy
-#endif
 	}
 	
 /*----------------------------------------------------------------------------------------------------------------------
@@ -615,47 +588,34 @@ void TreeLikelihood::conditionOnAdditionalInternal(
   const InternalData &		child,
   const CondLikelihood &	childCondLike)
 	{
-	double * cla = condLike.getCLA();
-	const double * childCLA = childCondLike.getCLA();
+	PHYCAS_HOT_PATH_TIMER_N(cla_timing, 0);	// part of a conditional likelihood array already counted
+
+	LikeFltType * cla = condLike.getCLA();
+	const LikeFltType * childCLA = childCondLike.getCLA();
+	UnderflowType * uf = condLike.getUF();
+	const UnderflowType * childUF = childCondLike.getUF();
+#if defined(DO_UNDERFLOW_POLICY)
+	// Note: check() has 3 CondLikelihood & args, but we only need 2 of them, so first 2 are same and 3rd represents child's cond. like
+	const CLAKernels::Rescaling rescaling = underflow_manager.check(condLike, condLike, childCondLike, true);	// last argument is polytomy
+#else
+	const CLAKernels::Rescaling rescaling = CLAKernels::kNoRescaling;
+#endif
+	const double correct_to = underflow_manager.getUnderflowMaxValue();
 
     unsigned num_subsets = partition_model->getNumSubsets();
     for (unsigned i = 0; i < num_subsets; ++i)
         {
-        unsigned num_patterns = partition_model->subset_num_patterns[i];
-        unsigned num_states = partition_model->subset_num_states[i];
-        unsigned num_rates = partition_model->subset_num_rates[i];
-
-        ConstPMatrices childPMatrices = child.getConstPMatrices(i);
-
-        //	+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
-        //	|                            rate 1                             | ...
-        //	+---+---+---+---+---+---+---+---+---------------+---+---+---+---+
-        //	|   pattern 1   |   pattern 2   |      ...      |   pattern n   | ...
-        //	+---+---+---+---+---+---+---+---+---------------+---+---+---+---+
-        //	| A | C | G | T | A | C | G | T |      ...      | A | C | G | T | ...
-        //	+---+---+---+---+---+---+---+---+---------------+---+---+---+---+
-        for (unsigned r = 0; r < num_rates; ++r)
+        const CLASubsetLayout & layout = cla_layout[i];
+        if (isRefreshingSubset(i))
             {
-            const double * const * childPMatrix = childPMatrices[r];
-            for (unsigned pat = 0; pat < num_patterns; ++pat, childCLA += num_states)
-                {
-                for (unsigned i = 0; i < num_states; ++i)
-                    {
-                    double childLike = 0.0;
-                    const double * childP_i = childPMatrix[i];
-                    for (unsigned j = 0; j < num_states; ++j)
-                        childLike += childP_i[j]*childCLA[j];
-                    *cla++ *= childLike;
-                    }   // loop across states
-                }   // loop across patterns
-		    } // loop across rates
+            ConstPMatrices childPMatrices = child.getConstPMatrices(i);
+            cla_kernels.multiplyInternal(layout, childPMatrices, childCLA, childUF, cla, uf, rescaling, correct_to);
+            }
+        cla += layout.length;
+        childCLA += layout.length;
+        uf += layout.np;
+        childUF += layout.np;
 		} // loop across subsets of partition
-		
-#if defined(DO_UNDERFLOW_POLICY)
-	//std::cerr << "@@@@@@@@@@@@@@ additional tip @@@@@@@@@@@@@@" << std::endl;
-	// Note: check() has 3 CondLikelihood & args, but we only need 2 of them, so first 2 are same and 3rd represents child's cond. like
-	underflow_manager.check(condLike, condLike, childCondLike, pattern_counts, true);	// last argument is polytomy
-#endif
 	}
 	
 //move this to member fxn of Tree
@@ -762,14 +722,15 @@ printf("in harvestLnL with EdgeEndpoints=(%d,%d)\n", nodeIndex(focal_edge.getFoc
 |	| 0 | 1 | 0 | 1 | 0 | 1 | 0 | 1 | 0 | 1 | 0 | 1 | A | C | G | T | A | C | G | T |
 |	+-----------------------+-----------------------+-------------------------------+
 |>	
+|	In the pattern-blocked layout, the patterns of each subset are first divided into blocks and the pictures above
+|	describe each block (plus padding); `cla_layout' gives the position of each rate category of each block.
 */
 double TreeLikelihood::harvestLnLFromValidEdge(
    ConstEdgeEndpoints & focal_edge)	/**< is the edge containing the focal node that will serve as the likelihood root */	
     {
 	//debugCompressedDataInfo("compressed_data_info.txt");
 	
-    // Create convenience variables focalNode, focalNeighbor, actualChild, focalEdgeLen, focalCondLike, focalNodeCLA,
-    // and singleRateCLALength
+    // Create convenience variables focalNode, focalNeighbor, actualChild, focalEdgeLen, focalCondLike and focalNodeCLA
     PHYCAS_ASSERT(focal_edge.getFocalNode() != NULL);
     PHYCAS_ASSERT(focal_edge.getFocalNeighbor() != NULL);
     const TreeNode * 			focalNeighbor		= focal_edge.getFocalNeighbor();
@@ -782,32 +743,15 @@ double TreeLikelihood::harvestLnLFromValidEdge(
     const LikeFltType * 		focalNodeCLA 		= focalCondLike->getCLA(); //PELIGROSO
     PHYCAS_ASSERT(focalNodeCLA != NULL);
 
-    // Get pointer to start of array holding pattern counts
 	PHYCAS_ASSERT((unsigned)pattern_counts.size() == std::accumulate(partition_model->subset_num_patterns.begin(), partition_model->subset_num_patterns.end(), (unsigned)0));
-    const pattern_count_t * const counts = (const pattern_count_t * const)(&pattern_counts[0]); //PELIGROSO
-    
-    // Get pointer to start of array holding number of potentially constant states for each pattern
-    // A potentially constant state for a pattern is a state present in all taxa with unambiguous data.
-    // If there are ambiguities, then it is possible that the pattern is not constant depending on 
-    // the way these ambiguities are resolved. Here is what this vector looks like:
-	// +---+---+---+---+---+---+---+---+
-	// | 0 | 1 | 0 | 1 | 3 | 2 | 0 | 2 |
-	// +---+---+---+---+---+---+---+---+
-	//   ^   ^       ^       ^
-	//   |   |       |       |
-	//   |   |       |       4th site can potentially be constant for either A (state 0) or G (state 2)
-	//   |   |       3rd site can be potentially constant for T (state 3)
-	//   |   2nd site can be potentially constant for 1 state: that state (A, state 0) follows in the next cell
-	//   1st site is definitely variable (hence the 0 meaning no states follow)
-    const unsigned * pinvar_states = &constant_states[0]; //PELIGROSO
         
     unsigned pattern_start = 0;
 	unsigned cum_cla_pos = 0;
 
     if (store_site_likes)
         {	
-        site_likelihood.clear();
-        site_uf.clear();
+        site_likelihood.resize(pattern_counts.size());
+        site_uf.resize(pattern_counts.size());
         }
 		
     double lnLikelihood = 0.0;
@@ -818,295 +762,402 @@ double TreeLikelihood::harvestLnLFromValidEdge(
         unsigned		ns					= partition_model->subset_num_states[i];
         unsigned		nr					= partition_model->subset_num_rates[i];
         unsigned		np					= partition_model->subset_num_patterns[i];
-        const unsigned	singleRateCLALength	= np*ns;
+        const CLASubsetLayout &	layout		= cla_layout[i];
             
         // Get state frequencies from model and alias rate category probability array for speed
         const double *	stateFreq			= &partition_model->subset_model[i]->getStateFreqs()[0]; //PELIGROSO
 
-        //const double * 	rateCatProbArray	= &rate_probs[i][rate_prob_start]; //PELIGROSO
-        const double * 	rateCatProbArray	= &rate_probs[i][0]; //PELIGROSO
-    
-        bool			is_pinvar			= partition_model->subset_model[i]->isPinvarModel();
-        double			pinvar				= partition_model->subset_model[i]->getPinvar();
+        // Everything harvestPatternBlock needs to know about this subset
+        HarvestSubsetInfo info;
+        info.first_pattern		= pattern_start;
+        info.num_patterns		= np;
+        info.num_rates			= nr;
+        info.block_size			= CLAKernels::calcBlockSize(ns);
+        info.state_freqs		= stateFreq;
+        info.rate_probs			= &rate_probs[i][0]; //PELIGROSO
+        info.is_pinvar			= partition_model->subset_model[i]->isPinvarModel();
+        info.pinvar				= partition_model->subset_model[i]->getPinvar();
+        info.focal_cond_like	= focalCondLike.get();
+        info.neighbor_cond_like	= NULL;
+        info.layout				= &layout;
+        info.focal_cla			= focalNodeCLA + cum_cla_pos;
+        info.neighbor_cla		= NULL;
+        info.tip_pmat_trans		= NULL;
+        info.tip_codes			= NULL;
+        info.pi_p				= NULL;
     
         if (focalNeighbor->IsTip())
             {
             const TipData &					tipData 			= *focalNeighbor->GetTipData();
-            double * * *					p					= tipData.getMutableTransposedPMatrices(i);
             const double * const * const *	tipPMatricesTrans	= tipData.getConstTransposedPMatrices(i);
             const int8_t *					tipStateCodes		= tipData.getConstStateCodes(i);
-            std::vector<const double *> 	focalNdCLAPtr(nr);
 			
             // Compute transition probability matrices (one for each relative rate) for the edge
             // connecting the tip node to the focal node
-            calcPMatTranspose(i, p, tipData.getConstStateListPos(i),  focalEdgeLen);
+            refreshPMatTranspose(i, tipData, focalEdgeLen);
             
-            // Set focalNdCLAPtr so that element r points to the CLA of the first state of the
-            // starting pattern for relative rate r
-            for (unsigned r = 0; r < nr; ++r)
-            	focalNdCLAPtr[r] = focalNodeCLA + cum_cla_pos + singleRateCLALength*r;
-                
-            for (unsigned pat = pattern_start; pat < pattern_start + np; ++pat)
-                {
-				// get index of pattern relative to first pattern in current partition subset
-				unsigned relpat = pat - subset_offset[i];
-				
-                // Compute the site likelihood for the current pattern
-                double siteLike = 0.0;
-                for (unsigned r = 0; r < nr; ++r)
-                    {
-                    const double * const * const	tipPMatrixT		= tipPMatricesTrans[r];
-					int8_t							from_state		= tipStateCodes[relpat];
-                    const double *					tipPMatT_pat	= tipPMatrixT[from_state];
-                    double 							siteRateLike 	= 0.0;
-                    
-                    // Go through possible states at the internal (focal) node
-                    for (unsigned s = 0; s < ns; ++s)
-                        {
-                        double frq 		= stateFreq[s];			// frequency of state s
-                        double clike 	= focalNdCLAPtr[r][s];	// likelihood conditional of state s at focal node
-                        double tprob	= tipPMatT_pat[s];		// trans. prob. of tip state to state s
-                        siteRateLike += frq*clike*tprob;		//@POL does this assume time-reversible model (using tipPMatT_pat backwards)?
-                        }
-					double rate_cat_prob = rateCatProbArray[r];
-                    siteLike += siteRateLike*rate_cat_prob;
-                    
-					//std::cerr << boost::str(boost::format("i = %d, r = %d, siteRateLike = %.8f") % i % r % siteRateLike) << std::endl;
-
-                    // Increment starting positions to next pattern for this relative rate
-                    focalNdCLAPtr[r] += ns;
-                    }
-    
-                double log_correction_factor = underflow_manager.getCorrectionFactor(pat, focalCondLike);
-    
-                if (is_pinvar)
-                    {
-                    double pinvar_like = 0.0;
-                    unsigned num_pinvar_states = *pinvar_states++;
-                    if (num_pinvar_states > 0)
-                        {
-                        // This pattern is at least potentially constant, so we must compute pinvar_like, 
-                        // the likelihood conditional on the site having rate = 0
-                        for (unsigned s = 0; s < num_pinvar_states; ++s)
-                            pinvar_like += stateFreq[*pinvar_states++];
-                            
-                        if (log_correction_factor != 0.0)
-                            {
-                            // If variable part of site-likelihood has been corrected for underflow,
-                            // we must also correct the invariable component
-                            
-                            // find correction factor (f) for pinvar_like
-                            double underflow_max_value = underflow_manager.getUnderflowMaxValue();
-                            PHYCAS_ASSERT(pinvar_like > underflow_max_value/DBL_MAX);
-                            double ratio = underflow_max_value/pinvar_like;
-                            double log_ratio = std::log(ratio);
-                            double f = std::floor(log_ratio);
-                            
-                            if (f < log_correction_factor)
-                                {
-                                double expdiff = exp(f - log_correction_factor);
-                                pinvar_like *= exp(f);
-                                siteLike *= expdiff;
-                                log_correction_factor = f;
-                                }
-                            else
-                                {
-                                // since log_correction_factor <= f, and since exp(f) is in no danger of overflowing,
-                                // we need not worry about exp(log_correction_factor) overflowing
-                                double expc = exp(log_correction_factor);
-                                pinvar_like *= expc;
-                                }
-                            }
-                        siteLike = pinvar*pinvar_like + (1.0 - pinvar)*siteLike;
-                        }
-                    else
-                        {
-                        // This pattern is not constant (or even potentially constant), so the probability 
-                        // of the data given invariability is zero
-                        siteLike = (1.0 - pinvar)*siteLike;
-                        }
-                    }
-    
-                double site_lnL = std::log(siteLike);
-                site_lnL -= log_correction_factor;
-    
-				//std::cerr << boost::str(boost::format("--> i = %d, siteLike = %.8f, site_lnL = %.8f") % i % siteLike % site_lnL) << std::endl;
-
-                if (store_site_likes)
-                    {
-                    site_likelihood.push_back(site_lnL);
-                    site_uf.push_back(log_correction_factor);
-                    }
-                lnLikelihood += counts[pat]*site_lnL;
-                } // pat loop
+            info.tip_pmat_trans = tipPMatricesTrans;
+            info.tip_codes = tipStateCodes;
+            lnLikelihood += harvestSubsetLnL(info);
             }
         else    // focalNeighbor is not a tip
             {
 			ConstCondLikelihoodShPtr	neighborCondLike	= getValidCondLikePtr(focalNeighbor, focalNode);
 			PHYCAS_ASSERT(neighborCondLike);
-			const double *				focalNeighborCLA	= neighborCondLike->getCLA(); //PELIGROSO
+			const LikeFltType *			focalNeighborCLA	= neighborCondLike->getCLA(); //PELIGROSO
 			PHYCAS_ASSERT(focalNeighborCLA != NULL);
             const InternalData *			neighborID		= focalNeighbor->GetInternalData();
             const double * const * const *	childPMatrices	= neighborID->getConstPMatrices(i);
             
             // Compute transition probability matrices (one for each relative rate) for the edge
             // connecting the two internal nodes
-            calcPMat(i, neighborID->getMutablePMatrices(i), focalEdgeLen);
-    
-    		// Create vectors whose elements point to the starting state CLA for each rate
-    		// Each element is updated after each pattern to point ns ahead to the next pattern.
-			// 
-			// +-----------------------------------------------------------------------------------------------+-------------------------------+
-			// |                                            subset 1                                           |           subset 2            |
-			// +-----------------------------------------------------------------------------------------------+-------------------------------+
-			// |                      r1                       |                      r2                       |               r1              |
-			// +-----------------------------------------------+-----------------------------------------------+-------------------------------+
-			// |      p1       |      p2       |       p3      |      p1       |      p2       |      p3       |      p1       |       p2      |
-			// +-----------------------------------------------+-----------------------------------------------+-------------------------------+
-			// | A | C | G | T | A | C | G | T | A | C | G | T | A | C | G | T | A | C | G | T | A | C | G | T | A | C | G | T | A | C | G | T |
-			// +-----------------------------------------------+-----------------------------------------------+-------------------------------+
-            std::vector<const double *> focalNdCLAPtr(nr);
-            std::vector<const double *> focalNeighborCLAPtr(nr);
+            refreshPMat(i, *neighborID, focalEdgeLen);
     
     		// Create an expected divergence matrix piP that is equivalent to a diagonal matrix of
     		// state frequencies multiplied by the transition probability matrix. This represents
     		// a precalculation that will save time later on.
             ScopedThreeDMatrix<double> piP;
             piP.Initialize(nr, ns, ns);
-            
-			// Set focalNdCLAPtr and focalNeighborCLAPtr so that element r points to the CLA of 
-			// the first state of the starting pattern for relative rate r. Also compute elements
-			// of piP matrix.
             for (unsigned r = 0; r < nr; ++r)
                 {
-				//std::cerr << "childPMatrices[" << r << "]" << std::endl;
-                focalNdCLAPtr[r]		= focalNodeCLA		+ singleRateCLALength*r	+ cum_cla_pos;	// bug fixed in svn revision 1209: cum_cla_pos was ns*pattern_start, which
-                focalNeighborCLAPtr[r]	= focalNeighborCLA	+ singleRateCLALength*r	+ cum_cla_pos;	// doesn't work because ns might differ across subsets
                 for (unsigned neighbor_state = 0; neighbor_state < ns; ++neighbor_state)
                     {
-					//std::cerr << boost::str(boost::format("> stateFreq[%d] = %.8f") % neighbor_state % stateFreq[neighbor_state]) << std::endl;
                     for (unsigned focal_state = 0; focal_state < ns; ++focal_state)
-                        {
                         piP.ptr[r][neighbor_state][focal_state] = stateFreq[neighbor_state]*childPMatrices[r][neighbor_state][focal_state];
-						//std::cerr << boost::str(boost::format("  focal_state = %d, neighbor_state = %.8f, childPMatrices[r][neighbor_state][focal_state] = %.8f") % focal_state % neighbor_state % childPMatrices[r][neighbor_state][focal_state]) << std::endl;
-                        }			
                     }			
                 }
     
-            for (unsigned pat = pattern_start; pat < pattern_start + np; ++pat)
+            // The likelihood of every pattern for each relative rate is computed by harvestSubsetLnL as:
+            //   sum_f Lf (sum_n pi_n P_{n,f} Ln) --> f = focal state, n = neighbor state, Lf = cla focal node, Ln = cla neighbor node
+            //   sum_f Lf (sum_n   piPnf      Ln) --> piPnf = pi_n P_{n,f} (this assumes a time-reversible model, using piP backwards)
+			// The CLAs of this subset begin at cum_cla_pos (bug fixed in svn revision 1209: the offset was ns*pattern_start, 
+			// which doesn't work because ns might differ across subsets)
+            info.neighbor_cond_like = neighborCondLike.get();
+            info.neighbor_cla = focalNeighborCLA + cum_cla_pos;
+            info.pi_p = piP.ptr;
+            lnLikelihood += harvestSubsetLnL(info);
+            }
+            pattern_start += np;
+			cum_cla_pos += layout.length;
+        }   // loop over subsets of partition   
+    
+        if (store_site_likes)
+            site_likelihood_lnL = lnLikelihood;
+        return lnLikelihood;
+    }
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the log-likelihood of the patterns in the subset described by `info'. The CLA kernels fill `site_rate_like'
+|	with the likelihood of each pattern in the subset for each rate category (site_rate_like[r*np + p] holds the 
+|	likelihood of pattern p, relative to the first pattern in the subset, for rate r), working through blocks of 
+|	`info.block_size' patterns that are shared among threads if there is a thread pool. As soon as all rates of a block
+|	are done, the same task combines them into the log-likelihood of the block (see harvestBlockTask), so there is a 
+|	single pass (and a single synchronization) per subset. The log-likelihoods of the blocks are added together in 
+|	block order; because the block size does not depend on the number of threads, the result is the same regardless 
+|	of how many threads are used.
+*/
+double TreeLikelihood::harvestSubsetLnL(
+  const HarvestSubsetInfo & info)	/**< describes the subset */
+	{
+	const unsigned nblocks = (info.num_patterns + info.block_size - 1)/info.block_size;
+	block_lnL.assign(nblocks, 0.0);
+	site_rate_like.resize(info.num_rates*info.num_patterns);
+
+	const CLAKernels::BlockFn harvest_block = boost::bind(&TreeLikelihood::harvestBlockTask, this, &info, _1, _2);
+	if (info.neighbor_cla == NULL)
+		cla_kernels.edgeTip(*info.layout, info.state_freqs, info.focal_cla, info.tip_pmat_trans, info.tip_codes, &site_rate_like[0], harvest_block);
+	else
+		cla_kernels.edgeInternal(*info.layout, info.pi_p, info.focal_cla, info.neighbor_cla, &site_rate_like[0], harvest_block);
+
+	double lnL = 0.0;
+	for (unsigned b = 0; b < nblocks; ++b)
+		lnL += block_lnL[b];
+	return lnL;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the log-likelihood of the `n' patterns beginning with pattern `first' (relative to the first pattern of 
+|	the subset described by `info'), storing it in the element of `block_lnL' for that block. Called by the CLA kernels
+|	(possibly from a worker thread of the thread pool) once `site_rate_like' holds every rate of these patterns.
+*/
+void TreeLikelihood::harvestBlockTask(
+  const HarvestSubsetInfo * info,	/**< describes the subset */
+  unsigned first,					/**< is the index (within the subset) of the first pattern of the block */
+  unsigned n)						/**< is the number of patterns in the block */
+	{
+	PHYCAS_ASSERT(first % info->block_size == 0);
+	block_lnL[first/info->block_size] = harvestPatternBlock(*info, info->first_pattern + first, info->first_pattern + first + n);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Combines rate categories (and the invariable sites component, if any) to obtain the site log-likelihood for each 
+|	pattern from `first' up to, but not including, `last', and returns the sum of the site log-likelihoods weighted by
+|	the pattern counts. Stores the site log-likelihoods and underflow corrections in `site_likelihood' and `site_uf' if
+|	`store_site_likes' is true. Modifies nothing else, so may be called concurrently for disjoint ranges of patterns.
+*/
+double TreeLikelihood::harvestPatternBlock(
+  const HarvestSubsetInfo & info,	/**< describes the subset containing the patterns */
+  unsigned first,					/**< is the index of the first pattern */
+  unsigned last)					/**< is one more than the index of the last pattern */
+	{
+    // Get pointer to start of array holding pattern counts
+    const pattern_count_t * const counts = (const pattern_count_t * const)(&pattern_counts[0]); //PELIGROSO
+    
+    // Get pointer to the number of potentially constant states for the first pattern in this block (see 
+    // TreeLikelihood::buildConstantStatesVector for a description of the layout of `constant_states')
+    const unsigned * pinvar_states = (info.is_pinvar ? &constant_states[constant_states_pos[first]] : NULL); //PELIGROSO
+
+    const unsigned nr = info.num_rates;
+    const unsigned np = info.num_patterns;
+    const double * stateFreq = info.state_freqs;
+    const double * rateCatProbArray = info.rate_probs;
+    const double pinvar = info.pinvar;
+
+    double lnLikelihood = 0.0;
+    for (unsigned pat = first; pat < last; ++pat)
+        {
+        // get index of pattern relative to first pattern in current partition subset
+        unsigned relpat = pat - info.first_pattern;
+
+        // Compute the site likelihood for the current pattern
+        double siteLike = 0.0;
+        for (unsigned r = 0; r < nr; ++r)
+            siteLike += site_rate_like[r*np + relpat]*rateCatProbArray[r];
+
+        double log_correction_factor = underflow_manager.getCorrectionFactor(pat, *info.focal_cond_like);
+        if (info.neighbor_cond_like != NULL)
+            log_correction_factor += underflow_manager.getCorrectionFactor(pat, *info.neighbor_cond_like);
+
+        if (info.is_pinvar)
+            {
+            double pinvar_like = 0.0;
+            unsigned num_pinvar_states = *pinvar_states++;
+            if (num_pinvar_states > 0)
                 {
-                double siteLike = 0.0;
-                for (unsigned r = 0; r < nr; ++r)
+                // This pattern is at least potentially constant, so we must compute pinvar_like, 
+                // the likelihood conditional on the site having rate = 0
+                for (unsigned s = 0; s < num_pinvar_states; ++s)
+                    pinvar_like += stateFreq[*pinvar_states++];
+                    
+                if (log_correction_factor != 0.0)
                     {
-                    const double *	focalNdCLAPtr_r 	= focalNdCLAPtr[r];
-                    const double *	neighborCLAForRate 	= focalNeighborCLAPtr[r];
-                    double 			siteRateLike		= 0.0;	
+                    // If variable part of site-likelihood has been corrected for underflow,
+                    // we must also correct the invariable component
                     
-                    // sum_f Lf (sum_n pi_n P_{n,f} Ln) --> f = focal state, n = neighbor state, Lf = cla focal node, Ln = cla neighbor node
-                    // sum_f Lf (sum_n   piPnf      Ln) --> piPnf = pi_n P_{n,f}
-                    // sum_f Lf (     neigborLike     ) --> neighborLike = sum_n piPnf Ln
-                    for (unsigned focal_state = 0; focal_state < ns; ++focal_state)
-                        {
-                        double Lf = focalNdCLAPtr_r[focal_state];
-
-                        double neigborLike = 0.0;
-                        const double * piP_focal_state = piP.ptr[r][focal_state];	// get pointer to row of piP matrix corresponding to focal_state
-                        for (unsigned neighbor_state = 0; neighbor_state < ns; ++neighbor_state)
-                        	{
-                        	double Ln 		= neighborCLAForRate[neighbor_state];
-                        	double piPnf 	= piP_focal_state[neighbor_state];	//@POL this assumes time-reversible model (using piP backwards)
-                            neigborLike += piPnf*Ln;	
-							//std::cerr << boost::str(boost::format("  focal_state = %d, neighbor_state = %.8f, Lf = %.8f, Ln = %.8f, piPnf = %.8f, neigborLike(cum) = %.8f") % focal_state % neighbor_state % Lf % Ln % piPnf % neigborLike) << std::endl;
-                            }
-						
-						//std::cerr << boost::str(boost::format("i = %d, r = %d, focal_state = %d, neighborLike = %.8f, Lf = %.8f, siteRateLike = %.8f") % i % r % focal_state % neigborLike % Lf % (Lf*neigborLike)) << std::endl;
-                            
-                        siteRateLike += Lf*neigborLike;
-                        } 
-                    siteLike += siteRateLike*rateCatProbArray[r];
+                    // find correction factor (f) for pinvar_like
+                    double underflow_max_value = underflow_manager.getUnderflowMaxValue();
+                    PHYCAS_ASSERT(pinvar_like > underflow_max_value/DBL_MAX);
+                    double ratio = underflow_max_value/pinvar_like;
+                    double log_ratio = std::log(ratio);
+                    double f = std::floor(log_ratio);
                     
-					// Increment starting positions to next pattern for this relative rate
-                    focalNdCLAPtr[r] 		+= ns;
-                    focalNeighborCLAPtr[r]	+= ns;
-                    }
-    
-                double log_correction_factor = underflow_manager.getCorrectionFactor(pat, focalCondLike);
-                log_correction_factor 		+= underflow_manager.getCorrectionFactor(pat, neighborCondLike);
-    
-                if (is_pinvar)
-                    {
-                    double pinvar_like = 0.0;
-                    unsigned num_pinvar_states = *pinvar_states++;
-                    if (num_pinvar_states > 0)
+                    if (f < log_correction_factor)
                         {
-                        // This pattern is at least potentially constant, so we must compute pinvar_like, 
-                        // the likelihood conditional on the site having rate = 0
-                        for (unsigned j = 0; j < num_pinvar_states; ++j)
-                            pinvar_like += stateFreq[*pinvar_states++];
-                        
-                        if (log_correction_factor != 0.0)
-                            {
-                            // If variable part of site-likelihood has been corrected for underflow,
-                            // we must also correct the invariable component
-                            
-                            // find correction factor (f) for pinvar_like
-                            double underflow_max_value = underflow_manager.getUnderflowMaxValue();
-                            PHYCAS_ASSERT(pinvar_like > underflow_max_value/DBL_MAX);
-                            double ratio = underflow_max_value/pinvar_like;
-                            double log_ratio = std::log(ratio);
-                            double f = std::floor(log_ratio);
-                            
-                            if (f < log_correction_factor)
-                                {
-                                double expdiff = exp(f - log_correction_factor);
-                                pinvar_like *= exp(f);
-                                siteLike *= expdiff;
-                                log_correction_factor = f;
-                                }
-                            else
-                                {
-                                // since log_correction_factor <= f, and since exp(f) is in no danger of overflowing,
-                                // we need not worry about exp(log_correction_factor) overflowing
-                                double expc = exp(log_correction_factor);
-                                pinvar_like *= expc;
-                                }
-                            }
-                        siteLike = pinvar*pinvar_like + (1.0 - pinvar)*siteLike;
+                        double expdiff = exp(f - log_correction_factor);
+                        pinvar_like *= exp(f);
+                        siteLike *= expdiff;
+                        log_correction_factor = f;
                         }
                     else
                         {
-                        // This pattern is not constant (or even potentially constant), so the probability 
-                        // of the data given invariability is zero
-                        siteLike = (1.0 - pinvar)*siteLike;
+                        // since log_correction_factor <= f, and since exp(f) is in no danger of overflowing,
+                        // we need not worry about exp(log_correction_factor) overflowing
+                        double expc = exp(log_correction_factor);
+                        pinvar_like *= expc;
                         }
                     }
-    
-                double site_lnL = std::log(siteLike);
-                site_lnL -= log_correction_factor;
-                
-				//std::cerr << boost::str(boost::format("--> i = %d, siteLike = %.8f, site_lnL = %.8f") % i % siteLike % site_lnL) << std::endl;
-						
-                if (store_site_likes)
+                siteLike = pinvar*pinvar_like + (1.0 - pinvar)*siteLike;
+                }
+            else
+                {
+                // This pattern is not constant (or even potentially constant), so the probability 
+                // of the data given invariability is zero
+                siteLike = (1.0 - pinvar)*siteLike;
+                }
+            }
+
+        double site_lnL = std::log(siteLike);
+        site_lnL -= log_correction_factor;
+
+        if (store_site_likes)
+            {
+            site_likelihood[pat] = site_lnL;
+            site_uf[pat] = log_correction_factor;
+            }
+        lnLikelihood += counts[pat]*site_lnL;
+        }
+    return lnLikelihood;
+	}
+	
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the first (`d1') and second (`d2') derivatives of the log-likelihood with respect to the length of the edge 
+|	`focal_edge', assuming that the two conditional likelihood arrays on either side of the edge are valid (the same 
+|	requirement as harvestLnLFromValidEdge). Because the site likelihood is linear in the transition matrices of the 
+|	edge, the CLA kernels used by harvestLnLFromValidEdge also yield the derivatives of the site likelihood when given 
+|	the derivatives of those matrices (computed by Model::calcPMatDerivatives). Underflow corrections cancel in the 
+|	ratio of a derivative to the site likelihood except where an invariable sites component must be added, in which 
+|	case the correction is applied exactly as in harvestPatternBlock.
+*/
+void TreeLikelihood::harvestEdgeLenDerivsFromValidEdge(
+  ConstEdgeEndpoints & focal_edge,	/**< is the edge whose length is the variable of differentiation */
+  double & d1,						/**< receives the first derivative of the log-likelihood */
+  double & d2)						/**< receives the second derivative of the log-likelihood */
+	{
+    PHYCAS_ASSERT(focal_edge.getFocalNode() != NULL);
+    PHYCAS_ASSERT(focal_edge.getFocalNeighbor() != NULL);
+    const TreeNode * 			focalNeighbor		= focal_edge.getFocalNeighbor();
+    const TreeNode * 			focalNode			= focal_edge.getFocalNode();
+    PHYCAS_ASSERT(focalNode->IsInternal());
+    const double 				focalEdgeLen 		= focal_edge.getActualChild()->GetEdgeLen();
+    ConstCondLikelihoodShPtr 	focalCondLike 		= getValidCondLikePtr(focal_edge);
+    PHYCAS_ASSERT(focalCondLike);
+    const LikeFltType * 		focalNodeCLA 		= focalCondLike->getCLA(); //PELIGROSO
+    ConstCondLikelihoodShPtr	neighborCondLike;
+    if (focalNeighbor->IsInternal())
+		neighborCondLike = getValidCondLikePtr(focalNeighbor, focalNode);
+
+    const pattern_count_t * const counts = (const pattern_count_t *)(&pattern_counts[0]); //PELIGROSO
+
+    d1 = 0.0;
+    d2 = 0.0;
+    unsigned pattern_start = 0;
+	unsigned cum_cla_pos = 0;
+    unsigned num_subsets = partition_model->getNumSubsets();
+    for (unsigned i = 0; i < num_subsets; ++i)
+        {
+        unsigned		ns					= partition_model->subset_num_states[i];
+        unsigned		nr					= partition_model->subset_num_rates[i];
+        unsigned		np					= partition_model->subset_num_patterns[i];
+        const CLASubsetLayout &	layout		= cla_layout[i];
+        ModelShPtr		model				= partition_model->subset_model[i];
+        const double *	stateFreq			= &model->getStateFreqs()[0]; //PELIGROSO
+        const double *	rateCatProbArray	= &rate_probs[i][0]; //PELIGROSO
+        const bool		is_pinvar			= model->isPinvarModel();
+        const double	pinvar				= model->getPinvar();
+
+        // Derivatives of the transition matrices with respect to the edge length: the rate-adjusted edge length of 
+        // rate category r is c_r times the edge length, so the chain rule contributes c_r to the first derivative 
+        // and c_r^2 to the second
+        const double_vect_t scaled = calcScaledEdgeLens(i, focalEdgeLen);
+        const double subset_relrate = partition_model->getSubsetRelRate(i);
+        double * * * dP = edgelen_dP.ptr;	// sized by calcEdgeLenDerivatives for the largest subset and tip
+        double * * * d2P = edgelen_d2P.ptr;
+        for (unsigned r = 0; r < nr; ++r)
+            {
+            const double c = subset_relrate*rate_means[i][r];
+            model->calcPMatDerivatives(dP[r], d2P[r], scaled[r]);
+            for (unsigned a = 0; a < ns; ++a)
+                {
+                for (unsigned b = 0; b < ns; ++b)
                     {
-                    site_likelihood.push_back(site_lnL);
-                    site_uf.push_back(log_correction_factor);
+                    dP[r][a][b] *= c;
+                    d2P[r][a][b] *= c*c;
                     }
-                    
-                lnLikelihood += counts[pat]*site_lnL;
                 }
             }
-            pattern_start += np;
-			cum_cla_pos += nr*np*ns;
-        }   // loop over subsets of partition   
-    
-        return lnLikelihood;
-    }
-	
+
+        // Fill site_rate_like, site_rate_d1 and site_rate_d2 with the likelihood of every pattern for each rate 
+        // category and its first and second derivatives
+        site_rate_like.resize(nr*np);
+        site_rate_d1.resize(nr*np);
+        site_rate_d2.resize(nr*np);
+        if (focalNeighbor->IsTip())
+            {
+            const TipData &					tipData 			= *focalNeighbor->GetTipData();
+            const double * const * const *	tipPMatricesTrans	= tipData.getConstTransposedPMatrices(i);
+            const int8_t *					tipStateCodes		= tipData.getConstStateCodes(i);
+            refreshPMatTranspose(i, tipData, focalEdgeLen);
+            augmentPMatTranspose(i, dP, tipData.getConstStateListPos(i));
+            augmentPMatTranspose(i, d2P, tipData.getConstStateListPos(i));
+            for (unsigned r = 0; r < nr; ++r)
+                {
+                // The complete ambiguity row of a T matrix holds the row sums of P, which are always 1, so its 
+                // derivatives are zero rather than the 1.0 filled in by augmentPMatTranspose
+                std::fill(dP[r][ns], dP[r][ns] + ns, 0.0);
+                std::fill(d2P[r][ns], d2P[r][ns] + ns, 0.0);
+                }
+            const LikeFltType * cla = focalNodeCLA + cum_cla_pos;
+            cla_kernels.edgeTip(layout, stateFreq, cla, tipPMatricesTrans, tipStateCodes, &site_rate_like[0], CLAKernels::BlockFn());
+            cla_kernels.edgeTip(layout, stateFreq, cla, dP, tipStateCodes, &site_rate_d1[0], CLAKernels::BlockFn());
+            cla_kernels.edgeTip(layout, stateFreq, cla, d2P, tipStateCodes, &site_rate_d2[0], CLAKernels::BlockFn());
+            }
+        else
+            {
+			const LikeFltType *				focalNeighborCLA	= neighborCondLike->getCLA(); //PELIGROSO
+            const InternalData *			neighborID			= focalNeighbor->GetInternalData();
+            const double * const * const *	childPMatrices		= neighborID->getConstPMatrices(i);
+            refreshPMat(i, *neighborID, focalEdgeLen);
+
+            // Premultiply by the state frequencies as harvestLnLFromValidEdge does to form piP
+            double * * * piP = edgelen_piP.ptr;
+            for (unsigned r = 0; r < nr; ++r)
+                {
+                for (unsigned neighbor_state = 0; neighbor_state < ns; ++neighbor_state)
+                    {
+                    for (unsigned focal_state = 0; focal_state < ns; ++focal_state)
+                        {
+                        piP[r][neighbor_state][focal_state] = stateFreq[neighbor_state]*childPMatrices[r][neighbor_state][focal_state];
+                        dP[r][neighbor_state][focal_state] *= stateFreq[neighbor_state];
+                        d2P[r][neighbor_state][focal_state] *= stateFreq[neighbor_state];
+                        }
+                    }
+                }
+            const LikeFltType * focalCLA = focalNodeCLA + cum_cla_pos;
+            const LikeFltType * neighborCLA = focalNeighborCLA + cum_cla_pos;
+            cla_kernels.edgeInternal(layout, piP, focalCLA, neighborCLA, &site_rate_like[0], CLAKernels::BlockFn());
+            cla_kernels.edgeInternal(layout, dP, focalCLA, neighborCLA, &site_rate_d1[0], CLAKernels::BlockFn());
+            cla_kernels.edgeInternal(layout, d2P, focalCLA, neighborCLA, &site_rate_d2[0], CLAKernels::BlockFn());
+            }
+
+        // Combine rate categories for each pattern. With L the site likelihood, d(log L)/dt = L'/L and 
+        // d2(log L)/dt2 = L''/L - (L'/L)^2. The invariable sites component does not depend on the edge length, so it 
+        // only dilutes L'/L and L''/L by the fraction of L contributed by the variable component
+        const unsigned * pinvar_states = (is_pinvar && np > 0 ? &constant_states[constant_states_pos[pattern_start]] : NULL); //PELIGROSO
+        for (unsigned relpat = 0; relpat < np; ++relpat)
+            {
+            const unsigned pat = pattern_start + relpat;
+            double siteLike = 0.0;
+            double siteD1 = 0.0;
+            double siteD2 = 0.0;
+            for (unsigned r = 0; r < nr; ++r)
+                {
+                siteLike += site_rate_like[r*np + relpat]*rateCatProbArray[r];
+                siteD1 += site_rate_d1[r*np + relpat]*rateCatProbArray[r];
+                siteD2 += site_rate_d2[r*np + relpat]*rateCatProbArray[r];
+                }
+
+            double variable_fraction = 1.0;
+            if (is_pinvar)
+                {
+                double pinvar_like = 0.0;
+                unsigned num_pinvar_states = *pinvar_states++;
+                for (unsigned s = 0; s < num_pinvar_states; ++s)
+                    pinvar_like += stateFreq[*pinvar_states++];
+                if (pinvar_like > 0.0 && pinvar > 0.0)
+                    {
+                    double log_correction_factor = underflow_manager.getCorrectionFactor(pat, *focalCondLike);
+                    if (neighborCondLike)
+                        log_correction_factor += underflow_manager.getCorrectionFactor(pat, *neighborCondLike);
+                    const double log_ratio = std::log(pinvar*pinvar_like) + log_correction_factor - std::log((1.0 - pinvar)*siteLike);
+                    variable_fraction = 1.0/(1.0 + std::exp(log_ratio));
+                    }
+                }
+
+            const double pat_d1 = variable_fraction*siteD1/siteLike;
+            const double pat_d2 = variable_fraction*siteD2/siteLike - pat_d1*pat_d1;
+            d1 += counts[pat]*pat_d1;
+            d2 += counts[pat]*pat_d2;
+            }
+
+        pattern_start += np;
+		cum_cla_pos += layout.length;
+        }
+	}
+
 double TreeLikelihood::harvestLnLFromValidNode(
    TreeNode * focalNode)	/**< a node whose conditional likelihoods are now valid and ready for final likelihood calculation */	
 	{
-    // Create convenience variables focalNode, focalNeighbor, actualChild, focalEdgeLen, focalCondLike, focalNodeCLA,
-    // and singleRateCLALength
+    // Create convenience variables focalNode, focalNeighbor, actualChild, focalEdgeLen, focalCondLike and focalNodeCLA
     PHYCAS_ASSERT(focalNode->IsInternal());
     InternalData * id = focalNode->GetInternalData();
     ConstCondLikelihoodShPtr focalCondLike = id->getValidChildCondLikePtr();
@@ -1168,7 +1219,7 @@ double TreeLikelihood::harvestLnLFromValidNode(
 		//double ssrr = partition_model->getSubsetRelRate(i);
 		//std::cerr << "Subset relative rate for subset " << i << " is " << ssrr << std::endl;
 		
-		const unsigned	singleRateCLALength	= np*ns;
+		const CLASubsetLayout &	layout		= cla_layout[i];
 		
 		// Get state frequencies from model and alias rate category probability array for speed
 		const double *	stateFreq			= &partition_model->subset_model[i]->getStateFreqs()[0]; //PELIGROSO
@@ -1179,16 +1230,12 @@ double TreeLikelihood::harvestLnLFromValidNode(
 		bool			is_pinvar			= partition_model->subset_model[i]->isPinvarModel();
 		double			pinvar				= partition_model->subset_model[i]->getPinvar();
 			
-		std::vector<const double *> focalNdCLAPtr(nr);
-		for (unsigned r = 0; r < nr; ++r)
-			focalNdCLAPtr[r] = focalNodeCLA + singleRateCLALength*r;
-		
 		for (unsigned pat = 0; pat < np; ++pat)
 			{
 			double siteLike = 0.0;
 			for (unsigned r = 0; r < nr; ++r)
 				{
-				const double * focalNdCLAPtr_r = focalNdCLAPtr[r];
+				const LikeFltType * focalNdCLAPtr_r = focalNodeCLA + layout.offset(pat, r);
 				double siteLike_r = 0.0;	
 				for (unsigned i = 0; i < ns; ++i)
                     {
@@ -1198,7 +1245,6 @@ double TreeLikelihood::harvestLnLFromValidNode(
                     //std::cerr << boost::str(boost::format("pat=%d, rate=%d, state=%d, cla=%g, freq=%g, like=%g") % pat % r % i % focalNdCLAPtr_r[i] % stateFreq[i] % siteLike_r) << std::endl;
                     }
 				siteLike += rateCatProbArray[r]*siteLike_r;
-				focalNdCLAPtr[r] += ns;
 				}
 			
 			double log_correction_factor = underflow_manager.getCorrectionFactor(pat, focalCondLike);
@@ -1266,6 +1312,8 @@ double TreeLikelihood::harvestLnLFromValidNode(
 		pattern_start += np;
 		}	// loop over subsets of partition
     
+        if (store_site_likes)
+            site_likelihood_lnL = lnLikelihood;
         return lnLikelihood;
     }
 
@@ -197,7 +197,10 @@ bool Model::hasEdgeLenHyperPrior()
 
 /*----------------------------------------------------------------------------------------------------------------------
 |	Computes all `numRates' transition probability matrices. Assumes edge lengths in `edgeLength' array have already
-|	been computed.
+|	been computed. The matrices need not belong to the same edge: TreeLikelihood::refreshPMatrixBatch passes every 
+|	matrix (all edges and rate categories) of a subset that must be recomputed before a likelihood calculation. This
+|	version simply calls calcPMat for each matrix; models that use an eigen-decomposition override it so that the 
+|	decomposition is checked (and reused) only once for the whole batch.
 */
 void Model::calcPMatrices(
   double * * *		pMat,			/**< is the array of 2-dimensional transition probability matrices (one transition matrix for each relative rate category) */
@@ -209,6 +212,39 @@ void Model::calcPMatrices(
 		calcPMat(pMat[i], edgeLength[i]);
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the first (`dPMat') and second (`d2PMat') derivatives of the transition probability matrix with respect to
+|	the rate-adjusted edge length `edgeLength'. This version uses central differences of calcPMat, with a step small
+|	relative to `edgeLength' (the evaluation point is moved away from zero if necessary so that no negative edge length
+|	is ever passed to calcPMat); models whose transition probabilities have a convenient closed form override it.
+*/
+void Model::calcPMatDerivatives(
+  double * *	dPMat,			/**< is the num_states by num_states matrix to receive the first derivatives */
+  double * *	d2PMat,			/**< is the num_states by num_states matrix to receive the second derivatives */
+  double		edgeLength		/**< is the rate-adjusted edge length */
+  ) const
+	{
+	const double h = 1.e-4*std::max(edgeLength, 1.e-2);
+	const double t = std::max(edgeLength, h);
+	double * * p0 = NewTwoDArray<double>(num_states, num_states);
+	double * * pminus = NewTwoDArray<double>(num_states, num_states);
+	double * * pplus = NewTwoDArray<double>(num_states, num_states);
+	calcPMat(p0, t);
+	calcPMat(pminus, t - h);
+	calcPMat(pplus, t + h);
+	for (unsigned i = 0; i < num_states; ++i)
+		{
+		for (unsigned j = 0; j < num_states; ++j)
+			{
+			dPMat[i][j] = (pplus[i][j] - pminus[i][j])/(2.0*h);
+			d2PMat[i][j] = (pplus[i][j] - 2.0*p0[i][j] + pminus[i][j])/(h*h);
+			}
+		}
+	DeleteTwoDArray<double>(pplus);
+	DeleteTwoDArray<double>(pminus);
+	DeleteTwoDArray<double>(p0);
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Accessor function that returns value of data member `num_states'.
 */
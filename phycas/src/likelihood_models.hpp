@@ -60,7 +60,8 @@ class Model	{
 		virtual void					releaseUpdaters();
 		virtual std::string				getModelName() const = 0;
 		virtual void					calcPMat(double * * pMat, double edgeLength) const = 0;
-		void							calcPMatrices(double * * * pMat, const double * edgeLength, unsigned numRates) const;
+		virtual void					calcPMatrices(double * * * pMat, const double * edgeLength, unsigned numRates) const;
+		virtual void					calcPMatDerivatives(double * * dPMat, double * * d2PMat, double edgeLength) const;
 		virtual std::string				lookupStateRepr(int state) const;
         virtual void					createParameters(TreeShPtr t, MCMCUpdaterVect & edgelens, MCMCUpdaterVect & edgelen_hyperparams, MCMCUpdaterVect & parameters, int subset_pos);
         virtual void					buildStateList(state_list_t &, state_list_pos_t &) const;
@@ -322,6 +323,7 @@ public:
     virtual std::string		getModelName() const;
     double					calcUniformizationLambda() const;
     void					calcPMat(double * * pMat, double edgeLength) const;
+    void					calcPMatDerivatives(double * * dPMat, double * * d2PMat, double edgeLength) const;
     double					calcLMat(double * * lMat) const;
     double					calcUMat(double * * uMat) const;
     virtual std::string		paramHeader() const;
@@ -345,6 +347,7 @@ class HKY: public Model
         double					    calcLMat(double * * lMat) const;
         double					    calcUMat(double * * uMat) const;
         void						calcPMat(double * * pMat, double edgeLength) const;
+        void						calcPMatDerivatives(double * * dPMat, double * * d2PMat, double edgeLength) const;
 
         void						fixKappa();
 		void						freeKappa();
@@ -36,6 +36,10 @@
 #include "phycas/src/internal_data.hpp"
 #include "phycas/src/mcmc_param.hpp"
 #include "phycas/src/mcmc_chain_manager.hpp"
+#include "phycas/src/mcmc_coupler.hpp"
+#include "phycas/src/checkpoint.hpp"
+#include "phycas/src/site_like_file.hpp"
+#include "phycas/src/async_file_writer.hpp"
 //#include "phycas/src/topo_prior_calculator.hpp"
 //#include "phycas/src/larget_simon_move.hpp"
 //#include "phycas/src/ncat_move.hpp"
@@ -79,6 +83,9 @@ class TreeLikelihoodWrapper : public TreeLikelihood
 		TreeLikelihoodWrapper(PyObject * self, PartitionModelShPtr m) : TreeLikelihood(m), m_self(self) 
 			{
 			}
+		TreeLikelihoodWrapper(PyObject * self, PartitionModelShPtr m, bool blocked) : TreeLikelihood(m, blocked), m_self(self) 
+			{
+			}
 		virtual ~TreeLikelihoodWrapper() {} //@POL may need to delete uMat here (see TreeLikelihood::~TreeLikelihood)
 
 		int startTreeViewer(TreeShPtr t, std::string msg, unsigned site) const 
@@ -102,7 +109,6 @@ BOOST_PYTHON_MODULE(_LikelihoodExt)
 	class_<AdHocDensity, boost::noncopyable, boost::shared_ptr<AdHocDensity> >("AdHocDensityBase", no_init)
 		;
 	class_<phycas::BeagleLib, boost::noncopyable, boost::shared_ptr<phycas::BeagleLib> >("BeagleLibBase")
-		.def("init", &BeagleLib::Init)
 		.def("listResources", &BeagleLib::ListResources)
 	;
 	class_<phycas::MCMCChainManager, boost::noncopyable, boost::shared_ptr<phycas::MCMCChainManager> >("MCMCChainManagerBase")
@@ -118,6 +124,7 @@ BOOST_PYTHON_MODULE(_LikelihoodExt)
 		.def("getLastLnPrior", &MCMCChainManager::getLastLnPrior)
         .def("getAllUpdaters", &MCMCChainManager::getAllUpdaters, return_value_policy<copy_const_reference>())
         .def("updateAllUpdaters", &MCMCChainManager::updateAllUpdaters)
+        .def("adaptWeights", &MCMCChainManager::adaptWeights)
         .def("getMoves", &MCMCChainManager::getMoves, return_value_policy<copy_const_reference>())
         .def("getModelParams", &MCMCChainManager::getModelParams, return_value_policy<copy_const_reference>())
         .def("getEdgeLenParams", &MCMCChainManager::getEdgeLenParams, return_value_policy<copy_const_reference>())
@@ -130,6 +137,80 @@ BOOST_PYTHON_MODULE(_LikelihoodExt)
 		.def("getRefTree", &MCMCChainManager::getRefTree) 
 		.def("calcRFDistance", &MCMCChainManager::calcRFDistance) 
 		.def("setMinSSWPSampleSize", &MCMCChainManager::setMinSSWPSampleSize)
+		.def("saveState", &MCMCChainManager::saveState)
+		.def("restoreState", &MCMCChainManager::restoreState)
+		;
+	class_<phycas::MCMCCoupler, boost::noncopyable, boost::shared_ptr<phycas::MCMCCoupler> >("MCMCCouplerBase")
+		.def("addChain", &MCMCCoupler::addChain)
+		.def("setLot", &MCMCCoupler::setLot)
+		.def("setNumThreads", &MCMCCoupler::setNumThreads)
+		.def("getNumThreads", &MCMCCoupler::getNumThreads)
+		.def("allowSwaps", &MCMCCoupler::allowSwaps)
+		.def("isAllowingSwaps", &MCMCCoupler::isAllowingSwaps)
+		.def("getNumChains", &MCMCCoupler::getNumChains)
+		.def("advance", &MCMCCoupler::advance)
+		.def("attemptSwap", &MCMCCoupler::attemptSwap)
+		.def("getChainAtRank", &MCMCCoupler::getChainAtRank)
+		.def("getPowerAtRank", &MCMCCoupler::getPowerAtRank)
+		.def("getNumSwapAttempts", &MCMCCoupler::getNumSwapAttempts)
+		.def("getNumSwapsAccepted", &MCMCCoupler::getNumSwapsAccepted)
+		.def("getSwapTable", &MCMCCoupler::getSwapTable)
+		.def("resetSwapTable", &MCMCCoupler::resetSwapTable)
+		.def("saveState", &MCMCCoupler::saveState)
+		.def("restoreState", &MCMCCoupler::restoreState)
+		;
+	class_<phycas::CheckpointWriter, boost::noncopyable, boost::shared_ptr<phycas::CheckpointWriter> >("CheckpointWriterBase", init<std::string>())
+		.def("putUInt", &CheckpointWriter::putUInt)
+		.def("putDouble", &CheckpointWriter::putDouble)
+		.def("putBool", &CheckpointWriter::putBool)
+		.def("putString", &CheckpointWriter::putString)
+		.def("putDoubleVect", &CheckpointWriter::putDoubleVect)
+		.def("close", &CheckpointWriter::close)
+		;
+	class_<phycas::CheckpointReader, boost::noncopyable, boost::shared_ptr<phycas::CheckpointReader> >("CheckpointReaderBase", init<std::string>())
+		.def("getUInt", &CheckpointReader::getUInt)
+		.def("getDouble", &CheckpointReader::getDouble)
+		.def("getBool", &CheckpointReader::getBool)
+		.def("getString", &CheckpointReader::getString)
+		.def("getDoubleVect", &CheckpointReader::getDoubleVect)
+		.def("atEnd", &CheckpointReader::atEnd)
+		;
+	class_<phycas::SiteLikeWriter, boost::noncopyable, boost::shared_ptr<phycas::SiteLikeWriter> >("SiteLikeWriterBase", init<std::string>())
+		.def("create", &SiteLikeWriter::create)
+		.def("reopen", &SiteLikeWriter::reopen)
+		.def("isOpen", &SiteLikeWriter::isOpen)
+		.def("addSample", &SiteLikeWriter::addSample)
+		.def("addPatternLnLs", &SiteLikeWriter::addPatternLnLs)
+		.def("transferTo", &SiteLikeWriter::transferTo)
+		.def("flush", &SiteLikeWriter::flush)
+		.def("tell", &SiteLikeWriter::tell)
+		.def("close", &SiteLikeWriter::close)
+		.def("setFlushInterval", &SiteLikeWriter::setFlushInterval)
+		.def("getFilename", &SiteLikeWriter::getFilename, return_value_policy<copy_const_reference>())
+		.def("getNumPatterns", &SiteLikeWriter::getNumPatterns)
+		.def("getNumBufferedSamples", &SiteLikeWriter::getNumBufferedSamples)
+		;
+	class_<phycas::AsyncFileWriter, boost::noncopyable, boost::shared_ptr<phycas::AsyncFileWriter> >("AsyncFileWriterBase")
+		.def("open", &AsyncFileWriter::open)
+		.def("isOpen", &AsyncFileWriter::is_open)
+		.def("write", &AsyncFileWriter::writeString)
+		.def("flush", &AsyncFileWriter::flush)
+		.def("sync", &AsyncFileWriter::sync)
+		.def("tellp", &AsyncFileWriter::tellp)
+		.def("close", &AsyncFileWriter::close)
+		.def("fail", &AsyncFileWriter::fail)
+		.def("setFlushInterval", &AsyncFileWriter::setFlushInterval)
+		;
+	class_<phycas::SiteLikeReader, boost::noncopyable, boost::shared_ptr<phycas::SiteLikeReader> >("SiteLikeReaderBase", init<std::string>())
+		.def("isSiteLikeFile", &SiteLikeReader::isSiteLikeFile)
+		.staticmethod("isSiteLikeFile")
+		.def("getNumSites", &SiteLikeReader::getNumSites)
+		.def("getNumPatterns", &SiteLikeReader::getNumPatterns)
+		.def("getNumSamples", &SiteLikeReader::getNumSamples)
+		.def("getCharToPattern", &SiteLikeReader::getCharToPattern, return_value_policy<copy_const_reference>())
+		.def("getCycles", &SiteLikeReader::getCycles)
+		.def("getPatternSamples", &SiteLikeReader::getPatternSamples)
+		.def("calcSiteLogHarmonicMeans", &SiteLikeReader::calcSiteLogHarmonicMeans)
 		;
 	class_<std::vector<MCMCUpdaterShPtr> >("paramVec", no_init)
 		.def("__iter__",  iterator<std::vector<MCMCUpdaterShPtr> >())
@@ -175,7 +256,7 @@ BOOST_PYTHON_MODULE(_LikelihoodExt)
 		.def("setNumSitesVect", &phycas::PartitionModel::setNumSitesVect)
 		.def("getSiteAssignments", &phycas::PartitionModel::getSiteAssignments, return_value_policy<copy_const_reference>())
 		;
-	class_<TreeLikelihood, TreeLikelihoodWrapper, boost::noncopyable>("TreeLikelihoodBase", init<boost::shared_ptr<PartitionModel> >())
+	class_<TreeLikelihood, TreeLikelihoodWrapper, boost::noncopyable>("TreeLikelihoodBase", init<boost::shared_ptr<PartitionModel>, optional<bool> >())
         .def("calcLogLikeAtSubstitutionSaturation", &TreeLikelihood::calcLogLikeAtSubstitutionSaturation)
 		.def("getPatternCounts", &TreeLikelihood::getPatternCounts, return_value_policy<copy_const_reference>())
 		.def("getCharIndexToPatternIndex", &TreeLikelihood::getCharIndexToPatternIndex, return_value_policy<copy_const_reference>())
@@ -183,6 +264,7 @@ BOOST_PYTHON_MODULE(_LikelihoodExt)
 		.def("getSiteUF", &TreeLikelihood::getSiteUF, return_value_policy<copy_const_reference>())
 		.def("storingSiteLikelihoods", &TreeLikelihood::storingSiteLikelihoods)
 		.def("storeSiteLikelihoods", &TreeLikelihood::storeSiteLikelihoods)
+		.def("hasSiteLikelihoodsFor", &TreeLikelihood::hasSiteLikelihoodsFor)
 		.def("copyDataFromDiscreteMatrix", &TreeLikelihood::copyDataFromDiscreteMatrix)
 		.def("copyDataFromSimData", &TreeLikelihood::copyDataFromSimData)
 		.def("prepareForSimulation", &TreeLikelihood::prepareForSimulation)
@@ -194,6 +276,11 @@ BOOST_PYTHON_MODULE(_LikelihoodExt)
 		.def("invalidateAwayFromNode", &TreeLikelihood::invalidateAwayFromNode)
 		.def("calcLnLFromNode", &TreeLikelihood::calcLnLFromNode)
 		.def("calcLnL", &TreeLikelihood::calcLnL)
+		.def("prepareEdgeLnL", &TreeLikelihood::prepareEdgeLnL)
+		.def("calcEdgeLnL", &TreeLikelihood::calcEdgeLnL)
+		.def("calcEdgeLenDerivatives", &TreeLikelihood::calcEdgeLenDerivatives)
+		.def("getEdgeLenFirstDerivs", &TreeLikelihood::getEdgeLenFirstDerivs, return_value_policy<copy_const_reference>())
+		.def("getEdgeLenSecondDerivs", &TreeLikelihood::getEdgeLenSecondDerivs, return_value_policy<copy_const_reference>())
 		.def("simulateFirst", &TreeLikelihood::simulateFirst)
 		.def("simulate", &TreeLikelihood::simulate)
 		.def("listPatterns", &TreeLikelihood::listPatterns)
@@ -211,16 +298,44 @@ BOOST_PYTHON_MODULE(_LikelihoodExt)
 		.def("getLikelihoodRootNodeNum", &TreeLikelihood::getLikelihoodRootNodeNum)
 		.def("useUnimap", &TreeLikelihood::useUnimap)
 		.def("isUsingUnimap", &TreeLikelihood::isUsingUnimap)
+		.def("isPatternBlocked", &TreeLikelihood::isPatternBlocked)
 		.def("fullRemapping", &TreeLikelihood::fullRemapping)
 		.def("setUFNumEdges", &TreeLikelihood::setUFNumEdges)
+		.def("usePowerOfTwoScaling", &TreeLikelihood::usePowerOfTwoScaling)
+		.def("isUsingPowerOfTwoScaling", &TreeLikelihood::isUsingPowerOfTwoScaling)
+		.def("getCLAKernelLevel", &TreeLikelihood::getCLAKernelLevel)
+		.def("setCLAKernelLevel", &TreeLikelihood::setCLAKernelLevel)
+		.def("getCLAKernelName", &TreeLikelihood::getCLAKernelName)
+		.def("isUsingFloatCLAs", &TreeLikelihood::isUsingFloatCLAs)
+		.def("getNumThreads", &TreeLikelihood::getNumThreads)
+		.def("setNumThreads", &TreeLikelihood::setNumThreads)
+		.def("usePMatCache", &TreeLikelihood::usePMatCache)
+		.def("isUsingPMatCache", &TreeLikelihood::isUsingPMatCache)
+		.def("getPMatCacheHits", &TreeLikelihood::getPMatCacheHits)
+		.def("getPMatCacheMisses", &TreeLikelihood::getPMatCacheMisses)
+		.def("resetPMatCacheStats", &TreeLikelihood::resetPMatCacheStats)
+		.def("isTimingHotPaths", &TreeLikelihood::isTimingHotPaths)
+		.def("getNumCLACalcs", &TreeLikelihood::getNumCLACalcs)
+		.def("getCLACalcSeconds", &TreeLikelihood::getCLACalcSeconds)
+		.def("getNumPMatCalcs", &TreeLikelihood::getNumPMatCalcs)
+		.def("getPMatCalcSeconds", &TreeLikelihood::getPMatCalcSeconds)
+		.def("getNumUnderflowCorrections", &TreeLikelihood::getNumUnderflowCorrections)
+		.def("getUnderflowCorrectionSeconds", &TreeLikelihood::getUnderflowCorrectionSeconds)
+		.def("getNumCacheRestores", &TreeLikelihood::getNumCacheRestores)
+		.def("resetHotPathStats", &TreeLikelihood::resetHotPathStats)
 		.def("bytesPerCLA", &TreeLikelihood::bytesPerCLA)
 		.def("numCLAsCreated", &TreeLikelihood::numCLAsCreated)
 		.def("numCLAsStored", &TreeLikelihood::numCLAsStored)
+		.def("useCLAArena", &TreeLikelihood::useCLAArena)
+		.def("isUsingCLAArena", &TreeLikelihood::isUsingCLAArena)
 		.def("setLot", &TreeLikelihood::setLot)
 		//.def("setDebug", &TreeLikelihood::setDebug)
 		.def("debugCheckForUncachedCLAs", &TreeLikelihood::debugCheckForUncachedCLAs)
 		.def("getNPatterns", &TreeLikelihood::getNumPatterns)
         .def("useBeagleLib", &TreeLikelihood::useBeagleLib)
+        .def("isUsingBeagleLib", &TreeLikelihood::isUsingBeagleLib)
+        .def("useLikelihoodEngine", &TreeLikelihood::useLikelihoodEngine)
+        .def("getLikelihoodEngineName", &TreeLikelihood::getLikelihoodEngineName)
 		;
 	class_<TipData, boost::noncopyable>("TipData", no_init)
 		.def("parentalCLAValid", &TipData::parentalCLAValid)
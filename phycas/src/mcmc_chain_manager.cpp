@@ -17,6 +17,7 @@
 |  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
 \~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 #include <cstdlib>
+#include <cmath>
 
 #include <fstream>//temp 
 
@@ -30,6 +31,8 @@
 #include "phycas/src/basic_tree.hpp"
 #include "phycas/src/mapping_move.hpp"
 #include "phycas/src/dirichlet_move.hpp"
+#include "phycas/src/tree_likelihood.hpp"
+#include "phycas/src/checkpoint.hpp"
 
 extern "C"
 {
@@ -590,6 +593,102 @@ void MCMCChainManager::refreshLastLnPrior()
 		}
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes the complete state of this chain to `out' so that restoreState can later resume it exactly: the current log
+|	likelihood and log prior, the tree (topology, node numbers, node names and edge lengths), the state of the 
+|	pseudorandom number generator shared by the updaters, and the state of every updater (see MCMCUpdater::saveState).
+|	The topology is stored as a Newick description, but node numbers and edge lengths are stored separately in preorder
+|	sequence as raw values so that nothing is lost to rounding.
+*/
+void MCMCChainManager::saveState(
+  CheckpointWriter & out) const	/**< is the checkpoint being written */
+	{
+	if (dirty)
+		{
+		throw XLikelihood("cannot call saveState() for chain manager before calling finalize()");
+		}
+	PHYCAS_ASSERT(!all_updaters.empty());
+	MCMCUpdaterShPtr u = all_updaters.front();
+
+	out.putDouble(last_ln_like);
+	out.putDouble(last_ln_prior);
+
+	TreeShPtr t = u->getTree();
+	out.putString(t->MakeNumberedNewick());
+	double_vect_t edgelens;
+	out.putUInt(t->GetNNodes());
+	for (preorder_iterator nd = t->begin(); nd != t->end(); ++nd)
+		{
+		out.putUInt(nd->GetNodeNumber());
+		out.putString(nd->GetNodeName());
+		edgelens.push_back(nd->GetEdgeLen());
+		}
+	out.putDoubleVect(edgelens);
+
+	out.putString(u->getLot()->GetState());
+
+	out.putUInt((unsigned)all_updaters.size());
+	for (MCMCUpdaterConstIter it = all_updaters.begin(); it != all_updaters.end(); ++it)
+		(*it)->saveState(out);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the state written by saveState. The tree is rebuilt in place (so that every updater keeps pointing to it) 
+|	and prepared anew for likelihood calculations. This chain manager must have been set up exactly as the one that 
+|	wrote the checkpoint (same data, model and updaters); an XLikelihood exception is thrown if a mismatch is detected.
+*/
+void MCMCChainManager::restoreState(
+  CheckpointReader & in)	/**< is the checkpoint being read */
+	{
+	if (dirty)
+		{
+		throw XLikelihood("cannot call restoreState() for chain manager before calling finalize()");
+		}
+	PHYCAS_ASSERT(!all_updaters.empty());
+	MCMCUpdaterShPtr u = all_updaters.front();
+
+	const double ln_like = in.getDouble();
+	const double ln_prior = in.getDouble();
+
+	TreeShPtr t = u->getTree();
+	t->BuildFromString(in.getString());
+	const unsigned nnodes = in.getUInt();
+	if (nnodes != t->GetNNodes())
+		throw XLikelihood("tree stored in checkpoint is corrupt");
+	for (preorder_iterator nd = t->begin(); nd != t->end(); ++nd)
+		{
+		const unsigned num = in.getUInt();
+		if (nd->IsTip() && nd->GetNodeNumber() != num)
+			throw XLikelihood("tree stored in checkpoint could not be rebuilt");
+		nd->SetNodeNum(num);
+		nd->SetNodeName(in.getString());
+		}
+	const double_vect_t edgelens = in.getDoubleVect();
+	if (edgelens.size() != nnodes)
+		throw XLikelihood("tree stored in checkpoint is corrupt");
+	double_vect_t::const_iterator edgelen_it = edgelens.begin();
+	for (preorder_iterator nd = t->begin(); nd != t->end(); ++nd)
+		nd->SetEdgeLen(*edgelen_it++);
+
+	u->getLot()->SetState(in.getString());
+
+	const unsigned nupdaters = in.getUInt();
+	if (nupdaters != all_updaters.size())
+		throw XLikelihood(boost::str(boost::format("checkpoint has state for %d updaters but this chain has %d") % nupdaters % all_updaters.size()));
+	for (MCMCUpdaterIter it = all_updaters.begin(); it != all_updaters.end(); ++it)
+		(*it)->restoreState(in);
+
+	TreeLikeShPtr likelihood = u->getTreeLikelihood();
+	if (likelihood)
+		{
+		likelihood->recalcRelativeRates();
+		likelihood->prepareForLikelihood(t);
+		}
+
+	last_ln_like = ln_like;
+	last_ln_prior = ln_prior;
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Adds edge length parameters (if `separate_edgelen_params' is true) and model-specific parameters to the 
 |	`edge_len_params' and `model_params' data members, respectively. Also adds edge length hyperparameters to the 
@@ -729,7 +828,7 @@ void MCMCChainManager::verboseUpdateAllUpdaters()
 			{
 			std::cerr << "########## updating " << nm << "..." << std::endl;
 			(*it)->setSaveDebugInfo(true);
-			(*it)->update();
+			(*it)->timedUpdate();
 			std::cerr << boost::str(boost::format("%s | %s") % nm % (*it)->getDebugInfo()) << std::endl;
 			}
 		}
@@ -746,7 +845,7 @@ void MCMCChainManager::quietUpdateAllUpdaters()
 		unsigned w = (*it)->getWeight();
 		for (unsigned i = 0; i < w; ++i)
 			{
-			(*it)->update();
+			(*it)->timedUpdate();
 			}
 		}
 	}
@@ -771,6 +870,64 @@ void MCMCChainManager::updateAllUpdaters()
 #	endif
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Re-weights the Metropolis-Hastings moves so that more of each cycle is spent on moves that change the state of the 
+|	chain cheaply and less on moves that are expensive or seldom accepted. The efficiency of a move is taken to be the 
+|	number of its proposals accepted per second spent in its update function, using the acceptance rate since the last 
+|	call to resetDiagnostics (smoothed by adding half an acceptance and one attempt, so that a move whose proposals were
+|	all rejected is not given zero efficiency) and the time per update measured by MCMCUpdater::timedUpdate since the 
+|	last call to resetTimedUpdateStats. Because a move only forces recalculation of the conditional likelihood arrays it
+|	invalidates, local moves are usually much cheaper than global ones, and the measured time reflects this. Each move's
+|	weight is then set to its base weight multiplied by its efficiency relative to the geometric mean efficiency of all 
+|	moves considered, limited to the range allowed by `max_factor' (see MCMCUpdater::scaleWeight). Acceptance rate is 
+|	only a proxy for a move's contribution to the effective sample size, and changing weights while samples are being 
+|	saved would make the chain inhomogeneous, so this function should only be called during burn-in. Moves that are 
+|	fixed, have a weight of zero or have not yet been both attempted and timed are left alone, as are parameters (which
+|	are updated by slice sampling and thus always "accept"). Returns the number of moves re-weighted, which is 0 if fewer
+|	than two moves could be compared (as is always the case if Phycas was compiled with PHYCAS_NO_HOT_PATH_TIMING 
+|	defined).
+*/
+unsigned MCMCChainManager::adaptWeights(
+  double max_factor)	/**< is the largest factor by which a move's weight may grow or shrink relative to its base weight */
+	{
+	if (dirty)
+		{
+		throw XLikelihood("cannot call adaptWeights() for chain manager before calling finalize()");
+		}
+	if (max_factor < 1.0)
+		{
+		throw XLikelihood("max_factor supplied to adaptWeights() must be at least 1");
+		}
+
+	MCMCUpdaterVect candidates;
+	double_vect_t log_efficiency;
+	for (MCMCUpdaterIter it = all_updaters.begin(); it != all_updaters.end(); ++it)
+		{
+		MCMCUpdaterShPtr u = *it;
+		if (!u->isMove() || u->hasSliceSampler() || u->isFixed() || u->getBaseWeight() == 0)
+			continue;
+		const double nattempts = u->getNumAttempts();
+		const double nupdates = u->getNumTimedUpdates();
+		const double secs = u->getTimedUpdateSeconds();
+		if (nattempts == 0.0 || nupdates == 0.0 || secs <= 0.0)
+			continue;
+		const double accept_rate = (u->getNumAccepts() + 0.5)/(nattempts + 1.0);
+		candidates.push_back(u);
+		log_efficiency.push_back(std::log(accept_rate*nupdates/secs));
+		}
+	if (candidates.size() < 2)
+		return 0;
+
+	double mean_log_efficiency = 0.0;
+	for (double_vect_t::const_iterator it = log_efficiency.begin(); it != log_efficiency.end(); ++it)
+		mean_log_efficiency += *it;
+	mean_log_efficiency /= (double)log_efficiency.size();
+
+	for (unsigned i = 0; i < (unsigned)candidates.size(); ++i)
+		candidates[i]->scaleWeight(std::exp(log_efficiency[i] - mean_log_efficiency), max_factor);
+	return (unsigned)candidates.size();
+	}
+
 
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -90,6 +90,9 @@ class MCMCChainManager : public MCMCChainManagerThisShPtr
         double                  praxisCalcLogPosterior(double * x);      
 		void					refreshLastLnLike();
 		void					refreshLastLnPrior();
+
+		void					saveState(CheckpointWriter & out) const;
+		void					restoreState(CheckpointReader & in);
 		
 		void					setMinSSWPSampleSize(unsigned n);
         double                  calcExternalEdgeLenWorkingPrior(const TreeNode & nd, double v) const;
@@ -111,6 +114,7 @@ class MCMCChainManager : public MCMCChainManagerThisShPtr
 		void					clear();
 		
 		void					updateAllUpdaters();
+		unsigned				adaptWeights(double max_factor);
 
 		const MCMCUpdaterVect &	getAllUpdaters() const;
 
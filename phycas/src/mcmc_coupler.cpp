@@ -0,0 +1,289 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#include <cmath>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include "phycas/src/mcmc_coupler.hpp"
+#include "phycas/src/mcmc_updater.hpp"
+#include "phycas/src/basic_lot.hpp"
+#include "phycas/src/xlikelihood.hpp"
+#include "phycas/src/checkpoint.hpp"
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Constructor creates a coupler with no chains that updates chains in a single thread until setNumThreads is called.
+*/
+MCMCCoupler::MCMCCoupler()
+  : num_threads(1), swapping(true)
+	{
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Destructor stops the worker threads (if any) before the chain managers are released.
+*/
+MCMCCoupler::~MCMCCoupler()
+	{
+	pool.reset();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Adds the chain managed by `cm' at the next rank of the heating ladder and sets the power of all of its updaters to
+|	`power'. Chains should be added in the same order as MCMCManager.chains (cold chain first). Adding a chain resets
+|	the swap table.
+*/
+void MCMCCoupler::addChain(
+  ChainManagerShPtr cm,		/**< is the chain manager of the chain to add (must already be finalized) */
+  double power)				/**< is the heating power of the new rank */
+	{
+	PHYCAS_ASSERT(cm);
+	rank_to_chain.push_back((unsigned)chains.size());
+	chains.push_back(cm);
+	powers.push_back(power);
+	setChainPower((unsigned)chains.size() - 1, power);
+	resetSwapTable();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the pseudorandom number generator used to choose which ranks to swap and to decide whether to accept swaps.
+|	This must not be the generator used by any of the chains.
+*/
+void MCMCCoupler::setLot(
+  LotShPtr r)	/**< is the pseudorandom number generator to use */
+	{
+	rng = r;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the number of threads among which chains are divided in advance. Using more threads than there are chains
+|	gains nothing, so at most getNumChains() threads are started.
+*/
+void MCMCCoupler::setNumThreads(
+  unsigned n)	/**< is the number of threads (values less than 1 are treated as 1) */
+	{
+	n = std::max(n, 1U);
+	if (n != num_threads)
+		{
+		num_threads = n;
+		pool.reset();
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	If `allow' is false, advance no longer attempts swaps, so the chains run independently of one another (each keeping
+|	the power it was given in addChain). Swaps are allowed by default.
+*/
+void MCMCCoupler::allowSwaps(
+  bool allow)	/**< is true if chains should be coupled by swaps */
+	{
+	swapping = allow;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Performs `ncycles' cycles. In each cycle, every chain performs one complete update cycle, with chains divided among
+|	getNumThreads() threads, after which one swap between two randomly-chosen ranks is attempted (unless swaps have been
+|	turned off using allowSwaps).
+*/
+void MCMCCoupler::advance(
+  unsigned ncycles)		/**< is the number of cycles to perform */
+	{
+	const unsigned nchains = getNumChains();
+	if (nchains == 0)
+		return;
+
+	const unsigned nthreads = std::min(num_threads, nchains);
+	if (!pool || pool->getNumThreads() != nthreads)
+		pool.reset(new ThreadPool(nthreads));
+
+	const ThreadPool::Task task = boost::bind(&MCMCCoupler::updateChain, this, _1, _2);
+	for (unsigned cycle = 0; cycle < ncycles; ++cycle)
+		{
+		pool->run(nchains, task);
+		if (swapping)
+			attemptSwap();
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Attempts to swap two randomly-chosen ranks i < j, accepting with probability
+|>
+|	min{1, [L(theta_i) f(theta_i)]^(power_j - power_i) [L(theta_j) f(theta_j)]^(power_i - power_j)}
+|>
+|	where theta_i is the current state of the chain at rank i. If accepted, the two chains exchange powers and ranks.
+|	Returns true if the swap was accepted. Does nothing (and returns false) if there are fewer than two chains.
+*/
+bool MCMCCoupler::attemptSwap()
+	{
+	const unsigned nchains = getNumChains();
+	if (nchains < 2)
+		return false;
+	if (!rng)
+		throw XLikelihood("MCMCCoupler::setLot must be called before chains can be swapped");
+
+	unsigned i = rng->SampleUInt(nchains);
+	unsigned j = rng->SampleUInt(nchains - 1);
+	if (j >= i)
+		++j;
+	else
+		std::swap(i, j);
+
+	ChainManagerShPtr cmi = chains[rank_to_chain[i]];
+	cmi->refreshLastLnLike();
+	cmi->refreshLastLnPrior();
+
+	ChainManagerShPtr cmj = chains[rank_to_chain[j]];
+	cmj->refreshLastLnLike();
+	cmj->refreshLastLnPrior();
+
+	const double log_accept_ratio = (powers[j] - powers[i])*(cmi->getLastLnLike() + cmi->getLastLnPrior() - cmj->getLastLnLike() - cmj->getLastLnPrior());
+	const double log_u = std::log(rng->Uniform(FILE_AND_LINE));
+
+	++swap_table[i*nchains + j];
+	if (log_u >= log_accept_ratio)
+		return false;
+
+	setChainPower(rank_to_chain[i], powers[j]);
+	setChainPower(rank_to_chain[j], powers[i]);
+	std::swap(rank_to_chain[i], rank_to_chain[j]);
+	++swap_table[j*nchains + i];
+	return true;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the index (in the order chains were added) of the chain currently at rank `rank'.
+*/
+unsigned MCMCCoupler::getChainAtRank(
+  unsigned rank) const	/**< is the rank (0 is the first rank added, normally the cold chain) */
+	{
+	PHYCAS_ASSERT(rank < rank_to_chain.size());
+	return rank_to_chain[rank];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the heating power associated with rank `rank'.
+*/
+double MCMCCoupler::getPowerAtRank(
+  unsigned rank) const	/**< is the rank */
+	{
+	PHYCAS_ASSERT(rank < powers.size());
+	return powers[rank];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of swaps attempted between ranks `i' and `j' since the swap table was last reset.
+*/
+unsigned MCMCCoupler::getNumSwapAttempts(
+  unsigned i,			/**< is one rank */
+  unsigned j) const		/**< is the other rank */
+	{
+	const unsigned nchains = getNumChains();
+	PHYCAS_ASSERT(i < nchains && j < nchains);
+	return swap_table[std::min(i, j)*nchains + std::max(i, j)];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of swaps accepted between ranks `i' and `j' since the swap table was last reset.
+*/
+unsigned MCMCCoupler::getNumSwapsAccepted(
+  unsigned i,			/**< is one rank */
+  unsigned j) const		/**< is the other rank */
+	{
+	const unsigned nchains = getNumChains();
+	PHYCAS_ASSERT(i < nchains && j < nchains);
+	return swap_table[std::max(i, j)*nchains + std::min(i, j)];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns a copy of the swap table, stored row by row (element [i][j] is at position i*getNumChains() + j).
+*/
+std::vector<unsigned> MCMCCoupler::getSwapTable() const
+	{
+	return swap_table;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets all elements of the swap table to zero.
+*/
+void MCMCCoupler::resetSwapTable()
+	{
+	swap_table.assign(chains.size()*chains.size(), 0);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes the current rank of each chain and the swap table to `out'. The chains themselves, and the Lot supplied to
+|	setLot, must be saved separately (see MCMCChainManager::saveState).
+*/
+void MCMCCoupler::saveState(
+  CheckpointWriter & out) const	/**< is the checkpoint being written */
+	{
+	out.putUInt((unsigned)chains.size());
+	for (std::vector<unsigned>::const_iterator it = rank_to_chain.begin(); it != rank_to_chain.end(); ++it)
+		out.putUInt(*it);
+	for (std::vector<unsigned>::const_iterator it = swap_table.begin(); it != swap_table.end(); ++it)
+		out.putUInt(*it);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the ranks and swap table written by saveState and gives each chain the power belonging to its restored 
+|	rank. Throws XLikelihood if the checkpoint was written by a coupler with a different number of chains.
+*/
+void MCMCCoupler::restoreState(
+  CheckpointReader & in)	/**< is the checkpoint being read */
+	{
+	const unsigned n = in.getUInt();
+	if (n != chains.size())
+		throw XLikelihood(boost::str(boost::format("checkpoint has %d coupled chains but this coupler has %d") % n % chains.size()));
+	for (std::vector<unsigned>::iterator it = rank_to_chain.begin(); it != rank_to_chain.end(); ++it)
+		{
+		*it = in.getUInt();
+		if (*it >= n)
+			throw XLikelihood("coupled chain ranks stored in checkpoint are corrupt");
+		}
+	for (std::vector<unsigned>::iterator it = swap_table.begin(); it != swap_table.end(); ++it)
+		*it = in.getUInt();
+	for (unsigned k = 0; k < n; ++k)
+		setChainPower(rank_to_chain[k], powers[k]);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Performs one update cycle for the chain at rank `rank'. Called by the thread pool, so it must touch nothing that
+|	belongs to another chain.
+*/
+void MCMCCoupler::updateChain(
+  unsigned rank,		/**< is the rank of the chain to update */
+  unsigned)				/**< is the index of the thread doing the update (not used) */
+	{
+	chains[rank_to_chain[rank]]->updateAllUpdaters();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the heating power of every updater of the chain with index `chain_index' to `power'.
+*/
+void MCMCCoupler::setChainPower(
+  unsigned chain_index,	/**< is the index of the chain (in the order chains were added) */
+  double power)			/**< is the new heating power */
+	{
+	const MCMCUpdaterVect & updaters = chains[chain_index]->getAllUpdaters();
+	for (MCMCUpdaterVect::const_iterator it = updaters.begin(); it != updaters.end(); ++it)
+		(*it)->setPower(power);
+	}
+
+} // namespace phycas
@@ -0,0 +1,96 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(MCMC_COUPLER_HPP)
+#define MCMC_COUPLER_HPP
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "phycas/src/mcmc_chain_manager.hpp"		// for ChainManagerShPtr (plus MCMCUpdaterVect, LotShPtr, etc.)
+#include "phycas/src/thread_pool.hpp"
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Runs the chains of a Metropolis-coupled MCMC (MCMCMC) analysis. Between swap attempts, each chain performs its
+|	update cycle (MCMCChainManager::updateAllUpdaters) in its own thread; the swap attempt that follows each cycle is
+|	made here in C++, so Python is only involved between calls to advance.
+|
+|	Chains are identified by the order in which they were added (chain index) and by their current position in the
+|	heating ladder (rank). The power associated with each rank never changes; when a swap between ranks i and j is
+|	accepted, the two chains exchange powers and ranks, just as MCMCManager.attemptChainSwap does in Python. The swap
+|	table uses the same layout as MCMCManager.swap_table: element [i][j] with i < j counts attempted swaps between
+|	ranks i and j, and element [j][i] counts the accepted ones.
+|
+|	Chains are updated concurrently, so no two chains may share a pseudorandom number generator, and no updater may
+|	call back into Python. The Lot supplied to setLot is used only for choosing and accepting swaps. If swapping is
+|	turned off (see allowSwaps), the chains are simply independent chains run side by side, which is how several power
+|	posteriors are explored at once in steppingstone sampling.
+*/
+class MCMCCoupler : boost::noncopyable
+	{
+	public:
+									MCMCCoupler();
+									~MCMCCoupler();
+
+		void						addChain(ChainManagerShPtr cm, double power);
+		void						setLot(LotShPtr r);
+		void						setNumThreads(unsigned n);
+		void						allowSwaps(bool allow);
+		bool						isAllowingSwaps() const;
+		unsigned					getNumThreads() const;
+		unsigned					getNumChains() const;
+
+		void						advance(unsigned ncycles);
+		bool						attemptSwap();
+
+		unsigned					getChainAtRank(unsigned rank) const;
+		double						getPowerAtRank(unsigned rank) const;
+		unsigned					getNumSwapAttempts(unsigned i, unsigned j) const;
+		unsigned					getNumSwapsAccepted(unsigned i, unsigned j) const;
+		std::vector<unsigned>		getSwapTable() const;
+		void						resetSwapTable();
+
+		void						saveState(CheckpointWriter & out) const;
+		void						restoreState(CheckpointReader & in);
+
+	private:
+
+		void						updateChain(unsigned rank, unsigned thread_index);
+		void						setChainPower(unsigned chain_index, double power);
+
+		std::vector<ChainManagerShPtr>	chains;			/**< The chain managers, in the order in which they were added */
+		std::vector<double>			powers;				/**< powers[k] is the heating power of the chain at rank k */
+		std::vector<unsigned>		rank_to_chain;		/**< rank_to_chain[k] is the index (into `chains') of the chain at rank k */
+		std::vector<unsigned>		swap_table;			/**< Attempted (upper triangle) and accepted (lower triangle) swaps, stored row by row */
+		LotShPtr					rng;				/**< The pseudorandom number generator used to choose and accept swaps */
+		unsigned					num_threads;		/**< The number of threads among which chains are divided */
+		bool						swapping;			/**< If true, advance attempts a swap after each cycle; if false, chains run independently */
+		ThreadPoolShPtr				pool;				/**< The threads that update the chains (created on first use) */
+	};
+
+typedef boost::shared_ptr<MCMCCoupler> MCMCCouplerShPtr;
+
+} // namespace phycas
+
+#include "phycas/src/mcmc_coupler.inl"
+
+#endif
@@ -0,0 +1,52 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(MCMC_COUPLER_INL)
+#define MCMC_COUPLER_INL
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of threads among which chains are divided in advance.
+*/
+inline unsigned MCMCCoupler::getNumThreads() const
+	{
+	return num_threads;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if advance attempts a chain swap after each cycle.
+*/
+inline bool MCMCCoupler::isAllowingSwaps() const
+	{
+	return swapping;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of chains added so far.
+*/
+inline unsigned MCMCCoupler::getNumChains() const
+	{
+	return (unsigned)chains.size();
+	}
+
+} // namespace phycas
+
+#endif
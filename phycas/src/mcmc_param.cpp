@@ -34,7 +34,7 @@ namespace phycas
 |	`curr_value' data member to 4.0 and refreshes `curr_ln_prior' accordingly.
 */
 EdgeLenParam::EdgeLenParam()
-  : MCMCUpdater(), my_node(NULL)
+  : MCMCUpdater(), my_node(NULL), edge_lnl_ready(false)
 	{
 	curr_value = 0.01;
 	has_slice_sampler = true;
@@ -82,7 +82,9 @@ bool EdgeLenParam::isExternalEdge()
 #endif
 	
 /*----------------------------------------------------------------------------------------------------------------------
-|	Calls the sample() member function of the `slice_sampler' data member.
+|	Calls the sample() member function of the `slice_sampler' data member. Only the length of the edge managed by this
+|	object changes while sampling, so TreeLikelihood::prepareEdgeLnL is called first, allowing operator() to use the
+|	much faster TreeLikelihood::calcEdgeLnL in place of TreeLikelihood::calcLnL.
 */
 bool EdgeLenParam::update()
 	{
@@ -94,6 +96,7 @@ bool EdgeLenParam::update()
 	else 
 		likelihood->useAsLikelihoodRoot(my_node->GetParent());
 	likelihood->invalidateAwayFromNode(*my_node);
+	edge_lnl_ready = (heating_power > 0.0 && likelihood->prepareEdgeLnL(tree, my_node));
 
 	double current_brlen = getCurrValueFromModel();
 	
@@ -106,6 +109,7 @@ bool EdgeLenParam::update()
 	//	}
 	slice_sampler->SetXValue(current_brlen);
 	slice_sampler->Sample();
+	edge_lnl_ready = false;
 	
 	ChainManagerShPtr p = chain_mgr.lock();
 	
@@ -200,7 +204,12 @@ double EdgeLenParam::operator()(
 			
 		//likelihood->startTreeViewer(tree, boost::str(boost::format("Before calcLnL: new edge length = %.6f") % v));
 		
-		curr_ln_like = (heating_power > 0.0 ? likelihood->calcLnL(tree) : 0.0);
+		if (heating_power == 0.0)
+			curr_ln_like = 0.0;
+		else if (edge_lnl_ready)
+			curr_ln_like = likelihood->calcEdgeLnL();
+		else
+			curr_ln_like = likelihood->calcLnL(tree);
 		
 		//likelihood->startTreeViewer(tree, boost::str(boost::format("After calcLnL: curr_ln_like = %.6f") % curr_ln_like));
 		
@@ -272,7 +281,7 @@ double GTRRateParam::operator()(
 		PHYCAS_ASSERT(gtr);
 		sendCurrValueToModel(r);
 		recalcPrior();
-		likelihood->useAsLikelihoodRoot(NULL);	// invalidates all CLAs
+		likelihood->invalidateSubsetCLAs(model);	// invalidates the CLAs of the subset(s) using this model
         curr_ln_like = (heating_power > 0.0 ? likelihood->calcLnL(tree) : 0.0);
 		ChainManagerShPtr p = chain_mgr.lock();
 		PHYCAS_ASSERT(p);
@@ -350,7 +359,7 @@ double OmegaParam::operator()(
 		sendCurrValueToModel(w);
 		recalcPrior();
 
-		likelihood->useAsLikelihoodRoot(NULL);	// invalidates all CLAs
+		likelihood->invalidateSubsetCLAs(model);	// invalidates the CLAs of the subset(s) using this model
 		curr_ln_like = (heating_power > 0.0 ? likelihood->calcLnL(tree) : 0.0);
 		ChainManagerShPtr p = chain_mgr.lock();
 		PHYCAS_ASSERT(p);
@@ -405,7 +414,7 @@ double PinvarParam::operator()(
 		sendCurrValueToModel(pinv);
 		recalcPrior(); // base class function that recomputes curr_ln_prior for the value curr_value
 		likelihood->recalcRelativeRates();	// must do this whenever model's rate heterogeneity status changes
-		likelihood->useAsLikelihoodRoot(NULL);	// invalidates all CLAs
+		likelihood->invalidateSubsetCLAs(model);	// invalidates the CLAs of the subset(s) using this model
 		curr_ln_like = (heating_power > 0.0 ? likelihood->calcLnL(tree) : 0.0);
 		ChainManagerShPtr p = chain_mgr.lock();
 		PHYCAS_ASSERT(p);
@@ -464,7 +473,7 @@ double StateFreqParam::operator()(
         //model.normalizeFreqs(state_freq.freqs);
 		sendCurrValueToModel(f);
 		recalcPrior();
-		likelihood->useAsLikelihoodRoot(NULL);	// invalidates all CLAs
+		likelihood->invalidateSubsetCLAs(model);	// invalidates the CLAs of the subset(s) using this model
         curr_ln_like = (heating_power > 0.0 ? likelihood->calcLnL(tree) : 0.0);
 		ChainManagerShPtr p = chain_mgr.lock();
 		PHYCAS_ASSERT(p);
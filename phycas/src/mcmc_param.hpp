@@ -212,6 +212,7 @@ class EdgeLenParam : public MCMCUpdater
 		
 	//temp private:
 		TreeNode *		my_node;
+		bool			edge_lnl_ready;		/**< If true, operator() computes the likelihood using TreeLikelihood::calcEdgeLnL (true only during update) */
 	};
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -235,8 +236,13 @@ class EdgeLenMasterParam : public MCMCUpdater
 							
 		void				educateWorkingPrior();
 		void				finalizeWorkingPrior();
+		void				copyWorkingPriorSample(const MCMCUpdater & other);
+		void				saveState(CheckpointWriter & out) const;
+		void				restoreState(CheckpointReader & in);
 		double				recalcWorkingPrior() const;
 		double				lnWorkingPriorOneEdge(const TreeNode & nd, double v) const;
+		double				lnPriorDerivOneEdge(const TreeNode & nd) const;
+		double				lnWorkingPriorDerivOneEdge(const TreeNode & nd) const;
 		std::string 		getWorkingPriorDescr() const;
 
 		virtual double		recalcPrior();
@@ -17,6 +17,9 @@
 |  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
 \~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
+#include <cmath>
+#include <algorithm>
+
 //#include "phycas/force_include.h"
 #include "phycas/src/likelihood_models.hpp"
 #include "phycas/src/tree_likelihood.hpp"
@@ -24,6 +27,8 @@
 #include "phycas/src/mcmc_param.hpp"
 #include "phycas/src/basic_tree.hpp"
 #include "phycas/src/mcmc_chain_manager.hpp"
+#include "phycas/src/checkpoint.hpp"
+#include "phycas/src/xlikelihood.hpp"
 
 namespace phycas
 {
@@ -35,9 +40,11 @@ namespace phycas
 */
 MCMCUpdater::MCMCUpdater()
   : 
+  base_weight(0),
   use_ref_dist(false),
   nattempts(0.0),
   naccepts(0.0),
+  update_lnl_evals(0.0),
   curr_value(0.1), 
   curr_ln_prior(0.0), 
   curr_ln_like(0.0), 
@@ -108,6 +115,64 @@ void MCMCUpdater::resetDiagnostics()
 	naccepts = 0.0;
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Calls update, adding the time it takes and the number of likelihood evaluations it performs to the totals reported
+|	by getTimedUpdateSeconds and getTimedUpdateLikelihoodEvals. MCMCChainManager::updateAllUpdaters uses this rather
+|	than calling update directly, so that the cost of each updater can be weighed against its benefit when choosing 
+|	weights. If Phycas was compiled with PHYCAS_NO_HOT_PATH_TIMING defined, this just calls update.
+*/
+bool MCMCUpdater::timedUpdate()
+	{
+#	if defined(PHYCAS_NO_HOT_PATH_TIMING)
+		return update();
+#	else
+		unsigned nevals_before = (likelihood ? likelihood->getNumLikelihoodEvals() : 0);
+		bool result = false;
+			{
+			PHYCAS_HOT_PATH_TIMER(update_timing);
+			result = update();
+			}
+		unsigned nevals_after = (likelihood ? likelihood->getNumLikelihoodEvals() : 0);
+		if (nevals_after > nevals_before)
+			update_lnl_evals += (double)(nevals_after - nevals_before);
+		return result;
+#	endif
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of calls to update made through timedUpdate since construction or the last call to 
+|	resetTimedUpdateStats.
+*/
+double MCMCUpdater::getNumTimedUpdates() const
+	{
+	return update_timing.getCount();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of seconds taken by the calls to update counted by getNumTimedUpdates.
+*/
+double MCMCUpdater::getTimedUpdateSeconds() const
+	{
+	return update_timing.getSeconds();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of likelihood evaluations performed by the calls to update counted by getNumTimedUpdates.
+*/
+double MCMCUpdater::getTimedUpdateLikelihoodEvals() const
+	{
+	return update_lnl_evals;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the totals reported by getNumTimedUpdates, getTimedUpdateSeconds and getTimedUpdateLikelihoodEvals to zero.
+*/
+void MCMCUpdater::resetTimedUpdateStats()
+	{
+	update_timing.reset();
+	update_lnl_evals = 0.0;
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Returns the value of the data member `is_fixed'. While `is_fixed' is true, then the update function always returns 
 |	immediately without ever modifying the parameter value.
@@ -277,6 +342,36 @@ void MCMCUpdater::setWeight(unsigned w)
 	weight = w;
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the weight this updater had before its weight was first changed by scaleWeight (i.e. the weight chosen by 
+|	the user). Returns the current weight if scaleWeight has never been called.
+*/
+unsigned MCMCUpdater::getBaseWeight() const
+	{
+	return (base_weight > 0 ? base_weight : weight);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets `weight' to the base weight (see getBaseWeight) multiplied by `factor' and rounded to the nearest integer, but 
+|	no larger than the base weight multiplied by `max_factor' and no smaller than the base weight divided by 
+|	`max_factor' (or 1, whichever is larger). Because the factor is always applied to the base weight rather than the
+|	current weight, repeated calls do not compound. Used by MCMCChainManager::adaptWeights.
+*/
+void MCMCUpdater::scaleWeight(
+  double factor,		/**< is the multiplier to apply to the base weight */
+  double max_factor)	/**< is the largest factor by which the weight may grow or shrink relative to the base weight */
+	{
+	PHYCAS_ASSERT(factor > 0.0);
+	PHYCAS_ASSERT(max_factor >= 1.0);
+	if (base_weight == 0)
+		base_weight = weight;
+	const double w0 = (double)base_weight;
+	const double wmin = std::max(1.0, std::ceil(w0/max_factor));
+	const double wmax = std::max(wmin, std::floor(w0*max_factor));
+	const double w = std::floor(w0*factor + 0.5);
+	weight = (unsigned)std::min(wmax, std::max(wmin, w));
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Sets the value of the move-specific data member used to determine the size of a step when exploring the posterior
 |   distribution. This base class version does nothing; override in derived classes to set the tuning parameter
@@ -765,6 +860,14 @@ TreeShPtr MCMCUpdater::getTree()
 	return tree;
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the `likelihood' data member, which is a shared pointer to the object that calculates the likelihood.
+*/
+TreeLikeShPtr MCMCUpdater::getTreeLikelihood()
+	{
+	return likelihood;
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Sets the power used in heating (variable `heating_power') to the specified value `p'.
 */
@@ -899,6 +1002,95 @@ void MCMCUpdater::finalizeWorkingPrior()
 	// std::cerr << boost::str(boost::format("@@@@@@@@@ updater named %s called base class version of finalizeWorkingPrior, which does nothing") % getName()) << std::endl;
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Replaces the data stored in `fitting_sample' and `mv_fitting_sample' with copies of the data stored by `other', 
+|	which should be the corresponding updater in another chain. A chain can then call finalizeWorkingPrior to build its
+|	own working prior from samples gathered by a different chain, as is done when several power posteriors are explored
+|	concurrently in steppingstone sampling. Derived classes that store fitting data elsewhere should override this
+|	function (and call this base class version).
+*/
+void MCMCUpdater::copyWorkingPriorSample(
+  const MCMCUpdater & other)	/**< is the updater whose fitting sample is to be copied */
+	{
+	fitting_sample = other.fitting_sample;
+	mv_fitting_sample = other.mv_fitting_sample;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes everything `out' needs in order for restoreState to put this updater back exactly where it was: the current
+|	value (and, for multivariate parameters, the current values held by the model), the log prior and log likelihood
+|	after the last update, the weight (which may have been adapted during burn-in), the Metropolis-Hastings diagnostics, the heating power, the samples gathered for fitting 
+|	working priors and the state of the slice sampler. The name is written first so that restoreState can detect a
+|	checkpoint written for a differently configured analysis. Derived classes with additional state (e.g. the tuning 
+|	parameters of moves) should override this function and call this base class version first.
+*/
+void MCMCUpdater::saveState(
+  CheckpointWriter & out) const	/**< is the checkpoint being written */
+	{
+	out.putString(name);
+	out.putDouble(curr_value);
+	out.putDouble(curr_ln_prior);
+	out.putDouble(curr_ln_like);
+	out.putUInt(weight);
+	out.putUInt(base_weight);
+	out.putDouble(nattempts);
+	out.putDouble(naccepts);
+	out.putDouble(heating_power);
+	out.putBool(is_standard_heating);
+
+	double_vect_t mv_values;
+	getCurrValuesFromModel(mv_values);
+	out.putDoubleVect(mv_values);
+
+	out.putDoubleVect(fitting_sample);
+	out.putUInt((unsigned)mv_fitting_sample.size());
+	for (double_vect_vect_t::const_iterator it = mv_fitting_sample.begin(); it != mv_fitting_sample.end(); ++it)
+		out.putDoubleVect(*it);
+
+	out.putBool(bool(slice_sampler));
+	if (slice_sampler)
+		out.putDoubleVect(slice_sampler->GetState());
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the state written by saveState, sending the restored value(s) of parameters to the model. Assumes the tree 
+|	has already been restored (see MCMCChainManager::restoreState). Throws XLikelihood if the next updater in `in' does
+|	not have the same name as this one.
+*/
+void MCMCUpdater::restoreState(
+  CheckpointReader & in)	/**< is the checkpoint being read */
+	{
+	const std::string nm = in.getString();
+	if (nm != name)
+		throw XLikelihood(boost::str(boost::format("checkpoint has state for updater %s where updater %s was expected") % nm % name));
+	curr_value			= in.getDouble();
+	curr_ln_prior		= in.getDouble();
+	curr_ln_like		= in.getDouble();
+	weight				= in.getUInt();
+	base_weight			= in.getUInt();
+	nattempts			= in.getDouble();
+	naccepts			= in.getDouble();
+	heating_power		= in.getDouble();
+	is_standard_heating	= in.getBool();
+	if (isParameter() && !isMasterParameter())
+		sendCurrValueToModel(curr_value);
+
+	const double_vect_t mv_values = in.getDoubleVect();
+	if (!mv_values.empty())
+		sendCurrValuesToModel(mv_values);
+
+	fitting_sample = in.getDoubleVect();
+	mv_fitting_sample.resize(in.getUInt());
+	for (double_vect_vect_t::iterator it = mv_fitting_sample.begin(); it != mv_fitting_sample.end(); ++it)
+		*it = in.getDoubleVect();
+
+	const bool had_slice_sampler = in.getBool();
+	if (had_slice_sampler != bool(slice_sampler))
+		throw XLikelihood(boost::str(boost::format("checkpoint does not match the slice sampler configuration of updater %s") % name));
+	if (slice_sampler)
+		slice_sampler->SetState(in.getDoubleVect());
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Use samples in `fitting_sample' to parameterize a new BetaDistribution, which is then stored in `ref_dist'. 
 |	Assumes `fitting_sample' has more than 1 element. 
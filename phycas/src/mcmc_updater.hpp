@@ -30,6 +30,7 @@
 #include "phycas/src/relative_rate_distribution.hpp"
 #include "phycas/src/lognormal.hpp"
 #include "phycas/src/states_patterns.hpp"		// for double_vect
+#include "phycas/src/hot_path_timer.hpp"			// for HotPathCounter
 
 namespace phycas
 {
@@ -49,6 +50,9 @@ typedef boost::weak_ptr<MCMCChainManager>		ChainManagerWkPtr;
 class MCMCUpdater;
 typedef boost::shared_ptr<MCMCUpdater>			MCMCUpdaterShPtr;
 
+class CheckpointWriter;
+class CheckpointReader;
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Class encapsulating both MCMC moves (i.e. Metropolis-Hastings updates) and model parameters (slice sampling 
 |	updates). Provides member functions for specifying a name to be used for this updater, as well as objects needed to
@@ -108,6 +112,7 @@ class MCMCUpdater : public AdHocDensity, public boost::enable_shared_from_this<M
 		// Accessors
 		const std::string &		getName() const;
 		unsigned				getWeight() const;
+		unsigned				getBaseWeight() const;
 		double					getLnLike() const;
 		double					getLnPrior() const;
 		virtual std::string 	getPriorDescr() const;
@@ -126,6 +131,7 @@ class MCMCUpdater : public AdHocDensity, public boost::enable_shared_from_this<M
         double                  setCurrLnPrior(double x);
 		
         TreeShPtr               getTree();
+        TreeLikeShPtr           getTreeLikelihood();
 
 		// Accessors used only by parameters
 		SliceSamplerShPtr		getSliceSampler();
@@ -136,6 +142,7 @@ class MCMCUpdater : public AdHocDensity, public boost::enable_shared_from_this<M
 		// Modifiers
 		virtual void			setName(const std::string & s);
 		virtual void			setWeight(unsigned w);
+		void					scaleWeight(double factor, double max_factor);
 		virtual void			setBoldness(double b);
         virtual void            setPosteriorTuningParam(double x);
         virtual void            setPriorTuningParam(double x);
@@ -170,6 +177,7 @@ class MCMCUpdater : public AdHocDensity, public boost::enable_shared_from_this<M
 		// Utilities
 		void					releaseSharedPointers();
 		virtual bool			update();
+		bool					timedUpdate();
 		virtual double			recalcLike();
 		void                    recalcRelativeRates();
 		
@@ -177,6 +185,10 @@ class MCMCUpdater : public AdHocDensity, public boost::enable_shared_from_this<M
 		double					getNumAttempts() const;
 		double					getNumAccepts() const;
 		void					resetDiagnostics();
+		double					getNumTimedUpdates() const;
+		double					getTimedUpdateSeconds() const;
+		double					getTimedUpdateLikelihoodEvals() const;
+		void					resetTimedUpdateStats();
 
 		// Utilities used only by parameters
 		void					fixParameter();
@@ -192,6 +204,11 @@ class MCMCUpdater : public AdHocDensity, public boost::enable_shared_from_this<M
 		void					fitLognormalWorkingPrior();
 		virtual void			educateWorkingPrior();
 		virtual void			finalizeWorkingPrior();
+		virtual void			copyWorkingPriorSample(const MCMCUpdater & other);
+
+		// Utilities related to checkpointing
+		virtual void			saveState(CheckpointWriter & out) const;
+		virtual void			restoreState(CheckpointReader & in);
 		
 		// Note: some member functions could be made pure virtuals were it not for a bug in the 
 		// boost::lambda library that causes compiles to fail if attempting to use boost::lambda::bind 
@@ -217,6 +234,7 @@ class MCMCUpdater : public AdHocDensity, public boost::enable_shared_from_this<M
 
 		std::string				name;					/**< Storage for the name of this parameter to be used in reporting to the user */
 		unsigned				weight;					/**< The number of times this updater's update() function should be called in each update cycle */
+		unsigned				base_weight;			/**< The weight this updater had before scaleWeight was first called (0 if scaleWeight has never been called) */
 		TreeShPtr				tree;					/**< The tree on which the likelihood will be calculated */
 		TreeManip				tree_manipulator;		/**< The object that facilitates topological rearrangements */
 		ModelShPtr				model;					/**< The substitution model to be used in computing the likelihood */
@@ -233,6 +251,8 @@ class MCMCUpdater : public AdHocDensity, public boost::enable_shared_from_this<M
 		ChainManagerWkPtr		chain_mgr;				/**< The object that knows how to compute the joint log prior density */
 		double					nattempts;				/**< The number of update attempts made since last call to resetDiagnostics (used only by Metropolis-Hastings moves, slice samplers maintain their own diagnostics) */
 		double					naccepts;				/**< The number of times a proposed move was accepted since last call to resetDiagnostics (used only by Metropolis-Hastings moves, slice samplers maintain their own diagnostics) */
+		HotPathCounter			update_timing;			/**< The number of calls to update made by timedUpdate since the last call to resetTimedUpdateStats and the time they took */
+		double					update_lnl_evals;		/**< The number of likelihood evaluations performed by the calls to update counted in `update_timing' */
 		double					curr_value;				/**< The current value of this parameter */
 		double					curr_ln_prior;			/**< The value of log prior after most recent call to this object's update() */
 		double					curr_ln_like;			/**< The value of log likelihood after most recent call to this object's update() */
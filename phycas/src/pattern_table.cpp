@@ -0,0 +1,191 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include "phycas/src/pattern_table.hpp"
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Orders pattern indices by the lexicographic order of the patterns themselves (comparing elements as signed values,
+|	exactly as std::less<int8_vect_t> does).
+*/
+class PatternLess
+	{
+	public:
+		PatternLess(const int8_t * first, unsigned length) : base(first), plen(length) {}
+		bool operator()(unsigned a, unsigned b) const
+			{
+			const int8_t * pa = base + a*plen;
+			const int8_t * pb = base + b*plen;
+			return std::lexicographical_compare(pa, pa + plen, pb, pb + plen);
+			}
+	private:
+		const int8_t *	base;
+		unsigned		plen;
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Constructs an empty table. Call clear to set the pattern length before storing any patterns.
+*/
+PatternTable::PatternTable()
+  : plen(0)
+	{
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Removes all patterns and sets the length of the patterns that will be stored from now on.
+*/
+void PatternTable::clear(
+  unsigned pattern_length)	/**< is the number of elements in each pattern */
+	{
+	PHYCAS_ASSERT(pattern_length > 0);
+	plen = pattern_length;
+	patterns.clear();
+	counts.clear();
+	sites.clear();
+	hashes.clear();
+	slots.assign(1024, UINT_MAX);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes a 64-bit hash of the `plen' elements starting at `pattern'. Eight elements are mixed in at a time; the 
+|	final avalanche step is the one used by splitmix64, so that the low-order bits used to choose a slot depend on every
+|	element of the pattern.
+*/
+boost::uint64_t PatternTable::hashPattern(
+  const int8_t * pattern) const	/**< is the first element of the pattern */
+	{
+	boost::uint64_t h = 0x9E3779B97F4A7C15ULL ^ (boost::uint64_t)plen;
+	unsigned i = 0;
+	for (; i + 8 <= plen; i += 8)
+		{
+		boost::uint64_t w;
+		std::memcpy(&w, pattern + i, 8);
+		h = (h ^ w)*0xBF58476D1CE4E5B9ULL;
+		h ^= (h >> 31);
+		}
+	if (i < plen)
+		{
+		boost::uint64_t w = 0;
+		std::memcpy(&w, pattern + i, plen - i);
+		h = (h ^ w)*0xBF58476D1CE4E5B9ULL;
+		h ^= (h >> 31);
+		}
+	h ^= (h >> 30);
+	h *= 0xBF58476D1CE4E5B9ULL;
+	h ^= (h >> 27);
+	h *= 0x94D049BB133111EBULL;
+	h ^= (h >> 31);
+	return h;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Rebuilds the hash table with `nslots' slots (which must be a power of 2), reinserting every stored pattern using its
+|	saved hash.
+*/
+void PatternTable::resizeSlots(
+  unsigned nslots)	/**< is the new number of slots */
+	{
+	PHYCAS_ASSERT((nslots & (nslots - 1)) == 0);
+	slots.assign(nslots, UINT_MAX);
+	const unsigned mask = nslots - 1;
+	const unsigned n = getNumPatterns();
+	for (unsigned i = 0; i < n; ++i)
+		{
+		unsigned s = (unsigned)(hashes[i] & mask);
+		while (slots[s] != UINT_MAX)
+			s = (s + 1) & mask;
+		slots[s] = i;
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Adds `weight' to the count of the `plen' elements starting at `pattern' and adds `site_index' to the list of sites 
+|	having that pattern (along with the two following sites if `codon_model' is true). The pattern is copied into the
+|	table if it has not been seen before. Returns the index of the pattern. The table is kept at most half full, so 
+|	probe sequences stay short.
+*/
+unsigned PatternTable::storePattern(
+  const int8_t * pattern,		/**< is the first element of the pattern to store */
+  unsigned site_index,			/**< is the index of the site in the original data matrix */
+  pattern_count_t weight,		/**< is the weight of this site (normally 1.0) */
+  bool codon_model)				/**< if true, site_index and the two sites following it are all recorded as having this pattern */
+	{
+	PHYCAS_ASSERT(plen > 0);
+	const boost::uint64_t h = hashPattern(pattern);
+	const unsigned mask = (unsigned)slots.size() - 1;
+	unsigned s = (unsigned)(h & mask);
+	for (;;)
+		{
+		const unsigned k = slots[s];
+		if (k == UINT_MAX)
+			break;
+		if (hashes[k] == h && std::equal(pattern, pattern + plen, patterns.begin() + k*plen))
+			{
+			// pattern has been seen before
+			counts[k] += weight;
+			sites[k].push_back(site_index);
+			if (codon_model)
+				{
+				sites[k].push_back(site_index + 1);
+				sites[k].push_back(site_index + 2);
+				}
+			return k;
+			}
+		s = (s + 1) & mask;
+		}
+
+	// pattern is new: append it and claim the empty slot found above
+	const unsigned k = getNumPatterns();
+	patterns.insert(patterns.end(), pattern, pattern + plen);
+	counts.push_back(weight);
+	hashes.push_back(h);
+	sites.push_back(uint_vect_t(1, site_index));
+	if (codon_model)
+		{
+		sites[k].push_back(site_index + 1);
+		sites[k].push_back(site_index + 2);
+		}
+	slots[s] = k;
+	if (2*(k + 1) > (unsigned)slots.size())
+		resizeSlots(2*(unsigned)slots.size());
+	return k;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the pattern indices sorted so that the patterns they refer to are in lexicographic order. Only the distinct
+|	patterns are sorted, which is much cheaper than keeping every site in an ordered container.
+*/
+uint_vect_t PatternTable::getSortedOrder() const
+	{
+	const unsigned n = getNumPatterns();
+	uint_vect_t order(n);
+	for (unsigned i = 0; i < n; ++i)
+		order[i] = i;
+	if (n > 1)
+		std::sort(order.begin(), order.end(), PatternLess(&patterns[0], plen));
+	return order;
+	}
+
+} // namespace phycas
@@ -0,0 +1,73 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+
+#if ! defined(PATTERN_TABLE_HPP)
+#define PATTERN_TABLE_HPP
+
+#include <vector>
+#include <boost/cstdint.hpp>
+#include "phycas/src/states_patterns.hpp"
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Stores the distinct site patterns of one partition subset while a data matrix is being compressed. Patterns all have
+|	the same length and are packed one after another in a single vector (i.e. the data are stored by column), so adding
+|	a pattern never allocates memory for the pattern itself. Duplicates are detected using an open-addressing hash 
+|	table (linear probing) keyed on a 64-bit hash of the pattern, so each site costs one hash computation and, usually, 
+|	one comparison with a stored pattern. Patterns are numbered in the order in which they were first seen; use 
+|	getSortedOrder to visit them in the lexicographic order in which the std::map used previously kept them.
+*/
+class PatternTable
+	{
+	public:
+									PatternTable();
+
+		void						clear(unsigned pattern_length);
+
+		unsigned					getPatternLength() const;
+		unsigned					getNumPatterns() const;
+		const int8_t *				getPattern(unsigned i) const;
+		pattern_count_t				getCount(unsigned i) const;
+		const uint_vect_t &			getSites(unsigned i) const;
+
+		unsigned					storePattern(const int8_t * pattern, unsigned site_index, pattern_count_t weight, bool codon_model);
+
+		uint_vect_t					getSortedOrder() const;
+
+	private:
+
+		boost::uint64_t				hashPattern(const int8_t * pattern) const;
+		void						resizeSlots(unsigned nslots);
+
+		unsigned					plen;			/**< The number of elements in each pattern */
+		int8_vect_t					patterns;		/**< The distinct patterns, packed end to end (pattern i starts at element i*plen) */
+		count_vect_t				counts;			/**< The sum of the weights of the sites having each pattern */
+		pattern_to_sites_t			sites;			/**< The indices of the sites having each pattern */
+		std::vector<boost::uint64_t> hashes;		/**< The hash of each pattern (saves recomputing hashes when the table grows) */
+		uint_vect_t					slots;			/**< The hash table proper: each element is a pattern index or UINT_MAX if empty; length is always a power of 2 */
+	};
+
+} // namespace phycas
+
+#include "phycas/src/pattern_table.inl"
+
+#endif
@@ -0,0 +1,76 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+
+#if ! defined(PATTERN_TABLE_INL)
+#define PATTERN_TABLE_INL
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of elements in each pattern (the number of taxa plus one for the subset index).
+*/
+inline unsigned PatternTable::getPatternLength() const
+	{
+	return plen;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of distinct patterns stored so far.
+*/
+inline unsigned PatternTable::getNumPatterns() const
+	{
+	return (unsigned)counts.size();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns a pointer to the first of the `plen' elements of pattern `i'. The pointer is invalidated by the next call to
+|	storePattern.
+*/
+inline const int8_t * PatternTable::getPattern(
+  unsigned i) const	/**< is the index of the pattern (in order of first appearance) */
+	{
+	PHYCAS_ASSERT(i < getNumPatterns());
+	return &patterns[i*plen];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the total weight of the sites having pattern `i'.
+*/
+inline pattern_count_t PatternTable::getCount(
+  unsigned i) const	/**< is the index of the pattern (in order of first appearance) */
+	{
+	PHYCAS_ASSERT(i < getNumPatterns());
+	return counts[i];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the indices (in the original data matrix) of the sites having pattern `i', in increasing order.
+*/
+inline const uint_vect_t & PatternTable::getSites(
+  unsigned i) const	/**< is the index of the pattern (in order of first appearance) */
+	{
+	PHYCAS_ASSERT(i < getNumPatterns());
+	return sites[i];
+	}
+
+} // namespace phycas
+
+#endif
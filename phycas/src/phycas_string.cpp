@@ -592,7 +592,7 @@ std::string & StrPrintF(string & str,
 */
 std::string &append_unsigned(std::string &s, unsigned v)
 	{
-	static char tmp[128];
+	char tmp[128];
 	sprintf(tmp, "%d", v);
 	s << tmp;
 	return s;
@@ -42,6 +42,8 @@
 #include "phycas/src/internal_data.hpp"
 #include "phycas/src/xphylogeny.hpp"
 #include "phycas/src/split.hpp"
+#include "phycas/src/tree_sample_file.hpp"
+#include "phycas/src/tree_summarizer.hpp"
 
 using namespace boost::python;
 using namespace phycas;
@@ -101,6 +103,7 @@ BOOST_PYTHON_MODULE(_PhylogenyExt)
 		.def("hasEdgeLens", &Tree::HasEdgeLens)
 		.def("clear", &Tree::Clear)
 		.def("buildFromString", &Tree::BuildFromString)
+		.def("buildFromPreorder", &Tree::BuildFromPreorder)
 		.def("edgeLenSum", &Tree::EdgeLenSum)
 		.def("edgeLens", &Tree::EdgeLens)
 		.def("keyToEdges", &Tree::KeyToEdges)
@@ -175,5 +178,55 @@ BOOST_PYTHON_MODULE(_PhylogenyExt)
 		.def("write", &Split::Write)
 		;
 
+	class_<TreeSampleWriter, boost::noncopyable, boost::shared_ptr<TreeSampleWriter> >("TreeSampleWriterBase", init<std::string>())
+		.def("create", &TreeSampleWriter::create)
+		.def("reopen", &TreeSampleWriter::reopen)
+		.def("isOpen", &TreeSampleWriter::isOpen)
+		.def("addTree", &TreeSampleWriter::addTree)
+		.def("transferTo", &TreeSampleWriter::transferTo)
+		.def("flush", &TreeSampleWriter::flush)
+		.def("tell", &TreeSampleWriter::tell)
+		.def("close", &TreeSampleWriter::close)
+		.def("setFlushInterval", &TreeSampleWriter::setFlushInterval)
+		.def("getFilename", &TreeSampleWriter::getFilename, return_value_policy<copy_const_reference>())
+		.def("getNumTreesAdded", &TreeSampleWriter::getNumTreesAdded)
+		;
+
+	class_<TreeSampleReader, boost::noncopyable, boost::shared_ptr<TreeSampleReader> >("TreeSampleReaderBase", init<std::string>())
+		.def("isTreeSampleFile", &TreeSampleReader::isTreeSampleFile)
+		.staticmethod("isTreeSampleFile")
+		.def("getTaxonLabels", &TreeSampleReader::getTaxonLabels, return_value_policy<copy_const_reference>())
+		.def("isRooted", &TreeSampleReader::isRooted)
+		.def("getNumTrees", &TreeSampleReader::getNumTrees)
+		.def("readNext", &TreeSampleReader::readNext)
+		.def("rewind", &TreeSampleReader::rewind)
+		.def("getCycle", &TreeSampleReader::getCycle)
+		.def("topologyChanged", &TreeSampleReader::topologyChanged)
+		;
+
+	class_<TreeSummarizer, boost::noncopyable, boost::shared_ptr<TreeSummarizer> >("TreeSummarizerBase", init<bool>())
+		.def("clear", &TreeSummarizer::clear)
+		.def("addTree", &TreeSummarizer::addTree)
+		.def("addTreesFromFile", &TreeSummarizer::addTreesFromFile)
+		.def("getNumTrees", &TreeSummarizer::getNumTrees)
+		.def("getMaxNumTaxa", &TreeSummarizer::getMaxNumTaxa)
+		.def("getNumSplits", &TreeSummarizer::getNumSplits)
+		.def("getSplitPattern", &TreeSummarizer::getSplitPattern)
+		.def("isTrivialSplit", &TreeSummarizer::isTrivialSplit)
+		.def("getSplitCount", &TreeSummarizer::getSplitCount)
+		.def("getSplitEdgeLenSum", &TreeSummarizer::getSplitEdgeLenSum)
+		.def("getSplitSamples", &TreeSummarizer::getSplitSamples, return_value_policy<copy_const_reference>())
+		.def("countSplitSojourns", &TreeSummarizer::countSplitSojourns)
+		.def("calcSplitPosteriorSeries", &TreeSummarizer::calcSplitPosteriorSeries)
+		.def("getMajorityRuleSplits", &TreeSummarizer::getMajorityRuleSplits)
+		.def("getNumTopologies", &TreeSummarizer::getNumTopologies)
+		.def("getTopologyCount", &TreeSummarizer::getTopologyCount)
+		.def("getTopologyTreeLenSum", &TreeSummarizer::getTopologyTreeLenSum)
+		.def("getTopologySamples", &TreeSummarizer::getTopologySamples, return_value_policy<copy_const_reference>())
+		.def("getTopologySplits", &TreeSummarizer::getTopologySplits, return_value_policy<copy_const_reference>())
+		.def("getTopologyNewick", &TreeSummarizer::getTopologyNewick, return_value_policy<copy_const_reference>())
+		.def("countTopologySojourns", &TreeSummarizer::countTopologySojourns)
+		;
+
     register_exception_translator<XPhylogeny>(&translateXPhylogeny);
 }
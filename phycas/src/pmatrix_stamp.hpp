@@ -0,0 +1,60 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(PMATRIX_STAMP_HPP)
+#define PMATRIX_STAMP_HPP
+
+#include <boost/shared_ptr.hpp>
+#include "phycas/src/states_patterns.hpp"
+
+namespace phycas
+{
+
+class Model;
+typedef boost::shared_ptr<Model> ModelShPtr;
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Records the inputs used the last time the transition matrices of one partition subset were computed for a node 
+|	(InternalData::pMatrices or TipData::pMatrixTranspose): the model, the model's time stamp (see 
+|	Model::getTimeStamp) and the edge length of each rate category after scaling by the relative rate and the subset 
+|	relative rate. TreeLikelihood uses the stamp to skip recomputing matrices whose inputs have not changed. Anything 
+|	that writes to the matrices other than TreeLikelihood::refreshPMat and TreeLikelihood::refreshPMatTranspose must 
+|	call invalidate (the non-const accessors of InternalData and TipData do so automatically).
+*/
+class PMatrixStamp
+	{
+	public:
+							PMatrixStamp();
+
+		bool				matches(const Model * m, unsigned time_stamp, const double_vect_t & scaled_edgelens) const;
+		void				set(ModelShPtr m, unsigned time_stamp, const double_vect_t & scaled_edgelens);
+		void				invalidate();
+
+	private:
+
+		ModelShPtr			model;				/**< is the model used to compute the matrices (empty if the matrices must be recomputed); holding a reference guarantees a later model cannot reuse its address */
+		unsigned			model_time_stamp;	/**< is the time stamp of `model' when the matrices were computed */
+		double_vect_t		edgelens;			/**< holds the scaled edge length used for each rate category */
+	};
+
+} // namespace phycas
+
+#include "phycas/src/pmatrix_stamp.inl"
+
+#endif
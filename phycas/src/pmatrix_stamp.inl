@@ -0,0 +1,71 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(PMATRIX_STAMP_INL)
+#define PMATRIX_STAMP_INL
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Constructor creates an invalid stamp, so the first request for the matrices always computes them.
+*/
+inline PMatrixStamp::PMatrixStamp()
+  : model_time_stamp(0)
+	{
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if the matrices were last computed using model `m' when its time stamp was `time_stamp' and using 
+|	exactly the edge lengths in `scaled_edgelens'.
+*/
+inline bool PMatrixStamp::matches(
+  const Model * m,							/**< is the model that would be used to compute the matrices */
+  unsigned time_stamp,						/**< is the current time stamp of `m' */
+  const double_vect_t & scaled_edgelens)	/**< is the scaled edge length for each rate category */
+  const
+	{
+	return (model && model.get() == m && model_time_stamp == time_stamp && edgelens == scaled_edgelens);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Records that the matrices have just been computed using model `m' (having time stamp `time_stamp') and the edge
+|	lengths in `scaled_edgelens'.
+*/
+inline void PMatrixStamp::set(
+  ModelShPtr m,								/**< is the model used to compute the matrices */
+  unsigned time_stamp,						/**< is the time stamp of `m' */
+  const double_vect_t & scaled_edgelens)	/**< is the scaled edge length for each rate category */
+	{
+	model = m;
+	model_time_stamp = time_stamp;
+	edgelens = scaled_edgelens;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Marks the matrices as needing to be recomputed.
+*/
+inline void PMatrixStamp::invalidate()
+	{
+	model.reset();
+	}
+
+} // namespace phycas
+
+#endif
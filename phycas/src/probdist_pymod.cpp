@@ -167,6 +167,11 @@ BOOST_PYTHON_MODULE(_ProbDistExt)
 //    ;
 //where DrawablePtr is a typedef for the smart pointer type. 
 
+	enum_<phycas::Lot::EngineType>("LotEngine")
+		.value("lehmer", phycas::Lot::lehmer)
+		.value("xoshiro256ss", phycas::Lot::xoshiro256ss)
+		;
+
 	class_<phycas::Lot, boost::shared_ptr<phycas::Lot>, boost::noncopyable>("LotBase", init<unsigned>())
 		.def("getSeed", &phycas::Lot::GetSeed)
 		.def("setSeed", &phycas::Lot::SetSeed)
@@ -174,6 +179,13 @@ BOOST_PYTHON_MODULE(_ProbDistExt)
 		.def("uniform", &phycas::Lot::Uniform)
 		.def("getrandbits", &phycas::Lot::GetRandBits)
 		.def("sampleUInt", &phycas::Lot::SampleUInt)
+		.def("getEngine", &phycas::Lot::GetEngine)
+		.def("setEngine", &phycas::Lot::SetEngine)
+		.def("getStream", &phycas::Lot::GetStream)
+		.def("useStream", &phycas::Lot::UseStream)
+		.def("getState", &phycas::Lot::GetState)
+		.def("setState", &phycas::Lot::SetState)
+		.def("getUniforms", &phycas::Lot::GetUniforms)
 		;
 
 	class_<MVNormalDistribution, bases<MultivariateProbabilityDistribution> >("MVNormalDistBase")
@@ -148,6 +148,7 @@ void QMatrix::redimension(unsigned new_dim)
 	flat_length = new_dim*new_dim;
 	
 	expwv.resize(new_dim);
+	zexp.resize(new_dim);
 
 	// Set the shape of a NumArray object that represents Q, P (transition probs), E (eigenvectors) or V (eigenvalues)
 	dim_vect.push_back((int)dimension);
@@ -338,6 +339,27 @@ void QMatrix::recalcQMatrixImpl()
 	q_dirty = false;
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the dot product of the `n' element vectors `x' and `y'. Four partial sums are kept so that the compiler can
+|	keep several multiply-adds in flight (and use vector instructions) without reordering floating point operations 
+|	itself.
+*/
+static inline double dotProduct(const double * x, const double * y, unsigned n)
+	{
+	double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+	unsigned k = 0;
+	for (; k + 4 <= n; k += 4)
+		{
+		s0 += x[k]*y[k];
+		s1 += x[k + 1]*y[k + 1];
+		s2 += x[k + 2]*y[k + 2];
+		s3 += x[k + 3]*y[k + 3];
+		}
+	for (; k < n; ++k)
+		s0 += x[k]*y[k];
+	return (s0 + s1) + (s2 + s3);
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |   Recomputes a transition probability matrix for an edge length `edgelen', storing it in `pmat'. If either state
 |   frequencies or relative rates have changed, the Q matrix is reconstructed and eigenvalues and eigenvectors 
@@ -347,40 +369,121 @@ void QMatrix::recalcPMat(
   double * * pmat,		/**< is the transition matrix to recalculate */
   double edgelen) 		/**< is the edge length */
 	{
-	recalcQMatrix();
-    double t = edgelen;
-
-    // The next two lines fix the "Rota" bug; see BUGS file for details
-    if (t < 1.e-8) 
-        t = 1.e-8; //TreeNode::edgeLenEpsilon;
+	recalcPMatBatch(1, &pmat, &edgelen);
+	}
 
-	// Adjust the supplied edgelen to account for the fact that the expected number of substitutions
-	// implied by the Q matrix is not unity
-	double v = t*edgelen_scaler;
+/*----------------------------------------------------------------------------------------------------------------------
+|   Recomputes the `n' transition probability matrices `pmats'[0], ..., `pmats'[`n' - 1] for the edge lengths in 
+|	`edgelens', reconstructing the Q matrix and its eigensystem first (once for the whole batch) if state frequencies or
+|	relative rates have changed. All exponentials are computed before any matrix is assembled. Because Q is made 
+|	symmetric by the sqrt(pi) similarity transform, Z*exp(D*v)*Z^T is symmetric, so only its upper triangle is 
+|	computed; each element is the dot product of a row of Z scaled by exp(D*v) with a contiguous row of Z.
+*/
+void QMatrix::recalcPMatBatch(
+  unsigned n,				/**< is the number of transition matrices to recalculate */
+  double * * * pmats,		/**< is the array of `n' transition matrices to recalculate */
+  const double * edgelens)	/**< is the array of `n' edge lengths */
+	{
+	recalcQMatrix();
+	const unsigned d = dimension;
 
-    // Precalculate exp to avoid doing the same calculation dimension*dimension times
-	for (unsigned k = 0; k < dimension; ++k)
+    // Precalculate exp(w*v) for every matrix to avoid doing the same calculation d*d times per matrix
+	expwv.resize(n*d);
+	for (unsigned m = 0; m < n; ++m)
 		{
-		expwv[k] = std::exp(w[k]*v);
-        }
+		double t = edgelens[m];
+
+		// The next two lines fix the "Rota" bug; see BUGS file for details
+		if (t < 1.e-8) 
+			t = 1.e-8; //TreeNode::edgeLenEpsilon;
+
+		// Adjust the supplied edgelen to account for the fact that the expected number of substitutions
+		// implied by the Q matrix is not unity
+		const double v = t*edgelen_scaler;
+		double * e = &expwv[m*d];
+		for (unsigned k = 0; k < d; ++k)
+			e[k] = std::exp(w[k]*v);
+		}
         
 	// Exponentiate eigenvalues and put everything back together again
 	// Real symmetric matrices can be diagonalized using Z*exp(D)*Z^T, where Z is the 
 	// orthogonal matrix of eigenvectors and D is the diagonal matrix of eigenvalues,
 	// each multiplied by time (scaled to equal expected number of substitutions)
-	for (unsigned i = 0; i < dimension; ++i)
+	double * a = &zexp[0];
+	for (unsigned m = 0; m < n; ++m)
 		{
-		double sqrtPi_i = sqrtPi[i];
-		for (unsigned j = 0; j < dimension; ++j)
+		const double * e = &expwv[m*d];
+		double * * pmat = pmats[m];
+		for (unsigned i = 0; i < d; ++i)
+			{
+			const double * zi = z[i];
+			for (unsigned k = 0; k < d; ++k)
+				a[k] = zi[k]*e[k];
+			const double sqrtPi_i = sqrtPi[i];
+			for (unsigned j = i; j < d; ++j)
+				{
+				const double s = dotProduct(a, z[j], d);
+				pmat[i][j] = s*sqrtPi[j]/sqrtPi_i;
+				if (j > i)
+					pmat[j][i] = s*sqrtPi_i/sqrtPi[j];
+				}
+			}
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|   Computes the first (`dpmat') and second (`d2pmat') derivatives with respect to `edgelen' of the transition 
+|	probability matrix computed by recalcPMatBatch. Differentiating Z*exp(D*v)*Z^T with respect to the edge length t 
+|	(where v = t*edgelen_scaler) simply multiplies each exp(w_k*v) by w_k*edgelen_scaler, once for the first derivative
+|	and twice for the second, so both matrices are assembled exactly as in recalcPMatBatch.
+*/
+void QMatrix::recalcPMatDerivatives(
+  double * * dpmat,			/**< is the matrix to receive the first derivatives */
+  double * * d2pmat,		/**< is the matrix to receive the second derivatives */
+  double edgelen)			/**< is the edge length */
+	{
+	recalcQMatrix();
+	const unsigned d = dimension;
+
+	double t = edgelen;
+	if (t < 1.e-8) 
+		t = 1.e-8; //TreeNode::edgeLenEpsilon;
+	const double v = t*edgelen_scaler;
+
+	// expwv holds the first derivative factors followed by the second derivative factors
+	expwv.resize(2*d);
+	double * e1 = &expwv[0];
+	double * e2 = &expwv[d];
+	for (unsigned k = 0; k < d; ++k)
+		{
+		const double rk = w[k]*edgelen_scaler;
+		const double ek = std::exp(w[k]*v);
+		e1[k] = rk*ek;
+		e2[k] = rk*rk*ek;
+		}
+
+	double * a = &zexp[0];
+	std::vector<double> b(d);
+	for (unsigned i = 0; i < d; ++i)
+		{
+		const double * zi = z[i];
+		for (unsigned k = 0; k < d; ++k)
+			{
+			a[k] = zi[k]*e1[k];
+			b[k] = zi[k]*e2[k];
+			}
+		const double sqrtPi_i = sqrtPi[i];
+		for (unsigned j = i; j < d; ++j)
 			{
-			double factor = sqrtPi[j]/sqrtPi_i;
-			double Pij = 0.0;
-			for (unsigned k = 0; k < dimension; ++k)
+			const double s1 = dotProduct(a, z[j], d);
+			const double s2 = dotProduct(&b[0], z[j], d);
+			dpmat[i][j] = s1*sqrtPi[j]/sqrtPi_i;
+			d2pmat[i][j] = s2*sqrtPi[j]/sqrtPi_i;
+			if (j > i)
 				{
-				double tmp = z[i][k]*z[j][k]*expwv[k];
-				Pij +=  tmp;
+				dpmat[j][i] = s1*sqrtPi_i/sqrtPi[j];
+				d2pmat[j][i] = s2*sqrtPi_i/sqrtPi[j];
 				}
-			pmat[i][j] = Pij*factor;
 			}
 		}
 	}
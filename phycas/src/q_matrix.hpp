@@ -92,6 +92,8 @@ class QMatrix
 	private:
 
 		void							recalcPMat(double * * pmat, double edgelen);	// used by GTR
+		void							recalcPMatBatch(unsigned n, double * * * pmats, const double * edgelens);	// used by GTR and Codon
+		void							recalcPMatDerivatives(double * * dpmat, double * * d2pmat, double edgelen);	// used by GTR and Codon
 		//void							recalcPMatrix(std::vector<double> & P, double edgelen);
 		std::string						showQMatrix();
 		void							clear();
@@ -115,7 +117,8 @@ class QMatrix
 
 		std::vector<double>				rr;				/**< The relative rates (elements in the upper diagonal of the R matrix). If the R matrix is 4x4, the order of the six elements in the relrates vector should be R[0][1], R[0][2], R[0][3], R[1][2], R[1][3] and R[2][3]. The R matrix is combined with the pi vector to create the Q matrix. */
 		
-		std::vector<double>				expwv;			/**< Workspace used for storing precalculated exp(w*v), where w is an eigenvalue and v an edge length; used in recalcPMat */
+		std::vector<double>				expwv;			/**< Workspace used for storing precalculated exp(w*v), where w is an eigenvalue and v an edge length, for every edge length in the batch being computed by recalcPMatBatch */
+		std::vector<double>				zexp;			/**< Workspace used by recalcPMatBatch to hold one row of the eigenvector matrix with each element multiplied by the corresponding exp(w*v) */
 
 		double							edgelen_scaler;	/**< factor needed */
 		double * *						qmat;			/**< */
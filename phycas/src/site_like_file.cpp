@@ -0,0 +1,479 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include <boost/format.hpp>
+#include "phycas/src/site_like_file.hpp"
+#include "phycas/src/tree_likelihood.hpp"
+#include "phycas/src/xlikelihood.hpp"
+
+namespace
+{
+const char			sitelike_magic[8]		= {'P', 'H', 'Y', 'S', 'L', 'N', 'L', '\0'};
+const unsigned		sitelike_version		= 1;
+const unsigned		sitelike_byte_order		= 0x01020304;
+const std::streamoff	sitelike_header_fixed	= 8 + 4*sizeof(unsigned);	// magic, version, byte order, nsites, npatterns
+}
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Stores the file name. Nothing is written until either create (for a new file) or reopen (to add samples to a file
+|	written earlier) is called. If `fn' is empty, samples are only buffered.
+*/
+SiteLikeWriter::SiteLikeWriter(
+  const std::string & fn)	/**< is the name of the file (may be empty) */
+  : filename(fn), num_patterns(0)
+	{
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes any samples still buffered. Errors are ignored because destructors must not throw; call close to find out
+|	whether the last block was written successfully.
+*/
+SiteLikeWriter::~SiteLikeWriter()
+	{
+	try
+		{
+		close();
+		}
+	catch(...)
+		{
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Creates the file (replacing any existing file with the same name) and writes the header. The element of
+|	`char_to_pattern' for each site is the index of that site's pattern, or a value not less than `npatterns' for a 
+|	site that was excluded. Throws XLikelihood if the file cannot be created.
+*/
+void SiteLikeWriter::create(
+  const uint_vect_t & char_to_pattern,	/**< maps each site to the pattern it exhibits */
+  unsigned npatterns)					/**< is the number of patterns (values per sample) */
+	{
+	PHYCAS_ASSERT(!filename.empty());
+	PHYCAS_ASSERT(!out.is_open());
+	out.open(filename, false);
+	if (!out.is_open())
+		throw XLikelihood(std::string("could not create site log-likelihood file ") + filename);
+	num_patterns = npatterns;
+	putBytes(sitelike_magic, sizeof(sitelike_magic));
+	putBytes(&sitelike_version, sizeof(unsigned));
+	putBytes(&sitelike_byte_order, sizeof(unsigned));
+	const unsigned nsites = (unsigned)char_to_pattern.size();
+	putBytes(&nsites, sizeof(unsigned));
+	putBytes(&num_patterns, sizeof(unsigned));
+	uint_vect_t site_pattern(char_to_pattern);
+	for (uint_vect_t::iterator it = site_pattern.begin(); it != site_pattern.end(); ++it)
+		{
+		if (*it >= num_patterns)
+			*it = UINT_MAX;
+		}
+	if (nsites > 0)
+		putBytes(&site_pattern[0], (std::streamsize)(nsites*sizeof(unsigned)));
+	out.flush();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Opens an existing file written by an earlier SiteLikeWriter (e.g. one that was truncated to the length it had when 
+|	a checkpoint was saved) so that further samples are added to the end of it. The number of patterns is taken from
+|	the header of the file.
+*/
+void SiteLikeWriter::reopen()
+	{
+	PHYCAS_ASSERT(!filename.empty());
+	PHYCAS_ASSERT(!out.is_open());
+		{
+		SiteLikeReader existing(filename);
+		num_patterns = existing.getNumPatterns();
+		}
+	out.open(filename, true);
+	if (!out.is_open())
+		throw XLikelihood(std::string("could not open site log-likelihood file ") + filename);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if create or reopen has been called and close has not.
+*/
+bool SiteLikeWriter::isOpen() const
+	{
+	return out.is_open();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Adds the pattern log-likelihoods stored by the most recent calculation of `likelihood' (which must have been told
+|	to store site likelihoods) as the sample for `cycle'. No likelihood calculation is done here.
+*/
+void SiteLikeWriter::addSample(
+  unsigned cycle,						/**< is the cycle at which the sample was taken */
+  const TreeLikelihood & likelihood)	/**< is the likelihood object of the chain being sampled */
+	{
+	addPatternLnLs(cycle, likelihood.getSiteLikelihoods());
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Adds `pattern_lnL' as the sample for `cycle', writing a block to the file whenever `max_block_samples' samples have
+|	accumulated. If the number of patterns is not yet known (a writer that only buffers samples), it is taken from the
+|	first sample. Throws XLikelihood if the number of values differs from the number of patterns.
+*/
+void SiteLikeWriter::addPatternLnLs(
+  unsigned cycle,						/**< is the cycle at which the sample was taken */
+  const double_vect_t & pattern_lnL)	/**< holds the log-likelihood of each pattern */
+	{
+	if (num_patterns == 0 && !out.is_open())
+		num_patterns = (unsigned)pattern_lnL.size();
+	if ((unsigned)pattern_lnL.size() != num_patterns || num_patterns == 0)
+		throw XLikelihood(boost::str(boost::format("expecting %d pattern log-likelihoods but got %d (were site likelihoods stored?)") % num_patterns % pattern_lnL.size()));
+	cycles.push_back(cycle);
+	values.insert(values.end(), pattern_lnL.begin(), pattern_lnL.end());
+	if (out.is_open() && cycles.size() == max_block_samples)
+		writeBlock();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Adds every sample buffered in this writer to `other' (in the order in which they were added) and empties the 
+|	buffer. Used to write samples that were gathered concurrently for different chains grouped by chain.
+*/
+void SiteLikeWriter::transferTo(
+  SiteLikeWriter & other)	/**< is the writer that takes the buffered samples */
+	{
+	double_vect_t v(num_patterns);
+	for (unsigned i = 0; i < (unsigned)cycles.size(); ++i)
+		{
+		std::copy(values.begin() + i*num_patterns, values.begin() + (i + 1)*num_patterns, v.begin());
+		other.addPatternLnLs(cycles[i], v);
+		}
+	cycles.clear();
+	values.clear();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes the buffered samples as one block of the file. The values are transposed so that all the sampled values for
+|	a pattern are contiguous.
+*/
+void SiteLikeWriter::writeBlock()
+	{
+	const unsigned n = (unsigned)cycles.size();
+	if (n == 0)
+		return;
+	column_buffer.resize(values.size());
+	double_vect_t::iterator col = column_buffer.begin();
+	for (unsigned p = 0; p < num_patterns; ++p)
+		{
+		for (unsigned i = 0; i < n; ++i)
+			*col++ = values[i*num_patterns + p];
+		}
+	putBytes(&n, sizeof(unsigned));
+	putBytes(&cycles[0], (std::streamsize)(n*sizeof(unsigned)));
+	putBytes(&column_buffer[0], (std::streamsize)(column_buffer.size()*sizeof(double)));
+	cycles.clear();
+	values.clear();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes `n' bytes starting at `p', throwing XLikelihood if the write fails.
+*/
+void SiteLikeWriter::putBytes(
+  const void * p,		/**< is the address of the first byte to write */
+  std::streamsize n)	/**< is the number of bytes to write */
+	{
+	out.write(reinterpret_cast<const char *>(p), n);
+	if (!out)
+		throw XLikelihood(std::string("error writing site log-likelihood file ") + filename);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes any buffered samples as a (possibly short) block and hands everything added so far to the background thread,
+|	which puts it in the file without delaying the caller. Does nothing if the file is not open.
+*/
+void SiteLikeWriter::flush()
+	{
+	if (!out.is_open())
+		return;
+	writeBlock();
+	out.flush();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Flushes the buffered samples, waits until the background thread has put them in the file, and returns the length of
+|	the file, which is the offset to which the file should be truncated before calling
+|	reopen to resume an analysis from a checkpoint saved now. Returned as a double because the length may not fit in an
+|	unsigned int. Returns 0.0 if the file is not open.
+*/
+double SiteLikeWriter::tell()
+	{
+	if (!out.is_open())
+		return 0.0;
+	flush();
+	out.sync();
+	return (double)out.tellp();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Writes any buffered samples and closes the file.
+*/
+void SiteLikeWriter::close()
+	{
+	if (!out.is_open())
+		return;
+	flush();
+	out.close();
+	if (!out)
+		throw XLikelihood(std::string("error closing site log-likelihood file ") + filename);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the minimum time in seconds between flushes of the file by the background thread.
+*/
+void SiteLikeWriter::setFlushInterval(
+  double seconds)	/**< is the flush interval */
+	{
+	out.setFlushInterval(seconds);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the name of the file (empty if samples are only buffered).
+*/
+const std::string & SiteLikeWriter::getFilename() const
+	{
+	return filename;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of values stored per sample (0 if not yet known).
+*/
+unsigned SiteLikeWriter::getNumPatterns() const
+	{
+	return num_patterns;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of samples added but not yet written to the file.
+*/
+unsigned SiteLikeWriter::getNumBufferedSamples() const
+	{
+	return (unsigned)cycles.size();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Opens the file `fn', reads its header and finds the start of every block.
+*/
+SiteLikeReader::SiteLikeReader(
+  const std::string & fn)	/**< is the name of the file */
+  : filename(fn), num_patterns(0), num_samples(0)
+	{
+	in.open(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!in.is_open())
+		throw XLikelihood(std::string("could not open site log-likelihood file ") + filename);
+	char magic[sizeof(sitelike_magic)];
+	getBytes(magic, sizeof(magic));
+	if (!std::equal(magic, magic + sizeof(magic), sitelike_magic))
+		throw XLikelihood(filename + " is not a Phycas site log-likelihood file");
+	unsigned x = 0;
+	getBytes(&x, sizeof(unsigned));
+	if (x != sitelike_version)
+		throw XLikelihood(filename + " was written by an incompatible version of Phycas");
+	getBytes(&x, sizeof(unsigned));
+	if (x != sitelike_byte_order)
+		throw XLikelihood(filename + " was written on a machine with a different byte order");
+	unsigned nsites = 0;
+	getBytes(&nsites, sizeof(unsigned));
+	getBytes(&num_patterns, sizeof(unsigned));
+	char_to_pattern.resize(nsites);
+	if (nsites > 0)
+		getBytes(&char_to_pattern[0], (std::streamsize)(nsites*sizeof(unsigned)));
+
+	// Walk the blocks, recording where each begins
+	in.seekg(0, std::ios::end);
+	const std::streamoff file_length = in.tellg();
+	std::streamoff pos = sitelike_header_fixed + (std::streamoff)nsites*sizeof(unsigned);
+	while (pos < file_length)
+		{
+		in.seekg(pos);
+		unsigned n = 0;
+		getBytes(&n, sizeof(unsigned));
+		const std::streamoff block_end = pos + sizeof(unsigned) + (std::streamoff)n*(sizeof(unsigned) + (std::streamoff)num_patterns*sizeof(double));
+		if (n == 0 || block_end > file_length)
+			throw XLikelihood(std::string("site log-likelihood file ") + filename + " is truncated or corrupt");
+		block_start.push_back(pos + sizeof(unsigned));
+		block_samples.push_back(n);
+		num_samples += n;
+		pos = block_end;
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if the file `fn' exists and begins with the signature written by SiteLikeWriter. Used to tell binary
+|	site log-likelihood files from the text files written by earlier versions.
+*/
+bool SiteLikeReader::isSiteLikeFile(
+  const std::string & fn)	/**< is the name of the file */
+	{
+	std::ifstream f(fn.c_str(), std::ios::in | std::ios::binary);
+	char magic[sizeof(sitelike_magic)];
+	f.read(magic, sizeof(magic));
+	return (f.gcount() == (std::streamsize)sizeof(magic) && std::equal(magic, magic + sizeof(magic), sitelike_magic));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads `n' bytes into the memory starting at `p', throwing XLikelihood if the end of the file is reached first.
+*/
+void SiteLikeReader::getBytes(
+  void * p,				/**< is the address at which to store the first byte read */
+  std::streamsize n)	/**< is the number of bytes to read */
+	{
+	in.read(reinterpret_cast<char *>(p), n);
+	if (in.gcount() != n)
+		throw XLikelihood(std::string("site log-likelihood file ") + filename + " is truncated or corrupt");
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of sites (including excluded sites).
+*/
+unsigned SiteLikeReader::getNumSites() const
+	{
+	return (unsigned)char_to_pattern.size();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of patterns (values per sample).
+*/
+unsigned SiteLikeReader::getNumPatterns() const
+	{
+	return num_patterns;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of samples in the file.
+*/
+unsigned SiteLikeReader::getNumSamples() const
+	{
+	return num_samples;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the site-to-pattern map stored in the header. Excluded sites map to UINT_MAX.
+*/
+const uint_vect_t & SiteLikeReader::getCharToPattern() const
+	{
+	return char_to_pattern;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the cycle at which each sample was taken.
+*/
+uint_vect_t SiteLikeReader::getCycles()
+	{
+	uint_vect_t v(num_samples);
+	unsigned k = 0;
+	for (unsigned b = 0; b < (unsigned)block_start.size(); ++b)
+		{
+		in.seekg(block_start[b]);
+		getBytes(&v[k], (std::streamsize)(block_samples[b]*sizeof(unsigned)));
+		k += block_samples[b];
+		}
+	return v;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns every sampled log-likelihood of the pattern `pattern'. Reads one contiguous run of values per block.
+*/
+double_vect_t SiteLikeReader::getPatternSamples(
+  unsigned pattern)		/**< is the index of the pattern */
+	{
+	if (pattern >= num_patterns)
+		throw XLikelihood(boost::str(boost::format("pattern index %d is out of range (file has %d patterns)") % pattern % num_patterns));
+	double_vect_t v(num_samples);
+	unsigned k = 0;
+	for (unsigned b = 0; b < (unsigned)block_start.size(); ++b)
+		{
+		const unsigned n = block_samples[b];
+		in.seekg(block_start[b] + (std::streamoff)n*sizeof(unsigned) + (std::streamoff)pattern*n*sizeof(double));
+		getBytes(&v[k], (std::streamsize)(n*sizeof(double)));
+		k += n;
+		}
+	return v;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the log of the harmonic mean of the sampled site likelihoods for every site, ignoring the first `burnin'
+|	samples. This is the log of the conditional predictive ordinate (CPO) of the site. Excluded sites get 0.0. The file
+|	is read once, block by block; for each pattern a running maximum of the negated log-likelihoods is kept so that the
+|	sum of reciprocals is accumulated without overflow. Throws XLikelihood if no samples remain after the burnin.
+*/
+double_vect_t SiteLikeReader::calcSiteLogHarmonicMeans(
+  unsigned burnin)	/**< is the number of samples at the start of the file to ignore */
+	{
+	if (burnin >= num_samples)
+		throw XLikelihood(boost::str(boost::format("site log-likelihood file %s has %d samples, not enough for a burnin of %d") % filename % num_samples % burnin));
+	double_vect_t max_neg_lnL(num_patterns, 0.0);
+	double_vect_t sum_scaled(num_patterns, 0.0);
+	double_vect_t block;
+	unsigned skip = burnin;
+	for (unsigned b = 0; b < (unsigned)block_start.size(); ++b)
+		{
+		const unsigned n = block_samples[b];
+		if (skip >= n)
+			{
+			skip -= n;
+			continue;
+			}
+		block.resize((std::size_t)n*num_patterns);
+		in.seekg(block_start[b] + (std::streamoff)n*sizeof(unsigned));
+		getBytes(&block[0], (std::streamsize)(block.size()*sizeof(double)));
+		for (unsigned p = 0; p < num_patterns; ++p)
+			{
+			const double * x = &block[p*n];
+			double & m = max_neg_lnL[p];
+			double & s = sum_scaled[p];
+			for (unsigned i = skip; i < n; ++i)
+				{
+				const double y = -x[i];
+				if (s == 0.0)
+					{
+					m = y;
+					s = 1.0;
+					}
+				else if (y > m)
+					{
+					s = s*std::exp(m - y) + 1.0;
+					m = y;
+					}
+				else
+					s += std::exp(y - m);
+				}
+			}
+		skip = 0;
+		}
+
+	const double log_n = std::log((double)(num_samples - burnin));
+	double_vect_t site_loghm(char_to_pattern.size(), 0.0);
+	for (unsigned i = 0; i < (unsigned)char_to_pattern.size(); ++i)
+		{
+		const unsigned p = char_to_pattern[i];
+		if (p < num_patterns)
+			site_loghm[i] = log_n - max_neg_lnL[p] - std::log(sum_scaled[p]);
+		}
+	return site_loghm;
+	}
+
+} // namespace phycas
@@ -0,0 +1,124 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(SITE_LIKE_FILE_HPP)
+#define SITE_LIKE_FILE_HPP
+
+#include <string>
+#include <fstream>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "phycas/src/states_patterns.hpp"		// for uint_vect_t and double_vect_t
+#include "phycas/src/async_file_writer.hpp"
+
+namespace phycas
+{
+
+class TreeLikelihood;
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Saves the pattern log-likelihoods of sampled MCMC states to a binary file for use in computing conditional 
+|	predictive ordinates (CPO). The header holds the number of sites, the number of patterns and the site-to-pattern
+|	map (UINT_MAX for excluded sites), so only one value per pattern (rather than one per site) is stored for each 
+|	sample. Samples are collected in blocks of up to `max_block_samples' samples, and each block is written 
+|	column-wise: the cycles of the samples in the block, followed by all sampled values for the first pattern, then all
+|	sampled values for the second pattern, and so on. Numbers are written in native byte order; the header records the
+|	byte order so that SiteLikeReader can refuse files written on a machine with a different one. Blocks are written to
+|	disk by a background thread (see AsyncFileWriter). A writer constructed
+|	with an empty file name just accumulates samples until they are handed to another writer by transferTo.
+*/
+class SiteLikeWriter : boost::noncopyable
+	{
+	public:
+									SiteLikeWriter(const std::string & fn);
+									~SiteLikeWriter();
+
+		void						create(const uint_vect_t & char_to_pattern, unsigned npatterns);
+		void						reopen();
+		bool						isOpen() const;
+
+		void						addSample(unsigned cycle, const TreeLikelihood & likelihood);
+		void						addPatternLnLs(unsigned cycle, const double_vect_t & pattern_lnL);
+		void						transferTo(SiteLikeWriter & other);
+
+		void						flush();
+		double						tell();
+		void						close();
+		void						setFlushInterval(double seconds);
+
+		const std::string &			getFilename() const;
+		unsigned					getNumPatterns() const;
+		unsigned					getNumBufferedSamples() const;
+
+	private:
+
+		void						writeBlock();
+		void						putBytes(const void * p, std::streamsize n);
+
+		static const unsigned		max_block_samples = 64;
+
+		std::string					filename;		/**< The name of the file (empty if samples are only buffered) */
+		AsyncFileWriter				out;			/**< Writes to `filename' in a background thread */
+		unsigned					num_patterns;	/**< The number of values stored for each sample */
+		uint_vect_t					cycles;			/**< The cycles of the samples not yet written */
+		double_vect_t				values;			/**< The pattern log-likelihoods of the samples not yet written (sample-major) */
+		double_vect_t				column_buffer;	/**< Workspace used by writeBlock to transpose `values' */
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads a file written by SiteLikeWriter. The constructor reads the header and records the position and size of every
+|	block, so individual patterns can be read without reading the entire file. Throws XLikelihood if the file cannot 
+|	be opened, was not written by SiteLikeWriter (or was written on a machine with different byte order), or is 
+|	truncated.
+*/
+class SiteLikeReader : boost::noncopyable
+	{
+	public:
+									SiteLikeReader(const std::string & fn);
+
+		static bool					isSiteLikeFile(const std::string & fn);
+
+		unsigned					getNumSites() const;
+		unsigned					getNumPatterns() const;
+		unsigned					getNumSamples() const;
+		const uint_vect_t &			getCharToPattern() const;
+		uint_vect_t					getCycles();
+		double_vect_t				getPatternSamples(unsigned pattern);
+
+		double_vect_t				calcSiteLogHarmonicMeans(unsigned burnin);
+
+	private:
+
+		void						getBytes(void * p, std::streamsize n);
+
+		std::string					filename;		/**< The name of the file (used in error messages) */
+		std::ifstream				in;				/**< The stream attached to `filename' */
+		uint_vect_t					char_to_pattern;/**< The site-to-pattern map read from the header */
+		unsigned					num_patterns;	/**< The number of values stored for each sample */
+		unsigned					num_samples;	/**< The total number of samples in all blocks */
+		std::vector<std::streamoff>	block_start;	/**< The position of the first cycle of each block */
+		uint_vect_t					block_samples;	/**< The number of samples in each block */
+	};
+
+typedef boost::shared_ptr<SiteLikeWriter> SiteLikeWriterShPtr;
+typedef boost::shared_ptr<SiteLikeReader> SiteLikeReaderShPtr;
+
+} // namespace phycas
+
+#endif
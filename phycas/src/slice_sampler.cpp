@@ -1033,3 +1033,64 @@ void SliceSampler::UseDoublingMethod(
     {
     doubling = d;
     }
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns everything needed to make this sampler continue exactly as it would have after being restored by SetState:
+|	the last sampled point, the unit width, the y-conditional adaptation settings, the mode found so far and the 
+|	diagnostic sums used by AdaptSimple and AdaptNeal. Unsigned counters are stored as doubles, which represent them 
+|	exactly.
+*/
+VecDbl SliceSampler::GetState() const
+	{
+	VecDbl v;
+	v.push_back(lastSampled.first);
+	v.push_back(lastSampled.second);
+	v.push_back(w);
+	v.push_back(ycond_on ? 1.0 : 0.0);
+	v.push_back(ycond_a);
+	v.push_back(ycond_b);
+	v.push_back(ycond_multiplier);
+	v.push_back(mode.first);
+	v.push_back(mode.second);
+	v.push_back(min_x);
+	v.push_back(max_x);
+	v.push_back(sumValues);
+	v.push_back(sumWidths);
+	v.push_back(sumDiffs);
+	v.push_back((double)func_evals);
+	v.push_back((double)failed_samples);
+	v.push_back((double)realized_m);
+	v.push_back((double)num_samples);
+	v.push_back((double)num_overrelaxed_samples);
+	return v;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the state saved by GetState. Throws XProbDist if `state' has the wrong length.
+*/
+void SliceSampler::SetState(
+  const VecDbl & state)	/**< is a vector returned by GetState */
+	{
+	if (state.size() != 19)
+		throw XProbDist("invalid state supplied to SliceSampler::SetState");
+	VecDbl::const_iterator it = state.begin();
+	lastSampled.first		= *it++;
+	lastSampled.second		= *it++;
+	w						= *it++;
+	ycond_on				= (*it++ != 0.0);
+	ycond_a					= *it++;
+	ycond_b					= *it++;
+	ycond_multiplier		= *it++;
+	mode.first				= *it++;
+	mode.second				= *it++;
+	min_x					= *it++;
+	max_x					= *it++;
+	sumValues				= *it++;
+	sumWidths				= *it++;
+	sumDiffs				= *it++;
+	func_evals				= (unsigned)*it++;
+	failed_samples			= (unsigned)*it++;
+	realized_m				= (unsigned)*it++;
+	num_samples				= (unsigned)*it++;
+	num_overrelaxed_samples	= (unsigned)*it++;
+	}
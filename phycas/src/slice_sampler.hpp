@@ -123,6 +123,11 @@ class SliceSampler
 		SliceStats				SummarizeDiagnostics();
 		void					ResetDiagnostics();
 
+		// For checkpointing
+		//
+		VecDbl					GetState() const;
+		void					SetState(const VecDbl & state);
+
 	protected:
 		
 		void					Init();
@@ -17,52 +17,45 @@
 |  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
 \~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
-#include <cmath>
-#include <limits>
-#include "phycas/src/stop_watch.hpp"    // includes <ctime>
+#include "phycas/src/stop_watch.hpp"
+#include "phycas/src/hot_path_timer.hpp"
 
 namespace phycas
 {
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Constructor sets ...
+|	Constructor calls reset and records the length of a HotPathClock tick.
 */
 StopWatch::StopWatch() 
 	{
     reset();
-    max_ticks = std::numeric_limits<std::clock_t>::max();
-    min_ticks = std::numeric_limits<std::clock_t>::min();
-    ticks_per_sec = (double)CLOCKS_PER_SEC;
+    seconds_per_tick = HotPathClock::secondsPerTick();
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Destructor clears ...
+|	Destructor does nothing.
 */
 StopWatch::~StopWatch() 
 	{
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|   
+|   Stops timing and sets the elapsed time to zero.
 */
 void StopWatch::reset()
 	{
     running = false;
     elapsed_seconds = 0.0;
-    start_ticks = (clock_t)0;
-    stop_ticks = (clock_t)0;
-    start_time = (time_t)0;
-    stop_time = (time_t)0;
+    start_ticks = 0;
+    stop_ticks = 0;
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|   
+|   Starts timing from zero.
 */
 void StopWatch::start()
 	{
-    start_time = time(NULL);
-    stop_time = start_time;
-    start_ticks = clock();
+    start_ticks = HotPathClock::now();
     stop_ticks = start_ticks;
     elapsed_seconds = 0.0;
     running = true;
@@ -73,8 +66,6 @@ void StopWatch::start()
 */
 void StopWatch::stop()
 	{
-    stop_time = time(NULL);
-    stop_ticks = clock();
     normalize();
     running = false;
 	}
@@ -89,41 +80,25 @@ double StopWatch::elapsedSeconds()
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|   Updates `elapsed_seconds' data member by computing the difference between a clock() call made now and the one made
-|   when timing was started. Overflow in the result from clock() is taken into account.
+|   Updates `elapsed_seconds' data member by computing the difference between the clock now and when timing was 
+|   started. The monotonic clock cannot overflow during a run, so calling this is never necessary; it is kept for 
+|	callers written for the clock()-based version.
 */
 void StopWatch::normalize()
 	{
     if (running)
         {
-        stop_ticks = clock();
-        if (stop_ticks < 0 && start_ticks > 0)
-            {
-            double a = (double)(max_ticks - start_ticks);
-            double b = (double)(stop_ticks - min_ticks);
-            elapsed_seconds += (a + b + 1)/ticks_per_sec;
-            }
-        else
-            {
-            elapsed_seconds += (double)(stop_ticks - start_ticks)/ticks_per_sec;
-            }
-        
-        // sanity check
-        stop_time = time(NULL);
-        //double crude_elapsed_seconds = (double)(stop_time - start_time);
-        //if (crude_elapsed_seconds > 0.0)
-        //    {
-        //    double diff = std::fabs(elapsed_seconds - crude_elapsed_seconds);
-        //    //PHYCAS_ASSERT(diff < 1.0);   // allow up to 1 sec. difference between clock() and time(NULL) estimates
-        //    }
-
-        start_ticks = stop_ticks;    
+        stop_ticks = HotPathClock::now();
+        elapsed_seconds = seconds_per_tick*(double)(stop_ticks - start_ticks);
         }
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|   Returns the clock reading when stop() or normalize() was last called (truncated to a long).
+*/
 long StopWatch::stopTicks()
 	{
-    return stop_ticks;
+    return (long)stop_ticks;
 	}
 
 std::string StopWatch::tobinary(long x)
@@ -148,48 +123,4 @@ std::string StopWatch::tobinary(long x)
     return revs;
     }
 
-#if 0
-void StopWatch::doofus()
-	{
-#if 1
-    std::string s;
-    s = tobinary(LONG_MIN);
-    std::cerr << "LONG_MIN + 0L = " << (LONG_MIN) << " = " << s << std::endl;
-    s = tobinary(LONG_MIN + 1L);
-    std::cerr << "LONG_MIN + 1L = " << (LONG_MIN + 1L) << " = " << s << std::endl;
-    s = tobinary(LONG_MIN + 2L);
-    std::cerr << "LONG_MIN + 2L = " << (LONG_MIN + 2L) << " = " << s << std::endl;
-    s = tobinary(-1L);
-    std::cerr << "-1L = " << (-1L) << " = " << s << std::endl;
-    double sz;
-    sz = (double)(std::numeric_limits<std::clock_t>::max());
-    std::cerr << "std::numeric_limits<clock_t>::max() = " << sz << std::endl;
-    sz = (double)(std::numeric_limits<std::clock_t>::min());
-    std::cerr << "std::numeric_limits<clock_t>::min() = " << sz << std::endl;
-#endif
-
-#if 1
-    long clocks_per_sec = 1000000;
-    long x = 0L;
-    double z = 0.0;
-    for (unsigned i = 0; i < 2148; ++i)
-        {
-        long prev_x = x;
-        x += clocks_per_sec;
-        if (x < 0 && prev_x > 0)
-            {
-            long a = LONG_MAX - prev_x;
-            long b = x - LONG_MIN;
-            z += (double)(a + b + 1);
-            }
-        else
-            {
-            z += (double)(x - prev_x);
-            }
-        std::cerr << i << '\t' << prev_x << '\t' << x << '\t' << z << std::endl;
-        }
-#endif
-	}
-#endif
-
 }	// namespace phycas
@@ -0,0 +1,161 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include "phycas/src/thread_pool.hpp"
+#include "phycas/src/xlikelihood.hpp"
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Starts `nthreads' - 1 worker threads, which wait until the first call to run. If `nthreads' is 0 or 1, no threads
+|	are started and run simply performs all tasks in the calling thread.
+*/
+ThreadPool::ThreadPool(
+  unsigned nthreads)	/**< is the total number of threads (including the thread that calls run) */
+  : num_threads(std::max(nthreads, 1U)), current_task(NULL), num_tasks(0), next_task(0), num_busy(0), generation(0), shutting_down(false)
+	{
+	for (unsigned t = 1; t < num_threads; ++t)
+		workers.create_thread(boost::bind(&ThreadPool::workerLoop, this, t));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Tells the worker threads to exit and waits for them to do so.
+*/
+ThreadPool::~ThreadPool()
+	{
+		{
+		boost::mutex::scoped_lock lock(mutex);
+		shutting_down = true;
+		}
+	work_available.notify_all();
+	workers.join_all();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Calls `task'(i, t) for every task index i in [0, `ntasks'), where t identifies the thread (0 for the calling thread,
+|	1 to getNumThreads() - 1 for the workers) performing the task. Returns only after all tasks have been performed. 
+|	Tasks must not modify anything that other tasks read or write. If a task throws an exception, the remaining tasks
+|	are still performed and an XLikelihood exception carrying the first error message is thrown after all have finished.
+*/
+void ThreadPool::run(
+  unsigned ntasks,		/**< is the number of tasks */
+  const Task & task)	/**< is the function to call for each task */
+	{
+	if (ntasks == 0)
+		return;
+
+	if (num_threads == 1 || ntasks == 1)
+		{
+		for (unsigned i = 0; i < ntasks; ++i)
+			task(i, 0);
+		return;
+		}
+
+		{
+		boost::mutex::scoped_lock lock(mutex);
+		current_task	= &task;
+		num_tasks		= ntasks;
+		next_task		= 0;
+		num_busy		= num_threads - 1;
+		error_msg.clear();
+		++generation;
+		}
+	work_available.notify_all();
+
+	doTasks(0);
+
+	std::string msg;
+		{
+		boost::mutex::scoped_lock lock(mutex);
+		while (num_busy > 0)
+			work_finished.wait(lock);
+		current_task = NULL;
+		msg.swap(error_msg);
+		}
+	if (!msg.empty())
+		throw XLikelihood(msg);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Performs tasks from the current batch until none remain to be handed out.
+*/
+void ThreadPool::doTasks(
+  unsigned thread_index)	/**< is the index of the calling thread */
+	{
+	for (;;)
+		{
+		unsigned i = 0;
+			{
+			boost::mutex::scoped_lock lock(mutex);
+			if (next_task >= num_tasks)
+				return;
+			i = next_task++;
+			}
+		try
+			{
+			(*current_task)(i, thread_index);
+			}
+		catch(std::exception & x)
+			{
+			boost::mutex::scoped_lock lock(mutex);
+			if (error_msg.empty())
+				error_msg = (*x.what() != '\0' ? x.what() : "unknown error in worker thread");
+			}
+		catch(...)
+			{
+			boost::mutex::scoped_lock lock(mutex);
+			if (error_msg.empty())
+				error_msg = "unknown error in worker thread";
+			}
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Body of each worker thread: waits for a batch of tasks to be posted by run, helps perform them, and reports back 
+|	when no tasks remain. Returns when the pool is destroyed.
+*/
+void ThreadPool::workerLoop(
+  unsigned thread_index)	/**< is the index of this worker (1 to getNumThreads() - 1) */
+	{
+	unsigned last_generation = 0;
+	for (;;)
+		{
+			{
+			boost::mutex::scoped_lock lock(mutex);
+			while (!shutting_down && generation == last_generation)
+				work_available.wait(lock);
+			if (shutting_down)
+				return;
+			last_generation = generation;
+			}
+
+		doTasks(thread_index);
+
+			{
+			boost::mutex::scoped_lock lock(mutex);
+			if (--num_busy == 0)
+				work_finished.notify_one();
+			}
+		}
+	}
+
+} // namespace phycas
@@ -0,0 +1,77 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(THREAD_POOL_HPP)
+#define THREAD_POOL_HPP
+
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	A fixed-size pool of worker threads used to split loops over data patterns among processor cores. The thread that 
+|	calls run participates in the work, so a pool created for n threads starts only n - 1 worker threads. Tasks are
+|	handed out in order of their index, but may complete in any order; callers that need reproducible results must 
+|	have each task write to its own slot of an output array and combine the slots (in index order) after run returns.
+*/
+class ThreadPool : boost::noncopyable
+	{
+	public:
+
+		typedef boost::function<void (unsigned, unsigned)> Task;	/**< Called as task(task index, thread index) */
+
+									ThreadPool(unsigned nthreads);
+									~ThreadPool();
+
+		unsigned					getNumThreads() const;
+		void						run(unsigned ntasks, const Task & task);
+
+	private:
+
+		void						workerLoop(unsigned thread_index);
+		void						doTasks(unsigned thread_index);
+
+		unsigned					num_threads;		/**< The number of threads (including the calling thread) that share the work */
+		boost::thread_group			workers;			/**< The num_threads - 1 worker threads */
+		boost::mutex				mutex;				/**< Guards all data members below */
+		boost::condition_variable	work_available;		/**< Signalled when a new batch of tasks is posted (or the pool is shutting down) */
+		boost::condition_variable	work_finished;		/**< Signalled when the last worker finishes its share of the current batch */
+		const Task *				current_task;		/**< The task being run for the current batch */
+		unsigned					num_tasks;			/**< The number of tasks in the current batch */
+		unsigned					next_task;			/**< The index of the next task to be handed out */
+		unsigned					num_busy;			/**< The number of workers that have not yet finished the current batch */
+		unsigned					generation;			/**< Incremented each time a batch is posted so that workers can tell a new batch from a spurious wakeup */
+		bool						shutting_down;		/**< Set by the destructor to tell workers to exit */
+		std::string					error_msg;			/**< The message of the first exception thrown by a task in the current batch */
+	};
+
+typedef boost::shared_ptr<ThreadPool> ThreadPoolShPtr;
+
+} // namespace phycas
+
+#include "phycas/src/thread_pool.inl"
+
+#endif
@@ -41,6 +41,7 @@ TipData::TipData(
 	const unsigned num_subsets = partition->getNumSubsets();
 	
 	pMatrixTranspose.resize(num_subsets);
+	pMatrixStamps.resize(num_subsets);
 	
 	for (unsigned i = 0; i < num_subsets; ++i)
 		{
@@ -85,6 +86,7 @@ TipData::TipData(
 	state_codes 	= state_list_vect_t(num_subsets);
 	
 	pMatrixTranspose.resize(num_subsets);
+	pMatrixStamps.resize(num_subsets);
 	univents.resize(num_subsets);
 	sMat.resize(num_subsets);
 	
@@ -32,6 +32,7 @@
 #include "phycas/src/univents.hpp"
 
 #include "phycas/src/partition_model.hpp"
+#include "phycas/src/pmatrix_stamp.hpp"
 
 #include "phycas/src/cond_likelihood_storage.hpp"
 
@@ -175,6 +176,7 @@ class TipData
 		state_list_pos_vect_t						state_list_pos;		/**< Vector of indices into the tip-specific `state_codes' array */
 		state_list_vect_t							state_codes;		/**< Array of tip-specific state codes */
 		std::vector< ScopedThreeDMatrix<double> >	pMatrixTranspose;	/**< pMatrixTranspose[s][r] is the transposed transition matrix for subset s and relative rate r */
+		mutable std::vector<PMatrixStamp>			pMatrixStamps;		/**< pMatrixStamps[s] records the inputs used to compute pMatrixTranspose[s] (see TreeLikelihood::refreshPMatTranspose) */
 		CondLikelihoodStorageShPtr					cla_pool;			/**< Source of CondLikelihood objects if needed */
 		std::vector<unsigned **> sMat;
 	};
@@ -210,21 +212,25 @@ inline const double * const * const * TipData::getConstTransposedPMatrices(
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Accessor function that returns the element of `pMatrixTranspose' (non-const) corresponding to subset `i'.
+|	Accessor function that returns the element of `pMatrixTranspose' (non-const) corresponding to subset `i'. Because 
+|	the caller may modify the matrices, the corresponding element of `pMatrixStamps' is invalidated.
 */
 inline double * * * TipData::getTransposedPMatrices(
   unsigned i)		/**< is the subset */
 	{
+	pMatrixStamps[i].invalidate();
 	return pMatrixTranspose[i].ptr;
 	}
 	
 /*----------------------------------------------------------------------------------------------------------------------
-|	Accessor function that returns the data member `pMatrixTranspose' (non-const).
+|	Accessor function that returns the data member `pMatrixTranspose' (non-const). Because the caller may modify the
+|	matrices, the corresponding element of `pMatrixStamps' is invalidated.
 */
 inline double * * * TipData::getMutableTransposedPMatrices(
   unsigned i)		/**< is the subset */
   const
 	{
+	pMatrixStamps[i].invalidate();
 	return pMatrixTranspose[i].ptr;
 	}	
 
@@ -35,9 +35,10 @@
 #include "phycas/src/partition_model.hpp"
 #include "phycas/src/char_super_matrix.hpp"
 #include "phycas/src/codon_model.hpp"
+#include "phycas/src/pattern_table.hpp"
+#include "phycas/src/xlikelihood.hpp"
 //#include <CoreServices/CoreServices.h>
 //#undef check	
-#include "libhmsbeagle/beagle.h"
 
 // formerly in tree_likelihood.inl
 #include "phycas/src/edge_endpoints.hpp"
@@ -246,13 +247,28 @@ double TreeUniventSubsetStruct::calcUnimapLnL(TreeShPtr t, TreeLikelihood & tree
 // **************************************************************************************
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	TreeLikelihood constructor.
+|	TreeLikelihood constructor. If `blocked' is true, conditional likelihood arrays use the pattern-blocked 
+|	layout (see CLASubsetLayout), which keeps every rate category of a block of patterns together in memory; the 
+|	layout cannot be changed afterwards.
 */
 TreeLikelihood::TreeLikelihood(
-  PartitionModelShPtr mod)		/**< is the partition model */
+  PartitionModelShPtr mod,		/**< is the partition model */
+  bool blocked)					/**< is true to use the pattern-blocked layout for conditional likelihood arrays */
   :
+  pmat_caching(true),
+  pmat_cache_hits(0),
+  pmat_cache_misses(0),
+  engine_root_parent(0),
+  engine_root_child(0),
+  engine_root_pmat(0),
   likelihood_root(0),
+  changed_subset(-1),
+  cla_subset(-1),
+  edge_focal(0),
+  edge_neighbor(0),
+  pattern_blocked(blocked),
   store_site_likes(false),
+  site_likelihood_lnL(0.0),
   no_data(false),
   nTaxa(0),
   partition_model(mod),
@@ -342,6 +358,17 @@ bool TreeLikelihood::storingSiteLikelihoods() const
     return store_site_likes;
     }
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if `site_likelihood' holds the site likelihoods from a calculation that produced the log-likelihood 
+|	`lnL'. Used to avoid recomputing the likelihood just to obtain site likelihoods: if the most recent calculation that
+|	stored site likelihoods was of the state whose log-likelihood is `lnL', those site likelihoods can be used as is.
+*/
+bool TreeLikelihood::hasSiteLikelihoodsFor(
+  double lnL) const	/**< is the log-likelihood of the current state */
+    {
+    return (store_site_likes && !site_likelihood.empty() && site_likelihood_lnL == lnL);
+    }
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Sets the current value of the data member `store_site_likes' to true if `yes' is true, and false if `yes' is false.
 */
@@ -391,6 +418,138 @@ void TreeLikelihood::useUnimap(
 	using_unimap = yes_or_no;
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Specifies whether refreshPMat and refreshPMatTranspose may skip recomputing transition matrices whose inputs (model,
+|	model time stamp and scaled edge lengths) are unchanged since they were last computed. Caching is on by default; 
+|	turning it off is useful mainly for checking that it makes no difference to the likelihood. Caching is never used
+|	with uniformized mapping, which manages transition matrices itself.
+*/
+void TreeLikelihood::usePMatCache(
+  bool yes_or_no)	/**< is true to cache transition matrices, false to always recompute them */
+	{
+	pmat_caching = yes_or_no;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the current value of the data member `pmat_caching'.
+*/
+bool TreeLikelihood::isUsingPMatCache() const
+	{
+	return pmat_caching;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of times (since construction or the last call to resetPMatCacheStats) that the transition 
+|	matrices of one subset for one node were found to be up to date and thus not recomputed.
+*/
+unsigned TreeLikelihood::getPMatCacheHits() const
+	{
+	return pmat_cache_hits;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of times (since construction or the last call to resetPMatCacheStats) that the transition 
+|	matrices of one subset for one node had to be recomputed.
+*/
+unsigned TreeLikelihood::getPMatCacheMisses() const
+	{
+	return pmat_cache_misses;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the counters returned by getPMatCacheHits and getPMatCacheMisses to zero.
+*/
+void TreeLikelihood::resetPMatCacheStats()
+	{
+	pmat_cache_hits = 0;
+	pmat_cache_misses = 0;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if the hot-path counters reported by getNumCLACalcs and its relatives are being maintained, which is
+|	the case unless Phycas was compiled with PHYCAS_NO_HOT_PATH_TIMING defined (see hot_path_timer.hpp).
+*/
+bool TreeLikelihood::isTimingHotPaths() const
+	{
+	return phycas::isTimingHotPaths();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of conditional likelihood arrays computed (since construction or the last call to 
+|	resetHotPathStats) by calcCLATwoTips, calcCLAOneTip and calcCLANoTips.
+*/
+double TreeLikelihood::getNumCLACalcs() const
+	{
+	return cla_timing.getCount();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of seconds spent computing the conditional likelihood arrays counted by getNumCLACalcs, 
+|	including underflow correction and the extra children of polytomies. Does not include the time spent computing
+|	transition matrices (see getPMatCalcSeconds).
+*/
+double TreeLikelihood::getCLACalcSeconds() const
+	{
+	return cla_timing.getSeconds();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of times (since construction or the last call to resetHotPathStats) the transition matrices of 
+|	one subset were computed for one edge, whether individually (calcPMatCommon) or in a batch (refreshPMatrixBatch).
+*/
+double TreeLikelihood::getNumPMatCalcs() const
+	{
+	return pmat_timing.getCount();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of seconds spent computing the transition matrices counted by getNumPMatCalcs.
+*/
+double TreeLikelihood::getPMatCalcSeconds() const
+	{
+	return pmat_timing.getSeconds();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of conditional likelihood arrays rescaled to prevent underflow (since construction or the last 
+|	call to resetHotPathStats). Always 0 if power-of-two scaling is in use (see UnderflowManager::getCorrectionTiming).
+*/
+double TreeLikelihood::getNumUnderflowCorrections() const
+	{
+	return underflow_manager.getCorrectionTiming().getCount();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of seconds spent rescaling the conditional likelihood arrays counted by 
+|	getNumUnderflowCorrections. Always 0: the CLA kernels rescale each block of patterns as it is computed, so this 
+|	time is part of getCLACalcSeconds (the function is kept so that existing scripts still work).
+*/
+double TreeLikelihood::getUnderflowCorrectionSeconds() const
+	{
+	return underflow_manager.getCorrectionTiming().getSeconds();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of cached conditional likelihood arrays restored (since construction or the last call to 
+|	resetHotPathStats) when proposals were rejected, each one being a conditional likelihood array that did not have 
+|	to be recomputed.
+*/
+double TreeLikelihood::getNumCacheRestores() const
+	{
+	return cache_restores.getCount();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets all counters reported by getNumCLACalcs and its relatives to zero.
+*/
+void TreeLikelihood::resetHotPathStats()
+	{
+	cla_timing.reset();
+	pmat_timing.reset();
+	cache_restores.reset();
+	underflow_manager.resetCorrectionTiming();
+	}
+
 
 
 std::string TreeUniventSubsetStruct::debugShowSMatrix() const
@@ -891,6 +1050,97 @@ void TreeLikelihood::setUFNumEdges(
 	underflow_manager.setTriggerSensitivity(nedges);
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	If `yes_or_no' is true, conditional likelihood arrays are protected from underflow by rescaling each pattern by a
+|	power of 2 wherever needed (see CLAKernels::rescaleBlock), rather than by rescaling every pattern by a factor of e^k
+|	once every `underflow_num_edges' edges. Resets `likelihood_root' because the underflow corrections already stored
+|	in conditional likelihood arrays are not valid under the other scheme.
+*/
+void TreeLikelihood::usePowerOfTwoScaling(
+  bool yes_or_no)	/**< is true to rescale by powers of 2 inside the kernels */
+	{
+	underflow_manager.setPowerOfTwoScaling(yes_or_no);
+	useAsLikelihoodRoot(NULL);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if conditional likelihood arrays are rescaled by powers of 2 inside the CLA kernels (see 
+|	usePowerOfTwoScaling).
+*/
+bool TreeLikelihood::isUsingPowerOfTwoScaling() const
+	{
+	return underflow_manager.isPowerOfTwoScaling();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the level of the loops used to compute conditional likelihood arrays (0 = scalar, 1 = SSE2, 2 = AVX2, 
+|	3 = AVX-512). See CLAKernels::KernelLevel.
+*/
+unsigned TreeLikelihood::getCLAKernelLevel() const
+	{
+	return cla_kernels.getLevel();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Selects the level of the loops used to compute conditional likelihood arrays (0 = scalar, 1 = SSE2, 2 = AVX2, 
+|	3 = AVX-512). Levels higher than the processor supports are reduced to the highest supported level. By default, the
+|	highest supported level is used; lower levels are useful mainly for checking that all levels give the same answer.
+|	Resets `likelihood_root' so that the next call to calcLnL recomputes every conditional likelihood array.
+*/
+void TreeLikelihood::setCLAKernelLevel(
+  unsigned level)	/**< is the requested kernel level */
+	{
+	cla_kernels.setLevel(level);
+	useAsLikelihoodRoot(NULL);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the name of the instruction set used by the loops that compute conditional likelihood arrays.
+*/
+std::string TreeLikelihood::getCLAKernelName() const
+	{
+	return CLAKernels::getLevelName(cla_kernels.getLevel());
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if conditional likelihood arrays are stored in single precision, which is the case only if Phycas was
+|	compiled with PHYCAS_FLOAT_CLA defined (see cond_likelihood.hpp).
+*/
+bool TreeLikelihood::isUsingFloatCLAs() const
+	{
+	return (sizeof(LikeFltType) == sizeof(float));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of threads among which the patterns are divided when computing the likelihood (1 unless
+|	setNumThreads has been called with a larger value).
+*/
+unsigned TreeLikelihood::getNumThreads() const
+	{
+	return (thread_pool ? thread_pool->getNumThreads() : 1);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the number of threads among which the patterns are divided when computing the likelihood. If `nthreads' is
+|	greater than 1, a pool of `nthreads' - 1 worker threads is created (the calling thread does its share of the work);
+|	if `nthreads' is 0 or 1, any existing pool is destroyed and all work is done in the calling thread. Patterns are
+|	divided into blocks whose size depends only on the number of states, and block log-likelihoods are always added in
+|	the same order, so the log-likelihood does not depend on the number of threads.
+*/
+void TreeLikelihood::setNumThreads(
+  unsigned nthreads)	/**< is the number of threads to use */
+	{
+	if (nthreads == getNumThreads())
+		return;
+	cla_kernels.setThreadPool(NULL);
+	thread_pool.reset();
+	if (nthreads > 1)
+		thread_pool.reset(new ThreadPool(nthreads));
+	cla_kernels.setThreadPool(thread_pool.get());
+	for (std::vector<LikelihoodEngineShPtr>::iterator it = engines.begin(); it != engines.end(); ++it)
+		(*it)->setThreadPool(thread_pool.get());
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Returns number of bytes allocated for each CLA. This equals sizeof(LikeFltType) times the product of the number of
 |	patterns, number of rates and number of states. Calls corresponding function of data member `cla_pool' to get the
@@ -921,6 +1171,64 @@ unsigned TreeLikelihood::numCLAsStored() const
 	return cla_pool->numCLAsStored();
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Turns arena allocation of conditional likelihood arrays on or off (see CondLikelihoodStorage::useArena). In arena
+|	mode, prepareForLikelihood also creates, in a single slab, enough CLAs for the tree being prepared. If `huge_pages' 
+|	is true, large slabs are backed by huge pages where the operating system supports it. Affects only CLAs created from 
+|	now on.
+*/
+void TreeLikelihood::useCLAArena(
+  bool yes_or_no,	/**< is true to allocate CLAs from slabs, false to allocate each CLA separately */
+  bool huge_pages)	/**< is true to request huge pages for large slabs */
+	{
+	cla_pool->useArena(yes_or_no, huge_pages);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if conditional likelihood arrays are being allocated from slabs. Calls corresponding function of data
+|	member `cla_pool' to get the value returned.
+*/
+bool TreeLikelihood::isUsingCLAArena() const
+	{
+	return cla_pool->isUsingArena();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if conditional likelihood arrays use the pattern-blocked layout (see CLASubsetLayout), which was 
+|	chosen when this object was constructed.
+*/
+bool TreeLikelihood::isPatternBlocked() const
+	{
+	return pattern_blocked;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the object describing where the conditional likelihoods of subset `subset' lie within each conditional 
+|	likelihood array. Valid only after data have been supplied (see recalcRelativeRates).
+*/
+const CLASubsetLayout & TreeLikelihood::getCLALayout(
+  unsigned subset)	/**< is the index of the partition subset */
+  const
+	{
+	PHYCAS_ASSERT(subset < cla_layout.size());
+	return cla_layout[subset];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the index of the first element of each conditional likelihood array belonging to subset `subset', which 
+|	follows the elements of all earlier subsets (see getCLALayout).
+*/
+unsigned TreeLikelihood::getCLASubsetStart(
+  unsigned subset)	/**< is the index of the partition subset */
+  const
+	{
+	PHYCAS_ASSERT(subset < cla_layout.size());
+	unsigned start = 0;
+	for (unsigned i = 0; i < subset; ++i)
+		start += cla_layout[i].length;
+	return start;
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Returns the current value of `likelihood_root'. See TreeLikelihood::useAsLikelihoodRoot for more information about
 |	the meaning of the likelihood root.
@@ -1139,7 +1447,8 @@ void TreeLikelihood::replacePartitionModel(
 |   calls the recalcRatesAndProbs function of the model to force recalculation of its `rate_means' and `rate_probs' 
 |   vectors. Should be called after changing the number of rate categories, the gamma shape parameter, or the pinvar 
 |   parameter of any subset model. Note that if the number of rate categories changes, trees on which likelihoods need 
-|   to be calculated also need to be re-equipped by calling prepareForLikelihood. 
+|   to be calculated also need to be re-equipped by calling prepareForLikelihood. Also recomputes `cla_layout' and 
+|   passes the dimensions on to `cla_pool' and `underflow_manager'.
 */
 void TreeLikelihood::recalcRelativeRates()
 	{
@@ -1149,9 +1458,10 @@ void TreeLikelihood::recalcRelativeRates()
 		PHYCAS_ASSERT(partition_model->subset_num_rates[i] == partition_model->subset_model[i]->getNRatesTotal());
         partition_model->subset_model[i]->recalcRatesAndProbs(rate_means[i], rate_probs[i]); //POL_BOOKMARK recalcRatesAndProbs call
 	    }
+	CondLikelihood::calcLayout(cla_layout, partition_model->subset_num_patterns, partition_model->subset_num_rates, partition_model->subset_num_states, pattern_blocked);
 	if (!no_data)
-		cla_pool->setCondLikeDimensions(partition_model->subset_num_patterns, partition_model->subset_num_rates, partition_model->subset_num_states);
-	underflow_manager.setDimensions(partition_model->subset_num_patterns, partition_model->subset_num_rates, partition_model->subset_num_states);
+		cla_pool->setCondLikeDimensions(partition_model->subset_num_patterns, partition_model->subset_num_rates, partition_model->subset_num_states, pattern_blocked);
+	underflow_manager.setDimensions(partition_model->subset_num_patterns);
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -1310,6 +1620,50 @@ void TreeLikelihood::useAsLikelihoodRoot(
   TreeNode * nd)
 	{
 	likelihood_root = nd;
+	changed_subset = -1;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Called instead of useAsLikelihoodRoot(NULL) when a parameter of the substitution model `mod' has changed. If `mod'
+|	is the model of just one partition subset, the next call to calcLnL recomputes only the part of each conditional
+|	likelihood array belonging to that subset (see refreshChangedSubsetCLAs), which for data divided into many subsets
+|	is much less work than recomputing every CLA in full. If `mod' is shared by several subsets, or if the CLAs were
+|	already waiting to be recomputed on behalf of a different subset, this function behaves like
+|	useAsLikelihoodRoot(NULL).
+*/
+void TreeLikelihood::invalidateSubsetCLAs(
+  ModelShPtr mod)	/**< is the model whose parameters have changed */
+	{
+	int subset = -1;
+	const unsigned num_subsets = partition_model->getNumSubsets();
+	for (unsigned i = 0; i < num_subsets; ++i)
+		{
+		if (partition_model->subset_model[i] == mod)
+			{
+			if (subset >= 0)
+				{
+				// mod is shared by more than one subset
+				useAsLikelihoodRoot(NULL);
+				return;
+				}
+			subset = (int)i;
+			}
+		}
+
+	if (subset < 0 || num_subsets == 1)
+		useAsLikelihoodRoot(NULL);
+	else if (likelihood_root != NULL)
+		{
+		// Every CLA in the tree is currently valid, so only those of this subset need recomputing
+		likelihood_root = NULL;
+		changed_subset = subset;
+		}
+	else if (changed_subset != subset)
+		{
+		// Either every CLA is already to be recomputed, or the CLAs of another subset are waiting to be
+		// recomputed too, in which case it is simplest to recompute everything
+		changed_subset = -1;
+		}
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -1368,22 +1722,31 @@ void TreeLikelihood::refreshCLA(
 	if (firstNeighbor->IsTip())
 		{
 		TipData & firstTD = *(firstNeighbor->GetTipData());
-        for (unsigned i = 0; i < num_subsets; ++i)
-    		calcPMatTranspose(i, firstTD.getTransposedPMatrices(i), firstTD.getConstStateListPos(i), firstEdgeLen);
+		for (unsigned i = 0; i < num_subsets; ++i)
+			{
+			if (isRefreshingSubset(i))
+				refreshPMatTranspose(i, firstTD, firstEdgeLen);
+			}
 		if (secondNeighbor->IsTip())
 			{
 			// 1. both neighbors are tips
 			TipData & secondTD = *(secondNeighbor->GetTipData());
-            for (unsigned i = 0; i < num_subsets; ++i)
-                calcPMatTranspose(i, secondTD.getTransposedPMatrices(i), secondTD.getConstStateListPos(i), secondNeighbor->GetEdgeLen());
+			for (unsigned i = 0; i < num_subsets; ++i)
+				{
+				if (isRefreshingSubset(i))
+					refreshPMatTranspose(i, secondTD, secondNeighbor->GetEdgeLen());
+				}
 			calcCLATwoTips(*ndCondLike, firstTD, secondTD);
 			}
 		else
 			{
 			// 2. first neighbor is a tip, but second is an internal node
 			InternalData & secondID = *(secondNeighbor->GetInternalData());
-            for (unsigned i = 0; i < num_subsets; ++i)
-			    calcPMat(i, secondID.getPMatrices(i), secondNeighbor->GetEdgeLen());
+			for (unsigned i = 0; i < num_subsets; ++i)
+				{
+				if (isRefreshingSubset(i))
+					refreshPMat(i, secondID, secondNeighbor->GetEdgeLen());
+				}
 			CondLikelihoodShPtr secCL = getCondLikePtr(secondNeighbor, &nd);
 			calcCLAOneTip(*ndCondLike, firstTD, secondID, *secCL);
 			}
@@ -1391,23 +1754,32 @@ void TreeLikelihood::refreshCLA(
 	else
 		{
 		InternalData & firstID = *(firstNeighbor->GetInternalData());
-        for (unsigned i = 0; i < num_subsets; ++i)
-    		calcPMat(i, firstID.getPMatrices(i), firstEdgeLen);
+		for (unsigned i = 0; i < num_subsets; ++i)
+			{
+			if (isRefreshingSubset(i))
+				refreshPMat(i, firstID, firstEdgeLen);
+			}
 		const CondLikelihood & firCL = *getCondLikePtr(firstNeighbor, &nd);
 		if (secondNeighbor->IsTip())
 			{
 			// 3. first neighbor internal node, but second is a tip
 			TipData & secondTD = *(secondNeighbor->GetTipData());
-            for (unsigned i = 0; i < num_subsets; ++i)
-	    		calcPMatTranspose(i, secondTD.getTransposedPMatrices(i), secondTD.getConstStateListPos(i), secondNeighbor->GetEdgeLen());
+			for (unsigned i = 0; i < num_subsets; ++i)
+				{
+				if (isRefreshingSubset(i))
+					refreshPMatTranspose(i, secondTD, secondNeighbor->GetEdgeLen());
+				}
 			calcCLAOneTip(*ndCondLike, secondTD, firstID, firCL);
 			}
 		else
 			{
 			// 4. both neighbors are internal nodes
 			InternalData & secondID = *(secondNeighbor->GetInternalData());
-            for (unsigned i = 0; i < num_subsets; ++i)
-    			calcPMat(i, secondID.getPMatrices(i), secondNeighbor->GetEdgeLen());
+			for (unsigned i = 0; i < num_subsets; ++i)
+				{
+				if (isRefreshingSubset(i))
+					refreshPMat(i, secondID, secondNeighbor->GetEdgeLen());
+				}
 			const CondLikelihood & secCL = *getCondLikePtr(secondNeighbor, &nd);
 			calcCLANoTips(*ndCondLike, firstID, firCL, secondID, secCL);
 			}
@@ -1421,15 +1793,21 @@ void TreeLikelihood::refreshCLA(
 			if (currNd->IsTip())
 				{
 				TipData & currTD = *(currNd->GetTipData());
-                for (unsigned i = 0; i < num_subsets; ++i)
-		    		calcPMatTranspose(i, currTD.getTransposedPMatrices(i), currTD.getConstStateListPos(i), currNd->GetEdgeLen());
+				for (unsigned i = 0; i < num_subsets; ++i)
+					{
+					if (isRefreshingSubset(i))
+						refreshPMatTranspose(i, currTD, currNd->GetEdgeLen());
+					}
 				conditionOnAdditionalTip(*ndCondLike, currTD);
 				}
 			else
 				{
 				InternalData & currID = *(currNd->GetInternalData());
-                for (unsigned i = 0; i < num_subsets; ++i)
-		    		calcPMat(i, currID.getPMatrices(i), currNd->GetEdgeLen());
+				for (unsigned i = 0; i < num_subsets; ++i)
+					{
+					if (isRefreshingSubset(i))
+						refreshPMat(i, currID, currNd->GetEdgeLen());
+					}
 				const CondLikelihood & currCL = *getCondLikePtr(currNd, &nd);
 				conditionOnAdditionalInternal(*ndCondLike, currID, currCL);
 				}
@@ -1756,6 +2134,7 @@ bool TreeLikelihood::restoreFromCacheParentalOnly(TreeNode * ref_nd, TreeNode *
 		// Move cached to working if cached exists
 		if (td->parCachedCLA)
 			{
+			PHYCAS_HOT_PATH_COUNT(cache_restores);
 			td->parWorkingCLA = td->parCachedCLA;
 			td->parCachedCLA.reset();
 			}
@@ -1772,6 +2151,7 @@ bool TreeLikelihood::restoreFromCacheParentalOnly(TreeNode * ref_nd, TreeNode *
 		// Move cached to working if cached exists
 		if (id->parCachedCLA)
 			{
+			PHYCAS_HOT_PATH_COUNT(cache_restores);
 			id->parWorkingCLA = id->parCachedCLA;
 			id->parCachedCLA.reset();
 			}
@@ -1803,6 +2183,7 @@ bool TreeLikelihood::restoreFromCacheBothEnds(TreeNode * ref_nd, TreeNode * /* u
 		// Move cached to working if cached exists
 		if (td->parCachedCLA)
 			{
+			PHYCAS_HOT_PATH_COUNT(cache_restores);
 			td->parWorkingCLA = td->parCachedCLA;
 			td->parCachedCLA.reset();
 			}
@@ -1822,6 +2203,7 @@ bool TreeLikelihood::restoreFromCacheBothEnds(TreeNode * ref_nd, TreeNode * /* u
 		// Move cached to working if cached exists
 		if (id->parCachedCLA)
 			{
+			PHYCAS_HOT_PATH_COUNT(cache_restores);
 			id->parWorkingCLA = id->parCachedCLA;
 			id->parCachedCLA.reset();
 			}
@@ -1836,6 +2218,7 @@ bool TreeLikelihood::restoreFromCacheBothEnds(TreeNode * ref_nd, TreeNode * /* u
 		// Move cached to working if cached exists
 		if (id->childCachedCLA)
 			{
+			PHYCAS_HOT_PATH_COUNT(cache_restores);
 			id->childWorkingCLA = id->childCachedCLA;
 			id->childCachedCLA.reset();
 			}
@@ -1869,6 +2252,7 @@ bool TreeLikelihood::restoreFromCacheNode(TreeNode * ref_nd, TreeNode * neighbor
 		// Move cached to working if there is a cached CLA
 		if (td->parCachedCLA)
 			{
+			PHYCAS_HOT_PATH_COUNT(cache_restores);
 			td->parWorkingCLA = td->parCachedCLA;
 			td->parCachedCLA.reset();
 			}
@@ -1887,6 +2271,7 @@ bool TreeLikelihood::restoreFromCacheNode(TreeNode * ref_nd, TreeNode * neighbor
 			// Move cached to working if there is a cached CLA
 			if (id->parCachedCLA)
 				{
+				PHYCAS_HOT_PATH_COUNT(cache_restores);
 				id->parWorkingCLA = id->parCachedCLA;
 				id->parCachedCLA.reset();
 				}
@@ -1908,6 +2293,7 @@ bool TreeLikelihood::restoreFromCacheNode(TreeNode * ref_nd, TreeNode * neighbor
 			// Move cached to working if there is a cached CLA
 			if (id->childCachedCLA)
 				{
+				PHYCAS_HOT_PATH_COUNT(cache_restores);
 				id->childWorkingCLA = id->childCachedCLA;
 				id->childCachedCLA.reset();
 				}
@@ -1994,7 +2380,7 @@ void TreeLikelihood::simulateImpl(SimDataShPtr sim_data, TreeShPtr t, LotShPtr r
     if (num_partition_subsets > 1)
         site_assignments = partition_model->getSiteAssignments();   // Note: nchar is ignored if more than 1 subset
     else
-        default_site_assignments.assign(0, nchar);
+        default_site_assignments.assign(nchar, 0);
 
     // Make sure sim_data's patternVect is long enough to save all simulated patterns
     nchar = (unsigned)site_assignments.size();
@@ -2144,7 +2530,7 @@ void TreeLikelihood::simulateImpl(SimDataShPtr sim_data, TreeShPtr t, LotShPtr r
                     // Get the T matrix
                     TipData & ndTD = *(nd->GetTipData());
                     //double * * Tmatrix = ndTD.pMatrixTranspose[r];
-                    double * * Tmatrix = rootTD.getTransposedPMatrices(subset)[r];   //POLSIM
+                    double * * Tmatrix = ndTD.getTransposedPMatrices(subset)[r];   //POLSIM
 
                     // Choose a uniform random deviate
                     double u = rng->Uniform(FILE_AND_LINE);
@@ -2408,347 +2794,8 @@ double TreeLikelihood::calcLnL(
     // You can reset this value to 0 using resetNumLikelihoodEvals()
     incrementNumLikelihoodEvals();
     
-	if (_useBeagleLib) {
-#if 0 // JC model test
-		if (!beagleLib) {
-			beagleLib = BeagleLibShPtr(new BeagleLib);
-			beagleLib->Init(t->GetNTips(), 1, 4, (unsigned)pattern_counts.size());
-			
-			std::vector<double> freqs(4, 0.25);
-			beagleLib->SetStateFrequencies(freqs);
-			
-			beagleLib->SetTipStates(t);
-			
-			std::vector<double> rates(1, 1.0);
-			std::vector<double> weights(1, 1.0);
-			beagleLib->SetCategoryRatesAndWeights(rates, weights);
-			
-			beagleLib->SetPatternWeights(pattern_counts);
-			
-			double tmp3[4] = {0.0, -1.3333333333333333, -1.3333333333333333, -1.3333333333333333};
-			std::vector<double> eigenValues(tmp3, tmp3+4);		
-			
-			double tmp[16] = {1.0,  2.0,  0.0,  0.5, 1.0,  -2.0,  0.5,  0.0, 1.0,  2.0, 0.0,  -0.5, 1.0,  -2.0,  -0.5,  0.0};
-			std::vector<double> eigenVectors(tmp, tmp+16);
-			
-			double tmp2[16] = {0.25,  0.25,  0.25,  0.25, 0.125,  -0.125,  0.125,  -0.125, 0.0,  1.0,  0.0,  -1.0, 1.0,  0.0,  -1.0,  0.0};
-			std::vector<double> inverseEigenVectors(tmp2, tmp2+16);		
-			beagleLib->SetEigenDecomposition(eigenValues, eigenVectors, inverseEigenVectors);			
-		}
-		
-		beagleLib->DefineOperations(t);
-		lnL = beagleLib->CalcLogLikelihood(t);
-#endif
-#if 1 // Codon model test
-		if (!beagleLib) {
-			beagleLib = BeagleLibShPtr(new BeagleLib);
-			beagleLib->Init(t->GetNTips(), 1, 61, (unsigned)pattern_counts.size());
-			
-			beagleLib->SetTipStates(t);
-			
-			std::vector<double> rates(1, 1.0);
-			std::vector<double> weights(1, 1.0);
-			beagleLib->SetCategoryRatesAndWeights(rates, weights);
-			
-			beagleLib->SetPatternWeights(pattern_counts);
-		}
-		
-		ModelShPtr subsetModel = partition_model->getModel(0);
-		
-		std::vector<double> freqs(61, 0.0);
-		subsetModel->beagleGetStateFreqs(freqs);
-		
-		std::vector<double> eigenValues(61, 0.0);		
-		subsetModel->beagleGetEigenValues(eigenValues);
-		
-		std::vector<double> eigenVectors(61*61, 0.0);
-		subsetModel->beagleGetEigenVectors(eigenVectors);
-		
-		std::vector<double> inverseEigenVectors(61*61, 0.0);		
-		subsetModel->beagleGetInverseEigenVectors(inverseEigenVectors);
-		
-		double edgelenScaler = subsetModel->beagleGetEdgelenScaler();
-		
-		beagleLib->SetStateFrequencies(freqs);
-		beagleLib->SetEigenDecomposition(eigenValues, eigenVectors, inverseEigenVectors);
-		beagleLib->DefineOperations(t,edgelenScaler);
-		lnL = beagleLib->CalcLogLikelihood(t);
-#endif
-#if 0 // GTR Gamma Pinvar model test
-		ModelShPtr subsetModel = partition_model->getModel(0);
-		unsigned nCat = (unsigned)(subsetModel->getNRatesTotal());
-		if (subsetModel->isPinvarModel())
-			nCat += 1;
-		
-		if (!beagleLib) {
-			beagleLib = BeagleLibShPtr(new BeagleLib);
-			beagleLib->Init(t->GetNTips(), nCat, (unsigned)(subsetModel->getNumStates()), (unsigned)pattern_counts.size());
-			beagleLib->SetTipStates(t);
-			beagleLib->SetPatternWeights(pattern_counts);
-		}
-		
-		std::vector<double> freqs(4, 0.0);
-		subsetModel->beagleGetStateFreqs(freqs);
-		
-		std::vector<double> eigenValues(4, 0.0);		
-		subsetModel->beagleGetEigenValues(eigenValues);
-		
-		std::vector<double> eigenVectors(4*4, 0.0);
-		subsetModel->beagleGetEigenVectors(eigenVectors);
-		
-		std::vector<double> inverseEigenVectors(4*4, 0.0);		
-		subsetModel->beagleGetInverseEigenVectors(inverseEigenVectors);
-		
-		double edgelenScaler = subsetModel->beagleGetEdgelenScaler();
-
-		std::vector<double> rates(nCat, 0.0);
-		std::vector<double> weights(nCat, 0.0);
-		if (subsetModel->isPinvarModel()) {
-			std::copy(rate_means[0].begin(), rate_means[0].end(), rates.begin()+1);
-			weights[0] = subsetModel->getPinvar();
-			std::copy(rate_probs[0].begin(), rate_probs[0].end(), weights.begin()+1);
-			for (std::vector<double>::iterator it = weights.begin()+1; it != weights.end(); ++it) {
-				*it *= (1.0 - weights[0]);
-			}
-		}
-		else {
-			std::copy(rate_means[0].begin(), rate_means[0].end(), rates.begin());
-			std::copy(rate_probs[0].begin(), rate_probs[0].end(), weights.begin());
-		}
-		
-//		//debug
-//		std::cerr << "nCat " << (unsigned)(subsetModel->getNRatesTotal()) << '\n';
-//		std::cerr << "freq\n";
-//		std::cerr << freqs[0] << " " << freqs[1] << " " << freqs[2] << " " << freqs[3] << '\n';
-//		
-//		std::cerr << "rates and weights\n";
-//		for (std::vector<double>::iterator it = rates.begin(); it != rates.end(); ++it) {
-//			std::cerr << *it << " ";
-//		}
-//		std::cerr << '\n';
-//		for (std::vector<double>::iterator it = weights.begin(); it != weights.end(); ++it) {
-//			std::cerr << *it << " ";
-//		}
-//		std::cerr << '\n';
-//		char ch;
-//		std::cin >> ch;
-		
-		beagleLib->SetStateFrequencies(freqs);
-		beagleLib->SetCategoryRatesAndWeights(rates, weights);
-		beagleLib->SetEigenDecomposition(eigenValues, eigenVectors, inverseEigenVectors);
-		beagleLib->DefineOperations(t, edgelenScaler);
-		lnL = beagleLib->CalcLogLikelihood(t);
-#endif
-#if 0	// Partition model test
-		//
-		// if no beagleLib, initialize it
-		//
-		if (beagleLib.empty()) {
-			// decide how many bealeLib objects are needed
-			//
-			unsigned nSubsets = partition_model->getNumSubsets();
-			beagleLib.resize(nSubsets);
-			
-			// initialize the beagleLib objects
-			//
-			for (unsigned whichSubset = 0; whichSubset < nSubsets; ++whichSubset) {
-				// decide the number of rate categories
-				//
-				ModelShPtr subsetModel = partition_model->getModel(whichSubset);
-				unsigned nCat = subsetModel->getNGammaRates();
-				if (subsetModel->isPinvarModel())
-					nCat += 1;
-				
-				// find out the subset pattern counts
-				//
-				std::vector<double>::iterator subsetPatternBegin = pattern_counts.begin();
-				std::vector<double>::iterator subsetPatternEnd = pattern_counts.begin();
-				for (unsigned i = 0; i <= whichSubset; ++i) {
-					if (i != whichSubset) {
-						subsetPatternBegin += partition_model->getNumPatterns(i);
-					}
-					subsetPatternEnd += partition_model->getNumPatterns(i);
-				}
-				std::vector<double>	subsetPatternCounts(subsetPatternBegin, subsetPatternEnd);
-				
-				// set beagleLib object
-				//
-				beagleLib[whichSubset] = BeagleLibShPtr(new BeagleLib);
-				//beagleLib[whichSubset]->Init(t->GetNTips(), nCat, subsetModel->getNumStates(), partition_model->getNumPatterns(whichSubset), whichSubset);
-				beagleLib[whichSubset]->Init(t->GetNTips(), nCat, subsetModel->getNumStates(), partition_model->getNumPatterns(whichSubset));
-				beagleLib[whichSubset]->SetTipStates(t, whichSubset);
-				beagleLib[whichSubset]->SetPatternWeights(subsetPatternCounts);
-				
-//				//debug
-//				std::cerr << "number of patters = " << partition_model->getNumPatterns(whichSubset) << '\n';
-//				for (std::vector<double>::iterator it = subsetPatternCounts.begin(); it != subsetPatternCounts.end(); ++it) {
-//					std::cerr << *it << " ";
-//				}
-//				std::cerr << '\n';
-//				char ch;
-//				std::cin >> ch;
-			}
-		}
-		
-		// @Daniel 
-		// If beagleLib objects have already existed, then everytime the TreeLikelihood::calcLnL is called
-		// there must be some parameters changed. BeagleLib objects need to know the changes, and reset
-		// the corresponding beagleLib object but not all of them.
-		// If the change is made in base frequencies, kappa, GTR relative rates, omega (dN/dS), pinvar or Gamma rate,
-		// most of time only one beagleLib object is affted, but it is still based on how the model is implemented,
-		// for example, model parameters are linked or unlinked.
-		// If the change is made in branch lengths, most of time all the beagleLib objects are affected unless branch
-		// lengths are unlinked. However, if the branch lengths are updated, only DefineOperations() need to be called.
-		// In short, it still needs discussing how to optimize the running of beagleLib and where to put the indicators
-		// because I would not like to bring too much changes to the original codes.
-		//
-		
-		for (unsigned whichSubset = 0; whichSubset < partition_model->getNumSubsets(); ++whichSubset) {
-			ModelShPtr subsetModel = partition_model->getModel(whichSubset);
-			unsigned nStates = subsetModel->getNumStates();
-			unsigned nCat    = subsetModel->getNGammaRates();
-			if (subsetModel->isPinvarModel())
-				nCat += 1;
-			
-			//debug
-			//std::cerr << "nCat = " << nCat << '\n'; 
-			
-			std::vector<double> freqs(nStates, 0.0);
-			subsetModel->beagleGetStateFreqs(freqs);
-			
-			//double tmp[4] = {-0.248887, -0.190674, -0.0582495, 0};
-			//std::vector<double> eigenValues(tmp, tmp+4);		
-			std::vector<double> eigenValues(nStates, 0.0);		
-			subsetModel->beagleGetEigenValues(eigenValues);
-			
-			//double tmp2[16] = {0.010561, 0.498268, -0.641013, -0.583711, -0.904067, 0.00258203, 0.280634, -0.322337, 0.00582811, -0.867005, -0.364029, -0.340223, 0.427221, 0.00497428, 0.614678, -0.663044};
-			std::vector<double> eigenVectors(nStates*nStates, 0.0);
-			//std::vector<double> eigenVectors(tmp2, tmp2+16);
-			subsetModel->beagleGetEigenVectors(eigenVectors);
-            
-            //POL
-            std::cerr << "\neigenValues in TreeLikelihood::calcLnL:\n";
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % eigenValues[0] % eigenValues[1] % eigenValues[2] % eigenValues[3]);
-            std::cerr << "\nModifying eigenVectors in TreeLikelihood::calcLnL:\n";
-            std::cerr << "Before:\n";
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % eigenVectors[0] % eigenVectors[1] % eigenVectors[2] % eigenVectors[3]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % eigenVectors[4] % eigenVectors[5] % eigenVectors[6] % eigenVectors[7]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % eigenVectors[8] % eigenVectors[9] % eigenVectors[10] % eigenVectors[11]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % eigenVectors[12] % eigenVectors[13] % eigenVectors[14] % eigenVectors[15]);
-            for (unsigned i = 0; i < nStates*nStates; ++i)
-                {
-                unsigned which_freq = (unsigned)(i / nStates);
-                double frq = freqs[which_freq];
-                double sqrtFreq = sqrt(frq);
-                double vbefore = eigenVectors[i];
-                double vafter = vbefore/sqrtFreq;
-                eigenVectors[i] = vafter;
-                //std::cerr << boost::str(boost::format("i=%g which_freq=%g frq=%g sqrtFreq=%g vbefore=%g vafter=%g\n") % i % which_freq % frq % sqrtFreq % vbefore % vafter);
-                }
-            std::cerr << "After:\n";
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % eigenVectors[0] % eigenVectors[1] % eigenVectors[2] % eigenVectors[3]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % eigenVectors[4] % eigenVectors[5] % eigenVectors[6] % eigenVectors[7]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % eigenVectors[8] % eigenVectors[9] % eigenVectors[10] % eigenVectors[11]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % eigenVectors[12] % eigenVectors[13] % eigenVectors[14] % eigenVectors[15]);
-            std::cerr << std::endl;
-			
-			//double tmp3[16] = {0.010561, -0.904067, 0.00582811, 0.427221, 0.498268, 0.00258203, -0.867005, 0.00497428, -0.641013, 0.280634, -0.364029, 0.614678, -0.583711, -0.322337, -0.340223, -0.663044};
-			std::vector<double> inverseEigenVectors(nStates*nStates, 0.0);		
-			//std::vector<double> inverseEigenVectors(tmp3, tmp3+16);		
-			subsetModel->beagleGetInverseEigenVectors(inverseEigenVectors);
-			
-            //POL
-            std::cerr << "\nModifying inverseEigenVectors in TreeLikelihood::calcLnL:\n";
-            std::cerr << "Before:\n";
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % inverseEigenVectors[0] % inverseEigenVectors[1] % inverseEigenVectors[2] % inverseEigenVectors[3]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % inverseEigenVectors[4] % inverseEigenVectors[5] % inverseEigenVectors[6] % inverseEigenVectors[7]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % inverseEigenVectors[8] % inverseEigenVectors[9] % inverseEigenVectors[10] % inverseEigenVectors[11]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % inverseEigenVectors[12] % inverseEigenVectors[13] % inverseEigenVectors[14] % inverseEigenVectors[15]);
-            for (unsigned i = 0; i < nStates*nStates; ++i)
-                {
-                unsigned which_freq = (unsigned)(i % nStates);
-                double frq = freqs[which_freq];
-                double sqrtFreq = sqrt(frq);
-                double vbefore = inverseEigenVectors[i];
-                double vafter = vbefore*sqrtFreq;
-                inverseEigenVectors[i] = vafter;
-                //std::cerr << boost::str(boost::format("i=%g which_freq=%g frq=%g sqrtFreq=%g vbefore=%g vafter=%g\n") % i % which_freq % frq % sqrtFreq % vbefore % vafter);
-                }
-            std::cerr << "After:\n";
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % inverseEigenVectors[0] % inverseEigenVectors[1] % inverseEigenVectors[2] % inverseEigenVectors[3]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % inverseEigenVectors[4] % inverseEigenVectors[5] % inverseEigenVectors[6] % inverseEigenVectors[7]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % inverseEigenVectors[8] % inverseEigenVectors[9] % inverseEigenVectors[10] % inverseEigenVectors[11]);
-            std::cerr << boost::str(boost::format("%15.5f %15.5f %15.5f %15.5f\n") % inverseEigenVectors[12] % inverseEigenVectors[13] % inverseEigenVectors[14] % inverseEigenVectors[15]);
-            std::cerr << std::endl;
-			
-			double edgelenScaler = subsetModel->beagleGetEdgelenScaler();
-			//double edgelenScaler = 10.748076900340607;
-			
-			std::vector<double> rates(nCat, 0.0);
-			std::vector<double> weights(nCat, 0.0);
-			if (subsetModel->isPinvarModel()) {
-				std::copy(rate_means[0].begin(), rate_means[0].end(), rates.begin()+1);
-				weights[0] = subsetModel->getPinvar();
-				std::copy(rate_probs[0].begin(), rate_probs[0].end(), weights.begin()+1);
-				for (std::vector<double>::iterator it = weights.begin()+1; it != weights.end(); ++it) {
-					*it *= (1.0 - weights[0]);
-				}
-			}
-			else {
-				std::copy(rate_means[0].begin(), rate_means[0].end(), rates.begin());
-				std::copy(rate_probs[0].begin(), rate_probs[0].end(), weights.begin());
-			}
-			
-//			//debug
-//			std::cerr << "freq\n";
-//			for (std::vector<double>::iterator it = freqs.begin(); it != freqs.end(); ++it) {
-//				std::cerr << *it << " ";
-//			}
-//			std::cerr << '\n';
-//			
-//			std::cerr << "rates and weights\n";
-//			for (std::vector<double>::iterator it = rates.begin(); it != rates.end(); ++it) {
-//				std::cerr << *it << " ";
-//			}
-//			std::cerr << '\n';
-//			for (std::vector<double>::iterator it = weights.begin(); it != weights.end(); ++it) {
-//				std::cerr << *it << " ";
-//			}
-//			std::cerr << '\n';
-//			
-//			std::cerr << "edgelenScaler = " << edgelenScaler << '\n';
-//
-//			for (std::vector<double>::iterator it = eigenValues.begin(); it != eigenValues.end(); ++it) {
-//				std::cerr << *it << " ";
-//			}
-//			std::cerr << '\n';
-            //std::cerr << "In TreeLikelihood::calcLnL (Partition model test)" << std::endl;
-			//char ch;
-			//std::cin >> ch;
-
-			beagleLib[whichSubset]->SetStateFrequencies(freqs);
-			beagleLib[whichSubset]->SetCategoryRatesAndWeights(rates, weights);
-			beagleLib[whichSubset]->SetEigenDecomposition(eigenValues, eigenVectors, inverseEigenVectors);
-			//beagleLib[whichSubset]->SetEigenDecomposition(eigenValues, inverseEigenVectors, eigenVectors);
-			beagleLib[whichSubset]->DefineOperations(t, edgelenScaler);
-			
-			// debug
-			//double tmpLnL = beagleLib[whichSubset]->CalcLogLikelihood(t);
-			//std::cerr << "tmpLnL = " << tmpLnL << '\n';
-			//lnL += tmpLnL;
-			
-			lnL += beagleLib[whichSubset]->CalcLogLikelihood(t);
-
-			std::vector<double> outMatrix(16, 0.0);
-			beagleGetTransitionMatrix(0, 0, &outMatrix[0]);
-			//for (std::vector<double>::iterator it = outMatrix.begin(); it != outMatrix.end(); ++it) {
-			//	std::cerr << *it << " ";
-			//}
-			//std::cerr << '\n';
-			//char ch;
-			//std::cin >> ch;
-		}
-#endif
+	if (!engine_name.empty() && !using_unimap) {
+		lnL = calcLnLUsingEngines(t);
 	}
 	else {
 		//@TEMP force crash to test entry into debugger
@@ -2759,7 +2806,14 @@ double TreeLikelihood::calcLnL(
 		// all CLAs. If likelihood_root does already point to a node, assume that the necessary 
 		// CLA invalidations have already been performed.
 		TreeNode * nd = likelihood_root;
-		if (nd == NULL)
+		if (nd == NULL && changed_subset >= 0 && !using_unimap)
+		{
+			// Only the CLAs of one subset need to be recomputed (see invalidateSubsetCLAs). This leaves
+			// the subroot node, which will be the new likelihood_root, to be recomputed by calcLnLFromNode
+			nd = refreshChangedSubsetCLAs(t);
+			likelihood_root = nd;
+		}
+		else if (nd == NULL)
 		{
 			// If no likelihood_root has been specified, invalidate the entire tree to be safe
 			nd = storeAllCLAs(t);
@@ -2767,6 +2821,7 @@ double TreeLikelihood::calcLnL(
 			// The subroot node will be the new likelihood_root
 			likelihood_root = nd;
 		}
+		changed_subset = -1;
 		
 		//if (0)
 		//	{
@@ -2808,7 +2863,464 @@ double TreeLikelihood::calcLnL(
 	return lnL;
 }
 
-void TreeLikelihood::debugSaveCLAs(TreeShPtr t, std::string fn, bool overwrite)
+/*----------------------------------------------------------------------------------------------------------------------
+|	Prepares for a series of calls to calcEdgeLnL, each of which computes the log-likelihood after a change to the
+|	length of the edge subtending `nd' and nothing else. The conditional likelihood arrays (CLAs) on either side of
+|	that edge do not depend on its length, so they are brought up to date here, once, and calcEdgeLnL need only
+|	combine them across the edge. Assumes that the CLAs depending on the length of the edge have been invalidated
+|	(e.g. by invalidateAwayFromNode). Returns false, leaving calcLnL as the only option, if no data are attached or if
+|	the tree is rooted, unimap is in use or a LikelihoodEngine is computing the likelihood.
+*/
+bool TreeLikelihood::prepareEdgeLnL(
+  TreeShPtr t,		/**< is the tree */
+  TreeNode * nd)	/**< is the node whose edge will be changed */
+	{
+	edge_focal = NULL;
+	edge_neighbor = NULL;
+	if (no_data || t->IsRooted() || using_unimap || !engine_name.empty())
+		return false;
+
+	PHYCAS_ASSERT(nd != NULL && nd->GetParent() != NULL);
+	if (nd->IsInternal())
+		{
+		edge_focal = nd;
+		edge_neighbor = nd->GetParent();
+		}
+	else
+		{
+		edge_focal = nd->GetParent();
+		edge_neighbor = nd;
+		}
+
+	// Bring all CLAs pointing toward edge_focal up to date, then compute the CLA of edge_focal that
+	// points toward edge_neighbor
+	NodeValidityChecker valid_functor = boost::bind(&TreeLikelihood::isValid, this, _1, _2);
+	effective_postorder_edge_iterator iter(edge_focal, valid_functor);
+	effective_postorder_edge_iterator iter_end;
+	std::vector<EdgeEndpoints> edges(iter, iter_end);
+	refreshPMatrixBatch(edges);
+	for (std::vector<EdgeEndpoints>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+		refreshCLA(*it->first, it->second);
+	refreshCLA(*edge_focal, edge_neighbor);
+
+	useAsLikelihoodRoot(edge_focal);
+	return true;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the log-likelihood computed from the two conditional likelihood arrays on either side of the edge prepared
+|	by the last call to prepareEdgeLnL, using the current length of that edge. Only the transition matrices of that one
+|	edge are computed, so this is much faster than calcLnL, but it is correct only as long as nothing other than the
+|	length of that edge has changed since prepareEdgeLnL was called.
+*/
+double TreeLikelihood::calcEdgeLnL()
+	{
+	PHYCAS_ASSERT(edge_focal != NULL && edge_neighbor != NULL);
+	incrementNumLikelihoodEvals();
+	ConstEdgeEndpoints edge(edge_focal, edge_neighbor);
+	return harvestLnLFromValidEdge(edge);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the first and second derivatives of the log-likelihood with respect to the length of every edge of the 
+|	unrooted tree `t', storing them in `edgelen_d1' and `edgelen_d2' (see getEdgeLenFirstDerivs and 
+|	getEdgeLenSecondDerivs), and returns the log-likelihood. Derivatives are stored in preorder, skipping the root node,
+|	which is the order of the edge length parameters (see Model::getEdgeLenParams); the second derivatives are the 
+|	diagonal of the Hessian matrix. Two traversals suffice: calcLnL leaves every filial conditional likelihood array 
+|	(CLA) valid, and visiting edges in preorder means that computing the parental CLAs needed for each edge requires 
+|	at most one new CLA beyond those computed for edges already visited. All CLAs computed remain valid afterwards.
+*/
+double TreeLikelihood::calcEdgeLenDerivatives(
+  TreeShPtr t)		/**< is the tree */
+	{
+	if (t->IsRooted())
+		throw XLikelihood("edge length derivatives can only be computed for unrooted trees");
+	if (using_unimap)
+		throw XLikelihood("edge length derivatives cannot be computed when unimap is in use");
+	if (!engine_name.empty())
+		throw XLikelihood("edge length derivatives cannot be computed when a likelihood engine is in use");
+
+	const double lnL = calcLnL(t);
+	edgelen_d1.clear();
+	edgelen_d2.clear();
+	if (no_data)
+		{
+		edgelen_d1.assign(t->GetNNodes() - 1, 0.0);
+		edgelen_d2.assign(t->GetNNodes() - 1, 0.0);
+		return lnL;
+		}
+
+	// Size the workspace used by harvestEdgeLenDerivsFromValidEdge once for every edge: the transition matrix 
+	// derivatives of a tip edge have one extra row for complete ambiguity and one for each partial ambiguity at that tip
+	unsigned max_rates = 1;
+	unsigned max_states = 1;
+	unsigned max_rows = 1;
+	const unsigned num_subsets = partition_model->getNumSubsets();
+	for (unsigned i = 0; i < num_subsets; ++i)
+		{
+		const unsigned ns = partition_model->subset_num_states[i];
+		max_rates = std::max(max_rates, partition_model->subset_num_rates[i]);
+		max_states = std::max(max_states, ns);
+		max_rows = std::max(max_rows, ns);
+		for (TreeNode * nd = t->GetFirstPreorder(); nd != NULL; nd = nd->GetNextPreorder())
+			{
+			if (nd->IsTip())
+				max_rows = std::max(max_rows, ns + 1 + (unsigned)nd->GetTipData()->getConstStateListPos(i).size());
+			}
+		}
+	edgelen_dP.Initialize(max_rates, max_rows, max_states);
+	edgelen_d2P.Initialize(max_rates, max_rows, max_states);
+	edgelen_piP.Initialize(max_rates, max_states, max_states);
+
+	NodeValidityChecker valid_functor = boost::bind(&TreeLikelihood::isValid, this, _1, _2);
+	for (TreeNode * nd = t->GetFirstPreorder(); nd != NULL; nd = nd->GetNextPreorder())
+		{
+		if (nd->IsAnyRoot())
+			continue;
+
+		// As in prepareEdgeLnL, the focal node must be internal
+		TreeNode * focal = (nd->IsInternal() ? nd : nd->GetParent());
+		TreeNode * neighbor = (nd->IsInternal() ? nd->GetParent() : nd);
+
+		// Bring all CLAs pointing toward focal up to date, then the CLA of focal pointing toward neighbor
+		effective_postorder_edge_iterator iter(focal, valid_functor);
+		effective_postorder_edge_iterator iter_end;
+		std::vector<EdgeEndpoints> edges(iter, iter_end);
+		refreshPMatrixBatch(edges);
+		for (std::vector<EdgeEndpoints>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+			refreshCLA(*it->first, it->second);
+		if (nd->IsInternal() ? !nd->GetInternalData()->filialCLAValid() : !nd->GetTipData()->parentalCLAValid())
+			refreshCLA(*focal, neighbor);
+
+		double d1 = 0.0;
+		double d2 = 0.0;
+		ConstEdgeEndpoints edge(focal, neighbor);
+		harvestEdgeLenDerivsFromValidEdge(edge, d1, d2);
+		edgelen_d1.push_back(d1);
+		edgelen_d2.push_back(d2);
+		}
+	return lnL;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the first derivatives of the log-likelihood with respect to each edge length computed by the last call to 
+|	calcEdgeLenDerivatives.
+*/
+const double_vect_t & TreeLikelihood::getEdgeLenFirstDerivs() const
+	{
+	return edgelen_d1;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the second derivatives of the log-likelihood with respect to each edge length computed by the last call to 
+|	calcEdgeLenDerivatives.
+*/
+const double_vect_t & TreeLikelihood::getEdgeLenSecondDerivs() const
+	{
+	return edgelen_d2;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Called by calcLnL when only the model of partition subset `changed_subset' has changed since every conditional
+|	likelihood array (CLA) in the tree was last valid (see invalidateSubsetCLAs). Parental CLAs and all cached CLAs are
+|	discarded, just as storeAllCLAs would do, but filial CLAs are kept. Internal nodes other than the subroot are then
+|	visited in postorder: the part of each filial CLA belonging to subset `changed_subset' is recomputed, and the parts
+|	belonging to other subsets are left alone. A node lacking a filial CLA has one computed in full. Returns the subroot
+|	node, whose CLA calcLnLFromNode recomputes when it harvests the log-likelihood.
+*/
+TreeNode * TreeLikelihood::refreshChangedSubsetCLAs(
+  TreeShPtr t)	/**< is the tree */
+	{
+	PHYCAS_ASSERT(changed_subset >= 0 && changed_subset < (int)partition_model->getNumSubsets());
+	TreeNode * root = t->GetFirstPreorder();
+	PHYCAS_ASSERT(root);
+	TreeNode * subroot = root->GetNextPreorder();
+	PHYCAS_ASSERT(subroot);
+
+	for (TreeNode * nd = root; nd != NULL; nd = nd->GetNextPreorder())
+		{
+		discardCacheBothEnds(nd);
+		if (nd->IsTip())
+			{
+			TipData * td = nd->GetTipData();
+			if (td->parWorkingCLA)
+				{
+				cla_pool->putCondLikelihood(td->parWorkingCLA);
+				td->parWorkingCLA.reset();
+				}
+			}
+		else
+			{
+			InternalData * id = nd->GetInternalData();
+			if (id->parWorkingCLA)
+				{
+				cla_pool->putCondLikelihood(id->parWorkingCLA);
+				id->parWorkingCLA.reset();
+				}
+			}
+		}
+
+	for (TreeNode * nd = t->GetLastPreorder(); nd != subroot; nd = nd->GetNextPostorder())
+		{
+		if (nd->IsTip())
+			continue;
+		if (nd->GetInternalData()->childWorkingCLA)
+			{
+			cla_subset = changed_subset;
+			refreshCLA(*nd, nd->GetParent());
+			cla_subset = -1;
+			}
+		else
+			refreshCLA(*nd, nd->GetParent());
+		}
+
+	return subroot;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Specifies the LikelihoodEngine that calcLnL uses: "cpu" for CPULikelihoodEngine or "beagle" for BeagleLib. If 
+|	`name' is the empty string (the default), calcLnL instead uses the conditional likelihood arrays stored in the
+|	tree, which is the only choice that allows a move to recompute just the part of the tree it has changed; engines
+|	always recompute the whole tree. One engine is created for each partition subset the next time calcLnL is called.
+|	Throws XLikelihood if `name' is not recognized.
+*/
+void TreeLikelihood::useLikelihoodEngine(
+  std::string name)	/**< is the name of the engine, or the empty string */
+	{
+	if (!name.empty())
+		createLikelihoodEngine(name);	// throws if name is unknown
+	engine_name = name;
+	engines.clear();
+	useAsLikelihoodRoot(NULL);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the name of the LikelihoodEngine used by calcLnL (the empty string if conditional likelihood arrays stored
+|	in the tree are used).
+*/
+std::string TreeLikelihood::getLikelihoodEngineName() const
+	{
+	return engine_name;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if calcLnL uses the BEAGLE library (see useLikelihoodEngine).
+*/
+bool TreeLikelihood::isUsingBeagleLib() const
+	{
+	return (engine_name == "beagle");
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Equivalent to useLikelihoodEngine("beagle") if `yes_or_no' is true and to useLikelihoodEngine("") otherwise.
+*/
+void TreeLikelihood::useBeagleLib(
+  bool yes_or_no)	/**< is true to use the BEAGLE library */
+	{
+	useLikelihoodEngine(yes_or_no ? "beagle" : "");
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of rate categories an engine needs for subset `i': one for each relative rate plus, if the model
+|	includes invariable sites, one more whose transition matrices are the identity.
+*/
+unsigned TreeLikelihood::getNumEngineCategories(
+  unsigned i) const	/**< is the subset of the partition */
+	{
+	return partition_model->subset_num_rates[i] + (partition_model->subset_model[i]->isPinvarModel() ? 1 : 0);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Creates one engine of the kind named by `engine_name' for each partition subset and gives it the data: the count of
+|	each pattern and, for each taxon, the partials of its tip (1.0 for every state consistent with the observed state
+|	and 0.0 otherwise). Partials buffer k < `nTaxa' holds the tip data of taxon k; the remaining buffers are used by 
+|	buildEngineOperations. Transition matrix index k belongs to the edge below the node whose partials are in buffer k,
+|	and the last index holds identity matrices, which buildEngineOperations uses to attach the extra children of 
+|	polytomies.
+*/
+void TreeLikelihood::createEngines()
+	{
+	const unsigned num_subsets = partition_model->getNumSubsets();
+	const unsigned nbuffers = 2*nTaxa;
+	engines.clear();
+	engine_num_categories.resize(num_subsets);
+	for (unsigned i = 0; i < num_subsets; ++i)
+		{
+		const unsigned ns = partition_model->subset_num_states[i];
+		const unsigned np = partition_model->subset_num_patterns[i];
+		const unsigned first = subset_offset[i];
+		engine_num_categories[i] = getNumEngineCategories(i);
+
+		LikelihoodEngineShPtr engine = createLikelihoodEngine(engine_name);
+		engine->createInstance(nTaxa, nbuffers, nbuffers + 1, ns, np, engine_num_categories[i]);
+		engine->setThreadPool(thread_pool.get());
+		engine->setPatternWeights(std::vector<double>(pattern_counts.begin() + first, pattern_counts.begin() + first + np));
+
+		const state_list_t & states = state_list[i];
+		std::vector<double> tip_partials(np*ns);
+		for (unsigned tip = 0; tip < nTaxa; ++tip)
+			{
+			for (unsigned p = 0; p < np; ++p)
+				{
+				double * tp = &tip_partials[p*ns];
+				const int code = pattern_vect[first + p][tip + 1];
+				if (code < 0 || code == (int)ns)
+					{
+					// missing data or gap
+					std::fill(tp, tp + ns, 1.0);
+					}
+				else if (code < (int)ns)
+					{
+					std::fill(tp, tp + ns, 0.0);
+					tp[code] = 1.0;
+					}
+				else
+					{
+					// partial ambiguity: state list holds the number of states followed by the states themselves
+					std::fill(tp, tp + ns, 0.0);
+					unsigned pos = state_list_pos[i][code];
+					const unsigned n = (unsigned)states[pos++];
+					for (unsigned k = 0; k < n; ++k, ++pos)
+						{
+						if (states[pos] >= 0)
+							tp[states[pos]] = 1.0;
+						}
+					}
+				}
+			engine->setTipPartials(tip, tip_partials);
+			}
+		engines.push_back(engine);
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Builds `engine_ops', which computes the partials of every internal node of the unrooted tree `t' in postorder, and
+|	the list of transition matrices it needs (`engine_pmat_index' and `engine_edgelens'). The partials of each node end
+|	up in the buffer recorded by SetTmp, and `engine_root_parent', `engine_root_child' and `engine_root_pmat' describe
+|	the edge between the subroot node and the root tip across which the likelihood is computed.
+*/
+void TreeLikelihood::buildEngineOperations(
+  TreeShPtr t)	/**< is the tree */
+	{
+	if (t->IsRooted())
+		throw XLikelihood("likelihood engines cannot be used with rooted trees");
+	const unsigned identity = 2*nTaxa;
+	unsigned next_buffer = nTaxa;
+	engine_ops.clear();
+	engine_pmat_index.clear();
+	engine_edgelens.clear();
+	TreeNode * root = t->GetFirstPreorder();
+	for (TreeNode * nd = t->GetLastPreorder(); nd != root; nd = nd->GetNextPostorder())
+		{
+		unsigned buffer = nd->GetNodeNumber();
+		if (nd->IsInternal())
+			{
+			TreeNode * c1 = nd->GetLeftChild();
+			TreeNode * c2 = (c1 ? c1->GetRightSib() : NULL);
+			if (c2 == NULL)
+				throw XLikelihood("likelihood engines require every internal node to have at least two children");
+			unsigned b1 = (unsigned)c1->GetTmp();
+			unsigned b2 = (unsigned)c2->GetTmp();
+			buffer = next_buffer++;
+			engine_ops.push_back(LikelihoodEngineOperation(buffer, b1, b1, b2, b2));
+
+			// Each additional child of a polytomy is combined with the partials computed so far, which are carried
+			// across the identity matrices
+			for (TreeNode * c = c2->GetRightSib(); c != NULL; c = c->GetRightSib())
+				{
+				const unsigned b = (unsigned)c->GetTmp();
+				const unsigned prev = buffer;
+				buffer = next_buffer++;
+				engine_ops.push_back(LikelihoodEngineOperation(buffer, prev, identity, b, b));
+				}
+			}
+		PHYCAS_ASSERT(buffer < identity);
+		nd->SetTmp((double)buffer);
+		engine_pmat_index.push_back(buffer);
+		engine_edgelens.push_back(nd->GetEdgeLen());
+		}
+	TreeNode * subroot = root->GetLeftChild();
+	PHYCAS_ASSERT(subroot && subroot->IsInternal());
+	engine_root_parent = (unsigned)subroot->GetTmp();
+	engine_root_child = root->GetNodeNumber();
+	engine_root_pmat = engine_root_parent;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Computes the log-likelihood of the whole tree `t' using the engines (see useLikelihoodEngine). For each subset, the
+|	transition matrices of every edge are computed here (so every substitution model is supported) and given to the
+|	engine along with the state frequencies and rate category probabilities; the engine then carries out the pruning
+|	calculation. Site log-likelihoods are stored in `site_likelihood' if `store_site_likes' is true; because engines
+|	undo their own rescaling, the corresponding elements of `site_uf' are zero.
+*/
+double TreeLikelihood::calcLnLUsingEngines(
+  TreeShPtr t)	/**< is the tree */
+	{
+	const unsigned num_subsets = partition_model->getNumSubsets();
+	bool recreate = (engines.size() != num_subsets);
+	for (unsigned i = 0; !recreate && i < num_subsets; ++i)
+		recreate = (engine_num_categories[i] != getNumEngineCategories(i));
+	if (recreate)
+		createEngines();
+
+	buildEngineOperations(t);
+
+	if (store_site_likes)
+		{
+		site_likelihood.resize(pattern_counts.size());
+		site_uf.assign(pattern_counts.size(), 0.0);
+		}
+
+	double lnL = 0.0;
+	for (unsigned i = 0; i < num_subsets; ++i)
+		{
+		LikelihoodEngine & engine = *engines[i];
+		const unsigned ns = partition_model->subset_num_states[i];
+		const unsigned nr = partition_model->subset_num_rates[i];
+		const unsigned ncat = engine_num_categories[i];
+
+		engine.setStateFrequencies(&partition_model->subset_model[i]->getStateFreqs()[0]);
+
+		// The invariable sites category (if any) comes last
+		std::vector<double> category_weights(rate_probs[i].begin(), rate_probs[i].end());
+		if (ncat > nr)
+			{
+			const double pinvar = partition_model->subset_model[i]->getPinvar();
+			for (unsigned r = 0; r < nr; ++r)
+				category_weights[r] *= (1.0 - pinvar);
+			category_weights.push_back(pinvar);
+			}
+		engine.setCategoryWeights(category_weights);
+
+		// Identity matrices go in the last index; calcPMat fills only the first nr categories, so any invariable sites
+		// category keeps its identity matrix for every edge
+		ScopedThreeDMatrix<double> pmats;
+		pmats.Initialize(ncat, ns, ns);
+		for (unsigned c = 0; c < ncat; ++c)
+			{
+			for (unsigned a = 0; a < ns; ++a)
+				{
+				std::fill(pmats.ptr[c][a], pmats.ptr[c][a] + ns, 0.0);
+				pmats.ptr[c][a][a] = 1.0;
+				}
+			}
+		engine.setTransitionMatrices(2*nTaxa, pmats.ptr);
+		for (unsigned e = 0; e < (unsigned)engine_pmat_index.size(); ++e)
+			{
+			calcPMat(i, pmats.ptr, engine_edgelens[e]);
+			engine.setTransitionMatrices(engine_pmat_index[e], pmats.ptr);
+			}
+
+		engine.updatePartials(engine_ops);
+		lnL += engine.calcEdgeLogLikelihood(engine_root_parent, engine_root_child, engine_root_pmat, (store_site_likes ? &site_likelihood[subset_offset[i]] : NULL));
+		}
+
+	if (store_site_likes)
+		site_likelihood_lnL = lnL;
+	return lnL;
+	}
+
+void TreeLikelihood::debugSaveCLAs(TreeShPtr t, std::string fn, bool overwrite)
 	{
 	std::ofstream tmpf;
 	if (overwrite)
@@ -2925,12 +3437,17 @@ double TreeLikelihood::calcLnLFromNode(
 		// to need its CLA updated.
 		effective_postorder_edge_iterator iter(&focal_node, valid_functor);
 		effective_postorder_edge_iterator iter_end;
-		for (; iter != iter_end; ++iter)
+		std::vector<EdgeEndpoints> edges(iter, iter_end);
+		
+		// Compute all transition matrices the refreshCLA calls below will need in one batch per subset
+		refreshPMatrixBatch(edges);
+		
+		for (std::vector<EdgeEndpoints>::const_iterator it = edges.begin(); it != edges.end(); ++it)
 			{
 			// first is the focal node, second is the avoid node
-			//if (iter->second->GetParent() == iter->first)
-			//	startTreeViewer(t, boost::str(boost::format("avoid = %d, nd = %d") % iter->second->GetNodeNumber() % iter->first->GetNodeNumber()));
-			refreshCLA(*iter->first, iter->second);
+			//if (it->second->GetParent() == it->first)
+			//	startTreeViewer(t, boost::str(boost::format("avoid = %d, nd = %d") % it->second->GetNodeNumber() % it->first->GetNodeNumber()));
+			refreshCLA(*it->first, it->second);
 			}
 		
 		// We have now brought all neighboring CLAs up-to-date, so we can now call harvestLnL to
@@ -2962,16 +3479,16 @@ void TreeLikelihood::debugWalkTreeShowCondLikes(    //POLCURR
                 const LikeFltType * cla = condlike->getCLA();                
                 unsigned num_subsets = partition_model->getNumSubsets();
                 for (unsigned i = 0; i < num_subsets; ++i) {
-                    unsigned num_patterns = partition_model->subset_num_patterns[i];
-                    unsigned num_states = partition_model->subset_num_states[i];
-                    unsigned num_rates = partition_model->subset_num_rates[i];
-                    for (unsigned r = 0; r < num_rates; ++r) {
-                        for (unsigned p = 0; p < num_patterns; ++p, cla += num_states) {
-                            for (unsigned s = 0; s < num_states; ++s) {
-                                std::cerr << boost::str(boost::format("%d:%g") % s % cla[s]) << '|';
+                    const CLASubsetLayout & layout = cla_layout[i];
+                    for (unsigned r = 0; r < layout.nr; ++r) {
+                        for (unsigned p = 0; p < layout.np; ++p) {
+                            const LikeFltType * claPat = cla + layout.offset(p, r);
+                            for (unsigned s = 0; s < layout.ns; ++s) {
+                                std::cerr << boost::str(boost::format("%d:%g") % s % claPat[s]) << '|';
                             }
                         }
                     }
+                    cla += layout.length;
                 }
                 std::cerr << std::endl;
             }
@@ -3222,6 +3739,7 @@ void TreeLikelihood::copyDataFromDiscreteMatrix(
 
 	{
 	nTaxa = mat->getNTax();
+	engines.clear();
 
 	// Currently, can only deal with the first matrix stored in the CharSuperMatrix object. The CharSuperMatrix object 
 	// will contain multiple matrices if the nexus file contains a mixed datatype data block
@@ -3392,7 +3910,10 @@ void TreeLikelihood::debugCompressedDataInfo(
 |	`pattern_counts' holds the count of the number of sites having each pattern. Additionally, the vectors 
 |	`pattern_to_sites' and `charIndexToPatternIndex' are built: `pattern_to_sites' allows you to get a list of sites
 |	given a specific pattern, and `charIndexToPatternIndex' lets you find the index of a pattern in `pattern_vect' and
-|	`pattern_counts' given an original site index.
+|	`pattern_counts' given an original site index. Sites are first assigned to partition subsets, then the sites of
+|	each subset are compressed into a PatternTable by compressSubsetPatterns (subsets are compressed concurrently if a
+|	thread pool has been created using setNumThreads). Within each subset, patterns are stored in lexicographic order,
+|	so the result does not depend on the number of threads.
 */
 unsigned TreeLikelihood::compressDataMatrix(
   const NxsCXXDiscreteMatrix    & mat,              /**< is the data source */
@@ -3402,10 +3923,6 @@ unsigned TreeLikelihood::compressDataMatrix(
 	unsigned 						nchar 		= mat.getNChar();
 	unsigned 						nsubsets 	= partition_model->getNumSubsets();	
 	
-	//typedef std::vector< pattern_map_t > pattern_map_vect_t;
-	pattern_map_vect_t 				pattern_map(nsubsets);
-	pattern_to_sites_map_t 			pattern_to_sites_map;
-	
 	// If user has not decided to partition the data, then the partition_info vector should be empty
 	bool default_partition = (partition_info.size() == 0 ? true : false);
 	
@@ -3446,15 +3963,14 @@ unsigned TreeLikelihood::compressDataMatrix(
 		PHYCAS_ASSERT(*eIt < nchar);
 		actingWeights[*eIt] = 0.0;
 		}
-	const double * wts = &(actingWeights[0]);	// PELIGROSO
+	const double * wts = (nchar > 0 ? &(actingWeights[0]) : NULL);	// PELIGROSO
 	
-	int8_vect_t pattern;
+	// Assign sites to subsets. For a codon model only the first site of each codon is listed.
+	pattern_to_sites_t subset_sites(nsubsets);
 	for (unsigned j = 0; j < nchar;)
 		{
 		unsigned subset = default_partition ? 0 : partition_info[j];
-		bool codon_model = partition_model->subset_model[subset]->isCodonModel();
-		
-		if (codon_model)
+		if (partition_model->subset_model[subset]->isCodonModel())
 			{
 			if (!default_partition)
 				{
@@ -3468,119 +3984,65 @@ unsigned TreeLikelihood::compressDataMatrix(
 			// j+2 = 5, which equals nchar, so break out of loop over sites
 			if (j+2 >= nchar)
 				break;
-
-			// here we (arbitrarily) use the max weight of any char in the codon
-			pattern_count_t charWt = (wts ? std::max(wts[j], std::max(wts[j+1], wts[j+2])) : 1.0); 
-			if (charWt > 0.0)
-				{
-				//std::cerr << std::endl;
-				
-				// Build up a vector representing the pattern of state codes at this site
-				pattern.clear();
-
-				// The index of the partition subset fills the first slot in the pattern
-				pattern.push_back((int8_t)subset);
-
-				for (unsigned i = 0; i < ntax; ++i)
-					{
-					const int8_t *	row			= mat.getRow(i);
-					const int8_t	code1		= row[j];
-					const int8_t	code2		= row[j + 1];
-					const int8_t	code3		= row[j + 2];
-					bool			code1_ok	= (code1 >= 0 && code1 < 4);
-					bool			code2_ok	= (code2 >= 0 && code2 < 4);
-					bool			code3_ok	= (code3 >= 0 && code3 < 4);
-					if (code1_ok && code2_ok && code3_ok)
-						{
-						//std::cerr << boost::str(boost::format("(%d,%d,%d)") % (unsigned)code1 % (unsigned)code2 % (unsigned)code3);
-						const int8_t code = codon_state_codes[16*code1 + 4*code2 + code3]; // CGT = 27 = 16*1 + 4*2 + 3
-						if (code > 60)
-							throw XLikelihood(str(boost::format("Stop codon encountered for taxon %d at sites %d-%d") % (i+1) % (j+1) % (j+4)));
-						pattern.push_back(code);
-						}
-					else
-						{
-						//std::cerr << "(???)";
-						// if any site within codon is ambiguous, entire codon is treated as completely ambiguous
-						pattern.push_back((int8_t)61);
-						}
-					}
-					
-				//std::cerr << boost::str(boost::format("\n%6d -> ") % j);
-					
-				storePattern(pattern_map[subset], pattern_to_sites_map, pattern, j, charWt, codon_model);
-				
-				//for (std::vector<int8_t>::const_iterator it = pattern.begin(); it != pattern.end(); ++it)
-				//	{
-				//	std::cerr << boost::str(boost::format("%s|") % codon_labels[(unsigned)(*it)]);
-				//	}
-				//std::cerr << std::endl;
-				}
+			subset_sites[subset].push_back(j);
 			j += 3;
 			}
-		else	// model for site j is not a codon model
-			{
-			unsigned nStates = getNumStates(subset);
-	
-			pattern_count_t charWt = (wts ? wts[j] : 1.0); 
-			if (charWt > 0.0)
-				{
-				// Build up a vector representing the pattern of state codes at this site
-				pattern.clear();
-				
-				// The index of the partition subset fills the first slot in the pattern
-				pattern.push_back((int8_t)subset);
+		else
+			subset_sites[subset].push_back(j++);
+		}
 
-				unsigned num_all_missing = 0;
-				for (unsigned i = 0; i < ntax; ++i)
-					{
-					const int8_t * row	= mat.getRow(i);
-					const int8_t   code = row[j];
+	// Rows are looked up once rather than once per site
+	std::vector<const int8_t *> rows(ntax);
+	for (unsigned i = 0; i < ntax; ++i)
+		rows[i] = mat.getRow(i);
 
-					if (default_partition)
-						{
-						pattern.push_back(code);
-						if ((unsigned)code == nStates)	
-							++num_all_missing;
-						}
-					else
-						{
-						//@POL any ambiguity is treated as ? for partitioned data (for now)
-						//@POL if this is relaxed, need to revisit TreeLikelihood::copyDataFromDiscreteMatrix,
-						//@POL which currently constructs a state_list without partial ambiguities 
-						if (code >= 0 && code < (state_code_t)nStates)	//POLBM
-							pattern.push_back(code);
-						else
-							{
-							pattern.push_back((state_code_t)nStates);
-							++num_all_missing;
-							}
-						}
-					}
+	std::vector<PatternTable> pattern_table(nsubsets);
+	pattern_to_sites_t subset_missing(nsubsets);
+	if (thread_pool && nsubsets > 1)
+		thread_pool->run(nsubsets, boost::bind(&TreeLikelihood::compressSubsetPatterns, this, _1, &rows, wts, default_partition, &subset_sites, &pattern_table, &subset_missing));
+	else
+		{
+		for (unsigned i = 0; i < nsubsets; ++i)
+			compressSubsetPatterns(i, &rows, wts, default_partition, &subset_sites, &pattern_table, &subset_missing);
+		}
+	subset_sites.clear();
 
-				// Do not include the pattern if it contains only completely missing data
-				// for all taxa
-				if (num_all_missing == ntax)
-					{
-					all_missing.push_back(j++);
-					continue;
-					}
-					
-				storePattern(pattern_map[subset], pattern_to_sites_map, pattern, j, charWt, codon_model);
-				}
-			++j;
-			}	// not a codon model
-		}	// loop over sites
+	// Sites with only missing data are listed in the order in which they appear in the data matrix
+	unsigned first_missing = (unsigned)all_missing.size();
+	for (unsigned i = 0; i < nsubsets; ++i)
+		all_missing.insert(all_missing.end(), subset_missing[i].begin(), subset_missing[i].end());
+	std::sort(all_missing.begin() + first_missing, all_missing.end());
 	
-// ***** below here now done by patternMapToVect *****
-    
 	// Build subset_offset, pattern_counts, pattern_vect, pattern_to_sites and charIndexToPatternIndex before 
-	// leaving this function (whereupon pattern_map and pattern_to_sites_map will be destroyed)
+	// leaving this function (whereupon pattern_table will be destroyed)
+	unsigned npatterns = patternTablesToVect(pattern_table);
+	
+	// There should no longer be any elements in charIndexToPatternIndex that have the value UINT_MAX
+	// If there are, the elements that still have the value UINT_MAX should correspond with indices stored in the all_missing vector
+	// or the excl set (excluded characters)
+	PHYCAS_ASSERT(!excl.empty() || !all_missing.empty() || (std::find(charIndexToPatternIndex.begin(), charIndexToPatternIndex.end(), UINT_MAX) == charIndexToPatternIndex.end()));
+
+	return npatterns;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Builds `subset_offset', `pattern_counts', `pattern_vect', `pattern_to_sites' and `charIndexToPatternIndex' from 
+|	the patterns stored in `pattern_table' (one PatternTable per partition subset), and records the number of sites and 
+|	patterns in each subset in `partition_model'. Within each subset, patterns are stored in lexicographic order. 
+|	Assumes `charIndexToPatternIndex' is already long enough to hold every site listed in the tables. Returns the total
+|	number of patterns.
+*/
+unsigned TreeLikelihood::patternTablesToVect(
+  const std::vector<PatternTable> & pattern_table)	/**< is the vector of pattern tables (one per subset) */
+	{
+	unsigned nsubsets = partition_model->getNumSubsets();
+	PHYCAS_ASSERT(pattern_table.size() == nsubsets);
+	
 	unsigned npatterns = 0;
 	std::vector<unsigned> npatterns_vect(nsubsets, 0);
 	for (unsigned i = 0; i < nsubsets; ++i)
 		{
-		unsigned np = (unsigned)pattern_map[i].size();
+		unsigned np = pattern_table[i].getNumPatterns();
 		npatterns_vect[i] = np;
 		npatterns += np;
 		}
@@ -3602,18 +4064,23 @@ unsigned TreeLikelihood::compressDataMatrix(
 	std::vector<unsigned> nsites_vect(nsubsets, 0);
 	for (unsigned i = 0; i < nsubsets; ++i)
 		{
+		const PatternTable & table = pattern_table[i];
+		const unsigned plen = table.getPatternLength();
+		const uint_vect_t order = table.getSortedOrder();
 		unsigned num_sites_this_subset = 0;
 		subset_offset.push_back(pattern_index);
-		for (pattern_map_t::iterator mapit = pattern_map[i].begin(); mapit != pattern_map[i].end(); ++mapit)
-			{			
+		for (uint_vect_t::const_iterator it = order.begin(); it != order.end(); ++it)
+			{
+			const int8_t * pattern = table.getPattern(*it);
+			
+			// get list of sites that had this pattern
+			const uint_vect_t & sites = table.getSites(*it);//UINT_LIST
+			
 			if (using_unimap)
 				{
-				// get list of sites that had this pattern
-				const uint_vect_t & sites = pattern_to_sites_map[mapit->first];//UINT_LIST
 				for (uint_vect_t::const_iterator sitesIt = sites.begin(); sitesIt != sites.end(); ++sitesIt)//UINT_LIST
 					{	
-					// mapit->first holds the pattern in the form of a vector of int8_t values
-					pattern_vect.push_back(mapit->first);
+					pattern_vect.push_back(int8_vect_t(pattern, pattern + plen));
 					pattern_counts.push_back(1);
 					num_sites_this_subset += 1;
 				
@@ -3624,20 +4091,13 @@ unsigned TreeLikelihood::compressDataMatrix(
 					charIndexToPatternIndex[*sitesIt] = pattern_index++;
 					++n_inc_chars;
 					}
-
 				}
 			else
 				{
-				// mapit->first holds the pattern in the form of a vector of int8_t values
-				pattern_vect.push_back(mapit->first);
-			
-				// mapit->second holds the pattern count
-				pattern_counts.push_back(mapit->second);
-				num_sites_this_subset += (unsigned)mapit->second;
+				pattern_vect.push_back(int8_vect_t(pattern, pattern + plen));
+				pattern_counts.push_back(table.getCount(*it));
+				num_sites_this_subset += (unsigned)table.getCount(*it);
 
-				// get list of sites that had this pattern
-				const uint_vect_t & sites = pattern_to_sites_map[mapit->first];//UINT_LIST
-				
 				// add this sites list to pattern_to_sites vector
 				pattern_to_sites.push_back(sites);
 		
@@ -3651,7 +4111,6 @@ unsigned TreeLikelihood::compressDataMatrix(
 					
 				++pattern_index;
 				}
-
 			}	// loop over patterns in subset i
 		nsites_vect[i] = num_sites_this_subset;
 		}	// loop over subsets
@@ -3663,22 +4122,113 @@ unsigned TreeLikelihood::compressDataMatrix(
 		
 	PHYCAS_ASSERT(partition_model->getTotalNumPatterns() == pattern_index);
 	subset_offset.push_back(pattern_index);
-// ***** above here now done by patternMapToVect *****
-	
-	// There should no longer be any elements in charIndexToPatternIndex that have the value UINT_MAX
-	// If there are, the elements that still have the value UINT_MAX should correspond with indices stored in the all_missing vector
-	// or the excl set (excluded characters)
-	PHYCAS_ASSERT(!excl.empty() || !all_missing.empty() || (std::find(charIndexToPatternIndex.begin(), charIndexToPatternIndex.end(), UINT_MAX) == charIndexToPatternIndex.end()));
 
-	// pattern_map and pattern_to_sites_map are just temporary containers. The information originally in
-	// pattern_map is now in pattern_vect and pattern_counts, and the information originally in 
-	// pattern_to_sites_map is now in charIndexToPatternIndex and pattern_to_sites.
-	pattern_map.clear();
-	pattern_to_sites_map.clear();
-	
 	return npatterns;
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Compresses the sites listed in `subset_sites'[`subset'] into (*`pattern_table')[`subset'], building each pattern 
+|	directly from the data matrix rows in `rows'. Sites having only missing data are not stored, but are appended to 
+|	(*`subset_missing')[`subset']. Only the elements of the output vectors belonging to `subset' are modified, so 
+|	different subsets may be compressed concurrently.
+*/
+void TreeLikelihood::compressSubsetPatterns(
+  unsigned subset,									/**< is the index of the partition subset to compress */
+  const std::vector<const int8_t *> * rows,			/**< is the vector of pointers to the first element of each row of the data matrix */
+  const double * wts,								/**< is the array of site weights (0.0 for excluded sites) */
+  bool default_partition,							/**< is true if the user did not partition the data (partial ambiguities are kept only in that case) */
+  const pattern_to_sites_t * subset_sites,			/**< is the vector of site lists (one per subset) */
+  std::vector<PatternTable> * pattern_table,		/**< is the vector of pattern tables (one per subset) to fill */
+  pattern_to_sites_t * subset_missing)				/**< is the vector of lists (one per subset) of sites having only missing data */
+	{
+	const unsigned ntax = (unsigned)rows->size();
+	const uint_vect_t & sites = (*subset_sites)[subset];
+	PatternTable & table = (*pattern_table)[subset];
+	uint_vect_t & missing = (*subset_missing)[subset];
+	const bool codon_model = partition_model->subset_model[subset]->isCodonModel();
+	const unsigned nStates = getNumStates(subset);
+	
+	// The index of the partition subset fills the first slot in each pattern
+	int8_vect_t pattern(ntax + 1);
+	pattern[0] = (int8_t)subset;
+	table.clear(ntax + 1);
+
+	for (uint_vect_t::const_iterator sIt = sites.begin(); sIt != sites.end(); ++sIt)
+		{
+		const unsigned j = *sIt;
+		if (codon_model)
+			{
+			// here we (arbitrarily) use the max weight of any char in the codon
+			pattern_count_t charWt = (wts ? std::max(wts[j], std::max(wts[j+1], wts[j+2])) : 1.0); 
+			if (charWt <= 0.0)
+				continue;
+			for (unsigned i = 0; i < ntax; ++i)
+				{
+				const int8_t *	row			= (*rows)[i];
+				const int8_t	code1		= row[j];
+				const int8_t	code2		= row[j + 1];
+				const int8_t	code3		= row[j + 2];
+				bool			code1_ok	= (code1 >= 0 && code1 < 4);
+				bool			code2_ok	= (code2 >= 0 && code2 < 4);
+				bool			code3_ok	= (code3 >= 0 && code3 < 4);
+				if (code1_ok && code2_ok && code3_ok)
+					{
+					const int8_t code = codon_state_codes[16*code1 + 4*code2 + code3]; // CGT = 27 = 16*1 + 4*2 + 3
+					if (code > 60)
+						throw XLikelihood(str(boost::format("Stop codon encountered for taxon %d at sites %d-%d") % (i+1) % (j+1) % (j+4)));
+					pattern[i + 1] = code;
+					}
+				else
+					{
+					// if any site within codon is ambiguous, entire codon is treated as completely ambiguous
+					pattern[i + 1] = (int8_t)61;
+					}
+				}
+			table.storePattern(&pattern[0], j, charWt, true);
+			}
+		else	// model for site j is not a codon model
+			{
+			pattern_count_t charWt = (wts ? wts[j] : 1.0); 
+			if (charWt <= 0.0)
+				continue;
+			unsigned num_all_missing = 0;
+			for (unsigned i = 0; i < ntax; ++i)
+				{
+				const int8_t code = (*rows)[i][j];
+				if (default_partition)
+					{
+					pattern[i + 1] = code;
+					if ((unsigned)code == nStates)	
+						++num_all_missing;
+					}
+				else
+					{
+					//@POL any ambiguity is treated as ? for partitioned data (for now)
+					//@POL if this is relaxed, need to revisit TreeLikelihood::copyDataFromDiscreteMatrix,
+					//@POL which currently constructs a state_list without partial ambiguities 
+					if (code >= 0 && code < (state_code_t)nStates)	//POLBM
+						pattern[i + 1] = code;
+					else
+						{
+						pattern[i + 1] = (state_code_t)nStates;
+						++num_all_missing;
+						}
+					}
+				}
+
+			// Do not include the pattern if it contains only completely missing data
+			// for all taxa
+			if (num_all_missing == ntax)
+				{
+				missing.push_back(j);
+				continue;
+				}
+				
+			table.storePattern(&pattern[0], j, charWt, false);
+			}
+		}
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Builds `pattern_vect' and `pattern_counts' using data stored in supplied `pattern_map'.
 */
@@ -3780,32 +4330,93 @@ void TreeLikelihood::patternMapToVect(
     }
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	Builds `pattern_vect' and `pattern_counts' using data stored in `sim_data'.
+|	Builds `pattern_vect', `pattern_counts', `pattern_to_sites' and `charIndexToPatternIndex' using data stored in 
+|	`sim_data'. Each simulated site is stored in the PatternTable of the partition subset to which `partition_model' 
+|	assigns it, so the patterns are laid out exactly as compressDataMatrix would lay out the same data read from a 
+|	file. Simulated data contain no ambiguities, so `state_list' and `state_list_pos' are rebuilt for each subset by
+|	buildUnambiguousStateList.
 */
 void TreeLikelihood::copyDataFromSimData(
   SimDataShPtr sim_data)	/**< is the data source */
 	{
-    // formerly DISABLED_UNTIL_SIMULATION_WORKING_WITH_PARTITIONING
-	// Copy simulated data to pattern_map
-	pattern_map_vect_t pattern_map_vect;
-    pattern_map_vect.push_back(sim_data->getSimPatternMap()); //POLSIM: 0 is first and only subset, need to generalize
-	pattern_to_sites_map_t & pattern_to_sites_map = sim_data->getPatternToSitesMap();   
-    patternMapToVect(pattern_map_vect, pattern_to_sites_map);
-
-	// Build up counts vector
-	//pattern_counts.clear();
-	//for (const pattern_map_t::iterator it = pattern_map.begin(); it != pattern_map.end(); ++it)
-	//	{
-	//	pattern_counts.push_back(it->second);
-	//	}
+	nTaxa = sim_data->getPatternLength();
+	engines.clear();
+	unsigned nsubsets = partition_model->getNumSubsets();
+	const uint_vect_t & site_assignments = partition_model->getSiteAssignments();
+	pattern_to_sites_map_t & pattern_to_sites_map = sim_data->getPatternToSitesMap();
+
+	unsigned nchar = 0;
+	for (pattern_to_sites_map_t::const_iterator it = pattern_to_sites_map.begin(); it != pattern_to_sites_map.end(); ++it)
+		{
+		if (!it->second.empty())
+			nchar = std::max(nchar, *std::max_element(it->second.begin(), it->second.end()) + 1);
+		}
+	charIndexToPatternIndex.assign(nchar, UINT_MAX);
+	all_missing.clear();
 
-	//nTaxa = sim_data->getPatternLength();
-	//num_patterns = (unsigned)pattern_map.size();
+	// The index of the partition subset fills the first slot in each pattern
+	std::vector<PatternTable> pattern_table(nsubsets);
+	for (unsigned i = 0; i < nsubsets; ++i)
+		pattern_table[i].clear(nTaxa + 1);
+	int8_vect_t pattern(nTaxa + 1);
+	for (pattern_to_sites_map_t::const_iterator it = pattern_to_sites_map.begin(); it != pattern_to_sites_map.end(); ++it)
+		{
+		PHYCAS_ASSERT(it->first.size() == nTaxa);
+		std::copy(it->first.begin(), it->first.end(), pattern.begin() + 1);
+		for (uint_vect_t::const_iterator sIt = it->second.begin(); sIt != it->second.end(); ++sIt)
+			{
+			unsigned subset = (nsubsets > 1 ? site_assignments.at(*sIt) : 0);
+			PHYCAS_ASSERT(subset < nsubsets);
+			pattern[0] = (int8_t)subset;
+			pattern_table[subset].storePattern(&pattern[0], *sIt, 1.0, false);
+			}
+		}
+	patternTablesToVect(pattern_table);
 
-	//model->buildStateList(state_list, state_list_pos);
+	state_list.resize(nsubsets);
+	state_list_pos.resize(nsubsets);
+	for (unsigned i = 0; i < nsubsets; ++i)
+		buildUnambiguousStateList(i);
+
+    buildConstantStatesVector();
 
 	// size of likelihood_rate_site vector needs to be revisited if the number of rates subsequently changes 
 	recalcRelativeRates();
+
+	createNewUniventsStructs();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Rebuilds `state_list'[`subset'] and `state_list_pos'[`subset'] for data in which every state is either one of the
+|	states of the subset model or completely missing. For n states, state k is listed as "1 k" and the missing state 
+|	as "n+1 -1 0 1 ... n-1", except for codon models, for which the missing state is listed as "61 0 1 ... 60".
+*/
+void TreeLikelihood::buildUnambiguousStateList(
+  unsigned subset)	/**< is the index of the partition subset */
+	{
+	PHYCAS_ASSERT(subset < state_list.size() && subset < state_list_pos.size());
+	const bool codon_model = partition_model->subset_model[subset]->isCodonModel();
+	const unsigned nstates = partition_model->subset_num_states[subset];
+	state_list_t & sl = state_list[subset];
+	state_list_pos_t & slp = state_list_pos[subset];
+	sl.clear();
+	slp.clear();
+	for (unsigned k = 0; k < nstates; ++k)
+		{
+		slp.push_back((unsigned)sl.size());
+		sl.push_back((int8_t)1);
+		sl.push_back((int8_t)k);
+		}
+	slp.push_back((unsigned)sl.size());
+	if (codon_model)
+		sl.push_back((int8_t)nstates);
+	else
+		{
+		sl.push_back((int8_t)(nstates + 1));
+		sl.push_back((int8_t)-1);
+		}
+	for (unsigned k = 0; k < nstates; ++k)
+		sl.push_back((int8_t)k);
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
@@ -3903,6 +4514,11 @@ void TreeLikelihood::prepareForLikelihood( //POL_BOOKMARK TreeLikelihood::prepar
 	// Put all existing conditional likelihood arrays already back into storage
 	//storeAllCLAs(t);	//@POL why are these two lines commented out? Seems like a good idea to clear the cla stack at this point.
 	//cla_pool->clearStack();	//@POL this here only because prepareForLikelihood called in NCatMove::proposeNewState when ncat is increased
+
+	// In arena mode, create enough CLAs for a full likelihood calculation on this tree plus the cached copies made
+	// during an MCMC move in one slab now, rather than in a series of smaller slabs as they are first requested
+	if (cla_pool->isUsingArena())
+		cla_pool->fillTo(2*t->GetNNodes());
 	
 	preorder_iterator nd = t->begin();
 	
@@ -3972,6 +4588,7 @@ unsigned TreeLikelihood::buildConstantStatesVector()
 	{
     PHYCAS_ASSERT(!pattern_vect.empty());
     constant_states.clear();
+    constant_states_pos.clear();
 
     unsigned 	num_potentially_constant = 0;
     int_set_t 	common_states;		// holds running intersection across taxa for this pattern
@@ -3983,6 +4600,7 @@ unsigned TreeLikelihood::buildConstantStatesVector()
 		// get subset-specific info
 		//@POL if slow, consider using subset_offset here to avoid setting subset and ns for each pattern
 		const unsigned subset = (unsigned)(*pat)[0];
+        constant_states_pos.push_back((unsigned)constant_states.size());
         bool site_potentially_constant = true;
         for (unsigned taxon = 0; taxon < nTaxa; ++taxon)
             {
@@ -4052,64 +4670,6 @@ unsigned TreeLikelihood::buildConstantStatesVector()
     return num_potentially_constant;
     }
 
-/*----------------------------------------------------------------------------------------------------------------------
-|	Increments the count corresponding to the supplied `pattern' in `pattern_vect' (adding a new map element if `pattern'
-|	has not yet been seen) and adds the `pattern_index' to a list of pattern indices corresponding to the supplied
-|	`pattern' in `patternToIndex' (adding a newly-created list containing just `pattern_index' if `pattern' has not yet
-|	been seen.
-*/
-void TreeLikelihood::storePattern(
-  pattern_map_t & pattern_map,					/**< is the map into which to store pattern */
-  pattern_to_sites_map_t & pattern_to_site_map,	/**< is the map into which to store the original site index of this pattern */
-  const std::vector<int8_t> & pattern,			/**< is the pattern to store */
-  const unsigned int site_index,				/**< is the index of the site in the original data matrix */
-  const pattern_count_t weight, 				/**< is the weight of this pattern (normally 1.0) */
-  bool codon_model)								/**< if true, site_index and following two sites will be stored in the vector of sites having this pattern; if false, only site_index will be stored */
-	{	
-	// Add the pattern to pattern_map if it has not yet been seen, otherwise increment 
-	// the count of this pattern if it is already in pattern_map (see item 24, p. 110, in Meyers' Efficient STL)
-	pattern_map_t::iterator lowb = pattern_map.lower_bound(pattern);
-	if (lowb != pattern_map.end() && !(pattern_map.key_comp()(pattern, lowb->first)))
-		{
-		// pattern is already in pattern_map, increment count
-		lowb->second += weight;
-		//std::cerr << boost::str(boost::format("%.1f -> |") % lowb->second);
-		}
-	else
-		{
-		// pattern has not yet been stored in pattern_map
-		pattern_map.insert(lowb, pattern_map_t::value_type(pattern, weight));
-		//std::cerr << boost::str(boost::format("%.1f -> |") % weight);
-		}
-			
-	// Add the pattern to pattern_to_site_map if it has not yet been seen, otherwise increment 
-	// the count of this pattern if it is already in the map (see item 24, p. 110, in Meyers' Efficient STL)
-	pattern_to_sites_map_t::iterator pToILowB = pattern_to_site_map.lower_bound(pattern);
-	if (pToILowB != pattern_to_site_map.end() && !(pattern_to_site_map.key_comp()(pattern, pToILowB->first)))
-		{
-		// a list of site indices has already been created for this pattern in pattern_to_site_map
-		// so all we need to do is append the index site_index to the existing list
-		pToILowB->second.push_back(site_index);
-		if (codon_model)
-			{
-			pToILowB->second.push_back(site_index + 1);
-			pToILowB->second.push_back(site_index + 2);
-			}
-		}
-	else
-		{
-		// this pattern has not yet been seen, so need to create a list of site indices whose only
-		// element (so far) is site_index and insert this list into the pattern_to_site_map map
-		uint_vect_t ilist(1, site_index);	// create a list containing 1 element whose value is site_index //UINT_LIST
-		if (codon_model)
-			{
-			ilist.push_back(site_index + 1);
-			ilist.push_back(site_index + 2);
-			}
-		pattern_to_site_map.insert(pToILowB, pattern_to_sites_map_t::value_type(pattern, ilist));
-		}
-	}
-
 /*----------------------------------------------------------------------------------------------------------------------
 |	Creates a string representation of the supplied `state'. For example, if `state' equals 1 (where model is a 
 |	standard DNA model), the string returned would be "C". If, however, `state' was 7 (again, standard DNA model), then
@@ -4388,7 +4948,8 @@ void TreeUniventSubsetStruct::fullRemapping(
 			{
 			// Choose states for all sites at this internal node
 			InternalData * nd_data =  nd->GetInternalData();
-			const LikeFltType * cla = nd_data->getChildCondLikePtr()->getCLA();
+			const CLASubsetLayout & layout = treeLike.getCLALayout(subsetIndex);
+			const LikeFltType * cla = nd_data->getChildCondLikePtr()->getCLA() + treeLike.getCLASubsetStart(subsetIndex);
 			ConstPMatrices pmatrices = nd_data->getConstPMatrices(subsetIndex);
 			double const * const * pmatrix = pmatrices[0]; // index is 0 because assuming only one rate 
 			if (nd == subroot)
@@ -4405,7 +4966,7 @@ void TreeUniventSubsetStruct::fullRemapping(
 				//	  of the frequency of each state assigned to this node in order to compute
 				//	  the likelihood (these frequencies are stored in the vector
 				//	  TreeLikelihood::obs_state_counts)
-				std::vector<LikeFltType> prob(num_states*num_patterns);
+				std::vector<LikeFltType> prob(layout.length);
 				const std::vector<double> & freqs = getModel()->getStateFreqs();
 
 				// Gather arrays needed from the root_tip
@@ -4415,13 +4976,13 @@ void TreeUniventSubsetStruct::fullRemapping(
 				treeLike.calcPMatTranspose(subsetIndex, root_tip_p, root_tip_data.getConstStateListPos(subsetIndex),	 root_tip_edge_len);
 				const double * const * const * root_tip_tmatrix	  = root_tip_data.getConstTransposedPMatrices(subsetIndex);
 				const int8_t *				   root_tip_codes	  = root_tip_data.getConstStateCodes(subsetIndex);
-				unsigned offset = 0;
 				for (unsigned j = 0; j < num_patterns; ++j)
 					{
+					const unsigned offset = layout.offset(j, 0);
 					double total = 0.0;
 					for (unsigned k = 0; k < num_states; ++k)
 						{
-						const double conditional_likelihood = *cla++;
+						const double conditional_likelihood = cla[offset+k];
 						const unsigned root_tip_state = (unsigned)root_tip_codes[j];
 						const double transition_prob = root_tip_tmatrix[0][k][root_tip_state];	  // note: first index is 0 because assuming no rate heterogeneity
 						const double unnorm_prob = freqs[k]*conditional_likelihood*transition_prob;
@@ -4430,10 +4991,9 @@ void TreeUniventSubsetStruct::fullRemapping(
 						}
 					for (unsigned k = 0; k < num_states; ++k)
 						prob[offset+k] /= total; 
-					offset += num_states;
 					}
 				obs_state_counts.resize(num_states);
-				univentProbMgr.sampleRootStates(nd_univents, &prob[0], *rng.get(), true, &obs_state_counts[0]);
+				univentProbMgr.sampleRootStates(nd_univents, layout, &prob[0], *rng.get(), true, &obs_state_counts[0]);
 				if (doSampleUnivents)
 					remapUniventsForNode(t, nd, treeLike);
 				}
@@ -4447,7 +5007,7 @@ void TreeUniventSubsetStruct::fullRemapping(
 				Univents & ndP_univents = getUniventsRef(*par, subsetIndex);
 				const std::vector<int8_t> & par_states_vec = ndP_univents.getEndStatesVecRef();
 				const int8_t * par_states_ptr = &par_states_vec[0];
-				univentProbMgr.sampleDescendantStates(nd_univents, pmatrix, cla, par_states_ptr, *rng.get());
+				univentProbMgr.sampleDescendantStates(nd_univents, pmatrix, layout, cla, par_states_ptr, *rng.get());
 				if (doSampleUnivents)
 					remapUniventsForNode(t, nd, treeLike);
 				}
@@ -26,15 +26,19 @@
 #include <boost/shared_array.hpp>
 
 #include "ncl/nxscxxdiscretematrix.h"
+#include "ncl/nxsallocatematrix.h"
 
 #include "phycas/src/states_patterns.hpp"
 #include "phycas/src/likelihood_models.hpp"
 #include "phycas/src/cond_likelihood.hpp"
 #include "phycas/src/cond_likelihood_storage.hpp"
 #include "phycas/src/underflow_manager.hpp"
+#include "phycas/src/cla_kernels.hpp"
+#include "phycas/src/thread_pool.hpp"
+#include "phycas/src/hot_path_timer.hpp"
 #include "phycas/src/univent_prob_mgr.hpp"
 #include "phycas/src/partition_model.hpp"
-#include "phycas/src/beaglelib.hpp"
+#include "phycas/src/likelihood_engine.hpp"
 
 namespace phycas
 {
@@ -52,6 +56,7 @@ typedef GenericEdgeEndpoints<const TreeNode *> ConstEdgeEndpoints;
 
 class TipData;
 class InternalData;
+class PatternTable;
 
 class SimData;
 typedef boost::shared_ptr<SimData>	SimDataShPtr;
@@ -120,7 +125,7 @@ class TreeLikelihood
 	{
 	public:
 
-										TreeLikelihood(PartitionModelShPtr mod);
+										TreeLikelihood(PartitionModelShPtr mod, bool blocked = false);
 								virtual ~TreeLikelihood(); //needed as long as startTreeViewer is virtual
 
 		// Accessors
@@ -148,6 +153,7 @@ class TreeLikelihood
 		const std::vector<double> &		getSiteLikelihoods() const;
 		const std::vector<double> &		getSiteUF() const;
 		bool							storingSiteLikelihoods() const;
+		bool							hasSiteLikelihoodsFor(double lnL) const;
 		const std::vector<unsigned> &	getCharIndexToPatternIndex() const;
 
 		// Modifiers
@@ -187,6 +193,11 @@ class TreeLikelihood
 		unsigned						bytesPerCLA() const;
 		unsigned						numCLAsCreated() const;
 		unsigned						numCLAsStored() const;
+		void							useCLAArena(bool yes_or_no, bool huge_pages = false);
+		bool							isUsingCLAArena() const;
+		bool							isPatternBlocked() const;
+		const CLASubsetLayout &			getCLALayout(unsigned subset) const;
+		unsigned						getCLASubsetStart(unsigned subset) const;
 
 		TreeNode *						storeAllCLAs(TreeShPtr t);
 		bool							debugCheckCLAsRemainInTree(TreeShPtr t) const;
@@ -197,9 +208,16 @@ class TreeLikelihood
 		void							refreshCLA(TreeNode & nd, const TreeNode * avoid);
 		double							calcLnLFromNode(TreeNode & focal_node, TreeShPtr t);
 		double							calcLnL(TreeShPtr);
+		bool							prepareEdgeLnL(TreeShPtr t, TreeNode * nd);
+		double							calcEdgeLnL();
+		double							calcEdgeLenDerivatives(TreeShPtr t);
+		const double_vect_t &			getEdgeLenFirstDerivs() const;
+		const double_vect_t &			getEdgeLenSecondDerivs() const;
 		
-		bool							isUsingBeagleLib() {return _useBeagleLib;}
-		void							useBeagleLib(bool yes_or_no = true) {_useBeagleLib = yes_or_no;}
+		void							useLikelihoodEngine(std::string name);
+		std::string						getLikelihoodEngineName() const;
+		bool							isUsingBeagleLib() const;
+		void							useBeagleLib(bool yes_or_no = true);
 
 		std::string						listPatterns(bool translate);
 		std::string						getStateStr(unsigned i, state_code_t state) const;
@@ -232,15 +250,45 @@ class TreeLikelihood
 
 		TreeNode *						getLikelihoodRoot();
 		void							useAsLikelihoodRoot(TreeNode * nd);
+		void							invalidateSubsetCLAs(ModelShPtr mod);
 
 		int								getLikelihoodRootNodeNum() const;
 		void							debugSaveCLAs(TreeShPtr t, std::string fn, bool overwrite);
 		virtual int						startTreeViewer(TreeShPtr, std::string, unsigned site = 0) const {return 0;}
 
 		void							setUFNumEdges(unsigned nedges);
+		void							usePowerOfTwoScaling(bool yes_or_no = true);
+		bool							isUsingPowerOfTwoScaling() const;
+
+		unsigned						getCLAKernelLevel() const;
+		void							setCLAKernelLevel(unsigned level);
+		std::string						getCLAKernelName() const;
+		bool							isUsingFloatCLAs() const;
+
+		unsigned						getNumThreads() const;
+		void							setNumThreads(unsigned nthreads);
 
 		void							calcPMatTranspose(unsigned i, double * * * transPMats, const uint_vect_t & stateListPosVec, double edgeLength);
 		void							calcPMat(unsigned i, double * * * p, double edgeLength); //
+		void							refreshPMatTranspose(unsigned i, const TipData & tipData, double edgeLength);
+		void							refreshPMat(unsigned i, const InternalData & internalData, double edgeLength);
+		void							refreshPMatrixBatch(const std::vector<EdgeEndpoints> & edges);
+
+		void							usePMatCache(bool yes_or_no = true);
+		bool							isUsingPMatCache() const;
+		unsigned						getPMatCacheHits() const;
+		unsigned						getPMatCacheMisses() const;
+		void							resetPMatCacheStats();
+
+		bool							isTimingHotPaths() const;
+		double							getNumCLACalcs() const;
+		double							getCLACalcSeconds() const;
+		double							getNumPMatCalcs() const;
+		double							getPMatCalcSeconds() const;
+		double							getNumUnderflowCorrections() const;
+		double							getUnderflowCorrectionSeconds() const;
+		double							getNumCacheRestores() const;
+		void							resetHotPathStats();
 
 		void							calcCLATwoTips(CondLikelihood & condLike, const TipData & leftTip, const TipData & rightTip);
 		void							calcCLAOneTip(CondLikelihood & condLike, const TipData & leftChild, const InternalData & rightChild, const CondLikelihood & rightCondLike);
@@ -252,6 +300,7 @@ class TreeLikelihood
 		double							harvestLnL(EdgeEndpoints & focalEdge, TreeShPtr t);
 		double							harvestLnLFromValidEdge(ConstEdgeEndpoints & focalEdge);
 		double							harvestLnLFromValidNode(TreeNode *focalNode);
+		void							harvestEdgeLenDerivsFromValidEdge(ConstEdgeEndpoints & focalEdge, double & d1, double & d2);
         void                            debugWalkTreeShowCondLikes(TreeShPtr t);
 
 		unsigned						buildConstantStatesVector();
@@ -273,11 +322,46 @@ class TreeLikelihood
 	protected:
 
 		UnderflowManager				underflow_manager;		/**< The object that takes care of underflow correction when computing likelihood for large trees */
+		CLAKernels						cla_kernels;			/**< Provides the (possibly vectorized) loops used to compute conditional likelihood arrays and site likelihoods */
+		double_vect_t					site_rate_like;			/**< Workspace used by the harvestLnL functions to hold the site likelihood of each pattern for each rate category of one subset */
+		bool							pmat_caching;			/**< If true, refreshPMat and refreshPMatTranspose skip recomputing transition matrices whose inputs have not changed */
+		unsigned						pmat_cache_hits;		/**< The number of times refreshPMat or refreshPMatTranspose found the transition matrices of a subset to be up to date */
+		unsigned						pmat_cache_misses;		/**< The number of times refreshPMat or refreshPMatTranspose had to recompute the transition matrices of a subset */
+		HotPathCounter					cla_timing;				/**< The number of conditional likelihood arrays computed by the calcCLA functions and the time spent computing them (including time spent by conditionOnAdditionalTip and conditionOnAdditionalInternal for polytomies) */
+		HotPathCounter					pmat_timing;			/**< The number of times the transition matrices of one subset were computed for one edge and the time spent computing them */
+		HotPathCounter					cache_restores;			/**< The number of cached conditional likelihood arrays moved back to working status by the restoreFromCache functions (only the count is used) */
+		double_vect_t					scaled_edgelens;		/**< Workspace used by calcScaledEdgeLens */
+		ThreadPoolShPtr					thread_pool;			/**< If not empty, the pool of threads among which blocks of patterns are divided (see setNumThreads) */
+		double_vect_t					block_lnL;				/**< Workspace used by harvestSubsetLnL to hold the log-likelihood of each block of patterns */
+
+		std::string						engine_name;			/**< The name of the LikelihoodEngine used by calcLnL, or the empty string if conditional likelihood arrays stored in the tree are used (see useLikelihoodEngine) */
+		std::vector<LikelihoodEngineShPtr>	engines;			/**< engines[i] computes the likelihood of subset i when `engine_name' is not empty (created by createEngines) */
+		uint_vect_t						engine_num_categories;	/**< engine_num_categories[i] is the number of rate categories for which engines[i] was created */
+		LikelihoodEngineOperationVect	engine_ops;				/**< The operations that compute the partials of every internal node (built by buildEngineOperations) */
+		uint_vect_t						engine_pmat_index;		/**< engine_pmat_index[k] is the index of the transition matrices for the edge whose length is engine_edgelens[k] */
+		double_vect_t					engine_edgelens;		/**< The length of every edge of the tree, in the order given by `engine_pmat_index' */
+		unsigned						engine_root_parent;		/**< The partials buffer of the subroot node */
+		unsigned						engine_root_child;		/**< The partials buffer of the root tip */
+		unsigned						engine_root_pmat;		/**< The transition matrices for the edge between the subroot node and the root tip */
 
 		TreeNode *						likelihood_root;		/**< If not NULL< calcLnL will use this node as the likelihood root, then reset it to NULL before returning */
+		int								changed_subset;			/**< If `likelihood_root' is NULL and this is not negative, only the CLAs of this partition subset need to be recomputed by calcLnL (see invalidateSubsetCLAs) */
+		int								cla_subset;				/**< If not negative, refreshCLA and the calcCLA functions recompute only the part of each CLA belonging to this partition subset */
+		TreeNode *						edge_focal;				/**< The internal node at one end of the edge prepared by prepareEdgeLnL */
+		TreeNode *						edge_neighbor;			/**< The node at the other end of the edge prepared by prepareEdgeLnL */
+		double_vect_t					edgelen_d1;				/**< The first derivatives of the log-likelihood with respect to each edge length computed by calcEdgeLenDerivatives */
+		double_vect_t					edgelen_d2;				/**< The second derivatives of the log-likelihood with respect to each edge length computed by calcEdgeLenDerivatives */
+		ScopedThreeDMatrix<double>		edgelen_dP;				/**< Workspace used by harvestEdgeLenDerivsFromValidEdge to hold the first derivatives of the transition matrices of one subset (sized by calcEdgeLenDerivatives) */
+		ScopedThreeDMatrix<double>		edgelen_d2P;			/**< Workspace used by harvestEdgeLenDerivsFromValidEdge to hold the second derivatives of the transition matrices of one subset (sized by calcEdgeLenDerivatives) */
+		ScopedThreeDMatrix<double>		edgelen_piP;			/**< Workspace used by harvestEdgeLenDerivsFromValidEdge to hold the transition matrices of one subset premultiplied by the state frequencies (sized by calcEdgeLenDerivatives) */
+		double_vect_t					site_rate_d1;			/**< Workspace used by harvestEdgeLenDerivsFromValidEdge to hold the first derivative of the site likelihood of each pattern for each rate category of one subset */
+		double_vect_t					site_rate_d2;			/**< Workspace used by harvestEdgeLenDerivsFromValidEdge to hold the second derivative of the site likelihood of each pattern for each rate category of one subset */
 		CondLikelihoodStorageShPtr		cla_pool;
+		bool							pattern_blocked;		/**< If true, conditional likelihood arrays use the pattern-blocked layout rather than the standard layout (fixed when this object is constructed; see CLASubsetLayout) */
+		CLALayoutVect					cla_layout;				/**< cla_layout[i] describes where the conditional likelihoods of subset i lie within each conditional likelihood array (set by recalcRelativeRates) */
 
 		bool							store_site_likes;		/**< If true, calcLnL always stores the site likelihoods in the `site_likelihood' data member; if false, the `site_likelihood' data member is not updated by calcLnL */
+		double							site_likelihood_lnL;	/**< The log-likelihood computed by the calculation that last stored site likelihoods in `site_likelihood' */
 		bool							no_data;				/**< If true, calcLnL always returns 0.0 (useful for allowing MCMC to explore the prior) */
 
 		unsigned						nTaxa;					/**< The number of taxa */
@@ -299,9 +383,49 @@ class TreeLikelihood
 		InternalData *					allocateInternalData();
 
 		void							debugCompressedDataInfo(std::string filename);
-		void	 						storePattern(pattern_map_t & pattern_map, pattern_to_sites_map_t & pattern_to_site_map, const std::vector<int8_t> & pattern, const unsigned pattern_index, const pattern_count_t weight, bool codon_model);
 		unsigned						compressDataMatrix(const NxsCXXDiscreteMatrix &, const std::vector<unsigned> & partition_info);
+		unsigned						patternTablesToVect(const std::vector<PatternTable> & pattern_table);
+		void							buildUnambiguousStateList(unsigned subset);
+		void							compressSubsetPatterns(unsigned subset, const std::vector<const int8_t *> * rows, const double * wts, bool default_partition, const pattern_to_sites_t * subset_sites, std::vector<PatternTable> * pattern_table, pattern_to_sites_t * subset_missing);
+		const double_vect_t &			calcScaledEdgeLens(unsigned i, double edgeLength);
 		void							calcPMatCommon(unsigned i, double * * * pMatrices, double edgeLength);
+		void							augmentPMatTranspose(unsigned i, double * * * transPMats, const StateListPos & stateListPosVec);
+
+		/*--------------------------------------------------------------------------------------------------------------
+		|	Describes one partition subset to harvestSubsetLnL, which computes `site_rate_like' for that subset, and to 
+		|	harvestPatternBlock, which combines its rates. Either the tip members or the internal node members are used.
+		*/
+		struct HarvestSubsetInfo
+			{
+			unsigned					first_pattern;		/**< is the index of the first pattern of the subset */
+			unsigned					num_patterns;		/**< is the number of patterns in the subset */
+			unsigned					num_rates;			/**< is the number of relative rate categories */
+			unsigned					block_size;			/**< is the number of patterns handled by each task */
+			const double *				state_freqs;		/**< are the equilibrium state frequencies */
+			const double *				rate_probs;			/**< are the rate category probabilities */
+			bool						is_pinvar;			/**< is true if the subset model includes invariable sites */
+			double						pinvar;				/**< is the proportion of invariable sites */
+			const CondLikelihood *		focal_cond_like;	/**< is the conditional likelihood array of the likelihood root */
+			const CondLikelihood *		neighbor_cond_like;	/**< is the conditional likelihood array of its neighbor (NULL if the neighbor is a tip) */
+			const CLASubsetLayout *		layout;				/**< describes the arrangement of the conditional likelihood arrays of the subset */
+			const LikeFltType *			focal_cla;			/**< is the first element of the subset in the likelihood root's conditional likelihood array */
+			const LikeFltType *			neighbor_cla;		/**< is the first element of the subset in the neighbor's conditional likelihood array (NULL if the neighbor is a tip) */
+			const double * const * const *	tip_pmat_trans;	/**< are the transposed transition matrices of the neighbor for each rate (if the neighbor is a tip) */
+			const int8_t *				tip_codes;			/**< are the state codes of the neighbor (if the neighbor is a tip) */
+			const double * const * const *	pi_p;			/**< are the frequency-weighted transition matrices for each rate (if the neighbor is internal) */
+			};
+
+		double							harvestSubsetLnL(const HarvestSubsetInfo & info);
+		void							harvestBlockTask(const HarvestSubsetInfo * info, unsigned first, unsigned n);
+		double							harvestPatternBlock(const HarvestSubsetInfo & info, unsigned first, unsigned last);
+
+		unsigned						getNumEngineCategories(unsigned i) const;
+		void							createEngines();
+		void							buildEngineOperations(TreeShPtr t);
+		double							calcLnLUsingEngines(TreeShPtr t);
+
+		TreeNode *						refreshChangedSubsetCLAs(TreeShPtr t);
+		bool							isRefreshingSubset(unsigned i) const {return (cla_subset < 0 || (unsigned)cla_subset == i);}
 
 		void							calcTMatForSim(unsigned i, TipData &, double);
 		void							simulateImpl(SimDataShPtr sim_data, TreeShPtr t, LotShPtr rng, unsigned nchar, bool refresh_probs);
@@ -326,11 +450,9 @@ class TreeLikelihood
 		pattern_to_sites_t				pattern_to_sites;			/**< vector of lists that provides a list of character indices for each pattern in `pattern_vect'. For example, if pattern j is found at sites 0, 15, and 167, then pattern_to_sites[j] is the list [0, 15, 167] */
 		uint_vect_t						charIndexToPatternIndex; 	/**< maps original character index to the position of the corresponding element in `pattern_vect' */
 		uint_vect_t						constant_states;			/**< keeps track of the states for potentially constant sites. See TreeLikelihood::buildConstantStatesVector for description of the structure of this vector. */
+		uint_vect_t						constant_states_pos;		/**< `constant_states_pos'[pat] is the index in `constant_states' of the number of potentially constant states for pattern pat */
 		uint_vect_t						all_missing;				/**< keeps track of sites excluded automatically because they have missing data for all taxa. */
 		double_vect_t					site_uf;					/**< site_uf[pat] stores the underflow correction factor used for pattern pat, but only if `store_site_likes' is true */
-		BeagleLibShPtr					beagleLib;					/**< BeagleLib wrapper */
-		//std::vector<BeagleLibShPtr>		beagleLib;					/**< BeagleLib wrapper */
-		bool							_useBeagleLib;
 	};
 
 /// used to get access to a CLA to write it
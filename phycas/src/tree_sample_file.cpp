@@ -0,0 +1,475 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#include <climits>
+#include <algorithm>
+#include <boost/format.hpp>
+#include "phycas/src/tree_sample_file.hpp"
+#include "phycas/src/xphylogeny.hpp"
+
+namespace
+{
+const char			treesample_magic[8]		= {'P', 'H', 'Y', 'T', 'R', 'E', 'E', 'S'};
+const unsigned		treesample_version		= 1;
+const unsigned		treesample_byte_order	= 0x01020304;
+const unsigned		treesample_rooted		= 0x01;	// header flag: trees are rooted
+const unsigned char	record_topology			= 0x01;	// record flag: parent and node number arrays follow the cycle
+const unsigned char	record_edgelens			= 0x02;	// record flag: edge lengths end the record
+}
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Stores the file name. The file is not opened until create (for a new file) or reopen (to add trees to a file written
+|	earlier) is called. If `fn' is empty, records are held in memory.
+*/
+TreeSampleWriter::TreeSampleWriter(
+  const std::string & fn)	/**< is the name of the file (may be empty) */
+  : filename(fn), num_added(0)
+	{
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Closes the file if it is still open, ignoring errors (call close beforehand to find out about them).
+*/
+TreeSampleWriter::~TreeSampleWriter()
+	{
+	try
+		{
+		close();
+		}
+	catch(...)
+		{
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Creates the file (replacing any existing file of the same name) and writes the header, which records whether the
+|	trees are rooted and the label of each taxon (in the order of the tip node numbers). Throws XPhylogeny if the file
+|	cannot be created.
+*/
+void TreeSampleWriter::create(
+  const std::vector<std::string> & taxon_labels,	/**< holds the taxon labels, indexed by tip node number */
+  bool rooted)										/**< is true if the sampled trees are rooted */
+	{
+	PHYCAS_ASSERT(!filename.empty());
+	PHYCAS_ASSERT(!out.is_open());
+	out.open(filename, false);
+	if (!out.is_open())
+		throw XPhylogeny(std::string("could not create tree sample file ") + filename);
+	putBytes(treesample_magic, sizeof(treesample_magic));
+	putBytes(&treesample_version, sizeof(unsigned));
+	putBytes(&treesample_byte_order, sizeof(unsigned));
+	const unsigned flags = (rooted ? treesample_rooted : 0);
+	putBytes(&flags, sizeof(unsigned));
+	const unsigned ntax = (unsigned)taxon_labels.size();
+	putBytes(&ntax, sizeof(unsigned));
+	for (std::vector<std::string>::const_iterator it = taxon_labels.begin(); it != taxon_labels.end(); ++it)
+		{
+		const unsigned len = (unsigned)it->size();
+		putBytes(&len, sizeof(unsigned));
+		putBytes(it->data(), (std::streamsize)len);
+		}
+	out.flush();
+	prev_parents.clear();
+	prev_numbers.clear();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Opens an existing file written by an earlier TreeSampleWriter (e.g. one truncated to the length it had when a 
+|	checkpoint was saved) so that further trees are added to the end of it. The header is checked by reading the file
+|	with a TreeSampleReader. The first tree added afterwards always stores its topology.
+*/
+void TreeSampleWriter::reopen()
+	{
+	PHYCAS_ASSERT(!filename.empty());
+	PHYCAS_ASSERT(!out.is_open());
+		{
+		TreeSampleReader existing(filename);
+		}
+	out.open(filename, true);
+	if (!out.is_open())
+		throw XPhylogeny(std::string("could not open tree sample file ") + filename);
+	prev_parents.clear();
+	prev_numbers.clear();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if create or reopen has been called and close has not.
+*/
+bool TreeSampleWriter::isOpen() const
+	{
+	return out.is_open();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Adds a record for the tree `t' sampled at `cycle'. The tree is walked once in preorder; the parent of each node is
+|	found on a stack holding the path from the root to the previous node, so no lookup table is needed. The parent and
+|	node number arrays are written only if they differ from those of the previous record. Throws XPhylogeny if `t' has
+|	no nodes.
+*/
+void TreeSampleWriter::addTree(
+  unsigned cycle,	/**< is the cycle at which the tree was sampled */
+  TreeShPtr t)		/**< is the tree to save */
+	{
+	PHYCAS_ASSERT(t);
+	parents.clear();
+	numbers.clear();
+	edgelens.clear();
+	path.clear();
+	path_index.clear();
+	const bool has_edgelens = t->HasEdgeLens();
+	unsigned i = 0;
+	for (TreeNode * nd = t->GetFirstPreorder(); nd != NULL; nd = nd->GetNextPreorder(), ++i)
+		{
+		TreeNode * par = nd->GetParent();
+		while (!path.empty() && path.back() != par)
+			{
+			path.pop_back();
+			path_index.pop_back();
+			}
+		if (par == NULL)
+			parents.push_back(UINT_MAX);
+		else
+			{
+			PHYCAS_ASSERT(!path.empty());
+			parents.push_back(path_index.back());
+			if (has_edgelens)
+				edgelens.push_back(nd->GetEdgeLen());
+			}
+		numbers.push_back(nd->GetNodeNumber());
+		path.push_back(nd);
+		path_index.push_back(i);
+		}
+	if (parents.empty())
+		throw XPhylogeny("cannot save a tree that has no nodes");
+
+	const bool same_topology = (parents == prev_parents && numbers == prev_numbers);
+	const unsigned char flags = (same_topology ? 0 : record_topology) | (has_edgelens ? record_edgelens : 0);
+	putBytes(&flags, 1);
+	putBytes(&cycle, sizeof(unsigned));
+	if (!same_topology)
+		{
+		const unsigned nnodes = (unsigned)parents.size();
+		putBytes(&nnodes, sizeof(unsigned));
+		putBytes(&parents[0], (std::streamsize)(nnodes*sizeof(unsigned)));
+		putBytes(&numbers[0], (std::streamsize)(nnodes*sizeof(unsigned)));
+		prev_parents.swap(parents);
+		prev_numbers.swap(numbers);
+		}
+	if (!edgelens.empty())
+		putBytes(&edgelens[0], (std::streamsize)(edgelens.size()*sizeof(double)));
+	++num_added;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Appends every record held in memory by this writer (which must have been constructed with an empty file name) to
+|	`other', then empties the buffer. Because the first record held by this writer always stores its topology, the 
+|	records remain valid wherever they are appended. Used to write trees sampled concurrently by different chains 
+|	grouped by chain.
+*/
+void TreeSampleWriter::transferTo(
+  TreeSampleWriter & other)	/**< is the writer to which the records are appended */
+	{
+	PHYCAS_ASSERT(filename.empty());
+	if (buffer.empty())
+		return;
+	other.putBytes(buffer.data(), (std::streamsize)buffer.size());
+	other.prev_parents = prev_parents;
+	other.prev_numbers = prev_numbers;
+	buffer.clear();
+	prev_parents.clear();
+	prev_numbers.clear();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Appends `n' bytes starting at `p' to the file (or to the memory buffer if there is no file), throwing XPhylogeny if
+|	the write fails.
+*/
+void TreeSampleWriter::putBytes(
+  const void * p,		/**< is the address of the first byte to write */
+  std::streamsize n)	/**< is the number of bytes to write */
+	{
+	if (filename.empty())
+		{
+		buffer.append(reinterpret_cast<const char *>(p), (std::string::size_type)n);
+		return;
+		}
+	if (!out.is_open())
+		throw XPhylogeny(std::string("tree sample file ") + filename + " is not open");
+	out.write(reinterpret_cast<const char *>(p), n);
+	if (!out)
+		throw XPhylogeny(std::string("error writing tree sample file ") + filename);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Hands every tree added so far to the background thread, which writes them without delaying the caller. Does nothing
+|	if the file is not open.
+*/
+void TreeSampleWriter::flush()
+	{
+	if (out.is_open())
+		out.flush();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Waits until every tree added so far is in the file and returns its length, to which the file should be truncated before reopen is called to resume 
+|	from a checkpoint saved now. Returned as a double so that lengths that do not fit in an unsigned int survive the
+|	trip through Python. Returns 0.0 if the file is not open.
+*/
+double TreeSampleWriter::tell()
+	{
+	if (!out.is_open())
+		return 0.0;
+	out.sync();
+	return (double)out.tellp();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Closes the file once the background thread has written every tree, throwing XPhylogeny if any write failed.
+*/
+void TreeSampleWriter::close()
+	{
+	if (!out.is_open())
+		return;
+	out.close();
+	if (!out)
+		throw XPhylogeny(std::string("error closing tree sample file ") + filename);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the minimum time in seconds between flushes of the file by the background thread (see 
+|	AsyncFileWriter::setFlushInterval).
+*/
+void TreeSampleWriter::setFlushInterval(
+  double seconds)	/**< is the flush interval */
+	{
+	out.setFlushInterval(seconds);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the name of the file (empty if records are held in memory).
+*/
+const std::string & TreeSampleWriter::getFilename() const
+	{
+	return filename;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of trees added since this writer was constructed.
+*/
+unsigned TreeSampleWriter::getNumTreesAdded() const
+	{
+	return num_added;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Opens the file `fn', reads its header and walks the records to count them and to make sure the last one is complete.
+*/
+TreeSampleReader::TreeSampleReader(
+  const std::string & fn)	/**< is the name of the file */
+  : filename(fn), rooted(false), num_trees(0), first_record(0), num_read(0), cycle(0), new_topology(false)
+	{
+	in.open(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!in.is_open())
+		throw XPhylogeny(std::string("could not open tree sample file ") + filename);
+	char magic[sizeof(treesample_magic)];
+	getBytes(magic, sizeof(magic));
+	if (!std::equal(magic, magic + sizeof(magic), treesample_magic))
+		throw XPhylogeny(filename + " is not a Phycas tree sample file");
+	unsigned x = 0;
+	getBytes(&x, sizeof(unsigned));
+	if (x != treesample_version)
+		throw XPhylogeny(filename + " was written by an incompatible version of Phycas");
+	getBytes(&x, sizeof(unsigned));
+	if (x != treesample_byte_order)
+		throw XPhylogeny(filename + " was written on a machine with a different byte order");
+	getBytes(&x, sizeof(unsigned));
+	rooted = ((x & treesample_rooted) != 0);
+	unsigned ntax = 0;
+	getBytes(&ntax, sizeof(unsigned));
+	taxon_labels.resize(ntax);
+	std::vector<char> label;
+	for (unsigned i = 0; i < ntax; ++i)
+		{
+		unsigned len = 0;
+		getBytes(&len, sizeof(unsigned));
+		label.resize(len + 1);
+		getBytes(&label[0], (std::streamsize)len);
+		taxon_labels[i].assign(&label[0], len);
+		}
+	first_record = in.tellg();
+
+	// Walk the records, skipping over their contents
+	in.seekg(0, std::ios::end);
+	const std::streamoff file_length = in.tellg();
+	std::streamoff pos = first_record;
+	unsigned nnodes = 0;
+	while (pos < file_length)
+		{
+		in.seekg(pos);
+		unsigned char flags = 0;
+		getBytes(&flags, 1);
+		pos += 1 + sizeof(unsigned);
+		if (flags & record_topology)
+			{
+			in.seekg(pos);
+			getBytes(&nnodes, sizeof(unsigned));
+			pos += sizeof(unsigned) + (std::streamoff)nnodes*2*sizeof(unsigned);
+			}
+		if (nnodes == 0 || (flags & ~(record_topology | record_edgelens)) != 0)
+			throw XPhylogeny(std::string("tree sample file ") + filename + " is corrupt");
+		if (flags & record_edgelens)
+			pos += (std::streamoff)(nnodes - 1)*sizeof(double);
+		if (pos > file_length)
+			throw XPhylogeny(std::string("tree sample file ") + filename + " is truncated");
+		++num_trees;
+		}
+	rewind();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if the file `fn' exists and begins with the signature written by TreeSampleWriter, as opposed to being
+|	a NEXUS tree file.
+*/
+bool TreeSampleReader::isTreeSampleFile(
+  const std::string & fn)	/**< is the name of the file */
+	{
+	std::ifstream f(fn.c_str(), std::ios::in | std::ios::binary);
+	char magic[sizeof(treesample_magic)];
+	f.read(magic, sizeof(magic));
+	return (f.gcount() == (std::streamsize)sizeof(magic) && std::equal(magic, magic + sizeof(magic), treesample_magic));
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads `n' bytes into the memory starting at `p', throwing XPhylogeny if the end of the file is reached first.
+*/
+void TreeSampleReader::getBytes(
+  void * p,				/**< is the address at which to store the first byte read */
+  std::streamsize n)	/**< is the number of bytes to read */
+	{
+	in.read(reinterpret_cast<char *>(p), n);
+	if (in.gcount() != n)
+		throw XPhylogeny(std::string("tree sample file ") + filename + " is truncated");
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the taxon labels stored in the header, indexed by tip node number.
+*/
+const std::vector<std::string> & TreeSampleReader::getTaxonLabels() const
+	{
+	return taxon_labels;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if the trees in the file are rooted.
+*/
+bool TreeSampleReader::isRooted() const
+	{
+	return rooted;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of trees in the file.
+*/
+unsigned TreeSampleReader::getNumTrees() const
+	{
+	return num_trees;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads the next tree into `t', returning false (and leaving `t' alone) if every tree has been read. If the topology
+|	of the tree is that of the previous tree and `t' is the tree into which the previous tree was read, only the edge
+|	lengths of `t' are replaced; the caller must therefore not change the topology or node numbers of `t' between calls.
+|	Otherwise `t' is rebuilt from the stored parent and node number arrays. Tip nodes are not given names (use 
+|	Tree::RectifyNames with the labels returned by getTaxonLabels if names are needed).
+*/
+bool TreeSampleReader::readNext(
+  TreeShPtr t)	/**< is the tree to build */
+	{
+	PHYCAS_ASSERT(t);
+	if (num_read == num_trees)
+		return false;
+	unsigned char flags = 0;
+	getBytes(&flags, 1);
+	getBytes(&cycle, sizeof(unsigned));
+	new_topology = ((flags & record_topology) != 0);
+	if (new_topology)
+		{
+		unsigned nnodes = 0;
+		getBytes(&nnodes, sizeof(unsigned));
+		parents.resize(nnodes);
+		numbers.resize(nnodes);
+		getBytes(&parents[0], (std::streamsize)(nnodes*sizeof(unsigned)));
+		getBytes(&numbers[0], (std::streamsize)(nnodes*sizeof(unsigned)));
+		}
+	PHYCAS_ASSERT(!parents.empty());
+	if (flags & record_edgelens)
+		{
+		edgelens.resize(parents.size() - 1);
+		if (!edgelens.empty())
+			getBytes(&edgelens[0], (std::streamsize)(edgelens.size()*sizeof(double)));
+		}
+	else
+		edgelens.clear();
+
+	if (new_topology || t != last_tree)
+		{
+		t->Clear();
+		t->setRootedness(rooted);
+		t->BuildFromPreorder(parents, numbers, edgelens);
+		last_tree = t;
+		}
+	else if (!edgelens.empty())
+		t->replaceEdgeLens(edgelens);
+	++num_read;
+	return true;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns to the first tree in the file, so that the next call to readNext reads it.
+*/
+void TreeSampleReader::rewind()
+	{
+	in.clear();
+	in.seekg(first_record);
+	num_read = 0;
+	parents.clear();
+	numbers.clear();
+	last_tree.reset();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the cycle at which the tree most recently read by readNext was sampled.
+*/
+unsigned TreeSampleReader::getCycle() const
+	{
+	return cycle;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns false if the tree most recently read by readNext has the same topology as the tree read before it.
+*/
+bool TreeSampleReader::topologyChanged() const
+	{
+	return new_topology;
+	}
+
+} // namespace phycas
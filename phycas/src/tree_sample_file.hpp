@@ -0,0 +1,131 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(TREE_SAMPLE_FILE_HPP)
+#define TREE_SAMPLE_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "phycas/src/basic_tree.hpp"
+#include "phycas/src/async_file_writer.hpp"
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Saves trees sampled during an MCMC analysis to a compact binary file, avoiding the cost of creating a Newick 
+|	description of every sampled tree and of parsing it again when the trees are summarized. The header holds the 
+|	taxon labels and whether the trees are rooted. Each tree is stored as one record beginning with a flags byte and
+|	the cycle at which the tree was sampled. A record whose topology differs from that of the previous record stores 
+|	the number of nodes, the preorder index of the parent of each node (in preorder, with UINT_MAX for the root) and
+|	the number of each node. A record whose topology (including node numbers) is the same as that of the previous 
+|	record omits these arrays. If the tree has edge lengths, these follow as doubles in preorder, skipping the root.
+|	Numbers are written in native byte order. The file is written by a background thread (see AsyncFileWriter), so 
+|	adding a tree never waits for the disk. A writer constructed with an empty file name holds its records in 
+|	memory until they are handed to another writer by transferTo.
+*/
+class TreeSampleWriter : boost::noncopyable
+	{
+	public:
+										TreeSampleWriter(const std::string & fn);
+										~TreeSampleWriter();
+
+		void							create(const std::vector<std::string> & taxon_labels, bool rooted);
+		void							reopen();
+		bool							isOpen() const;
+
+		void							addTree(unsigned cycle, TreeShPtr t);
+		void							transferTo(TreeSampleWriter & other);
+
+		void							flush();
+		double							tell();
+		void							close();
+		void							setFlushInterval(double seconds);
+
+		const std::string &				getFilename() const;
+		unsigned						getNumTreesAdded() const;
+
+	private:
+
+		void							putBytes(const void * p, std::streamsize n);
+
+		std::string						filename;		/**< The name of the file (empty if records are only held in memory) */
+		AsyncFileWriter					out;			/**< Writes to `filename' in a background thread */
+		std::string						buffer;			/**< Holds the records of a writer that has no file */
+		unsigned						num_added;		/**< The number of trees added since construction */
+		std::vector<unsigned>			prev_parents;	/**< The parent array of the most recently written topology (empty if the next record must store its topology) */
+		std::vector<unsigned>			prev_numbers;	/**< The node numbers of the most recently written topology */
+		std::vector<unsigned>			parents;		/**< Workspace holding the parent array of the tree being added */
+		std::vector<unsigned>			numbers;		/**< Workspace holding the node numbers of the tree being added */
+		std::vector<double>				edgelens;		/**< Workspace holding the edge lengths of the tree being added */
+		std::vector<TreeNode *>			path;			/**< Workspace holding the path from the root to the current node */
+		std::vector<unsigned>			path_index;		/**< Workspace holding the preorder index of each node in `path' */
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads the trees in a file written by TreeSampleWriter one at a time, in the order in which they were sampled. When
+|	consecutive trees share a topology and are read into the same Tree object, only the edge lengths of that object are
+|	replaced. The constructor reads the header and checks that every record is complete. Throws XPhylogeny if the file
+|	cannot be opened, was not written by TreeSampleWriter (or was written on a machine with different byte order), or is
+|	truncated.
+*/
+class TreeSampleReader : boost::noncopyable
+	{
+	public:
+										TreeSampleReader(const std::string & fn);
+
+		static bool						isTreeSampleFile(const std::string & fn);
+
+		const std::vector<std::string> &	getTaxonLabels() const;
+		bool							isRooted() const;
+		unsigned						getNumTrees() const;
+
+		bool							readNext(TreeShPtr t);
+		void							rewind();
+		unsigned						getCycle() const;
+		bool							topologyChanged() const;
+
+	private:
+
+		void							getBytes(void * p, std::streamsize n);
+
+		std::string						filename;		/**< The name of the file (used in error messages) */
+		std::ifstream					in;				/**< The stream attached to `filename' */
+		std::vector<std::string>		taxon_labels;	/**< The taxon labels read from the header */
+		bool							rooted;			/**< True if the trees in the file are rooted */
+		unsigned						num_trees;		/**< The number of records in the file */
+		std::streamoff					first_record;	/**< The position of the first record */
+		unsigned						num_read;		/**< The number of records read by readNext since the file was opened or rewound */
+		unsigned						cycle;			/**< The cycle of the record most recently read */
+		bool							new_topology;	/**< True if the record most recently read stored a topology */
+		TreeShPtr						last_tree;		/**< The tree most recently built (whose topology is that in `parents' and `numbers') */
+		std::vector<unsigned>			parents;		/**< The parent array of the most recent topology */
+		std::vector<unsigned>			numbers;		/**< The node numbers of the most recent topology */
+		std::vector<double>				edgelens;		/**< The edge lengths of the record most recently read */
+	};
+
+typedef boost::shared_ptr<TreeSampleWriter> TreeSampleWriterShPtr;
+typedef boost::shared_ptr<TreeSampleReader> TreeSampleReaderShPtr;
+
+} // namespace phycas
+
+#endif
@@ -21,6 +21,7 @@
 #include "phycas/src/likelihood_models.hpp"
 #include "phycas/src/tree_likelihood.hpp"
 #include "phycas/src/xlikelihood.hpp"
+#include "phycas/src/checkpoint.hpp"
 #include "phycas/src/mcmc_chain_manager.hpp"
 #include "phycas/src/tree_scaler_move.hpp"
 #include "phycas/src/basic_tree.hpp"
@@ -84,6 +85,28 @@ void TreeScalerMove::setBoldness(
 	lambda = min_lambda + (max_lambda - min_lambda)*boldness/100.0;
 	}
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Adds `boldness' and `lambda' to the state saved by MCMCUpdater::saveState.
+*/
+void TreeScalerMove::saveState(
+  CheckpointWriter & out) const	/**< is the checkpoint being written */
+	{
+	MCMCUpdater::saveState(out);
+	out.putDouble(boldness);
+	out.putDouble(lambda);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Restores the state written by saveState.
+*/
+void TreeScalerMove::restoreState(
+  CheckpointReader & in)	/**< is the checkpoint being read */
+	{
+	MCMCUpdater::restoreState(in);
+	boldness	= in.getDouble();
+	lambda		= in.getDouble();
+	}
+
 /*----------------------------------------------------------------------------------------------------------------------
 |	Returns the natural log of the Hastings ratio for this move. The Hastings ratio is (`mstar'/`m')^n, where `mstar' is
 |	the new tree length and `m' is the tree length before the move is proposed. The value n is the number of edges in
@@ -53,6 +53,8 @@ class TreeScalerMove : public MCMCUpdater
         virtual void    setPosteriorTuningParam(double x);
         virtual void    setPriorTuningParam(double x);
 		virtual void	setBoldness(double x);
+		virtual void	saveState(CheckpointWriter & out) const;
+		virtual void	restoreState(CheckpointReader & in);
 		virtual bool	update();
 		virtual double	recalcPrior();			// override virtual from MCMCUpdater base class
 		virtual void	revert();
@@ -0,0 +1,449 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#include <climits>
+#include <algorithm>
+#include "phycas/src/tree_summarizer.hpp"
+#include "phycas/src/tree_sample_file.hpp"
+#include "phycas/src/xphylogeny.hpp"
+
+namespace phycas
+{
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Constructs an empty summary. If `rooted_trees' is false, splits are given a standard polarity before being stored.
+*/
+TreeSummarizer::TreeSummarizer(
+  bool rooted_trees)	/**< is true if the trees to be summarized are rooted */
+  : rooted(rooted_trees)
+	{
+	clear();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Forgets every tree added so far.
+*/
+void TreeSummarizer::clear()
+	{
+	num_trees = 0;
+	max_ntax = 0;
+
+	splits.clear();
+	split_counts.clear();
+	split_edgelens.clear();
+	split_samples.clear();
+	split_hashes.clear();
+	split_slots.assign(256, UINT_MAX);
+
+	topo_splits.clear();
+	topo_counts.clear();
+	topo_treelens.clear();
+	topo_samples.clear();
+	topo_newicks.clear();
+	topo_hashes.clear();
+	topo_slots.assign(256, UINT_MAX);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Mixes the words in `v' into a 64-bit hash, finishing with the avalanche step of splitmix64 so that the low-order 
+|	bits used to choose a slot depend on every word.
+*/
+template <typename T>
+boost::uint64_t TreeSummarizer::hashWords(
+  const std::vector<T> & v)	/**< is the vector of words to hash */
+	{
+	const unsigned n = (unsigned)v.size();
+	boost::uint64_t h = 0x9E3779B97F4A7C15ULL ^ (boost::uint64_t)n;
+	for (unsigned i = 0; i < n; ++i)
+		{
+		h = (h ^ (boost::uint64_t)v[i])*0xBF58476D1CE4E5B9ULL;
+		h ^= (h >> 31);
+		}
+	h ^= (h >> 30);
+	h *= 0xBF58476D1CE4E5B9ULL;
+	h ^= (h >> 27);
+	h *= 0x94D049BB133111EBULL;
+	h ^= (h >> 31);
+	return h;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Doubles the number of `slots' and reinserts the indices of all `hashes' stored so far.
+*/
+void TreeSummarizer::rehash(
+  std::vector<unsigned> & slots,					/**< is the hash table to enlarge */
+  const std::vector<boost::uint64_t> & hashes)	/**< is the hash of each entry indexed by `slots' */
+	{
+	const unsigned nslots = 2*(unsigned)slots.size();
+	slots.assign(nslots, UINT_MAX);
+	const unsigned mask = nslots - 1;
+	const unsigned n = (unsigned)hashes.size();
+	for (unsigned i = 0; i < n; ++i)
+		{
+		unsigned s = (unsigned)(hashes[i] & mask);
+		while (slots[s] != UINT_MAX)
+			s = (s + 1) & mask;
+		slots[s] = i;
+		}
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the index of the stored split equal to `s', first storing a copy of `s' (with a count and edge length sum of
+|	zero) if it has not been seen before.
+*/
+unsigned TreeSummarizer::findSplit(
+  const Split & s)	/**< is the split to look up */
+	{
+	const boost::uint64_t h = hashWords(s.unit);
+	const unsigned mask = (unsigned)split_slots.size() - 1;
+	unsigned slot = (unsigned)(h & mask);
+	for (;;)
+		{
+		const unsigned k = split_slots[slot];
+		if (k == UINT_MAX)
+			break;
+		if (split_hashes[k] == h && splits[k].unit == s.unit)
+			return k;
+		slot = (slot + 1) & mask;
+		}
+
+	const unsigned k = (unsigned)splits.size();
+	splits.push_back(s);
+	split_counts.push_back(0);
+	split_edgelens.push_back(0.0);
+	split_samples.push_back(std::vector<unsigned>());
+	split_hashes.push_back(h);
+	split_slots[slot] = k;
+	if (2*splits.size() > split_slots.size())
+		rehash(split_slots, split_hashes);
+	return k;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the index of the topology whose sorted list of non-tip split indices is `key', first storing a new topology
+|	(with a count and tree length sum of zero and an empty newick description) if `key' has not been seen before.
+*/
+unsigned TreeSummarizer::findTopology(
+  const std::vector<unsigned> & key)	/**< is the sorted list of split indices identifying the topology */
+	{
+	const boost::uint64_t h = hashWords(key);
+	const unsigned mask = (unsigned)topo_slots.size() - 1;
+	unsigned slot = (unsigned)(h & mask);
+	for (;;)
+		{
+		const unsigned k = topo_slots[slot];
+		if (k == UINT_MAX)
+			break;
+		if (topo_hashes[k] == h && topo_splits[k] == key)
+			return k;
+		slot = (slot + 1) & mask;
+		}
+
+	const unsigned k = (unsigned)topo_splits.size();
+	topo_splits.push_back(key);
+	topo_counts.push_back(0);
+	topo_treelens.push_back(0.0);
+	topo_samples.push_back(std::vector<unsigned>());
+	topo_newicks.push_back(std::string());
+	topo_hashes.push_back(h);
+	topo_slots[slot] = k;
+	if (2*topo_splits.size() > topo_slots.size())
+		rehash(topo_slots, topo_hashes);
+	return k;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Adds the splits and topology of the tree `t' to the summary. The splits of `t' are recalculated. Every node other 
+|	than the root contributes its split; the split is considered a tip split if the node is a tip or its parent is the
+|	tip serving as the root. Edge lengths are taken to be 1.0 if `t' has no edge lengths.
+*/
+void TreeSummarizer::addTree(
+  TreeShPtr t)	/**< is the tree to add */
+	{
+	++num_trees;
+	const unsigned ntax = t->GetNObservables();
+	if (ntax > max_ntax)
+		max_ntax = ntax;
+	t->RecalcAllSplits(ntax);
+	const bool has_edgelens = t->HasEdgeLens();
+
+	workspace_key.clear();
+	double treelen = 0.0;
+	for (TreeNode * nd = t->GetFirstPreorder()->GetNextPreorder(); nd; nd = nd->GetNextPreorder())
+		{
+		const bool tip_split = nd->IsTip() || nd->GetParent()->IsTipRoot();
+		const double edgelen = (has_edgelens ? nd->GetEdgeLen() : 1.0);
+		treelen += edgelen;
+
+		workspace_split = nd->GetSplit();
+		if (!rooted && workspace_split.IsBitSet(0))
+			workspace_split.InvertSplit();
+
+		const unsigned k = findSplit(workspace_split);
+		split_counts[k] += 1;
+		split_edgelens[k] += edgelen;
+		if (!tip_split)
+			{
+			split_samples[k].push_back(num_trees);
+			workspace_key.push_back(k);
+			}
+		}
+
+	std::sort(workspace_key.begin(), workspace_key.end());
+	const unsigned k = findTopology(workspace_key);
+	if (topo_counts[k] == 0)
+		topo_newicks[k] = t->MakeNumberedNewick();
+	topo_counts[k] += 1;
+	topo_treelens[k] += treelen;
+	topo_samples[k].push_back(num_trees);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Reads every remaining tree from `reader' into `t', adding all but the first `burnin' of them to the summary. Trees
+|	whose topology is unchanged from the previous record are read without rebuilding `t'. Returns the number of trees
+|	read (including those skipped).
+*/
+unsigned TreeSummarizer::addTreesFromFile(
+  TreeSampleReader & reader,	/**< is the source of the trees */
+  unsigned burnin,				/**< is the number of trees to skip */
+  TreeShPtr t)					/**< is the tree into which each sample is read */
+	{
+	if (reader.isRooted() != rooted)
+		throw XPhylogeny(reader.isRooted() ? "expecting unrooted trees but trees in file are rooted" : "expecting rooted trees but trees in file are unrooted");
+	unsigned nread = 0;
+	while (reader.readNext(t))
+		{
+		if (nread++ >= burnin)
+			addTree(t);
+		}
+	return nread;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of trees added.
+*/
+unsigned TreeSummarizer::getNumTrees() const
+	{
+	return num_trees;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the largest number of observables (tips) found in any tree added.
+*/
+unsigned TreeSummarizer::getMaxNumTaxa() const
+	{
+	return max_ntax;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of distinct splits found, including tip splits.
+*/
+unsigned TreeSummarizer::getNumSplits() const
+	{
+	return (unsigned)splits.size();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the pattern representation (see Split::CreatePatternRepresentation) of split `i'.
+*/
+std::string TreeSummarizer::getSplitPattern(
+  unsigned i) const	/**< is the index of the split */
+	{
+	PHYCAS_ASSERT(i < splits.size());
+	return splits[i].CreatePatternRepresentation();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if split `i' was only ever found as a tip split, in which case no sample indices are stored for it.
+*/
+bool TreeSummarizer::isTrivialSplit(
+  unsigned i) const	/**< is the index of the split */
+	{
+	PHYCAS_ASSERT(i < splits.size());
+	return split_samples[i].empty();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of trees in which split `i' was found.
+*/
+unsigned TreeSummarizer::getSplitCount(
+  unsigned i) const	/**< is the index of the split */
+	{
+	PHYCAS_ASSERT(i < splits.size());
+	return split_counts[i];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the sum of the edge lengths of split `i' over all trees in which it was found.
+*/
+double TreeSummarizer::getSplitEdgeLenSum(
+  unsigned i) const	/**< is the index of the split */
+	{
+	PHYCAS_ASSERT(i < splits.size());
+	return split_edgelens[i];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the increasing 1-based indices of the trees in which split `i' was found other than as a tip split.
+*/
+const std::vector<unsigned> & TreeSummarizer::getSplitSamples(
+  unsigned i) const	/**< is the index of the split */
+	{
+	PHYCAS_ASSERT(i < splits.size());
+	return split_samples[i];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of runs of consecutive values in the increasing list `samples' (at least 1, even if `samples' is
+|	empty, because a split that is always present has a single sojourn).
+*/
+unsigned TreeSummarizer::countSojourns(
+  const std::vector<unsigned> & samples)	/**< is the list of sample indices */
+	{
+	unsigned n = 1;
+	for (unsigned j = 1; j < (unsigned)samples.size(); ++j)
+		{
+		if (samples[j] - samples[j - 1] > 1)
+			++n;
+		}
+	return n;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of sojourns of split `i', a sojourn being a run of consecutive trees containing the split.
+*/
+unsigned TreeSummarizer::countSplitSojourns(
+  unsigned i) const	/**< is the index of the split */
+	{
+	PHYCAS_ASSERT(i < splits.size());
+	return countSojourns(split_samples[i]);
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns, for each number of trees x in `xvect' (which must be increasing), the fraction of the first x trees that 
+|	contain split `i' (0.0 if x is 0). This is the cumulative split posterior used in AWTY plots.
+*/
+std::vector<double> TreeSummarizer::calcSplitPosteriorSeries(
+  unsigned i,							/**< is the index of the split */
+  const std::vector<unsigned> & xvect) const	/**< is the list of tree counts at which the posterior is to be computed */
+	{
+	PHYCAS_ASSERT(i < splits.size());
+	const std::vector<unsigned> & v = split_samples[i];
+	std::vector<double> y(xvect.size(), 0.0);
+	unsigned k = 0;
+	for (unsigned j = 0; j < (unsigned)xvect.size(); ++j)
+		{
+		const unsigned x = xvect[j];
+		while (k < v.size() && v[k] <= x)
+			++k;
+		if (x > 0)
+			y[j] = (double)k/(double)x;
+		}
+	return y;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the indices of the non-tip splits found in at least half of the trees, in order of decreasing count (splits
+|	with equal counts are in the order in which they were first encountered). These are the splits of the majority-rule
+|	consensus tree.
+*/
+std::vector<unsigned> TreeSummarizer::getMajorityRuleSplits() const
+	{
+	std::vector<std::pair<unsigned, unsigned> > v;
+	for (unsigned i = 0; i < (unsigned)splits.size(); ++i)
+		{
+		if (!split_samples[i].empty() && 2*split_counts[i] >= num_trees)
+			v.push_back(std::make_pair(num_trees - split_counts[i], i));
+		}
+	std::sort(v.begin(), v.end());
+	std::vector<unsigned> majrule;
+	for (unsigned j = 0; j < (unsigned)v.size(); ++j)
+		majrule.push_back(v[j].second);
+	return majrule;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of distinct tree topologies found.
+*/
+unsigned TreeSummarizer::getNumTopologies() const
+	{
+	return (unsigned)topo_splits.size();
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of trees having topology `i'.
+*/
+unsigned TreeSummarizer::getTopologyCount(
+  unsigned i) const	/**< is the index of the topology */
+	{
+	PHYCAS_ASSERT(i < topo_splits.size());
+	return topo_counts[i];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the sum of the lengths of all trees having topology `i'.
+*/
+double TreeSummarizer::getTopologyTreeLenSum(
+  unsigned i) const	/**< is the index of the topology */
+	{
+	PHYCAS_ASSERT(i < topo_splits.size());
+	return topo_treelens[i];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the increasing 1-based indices of the trees having topology `i'.
+*/
+const std::vector<unsigned> & TreeSummarizer::getTopologySamples(
+  unsigned i) const	/**< is the index of the topology */
+	{
+	PHYCAS_ASSERT(i < topo_splits.size());
+	return topo_samples[i];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the sorted indices of the non-tip splits making up topology `i'.
+*/
+const std::vector<unsigned> & TreeSummarizer::getTopologySplits(
+  unsigned i) const	/**< is the index of the topology */
+	{
+	PHYCAS_ASSERT(i < topo_splits.size());
+	return topo_splits[i];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the numbered newick description (see Tree::MakeNumberedNewick) of the first tree found having topology `i'.
+*/
+const std::string & TreeSummarizer::getTopologyNewick(
+  unsigned i) const	/**< is the index of the topology */
+	{
+	PHYCAS_ASSERT(i < topo_splits.size());
+	return topo_newicks[i];
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the number of sojourns of topology `i', a sojourn being a run of consecutive trees having the topology.
+*/
+unsigned TreeSummarizer::countTopologySojourns(
+  unsigned i) const	/**< is the index of the topology */
+	{
+	PHYCAS_ASSERT(i < topo_splits.size());
+	return countSojourns(topo_samples[i]);
+	}
+
+} // namespace phycas
@@ -0,0 +1,112 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\
+|  Phycas: Python software for phylogenetic analysis                          |
+|  Copyright (C) 2006 Mark T. Holder, Paul O. Lewis and David L. Swofford     |
+|                                                                             |
+|  This program is free software; you can redistribute it and/or modify       |
+|  it under the terms of the GNU General Public License as published by       |
+|  the Free Software Foundation; either version 2 of the License, or          |
+|  (at your option) any later version.                                        |
+|                                                                             |
+|  This program is distributed in the hope that it will be useful,            |
+|  but WITHOUT ANY WARRANTY; without even the implied warranty of             |
+|  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              |
+|  GNU General Public License for more details.                               |
+|                                                                             |
+|  You should have received a copy of the GNU General Public License along    |
+|  with this program; if not, write to the Free Software Foundation, Inc.,    |
+|  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.                |
+\~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+#if ! defined(TREE_SUMMARIZER_HPP)
+#define TREE_SUMMARIZER_HPP
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include "phycas/src/basic_tree.hpp"
+#include "phycas/src/split.hpp"
+
+namespace phycas
+{
+
+class TreeSampleReader;
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Tallies the splits and tree topologies found in a sample of trees (e.g. the trees saved during an MCMC analysis).
+|	For each distinct split, the number of trees containing it, the sum of its edge lengths and (unless the split was 
+|	always associated with a tip) the 1-based indices of the trees in which it was found are recorded. Splits are 
+|	stored with a standard polarity (bit 0 unset) unless the trees are rooted, and are looked up by hashing the words of
+|	their unit vector. A topology is identified by the sorted indices of the splits it contains that are not associated
+|	with tips; for each distinct topology the number of trees, the sum of tree lengths and the indices of the trees 
+|	having that topology are recorded, along with the numbered newick description of the first such tree. Splits and 
+|	topologies are numbered in the order in which they were first encountered.
+*/
+class TreeSummarizer
+	{
+	public:
+										TreeSummarizer(bool rooted_trees);
+
+		void							clear();
+		void							addTree(TreeShPtr t);
+		unsigned						addTreesFromFile(TreeSampleReader & reader, unsigned burnin, TreeShPtr t);
+
+		unsigned						getNumTrees() const;
+		unsigned						getMaxNumTaxa() const;
+
+		unsigned						getNumSplits() const;
+		std::string						getSplitPattern(unsigned i) const;
+		bool							isTrivialSplit(unsigned i) const;
+		unsigned						getSplitCount(unsigned i) const;
+		double							getSplitEdgeLenSum(unsigned i) const;
+		const std::vector<unsigned> &	getSplitSamples(unsigned i) const;
+		unsigned						countSplitSojourns(unsigned i) const;
+		std::vector<double>				calcSplitPosteriorSeries(unsigned i, const std::vector<unsigned> & xvect) const;
+		std::vector<unsigned>			getMajorityRuleSplits() const;
+
+		unsigned						getNumTopologies() const;
+		unsigned						getTopologyCount(unsigned i) const;
+		double							getTopologyTreeLenSum(unsigned i) const;
+		const std::vector<unsigned> &	getTopologySamples(unsigned i) const;
+		const std::vector<unsigned> &	getTopologySplits(unsigned i) const;
+		const std::string &				getTopologyNewick(unsigned i) const;
+		unsigned						countTopologySojourns(unsigned i) const;
+
+	private:
+
+		static unsigned					countSojourns(const std::vector<unsigned> & samples);
+		template <typename T>
+		static boost::uint64_t			hashWords(const std::vector<T> & v);
+		static void						rehash(std::vector<unsigned> & slots, const std::vector<boost::uint64_t> & hashes);
+
+		unsigned						findSplit(const Split & s);
+		unsigned						findTopology(const std::vector<unsigned> & key);
+
+		bool							rooted;				/**< If false, splits having bit 0 set are inverted before being stored */
+		unsigned						num_trees;			/**< The number of trees added */
+		unsigned						max_ntax;			/**< The largest number of observables in any tree added */
+
+		std::vector<Split>				splits;				/**< The distinct splits, in the order first encountered */
+		std::vector<unsigned>			split_counts;		/**< The number of trees containing each split */
+		std::vector<double>				split_edgelens;		/**< The sum of the edge lengths of each split */
+		std::vector< std::vector<unsigned> >	split_samples;	/**< The indices of the trees in which each split was found other than as a tip split */
+		std::vector<boost::uint64_t>	split_hashes;		/**< The hash of each element of `splits' */
+		std::vector<unsigned>			split_slots;		/**< Open-addressing hash table holding indices into `splits' (UINT_MAX marks an empty slot) */
+
+		std::vector< std::vector<unsigned> >	topo_splits;	/**< The sorted indices of the non-tip splits in each distinct topology */
+		std::vector<unsigned>			topo_counts;		/**< The number of trees having each topology */
+		std::vector<double>				topo_treelens;		/**< The sum of the tree lengths of the trees having each topology */
+		std::vector< std::vector<unsigned> >	topo_samples;	/**< The indices of the trees having each topology */
+		std::vector<std::string>		topo_newicks;		/**< The numbered newick description of the first tree having each topology */
+		std::vector<boost::uint64_t>	topo_hashes;		/**< The hash of each element of `topo_splits' */
+		std::vector<unsigned>			topo_slots;			/**< Open-addressing hash table holding indices into `topo_splits' */
+
+		Split							workspace_split;	/**< Workspace used to hold the normalized split of the current node */
+		std::vector<unsigned>			workspace_key;		/**< Workspace used to build the topology key of the current tree */
+	};
+
+typedef boost::shared_ptr<TreeSummarizer> TreeSummarizerShPtr;
+
+} // namespace phycas
+
+#endif
@@ -24,13 +24,22 @@
 #include "phycas/src/states_patterns.hpp"
 #include "phycas/src/cond_likelihood.hpp"
 #include "phycas/src/cond_likelihood_storage.hpp"
+#include "phycas/src/hot_path_timer.hpp"
+#include "phycas/src/cla_kernels.hpp"
 
 namespace phycas
 {
 
 /*----------------------------------------------------------------------------------------------------------------------
 |	Underflow manager for use with TreeLikelihood class that keeps track of underflow correction factors for each data
-|	pattern. It adds a vector the length of	which is the number of site patterns to each CondLikelihood object.
+|	pattern. It adds a vector the length of	which is the number of site patterns to each CondLikelihood object. The
+|	rescaling itself is done by CLAKernels while each block of patterns of a conditional likelihood array is computed;
+|	this class decides (in twoTips and check, called before each array is computed) which kind of rescaling the kernels
+|	are to do, and interprets the corrections afterwards. By default, the correction for a pattern is the (integer) 
+|	natural log of the factor by which its conditional likelihoods have been multiplied, and every pattern is rescaled 
+|	once `underflow_num_edges' edges have been traversed since the last rescaling. If power-of-two scaling is turned on
+|	(see setPowerOfTwoScaling), patterns at risk are rescaled at every node and corrections are base-2 exponents, which
+|	the functions returning corrections convert to natural logs.
 */
 class UnderflowManager
 	{
@@ -39,26 +48,30 @@ class UnderflowManager
 									
 		void 						setTriggerSensitivity(unsigned nedges);
 		void						setCorrectToValue(double maxval);
-		void 						setDimensions(const uint_vect_t & np, const uint_vect_t & nr, const uint_vect_t & ns);
+		void						setPowerOfTwoScaling(bool pow2);
+		bool						isPowerOfTwoScaling() const;
+		void 						setDimensions(const uint_vect_t & np);
 		
 		double                      getUnderflowMaxValue() const;
 		
-		void 						twoTips(CondLikelihood & cond_like) const;
-		void						check(CondLikelihood & cond_like, const CondLikelihood & left_cond_like, const CondLikelihood & right_cond_like, const count_vect_t & counts, bool polytomy) const;
+		CLAKernels::Rescaling		twoTips(CondLikelihood & cond_like) const;
+		CLAKernels::Rescaling		check(CondLikelihood & cond_like, const CondLikelihood & left_cond_like, const CondLikelihood & right_cond_like, bool polytomy) const;
 
 		double						getCorrectionFactor(unsigned pat, ConstCondLikelihoodShPtr condlike_shptr) const;
+		double						getCorrectionFactor(unsigned pat, const CondLikelihood & cond_like) const;
 		double						correctSiteLike(double & site_like, unsigned pat, ConstCondLikelihoodShPtr condlike_shptr) const;
 		void						correctLnLike(double & ln_like, ConstCondLikelihoodShPtr condlike_shptr) const;
 
+		const HotPathCounter &		getCorrectionTiming() const;
+		void						resetCorrectionTiming();
+
 	protected:
 	
-		uint_vect_t					num_rates;				/**< Vector of the number of among-site rate categories for each partition subset */
-		uint_vect_t					num_patterns;			/**< Vector of the number of data patterns for each partition subset */
-		uint_vect_t 				num_states;				/**< Vector of the number of states for each partition subset */
 		unsigned					total_patterns;			/**< The total number of patterns over all partition subsets */
 		unsigned					underflow_num_edges;    /**< Number of edges to traverse before underflow risk is evaluated */
+		bool						power_of_two;			/**< If true, corrections are base-2 exponents rather than natural logs (see setPowerOfTwoScaling) */
 		double						underflow_max_value;    /**< Maximum of the `num_states' conditional likelihoods for a given rate and pattern after underflow correction */
-		mutable std::vector<double>	underflow_work;			/**< Workspace used when correcting for underflow (will have length equal to num_patterns) */
+		mutable HotPathCounter		correction_timing;		/**< The number of conditional likelihood arrays for which check requested kRescaleLog */
 	};
 
 } // namespace phycas
@@ -23,6 +23,34 @@
 namespace phycas
 {
 
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns true if underflow corrections are powers of 2 computed while the conditional likelihood arrays are filled
+|	(see setPowerOfTwoScaling).
+*/
+inline bool UnderflowManager::isPowerOfTwoScaling() const
+	{
+	return power_of_two;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the counter holding the number of conditional likelihood arrays for which check requested rescaling since
+|	construction or the last call to resetCorrectionTiming. The rescaling is done by CLAKernels while each array is 
+|	computed, so no time is recorded separately (it is part of the time spent computing conditional likelihood arrays).
+|	Rescaling done when power-of-two scaling is in effect is not counted.
+*/
+inline const HotPathCounter & UnderflowManager::getCorrectionTiming() const
+	{
+	return correction_timing;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Sets the counter returned by getCorrectionTiming to zero.
+*/
+inline void UnderflowManager::resetCorrectionTiming()
+	{
+	correction_timing.reset();
+	}
+
 } // namespace phycas
 
 #endif
@@ -520,16 +520,21 @@ double UnimapTopoMove::HarvestLnLikeFromCondLikePar(
 #if 1 || DISABLED_UNTIL_UNIMAP_WORKING_WITH_PARTITIONING
 	double lnLikelihood = 0.0;
 	for (unsigned rep = 0; rep < 1; ++rep){
-	LikeFltType * focalNdCLAPtr = focalCondLike->getCLA(); //PELIGROSO
-	PHYCAS_ASSERT(focalNdCLAPtr);
+	// The conditional likelihoods of this subset begin at subset_start, and layout says where those of each pattern lie
+	const CLASubsetLayout & layout = likelihood->getCLALayout(subsetIndex);
+	const unsigned subset_start = likelihood->getCLASubsetStart(subsetIndex);
+	LikeFltType * focalCLA = focalCondLike->getCLA() + subset_start; //PELIGROSO
+	PHYCAS_ASSERT(focalCLA);
 	const unsigned num_patterns = likelihood->getPartitionModel()->getNumPatterns(subsetIndex);
 	const unsigned num_states = likelihood->getNumStates(subsetIndex);
 		// Get state frequencies from model and alias rate category probability array for speed
 	const double * stateFreq = &model->getStateFreqs()[0]; //PELIGROSO
 	
-	const double * focalNeighborCLAPtr = neighborCondLike->getCLA(); //PELIGROSO
+	const LikeFltType * focalNeighborCLA = neighborCondLike->getCLA() + subset_start; //PELIGROSO
 	for (unsigned pat = 0; pat < num_patterns; ++pat)
 		{
+		LikeFltType * focalNdCLAPtr = focalCLA + layout.offset(pat, 0);
+		const LikeFltType * focalNeighborCLAPtr = focalNeighborCLA + layout.offset(pat, 0);
 		double siteLike = 0.0;
 		for (unsigned i = 0; i < num_states; ++i)
 			{
@@ -540,8 +545,6 @@ double UnimapTopoMove::HarvestLnLikeFromCondLikePar(
 			focalNdCLAPtr[i] *= stateFreq[i]*neigborLike;
 			siteLike += focalNdCLAPtr[i];
 			}
-		focalNdCLAPtr += num_states;
-		focalNeighborCLAPtr += num_states;
 		double site_lnL = std::log(siteLike);
 
 		lnLikelihood += site_lnL;
@@ -627,16 +630,18 @@ void UnimapTopoMove::resampleInternalNodeStates(const LikeFltType * root_state_p
 {
 	const UniventProbMgr & upm = likelihood->GetUniventProbMgrConstRef(subsetIndex);
 	Lot & rngRef = *rng;
+	const CLASubsetLayout & layout = likelihood->getCLALayout(subsetIndex);
+	const unsigned subset_start = likelihood->getCLASubsetStart(subsetIndex);
 	
 	TreeNode * aPar = a->GetParent();
 	PHYCAS_ASSERT(aPar && (aPar == origNode || aPar == origNodePar));
 	Univents & ndU = getUniventsRef(*aPar, subsetIndex);
-	upm.sampleRootStates(ndU, root_state_posterior, rngRef, false, NULL);
+	upm.sampleRootStates(ndU, layout, root_state_posterior + subset_start, rngRef, false, NULL);
 	TreeNode * otherInternal = (aPar == origNode ? origNodePar : origNode);
 	PHYCAS_ASSERT(otherInternal);
 	Univents & ndPU = getUniventsRef(*otherInternal, subsetIndex);
 	const int8_t * nd_states = &(ndU.getEndStatesVecConstRef()[0]);
-	upm.sampleDescendantStates(ndPU, (const double **) pre_p_mat[subsetIndex][0], des_cla, nd_states, rngRef);
+	upm.sampleDescendantStates(ndPU, (const double **) pre_p_mat[subsetIndex][0], layout, des_cla + subset_start, nd_states, rngRef);
 	
 	likelihood->flagNodeWithInvalidUnivents(x);
 	getUniventsRef(*x, subsetIndex).setValid(false);
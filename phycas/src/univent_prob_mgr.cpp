@@ -484,12 +484,15 @@ void UniventProbMgr::sampleUniventsImpl(
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
-|	
+|	Samples a state for each site i at a node given the state of its parent (`parent_states'[i]) and stores it in
+|	`nd_states'[i]. The conditional likelihood array `des_cla' points to the first element of the subset, and `layout'
+|	says where the conditional likelihoods of each pattern lie from there (only the first rate category is used).
 */
 void UniventProbMgr::sampleDescendantStatesImpl(
 	const unsigned num_patterns, 
 	int8_t * nd_states, 
 	const double * const * p_mat, 
+	const CLASubsetLayout & layout,
 	const LikeFltType * des_cla, 
 	const int8_t * parent_states,
 	Lot & rng) const
@@ -500,10 +503,11 @@ void UniventProbMgr::sampleDescendantStatesImpl(
 	for (unsigned i = 0 ; i < num_patterns; ++i)
 		{
 		const int8_t par_state = *parent_states++;
+		const LikeFltType * pat_cla = des_cla + layout.offset(i, 0);
 		double total = 0.0;
 		for (unsigned j = 0; j < numStates; ++j)
 			{
-			post_prob[j] =  (*des_cla++)* p_mat[par_state][j];
+			post_prob[j] =  pat_cla[j]* p_mat[par_state][j];
 			total += post_prob[j];
 			}
 		for (unsigned j = 0; j < numStates; ++j)
@@ -515,14 +519,16 @@ void UniventProbMgr::sampleDescendantStatesImpl(
 
 /*----------------------------------------------------------------------------------------------------------------------
 |	Samples a state at the root of the tree for each site i and stores the sample state in `nd_states'[i]. Must provide
-|	the multinomial probabilities in `rootStatePosterior' (this vector is nstates*nsites long). If `rootStatePosterior'
-|	is already normalized, specify true for `posteriors_normalized' to avoid the extra computation associated with
-|	normalization. The `obs_state_counts' array is assumed to be nstates long and will hold total counts of each state
-|	at the root when this function returns.
+|	the multinomial probabilities in `rootStatePosterior', arranged like the conditional likelihoods of a subset as 
+|	described by `layout' (only the first rate category is used). If `rootStatePosterior' is already normalized, 
+|	specify true for `posteriors_normalized' to avoid the extra computation associated with normalization. The 
+|	`obs_state_counts' array is assumed to be nstates long and will hold total counts of each state at the root when 
+|	this function returns.
 */
 void UniventProbMgr::sampleRootStatesImpl(
 	const unsigned num_patterns,
 	int8_t * nd_states,
+	const CLASubsetLayout & layout,
 	const LikeFltType * rootStatePosterior,
 	Lot & rng,
 	bool posteriors_normalized, 
@@ -535,16 +541,24 @@ void UniventProbMgr::sampleRootStatesImpl(
 			obs_state_counts[i] = 0;
 		}
 
+#if defined(PHYCAS_FLOAT_CLA)
+	std::vector<double> post_prob(numStates);	// Lot::MultinomialDraw needs double precision probabilities
+#endif
 	for (unsigned i = 0 ; i < num_patterns; ++i)
 		{
+		const LikeFltType * pat_posterior = rootStatePosterior + layout.offset(i, 0);
 		double total = 1.0;
 		if (!posteriors_normalized)
-			total = std::accumulate(rootStatePosterior, rootStatePosterior + numStates, 0.0); 
-		const int8_t st = rng.MultinomialDraw(rootStatePosterior, numStates, total);
+			total = std::accumulate(pat_posterior, pat_posterior + numStates, 0.0); 
+#if defined(PHYCAS_FLOAT_CLA)
+		std::copy(pat_posterior, pat_posterior + numStates, post_prob.begin());
+		const int8_t st = rng.MultinomialDraw(&post_prob[0], numStates, total);
+#else
+		const int8_t st = rng.MultinomialDraw(pat_posterior, numStates, total);
+#endif
 		nd_states[i] = st;
 		if (obs_state_counts)
 			obs_state_counts[st] += 1;
-		rootStatePosterior += numStates;
 		}
 #endif
 	}
@@ -40,11 +40,11 @@ class UniventProbMgr
 	public:
 		                                    UniventProbMgr(ModelShPtr);
 		
-		void                                sampleDescendantStates(Univents & u, const double * const * p_mat, const LikeFltType * des_cla, const int8_t * parent_states, Lot & rng) const;
-		void                                sampleRootStates(Univents & u, const LikeFltType * rootStatePosterior, Lot & rng, bool posteriors_normalized, unsigned * obs_state_counts = NULL) const;
+		void                                sampleDescendantStates(Univents & u, const double * const * p_mat, const CLASubsetLayout & layout, const LikeFltType * des_cla, const int8_t * parent_states, Lot & rng) const;
+		void                                sampleRootStates(Univents & u, const CLASubsetLayout & layout, const LikeFltType * rootStatePosterior, Lot & rng, bool posteriors_normalized, unsigned * obs_state_counts = NULL) const;
 
-		void                                sampleDescendantStatesImpl(const unsigned num_patterns, int8_t * nd_states, const double * const * p_mat, const LikeFltType * des_cla, const int8_t * parent_states, Lot & rng) const;
-		void                                sampleRootStatesImpl(const unsigned num_patterns, int8_t * nd_states, const LikeFltType * rootStatePosterior, Lot & rng, bool posteriors_normalized,  unsigned * obs_state_counts = NULL) const;
+		void                                sampleDescendantStatesImpl(const unsigned num_patterns, int8_t * nd_states, const double * const * p_mat, const CLASubsetLayout & layout, const LikeFltType * des_cla, const int8_t * parent_states, Lot & rng) const;
+		void                                sampleRootStatesImpl(const unsigned num_patterns, int8_t * nd_states, const CLASubsetLayout & layout, const LikeFltType * rootStatePosterior, Lot & rng, bool posteriors_normalized,  unsigned * obs_state_counts = NULL) const;
 
 		void                                sampleUniventsKeepEndStates(Univents & u, const double edgelen, const int8_t * par_states, const double * * p_mat_transposed, Lot & rng) const;
 		void                                sampleUnivents(Univents & u,  const double edgelen, const int8_t * par_states, const double * const * p_mat, Lot & rng, unsigned ** s_mat) const;
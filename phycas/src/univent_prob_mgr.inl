@@ -26,21 +26,21 @@ namespace phycas
 /*----------------------------------------------------------------------------------------------------------------------
 |	
 */
-inline void UniventProbMgr::sampleDescendantStates(Univents & u, const double * const * p_mat, const LikeFltType * des_cla, const int8_t * parent_states, Lot & rng) const
+inline void UniventProbMgr::sampleDescendantStates(Univents & u, const double * const * p_mat, const CLASubsetLayout & layout, const LikeFltType * des_cla, const int8_t * parent_states, Lot & rng) const
 	{
 	PHYCAS_ASSERT(u.size() == u.end_states_vec.size());
 	u.setValid(false);
-	sampleDescendantStatesImpl(u.size(), &u.end_states_vec[0], p_mat, des_cla, parent_states, rng);
+	sampleDescendantStatesImpl(u.size(), &u.end_states_vec[0], p_mat, layout, des_cla, parent_states, rng);
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
 |	
 */
-inline void UniventProbMgr::sampleRootStates(Univents & u, const LikeFltType * rootStatePosterior, Lot & rng, bool posteriors_normalized, unsigned * obs_state_counts) const
+inline void UniventProbMgr::sampleRootStates(Univents & u, const CLASubsetLayout & layout, const LikeFltType * rootStatePosterior, Lot & rng, bool posteriors_normalized, unsigned * obs_state_counts) const
 	{
 	PHYCAS_ASSERT(u.size() == u.end_states_vec.size());
 	u.setValid(false);
-	sampleRootStatesImpl(u.size(), &u.end_states_vec[0], rootStatePosterior, rng, posteriors_normalized, obs_state_counts);
+	sampleRootStatesImpl(u.size(), &u.end_states_vec[0], layout, rootStatePosterior, rng, posteriors_normalized, obs_state_counts);
 	}
 
 /*----------------------------------------------------------------------------------------------------------------------
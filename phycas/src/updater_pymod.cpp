@@ -31,6 +31,7 @@
 #include "phycas/src/unimap_nni_move.hpp"
 #include "phycas/src/unimap_fast_nni_move.hpp"
 #include "phycas/src/tree_scaler_move.hpp"
+#include "phycas/src/edgelen_hmc_move.hpp"
 #include "phycas/src/dirichlet_move.hpp"
 #include "phycas/src/bush_move.hpp"
 #include "phycas/src/edge_move.hpp"
@@ -59,6 +60,7 @@ void updater_pymod()
 		.def("recalcWorkingPrior", &MCMCUpdater::recalcWorkingPrior)
 		.def("educateWorkingPrior", &MCMCUpdater::educateWorkingPrior)
 		.def("finalizeWorkingPrior", &MCMCUpdater::finalizeWorkingPrior)
+		.def("copyWorkingPriorSample", &MCMCUpdater::copyWorkingPriorSample)
 		.def("getWorkingPriorDescr", &MCMCUpdater::getWorkingPriorDescr)
 		.def("sampleWorkingPrior", &MCMCUpdater::sampleWorkingPrior)
 		.def("sampleMultivariateWorkingPrior", &MCMCUpdater::sampleMultivariateWorkingPrior)
@@ -67,8 +69,10 @@ void updater_pymod()
 		.def("getName", &MCMCUpdater::getName, return_value_policy<copy_const_reference>())
 		.def("getPriorDescr", &MCMCUpdater::getPriorDescr)
 		.def("getWeight", &MCMCUpdater::getWeight)
+		.def("getBaseWeight", &MCMCUpdater::getBaseWeight)
 		.def("setName", &MCMCUpdater::setName)
 		.def("setWeight", &MCMCUpdater::setWeight)
+		.def("scaleWeight", &MCMCUpdater::scaleWeight)
 		.def("setPosteriorTuningParam", &MCMCUpdater::setPosteriorTuningParam)
 		.def("setPriorTuningParam", &MCMCUpdater::setPriorTuningParam)
 		.def("setBoldness", &MCMCUpdater::setBoldness)
@@ -89,7 +93,12 @@ void updater_pymod()
 		.def("getNumAttempts", &MCMCUpdater::getNumAttempts)
 		.def("getNumAccepts", &MCMCUpdater::getNumAccepts)
 		.def("resetDiagnostics", &MCMCUpdater::resetDiagnostics)
+		.def("getNumTimedUpdates", &MCMCUpdater::getNumTimedUpdates)
+		.def("getTimedUpdateSeconds", &MCMCUpdater::getTimedUpdateSeconds)
+		.def("getTimedUpdateLikelihoodEvals", &MCMCUpdater::getTimedUpdateLikelihoodEvals)
+		.def("resetTimedUpdateStats", &MCMCUpdater::resetTimedUpdateStats)
 		.def("update", &MCMCUpdater::update)
+		.def("timedUpdate", &MCMCUpdater::timedUpdate)
 		.def("isFixed", &MCMCUpdater::isFixed)
 		.def("fixParameter", &MCMCUpdater::fixParameter)
 		.def("freeParameter", &MCMCUpdater::freeParameter)
@@ -139,6 +148,15 @@ void updater_pymod()
 		boost::noncopyable, boost::shared_ptr<phycas::TreeScalerMove> >("TreeScalerMove") 
 		.def("update", &phycas::TreeScalerMove::update)
 		;
+	class_<phycas::EdgeLenHMCMove, bases<phycas::MCMCUpdater>, 
+		boost::noncopyable, boost::shared_ptr<phycas::EdgeLenHMCMove> >("EdgeLenHMCMove") 
+		.def("update", &phycas::EdgeLenHMCMove::update)
+		.def("setNumLeapfrogSteps", &phycas::EdgeLenHMCMove::setNumLeapfrogSteps)
+		.def("getNumLeapfrogSteps", &phycas::EdgeLenHMCMove::getNumLeapfrogSteps)
+		.def("getStepSize", &phycas::EdgeLenHMCMove::getStepSize)
+		.def("setAdapting", &phycas::EdgeLenHMCMove::setAdapting)
+		.def("isAdapting", &phycas::EdgeLenHMCMove::isAdapting)
+		;
 	class_<phycas::DirichletMove, bases<phycas::MCMCUpdater>, 
 		boost::noncopyable, boost::shared_ptr<phycas::DirichletMove> >("DirichletMove") 
 		.def("setDimension", &phycas::DirichletMove::setDimension)
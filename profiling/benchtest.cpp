@@ -0,0 +1,534 @@
+// Times the core likelihood calculations (calcLnL, refreshCLA, calcPMat and pattern compression) and one update by
+// each MCMCUpdater over a grid of data sets simulated with SimData, then writes median and percentile timings,
+// likelihood evaluations per second and the memory used by conditional likelihood arrays (CLAs) as JSON.
+//
+// Usage: benchtest [--taxa=10,100] [--sites=1000,10000] [--states=4] [--rates=1,4] [--partitioned=0,1]
+//                  [--reps=20] [--threads=1] [--seed=13579] [--separate-edgelens] [--out=benchtest.json]
+//
+// The taxa, sites, states, rates and partitioned options each take a comma-separated list, and every combination
+// is run. The defaults finish in a minute or two; the full grid is
+//
+//   benchtest --taxa=10,100,1000,5000 --sites=1000,10000,100000,1000000 --states=2,4,61 --rates=1,4,8 --partitioned=0,1
+//
+// The number of states chooses the model: 2 (Binary), 4 (HKY) or 61 (Codon, in which case sites counts nucleotide
+// sites, so sites/3 codons are simulated). Phycas has no 20-state (amino acid) model, so 20 is rejected. Partitioned
+// data sets divide the sites evenly between two subsets, each having its own copy of the model. By default the MCMC
+// updaters are those of an ordinary run (a Larget-Simon move plus the model parameters); --separate-edgelens instead
+// gives every edge its own slice-sampled edge length parameter, as happens when the topology is fixed.
+//
+// Each timing is summarized by the number of samples, the median and the 10th and 90th percentiles (microseconds per
+// call). Calls too fast to time individually are timed in batches and each batch contributes one sample (the mean
+// time per call in that batch).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/format.hpp>
+#include <boost/cstdint.hpp>
+#include "phycas/src/basic_tree.hpp"
+#include "phycas/src/tree_manip.hpp"
+#include "phycas/src/tree_likelihood.hpp"
+#include "phycas/src/likelihood_models.hpp"
+#include "phycas/src/codon_model.hpp"
+#include "phycas/src/partition_model.hpp"
+#include "phycas/src/internal_data.hpp"
+#include "phycas/src/sim_data.hpp"
+#include "phycas/src/larget_simon_move.hpp"
+#include "phycas/src/mcmc_chain_manager.hpp"
+#include "phycas/src/probability_distribution.hpp"
+
+using namespace phycas;
+
+typedef boost::shared_ptr<LargetSimonMove> LargetSimonMoveShPtr;
+typedef boost::shared_ptr<MCMCChainManager> MCMCChainManagerShPtr;
+typedef boost::shared_ptr<TreeLikelihood> TreeLikelihoodShPtr;
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Measures elapsed wall-clock time with microsecond resolution.
+*/
+class BenchClock
+	{
+	public:
+		BenchClock() {start();}
+
+		void	start()				{t0 = boost::posix_time::microsec_clock::universal_time();}
+		double	elapsedSeconds()	{return 1.0e-6*(double)(boost::posix_time::microsec_clock::universal_time() - t0).total_microseconds();}
+
+	private:
+		boost::posix_time::ptime	t0;		/**< is the time at which start was last called */
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Collects the times taken by repeated calls of one operation, along with the number of likelihood evaluations those
+|	calls performed.
+*/
+class BenchTiming
+	{
+	public:
+		BenchTiming() : ncalls(0), nevals(0), total_seconds(0.0) {}
+
+		void addBatch(double seconds, unsigned calls, unsigned evals)
+			{
+			if (calls == 0)
+				return;
+			samples.push_back(seconds/(double)calls);
+			ncalls += calls;
+			nevals += evals;
+			total_seconds += seconds;
+			}
+
+		double percentile(double p) const
+			{
+			if (samples.empty())
+				return 0.0;
+			std::vector<double> v(samples);
+			std::sort(v.begin(), v.end());
+			double x = p*(double)(v.size() - 1);
+			unsigned i = (unsigned)std::floor(x);
+			if (i + 1 >= v.size())
+				return v.back();
+			return v[i] + (x - (double)i)*(v[i + 1] - v[i]);
+			}
+
+		std::vector<double>	samples;		/**< is the mean time per call (seconds) of each timed batch */
+		unsigned			ncalls;			/**< is the total number of calls timed */
+		unsigned			nevals;			/**< is the total number of likelihood evaluations performed by those calls */
+		double				total_seconds;	/**< is the total time taken by all calls */
+	};
+
+typedef std::vector< std::pair<std::string, BenchTiming> > BenchTimingVect;
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Describes one simulated data set in the benchmark grid.
+*/
+struct BenchSpec
+	{
+	unsigned	ntax;			/**< is the number of taxa */
+	unsigned	nsites;			/**< is the number of (nucleotide) sites */
+	unsigned	nstates;		/**< is the number of states (2, 4 or 61) */
+	unsigned	nrates;			/**< is the number of discrete gamma rate categories */
+	bool		partitioned;	/**< is true if the sites are divided between two subsets */
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Settings that apply to every data set in the grid.
+*/
+struct BenchSettings
+	{
+	BenchSettings() : reps(20), nthreads(1), seed(13579), separate_edgelens(false), outfile("benchtest.json") {}
+
+	unsigned	reps;				/**< is the number of samples taken of each timing */
+	unsigned	nthreads;			/**< is the number of threads used by TreeLikelihood */
+	unsigned	seed;				/**< is the pseudorandom number seed */
+	bool		separate_edgelens;	/**< if true, each edge length is updated by its own slice sampler */
+	std::string	outfile;			/**< is the name of the JSON file to write */
+	};
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Parses a comma-separated list of unsigned integers, exiting with a message if any element is not a number.
+*/
+std::vector<unsigned> parseList(const std::string & opt, const std::string & s)
+	{
+	std::vector<unsigned> v;
+	std::istringstream in(s);
+	std::string item;
+	while (std::getline(in, item, ','))
+		{
+		char * end = NULL;
+		unsigned long x = std::strtoul(item.c_str(), &end, 10);
+		if (item.empty() || *end != '\0')
+			{
+			std::cerr << "benchtest: bad value \"" << item << "\" for " << opt << std::endl;
+			std::exit(1);
+			}
+		v.push_back((unsigned)x);
+		}
+	return v;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Creates the substitution model for one subset of `spec', giving a prior to every parameter that an MCMC analysis
+|	would update.
+*/
+ModelShPtr createModel(const BenchSpec & spec, LotShPtr lot, ProbDistShPtr edgelen_prior)
+	{
+	ProbDistShPtr kappa_prior(new ExponentialDistribution(1.0));
+	kappa_prior->SetLot(lot.get());
+
+	ModelShPtr m;
+	if (spec.nstates == 2)
+		m.reset(new Binary());
+	else if (spec.nstates == 4)
+		{
+		HKYShPtr hky(new HKY());
+		hky->setKappa(4.0);
+		hky->setKappaPrior(kappa_prior);
+		hky->freeKappa();
+		hky->setNucleotideFreqs(0.1, 0.2, 0.3, 0.4);
+		ProbDistShPtr freq_prior(new ExponentialDistribution(1.0));
+		freq_prior->SetLot(lot.get());
+		hky->setStateFreqParamPrior(freq_prior);
+		hky->freeStateFreqs();
+		m = hky;
+		}
+	else
+		{
+		// State frequencies stay fixed: slice sampling all 61 of them would swamp the other updaters
+		CodonShPtr codon(new Codon());
+		codon->setKappa(4.0);
+		codon->setKappaPrior(kappa_prior);
+		codon->freeKappa();
+		codon->setOmega(0.2);
+		ProbDistShPtr omega_prior(new ExponentialDistribution(5.0));
+		omega_prior->SetLot(lot.get());
+		codon->setOmegaPrior(omega_prior);
+		codon->freeOmega();
+		codon->setAllFreqsEqual();
+		ProbDistShPtr freq_prior(new ExponentialDistribution(1.0));
+		freq_prior->SetLot(lot.get());
+		codon->setStateFreqParamPrior(freq_prior);
+		codon->fixStateFreqs();
+		m = codon;
+		}
+
+	m->setNGammaRates(spec.nrates);
+	if (spec.nrates > 1)
+		{
+		m->setShape(0.5);
+		ProbDistShPtr shape_prior(new ExponentialDistribution(1.0));
+		shape_prior->SetLot(lot.get());
+		m->setDiscreteGammaShapePrior(shape_prior);
+		m->setPriorOnShapeInverse(false);
+		m->freeShape();
+		}
+	m->setNotPinvarModel();
+	m->setInternalEdgeLenPrior(edgelen_prior);
+	m->setExternalEdgeLenPrior(edgelen_prior);
+	return m;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Adds the timings in `timings' to `out' as a JSON array of objects.
+*/
+void writeTimings(std::ostream & out, const BenchTimingVect & timings, const char * indent)
+	{
+	out << "[";
+	for (BenchTimingVect::const_iterator it = timings.begin(); it != timings.end(); ++it)
+		{
+		const BenchTiming & t = it->second;
+		double evals_per_sec = (t.total_seconds > 0.0 ? (double)t.nevals/t.total_seconds : 0.0);
+		out << (it == timings.begin() ? "\n" : ",\n") << indent;
+		out << boost::str(boost::format("{\"name\": \"%s\", \"samples\": %d, \"calls\": %d, \"median_us\": %.3f, \"p10_us\": %.3f, \"p90_us\": %.3f, \"evals\": %d, \"evals_per_sec\": %.1f}")
+			% it->first % t.samples.size() % t.ncalls % (1.0e6*t.percentile(0.5)) % (1.0e6*t.percentile(0.1)) % (1.0e6*t.percentile(0.9)) % t.nevals % evals_per_sec);
+		}
+	out << "]";
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Returns the name under which the timings of updater `name' are pooled: per-edge and per-subset updaters (whose
+|	names differ only in a trailing number) are pooled together.
+*/
+std::string updaterGroupName(std::string name)
+	{
+	std::string::size_type n = name.find_last_not_of("0123456789");
+	if (n != std::string::npos && n + 1 < name.size())
+		{
+		name.erase(n + 1);
+		if (!name.empty() && name[name.size() - 1] == '_')
+			name.erase(name.size() - 1);
+		}
+	return name;
+	}
+
+/*----------------------------------------------------------------------------------------------------------------------
+|	Simulates the data set described by `spec', times each operation `settings.reps' times and writes the results to
+|	`out' as a JSON object.
+*/
+void runDataSet(std::ostream & out, const BenchSpec & spec, const BenchSettings & settings)
+	{
+	LotShPtr lot(new Lot());
+	lot->SetSeed(settings.seed);
+
+	ProbDistShPtr edgelen_prior(new ExponentialDistribution(10.0));
+	edgelen_prior->SetLot(lot.get());
+
+	// For codon models each simulated character is a codon
+	const bool codon = (spec.nstates == 61);
+	const unsigned nchar = (codon ? spec.nsites/3 : spec.nsites);
+	const unsigned nsubsets = (spec.partitioned ? 2 : 1);
+
+	PartitionModelShPtr partition_model(new PartitionModel());
+	std::vector<ModelShPtr> models;
+	for (unsigned i = 0; i < nsubsets; ++i)
+		{
+		models.push_back(createModel(spec, lot, edgelen_prior));
+		partition_model->addModel(models.back());
+		}
+	std::vector<unsigned> site_assignments(nchar, 0);
+	std::vector<unsigned> subset_sizes(nsubsets, nchar);
+	if (spec.partitioned)
+		{
+		std::fill(site_assignments.begin() + nchar/2, site_assignments.end(), 1);
+		subset_sizes[0] = nchar/2;
+		subset_sizes[1] = nchar - nchar/2;
+		}
+	partition_model->setSiteAssignments(site_assignments);
+	partition_model->setNumSitesVect(subset_sizes);
+
+	TreeLikelihoodShPtr likelihood(new TreeLikelihood(partition_model));
+	likelihood->setLot(lot);
+	likelihood->setNumThreads(settings.nthreads);
+
+	TreeShPtr t(new Tree());
+	TreeManip tree_manip(t);
+	tree_manip.equiprobTree(spec.ntax, lot, edgelen_prior, edgelen_prior);
+
+	// Simulate the data
+	SimDataShPtr sim_data(new SimData());
+	likelihood->prepareForSimulation(t);
+	likelihood->simulateFirst(sim_data, t, lot, nchar);
+
+	BenchTimingVect timings;
+	BenchClock clock;
+
+	// Compression of the simulated sites into patterns (the PatternTable path shared with compressDataMatrix)
+	timings.push_back(std::make_pair(std::string("compressPatterns"), BenchTiming()));
+	for (unsigned rep = 0; rep < settings.reps; ++rep)
+		{
+		clock.start();
+		likelihood->copyDataFromSimData(sim_data);
+		timings.back().second.addBatch(clock.elapsedSeconds(), 1, 0);
+		}
+	sim_data.reset();
+	likelihood->prepareForLikelihood(t);
+	const unsigned npatterns = likelihood->getNumPatterns();
+
+	// Full likelihood calculations: every CLA is recalculated
+	timings.push_back(std::make_pair(std::string("calcLnL_full"), BenchTiming()));
+	for (unsigned rep = 0; rep < settings.reps; ++rep)
+		{
+		likelihood->useAsLikelihoodRoot(NULL);
+		unsigned nevals = likelihood->getNumLikelihoodEvals();
+		clock.start();
+		likelihood->calcLnL(t);
+		double secs = clock.elapsedSeconds();
+		timings.back().second.addBatch(secs, 1, likelihood->getNumLikelihoodEvals() - nevals);
+		}
+
+	// Likelihood calculations in which every CLA is already valid, so only the likelihood root is harvested
+	timings.push_back(std::make_pair(std::string("calcLnL_cached"), BenchTiming()));
+	for (unsigned rep = 0; rep < settings.reps; ++rep)
+		{
+		unsigned nevals = likelihood->getNumLikelihoodEvals();
+		clock.start();
+		likelihood->calcLnL(t);
+		double secs = clock.elapsedSeconds();
+		timings.back().second.addBatch(secs, 1, likelihood->getNumLikelihoodEvals() - nevals);
+		}
+
+	// Each batch refreshes the CLA (toward the likelihood root) of every internal node other than the subroot
+	std::vector<TreeNode *> internals;
+	for (preorder_iterator nd = t->begin(); nd != t->end(); ++nd)
+		{
+		if (!nd->IsTip() && !nd->IsSubroot())
+			internals.push_back(&(*nd));
+		}
+	timings.push_back(std::make_pair(std::string("refreshCLA"), BenchTiming()));
+	for (unsigned rep = 0; rep < settings.reps && !internals.empty(); ++rep)
+		{
+		clock.start();
+		for (std::vector<TreeNode *>::iterator nd = internals.begin(); nd != internals.end(); ++nd)
+			likelihood->refreshCLA(**nd, (*nd)->GetParent());
+		timings.back().second.addBatch(clock.elapsedSeconds(), (unsigned)internals.size(), 0);
+		}
+
+	// Each batch calculates 100 sets of transition matrices (one per rate category) for random edge lengths
+	const unsigned pmat_batch = 100;
+	std::vector<double> edgelens(pmat_batch);
+	timings.push_back(std::make_pair(std::string("calcPMat"), BenchTiming()));
+	if (!internals.empty())
+		{
+		InternalData * nd_data = internals.front()->GetInternalData();
+		for (unsigned rep = 0; rep < settings.reps; ++rep)
+			{
+			for (unsigned k = 0; k < pmat_batch; ++k)
+				edgelens[k] = 0.01 + 0.2*lot->Uniform(FILE_AND_LINE);
+			clock.start();
+			for (unsigned k = 0; k < pmat_batch; ++k)
+				likelihood->calcPMat(k % nsubsets, nd_data->getPMatrices(k % nsubsets), edgelens[k]);
+			timings.back().second.addBatch(clock.elapsedSeconds(), pmat_batch, 0);
+			}
+		}
+
+	// One update by each updater per cycle, pooled by updater name
+	MCMCChainManagerShPtr mcmc(new MCMCChainManager());
+	for (unsigned i = 0; i < nsubsets; ++i)
+		{
+		models[i]->setEdgeSpecificParams(settings.separate_edgelens);
+		mcmc->addMCMCUpdaters(models[i], t, likelihood, lot, 1000, 1, (nsubsets == 1 ? -1 : (int)i));
+		}
+	if (!settings.separate_edgelens)
+		{
+		LargetSimonMoveShPtr lsmove(new LargetSimonMove());
+		lsmove->setName("larget_simon_local");
+		lsmove->setWeight(1);
+		lsmove->setTree(t);
+		lsmove->setModel(models[0]);
+		lsmove->setTreeLikelihood(likelihood);
+		lsmove->setLot(lot);
+		lsmove->setLambda(0.2);
+		mcmc->addMove(lsmove);
+		}
+	mcmc->finalize();
+	likelihood->recalcRelativeRates();
+	mcmc->refreshLastLnLike();
+
+	const MCMCUpdaterVect & all_updaters = mcmc->getAllUpdaters();
+	for (MCMCUpdaterVect::const_iterator p = all_updaters.begin(); p != all_updaters.end(); ++p)
+		{
+		(*p)->setPower(1.0);
+		(*p)->setBoldness(0.0);
+		(*p)->setStandardHeating();
+		}
+
+	BenchTimingVect updater_timings;
+	std::map<std::string, unsigned> updater_index;
+	for (unsigned rep = 0; rep < settings.reps; ++rep)
+		{
+		for (MCMCUpdaterVect::const_iterator p = all_updaters.begin(); p != all_updaters.end(); ++p)
+			{
+			if ((*p)->isFixed())
+				continue;
+			std::string name = updaterGroupName((*p)->getName());
+			std::map<std::string, unsigned>::iterator found = updater_index.find(name);
+			if (found == updater_index.end())
+				{
+				found = updater_index.insert(std::make_pair(name, (unsigned)updater_timings.size())).first;
+				updater_timings.push_back(std::make_pair(name, BenchTiming()));
+				}
+			unsigned nevals = likelihood->getNumLikelihoodEvals();
+			clock.start();
+			(*p)->update();
+			double secs = clock.elapsedSeconds();
+			updater_timings[found->second].second.addBatch(secs, 1, likelihood->getNumLikelihoodEvals() - nevals);
+			}
+		}
+
+	out << boost::str(boost::format("    {\"taxa\": %d, \"sites\": %d, \"states\": %d, \"rates\": %d, \"partitioned\": %s, \"subsets\": %d, \"patterns\": %d,\n")
+		% spec.ntax % spec.nsites % spec.nstates % spec.nrates % (spec.partitioned ? "true" : "false") % nsubsets % npatterns);
+	out << boost::str(boost::format("     \"cla_bytes\": %d, \"bytes_per_cla\": %d, \"clas_created\": %d, \"clas_stored\": %d,\n")
+		% ((boost::uint64_t)likelihood->bytesPerCLA()*likelihood->numCLAsCreated()) % likelihood->bytesPerCLA() % likelihood->numCLAsCreated() % likelihood->numCLAsStored());
+	out << "     \"timings\": ";
+	writeTimings(out, timings, "      ");
+	out << ",\n     \"updaters\": ";
+	writeTimings(out, updater_timings, "      ");
+	out << "}";
+
+	mcmc->releaseUpdaters();
+	for (std::vector<ModelShPtr>::iterator m = models.begin(); m != models.end(); ++m)
+		(*m)->releaseUpdaters();
+	}
+
+int main(int argc, char * argv[])
+	{
+	std::vector<unsigned> taxa(1, 10);
+	taxa.push_back(100);
+	std::vector<unsigned> sites(1, 1000);
+	sites.push_back(10000);
+	std::vector<unsigned> states(1, 4);
+	std::vector<unsigned> rates(1, 1);
+	rates.push_back(4);
+	std::vector<unsigned> partitioned(1, 0);
+	partitioned.push_back(1);
+	BenchSettings settings;
+
+	for (int i = 1; i < argc; ++i)
+		{
+		std::string arg(argv[i]);
+		std::string::size_type eq = arg.find('=');
+		std::string opt = arg.substr(0, eq);
+		std::string val = (eq == std::string::npos ? std::string() : arg.substr(eq + 1));
+		if (opt == "--taxa")
+			taxa = parseList(opt, val);
+		else if (opt == "--sites")
+			sites = parseList(opt, val);
+		else if (opt == "--states")
+			states = parseList(opt, val);
+		else if (opt == "--rates")
+			rates = parseList(opt, val);
+		else if (opt == "--partitioned")
+			partitioned = parseList(opt, val);
+		else if (opt == "--reps")
+			settings.reps = parseList(opt, val).at(0);
+		else if (opt == "--threads")
+			settings.nthreads = parseList(opt, val).at(0);
+		else if (opt == "--seed")
+			settings.seed = parseList(opt, val).at(0);
+		else if (opt == "--separate-edgelens")
+			settings.separate_edgelens = true;
+		else if (opt == "--out")
+			settings.outfile = val;
+		else
+			{
+			std::cerr << "benchtest: unknown option " << arg << std::endl;
+			return 1;
+			}
+		}
+
+	for (std::vector<unsigned>::const_iterator s = states.begin(); s != states.end(); ++s)
+		{
+		if (*s != 2 && *s != 4 && *s != 61)
+			{
+			std::cerr << "benchtest: " << *s << " states not supported (phycas models have 2, 4 or 61 states)" << std::endl;
+			return 1;
+			}
+		}
+	for (std::vector<unsigned>::const_iterator t = taxa.begin(); t != taxa.end(); ++t)
+		{
+		if (*t < 4)
+			{
+			std::cerr << "benchtest: at least 4 taxa are needed" << std::endl;
+			return 1;
+			}
+		}
+
+	std::ofstream out(settings.outfile.c_str());
+	if (!out)
+		{
+		std::cerr << "benchtest: could not create " << settings.outfile << std::endl;
+		return 1;
+		}
+	out << "{\"reps\": " << settings.reps << ", \"threads\": " << settings.nthreads << ", \"seed\": " << settings.seed;
+	out << ", \"separate_edgelens\": " << (settings.separate_edgelens ? "true" : "false") << ",\n \"datasets\": [\n";
+
+	bool first = true;
+	for (std::vector<unsigned>::const_iterator s = states.begin(); s != states.end(); ++s)
+		for (std::vector<unsigned>::const_iterator r = rates.begin(); r != rates.end(); ++r)
+			for (std::vector<unsigned>::const_iterator p = partitioned.begin(); p != partitioned.end(); ++p)
+				for (std::vector<unsigned>::const_iterator n = sites.begin(); n != sites.end(); ++n)
+					for (std::vector<unsigned>::const_iterator t = taxa.begin(); t != taxa.end(); ++t)
+						{
+						BenchSpec spec;
+						spec.ntax = *t;
+						spec.nsites = *n;
+						spec.nstates = *s;
+						spec.nrates = *r;
+						spec.partitioned = (*p != 0);
+						std::cerr << boost::str(boost::format("taxa=%d sites=%d states=%d rates=%d partitioned=%d") % spec.ntax % spec.nsites % spec.nstates % spec.nrates % *p) << std::endl;
+						if (!first)
+							out << ",\n";
+						first = false;
+						runDataSet(out, spec, settings);
+						out.flush();
+						}
+	out << "\n ]}" << std::endl;
+	out.close();
+	return 0;
+	}